@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+#
+# Compare two micro-benchmark result files produced by "make bench-run".
+#
+# Each file holds one JSON object per line, as written by the bench library
+# (src/lib/bench). Cases are matched by suite and case name; the median time
+# per operation (ns_p50) and the allocations per operation are compared.
+#
+# Usage: bench_compare.py [--threshold PCT] baseline.json results.json
+#
+# Exits with 1 if any case got slower than the threshold (default 10%) or
+# allocates more than in the baseline.
+#
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    results = {}
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line:
+                continue
+            r = json.loads(line)
+            results[(r["suite"], r["case"])] = r
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare micro-benchmark results")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="regression threshold on the median time, in percent")
+    parser.add_argument("baseline")
+    parser.add_argument("results")
+    args = parser.parse_args()
+
+    base = load(args.baseline)
+    new = load(args.results)
+
+    regressions = 0
+    print("%-48s %12s %12s %8s %10s %10s" %
+          ("case", "base p50", "new p50", "delta", "base alloc", "new alloc"))
+    for key in sorted(set(base) | set(new)):
+        name = "%s/%s" % key
+        if key not in base or key not in new:
+            print("%-48s %s" % (name, "only in " + ("results" if key in new else "baseline")))
+            continue
+
+        b = base[key]
+        n = new[key]
+        delta = 0.0
+        if b["ns_p50"] > 0:
+            delta = (n["ns_p50"] - b["ns_p50"]) * 100.0 / b["ns_p50"]
+
+        mark = ""
+        if delta > args.threshold:
+            mark = " SLOWER"
+        if b["allocs"] >= 0 and n["allocs"] > b["allocs"]:
+            mark += " ALLOCS"
+        if mark:
+            regressions += 1
+
+        print("%-48s %10.1fns %10.1fns %+7.1f%% %10.3f %10.3f%s" %
+              (name, b["ns_p50"], n["ns_p50"], delta, b["allocs"], n["allocs"], mark))
+
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
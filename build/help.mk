@@ -42,6 +42,9 @@ help:
 	$(NQ) "   unit-list                 List ALL active units"
 	$(NQ) "   unit-run                  Build and exectutes ALL active units"
 	$(NQ) "   unit-coverage             Build, execute and provide coverage (requires CC=clang-6.0)"
+	$(NQ) "   bench-all                 Build ALL active micro-benchmarks (BENCH_BIN units)"
+	$(NQ) "   bench-run                 Build and execute ALL micro-benchmarks, results in BENCH_RESULTS"
+	$(NQ) "   bench-compare             Compare BENCH_RESULTS against BENCH_BASELINE"
 	$(NQ) ""
 	$(NQ) "   UNIT_PATH/clean           Clean a single UNIT"
 	$(NQ) "   UNIT_PATH/rclean          Clean a single UNIT and its dependencies"
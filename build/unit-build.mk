@@ -43,6 +43,12 @@ TESTBINDIR = $(BINDIR)/utest
 $(TESTBINDIR): | $(WORKDIRS)
 	$(Q)$(MKDIR) $(@)
 
+# Create directory to store micro-benchmark binaries and results
+BENCHBINDIR = $(BINDIR)/bench
+
+$(BENCHBINDIR): | $(WORKDIRS)
+	$(Q)$(MKDIR) $(@)
+
 ##########################################################
 # Append LOCAL_CFLAGS, which can be used to add
 # developer C flags to the target's CFLAGS.
@@ -147,6 +153,39 @@ $(call UNIT_MAKE_CLEAN,$(TESTBINDIR)/$(UNIT_BIN))
 $(call UNIT_C_RULES)
 endef
 
+##########################################################
+# Definition of a "BENCH_BIN" type unit
+##########################################################
+define UNIT_BUILD_BENCH_BIN
+# Add the unit to the global list of units
+UNIT_ALL += $(UNIT_PATH)
+UNIT_ALL_INSTALL += $(UNIT_PATH)/install
+UNIT_ALL_CLEAN += $(UNIT_PATH)/clean
+UNIT_ALL_BENCH_BIN_UNITS += $(UNIT_PATH)
+UNIT_ALL_BENCH_BIN_FILES += $(BENCHBINDIR)/$(UNIT_BIN)/bench
+UNIT_DIRS += $(BENCHBINDIR)/$(UNIT_BIN)
+UNIT_GOALS_$(UNIT_PATH) += $(BENCHBINDIR)/$(UNIT_BIN)/bench
+
+$(call UNIT_MAKE_RULES)
+
+$(UNIT_BUILD)/.target: $(BENCHBINDIR)/$(UNIT_BIN)/bench
+
+# Same naming convention as TEST_BIN: $(UNIT_BIN)/bench
+$(BENCHBINDIR)/$(UNIT_BIN): | $(BENCHBINDIR)
+
+$(BENCHBINDIR)/$(UNIT_BIN)/bench: $(UNIT_OBJ) $(UNIT_ALL_DEPS)
+	$$(NQ) " $(call color_link,link)    [$$(call COLOR_BOLD,$(UNIT_BIN))] $$@"
+	$$(Q)$$(CC) -L$(LIBDIR) -Wl,--start-group $$(UNIT_BIN_LDFLAGS) $$(foreach DEP,$$(sort $$(DEPS_$(UNIT_PATH))),$$(LDFLAGS_$$(DEP))) $(UNIT_OBJ) -Wl,--end-group $$(OS_LDFLAGS) $(UNIT_LDFLAGS) -o $$@
+
+$(UNIT_PATH)/install: $(UNIT_BUILD)/.target
+	$$(Q)true
+
+$$(eval $$(call UNIT_MAKE_DIRS))
+$$(eval $$(call UNIT_MAKE_INFO))
+$(call UNIT_MAKE_CLEAN,$(BENCHBINDIR)/$(UNIT_BIN))
+$(call UNIT_C_RULES)
+endef
+
 ##########################################################
 # Definition of a "LIB" type unit
 ##########################################################
@@ -705,12 +744,41 @@ $(TESTBINDIR)/clean:
 	$(NQ) " $(call color_clean,clean)   [$(call COLOR_BOLD,$(notdir $(TESTBINDIR)))] $(TESTBINDIR)"
 	$(Q)$(RM) -r $(TESTBINDIR)
 
+$(BENCHBINDIR)/clean:
+	$(NQ) " $(call color_clean,clean)   [$(call COLOR_BOLD,$(notdir $(BENCHBINDIR)))] $(BENCHBINDIR)"
+	$(Q)$(RM) -r $(BENCHBINDIR)
+
 unit-all: workdirs $(UNIT_ALL)
 unit-bin: workdirs $(UNIT_ALL_BIN_UNITS)
 unit-install: $(UNIT_ALL_INSTALL)
-unit-clean: $(UNIT_ALL_CLEAN) $(TESTBINDIR)/clean
+unit-clean: $(UNIT_ALL_CLEAN) $(TESTBINDIR)/clean $(BENCHBINDIR)/clean
 unit-info: $(foreach UNIT,$(sort $(UNIT_ALL)),$(UNIT)/info)
 
+##########################################################
+# Micro-benchmarks
+##########################################################
+# bench-run appends the results of all BENCH_BIN units, one JSON object per
+# line, to $(BENCH_RESULTS). BENCH_ARGS is passed to every benchmark binary.
+# bench-compare compares $(BENCH_RESULTS) against a previous run saved in
+# $(BENCH_BASELINE).
+BENCH_RESULTS ?= $(BENCHBINDIR)/results.json
+BENCH_BASELINE ?= $(BENCHBINDIR)/baseline.json
+BENCH_ARGS ?=
+
+.PHONY: bench-all bench-run bench-compare
+bench-all: workdirs $(UNIT_ALL_BENCH_BIN_UNITS)
+
+bench-run: bench-all
+	$(NQ) " $(call color_external,Running) $(call COLOR_BOLD,all benchmarks) -> $(BENCH_RESULTS)"
+	$(Q)$(RM) $(BENCH_RESULTS); \
+	for bench in $(UNIT_ALL_BENCH_BIN_FILES); do \
+	    echo "   $(call color_external,Executing) $$(basename $$(dirname $$bench))"; \
+	    LD_LIBRARY_PATH=${LIBDIR} $$bench $(BENCH_ARGS) -o $(BENCH_RESULTS) || exit 1; \
+	done
+
+bench-compare:
+	$(Q)build/bench_compare.py $(BENCH_BASELINE) $(BENCH_RESULTS)
+
 ##########################################################
 # Targets to allow for code coverage calculation
 ##########################################################
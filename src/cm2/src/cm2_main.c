@@ -36,6 +36,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <ev.h>
 #include <syslog.h>
 #include <getopt.h>
+#include <inttypes.h>
 
 #include "ds_tree.h"
 #include "log.h"
@@ -43,6 +44,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "os.h"
 #include "os_socket.h"
 #include "ovsdb.h"
+#include "ovsdb_cache.h"
 #include "evext.h"
 #include "os_backtrace.h"
 #include "json_util.h"
@@ -50,6 +52,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "kconfig.h"
 #include "cm2.h"
 #include "cm2_uplink_event.h"
+#include "procfs_sample.h"
 
 /******************************************************************************/
 
@@ -68,31 +71,13 @@ static log_severity_t   cm2_log_severity = LOG_SEVERITY_INFO;
 
 static void dump_proc_mem_usage(void)
 {
-    char fname[128] = {};
-    char line[1024] = {};
+    struct procfs_pid_status ps;
     int pid = getpid();
-    int vmrss = 0;
-    int vmsize = 0;
-
-    snprintf(fname, sizeof(fname), "/proc/%d/status", pid);
-
-    FILE *file = fopen(fname, "r");
-    if (file) {
-
-        while (fgets(line, sizeof(line), file)) {
-            if (strstr(line, "VmRSS:"))
-            {
-                vmrss = atoi(line + strlen("VmRSS: "));
-            }
-            else if (strstr(line, "VmSize:"))
-            {
-                 vmsize = atoi(line + strlen("VmSize: "));
-            }
-        }
-
-        fclose(file);
-        LOGI("pid %d: mem usage: real mem: %d, virt mem %d\n", pid, vmrss, vmsize);
+
+    if (procfs_pid_status_get(pid, &ps)) {
+        LOGI("pid %d: mem usage: real mem: %"PRIu64", virt mem %"PRIu64"\n", pid, ps.ps_vm_rss, ps.ps_vm_size);
     }
+    ovsdb_cache_mem_report();
     return;
 }
 
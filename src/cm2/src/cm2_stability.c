@@ -34,6 +34,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "cm2_stability.h"
 #include "ds_tree.h"
 #include "cm2_uplink_event.h"
+#include "procfs_sample.h"
 
 
 #include "os_time.h"
@@ -98,43 +99,19 @@ bool cm2_vtag_stability_check(void) {
 }
 
 static bool cm2_cpu_is_low_loadavg(void) {
-    char   line[128];
-    bool   retval;
-    char   *s_val;
-    float  val;
-    FILE   *f1;
+    struct procfs_loadavg la;
 
-    f1 = NULL;
-    retval = false;
-
-    f1 = popen("cat /proc/loadavg", "r");
-    if (!f1) {
-        LOGE("Failed to retrieve loadavg command");
-        return retval;
-    }
-
-    if (fgets(line, sizeof(line), f1) == NULL) {
+    if (!procfs_loadavg_get(&la)) {
         LOGW("No loadavg found");
-        goto error;
+        return false;
     }
 
-    while (line[strlen(line) - 1] == '\r' || line[strlen(line) - 1] == '\n') {
-        line[strlen(line) - 1] = '\0';
-
-        s_val=strtok(line," ");
-        val = atof(s_val);
-
-        if (val > atof(CONFIG_CM2_STABILITY_THRESH_CPU)) {
-            LOGI("Skip stability check due to high CPU usage, load avg: %f", val);
-            break;
-        }
-        retval = true;
+    if (la.la_one > atof(CONFIG_CM2_STABILITY_THRESH_CPU)) {
+        LOGI("Skip stability check due to high CPU usage, load avg: %f", la.la_one);
+        return false;
     }
 
-    error:
-        pclose(f1);
-
-    return retval;
+    return true;
 }
 
 #ifdef CONFIG_CM2_STABILITY_USE_RESTORE_SWITCH_CFG
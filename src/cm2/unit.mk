@@ -89,3 +89,4 @@ UNIT_DEPS += src/lib/timevt
 UNIT_DEPS += src/lib/os_fdbuf
 UNIT_DEPS += src/lib/ff
 UNIT_DEPS += src/lib/ovsdb_bridge
+UNIT_DEPS += src/lib/procfs
@@ -52,6 +52,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "os_backtrace.h"
 #include "util.h"
 #include "os.h"
+#include "procfs_sample.h"
 
 #include "dm.h"
 
@@ -65,28 +66,12 @@ struct dm_chkmem
 
 static void proc_get_mem_usage(struct dm_chkmem *mu)
 {
-    char fname[128] = {};
-    char line[1024] = {};
+    struct procfs_pid_status ps;
 
-    SPRINTF(fname, "/proc/%d/status", mu->pid);
+    if (!procfs_pid_status_get(mu->pid, &ps)) return;
 
-    FILE *file = fopen(fname, "r");
-    if (file)
-    {
-        while (fgets(line, sizeof(line), file))
-        {
-            if (strstr(line, "VmRSS:"))
-            {
-                mu->vmrss = atoi(line + strlen("VmRSS: "));
-            }
-            else if (strstr(line, "VmSize:"))
-            {
-                mu->vmsize = atoi(line + strlen("VmSize: "));
-            }
-        }
-
-        fclose(file);
-    }
+    mu->vmrss = ps.ps_vm_rss;
+    mu->vmsize = ps.ps_vm_size;
 }
 
 int chkmem_check_pss(int pid, char *pname, int memmax, int memmax_cnt, int *highest, int *cnt)
@@ -75,5 +75,6 @@ UNIT_DEPS += src/lib/evx
 UNIT_DEPS += src/lib/pasync
 UNIT_DEPS += $(if $(CONFIG_REVSSH_ENABLED), src/lib/revssh)
 UNIT_DEPS += src/lib/reboot_flags
+UNIT_DEPS += src/lib/procfs
 
 UNIT_DEPS_CFLAGS += src/lib/version
@@ -38,6 +38,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "fcm_mgr.h"
 #include "log.h"
 #include "neigh_table.h"
+#include "ovsdb_cache.h"
 
 // Intervals and timeouts in seconds
 #define FCM_TIMER_INTERVAL   5
@@ -70,6 +71,7 @@ fcm_event_cb(struct ev_loop *loop, ev_timer *watcher, int revents)
     fcm_get_memory(&mem);
     LOGI("%s: pid %s: mem usage: real mem: %u, virt mem %u", __func__,
          mgr->pid, mem.curr_real_mem, mem.curr_virt_mem);
+    ovsdb_cache_mem_report();
 
     reset = ((uint64_t)mem.curr_real_mem > mgr->max_mem);
 
@@ -0,0 +1,45 @@
+# Copyright (c) 2015, Plume Design Inc. All rights reserved.
+# 
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#    1. Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#    2. Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#    3. Neither the name of the Plume Design Inc. nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+##############################################################################
+#
+# FSM core sources, shared by fsm, its unit tests and fsm_replay
+# (paths relative to src/fsm/src)
+#
+##############################################################################
+FSM_CORE_SRC := fsm_ovsdb.c
+FSM_CORE_SRC += fsm_event.c
+FSM_CORE_SRC += fsm_service.c
+FSM_CORE_SRC += fsm_dpi.c
+FSM_CORE_SRC += fsm_dpi_stream.c
+FSM_CORE_SRC += fsm_dpi_verdict.c
+FSM_CORE_SRC += fsm_perf.c
+FSM_CORE_SRC += fsm_oms.c
+FSM_CORE_SRC += fsm_internal.c
+FSM_CORE_SRC += fsm_dpi_client.c
+FSM_CORE_SRC += fsm_nfqueues.c
+FSM_CORE_SRC += fsm_raw.c
+FSM_CORE_SRC += $(if $(CONFIG_FSM_DPI_SOCKET), fsm_dispatch_listener.c)
+FSM_CORE_SRC += $(if $(CONFIG_FSM_TAP_INTF), fsm_pcap.c, fsm_pcap_stubs.c)
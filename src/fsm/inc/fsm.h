@@ -35,11 +35,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <time.h>
 
 #include "ds_tree.h"
+#include "fsm_perf.h"
 #include "fsm_policy.h"
 #include "net_header_parse.h"
 #include "network_metadata_report.h"
 #include "os_types.h"
 #include "ovsdb_utils.h"
+#include "policy_tags.h"
 #include "schema.h"
 #include "ovsdb_update.h"
 
@@ -200,6 +202,15 @@ struct fsm_dpi_plugin_ops
     void (*unregister_clients)(struct fsm_session *);
     void (*mark_flow)(struct fsm_session *, struct net_md_stats_accumulator *);
     void (*dpi_free_resources)(struct fsm_session *);
+    /*
+     * Optional. Receives the reassembled bytes of tcp flows in place of
+     * handler: net_parser->data points to the contiguous stream bytes of
+     * the packet's direction, from the start of the stream, and
+     * packet_len accounts for them. Called when new contiguous bytes are
+     * available. The handler is called instead when the flow can not be
+     * reassembled.
+     */
+    void (*stream_handler)(struct fsm_session *, struct net_header_parser *);
 };
 
 
@@ -366,6 +377,8 @@ struct fsm_dpi_dispatcher
     time_t periodic_backoff_ts;
     char *included_devices;
     char *excluded_devices;
+    struct om_tag_handle included_tag;  /* included_devices, if a tag */
+    struct om_tag_handle excluded_tag;  /* excluded_devices, if a tag */
     char *listening_ip;
     char *listening_port;
     int recv_method;
@@ -381,10 +394,13 @@ struct fsm_dpi_plugin
     struct fsm_session *session;
     char *targets;
     char *excluded_targets;
+    struct om_tag_handle targets_tag;   /* targets, if a tag */
+    struct om_tag_handle excluded_tag;  /* excluded_targets, if a tag */
     bool bound;
     bool clients_init;
     ds_tree_t dpi_clients;
     ds_tree_node_t dpi_node;
+    struct fsm_perf_hist perf;  /* packet handler latency */
 };
 
 /**
@@ -408,6 +424,37 @@ struct fsm_dpi_flow_info
 };
 
 
+/**
+ * @brief a dpi plugin slot of a flow's dispatch array
+ */
+struct fsm_dpi_plugin_slot
+{
+    struct fsm_dpi_flow_info *info;   /* the flow's plugin decision */
+    struct fsm_session *session;      /* the dpi plugin session */
+    struct fsm_dpi_plugin_ops *ops;   /* the dpi plugin handlers */
+    bool process;                     /* flow macs match the plugin targets */
+};
+
+
+/**
+ * @brief flat per flow array of the dpi plugins a packet is dispatched to
+ *
+ * Built from the flow's dpi_plugins tree on the first packet, with the
+ * targeted/excluded devices verdict of each plugin precomputed for the
+ * flow's mac addresses. Rebuilt when the flow's plugins, the plugins'
+ * targets, or the tags they refer to change.
+ */
+struct fsm_dpi_plugin_slots
+{
+    uint32_t gen;                     /* generation the slots were built at */
+    int num_slots;
+    bool has_stream;                  /* a plugin provides a stream handler */
+    bool has_mac[2];
+    os_macaddr_t macs[2];             /* the mac addresses of the flow */
+    struct fsm_dpi_plugin_slot slots[];
+};
+
+
 struct fsm_forward_context
 {
     bool initialized;
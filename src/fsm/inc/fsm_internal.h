@@ -233,6 +233,17 @@ fsm_dpi_unregister_client(struct fsm_session *dpi_plugin_session,
                           struct fsm_session *dpi_client_session,
                           char *attr);
 
+/**
+ * @brief initialize a plugin
+ *
+ * @param session the session to initialize
+ * @return true if successful, false otherwise
+ *
+ * Loads the plugin (dso or static table) and calls its init routine
+ */
+bool
+fsm_init_plugin(struct fsm_session *session);
+
 /**
  * @brief wrap plugin initialization
  *
@@ -338,6 +349,264 @@ fsm_dpi_should_process(struct net_header_parser *net_parser,
                        char *included_targets,
                        char *excluded_targets);
 
+
+/**
+ * @brief invalidate the per flow dpi plugin slots
+ *
+ * Flows rebuild their dispatch array on their next packet.
+ * To be called when the dpi plugins or their targets change.
+ */
+void
+fsm_dpi_invalidate_plugin_slots(void);
+
+
+#define FSM_TCP_STREAM_OOO_MAX 8
+
+/**
+ * @brief a received out of order segment, as offsets in the stream buffer
+ */
+struct fsm_tcp_stream_range
+{
+    uint32_t start;
+    uint32_t end;
+};
+
+
+/**
+ * @brief one direction of a reassembled tcp stream
+ *
+ * Bytes are stored at their offset from the first sequence number in
+ * a pooled buffer, so out of order segments land in place and only
+ * their boundaries need to be tracked.
+ */
+struct fsm_tcp_stream_dir
+{
+    bool init;
+    bool closed;                      /* no longer reassembled */
+    uint32_t isn;                     /* sequence number of buf[0] */
+    uint8_t *buf;
+    size_t len;                       /* contiguous bytes */
+    size_t delivered;                 /* contiguous bytes seen by the plugins */
+    int num_ooo;
+    struct fsm_tcp_stream_range ooo[FSM_TCP_STREAM_OOO_MAX];
+};
+
+
+/**
+ * @brief per flow tcp stream reassembly context
+ */
+struct fsm_tcp_stream
+{
+    bool released;                    /* buffers returned to the pool */
+    uint16_t sport;                   /* source port of direction 0 */
+    uint16_t dport;                   /* destination port of direction 0 */
+    int ip_version;
+    uint8_t saddr[16];                /* source address of direction 0 */
+    struct fsm_tcp_stream_dir dirs[2];
+};
+
+
+/**
+ * @brief tcp stream reassembly memory usage
+ */
+struct fsm_tcp_stream_stats
+{
+    size_t mem_used;                  /* bytes of stream buffers in use */
+    size_t mem_max;                   /* global cap */
+    size_t buf_size;                  /* per flow and direction cap */
+    int pooled;                       /* buffers available for reuse */
+    uint64_t alloc_failures;          /* streams refused due to the global cap */
+};
+
+
+/**
+ * @brief adds a tcp segment to a stream direction
+ *
+ * @param stream the flow's stream context
+ * @param dir the direction (0 or 1)
+ * @param seq the segment's sequence number
+ * @param syn the segment's SYN flag
+ * @param data the segment's payload
+ * @param len the payload length
+ * @return true if the stream is still reassembled in this direction,
+ *         false if the plugins should fall back to the packet payload
+ */
+bool
+fsm_tcp_stream_add(struct fsm_tcp_stream *stream, int dir, uint32_t seq,
+                   bool syn, const uint8_t *data, size_t len);
+
+
+/**
+ * @brief adds the packet's tcp segment to the flow's stream
+ *
+ * Allocates the flow's stream context on the first call.
+ * @param acc the flow accumulator
+ * @param net_parser the parsed packet
+ * @return the stream direction of the packet, NULL if not reassembled
+ */
+struct fsm_tcp_stream_dir *
+fsm_tcp_stream_process(struct net_md_stats_accumulator *acc,
+                       struct net_header_parser *net_parser);
+
+
+/**
+ * @brief returns the flow's stream buffers to the pool
+ *
+ * The flow is no longer reassembled afterwards.
+ * @param acc the flow accumulator
+ */
+void
+fsm_tcp_stream_release(struct net_md_stats_accumulator *acc);
+
+
+/**
+ * @brief frees the flow's stream context
+ *
+ * @param acc the flow accumulator
+ */
+void
+fsm_tcp_stream_free(struct net_md_stats_accumulator *acc);
+
+
+/**
+ * @brief retrieves the stream reassembly memory usage
+ *
+ * @param stats the stats to fill
+ */
+void
+fsm_tcp_stream_get_stats(struct fsm_tcp_stream_stats *stats);
+
+
+/**
+ * @brief frees the pooled stream buffers
+ */
+void
+fsm_tcp_stream_pool_flush(void);
+
+/**
+ * @brief 5-tuple of a flow verdict
+ */
+struct fsm_dpi_verdict_key
+{
+    uint8_t ip_version;
+    uint8_t ipprotocol;
+    uint16_t sport;                   /* Network byte order */
+    uint16_t dport;                   /* Network byte order */
+    int16_t vlan_id;
+    uint8_t src_ip[16];
+    uint8_t dst_ip[16];
+};
+
+
+/**
+ * @brief flows verdicts snapshot counters
+ */
+struct fsm_dpi_verdict_stats
+{
+    uint64_t loaded;                  /* verdicts loaded from the snapshot */
+    uint64_t restored;                /* verdicts resumed by a flow */
+    uint64_t mismatches;              /* verdicts contradicted by conntrack */
+    uint64_t expired;                 /* verdicts never claimed by a flow */
+    uint32_t saved;                   /* verdicts in the last snapshot */
+};
+
+
+/**
+ * @brief builds the verdict key of a flow
+ *
+ * @param fkey the flow key
+ * @param key the verdict key to fill
+ * @return false if the flow is not an IP flow
+ */
+bool
+fsm_dpi_verdict_get_key(struct net_md_flow_key *fkey,
+                        struct fsm_dpi_verdict_key *key);
+
+
+/**
+ * @brief adds a decided flow to the verdicts snapshot
+ *
+ * @param acc the flow accumulator
+ */
+void
+fsm_dpi_verdict_record(struct net_md_stats_accumulator *acc);
+
+
+/**
+ * @brief removes a flow from the verdicts snapshot
+ *
+ * @param acc the flow accumulator
+ */
+void
+fsm_dpi_verdict_forget(struct net_md_stats_accumulator *acc);
+
+
+/**
+ * @brief resumes the verdict of a new flow from the loaded snapshot
+ *
+ * For queued packets, the verdict is only resumed if the conntrack mark
+ * still matches it.
+ * @param acc the flow accumulator
+ * @param net_parser the flow's first packet since the restart
+ * @return true if the flow's verdict was restored
+ */
+bool
+fsm_dpi_verdict_restore(struct net_md_stats_accumulator *acc,
+                        struct net_header_parser *net_parser);
+
+
+/**
+ * @brief writes the flows verdicts snapshot
+ *
+ * @param path the snapshot path
+ * @return true if successful
+ */
+bool
+fsm_dpi_verdict_save(const char *path);
+
+
+/**
+ * @brief loads a flows verdicts snapshot
+ *
+ * Snapshots taken before the last reboot are ignored.
+ * @param path the snapshot path
+ * @return true if successful
+ */
+bool
+fsm_dpi_verdict_load(const char *path);
+
+
+/**
+ * @brief refreshes the snapshot and expires the unclaimed verdicts
+ *
+ * @param now the current time
+ */
+void
+fsm_dpi_verdict_periodic(time_t now);
+
+
+/**
+ * @brief loads the snapshot left by the previous FSM instance
+ */
+void
+fsm_dpi_verdict_init(void);
+
+
+/**
+ * @brief saves the snapshot and releases the verdicts
+ */
+void
+fsm_dpi_verdict_exit(void);
+
+
+/**
+ * @brief retrieves the flows verdicts snapshot counters
+ *
+ * @param stats the counters to fill
+ */
+void
+fsm_dpi_verdict_get_stats(struct fsm_dpi_verdict_stats *stats);
+
 void
 fsm_pcap_dispatcher_handler(void *context,
                             struct net_header_parser *net_parser);
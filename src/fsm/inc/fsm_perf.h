@@ -0,0 +1,185 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef FSM_PERF_H_INCLUDED
+#define FSM_PERF_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <ev.h>
+
+/**
+ * FSM packet path instrumentation
+ *
+ * Per stage counters and log2 latency histograms of the packet path, plus
+ * one histogram per dpi plugin. The instrumentation is always compiled in
+ * and enabled at runtime through the dpi dispatcher's other_config
+ * (perf_stats=true). When disabled, a probe costs a load and a branch.
+ *
+ * The stats are dumped to the log on SIGUSR1 and, when FSM talks osbus,
+ * exported through the perf_stats method.
+ */
+
+/* Bucket i counts the samples in [2^i, 2^(i+1)) ns, the last one is open */
+#define FSM_PERF_HIST_BUCKETS 32
+
+enum fsm_perf_stage
+{
+    FSM_PERF_PARSE = 0,     /* network headers parsing */
+    FSM_PERF_FLOW,          /* conntrack and flow accumulator lookup */
+    FSM_PERF_DISPATCH,      /* plugin slots lookup and plugin handlers */
+    FSM_PERF_VERDICT,       /* flow mark and verdict programming */
+    FSM_PERF_PACKET,        /* whole dpi dispatcher packet handler */
+    FSM_PERF_NUM_STAGES,
+};
+
+struct fsm_perf_hist
+{
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t buckets[FSM_PERF_HIST_BUCKETS];
+};
+
+extern bool g_fsm_perf_enabled;
+extern struct fsm_perf_hist g_fsm_perf_stages[FSM_PERF_NUM_STAGES];
+
+struct fsm_session;
+
+/**
+ * @brief starts timing a probe
+ *
+ * @return the current monotonic time in ns, 0 if the instrumentation is
+ *         disabled
+ */
+static inline uint64_t
+fsm_perf_start(void)
+{
+    struct timespec now;
+
+    if (__builtin_expect(!g_fsm_perf_enabled, 1)) return 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000ULL) + now.tv_nsec;
+}
+
+/**
+ * @brief adds a latency sample to a histogram
+ *
+ * @param hist the histogram to update
+ * @param ns the sample in ns
+ */
+void
+fsm_perf_hist_add(struct fsm_perf_hist *hist, uint64_t ns);
+
+/**
+ * @brief ends timing a probe started by fsm_perf_start()
+ *
+ * @param hist the histogram accounting the probe
+ * @param start the value returned by fsm_perf_start()
+ */
+void
+fsm_perf_hist_end(struct fsm_perf_hist *hist, uint64_t start);
+
+/**
+ * @brief ends timing a packet path stage
+ *
+ * @param stage the stage to account
+ * @param start the value returned by fsm_perf_start()
+ */
+static inline void
+fsm_perf_stage_end(enum fsm_perf_stage stage, uint64_t start)
+{
+    if (start == 0) return;
+    fsm_perf_hist_end(&g_fsm_perf_stages[stage], start);
+}
+
+void
+fsm_perf_plugin_add(struct fsm_session *session, uint64_t start);
+
+/**
+ * @brief ends timing a dpi plugin handler
+ *
+ * @param session the dpi plugin session
+ * @param start the value returned by fsm_perf_start()
+ */
+static inline void
+fsm_perf_plugin_end(struct fsm_session *session, uint64_t start)
+{
+    if (start == 0) return;
+    fsm_perf_plugin_add(session, start);
+}
+
+/**
+ * @brief returns the name of a stage
+ */
+const char *
+fsm_perf_stage_name(enum fsm_perf_stage stage);
+
+/**
+ * @brief returns the stats of a stage
+ */
+const struct fsm_perf_hist *
+fsm_perf_stage_get(enum fsm_perf_stage stage);
+
+/**
+ * @brief enables or disables the instrumentation
+ *
+ * Enabling it after it was disabled starts from cleared stats.
+ * @param enable the requested state
+ */
+void
+fsm_perf_set_enabled(bool enable);
+
+/**
+ * @brief clears the stage and plugin stats
+ */
+void
+fsm_perf_reset(void);
+
+/**
+ * @brief logs the stage and plugin stats
+ */
+void
+fsm_perf_dump(void);
+
+/**
+ * @brief installs the SIGUSR1 dump handler
+ *
+ * @param loop the FSM event loop
+ */
+void
+fsm_perf_init(struct ev_loop *loop);
+
+/**
+ * @brief stops the SIGUSR1 dump handler and the osbus export
+ */
+void
+fsm_perf_exit(void);
+
+#endif /* FSM_PERF_H_INCLUDED */
@@ -0,0 +1,686 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * Offline replay of a pcap file through the FSM packet path.
+ *
+ * The capture is loaded in memory, then each packet goes through
+ * net_header_parse(), the dpi dispatcher (flow accumulators, plugin slots,
+ * tcp stream reassembly) and the configured dpi plugins. Verdicts are
+ * collected by a stub mark backend instead of conntrack or nfqueue.
+ *
+ * Reports the throughput, the average time spent per stage and the number
+ * of heap allocations per packet. With -H, the latency histograms of the
+ * FSM packet path instrumentation (fsm_perf) are reported as well.
+ *
+ * Example:
+ *   fsm_replay -r capture.pcap -n 10 \
+ *       -p dpi_dns -p dpi_sni \
+ *       -p walleye_dpi:signature_store=/tmp/app_signatures
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <pcap.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <ev.h>
+
+#include "bench.h"
+#include "fsm.h"
+#include "fsm_fn_trace.h"
+#include "fsm_internal.h"
+#include "fsm_perf.h"
+#include "fsm_policy.h"
+#include "log.h"
+#include "memutil.h"
+#include "net_header_parse.h"
+#include "network_metadata_report.h"
+#include "network_metadata_utils.h"
+#include "os.h"
+#include "schema.h"
+#include "target.h"
+
+#define MODULE_ID LOG_MODULE_ID_MAIN
+
+#define FSM_REPLAY_DISPATCHER "replay_dispatcher"
+#define FSM_REPLAY_MAX_PLUGINS 8
+
+struct fsm_replay_pkt
+{
+    uint8_t *data;
+    uint32_t caplen;
+};
+
+struct fsm_replay_stage
+{
+    uint64_t ns;
+    uint64_t allocs;
+};
+
+struct fsm_replay_plugin
+{
+    struct schema_Flow_Service_Manager_Config conf;
+    struct fsm_session *session;
+    void (*handler)(struct fsm_session *, struct net_header_parser *);
+    void (*stream_handler)(struct fsm_session *, struct net_header_parser *);
+    struct fsm_replay_stage stage;
+};
+
+struct fsm_replay_mgr
+{
+    struct fsm_replay_pkt *pkts;
+    size_t num_pkts;
+    uint64_t num_bytes;
+    int datalink;
+    struct schema_Flow_Service_Manager_Config dispatcher_conf;
+    struct fsm_session *dispatcher;
+    struct fsm_replay_plugin plugins[FSM_REPLAY_MAX_PLUGINS];
+    size_t num_plugins;
+    struct fsm_replay_stage parse;
+    struct fsm_replay_stage dispatch;
+    uint64_t parse_errors;
+    uint64_t marks;
+    uint64_t passthru;
+    uint64_t drops;
+};
+
+static struct fsm_replay_mgr g_replay;
+
+
+/******************************************************************************
+ *  Stage accounting
+ *****************************************************************************/
+
+static inline uint64_t
+fsm_replay_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static inline void
+fsm_replay_stage_add(struct fsm_replay_stage *stage, uint64_t start_ns,
+                     uint64_t start_allocs)
+{
+    stage->ns += fsm_replay_now_ns() - start_ns;
+    stage->allocs += bench_alloc_count() - start_allocs;
+}
+
+
+static struct fsm_replay_plugin *
+fsm_replay_plugin_lookup(struct fsm_session *session)
+{
+    size_t i;
+
+    for (i = 0; i < g_replay.num_plugins; i++)
+    {
+        if (g_replay.plugins[i].session == session) return &g_replay.plugins[i];
+    }
+
+    return NULL;
+}
+
+
+/**
+ * @brief times a dpi plugin packet handler
+ */
+static void
+fsm_replay_plugin_handler(struct fsm_session *session,
+                          struct net_header_parser *net_parser)
+{
+    struct fsm_replay_plugin *plugin;
+    uint64_t allocs;
+    uint64_t start;
+
+    plugin = fsm_replay_plugin_lookup(session);
+    if (plugin == NULL) return;
+
+    allocs = bench_alloc_count();
+    start = fsm_replay_now_ns();
+    plugin->handler(session, net_parser);
+    fsm_replay_stage_add(&plugin->stage, start, allocs);
+}
+
+
+/**
+ * @brief times a dpi plugin tcp stream handler
+ */
+static void
+fsm_replay_plugin_stream_handler(struct fsm_session *session,
+                                 struct net_header_parser *net_parser)
+{
+    struct fsm_replay_plugin *plugin;
+    uint64_t allocs;
+    uint64_t start;
+
+    plugin = fsm_replay_plugin_lookup(session);
+    if (plugin == NULL) return;
+
+    allocs = bench_alloc_count();
+    start = fsm_replay_now_ns();
+    plugin->stream_handler(session, net_parser);
+    fsm_replay_stage_add(&plugin->stage, start, allocs);
+}
+
+
+/******************************************************************************
+ *  Stub backends
+ *****************************************************************************/
+
+/**
+ * @brief records the verdict in place of the conntrack/nfqueue backends
+ */
+static int
+fsm_replay_set_dpi_mark(struct net_header_parser *net_parser,
+                        struct dpi_mark_policy *mark_policy)
+{
+    struct net_md_stats_accumulator *acc;
+
+    g_replay.marks++;
+
+    acc = net_parser->acc;
+    if (acc == NULL) return 0;
+
+    if (acc->dpi_done == FSM_DPI_PASSTHRU) g_replay.passthru++;
+    if (acc->dpi_done == FSM_DPI_DROP) g_replay.drops++;
+
+    return 0;
+}
+
+
+static bool
+fsm_replay_update_session_tap(struct fsm_session *session)
+{
+    session->tap_type = fsm_session_tap_mode(session);
+    session->set_dpi_mark = fsm_replay_set_dpi_mark;
+
+    return true;
+}
+
+
+static int
+fsm_replay_get_br(char *if_name, char *bridge, size_t len)
+{
+    strscpy(bridge, "br-home", len);
+
+    return 0;
+}
+
+
+static bool
+fsm_replay_send_report(struct net_md_aggregator *aggr, char *mqtt_topic)
+{
+    if (aggr == NULL) return false;
+
+    aggr->held_flows = 0;
+    net_md_reset_aggregator(aggr);
+
+    return true;
+}
+
+
+/******************************************************************************
+ *  Setup
+ *****************************************************************************/
+
+/**
+ * @brief adds a dpi plugin from a "handler[:key=value[,key=value]]" spec
+ */
+static bool
+fsm_replay_add_plugin_conf(char *spec)
+{
+    struct schema_Flow_Service_Manager_Config *conf;
+    struct fsm_replay_plugin *plugin;
+    char *options;
+    char *value;
+    char *key;
+
+    if (g_replay.num_plugins >= FSM_REPLAY_MAX_PLUGINS)
+    {
+        LOGE("%s: too many plugins, max %d", __func__, FSM_REPLAY_MAX_PLUGINS);
+        return false;
+    }
+
+    plugin = &g_replay.plugins[g_replay.num_plugins];
+    conf = &plugin->conf;
+    MEMZERO(*conf);
+
+    options = strchr(spec, ':');
+    if (options != NULL) *options++ = '\0';
+
+    SCHEMA_SET_STR(conf->handler, spec);
+    SCHEMA_SET_STR(conf->type, "dpi_plugin");
+    SCHEMA_KEY_VAL_APPEND(conf->other_config, "dpi_dispatcher", FSM_REPLAY_DISPATCHER);
+
+    while (options != NULL && (key = strsep(&options, ",")) != NULL)
+    {
+        value = strchr(key, '=');
+        if (value == NULL)
+        {
+            LOGE("%s: %s: invalid option %s", __func__, spec, key);
+            return false;
+        }
+        *value++ = '\0';
+
+        /* plugin= overrides the dso path, all others go to other_config */
+        if (!strcmp(key, "plugin"))
+        {
+            SCHEMA_SET_STR(conf->plugin, value);
+            continue;
+        }
+        SCHEMA_KEY_VAL_APPEND(conf->other_config, key, value);
+    }
+
+    g_replay.num_plugins++;
+
+    return true;
+}
+
+
+static bool
+fsm_replay_init_sessions(void)
+{
+    struct schema_Flow_Service_Manager_Config *conf;
+    struct fsm_dpi_plugin_ops *dpi_plugin_ops;
+    union fsm_dpi_context *dpi_context;
+    struct fsm_replay_plugin *plugin;
+    struct fsm_mgr *mgr;
+    ds_tree_t *sessions;
+    size_t i;
+
+    fsm_init_mgr(EV_DEFAULT);
+    mgr = fsm_get_mgr();
+    mgr->init_plugin = fsm_init_plugin;
+    mgr->get_br = fsm_replay_get_br;
+    mgr->update_session_tap = fsm_replay_update_session_tap;
+    fsm_init_manager();
+
+    sessions = fsm_get_sessions();
+
+    for (i = 0; i < g_replay.num_plugins; i++)
+    {
+        plugin = &g_replay.plugins[i];
+        fsm_add_session(&plugin->conf);
+        plugin->session = ds_tree_find(sessions, plugin->conf.handler);
+        if (plugin->session == NULL)
+        {
+            LOGE("%s: could not load plugin %s", __func__, plugin->conf.handler);
+            return false;
+        }
+
+        /* Time the plugin handlers */
+        dpi_plugin_ops = &plugin->session->p_ops->dpi_plugin_ops;
+        plugin->handler = dpi_plugin_ops->handler;
+        plugin->stream_handler = dpi_plugin_ops->stream_handler;
+        if (plugin->handler != NULL) dpi_plugin_ops->handler = fsm_replay_plugin_handler;
+        if (plugin->stream_handler != NULL) dpi_plugin_ops->stream_handler = fsm_replay_plugin_stream_handler;
+    }
+
+    conf = &g_replay.dispatcher_conf;
+    MEMZERO(*conf);
+    SCHEMA_SET_STR(conf->handler, FSM_REPLAY_DISPATCHER);
+    SCHEMA_SET_STR(conf->type, "dpi_dispatcher");
+    fsm_add_session(conf);
+
+    g_replay.dispatcher = ds_tree_find(sessions, FSM_REPLAY_DISPATCHER);
+    if (g_replay.dispatcher == NULL)
+    {
+        LOGE("%s: could not create the dpi dispatcher", __func__);
+        return false;
+    }
+
+    dpi_context = g_replay.dispatcher->dpi;
+    if (dpi_context == NULL) return false;
+    dpi_context->dispatch.aggr->send_report = fsm_replay_send_report;
+
+    return true;
+}
+
+
+/**
+ * @brief loads all packets of the capture in memory
+ */
+static bool
+fsm_replay_load_pcap(const char *path)
+{
+    char errbuf[PCAP_ERRBUF_SIZE];
+    struct pcap_pkthdr *header;
+    struct fsm_replay_pkt *pkt;
+    const uint8_t *bytes;
+    size_t size;
+    pcap_t *pcap;
+    int rc;
+
+    pcap = pcap_open_offline(path, errbuf);
+    if (pcap == NULL)
+    {
+        LOGE("%s: %s: %s", __func__, path, errbuf);
+        return false;
+    }
+
+    g_replay.datalink = pcap_datalink(pcap);
+
+    size = 0;
+    while ((rc = pcap_next_ex(pcap, &header, &bytes)) == 1)
+    {
+        if (header->caplen == 0) continue;
+
+        if (g_replay.num_pkts == size)
+        {
+            size = (size == 0) ? 1024 : size * 2;
+            g_replay.pkts = REALLOC(g_replay.pkts, size * sizeof(*g_replay.pkts));
+        }
+
+        pkt = &g_replay.pkts[g_replay.num_pkts++];
+        pkt->data = MEMNDUP(bytes, header->caplen);
+        pkt->caplen = header->caplen;
+        g_replay.num_bytes += header->caplen;
+    }
+
+    if (rc == PCAP_ERROR) LOGE("%s: %s: %s", __func__, path, pcap_geterr(pcap));
+    pcap_close(pcap);
+
+    return (rc != PCAP_ERROR) && (g_replay.num_pkts != 0);
+}
+
+
+static void
+fsm_replay_free_pcap(void)
+{
+    size_t i;
+
+    for (i = 0; i < g_replay.num_pkts; i++) FREE(g_replay.pkts[i].data);
+    FREE(g_replay.pkts);
+    g_replay.num_pkts = 0;
+}
+
+
+/******************************************************************************
+ *  Replay
+ *****************************************************************************/
+
+static void
+fsm_replay_packet(struct fsm_replay_pkt *pkt)
+{
+    struct net_header_parser net_parser;
+    struct fsm_parser_ops *parser_ops;
+    struct fsm_session *session;
+    uint64_t allocs;
+    uint64_t start;
+    uint64_t ts;
+    size_t len;
+
+    session = g_replay.dispatcher;
+
+    allocs = bench_alloc_count();
+    start = fsm_replay_now_ns();
+    memset(&net_parser, 0, sizeof(net_parser));
+    net_parser.packet_len = pkt->caplen;
+    net_parser.caplen = pkt->caplen;
+    net_parser.data = pkt->data;
+    net_parser.pcap_datalink = g_replay.datalink;
+    net_parser.payload_updated = false;
+    net_parser.tap_intf = g_replay.dispatcher_conf.if_name;
+    ts = fsm_perf_start();
+    len = net_header_parse(&net_parser);
+    if (len != 0) fsm_perf_stage_end(FSM_PERF_PARSE, ts);
+    fsm_replay_stage_add(&g_replay.parse, start, allocs);
+    if (len == 0)
+    {
+        g_replay.parse_errors++;
+        return;
+    }
+
+    allocs = bench_alloc_count();
+    start = fsm_replay_now_ns();
+    parser_ops = &session->p_ops->parser_ops;
+    parser_ops->handler(session, &net_parser);
+    fsm_replay_stage_add(&g_replay.dispatch, start, allocs);
+}
+
+
+static void
+fsm_replay_report_stage(const char *name, struct fsm_replay_stage *stage,
+                        uint64_t num_pkts)
+{
+    printf("  %-24s %10.1f ns/pkt %8.2f allocs/pkt\n", name,
+           (double)stage->ns / num_pkts, (double)stage->allocs / num_pkts);
+}
+
+
+static void
+fsm_replay_report(uint64_t elapsed_ns, uint64_t allocs, int loops)
+{
+    struct fsm_replay_stage overhead;
+    struct fsm_replay_plugin *plugin;
+    uint64_t num_pkts;
+    size_t i;
+
+    num_pkts = (uint64_t)g_replay.num_pkts * loops;
+
+    printf("packets:    %" PRIu64 " (%zu x %d)\n", num_pkts, g_replay.num_pkts, loops);
+    printf("bytes:      %" PRIu64 "\n", g_replay.num_bytes * loops);
+    printf("elapsed:    %.3f ms\n", elapsed_ns / 1e6);
+    printf("throughput: %.0f pkts/s, %.1f Mbit/s\n",
+           num_pkts * 1e9 / elapsed_ns,
+           g_replay.num_bytes * loops * 8 * 1e3 / elapsed_ns);
+    printf("per packet: %.1f ns, %.2f allocs\n",
+           (double)elapsed_ns / num_pkts, (double)allocs / num_pkts);
+    if (bench_alloc_count() < 0) printf("            (allocation counting not available)\n");
+    printf("verdicts:   %" PRIu64 " marks, %" PRIu64 " passthru, %" PRIu64 " drop\n",
+           g_replay.marks, g_replay.passthru, g_replay.drops);
+    printf("parse errors: %" PRIu64 "\n", g_replay.parse_errors);
+
+    printf("stages:\n");
+    fsm_replay_report_stage("net_header_parse", &g_replay.parse, num_pkts);
+    fsm_replay_report_stage("dispatch (total)", &g_replay.dispatch, num_pkts);
+
+    /* Flow accumulators, plugin slots and stream reassembly */
+    overhead = g_replay.dispatch;
+    for (i = 0; i < g_replay.num_plugins; i++)
+    {
+        plugin = &g_replay.plugins[i];
+        overhead.ns -= plugin->stage.ns;
+        overhead.allocs -= plugin->stage.allocs;
+    }
+    fsm_replay_report_stage("dispatch (fsm core)", &overhead, num_pkts);
+
+    for (i = 0; i < g_replay.num_plugins; i++)
+    {
+        plugin = &g_replay.plugins[i];
+        fsm_replay_report_stage(plugin->conf.handler, &plugin->stage, num_pkts);
+    }
+}
+
+
+static void
+fsm_replay_report_hist(const char *name, const struct fsm_perf_hist *hist)
+{
+    int i;
+
+    if (hist->count == 0) return;
+
+    printf("  %-24s %10" PRIu64 " samples, avg %.1f ns, max %" PRIu64 " ns\n",
+           name, hist->count, (double)hist->total_ns / hist->count, hist->max_ns);
+    for (i = 0; i < FSM_PERF_HIST_BUCKETS; i++)
+    {
+        if (hist->buckets[i] == 0) continue;
+
+        if (i == FSM_PERF_HIST_BUCKETS - 1)
+        {
+            printf("    >= %-12" PRIu64, (uint64_t)1 << i);
+        }
+        else
+        {
+            printf("    <  %-12" PRIu64, (uint64_t)1 << (i + 1));
+        }
+        printf(" ns %10" PRIu64 " %6.2f%%\n", hist->buckets[i],
+               hist->buckets[i] * 100.0 / hist->count);
+    }
+}
+
+
+static void
+fsm_replay_report_hists(void)
+{
+    struct fsm_replay_plugin *plugin;
+    struct fsm_session *session;
+    int i;
+
+    printf("histograms:\n");
+    for (i = 0; i < FSM_PERF_NUM_STAGES; i++)
+    {
+        fsm_replay_report_hist(fsm_perf_stage_name(i), fsm_perf_stage_get(i));
+    }
+
+    for (i = 0; i < (int)g_replay.num_plugins; i++)
+    {
+        plugin = &g_replay.plugins[i];
+        session = plugin->session;
+        if (session == NULL || session->dpi == NULL) continue;
+
+        fsm_replay_report_hist(plugin->conf.handler, &session->dpi->plugin.perf);
+    }
+}
+
+
+static void
+fsm_replay_usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s -r <file.pcap> [-n <loops>] [-H] [-v] -p <plugin> [-p <plugin> ...]\n"
+            "\n"
+            "  -r <file>    pcap file to replay\n"
+            "  -n <loops>   number of times the capture is replayed (default 1)\n"
+            "  -p <plugin>  dpi plugin: handler[:key=value[,key=value]]\n"
+            "               plugin=<path> sets the plugin dso, other keys are\n"
+            "               passed as other_config, e.g.\n"
+            "               walleye_dpi:signature_store=/tmp/app_signatures\n"
+            "  -H           report the packet path latency histograms\n"
+            "  -v           verbose logging\n",
+            name);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    uint64_t elapsed;
+    uint64_t allocs;
+    uint64_t start;
+    char *pcap_file;
+    bool histograms;
+    bool verbose;
+    int loops;
+    size_t i;
+    int opt;
+    int l;
+
+    pcap_file = NULL;
+    histograms = false;
+    verbose = false;
+    loops = 1;
+
+    while ((opt = getopt(argc, argv, "r:n:p:Hvh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'r':
+                pcap_file = optarg;
+                break;
+
+            case 'n':
+                loops = atoi(optarg);
+                break;
+
+            case 'p':
+                if (!fsm_replay_add_plugin_conf(optarg)) return EXIT_FAILURE;
+                break;
+
+            case 'H':
+                histograms = true;
+                break;
+
+            case 'v':
+                verbose = true;
+                break;
+
+            default:
+                fsm_replay_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (pcap_file == NULL || loops <= 0)
+    {
+        fsm_replay_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    target_log_open("FSM_REPLAY", LOG_OPEN_STDOUT);
+    log_severity_set(verbose ? LOG_SEVERITY_DEBUG : LOG_SEVERITY_WARN);
+
+    fsm_fn_tracer_init();
+
+    if (!fsm_replay_load_pcap(pcap_file)) return EXIT_FAILURE;
+
+    if (!fsm_replay_init_sessions())
+    {
+        fsm_replay_free_pcap();
+        return EXIT_FAILURE;
+    }
+
+    if (histograms) fsm_perf_set_enabled(true);
+
+    allocs = bench_alloc_count();
+    start = fsm_replay_now_ns();
+    for (l = 0; l < loops; l++)
+    {
+        for (i = 0; i < g_replay.num_pkts; i++)
+        {
+            fsm_replay_packet(&g_replay.pkts[i]);
+        }
+    }
+    elapsed = fsm_replay_now_ns() - start;
+    allocs = bench_alloc_count() - allocs;
+
+    fsm_replay_report(elapsed, allocs, loops);
+    if (histograms) fsm_replay_report_hists();
+
+    fsm_reset_mgr();
+    fsm_replay_free_pcap();
+
+    return EXIT_SUCCESS;
+}
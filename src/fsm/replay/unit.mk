@@ -0,0 +1,95 @@
+# Copyright (c) 2015, Plume Design Inc. All rights reserved.
+# 
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#    1. Redistributions of source code must retain the above copyright
+#       notice, this list of conditions and the following disclaimer.
+#    2. Redistributions in binary form must reproduce the above copyright
+#       notice, this list of conditions and the following disclaimer in the
+#       documentation and/or other materials provided with the distribution.
+#    3. Neither the name of the Plume Design Inc. nor the
+#       names of its contributors may be used to endorse or promote products
+#       derived from this software without specific prior written permission.
+# 
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+# DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+##############################################################################
+#
+# fsm_replay - offline pcap replay benchmark of the FSM dpi packet path
+#
+##############################################################################
+UNIT_NAME := fsm_replay
+UNIT_DIR := tools
+UNIT_DISABLE := $(if $(CONFIG_FSM_REPLAY),n,y)
+
+# Template type:
+UNIT_TYPE := BIN
+
+UNIT_SRC := fsm_replay.c
+include $(UNIT_PATH)/../fsm_src.mk
+UNIT_SRC += $(addprefix ../src/,$(FSM_CORE_SRC))
+
+UNIT_CFLAGS := -I$(UNIT_PATH)/../inc
+UNIT_CFLAGS += -Isrc/lib/oms/inc
+
+UNIT_LDFLAGS := -lev -ljansson -lmnl -lpcap
+
+UNIT_DEPS := src/lib/ds
+UNIT_DEPS += src/lib/common
+UNIT_DEPS += src/lib/log
+UNIT_DEPS += src/lib/target
+UNIT_DEPS += src/lib/ovsdb
+UNIT_DEPS += src/lib/pjs
+UNIT_DEPS += src/lib/schema
+UNIT_DEPS += src/lib/datapipeline
+UNIT_DEPS += src/lib/json_util
+UNIT_DEPS += src/lib/policy_tags
+UNIT_DEPS += src/lib/nf_utils
+UNIT_DEPS += src/lib/fsm_utils
+UNIT_DEPS += src/lib/fsm_policy
+UNIT_DEPS += src/lib/dpi_stats
+UNIT_DEPS += src/lib/ustack
+UNIT_DEPS += src/qm/qm_conn
+UNIT_DEPS += src/lib/json_mqtt
+UNIT_DEPS += src/lib/network_telemetry
+UNIT_DEPS += src/lib/network_metadata
+UNIT_DEPS += src/lib/neigh_table
+UNIT_DEPS += src/lib/oms
+UNIT_DEPS += src/lib/gatekeeper_cache
+UNIT_DEPS += src/lib/network_zone
+UNIT_DEPS += src/lib/dpi_intf
+UNIT_DEPS += src/lib/accel_evict_msg
+UNIT_DEPS += src/lib/osa
+UNIT_DEPS += src/lib/nfe
+UNIT_DEPS += src/lib/bench
+UNIT_DEPS += $(if $(CONFIG_FSM_IPC_USE_OSBUS), src/lib/osbus)
+
+ifeq ($(CONFIG_FSM_NO_DSO),y)
+	UNIT_DEPS += $(if $(CONFIG_LIB_LEGACY_FSM_HTTP_PARSER), src/lib/http_parse)
+	UNIT_DEPS += $(if $(CONFIG_LIB_LEGACY_FSM_DNS_PARSER), src/lib/dns_parse)
+	UNIT_DEPS += $(if $(CONFIG_LIB_LEGACY_FSM_MDNS_PARSER), src/lib/mdns_plugin)
+	UNIT_DEPS += $(if $(CONFIG_LIB_LEGACY_FSM_UPNP_PARSER), src/lib/upnp_parse)
+	UNIT_DEPS += $(if $(CONFIG_LIB_LEGACY_FSM_NDP_PARSER), src/lib/ndp_parse)
+	UNIT_DEPS += $(if $(CONFIG_FSM_NO_DSO), src/lib/gatekeeper_plugin)
+	UNIT_DEPS += $(if $(CONFIG_FSM_NO_DSO), src/lib/walleye)
+	UNIT_DEPS += $(if $(CONFIG_FSM_NO_DSO), src/lib/ipthreat_dpi)
+	UNIT_DEPS += $(if $(CONFIG_FSM_NO_DSO), src/lib/fsm_dpi_client)
+	UNIT_DEPS += $(if $(CONFIG_FSM_NO_DSO), src/lib/fsm_dpi_adt)
+	UNIT_DEPS += $(if $(CONFIG_FSM_NO_DSO), src/lib/fsm_dpi_dns)
+	UNIT_DEPS += $(if $(CONFIG_FSM_NO_DSO), src/lib/fsm_dpi_sni)
+	UNIT_DEPS += $(if $(CONFIG_FSM_NO_DSO), src/lib/fsm_dpi_ndp)
+	UNIT_DEPS += $(if $(CONFIG_FSM_NO_DSO), src/lib/fsm_dpi_mdns_responder)
+	UNIT_DEPS += $(if $(CONFIG_FSM_NO_DSO), src/lib/fsm_dpi_adt_upnp)
+	UNIT_DEPS += $(if $(CONFIG_FSM_NO_DSO), src/lib/fsm_dpi_dhcp_relay)
+	UNIT_DEPS += $(if $(CONFIG_FSM_NO_DSO), src/lib/wc_null_plugin)
+	UNIT_DEPS += $(if $(CONFIG_FSM_NO_DSO), src/lib/we_dpi)
+endif
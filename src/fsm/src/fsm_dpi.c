@@ -70,6 +70,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "dpi_intf.h"
 #include "fsm_ipc.h"
 #include "fsm_fn_trace.h"
+#include "fsm_perf.h"
 
 #include "accel_evict_msg.h"
 #include "nfe.h"
@@ -224,6 +225,8 @@ fsm_init_dpi_plugin(struct fsm_session *session)
     dpi_plugin->targets = fsm_get_other_config_val(session, "targeted_devices");
     dpi_plugin->excluded_targets = fsm_get_other_config_val(session,
                                                             "excluded_devices");
+    om_tag_handle_init(&dpi_plugin->targets_tag, dpi_plugin->targets);
+    om_tag_handle_init(&dpi_plugin->excluded_tag, dpi_plugin->excluded_targets);
 
     ret = fsm_dpi_add_plugin_to_dispatcher(session);
     if (!ret) return ret;
@@ -372,6 +375,8 @@ fsm_dpi_add_plugin_to_flows(struct fsm_session *session,
 {
     struct net_md_eth_pair *pair;
 
+    fsm_dpi_invalidate_plugin_slots();
+
     pair = ds_tree_head(aggr->eth_pairs);
     while (pair != NULL)
     {
@@ -494,6 +499,9 @@ fsm_free_dpi_plugin(struct fsm_session *session)
     struct net_md_aggregator *aggr;
     struct fsm_session *dispatcher;
 
+    /* Flows must not dispatch to the plugin anymore */
+    fsm_dpi_invalidate_plugin_slots();
+
     /* Retrieve the dispatcher */
     dispatcher = fsm_dpi_find_dispatcher(session);
     if (dispatcher == NULL) return;
@@ -527,25 +535,31 @@ fsm_free_dpi_plugin(struct fsm_session *session)
  *
  * @param the mac address to check
  * @param val an opensync tag name or the string representation of a mac address
+ * @param tag the handle initialized from val, NULL to parse val
  * @return true if the mac matches the value, false otherwise
  */
 static bool
-fsm_dpi_find_mac_in_val(os_macaddr_t *mac, char *val)
+fsm_dpi_find_mac_in_val(os_macaddr_t *mac, char *val, struct om_tag_handle *tag)
 {
+    struct om_tag_handle handle;
     char mac_s[32] = { 0 };
-    bool rc;
     int ret;
 
     if (val == NULL) return false;
 
     /* In case of NFQUEUE mac address may be null, hence the condition */
     if (mac == NULL) return false;
+
+    if (tag == NULL)
+    {
+        tag = &handle;
+        om_tag_handle_init(tag, val);
+    }
+    if (tag->valid) return om_tag_handle_in_mac(tag, mac);
+
     snprintf(mac_s, sizeof(mac_s), PRI_os_macaddr_lower_t,
              FMT_os_macaddr_pt(mac));
 
-    rc = om_tag_in(mac_s, val);
-    if (rc) return true;
-
     ret = strncmp(mac_s, val, strlen(mac_s));
     return (ret == 0);
 }
@@ -576,17 +590,20 @@ fsm_dpi_find_mac(os_macaddr_t *mac, struct fsm_dpi_dispatcher *dispatch)
     if (!excluded_devices && !included_devices) return false;
     if (!excluded_devices && included_devices)
     {
-        rc = fsm_dpi_find_mac_in_val(mac, dispatch->included_devices);
+        rc = fsm_dpi_find_mac_in_val(mac, dispatch->included_devices,
+                                     &dispatch->included_tag);
         return rc;
     }
     if (excluded_devices && !included_devices)
     {
-        rc = fsm_dpi_find_mac_in_val(mac, dispatch->excluded_devices);
+        rc = fsm_dpi_find_mac_in_val(mac, dispatch->excluded_devices,
+                                     &dispatch->excluded_tag);
         return (!rc);
     }
     if (excluded_devices && included_devices)
     {
-        rc = fsm_dpi_find_mac_in_val(mac, dispatch->excluded_devices);
+        rc = fsm_dpi_find_mac_in_val(mac, dispatch->excluded_devices,
+                                     &dispatch->excluded_tag);
         return (!rc);
     }
 
@@ -1252,6 +1269,24 @@ fsm_dispatcher_init_tap_intfs(struct fsm_session *dispatcher)
 }
 
 
+/**
+ * @brief toggles the packet path instrumentation
+ *
+ * Driven by the dispatcher's other_config perf_stats value.
+ * @param session the dispatcher session
+ */
+static void
+fsm_dpi_set_perf_stats_cfg(struct fsm_session *session)
+{
+    char *perf_stats;
+    bool enable;
+
+    perf_stats = fsm_get_other_config_val(session, "perf_stats");
+    enable = (perf_stats != NULL && strcmp(perf_stats, "true") == 0);
+    fsm_perf_set_enabled(enable);
+}
+
+
 /**
  * @brief initializes the dpi resources of a dispatcher session
  *
@@ -1285,6 +1320,8 @@ fsm_init_dpi_dispatcher(struct fsm_session *session)
                                                           "included_devices");
     dispatch->excluded_devices = fsm_get_other_config_val(session,
                                                           "excluded_devices");
+    om_tag_handle_init(&dispatch->included_tag, dispatch->included_devices);
+    om_tag_handle_init(&dispatch->excluded_tag, dispatch->excluded_devices);
 
     dispatch->listening_ip = fsm_get_other_config_val(session,
                                                       "listening_ip");
@@ -1338,6 +1375,7 @@ fsm_init_dpi_dispatcher(struct fsm_session *session)
     }
 
     fsm_set_dpi_health_stats_cfg(session);
+    fsm_dpi_set_perf_stats_cfg(session);
 
     /* NFE Initialization */
     nfe_conntrack_tcp_timeout_est = 300;
@@ -1426,6 +1464,9 @@ fsm_free_dpi_dispatcher(struct fsm_session *session)
     accel_evict_msg_socket_exit();
 
     fsm_ipc_terminate_client();
+
+    /* The instrumentation setting belongs to the dispatcher */
+    fsm_perf_set_enabled(false);
 }
 
 
@@ -1517,10 +1558,14 @@ fsm_update_dpi_plugin(struct fsm_session *session)
                                                "targeted_devices");
     plugin->excluded_targets = fsm_get_other_config_val(session,
                                                         "excluded_devices");
+    om_tag_handle_init(&plugin->targets_tag, plugin->targets);
+    om_tag_handle_init(&plugin->excluded_tag, plugin->excluded_targets);
     LOGD("%s: %s: targeted_devices: %s", __func__, session->name,
          plugin->targets ? plugin->targets : "None");
     LOGD("%s: %s: excluded_devices: %s", __func__, session->name,
          plugin->excluded_targets ? plugin->excluded_targets : "None") ;
+
+    fsm_dpi_invalidate_plugin_slots();
 }
 
 
@@ -1546,6 +1591,8 @@ fsm_update_dpi_dispatcher(struct fsm_session *session)
                                                           "included_devices");
     dispatch->excluded_devices = fsm_get_other_config_val(session,
                                                           "excluded_devices");
+    om_tag_handle_init(&dispatch->included_tag, dispatch->included_devices);
+    om_tag_handle_init(&dispatch->excluded_tag, dispatch->excluded_devices);
     dispatch->listening_ip = fsm_get_other_config_val(session,
                                                       "listening_ip");
     dispatch->listening_port = fsm_get_other_config_val(session, "listening_port");
@@ -1559,6 +1606,8 @@ fsm_update_dpi_dispatcher(struct fsm_session *session)
     {
         fsm_reinit_mem_monitor();
     }
+
+    fsm_dpi_set_perf_stats_cfg(session);
 }
 
 
@@ -1636,6 +1685,9 @@ fsm_free_dpi_context(struct fsm_session *session)
     {
         fsm_free_dpi_plugins_resources(session);
         fsm_free_dpi_dispatcher(session);
+
+        /* The flows are gone, release the cached stream buffers */
+        fsm_tcp_stream_pool_flush();
     }
     else if (session->type == FSM_DPI_PLUGIN)
     {
@@ -1832,14 +1884,18 @@ fsm_dpi_mark_for_report(struct fsm_session *session,
  *
  * @param the mac to check
  * @param included_targets tag representing the included targets
+ * @param included_tag the handle of included_targets, NULL to parse it
  * @param excluded_targets tag representing the excluded targets
+ * @param excluded_tag the handle of excluded_targets, NULL to parse it
  *
  * check if a packet should be processed based on its the source and destination
  */
-bool
-fsm_dpi_should_process_mac(os_macaddr_t *mac,
-                           char *included_targets,
-                           char *excluded_targets)
+static bool
+fsm_dpi_should_process_mac_tags(os_macaddr_t *mac,
+                                char *included_targets,
+                                struct om_tag_handle *included_tag,
+                                char *excluded_targets,
+                                struct om_tag_handle *excluded_tag)
 {
     bool is_unicast;
     bool excluded;
@@ -1855,14 +1911,14 @@ fsm_dpi_should_process_mac(os_macaddr_t *mac,
     /* Check if the mac is explicitly included */
     if (included_targets != NULL)
     {
-        included = fsm_dpi_find_mac_in_val(mac, included_targets);
+        included = fsm_dpi_find_mac_in_val(mac, included_targets, included_tag);
         return included;
     }
 
     /* The mac is not explicitly included, check if it is explicitly excluded */
     if (excluded_targets != NULL)
     {
-        excluded = !fsm_dpi_find_mac_in_val(mac, excluded_targets);
+        excluded = !fsm_dpi_find_mac_in_val(mac, excluded_targets, excluded_tag);
         return excluded;
     }
 
@@ -1871,12 +1927,33 @@ fsm_dpi_should_process_mac(os_macaddr_t *mac,
 }
 
 
+/**
+ * @brief check if a mac should be processed
+ *
+ * @param the mac to check
+ * @param included_targets tag representing the included targets
+ * @param excluded_targets tag representing the excluded targets
+ *
+ * check if a packet should be processed based on its the source and destination
+ */
+bool
+fsm_dpi_should_process_mac(os_macaddr_t *mac,
+                           char *included_targets,
+                           char *excluded_targets)
+{
+    return fsm_dpi_should_process_mac_tags(mac, included_targets, NULL,
+                                           excluded_targets, NULL);
+}
+
+
 /**
  * @brief check if a packet should be processed
  *
  * @param the parsed info for the current packet
  * @param included_targets tag representing the included targets
+ * @param included_tag the handle of included_targets, NULL to parse it
  * @param excluded_targets tag representing the excluded targets
+ * @param excluded_tag the handle of excluded_targets, NULL to parse it
  *
  * check if a packet should be procesed based on its the source and destination
  * Both source and destination macs are checked for processing.
@@ -1885,10 +1962,12 @@ fsm_dpi_should_process_mac(os_macaddr_t *mac,
  * For example, a DNS reply may come from a source to be excluded, to a destination
  * to be included. Such a packet needs to be processed.
  */
-bool
-fsm_dpi_should_process(struct net_header_parser *net_parser,
-                       char *included_targets,
-                       char *excluded_targets)
+static bool
+fsm_dpi_should_process_tags(struct net_header_parser *net_parser,
+                            char *included_targets,
+                            struct om_tag_handle *included_tag,
+                            char *excluded_targets,
+                            struct om_tag_handle *excluded_tag)
 {
     struct eth_header *eth_hdr;
     bool process;
@@ -1900,17 +1979,167 @@ fsm_dpi_should_process(struct net_header_parser *net_parser,
     eth_hdr = &net_parser->eth_header;
 
     /* Check the source mac */
-    process = fsm_dpi_should_process_mac(eth_hdr->srcmac,
-                                         included_targets, excluded_targets);
+    process = fsm_dpi_should_process_mac_tags(eth_hdr->srcmac,
+                                              included_targets, included_tag,
+                                              excluded_targets, excluded_tag);
 
     /* Check the destination mac */
-    process |= fsm_dpi_should_process_mac(eth_hdr->dstmac,
-                                          included_targets, excluded_targets);
+    process |= fsm_dpi_should_process_mac_tags(eth_hdr->dstmac,
+                                               included_targets, included_tag,
+                                               excluded_targets, excluded_tag);
 
     return process;
 }
 
 
+bool
+fsm_dpi_should_process(struct net_header_parser *net_parser,
+                       char *included_targets,
+                       char *excluded_targets)
+{
+    return fsm_dpi_should_process_tags(net_parser, included_targets, NULL,
+                                       excluded_targets, NULL);
+}
+
+
+/* Generation of the per flow dpi plugin slots */
+static uint32_t fsm_dpi_slots_gen;
+
+
+/**
+ * @brief invalidate the per flow dpi plugin slots
+ *
+ * Flows rebuild their dispatch array on their next packet.
+ */
+void
+fsm_dpi_invalidate_plugin_slots(void)
+{
+    fsm_dpi_slots_gen++;
+}
+
+
+/**
+ * @brief check if the slots were built for the macs of a packet
+ *
+ * The targets verdict considers both macs of the packet, so a flow's
+ * slots apply to either direction of the flow.
+ * @param slots the flow's plugin slots
+ * @param eth_hdr the packet's ethernet header
+ * @return true if the slots verdicts apply to the packet
+ */
+static bool
+fsm_dpi_slots_macs_match(struct fsm_dpi_plugin_slots *slots,
+                         struct eth_header *eth_hdr)
+{
+    os_macaddr_t *macs[2];
+    int i;
+
+    macs[0] = eth_hdr->srcmac;
+    macs[1] = eth_hdr->dstmac;
+
+    for (i = 0; i < 2; i++)
+    {
+        if (macs[i] == NULL && slots->has_mac[i]) return false;
+        if (macs[i] != NULL && !slots->has_mac[i]) return false;
+    }
+
+    if (macs[0] != NULL && memcmp(macs[0], &slots->macs[0], sizeof(os_macaddr_t)))
+    {
+        if (memcmp(macs[0], &slots->macs[1], sizeof(os_macaddr_t))) return false;
+        if (macs[1] == NULL) return false;
+        return !memcmp(macs[1], &slots->macs[0], sizeof(os_macaddr_t));
+    }
+
+    if (macs[1] == NULL) return true;
+
+    return !memcmp(macs[1], &slots->macs[1], sizeof(os_macaddr_t));
+}
+
+
+/**
+ * @brief returns the flat dpi plugin array of a flow
+ *
+ * Builds or rebuilds the array from the flow's dpi_plugins tree when
+ * missing or outdated, evaluating the plugins targets once per flow
+ * rather than for every packet.
+ * @param acc the flow accumulator
+ * @param net_parser the parsed info for the current packet
+ * @return the flow's plugin slots, NULL if the flow has no plugins
+ */
+static struct fsm_dpi_plugin_slots *
+fsm_dpi_get_plugin_slots(struct net_md_stats_accumulator *acc,
+                         struct net_header_parser *net_parser)
+{
+    union fsm_dpi_context *plugin_dpi_context;
+    struct fsm_dpi_plugin_slots *slots;
+    struct fsm_dpi_plugin_slot *slot;
+    struct fsm_dpi_flow_info *info;
+    struct fsm_session *dpi_plugin;
+    struct fsm_dpi_plugin *plugin;
+    struct eth_header *eth_hdr;
+    ds_tree_t *tree;
+    int num_slots;
+
+    eth_hdr = &net_parser->eth_header;
+
+    slots = acc->dpi_slots;
+    if (slots != NULL && slots->gen == fsm_dpi_slots_gen &&
+        fsm_dpi_slots_macs_match(slots, eth_hdr))
+    {
+        return slots;
+    }
+
+    FREE(acc->dpi_slots);
+    acc->dpi_slots = NULL;
+
+    tree = acc->dpi_plugins;
+    if (tree == NULL) return NULL;
+
+    num_slots = 0;
+    ds_tree_foreach(tree, info) num_slots++;
+    if (num_slots == 0) return NULL;
+
+    slots = CALLOC(1, sizeof(*slots) + (num_slots * sizeof(*slot)));
+    if (slots == NULL) return NULL;
+
+    slots->gen = fsm_dpi_slots_gen;
+    if (eth_hdr->srcmac != NULL)
+    {
+        slots->has_mac[0] = true;
+        slots->macs[0] = *eth_hdr->srcmac;
+    }
+    if (eth_hdr->dstmac != NULL)
+    {
+        slots->has_mac[1] = true;
+        slots->macs[1] = *eth_hdr->dstmac;
+    }
+
+    slot = slots->slots;
+    ds_tree_foreach(tree, info)
+    {
+        dpi_plugin = info->session;
+        plugin_dpi_context = dpi_plugin->dpi;
+        plugin = &plugin_dpi_context->plugin;
+
+        slot->info = info;
+        slot->session = dpi_plugin;
+        slot->ops = (dpi_plugin->p_ops != NULL ? &dpi_plugin->p_ops->dpi_plugin_ops : NULL);
+        slot->process = fsm_dpi_should_process_tags(net_parser,
+                                                    plugin->targets,
+                                                    &plugin->targets_tag,
+                                                    plugin->excluded_targets,
+                                                    &plugin->excluded_tag);
+        if (slot->ops != NULL && slot->ops->stream_handler != NULL) slots->has_stream = true;
+        slot++;
+    }
+    slots->num_slots = num_slots;
+    acc->dpi_slots = slots;
+
+    return slots;
+}
+
+
+
 #define FLUSH_COOKIE 0xDA2C5588
 int
 flush_accel_flows(struct net_md_stats_accumulator *acc)
@@ -1990,6 +2219,45 @@ flush_accel_flows(struct net_md_stats_accumulator *acc)
 }
 
 
+/**
+ * @brief hands the reassembled stream bytes to a dpi plugin
+ *
+ * The packet's payload is swapped for the contiguous bytes of its
+ * stream direction for the duration of the call.
+ * @param dpi_plugin the dpi plugin session
+ * @param dpi_plugin_ops the dpi plugin handlers
+ * @param net_parser the parsed info for the current packet
+ * @param sdir the packet's stream direction
+ */
+static void
+fsm_dpi_stream_dispatch(struct fsm_session *dpi_plugin,
+                        struct fsm_dpi_plugin_ops *dpi_plugin_ops,
+                        struct net_header_parser *net_parser,
+                        struct fsm_tcp_stream_dir *sdir)
+{
+    size_t packet_len;
+    uint8_t *data;
+    uint64_t ts;
+
+    /* Nothing new to parse */
+    if (sdir->len == sdir->delivered) return;
+
+    data = net_parser->data;
+    packet_len = net_parser->packet_len;
+    net_parser->data = sdir->buf;
+    net_parser->packet_len = net_parser->parsed + sdir->len;
+
+    ts = fsm_perf_start();
+    fsm_fn_trace(dpi_plugin_ops->stream_handler, FSM_FN_ENTER);
+    dpi_plugin_ops->stream_handler(dpi_plugin, net_parser);
+    fsm_fn_trace(dpi_plugin_ops->stream_handler, FSM_FN_EXIT);
+    fsm_perf_plugin_end(dpi_plugin, ts);
+
+    net_parser->data = data;
+    net_parser->packet_len = packet_len;
+}
+
+
 /**
  * @brief dispatches a received packet to the dpi plugin handlers
  *
@@ -2002,20 +2270,22 @@ static void
 fsm_dispatch_pkt(struct fsm_session *session,
                  struct net_header_parser *net_parser)
 {
-    union fsm_dpi_context *plugin_dpi_context;
     struct fsm_dpi_plugin_ops *dpi_plugin_ops;
     struct net_md_stats_accumulator *acc;
+    struct fsm_dpi_plugin_slots *slots;
+    struct fsm_tcp_stream_dir *sdir;
     struct dpi_mark_policy mark_policy;
+    struct fsm_dpi_plugin_slot *slot;
     struct fsm_dpi_flow_info *info;
     struct fsm_session *dpi_plugin;
-    struct fsm_dpi_plugin *plugin;
     int state = FSM_DPI_CLEAR;
-    ds_tree_t *tree;
-    bool process;
+    uint64_t ts;
+    bool stream;
     bool drop;
     bool pass;
     int mark;
     int err;
+    int i;
 
     acc = net_parser->acc;
     if (acc == NULL) return;
@@ -2047,7 +2317,9 @@ fsm_dispatch_pkt(struct fsm_session *session,
             mark_policy.mark_policy = PKT_VERDICT_ONLY;
         }
 
+        ts = fsm_perf_start();
         err = session->set_dpi_mark(net_parser, &mark_policy);
+        fsm_perf_stage_end(FSM_PERF_VERDICT, ts);
         if (err != 0)
         {
             LOGD("%s: Setting ct_mark failed (1)", __func__);
@@ -2057,29 +2329,29 @@ fsm_dispatch_pkt(struct fsm_session *session,
         return;
     }
 
-    tree = acc->dpi_plugins;
-    if (tree == NULL) return;
+    ts = fsm_perf_start();
+    slots = fsm_dpi_get_plugin_slots(acc, net_parser);
+    if (slots == NULL)
+    {
+        fsm_perf_stage_end(FSM_PERF_DISPATCH, ts);
+        return;
+    }
 
-    info = ds_tree_head(tree);
-    if (info == NULL) return;
+    sdir = NULL;
+    if (slots->has_stream) sdir = fsm_tcp_stream_process(acc, net_parser);
 
+    stream = false;
     drop = false;
     pass = true;
 
-    while (info != NULL && !drop)
+    for (i = 0, slot = slots->slots; i < slots->num_slots && !drop; i++, slot++)
     {
-        dpi_plugin = info->session;
-        plugin_dpi_context = dpi_plugin->dpi;
-        plugin = &plugin_dpi_context->plugin;
+        dpi_plugin = slot->session;
+        info = slot->info;
 
-        process = fsm_dpi_should_process(net_parser,
-                                         plugin->targets,
-                                         plugin->excluded_targets);
-        if (!process)
+        if (!slot->process)
         {
             FSM_TRACK_DNS(net_parser, dpi_plugin->name);
-
-            info = ds_tree_next(tree, info);
             continue;
         }
 
@@ -2090,30 +2362,47 @@ fsm_dispatch_pkt(struct fsm_session *session,
 
         if (info->decision == FSM_DPI_INSPECT || acc->dpi_always)
         {
-            if (dpi_plugin->p_ops == NULL)
+            dpi_plugin_ops = slot->ops;
+            if (dpi_plugin_ops == NULL) continue;
+
+            FSM_TRACK_DNS(net_parser, dpi_plugin->name);
+
+            if (sdir != NULL && dpi_plugin_ops->stream_handler != NULL)
             {
-                info = ds_tree_next(tree, info);
-                continue;
+                fsm_dpi_stream_dispatch(dpi_plugin, dpi_plugin_ops, net_parser, sdir);
             }
+            else if (dpi_plugin_ops->handler != NULL)
+            {
+                uint64_t plugin_ts;
 
-            dpi_plugin_ops = &dpi_plugin->p_ops->dpi_plugin_ops;
-            if (dpi_plugin_ops->handler == NULL)
+                plugin_ts = fsm_perf_start();
+                fsm_fn_trace(dpi_plugin_ops->handler, FSM_FN_ENTER);
+                dpi_plugin_ops->handler(dpi_plugin, net_parser);
+                fsm_fn_trace(dpi_plugin_ops->handler, FSM_FN_EXIT);
+                fsm_perf_plugin_end(dpi_plugin, plugin_ts);
+            }
+            else
             {
-                info = ds_tree_next(tree, info);
                 continue;
             }
-            FSM_TRACK_DNS(net_parser, dpi_plugin->name);
 
-            fsm_fn_trace(dpi_plugin_ops->handler, FSM_FN_ENTER);
-            dpi_plugin_ops->handler(dpi_plugin, net_parser);
-            fsm_fn_trace(dpi_plugin_ops->handler, FSM_FN_EXIT);
+            if (dpi_plugin_ops->stream_handler != NULL)
+            {
+                stream |= (info->decision == FSM_DPI_INSPECT);
+            }
         }
 
         drop = (info->decision == FSM_DPI_DROP);
         pass &= (info->decision == FSM_DPI_PASSTHRU);
+    }
 
-        info = ds_tree_next(tree, info);
+    /* Release the stream buffers as soon as no stream plugin needs them */
+    if (sdir != NULL) sdir->delivered = sdir->len;
+    if (acc->tcp_stream != NULL && !stream && !acc->dpi_always)
+    {
+        fsm_tcp_stream_release(acc);
     }
+    fsm_perf_stage_end(FSM_PERF_DISPATCH, ts);
 
     if (net_parser->payload_updated)
     {
@@ -2130,11 +2419,13 @@ fsm_dispatch_pkt(struct fsm_session *session,
 
     if (pass || drop)
     {
+        ts = fsm_perf_start();
         mark = fsm_dpi_get_mark(net_parser->acc->flow_marker, acc->dpi_done);
 
         /* Set the flow_marker to be used for FCM */
         acc->flow_marker = mark;
         fsm_dpi_set_flow_marker(acc);
+        fsm_dpi_verdict_record(acc);
         memset(&mark_policy, 0, sizeof(mark_policy));
         mark_policy.flow_mark = mark;
         err = session->set_dpi_mark(net_parser, &mark_policy);
@@ -2150,6 +2441,7 @@ fsm_dispatch_pkt(struct fsm_session *session,
                 acc->mark_done = mark;
             }
         }
+        fsm_perf_stage_end(FSM_PERF_VERDICT, ts);
     }
     else
     {
@@ -2208,7 +2500,7 @@ fsm_net_parser_to_key(struct net_header_parser *net_parser, struct net_md_flow_k
 }
 
 /**
- * @brief the dispatcher plugin's packet handler
+ * @brief processes a packet presented to the dispatcher
  *
  * Retrieves the flow accumulator.
  * If the flow is new, bind it to the dpi plugins
@@ -2217,8 +2509,8 @@ fsm_net_parser_to_key(struct net_header_parser *net_parser, struct net_md_flow_k
  * @param net_parser the parsed packet
  */
 static void
-fsm_dpi_handler(struct fsm_session *session,
-                struct net_header_parser *net_parser)
+fsm_dpi_process_pkt(struct fsm_session *session,
+                    struct net_header_parser *net_parser)
 {
     struct net_md_stats_accumulator *acc;
     struct fsm_dpi_dispatcher *dispatch;
@@ -2228,6 +2520,7 @@ fsm_dpi_handler(struct fsm_session *session,
     nfe_conn_t conn;
     size_t payload_len;
     bool process;
+    uint64_t ts;
 
     dpi_context = session->dpi;
     if (dpi_context == NULL) return;
@@ -2247,9 +2540,11 @@ fsm_dpi_handler(struct fsm_session *session,
     }
 
     dispatch = &dpi_context->dispatch;
-    process = fsm_dpi_should_process(net_parser,
-                                     dispatch->included_devices,
-                                     dispatch->excluded_devices);
+    process = fsm_dpi_should_process_tags(net_parser,
+                                          dispatch->included_devices,
+                                          &dispatch->included_tag,
+                                          dispatch->excluded_devices,
+                                          &dispatch->excluded_tag);
     FSM_TRACK_DNS(net_parser, session->name);
     if (!process)
     {
@@ -2259,8 +2554,13 @@ fsm_dpi_handler(struct fsm_session *session,
         return;
     }
 
+    ts = fsm_perf_start();
     conn = fsm_net_parser_to_conn(net_parser);
-    if (conn == NULL) return;
+    if (conn == NULL)
+    {
+        fsm_perf_stage_end(FSM_PERF_FLOW, ts);
+        return;
+    }
 
     acc = container_of(conn, struct net_md_stats_accumulator, priv);
     if (acc == NULL) return;
@@ -2273,6 +2573,9 @@ fsm_dpi_handler(struct fsm_session *session,
         acc->initialized = true;
         acc->aggr = dispatch->aggr;
         dispatch->aggr->nfe_ct = nfe_ct;
+
+        /* Resume the verdict reached before a restart */
+        if (fsm_dpi_verdict_restore(acc, net_parser)) fsm_dpi_set_flow_marker(acc);
     }
 
     counters.packets_count = acc->counters.packets_count + 1;
@@ -2282,6 +2585,7 @@ fsm_dpi_handler(struct fsm_session *session,
     net_md_set_counters(dispatch->aggr, acc, &counters);
 
     net_parser->acc = acc;
+    fsm_perf_stage_end(FSM_PERF_FLOW, ts);
 
     process = fsm_dpi_filter_packet(net_parser);
     if (!process) return;
@@ -2291,6 +2595,24 @@ fsm_dpi_handler(struct fsm_session *session,
     FREE(acc->packet);
 }
 
+
+/**
+ * @brief the dispatcher plugin's packet handler
+ *
+ * @param session the dispatcher session
+ * @param net_parser the parsed packet
+ */
+static void
+fsm_dpi_handler(struct fsm_session *session,
+                struct net_header_parser *net_parser)
+{
+    uint64_t ts;
+
+    ts = fsm_perf_start();
+    fsm_dpi_process_pkt(session, net_parser);
+    fsm_perf_stage_end(FSM_PERF_PACKET, ts);
+}
+
 /**
  * @brief releases the dpi context of a flow accumulator
  *
@@ -2306,6 +2628,11 @@ fsm_dpi_free_flow_context(struct net_md_stats_accumulator *acc)
     struct fsm_session *session;
     ds_tree_t *dpi_sessions;
 
+    FREE(acc->dpi_slots);
+    acc->dpi_slots = NULL;
+    fsm_tcp_stream_free(acc);
+    fsm_dpi_verdict_forget(acc);
+
     dpi_sessions = acc->dpi_plugins;
     if (dpi_sessions == NULL) return;
 
@@ -2446,6 +2773,7 @@ static void nfe_log_acc_cb(nfe_conn_t conn, void *data)
 void
 fsm_dpi_recycle_nfe_conns(void)
 {
+    struct nfe_conntrack_stats ct_stats;
     struct nfe_tuple tuple;
     struct timespec now;
     nfe_conn_t conn;
@@ -2476,6 +2804,15 @@ fsm_dpi_recycle_nfe_conns(void)
     nfe_conn_release(conn);
 
     LOGT("%s: Number of active flows: %d",__func__, nfe_conntrack_dump(nfe_ct, nfe_log_acc_cb, NULL));
+
+    if (nfe_conntrack_stats(nfe_ct, &ct_stats) < 0) return;
+
+    LOGD("%s: conntrack buckets: %u (%u used), load: %u.%02u, max chain: %u,"
+         " chains > %d: %u, resizes: +%u/-%u, rehash pending: %u", __func__,
+         ct_stats.buckets, ct_stats.used_buckets,
+         ct_stats.load_factor / 100, ct_stats.load_factor % 100,
+         ct_stats.max_chain, NFE_CONNTRACK_LONG_CHAIN, ct_stats.long_chains,
+         ct_stats.grows, ct_stats.shrinks, ct_stats.rehash_pending);
 }
 
 
@@ -2490,6 +2827,7 @@ fsm_dpi_recycle_nfe_conns(void)
 void
 fsm_dpi_periodic(struct fsm_session *session)
 {
+    struct fsm_tcp_stream_stats stream_stats;
     struct dpi_stats_packed_buffer *pb;
     struct dpi_stats_report dpi_report;
     struct fsm_dpi_dispatcher *dispatch;
@@ -2528,6 +2866,9 @@ fsm_dpi_periodic(struct fsm_session *session)
 
     now = time(NULL);
 
+    /* refresh the flows verdicts snapshot */
+    fsm_dpi_verdict_periodic(now);
+
     if ((now - dispatch->periodic_report_ts) >= dpi_report_conf_intvl)
     {
         windows = report->flow_windows;
@@ -2545,6 +2886,12 @@ fsm_dpi_periodic(struct fsm_session *session)
              ", io failures: %" PRIu64, __func__,
              g_fsm_io_success_cnt, g_fsm_io_failure_cnt);
 
+        fsm_tcp_stream_get_stats(&stream_stats);
+        LOGI("%s: tcp stream: mem used: %zu/%zu, pooled buffers: %d, "
+             "alloc failures: %" PRIu64, __func__,
+             stream_stats.mem_used, stream_stats.mem_max,
+             stream_stats.pooled, stream_stats.alloc_failures);
+
         dispatch->periodic_report_ts = now;
 
         pb = dpi_stats_serialize_counter_report(&dpi_report);
@@ -0,0 +1,406 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/tcp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsm.h"
+#include "fsm_internal.h"
+#include "kconfig.h"
+#include "log.h"
+#include "memutil.h"
+#include "net_header_parse.h"
+#include "network_metadata_report.h"
+#include "os.h"
+#include "util.h"
+
+/* Number of released stream buffers kept for reuse */
+#define FSM_TCP_STREAM_POOL_MAX 16
+
+/**
+ * @brief pool of tcp stream reassembly buffers
+ *
+ * All the buffers have the per flow direction cap size. Pooled buffers
+ * are chained through their first bytes. mem_used only accounts for the
+ * buffers attached to a stream.
+ */
+static struct fsm_tcp_stream_pool
+{
+    bool initialized;
+    size_t buf_size;
+    size_t mem_max;
+    size_t mem_used;
+    void *head;
+    int pooled;
+    uint64_t alloc_failures;
+} stream_pool;
+
+
+static void
+fsm_tcp_stream_pool_init(void)
+{
+    if (stream_pool.initialized) return;
+
+    stream_pool.buf_size = CONFIG_FSM_DPI_TCP_STREAM_FLOW_MAX;
+    if (stream_pool.buf_size < sizeof(void *)) stream_pool.buf_size = sizeof(void *);
+    stream_pool.mem_max = (size_t)CONFIG_FSM_DPI_TCP_STREAM_MEM_MAX * 1024;
+    stream_pool.initialized = true;
+}
+
+
+static uint8_t *
+fsm_tcp_stream_buf_get(void)
+{
+    uint8_t *buf;
+
+    fsm_tcp_stream_pool_init();
+
+    /* The global cap applies to the buffers in use, not to the pooled ones */
+    if (stream_pool.mem_used + stream_pool.buf_size > stream_pool.mem_max)
+    {
+        stream_pool.alloc_failures++;
+        return NULL;
+    }
+
+    if (stream_pool.head != NULL)
+    {
+        buf = stream_pool.head;
+        memcpy(&stream_pool.head, buf, sizeof(void *));
+        stream_pool.pooled--;
+    }
+    else
+    {
+        buf = MALLOC(stream_pool.buf_size);
+    }
+    stream_pool.mem_used += stream_pool.buf_size;
+
+    return buf;
+}
+
+
+static void
+fsm_tcp_stream_buf_put(uint8_t *buf)
+{
+    if (buf == NULL) return;
+
+    stream_pool.mem_used -= stream_pool.buf_size;
+
+    if (stream_pool.pooled < FSM_TCP_STREAM_POOL_MAX)
+    {
+        memcpy(buf, &stream_pool.head, sizeof(void *));
+        stream_pool.head = buf;
+        stream_pool.pooled++;
+        return;
+    }
+
+    FREE(buf);
+}
+
+
+void
+fsm_tcp_stream_pool_flush(void)
+{
+    uint8_t *buf;
+
+    while (stream_pool.head != NULL)
+    {
+        buf = stream_pool.head;
+        memcpy(&stream_pool.head, buf, sizeof(void *));
+        FREE(buf);
+        stream_pool.pooled--;
+    }
+}
+
+
+void
+fsm_tcp_stream_get_stats(struct fsm_tcp_stream_stats *stats)
+{
+    fsm_tcp_stream_pool_init();
+
+    stats->mem_used = stream_pool.mem_used;
+    stats->mem_max = stream_pool.mem_max;
+    stats->buf_size = stream_pool.buf_size;
+    stats->pooled = stream_pool.pooled;
+    stats->alloc_failures = stream_pool.alloc_failures;
+}
+
+
+/**
+ * @brief stops reassembling a stream direction
+ *
+ * @param sdir the stream direction
+ * @return false, for the callers' convenience
+ */
+static bool
+fsm_tcp_stream_close(struct fsm_tcp_stream_dir *sdir)
+{
+    fsm_tcp_stream_buf_put(sdir->buf);
+    sdir->buf = NULL;
+    sdir->num_ooo = 0;
+    sdir->closed = true;
+
+    return false;
+}
+
+
+/**
+ * @brief records an out of order segment, merging overlapping ranges
+ *
+ * @return false if too many holes are pending
+ */
+static bool
+fsm_tcp_stream_add_range(struct fsm_tcp_stream_dir *sdir,
+                         uint32_t start, uint32_t end)
+{
+    struct fsm_tcp_stream_range *range;
+    int i;
+
+    i = 0;
+    while (i < sdir->num_ooo)
+    {
+        range = &sdir->ooo[i];
+        if ((end < range->start) || (start > range->end))
+        {
+            i++;
+            continue;
+        }
+
+        start = MIN(start, range->start);
+        end = MAX(end, range->end);
+        sdir->num_ooo--;
+        *range = sdir->ooo[sdir->num_ooo];
+    }
+
+    if (sdir->num_ooo == FSM_TCP_STREAM_OOO_MAX) return false;
+
+    range = &sdir->ooo[sdir->num_ooo++];
+    range->start = start;
+    range->end = end;
+
+    return true;
+}
+
+
+/**
+ * @brief extends the contiguous bytes with the out of order segments
+ *        they now reach
+ */
+static void
+fsm_tcp_stream_advance(struct fsm_tcp_stream_dir *sdir)
+{
+    struct fsm_tcp_stream_range *range;
+    bool progress;
+    int i;
+
+    do
+    {
+        progress = false;
+        for (i = 0; i < sdir->num_ooo; i++)
+        {
+            range = &sdir->ooo[i];
+            if (range->start > sdir->len) continue;
+
+            if (range->end > sdir->len) sdir->len = range->end;
+            sdir->num_ooo--;
+            *range = sdir->ooo[sdir->num_ooo];
+            progress = true;
+            break;
+        }
+    } while (progress);
+}
+
+
+bool
+fsm_tcp_stream_add(struct fsm_tcp_stream *stream, int dir, uint32_t seq,
+                   bool syn, const uint8_t *data, size_t len)
+{
+    struct fsm_tcp_stream_dir *sdir;
+    size_t buf_size;
+    size_t trim;
+    int32_t off;
+    size_t end;
+
+    sdir = &stream->dirs[dir];
+    if (sdir->closed) return false;
+
+    if (!sdir->init)
+    {
+        sdir->isn = (syn ? seq + 1 : seq);
+        sdir->init = true;
+    }
+
+    /* The SYN consumes a sequence number */
+    if (syn) seq++;
+
+    if (len == 0) return true;
+
+    /*
+     * Trim the already received part of retransmitted segments. The
+     * contiguous bytes may have been delivered to the plugins already,
+     * keep them as first received.
+     */
+    off = (int32_t)(seq - sdir->isn);
+    if (off < 0 || (size_t)off < sdir->len)
+    {
+        trim = (size_t)((int64_t)sdir->len - off);
+        if (trim >= len) return true;
+
+        data += trim;
+        len -= trim;
+        off = (int32_t)sdir->len;
+    }
+
+    fsm_tcp_stream_pool_init();
+    buf_size = stream_pool.buf_size;
+
+    /* Past the per flow cap */
+    if ((size_t)off >= buf_size) return fsm_tcp_stream_close(sdir);
+
+    if (sdir->buf == NULL)
+    {
+        sdir->buf = fsm_tcp_stream_buf_get();
+        if (sdir->buf == NULL) return fsm_tcp_stream_close(sdir);
+    }
+
+    end = MIN((size_t)off + len, buf_size);
+    memcpy(sdir->buf + off, data, end - off);
+
+    if ((size_t)off > sdir->len)
+    {
+        if (!fsm_tcp_stream_add_range(sdir, off, end)) return fsm_tcp_stream_close(sdir);
+        return true;
+    }
+
+    if (end > sdir->len) sdir->len = end;
+    fsm_tcp_stream_advance(sdir);
+
+    return true;
+}
+
+
+static void
+fsm_tcp_stream_get_saddr(struct net_header_parser *net_parser, uint8_t *saddr)
+{
+    if (net_parser->ip_version == 4)
+    {
+        memcpy(saddr, &net_parser->eth_pld.ip.iphdr->saddr, 4);
+    }
+    else
+    {
+        memcpy(saddr, &net_parser->eth_pld.ip.ipv6hdr->ip6_src, 16);
+    }
+}
+
+
+/**
+ * @brief computes the stream direction of a packet
+ *
+ * Direction 0 is the one of the first packet seen.
+ */
+static int
+fsm_tcp_stream_get_dir(struct fsm_tcp_stream *stream,
+                       struct net_header_parser *net_parser)
+{
+    struct tcphdr *tcph;
+    uint8_t saddr[16];
+    size_t len;
+
+    tcph = net_parser->ip_pld.tcphdr;
+    if (tcph->source != tcph->dest) return (tcph->source == stream->sport ? 0 : 1);
+
+    len = (stream->ip_version == 4 ? 4 : 16);
+    fsm_tcp_stream_get_saddr(net_parser, saddr);
+
+    return (memcmp(saddr, stream->saddr, len) == 0 ? 0 : 1);
+}
+
+
+struct fsm_tcp_stream_dir *
+fsm_tcp_stream_process(struct net_md_stats_accumulator *acc,
+                       struct net_header_parser *net_parser)
+{
+    struct fsm_tcp_stream *stream;
+    struct tcphdr *tcph;
+    size_t len;
+    bool rc;
+    int dir;
+
+    if (net_parser->ip_protocol != IPPROTO_TCP) return NULL;
+
+    tcph = net_parser->ip_pld.tcphdr;
+    if (tcph == NULL) return NULL;
+
+    stream = acc->tcp_stream;
+    if (stream == NULL)
+    {
+        stream = CALLOC(1, sizeof(*stream));
+        stream->sport = tcph->source;
+        stream->dport = tcph->dest;
+        stream->ip_version = net_parser->ip_version;
+        fsm_tcp_stream_get_saddr(net_parser, stream->saddr);
+        acc->tcp_stream = stream;
+    }
+
+    if (stream->released) return NULL;
+
+    dir = fsm_tcp_stream_get_dir(stream, net_parser);
+    len = net_parser->packet_len - net_parser->parsed;
+    rc = fsm_tcp_stream_add(stream, dir, ntohl(tcph->seq), tcph->syn,
+                            net_parser->data, len);
+    if (!rc) return NULL;
+
+    return &stream->dirs[dir];
+}
+
+
+void
+fsm_tcp_stream_release(struct net_md_stats_accumulator *acc)
+{
+    struct fsm_tcp_stream *stream;
+
+    stream = acc->tcp_stream;
+    if (stream == NULL) return;
+    if (stream->released) return;
+
+    fsm_tcp_stream_close(&stream->dirs[0]);
+    fsm_tcp_stream_close(&stream->dirs[1]);
+    stream->released = true;
+}
+
+
+void
+fsm_tcp_stream_free(struct net_md_stats_accumulator *acc)
+{
+    fsm_tcp_stream_release(acc);
+    FREE(acc->tcp_stream);
+    acc->tcp_stream = NULL;
+}
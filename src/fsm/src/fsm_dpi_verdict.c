@@ -0,0 +1,599 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ds_tree.h"
+#include "fsm.h"
+#include "fsm_dpi_utils.h"
+#include "fsm_internal.h"
+#include "kconfig.h"
+#include "log.h"
+#include "memutil.h"
+#include "net_header_parse.h"
+#include "network_metadata_report.h"
+#include "os.h"
+#include "util.h"
+
+#define FSM_DPI_VERDICT_MAGIC 0x46445643 /* FDVC */
+#define FSM_DPI_VERDICT_VERSION 1
+#define FSM_DPI_VERDICT_NAME_LEN 64
+#define FSM_DPI_VERDICT_BOOT_ID_LEN 40
+#define FSM_DPI_VERDICT_BOOT_ID_PATH "/proc/sys/kernel/random/boot_id"
+
+/* Restored verdicts not claimed by a flow within this delay are dropped */
+#define FSM_DPI_VERDICT_RESTORE_TTL 600
+
+/*
+ * Snapshot layout: a header followed by the records. Each record is
+ * followed by its plugin decisions.
+ */
+struct fsm_dpi_verdict_hdr
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t name_len;
+    uint32_t count;
+    char boot_id[FSM_DPI_VERDICT_BOOT_ID_LEN];
+};
+
+struct fsm_dpi_verdict_rec
+{
+    struct fsm_dpi_verdict_key key;
+    int32_t flow_marker;
+    int32_t dpi_done;
+    uint32_t num_plugins;
+};
+
+struct fsm_dpi_verdict_plugin
+{
+    int32_t decision;
+    char name[FSM_DPI_VERDICT_NAME_LEN];
+};
+
+/**
+ * @brief a flow whose verdict is part of the snapshot
+ */
+struct fsm_dpi_verdict_flow
+{
+    struct net_md_stats_accumulator *acc;
+    ds_tree_node_t node;
+};
+
+/**
+ * @brief a verdict loaded from the snapshot, waiting for its flow
+ */
+struct fsm_dpi_verdict_entry
+{
+    struct fsm_dpi_verdict_key key;
+    int flow_marker;
+    int dpi_done;
+    int num_plugins;
+    struct fsm_dpi_verdict_plugin *plugins;
+    ds_tree_node_t node;
+};
+
+static int
+fsm_dpi_verdict_key_cmp(const void *a, const void *b)
+{
+    return memcmp(a, b, sizeof(struct fsm_dpi_verdict_key));
+}
+
+static struct fsm_dpi_verdict_mgr
+{
+    bool initialized;
+    bool dirty;
+    time_t save_ts;
+    time_t load_ts;
+    ds_tree_t flows;      /* struct fsm_dpi_verdict_flow, keyed by accumulator */
+    ds_tree_t restored;   /* struct fsm_dpi_verdict_entry, keyed by 5-tuple */
+    struct fsm_dpi_verdict_stats stats;
+} verdict_mgr;
+
+
+static struct fsm_dpi_verdict_mgr *
+fsm_dpi_verdict_get_mgr(void)
+{
+    struct fsm_dpi_verdict_mgr *mgr = &verdict_mgr;
+
+    if (mgr->initialized) return mgr;
+
+    ds_tree_init(&mgr->flows, ds_void_cmp, struct fsm_dpi_verdict_flow, node);
+    ds_tree_init(&mgr->restored, fsm_dpi_verdict_key_cmp,
+                 struct fsm_dpi_verdict_entry, node);
+    mgr->initialized = true;
+
+    return mgr;
+}
+
+
+/**
+ * @brief reads the kernel boot id
+ *
+ * Conntrack entries, hence the snapshot, do not survive a reboot.
+ */
+static void
+fsm_dpi_verdict_get_boot_id(char *boot_id)
+{
+    ssize_t len;
+    int fd;
+
+    memset(boot_id, 0, FSM_DPI_VERDICT_BOOT_ID_LEN);
+
+    fd = open(FSM_DPI_VERDICT_BOOT_ID_PATH, O_RDONLY);
+    if (fd < 0) return;
+
+    len = read(fd, boot_id, FSM_DPI_VERDICT_BOOT_ID_LEN - 1);
+    if (len < 0) memset(boot_id, 0, FSM_DPI_VERDICT_BOOT_ID_LEN);
+    close(fd);
+}
+
+
+bool
+fsm_dpi_verdict_get_key(struct net_md_flow_key *fkey,
+                        struct fsm_dpi_verdict_key *key)
+{
+    size_t ip_len;
+
+    memset(key, 0, sizeof(*key));
+    if (fkey == NULL) return false;
+
+    if (fkey->ip_version == 4) ip_len = 4;
+    else if (fkey->ip_version == 6) ip_len = 16;
+    else return false;
+
+    if (fkey->src_ip == NULL || fkey->dst_ip == NULL) return false;
+
+    key->ip_version = fkey->ip_version;
+    key->ipprotocol = fkey->ipprotocol;
+    key->sport = fkey->sport;
+    key->dport = fkey->dport;
+    key->vlan_id = fkey->vlan_id;
+    memcpy(key->src_ip, fkey->src_ip, ip_len);
+    memcpy(key->dst_ip, fkey->dst_ip, ip_len);
+
+    return true;
+}
+
+
+static void
+fsm_dpi_verdict_reverse_key(struct fsm_dpi_verdict_key *key)
+{
+    uint8_t ip[sizeof(key->src_ip)];
+    uint16_t port;
+
+    memcpy(ip, key->src_ip, sizeof(ip));
+    memcpy(key->src_ip, key->dst_ip, sizeof(ip));
+    memcpy(key->dst_ip, ip, sizeof(ip));
+
+    port = key->sport;
+    key->sport = key->dport;
+    key->dport = port;
+}
+
+
+void
+fsm_dpi_verdict_record(struct net_md_stats_accumulator *acc)
+{
+    struct fsm_dpi_verdict_flow *flow;
+    struct fsm_dpi_verdict_mgr *mgr;
+
+    if (!kconfig_enabled(CONFIG_FSM_DPI_VERDICT_CACHE)) return;
+
+    mgr = fsm_dpi_verdict_get_mgr();
+
+    flow = ds_tree_find(&mgr->flows, acc);
+    if (flow != NULL) return;
+
+    flow = CALLOC(1, sizeof(*flow));
+    flow->acc = acc;
+    ds_tree_insert(&mgr->flows, flow, acc);
+    mgr->dirty = true;
+}
+
+
+void
+fsm_dpi_verdict_forget(struct net_md_stats_accumulator *acc)
+{
+    struct fsm_dpi_verdict_flow *flow;
+    struct fsm_dpi_verdict_mgr *mgr;
+
+    mgr = fsm_dpi_verdict_get_mgr();
+
+    flow = ds_tree_find(&mgr->flows, acc);
+    if (flow == NULL) return;
+
+    ds_tree_remove(&mgr->flows, flow);
+    FREE(flow);
+    mgr->dirty = true;
+}
+
+
+/**
+ * @brief writes a flow's verdict record
+ *
+ * @return true if a record was written
+ */
+static bool
+fsm_dpi_verdict_write_flow(FILE *fp, struct net_md_stats_accumulator *acc)
+{
+    struct fsm_dpi_verdict_plugin plugin;
+    struct fsm_dpi_verdict_rec rec;
+    struct fsm_dpi_flow_info *info;
+    size_t rc;
+
+    if (acc->dpi_done == FSM_DPI_CLEAR) return false;
+
+    MEMZERO(rec);
+    if (!fsm_dpi_verdict_get_key(acc->key, &rec.key)) return false;
+
+    rec.flow_marker = acc->flow_marker;
+    rec.dpi_done = acc->dpi_done;
+    if (acc->dpi_plugins != NULL)
+    {
+        ds_tree_foreach(acc->dpi_plugins, info) rec.num_plugins++;
+    }
+
+    rc = fwrite(&rec, sizeof(rec), 1, fp);
+    if (rc != 1) return false;
+
+    if (acc->dpi_plugins == NULL) return true;
+
+    ds_tree_foreach(acc->dpi_plugins, info)
+    {
+        MEMZERO(plugin);
+        plugin.decision = info->decision;
+        STRSCPY_WARN(plugin.name, info->session->name);
+        rc = fwrite(&plugin, sizeof(plugin), 1, fp);
+        if (rc != 1) return false;
+    }
+
+    return true;
+}
+
+
+bool
+fsm_dpi_verdict_save(const char *path)
+{
+    struct fsm_dpi_verdict_flow *flow;
+    struct fsm_dpi_verdict_mgr *mgr;
+    struct fsm_dpi_verdict_hdr hdr;
+    char tmp[PATH_MAX];
+    bool ret;
+    FILE *fp;
+
+    mgr = fsm_dpi_verdict_get_mgr();
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fp = fopen(tmp, "w");
+    if (fp == NULL)
+    {
+        LOGD("%s: failed to open %s: %s", __func__, tmp, strerror(errno));
+        return false;
+    }
+
+    MEMZERO(hdr);
+    hdr.magic = FSM_DPI_VERDICT_MAGIC;
+    hdr.version = FSM_DPI_VERDICT_VERSION;
+    hdr.name_len = FSM_DPI_VERDICT_NAME_LEN;
+    fsm_dpi_verdict_get_boot_id(hdr.boot_id);
+
+    ret = (fwrite(&hdr, sizeof(hdr), 1, fp) == 1);
+    ds_tree_foreach(&mgr->flows, flow)
+    {
+        if (!ret) break;
+        if (fsm_dpi_verdict_write_flow(fp, flow->acc)) hdr.count++;
+        ret = !ferror(fp);
+    }
+
+    /* Update the record count */
+    ret &= (fseek(fp, 0, SEEK_SET) == 0);
+    ret &= (fwrite(&hdr, sizeof(hdr), 1, fp) == 1);
+    ret &= (fclose(fp) == 0);
+    if (ret) ret = (rename(tmp, path) == 0);
+
+    if (!ret)
+    {
+        LOGW("%s: failed to save the flows verdicts to %s", __func__, path);
+        unlink(tmp);
+        return false;
+    }
+
+    mgr->dirty = false;
+    mgr->stats.saved = hdr.count;
+    LOGD("%s: saved %u flows verdicts to %s", __func__, hdr.count, path);
+
+    return true;
+}
+
+
+/**
+ * @brief validates and loads the snapshot records
+ *
+ * @return the number of loaded records, -1 if the snapshot is invalid
+ */
+static int
+fsm_dpi_verdict_parse(struct fsm_dpi_verdict_mgr *mgr, const uint8_t *map, size_t len)
+{
+    const struct fsm_dpi_verdict_hdr *hdr;
+    const struct fsm_dpi_verdict_rec *rec;
+    struct fsm_dpi_verdict_entry *entry;
+    char boot_id[FSM_DPI_VERDICT_BOOT_ID_LEN];
+    size_t plugins_len;
+    size_t off;
+    uint32_t i;
+    int count;
+
+    if (len < sizeof(*hdr)) return -1;
+
+    hdr = (const struct fsm_dpi_verdict_hdr *)map;
+    if (hdr->magic != FSM_DPI_VERDICT_MAGIC) return -1;
+    if (hdr->version != FSM_DPI_VERDICT_VERSION) return -1;
+    if (hdr->name_len != FSM_DPI_VERDICT_NAME_LEN) return -1;
+
+    fsm_dpi_verdict_get_boot_id(boot_id);
+    if (memcmp(boot_id, hdr->boot_id, sizeof(boot_id)) != 0)
+    {
+        LOGI("%s: discarding the flows verdicts of a previous boot", __func__);
+        return -1;
+    }
+
+    count = 0;
+    off = sizeof(*hdr);
+    for (i = 0; i < hdr->count; i++)
+    {
+        if (len - off < sizeof(*rec)) break;
+        rec = (const struct fsm_dpi_verdict_rec *)(map + off);
+        off += sizeof(*rec);
+
+        if (rec->num_plugins > (len - off) / sizeof(struct fsm_dpi_verdict_plugin)) break;
+        plugins_len = rec->num_plugins * sizeof(struct fsm_dpi_verdict_plugin);
+
+        if (ds_tree_find(&mgr->restored, (void *)&rec->key) != NULL)
+        {
+            off += plugins_len;
+            continue;
+        }
+
+        entry = CALLOC(1, sizeof(*entry));
+        entry->key = rec->key;
+        entry->flow_marker = rec->flow_marker;
+        entry->dpi_done = rec->dpi_done;
+        entry->num_plugins = rec->num_plugins;
+        if (plugins_len != 0) entry->plugins = MEMNDUP(map + off, plugins_len);
+        ds_tree_insert(&mgr->restored, entry, &entry->key);
+        off += plugins_len;
+        count++;
+    }
+
+    return count;
+}
+
+
+bool
+fsm_dpi_verdict_load(const char *path)
+{
+    struct fsm_dpi_verdict_mgr *mgr;
+    struct stat st;
+    void *map;
+    int count;
+    int fd;
+
+    mgr = fsm_dpi_verdict_get_mgr();
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        LOGW("%s: failed to map %s: %s", __func__, path, strerror(errno));
+        return false;
+    }
+
+    count = fsm_dpi_verdict_parse(mgr, map, st.st_size);
+    munmap(map, st.st_size);
+    if (count < 0) return false;
+
+    mgr->load_ts = time(NULL);
+    mgr->stats.loaded += count;
+    LOGI("%s: loaded %d flows verdicts from %s", __func__, count, path);
+
+    return true;
+}
+
+
+static void
+fsm_dpi_verdict_free_entry(struct fsm_dpi_verdict_mgr *mgr,
+                           struct fsm_dpi_verdict_entry *entry)
+{
+    ds_tree_remove(&mgr->restored, entry);
+    FREE(entry->plugins);
+    FREE(entry);
+}
+
+
+bool
+fsm_dpi_verdict_restore(struct net_md_stats_accumulator *acc,
+                        struct net_header_parser *net_parser)
+{
+    struct fsm_dpi_verdict_entry *entry;
+    struct fsm_dpi_verdict_mgr *mgr;
+    struct fsm_dpi_verdict_key key;
+    struct fsm_dpi_flow_info *info;
+    int mark;
+    int i;
+
+    mgr = fsm_dpi_verdict_get_mgr();
+    if (ds_tree_is_empty(&mgr->restored)) return false;
+
+    if (!fsm_dpi_verdict_get_key(acc->key, &key)) return false;
+
+    entry = ds_tree_find(&mgr->restored, &key);
+    if (entry == NULL)
+    {
+        fsm_dpi_verdict_reverse_key(&key);
+        entry = ds_tree_find(&mgr->restored, &key);
+    }
+    if (entry == NULL) return false;
+
+    /*
+     * Queued packets carry the conntrack mark. A mismatch means the
+     * conntrack entry was reset or reused by a new connection.
+     */
+    mark = fsm_dpi_get_mark(entry->flow_marker, entry->dpi_done);
+    if (net_parser->source == PKT_SOURCE_NFQ && net_parser->ct_mark != (uint32_t)mark)
+    {
+        LOGD("%s: conntrack mark %u does not match the restored mark %d",
+             __func__, net_parser->ct_mark, mark);
+        mgr->stats.mismatches++;
+        fsm_dpi_verdict_free_entry(mgr, entry);
+        return false;
+    }
+
+    acc->dpi_done = entry->dpi_done;
+    acc->flow_marker = entry->flow_marker;
+
+    if (acc->dpi_plugins != NULL)
+    {
+        ds_tree_foreach(acc->dpi_plugins, info)
+        {
+            for (i = 0; i < entry->num_plugins; i++)
+            {
+                if (strncmp(info->session->name, entry->plugins[i].name,
+                            FSM_DPI_VERDICT_NAME_LEN) != 0)
+                {
+                    continue;
+                }
+                info->decision = entry->plugins[i].decision;
+                break;
+            }
+        }
+    }
+
+    fsm_dpi_verdict_free_entry(mgr, entry);
+    fsm_dpi_verdict_record(acc);
+    mgr->stats.restored++;
+
+    return true;
+}
+
+
+void
+fsm_dpi_verdict_periodic(time_t now)
+{
+    struct fsm_dpi_verdict_entry *entry;
+    struct fsm_dpi_verdict_entry *next;
+    struct fsm_dpi_verdict_mgr *mgr;
+
+    if (!kconfig_enabled(CONFIG_FSM_DPI_VERDICT_CACHE)) return;
+
+    mgr = fsm_dpi_verdict_get_mgr();
+
+    /* Drop the verdicts of the flows gone while FSM was down */
+    if (!ds_tree_is_empty(&mgr->restored) &&
+        (now - mgr->load_ts) >= FSM_DPI_VERDICT_RESTORE_TTL)
+    {
+        entry = ds_tree_head(&mgr->restored);
+        while (entry != NULL)
+        {
+            next = ds_tree_next(&mgr->restored, entry);
+            fsm_dpi_verdict_free_entry(mgr, entry);
+            mgr->stats.expired++;
+            entry = next;
+        }
+    }
+
+    if (!mgr->dirty) return;
+    if ((now - mgr->save_ts) < CONFIG_FSM_DPI_VERDICT_CACHE_INTERVAL) return;
+
+    mgr->save_ts = now;
+    fsm_dpi_verdict_save(CONFIG_FSM_DPI_VERDICT_CACHE_PATH);
+}
+
+
+void
+fsm_dpi_verdict_init(void)
+{
+    if (!kconfig_enabled(CONFIG_FSM_DPI_VERDICT_CACHE)) return;
+
+    fsm_dpi_verdict_load(CONFIG_FSM_DPI_VERDICT_CACHE_PATH);
+}
+
+
+void
+fsm_dpi_verdict_exit(void)
+{
+    struct fsm_dpi_verdict_entry *entry;
+    struct fsm_dpi_verdict_flow *flow;
+    struct fsm_dpi_verdict_mgr *mgr;
+
+    mgr = fsm_dpi_verdict_get_mgr();
+
+    if (kconfig_enabled(CONFIG_FSM_DPI_VERDICT_CACHE) && mgr->dirty)
+    {
+        fsm_dpi_verdict_save(CONFIG_FSM_DPI_VERDICT_CACHE_PATH);
+    }
+
+    while ((flow = ds_tree_head(&mgr->flows)) != NULL)
+    {
+        ds_tree_remove(&mgr->flows, flow);
+        FREE(flow);
+    }
+
+    while ((entry = ds_tree_head(&mgr->restored)) != NULL)
+    {
+        fsm_dpi_verdict_free_entry(mgr, entry);
+    }
+    mgr->dirty = false;
+}
+
+
+void
+fsm_dpi_verdict_get_stats(struct fsm_dpi_verdict_stats *stats)
+{
+    struct fsm_dpi_verdict_mgr *mgr;
+
+    mgr = fsm_dpi_verdict_get_mgr();
+    *stats = mgr->stats;
+}
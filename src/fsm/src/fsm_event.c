@@ -41,6 +41,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "log.h"
 #include "fsm_fn_trace.h"
 #include "os_ev_trace.h"
+#include "ovsdb_cache.h"
 
 // Intervals and timeouts in seconds
 #define FSM_TIMER_INTERVAL 5
@@ -77,6 +78,7 @@ fsm_event_cb(struct ev_loop *loop, ev_timer *watcher, int revents)
     fsm_get_memory(&mem);
     LOGI("pid %s: mem usage: real mem: %u, virt mem %u",
          mgr->pid, mem.curr_real_mem, mem.curr_virt_mem);
+    ovsdb_cache_mem_report();
 
     reset = ((uint64_t)mem.curr_real_mem > mgr->max_mem);
     if (reset)
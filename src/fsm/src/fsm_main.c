@@ -36,6 +36,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <ev.h>
 #include <syslog.h>
 #include <getopt.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -55,6 +56,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "kconfig.h"
 #include "qm_conn.h"
 #include "fsm_fn_trace.h"
+#include "fsm_perf.h"
 #include "mem_monitor.h"
 #include "fsm_internal.h"
 
@@ -70,6 +72,18 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  *****************************************************************************/
 
 static log_severity_t  fsm_log_severity = LOG_SEVERITY_INFO;
+static ev_signal fsm_sigterm;
+
+
+/**
+ * @brief stops the main loop so FSM exits through its cleanup path
+ */
+static void
+fsm_sigterm_cb(struct ev_loop *loop, ev_signal *w, int revents)
+{
+    LOGN("FSM terminating");
+    ev_break(loop, EVBREAK_ALL);
+}
 
 
 /******************************************************************************
@@ -101,6 +115,13 @@ int main(int argc, char ** argv)
 
     fsm_init_mgr(loop);
     fsm_init_mem_monitor();
+    fsm_dpi_verdict_init();
+
+    ev_signal_init(&fsm_sigterm, fsm_sigterm_cb, SIGTERM);
+    ev_signal_start(loop, &fsm_sigterm);
+
+    /* SIGUSR1 dumps the packet path instrumentation stats */
+    fsm_perf_init(loop);
 
     backtrace_init();
 
@@ -166,6 +187,10 @@ int main(int argc, char ** argv)
 
     ev_run(loop, 0);
 
+    /* Let the next FSM instance resume the decided flows */
+    fsm_dpi_verdict_exit();
+    fsm_perf_exit();
+
     target_close(TARGET_INIT_MGR_FSM, loop);
 
     neigh_table_cleanup();
@@ -29,6 +29,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <netinet/in.h>
 #include "fsm_dpi_utils.h"
 #include "fsm_internal.h"
+#include "fsm_perf.h"
 #include "neigh_table.h"
 #include "sockaddr_storage.h"
 
@@ -54,6 +55,7 @@ fsm_nfq_net_header_parse(struct nfq_pkt_info *pkt_info, void *data)
     void *dst_ip;
     int domain;
     uint16_t ethertype;
+    uint64_t ts;
     int len = 0;
 
     MEMZERO(net_parser);
@@ -66,6 +68,7 @@ fsm_nfq_net_header_parse(struct nfq_pkt_info *pkt_info, void *data)
     net_parser.tx_vidx = pkt_info->tx_vidx;
     net_parser.rx_pidx = pkt_info->rx_pidx;
     net_parser.tx_pidx = pkt_info->tx_pidx;
+    net_parser.ct_mark = pkt_info->ct_mark;
 
     net_parser.payload_updated = false;
     net_parser.start = net_parser.data;
@@ -75,6 +78,7 @@ fsm_nfq_net_header_parse(struct nfq_pkt_info *pkt_info, void *data)
     net_parser.source = PKT_SOURCE_NFQ;
     net_parser.eth_header.ethertype = pkt_info->hw_protocol;
 
+    ts = fsm_perf_start();
     len = net_header_parse_ip(&net_parser);
     if (len == 0)
     {
@@ -111,6 +115,7 @@ fsm_nfq_net_header_parse(struct nfq_pkt_info *pkt_info, void *data)
         LOGT("%s: failed to parse protocol %x", __func__, ip_protocol);
         return;
     }
+    fsm_perf_stage_end(FSM_PERF_PARSE, ts);
 
     /* Account for the ethetnet header that will be prepended */
     net_parser.start -= ETH_HLEN;
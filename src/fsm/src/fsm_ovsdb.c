@@ -144,6 +144,7 @@ fsm_tag_update_cb(om_tag_t *tag,
 {
     network_zone_tag_update_cb(tag, removed, added, updated);
     fsm_process_tag_update(tag, removed, added, updated);
+    fsm_dpi_invalidate_plugin_slots();
     return true;
 }
 
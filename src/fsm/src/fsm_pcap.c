@@ -35,6 +35,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "log.h"
 #include "fsm.h"
 #include "fsm_internal.h"
+#include "fsm_perf.h"
 #include "json_util.h"
 #include "qm_conn.h"
 #include "os_types.h"
@@ -75,6 +76,7 @@ fsm_pcap_handler(uint8_t * args, const struct pcap_pkthdr *header,
     struct net_header_parser net_parser;
     struct fsm_parser_ops *parser_ops;
     struct fsm_session *session;
+    uint64_t ts;
     size_t len;
 
     if (header->caplen == 0) return;
@@ -88,8 +90,10 @@ fsm_pcap_handler(uint8_t * args, const struct pcap_pkthdr *header,
     net_parser.pcap_datalink = session->pcaps->pcap_datalink;
     net_parser.payload_updated = false;
     net_parser.tap_intf = session->conf->if_name;
+    ts = fsm_perf_start();
     len = net_header_parse(&net_parser);
     if (len == 0) return;
+    fsm_perf_stage_end(FSM_PERF_PARSE, ts);
 
     parser_ops = &session->p_ops->parser_ops;
     parser_ops->handler(session, &net_parser);
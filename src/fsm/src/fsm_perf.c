@@ -0,0 +1,413 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <ev.h>
+
+#include "const.h"
+#include "ds_tree.h"
+#include "fsm.h"
+#include "fsm_perf.h"
+#include "kconfig.h"
+#include "log.h"
+#include "os.h"
+#include "util.h"
+
+#ifdef CONFIG_FSM_IPC_USE_OSBUS
+#include "osbus.h"
+#endif
+
+bool g_fsm_perf_enabled;
+struct fsm_perf_hist g_fsm_perf_stages[FSM_PERF_NUM_STAGES];
+
+static const char *fsm_perf_stage_names[FSM_PERF_NUM_STAGES] =
+{
+    [FSM_PERF_PARSE] = "parse",
+    [FSM_PERF_FLOW] = "flow",
+    [FSM_PERF_DISPATCH] = "dispatch",
+    [FSM_PERF_VERDICT] = "verdict",
+    [FSM_PERF_PACKET] = "packet",
+};
+
+static struct fsm_perf_mgr
+{
+    struct ev_loop *loop;
+    ev_signal dump_sig;
+    bool initialized;
+    bool osbus_registered;
+} fsm_perf;
+
+
+void
+fsm_perf_hist_add(struct fsm_perf_hist *hist, uint64_t ns)
+{
+    int bucket;
+
+    bucket = 63 - __builtin_clzll(ns | 1);
+    if (bucket >= FSM_PERF_HIST_BUCKETS) bucket = FSM_PERF_HIST_BUCKETS - 1;
+
+    hist->buckets[bucket]++;
+    hist->count++;
+    hist->total_ns += ns;
+    if (ns > hist->max_ns) hist->max_ns = ns;
+}
+
+
+void
+fsm_perf_hist_end(struct fsm_perf_hist *hist, uint64_t start)
+{
+    uint64_t now;
+
+    now = fsm_perf_start();
+    /* Disabled while the probe was running */
+    if (now == 0) return;
+
+    fsm_perf_hist_add(hist, now - start);
+}
+
+
+void
+fsm_perf_plugin_add(struct fsm_session *session, uint64_t start)
+{
+    if (session->dpi == NULL) return;
+
+    fsm_perf_hist_end(&session->dpi->plugin.perf, start);
+}
+
+
+const char *
+fsm_perf_stage_name(enum fsm_perf_stage stage)
+{
+    if (stage >= FSM_PERF_NUM_STAGES) return "unknown";
+
+    return fsm_perf_stage_names[stage];
+}
+
+
+const struct fsm_perf_hist *
+fsm_perf_stage_get(enum fsm_perf_stage stage)
+{
+    if (stage >= FSM_PERF_NUM_STAGES) return NULL;
+
+    return &g_fsm_perf_stages[stage];
+}
+
+
+/**
+ * @brief walks the dpi plugin sessions
+ *
+ * @param fn called with each dpi plugin session and its histogram
+ * @param ctx passed to fn
+ */
+static void
+fsm_perf_foreach_plugin(void (*fn)(void *ctx, struct fsm_session *session,
+                                   struct fsm_perf_hist *hist),
+                        void *ctx)
+{
+    struct fsm_session *session;
+    ds_tree_t *sessions;
+
+    sessions = fsm_get_sessions();
+    if (sessions == NULL) return;
+
+    ds_tree_foreach(sessions, session)
+    {
+        if (session->type != FSM_DPI_PLUGIN) continue;
+        if (session->dpi == NULL) continue;
+
+        fn(ctx, session, &session->dpi->plugin.perf);
+    }
+}
+
+
+static void
+fsm_perf_reset_plugin(void *ctx, struct fsm_session *session,
+                      struct fsm_perf_hist *hist)
+{
+    MEMZERO(*hist);
+}
+
+
+void
+fsm_perf_reset(void)
+{
+    memset(g_fsm_perf_stages, 0, sizeof(g_fsm_perf_stages));
+    fsm_perf_foreach_plugin(fsm_perf_reset_plugin, NULL);
+}
+
+
+static void
+fsm_perf_dump_hist(const char *kind, const char *name,
+                   const struct fsm_perf_hist *hist)
+{
+    char buckets[FSM_PERF_HIST_BUCKETS * 24];
+    size_t len;
+    int i;
+
+    if (hist->count == 0) return;
+
+    buckets[0] = '\0';
+    len = 0;
+    for (i = 0; i < FSM_PERF_HIST_BUCKETS && len < sizeof(buckets); i++)
+    {
+        if (hist->buckets[i] == 0) continue;
+
+        /* Upper bound of the bucket, the last one is open */
+        if (i == FSM_PERF_HIST_BUCKETS - 1)
+        {
+            len += snprintf(buckets + len, sizeof(buckets) - len,
+                            " >=2^%d:%" PRIu64, i, hist->buckets[i]);
+        }
+        else
+        {
+            len += snprintf(buckets + len, sizeof(buckets) - len,
+                            " <2^%d:%" PRIu64, i + 1, hist->buckets[i]);
+        }
+    }
+
+    LOGI("%s: %s %s: count: %" PRIu64 ", avg: %" PRIu64 "ns, max: %" PRIu64
+         "ns, hist(ns):%s", __func__, kind, name, hist->count,
+         hist->total_ns / hist->count, hist->max_ns, buckets);
+}
+
+
+static void
+fsm_perf_dump_plugin(void *ctx, struct fsm_session *session,
+                     struct fsm_perf_hist *hist)
+{
+    fsm_perf_dump_hist("plugin", session->name, hist);
+}
+
+
+void
+fsm_perf_dump(void)
+{
+    int i;
+
+    LOGI("%s: packet path instrumentation %s", __func__,
+         g_fsm_perf_enabled ? "enabled" : "disabled");
+
+    for (i = 0; i < FSM_PERF_NUM_STAGES; i++)
+    {
+        fsm_perf_dump_hist("stage", fsm_perf_stage_names[i], &g_fsm_perf_stages[i]);
+    }
+
+    fsm_perf_foreach_plugin(fsm_perf_dump_plugin, NULL);
+}
+
+
+#ifdef CONFIG_FSM_IPC_USE_OSBUS
+
+static osbus_msg_policy_t fsm_perf_osbus_policy_perf_stats[] = {};
+static osbus_msg_policy_t fsm_perf_osbus_policy_perf_reset[] = {};
+
+
+static void
+fsm_perf_osbus_hist(osbus_msg_t *msg, const char *name,
+                    const struct fsm_perf_hist *hist)
+{
+    osbus_msg_t *buckets;
+    osbus_msg_t *obj;
+    int i;
+
+    obj = osbus_msg_set_prop_object(msg, name);
+    if (obj == NULL) return;
+
+    osbus_msg_set_prop_int64(obj, "count", hist->count);
+    osbus_msg_set_prop_int64(obj, "total_ns", hist->total_ns);
+    osbus_msg_set_prop_int64(obj, "max_ns", hist->max_ns);
+
+    buckets = osbus_msg_set_prop_array(obj, "buckets");
+    if (buckets == NULL) return;
+
+    for (i = 0; i < FSM_PERF_HIST_BUCKETS; i++)
+    {
+        osbus_msg_add_item_int64(buckets, hist->buckets[i]);
+    }
+}
+
+
+static void
+fsm_perf_osbus_plugin(void *ctx, struct fsm_session *session,
+                      struct fsm_perf_hist *hist)
+{
+    fsm_perf_osbus_hist(ctx, session->name, hist);
+}
+
+
+static bool
+fsm_perf_osbus_method_perf_stats(
+        osbus_handle_t handle,
+        char *method_name,
+        osbus_msg_t *msg,
+        osbus_msg_t **reply,
+        bool *defer_reply,
+        osbus_async_reply_t *reply_handle)
+{
+    osbus_msg_t *plugins;
+    osbus_msg_t *stages;
+    int i;
+
+    *reply = osbus_msg_new_object();
+    osbus_msg_set_prop_bool(*reply, "enabled", g_fsm_perf_enabled);
+
+    stages = osbus_msg_set_prop_object(*reply, "stages");
+    for (i = 0; stages != NULL && i < FSM_PERF_NUM_STAGES; i++)
+    {
+        fsm_perf_osbus_hist(stages, fsm_perf_stage_names[i], &g_fsm_perf_stages[i]);
+    }
+
+    plugins = osbus_msg_set_prop_object(*reply, "plugins");
+    if (plugins != NULL) fsm_perf_foreach_plugin(fsm_perf_osbus_plugin, plugins);
+
+    return true;
+}
+
+
+static bool
+fsm_perf_osbus_method_perf_reset(
+        osbus_handle_t handle,
+        char *method_name,
+        osbus_msg_t *msg,
+        osbus_msg_t **reply,
+        bool *defer_reply,
+        osbus_async_reply_t *reply_handle)
+{
+    fsm_perf_reset();
+    return true;
+}
+
+
+static osbus_method_t fsm_perf_osbus_methods[] = {
+    OSBUS_METHOD_ENTRY(fsm_perf_osbus, perf_stats),
+    OSBUS_METHOD_ENTRY(fsm_perf_osbus, perf_reset),
+};
+
+
+static void
+fsm_perf_osbus_register(void)
+{
+    if (fsm_perf.osbus_registered) return;
+
+    /* The bus connection may be shared with the FCM ipc, never closed here */
+    if (!osbus_default_handle() && !osbus_init())
+    {
+        LOGD("%s: osbus not available", __func__);
+        return;
+    }
+
+    if (!osbus_method_register(OSBUS_DEFAULT, fsm_perf_osbus_methods,
+                               ARRAY_LEN(fsm_perf_osbus_methods)))
+    {
+        LOGE("%s: failed to register osbus methods", __func__);
+        return;
+    }
+
+    fsm_perf.osbus_registered = true;
+}
+
+
+static void
+fsm_perf_osbus_unregister(void)
+{
+    if (!fsm_perf.osbus_registered) return;
+
+    osbus_method_unregister(OSBUS_DEFAULT, fsm_perf_osbus_methods,
+                            ARRAY_LEN(fsm_perf_osbus_methods));
+    fsm_perf.osbus_registered = false;
+}
+
+#else
+
+static void
+fsm_perf_osbus_register(void)
+{
+}
+
+
+static void
+fsm_perf_osbus_unregister(void)
+{
+}
+
+#endif /* CONFIG_FSM_IPC_USE_OSBUS */
+
+
+void
+fsm_perf_set_enabled(bool enable)
+{
+    if (enable == g_fsm_perf_enabled) return;
+
+    LOGI("%s: packet path instrumentation %s", __func__,
+         enable ? "enabled" : "disabled");
+
+    if (enable)
+    {
+        fsm_perf_reset();
+        /* Only export the stats from the FSM main process */
+        if (fsm_perf.initialized) fsm_perf_osbus_register();
+    }
+
+    g_fsm_perf_enabled = enable;
+}
+
+
+static void
+fsm_perf_dump_cb(struct ev_loop *loop, ev_signal *w, int revents)
+{
+    fsm_perf_dump();
+}
+
+
+void
+fsm_perf_init(struct ev_loop *loop)
+{
+    if (fsm_perf.initialized) return;
+
+    fsm_perf.loop = loop;
+    ev_signal_init(&fsm_perf.dump_sig, fsm_perf_dump_cb, SIGUSR1);
+    ev_signal_start(loop, &fsm_perf.dump_sig);
+    fsm_perf.initialized = true;
+}
+
+
+void
+fsm_perf_exit(void)
+{
+    g_fsm_perf_enabled = false;
+    fsm_perf_osbus_unregister();
+
+    if (!fsm_perf.initialized) return;
+
+    ev_signal_stop(fsm_perf.loop, &fsm_perf.dump_sig);
+    fsm_perf.initialized = false;
+}
@@ -25,10 +25,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <arpa/inet.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <net/if.h>
 
@@ -42,8 +44,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "unity.h"
 #include "unit_test_utils.h"
 #include "fsm_fn_trace.h"
+#include "fsm_perf.h"
 #include "kconfig.h"
 #include "nfe.h"
+#include "nf_utils.h"
 
 #include "pcap.c"
 
@@ -1669,6 +1673,388 @@ test_dpi_dispatch_delete(void)
 }
 
 
+/**
+ * @brief validate the tcp stream reassembly
+ *
+ * Feeds a stream split in segments delivered out of order, retransmitted
+ * and overlapping, and validates the contiguous bytes and the release of
+ * the buffers.
+ */
+void
+test_dpi_tcp_stream(void)
+{
+    struct net_md_stats_accumulator acc;
+    struct fsm_tcp_stream_stats stats;
+    struct fsm_tcp_stream_dir *sdir;
+    struct fsm_tcp_stream *stream;
+    const char *msg = "GET /index.html HTTP/1.1\r\nHost: www.example.com\r\n\r\n";
+    uint32_t isn = 0xfffffff0; /* exercise the sequence wrap around */
+    size_t msg_len;
+    size_t used;
+    bool rc;
+    int i;
+
+    memset(&acc, 0, sizeof(acc));
+    msg_len = strlen(msg);
+
+    stream = CALLOC(1, sizeof(*stream));
+    acc.tcp_stream = stream;
+    fsm_tcp_stream_get_stats(&stats);
+    used = stats.mem_used;
+    TEST_ASSERT_TRUE(stats.buf_size >= msg_len);
+
+    /* SYN */
+    rc = fsm_tcp_stream_add(stream, 0, isn, true, NULL, 0);
+    TEST_ASSERT_TRUE(rc);
+    sdir = &stream->dirs[0];
+    TEST_ASSERT_EQUAL_UINT32(isn + 1, sdir->isn);
+
+    /* Third segment first */
+    rc = fsm_tcp_stream_add(stream, 0, isn + 1 + 30, false, (const uint8_t *)msg + 30, msg_len - 30);
+    TEST_ASSERT_TRUE(rc);
+    TEST_ASSERT_EQUAL_INT(0, sdir->len);
+    TEST_ASSERT_EQUAL_INT(1, sdir->num_ooo);
+
+    /* First segment */
+    rc = fsm_tcp_stream_add(stream, 0, isn + 1, false, (const uint8_t *)msg, 10);
+    TEST_ASSERT_TRUE(rc);
+    TEST_ASSERT_EQUAL_INT(10, sdir->len);
+    TEST_ASSERT_EQUAL_MEMORY(msg, sdir->buf, 10);
+
+    /* Retransmission of the first segment, overlapping the second one */
+    rc = fsm_tcp_stream_add(stream, 0, isn + 1, false, (const uint8_t *)msg, 20);
+    TEST_ASSERT_TRUE(rc);
+    TEST_ASSERT_EQUAL_INT(20, sdir->len);
+
+    /* The second segment fills the hole */
+    rc = fsm_tcp_stream_add(stream, 0, isn + 1 + 10, false, (const uint8_t *)msg + 10, 20);
+    TEST_ASSERT_TRUE(rc);
+    TEST_ASSERT_EQUAL_INT(msg_len, sdir->len);
+    TEST_ASSERT_EQUAL_INT(0, sdir->num_ooo);
+    TEST_ASSERT_EQUAL_MEMORY(msg, sdir->buf, msg_len);
+    fsm_tcp_stream_get_stats(&stats);
+    TEST_ASSERT_EQUAL_INT(used + stats.buf_size, stats.mem_used);
+
+    /* An overlapping retransmit with different bytes keeps the received prefix */
+    rc = fsm_tcp_stream_add(stream, 0, isn + 1 + msg_len - 4, false, (const uint8_t *)"XXXXYY", 6);
+    TEST_ASSERT_TRUE(rc);
+    TEST_ASSERT_EQUAL_INT(msg_len + 2, sdir->len);
+    TEST_ASSERT_EQUAL_MEMORY(msg, sdir->buf, msg_len);
+    TEST_ASSERT_EQUAL_MEMORY("YY", sdir->buf + msg_len, 2);
+
+    /* The other direction starts mid stream */
+    rc = fsm_tcp_stream_add(stream, 1, 1000, false, (const uint8_t *)msg, 4);
+    TEST_ASSERT_TRUE(rc);
+    TEST_ASSERT_EQUAL_INT(4, stream->dirs[1].len);
+
+    /* Segments beyond the per flow cap close the direction */
+    rc = fsm_tcp_stream_add(stream, 1, 1000 + stats.buf_size, false, (const uint8_t *)msg, 4);
+    TEST_ASSERT_FALSE(rc);
+    TEST_ASSERT_TRUE(stream->dirs[1].closed);
+    TEST_ASSERT_NULL(stream->dirs[1].buf);
+    rc = fsm_tcp_stream_add(stream, 1, 1004, false, (const uint8_t *)msg, 4);
+    TEST_ASSERT_FALSE(rc);
+
+    /* Too many holes close the direction */
+    fsm_tcp_stream_release(&acc);
+    TEST_ASSERT_TRUE(stream->released);
+    memset(stream, 0, sizeof(*stream));
+    rc = fsm_tcp_stream_add(stream, 0, 0, false, NULL, 0);
+    TEST_ASSERT_TRUE(rc);
+    for (i = 0; i < FSM_TCP_STREAM_OOO_MAX; i++)
+    {
+        rc = fsm_tcp_stream_add(stream, 0, 2 * (i + 1), false, (const uint8_t *)msg, 1);
+        TEST_ASSERT_TRUE(rc);
+    }
+    rc = fsm_tcp_stream_add(stream, 0, 2 * (FSM_TCP_STREAM_OOO_MAX + 1), false, (const uint8_t *)msg, 1);
+    TEST_ASSERT_FALSE(rc);
+
+    /* All the buffers are back in the pool and no longer count as used */
+    fsm_tcp_stream_free(&acc);
+    TEST_ASSERT_NULL(acc.tcp_stream);
+    fsm_tcp_stream_get_stats(&stats);
+    TEST_ASSERT_EQUAL_INT(used, stats.mem_used);
+    TEST_ASSERT_TRUE(stats.pooled > 0);
+    fsm_tcp_stream_pool_flush();
+    fsm_tcp_stream_get_stats(&stats);
+    TEST_ASSERT_EQUAL_INT(used, stats.mem_used);
+    TEST_ASSERT_EQUAL_INT(0, stats.pooled);
+}
+
+
+static struct
+{
+    struct fsm_session *expected;
+    uint64_t calls;
+    uint64_t packet_calls;
+    uint8_t stream[256];
+    size_t len;
+} g_stream_dpi;
+
+static void
+test_stream_dpi_handler(struct fsm_session *session,
+                        struct net_header_parser *net_parser)
+{
+    size_t len;
+
+    TEST_ASSERT_TRUE(session == g_stream_dpi.expected);
+    g_stream_dpi.calls++;
+
+    /* The plugin sees the whole reassembled stream */
+    len = net_parser->packet_len - net_parser->parsed;
+    TEST_ASSERT_TRUE(len <= sizeof(g_stream_dpi.stream));
+    memcpy(g_stream_dpi.stream, net_parser->data, len);
+    g_stream_dpi.len = len;
+}
+
+static void
+test_stream_dpi_packet_handler(struct fsm_session *session,
+                               struct net_header_parser *net_parser)
+{
+    g_stream_dpi.packet_calls++;
+}
+
+
+/**
+ * @brief replays a tcp segment through the dispatcher
+ *
+ * @param pkt the frame, a copy of pkt372
+ * @param seq_delta added to the original sequence number
+ * @param fill if not 0, overwrites the tcp payload
+ */
+static void
+test_stream_dispatch_pkt(struct fsm_session *dispatcher,
+                         struct net_header_parser *net_parser,
+                         uint8_t *pkt, uint32_t seq_delta, uint8_t fill)
+{
+    struct fsm_parser_ops *dispatch_ops;
+    uint32_t seq;
+    size_t len;
+
+    memcpy(pkt, pkt372, sizeof(pkt372));
+    /* Use a flow of its own: source port + 1 */
+    pkt[35]++;
+    /* The tcp header starts after the ethernet and ip headers */
+    memcpy(&seq, pkt + 14 + 20 + 4, sizeof(seq));
+    seq = htonl(ntohl(seq) + seq_delta);
+    memcpy(pkt + 14 + 20 + 4, &seq, sizeof(seq));
+
+    net_parser->packet_len = sizeof(pkt372);
+    net_parser->caplen = sizeof(pkt372);
+    net_parser->data = pkt;
+    len = net_header_parse(net_parser);
+    TEST_ASSERT_TRUE(len != 0);
+    if (fill != 0) memset(pkt + net_parser->parsed, fill, sizeof(pkt372) - net_parser->parsed);
+
+    dispatch_ops = &dispatcher->p_ops->parser_ops;
+    dispatch_ops->handler(dispatcher, net_parser);
+}
+
+
+/**
+ * @brief validate the dispatch of a reassembled stream to a dpi plugin
+ *
+ * Registers a plugin providing a stream handler, and validates that the
+ * dispatcher hands it the reassembled stream instead of the packets,
+ * only when new bytes are available, and that the stream buffers are
+ * released when the dispatcher is torn down.
+ */
+void
+test_dpi_stream_dispatch(void)
+{
+    struct schema_Flow_Service_Manager_Config *conf;
+    struct fsm_dpi_dispatcher *dpi_dispatcher;
+    struct net_header_parser *net_parser;
+    struct fsm_tcp_stream_stats stats;
+    struct fsm_session *dispatcher;
+    struct fsm_session *plugin;
+    uint8_t pkt[sizeof(pkt372)];
+    size_t payload_len;
+    ds_tree_t *sessions;
+    size_t used;
+
+    fsm_tcp_stream_get_stats(&stats);
+    used = stats.mem_used;
+
+    /* Add a dpi plugin session providing a stream handler */
+    conf = &g_confs[7];
+    fsm_add_session(conf);
+    sessions = fsm_get_sessions();
+    plugin = ds_tree_find(sessions, conf->handler);
+    TEST_ASSERT_NOT_NULL(plugin);
+    plugin->p_ops->dpi_plugin_ops.handler = test_stream_dpi_packet_handler;
+    plugin->p_ops->dpi_plugin_ops.stream_handler = test_stream_dpi_handler;
+    MEMZERO(g_stream_dpi);
+    g_stream_dpi.expected = plugin;
+
+    /* Add a dpi dispatcher session */
+    conf = &g_confs[6];
+    fsm_add_session(conf);
+    dispatcher = ds_tree_find(sessions, conf->handler);
+    TEST_ASSERT_NOT_NULL(dispatcher);
+    TEST_ASSERT_NOT_NULL(dispatcher->dpi);
+    dpi_dispatcher = &dispatcher->dpi->dispatch;
+    dpi_dispatcher->aggr->send_report = test_send_report;
+    net_parser = &dpi_dispatcher->net_parser;
+
+    /* Rebuild the flows' plugin slots with the stream handler */
+    fsm_dpi_invalidate_plugin_slots();
+
+    /* First segment */
+    test_stream_dispatch_pkt(dispatcher, net_parser, pkt, 0, 0);
+    payload_len = sizeof(pkt372) - net_parser->parsed;
+    TEST_ASSERT_NOT_NULL(net_parser->acc);
+    TEST_ASSERT_NOT_NULL(net_parser->acc->tcp_stream);
+    TEST_ASSERT_EQUAL_UINT64(1, g_stream_dpi.calls);
+    TEST_ASSERT_EQUAL_UINT64(0, g_stream_dpi.packet_calls);
+    TEST_ASSERT_EQUAL_INT(payload_len, g_stream_dpi.len);
+    TEST_ASSERT_EQUAL_MEMORY(pkt372 + net_parser->parsed, g_stream_dpi.stream, payload_len);
+
+    /* A plain retransmission brings no new bytes */
+    test_stream_dispatch_pkt(dispatcher, net_parser, pkt, 0, 0);
+    TEST_ASSERT_EQUAL_UINT64(1, g_stream_dpi.calls);
+
+    /*
+     * An overlapping retransmission with different bytes extends the
+     * stream, the delivered bytes are kept
+     */
+    test_stream_dispatch_pkt(dispatcher, net_parser, pkt, 10, 'X');
+    TEST_ASSERT_EQUAL_UINT64(2, g_stream_dpi.calls);
+    TEST_ASSERT_EQUAL_INT(payload_len + 10, g_stream_dpi.len);
+    TEST_ASSERT_EQUAL_MEMORY(pkt372 + net_parser->parsed, g_stream_dpi.stream, payload_len);
+    TEST_ASSERT_EQUAL_MEMORY("XXXXXXXXXX", g_stream_dpi.stream + payload_len, 10);
+    TEST_ASSERT_EQUAL_UINT64(0, g_stream_dpi.packet_calls);
+
+    fsm_tcp_stream_get_stats(&stats);
+    TEST_ASSERT_EQUAL_INT(used + stats.buf_size, stats.mem_used);
+
+    /* Tearing down the dispatcher releases the flows and the pooled buffers */
+    conf = &g_confs[6];
+    fsm_delete_session(conf);
+    fsm_tcp_stream_get_stats(&stats);
+    TEST_ASSERT_EQUAL_INT(used, stats.mem_used);
+    TEST_ASSERT_EQUAL_INT(0, stats.pooled);
+
+    /* Remove the dpi plugin session */
+    plugin->p_ops->dpi_plugin_ops.stream_handler = NULL;
+    conf = &g_confs[7];
+    fsm_delete_session(conf);
+}
+
+
+/**
+ * @brief validate the flows verdicts snapshot
+ *
+ * Saves the verdict of a decided flow, reloads it as a restarted FSM
+ * would, and validates that the verdict is resumed by the flow seen in
+ * either direction, unless contradicted by the conntrack mark.
+ */
+void
+test_dpi_verdict_cache(void)
+{
+    const char *path = "/tmp/test_fsm_dpi_verdicts";
+    struct net_md_stats_accumulator new_acc;
+    struct net_md_stats_accumulator acc;
+    struct fsm_dpi_verdict_stats stats;
+    struct fsm_dpi_flow_info new_info;
+    struct net_header_parser parser;
+    struct fsm_dpi_flow_info info;
+    struct net_md_flow_key new_key;
+    struct net_md_flow_key key;
+    struct fsm_session session;
+    ds_tree_t new_plugins;
+    ds_tree_t plugins;
+    uint8_t sip[4] = { 192, 168, 40, 2 };
+    uint8_t dip[4] = { 8, 8, 8, 8 };
+    bool rc;
+
+    if (!kconfig_enabled(CONFIG_FSM_DPI_VERDICT_CACHE))
+    {
+        TEST_IGNORE_MESSAGE("flows verdicts snapshot disabled");
+    }
+
+    memset(&session, 0, sizeof(session));
+    session.name = "test_dpi_plugin";
+
+    /* A flow decided by a plugin */
+    memset(&key, 0, sizeof(key));
+    key.ip_version = 4;
+    key.ipprotocol = IPPROTO_TCP;
+    key.src_ip = sip;
+    key.dst_ip = dip;
+    key.sport = htons(40000);
+    key.dport = htons(443);
+
+    memset(&acc, 0, sizeof(acc));
+    acc.key = &key;
+    ds_tree_init(&plugins, ds_void_cmp, struct fsm_dpi_flow_info, dpi_node);
+    memset(&info, 0, sizeof(info));
+    info.session = &session;
+    info.decision = FSM_DPI_PASSTHRU;
+    ds_tree_insert(&plugins, &info, &session);
+    acc.dpi_plugins = &plugins;
+    acc.dpi_done = FSM_DPI_PASSTHRU;
+    acc.flow_marker = CT_MARK_ACCEPT;
+
+    fsm_dpi_verdict_record(&acc);
+    rc = fsm_dpi_verdict_save(path);
+    TEST_ASSERT_TRUE(rc);
+    fsm_dpi_verdict_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.saved);
+
+    /* FSM restarts */
+    fsm_dpi_verdict_forget(&acc);
+    rc = fsm_dpi_verdict_load(path);
+    TEST_ASSERT_TRUE(rc);
+
+    /* The flow's first packet is a reply */
+    memset(&new_key, 0, sizeof(new_key));
+    new_key.ip_version = 4;
+    new_key.ipprotocol = IPPROTO_TCP;
+    new_key.src_ip = dip;
+    new_key.dst_ip = sip;
+    new_key.sport = htons(443);
+    new_key.dport = htons(40000);
+
+    memset(&new_acc, 0, sizeof(new_acc));
+    new_acc.key = &new_key;
+    ds_tree_init(&new_plugins, ds_void_cmp, struct fsm_dpi_flow_info, dpi_node);
+    memset(&new_info, 0, sizeof(new_info));
+    new_info.session = &session;
+    ds_tree_insert(&new_plugins, &new_info, &session);
+    new_acc.dpi_plugins = &new_plugins;
+
+    /* A queued packet whose conntrack mark was reset */
+    memset(&parser, 0, sizeof(parser));
+    parser.source = PKT_SOURCE_NFQ;
+    parser.ct_mark = CT_MARK_INSPECT;
+    rc = fsm_dpi_verdict_restore(&new_acc, &parser);
+    TEST_ASSERT_FALSE(rc);
+    TEST_ASSERT_EQUAL_INT(FSM_DPI_CLEAR, new_acc.dpi_done);
+
+    /* Reload, the conntrack mark now matches */
+    rc = fsm_dpi_verdict_load(path);
+    TEST_ASSERT_TRUE(rc);
+    parser.ct_mark = CT_MARK_ACCEPT;
+    rc = fsm_dpi_verdict_restore(&new_acc, &parser);
+    TEST_ASSERT_TRUE(rc);
+    TEST_ASSERT_EQUAL_INT(FSM_DPI_PASSTHRU, new_acc.dpi_done);
+    TEST_ASSERT_EQUAL_INT(CT_MARK_ACCEPT, new_acc.flow_marker);
+    TEST_ASSERT_EQUAL_INT(FSM_DPI_PASSTHRU, new_info.decision);
+
+    /* The verdict is only resumed once */
+    rc = fsm_dpi_verdict_restore(&new_acc, &parser);
+    TEST_ASSERT_FALSE(rc);
+
+    fsm_dpi_verdict_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT64(1, stats.mismatches);
+    TEST_ASSERT_EQUAL_UINT64(1, stats.restored);
+
+    fsm_dpi_verdict_forget(&new_acc);
+    unlink(path);
+}
+
+
 /**
  * @brief validate the timing out of a flow
  *
@@ -1774,6 +2160,283 @@ test_4_dpi_dispatcher_and_plugin(void)
 }
 
 
+static struct
+{
+    struct fsm_session *expected;
+    uint64_t dispatched;
+    uint64_t misdispatched;
+} g_bench_dpi;
+
+static void
+test_bench_dpi_handler(struct fsm_session *session,
+                       struct net_header_parser *net_parser)
+{
+    if (session == g_bench_dpi.expected) g_bench_dpi.dispatched++;
+    else g_bench_dpi.misdispatched++;
+}
+
+
+/**
+ * @brief measure the per packet cost of the dpi dispatch
+ *
+ * Replays the same packet through the dispatcher, validates that the
+ * flow's plugin slots are built once and reused, and that every packet
+ * is accounted to the flow and handed to the dpi plugin. Reports the
+ * average dispatch time per packet.
+ */
+void
+test_dpi_dispatch_bench(void)
+{
+    struct schema_Flow_Service_Manager_Config *conf;
+    union fsm_dpi_context *dispatcher_dpi_context;
+    struct fsm_dpi_plugin_slots *slots;
+    struct fsm_dpi_dispatcher *dpi_dispatcher;
+    struct net_header_parser *net_parser;
+    struct fsm_parser_ops *dispatch_ops;
+    struct fsm_session *dispatcher;
+    struct fsm_session *plugin;
+    struct timespec start;
+    struct timespec end;
+    ds_tree_t *sessions;
+    uint64_t packets;
+    int64_t elapsed_ns;
+    const int loops = 10000;
+    size_t len;
+    int i;
+
+    /* Add a dpi plugin session */
+    conf = &g_confs[7];
+    fsm_add_session(conf);
+    sessions = fsm_get_sessions();
+    plugin = ds_tree_find(sessions, conf->handler);
+    TEST_ASSERT_NOT_NULL(plugin);
+    plugin->p_ops->dpi_plugin_ops.handler = test_bench_dpi_handler;
+    MEMZERO(g_bench_dpi);
+    g_bench_dpi.expected = plugin;
+
+    /* Add a dpi dispatcher session */
+    conf = &g_confs[6];
+    fsm_add_session(conf);
+    dispatcher = ds_tree_find(sessions, conf->handler);
+    TEST_ASSERT_NOT_NULL(dispatcher);
+
+    dispatcher_dpi_context = dispatcher->dpi;
+    TEST_ASSERT_NOT_NULL(dispatcher_dpi_context);
+    dpi_dispatcher = &dispatcher_dpi_context->dispatch;
+    net_parser = &dpi_dispatcher->net_parser;
+    dpi_dispatcher->aggr->send_report = test_send_report;
+    dispatch_ops = &dispatcher->p_ops->parser_ops;
+    TEST_ASSERT_NOT_NULL(dispatch_ops->handler);
+
+    /* Create the flow */
+    UT_CREATE_PCAP_PAYLOAD(pkt372, net_parser);
+    len = net_header_parse(net_parser);
+    TEST_ASSERT_TRUE(len != 0);
+    dispatch_ops->handler(dispatcher, net_parser);
+    TEST_ASSERT_NOT_NULL(net_parser->acc);
+
+    /* Validate that the flow's plugin slots got built */
+    slots = net_parser->acc->dpi_slots;
+    TEST_ASSERT_NOT_NULL(slots);
+    TEST_ASSERT_EQUAL_INT(1, slots->num_slots);
+
+    packets = net_parser->acc->counters.packets_count;
+    g_bench_dpi.dispatched = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < loops; i++)
+    {
+        /* Avoid the payload file dump of UT_CREATE_PCAP_PAYLOAD */
+        net_parser->packet_len = sizeof(pkt372);
+        net_parser->caplen = sizeof(pkt372);
+        net_parser->data = (uint8_t *)pkt372;
+        net_header_parse(net_parser);
+        dispatch_ops->handler(dispatcher, net_parser);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    /* Validate that the slots were reused */
+    TEST_ASSERT_TRUE(net_parser->acc->dpi_slots == slots);
+
+    /* Every packet was accounted to the flow and seen by the plugin */
+    TEST_ASSERT_EQUAL_UINT64(packets + loops, net_parser->acc->counters.packets_count);
+    TEST_ASSERT_EQUAL_UINT64(loops, g_bench_dpi.dispatched);
+    TEST_ASSERT_EQUAL_UINT64(0, g_bench_dpi.misdispatched);
+
+    elapsed_ns = (end.tv_sec - start.tv_sec) * 1000000000LL;
+    elapsed_ns += (end.tv_nsec - start.tv_nsec);
+    LOGI("%s: %d packets dispatched, %" PRId64 " ns/packet", __func__,
+         loops, elapsed_ns / loops);
+
+    /* A tag update invalidates the slots */
+    fsm_dpi_invalidate_plugin_slots();
+    UT_CREATE_PCAP_PAYLOAD(pkt372, net_parser);
+    net_header_parse(net_parser);
+    dispatch_ops->handler(dispatcher, net_parser);
+    TEST_ASSERT_NOT_NULL(net_parser->acc->dpi_slots);
+    TEST_ASSERT_EQUAL_INT(1, ((struct fsm_dpi_plugin_slots *)net_parser->acc->dpi_slots)->num_slots);
+    TEST_ASSERT_EQUAL_UINT64(loops + 1, g_bench_dpi.dispatched);
+
+    /* Remove the dpi plugin session */
+    conf = &g_confs[7];
+    fsm_delete_session(conf);
+}
+
+
+/**
+ * @brief validate the log2 bucketing of the latency histograms
+ */
+void
+test_fsm_perf_hist(void)
+{
+    struct fsm_perf_hist hist;
+
+    MEMZERO(hist);
+    fsm_perf_hist_add(&hist, 0);
+    fsm_perf_hist_add(&hist, 1);
+    fsm_perf_hist_add(&hist, 3);
+    fsm_perf_hist_add(&hist, 1023);
+    fsm_perf_hist_add(&hist, 1024);
+    fsm_perf_hist_add(&hist, 1ULL << 40);
+
+    TEST_ASSERT_EQUAL_UINT64(6, hist.count);
+    TEST_ASSERT_EQUAL_UINT64(1ULL << 40, hist.max_ns);
+    TEST_ASSERT_EQUAL_UINT64(2051 + (1ULL << 40), hist.total_ns);
+    TEST_ASSERT_EQUAL_UINT64(2, hist.buckets[0]);
+    TEST_ASSERT_EQUAL_UINT64(1, hist.buckets[1]);
+    TEST_ASSERT_EQUAL_UINT64(1, hist.buckets[9]);
+    TEST_ASSERT_EQUAL_UINT64(1, hist.buckets[10]);
+    /* Samples past the last bucket are clamped into it */
+    TEST_ASSERT_EQUAL_UINT64(1, hist.buckets[FSM_PERF_HIST_BUCKETS - 1]);
+}
+
+
+static void
+test_perf_dpi_handler(struct fsm_session *session,
+                      struct net_header_parser *net_parser)
+{
+}
+
+
+/**
+ * @brief validate the packet path instrumentation
+ *
+ * Replays the same packet through the dispatcher with the
+ * instrumentation disabled, then enabled. Validates that nothing is
+ * accounted while disabled, and that every packet is accounted in the
+ * stages and the dpi plugin histogram once enabled. Reports the per
+ * packet cost of both modes.
+ */
+void
+test_dpi_perf_stats(void)
+{
+    struct schema_Flow_Service_Manager_Config *conf;
+    union fsm_dpi_context *dispatcher_dpi_context;
+    struct fsm_dpi_dispatcher *dpi_dispatcher;
+    struct net_header_parser *net_parser;
+    struct fsm_parser_ops *dispatch_ops;
+    const struct fsm_perf_hist *dispatch;
+    struct fsm_session *dispatcher;
+    struct fsm_session *plugin;
+    int64_t elapsed_ns[2];
+    struct timespec start;
+    struct timespec end;
+    ds_tree_t *sessions;
+    const int loops = 10000;
+    int enabled;
+    int i;
+
+    /* Add a dpi plugin session */
+    conf = &g_confs[7];
+    fsm_add_session(conf);
+    sessions = fsm_get_sessions();
+    plugin = ds_tree_find(sessions, conf->handler);
+    TEST_ASSERT_NOT_NULL(plugin);
+    plugin->p_ops->dpi_plugin_ops.handler = test_perf_dpi_handler;
+
+    /* Add a dpi dispatcher session */
+    conf = &g_confs[6];
+    fsm_add_session(conf);
+    dispatcher = ds_tree_find(sessions, conf->handler);
+    TEST_ASSERT_NOT_NULL(dispatcher);
+
+    dispatcher_dpi_context = dispatcher->dpi;
+    TEST_ASSERT_NOT_NULL(dispatcher_dpi_context);
+    dpi_dispatcher = &dispatcher_dpi_context->dispatch;
+    net_parser = &dpi_dispatcher->net_parser;
+    dpi_dispatcher->aggr->send_report = test_send_report;
+    dispatch_ops = &dispatcher->p_ops->parser_ops;
+
+    /* The dispatcher's other_config does not enable it */
+    TEST_ASSERT_FALSE(g_fsm_perf_enabled);
+
+    /* Create the flow */
+    UT_CREATE_PCAP_PAYLOAD(pkt372, net_parser);
+    net_header_parse(net_parser);
+    dispatch_ops->handler(dispatcher, net_parser);
+    TEST_ASSERT_NOT_NULL(net_parser->acc);
+
+    for (enabled = 0; enabled < 2; enabled++)
+    {
+        fsm_perf_set_enabled(enabled);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < loops; i++)
+        {
+            /* Avoid the payload file dump of UT_CREATE_PCAP_PAYLOAD */
+            net_parser->packet_len = sizeof(pkt372);
+            net_parser->caplen = sizeof(pkt372);
+            net_parser->data = (uint8_t *)pkt372;
+            net_header_parse(net_parser);
+            dispatch_ops->handler(dispatcher, net_parser);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        elapsed_ns[enabled] = (end.tv_sec - start.tv_sec) * 1000000000LL;
+        elapsed_ns[enabled] += (end.tv_nsec - start.tv_nsec);
+
+        if (!enabled)
+        {
+            TEST_ASSERT_EQUAL_UINT64(0, fsm_perf_stage_get(FSM_PERF_PACKET)->count);
+            TEST_ASSERT_EQUAL_UINT64(0, plugin->dpi->plugin.perf.count);
+        }
+    }
+
+    LOGI("%s: %d packets dispatched, disabled: %" PRId64 " ns/packet, enabled: %" PRId64 " ns/packet",
+         __func__, loops, elapsed_ns[0] / loops, elapsed_ns[1] / loops);
+
+    TEST_ASSERT_EQUAL_UINT64(loops, fsm_perf_stage_get(FSM_PERF_PACKET)->count);
+    TEST_ASSERT_EQUAL_UINT64(loops, fsm_perf_stage_get(FSM_PERF_FLOW)->count);
+
+    /* The plugin keeps inspecting the flow, no verdict is programmed */
+    dispatch = fsm_perf_stage_get(FSM_PERF_DISPATCH);
+    TEST_ASSERT_EQUAL_UINT64(loops, dispatch->count);
+    TEST_ASSERT_EQUAL_UINT64(0, fsm_perf_stage_get(FSM_PERF_VERDICT)->count);
+    TEST_ASSERT_EQUAL_UINT64(loops, plugin->dpi->plugin.perf.count);
+    TEST_ASSERT_TRUE(plugin->dpi->plugin.perf.max_ns <= dispatch->max_ns);
+
+    fsm_perf_dump();
+
+    /* Disabling stops the accounting */
+    fsm_perf_set_enabled(false);
+    net_parser->packet_len = sizeof(pkt372);
+    net_parser->caplen = sizeof(pkt372);
+    net_parser->data = (uint8_t *)pkt372;
+    net_header_parse(net_parser);
+    dispatch_ops->handler(dispatcher, net_parser);
+    TEST_ASSERT_EQUAL_UINT64(loops, fsm_perf_stage_get(FSM_PERF_PACKET)->count);
+
+    /* Re-enabling starts from cleared stats */
+    fsm_perf_set_enabled(true);
+    TEST_ASSERT_EQUAL_UINT64(0, fsm_perf_stage_get(FSM_PERF_PACKET)->count);
+    TEST_ASSERT_EQUAL_UINT64(0, plugin->dpi->plugin.perf.count);
+    fsm_perf_set_enabled(false);
+
+    /* Remove the dpi plugin session */
+    conf = &g_confs[7];
+    fsm_delete_session(conf);
+}
+
+
 /**
  * @brief validate the timing out of a flow
  *
@@ -5216,6 +5879,12 @@ test_dispatcher_device_process(void)
     rc = strncmp(dpi_dispatcher->excluded_devices, "${tag_2}", strlen("${tag_2}"));
     TEST_ASSERT_EQUAL(0, rc);
 
+    /* The tags were parsed once, when the dispatcher was configured */
+    TEST_ASSERT_TRUE(dpi_dispatcher->included_tag.valid);
+    TEST_ASSERT_EQUAL_STRING("tag_1", dpi_dispatcher->included_tag.name);
+    TEST_ASSERT_TRUE(dpi_dispatcher->excluded_tag.valid);
+    TEST_ASSERT_EQUAL_STRING("tag_2", dpi_dispatcher->excluded_tag.name);
+
     /* The source mac is part of tag_1, destination mac is multicast */
 
     /* smac is included devices, expect processing */
@@ -5532,6 +6201,12 @@ main(int argc, char *argv[])
     RUN_TEST(test_fsm_dpi_handler);
     RUN_TEST(test_3_dpi_dispatcher_and_plugin);
     RUN_TEST(test_4_dpi_dispatcher_and_plugin);
+    RUN_TEST(test_dpi_dispatch_bench);
+    RUN_TEST(test_fsm_perf_hist);
+    RUN_TEST(test_dpi_perf_stats);
+    RUN_TEST(test_dpi_tcp_stream);
+    RUN_TEST(test_dpi_stream_dispatch);
+    RUN_TEST(test_dpi_verdict_cache);
     RUN_TEST(test_5_dpi_dispatcher_and_plugin);
     RUN_TEST(test_6_service_plugin);
     RUN_TEST(test_7_dpi_dispatcher_and_plugin);
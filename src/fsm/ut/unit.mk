@@ -30,17 +30,8 @@ UNIT_TYPE := TEST_BIN
 
 UNIT_SRC := test_fsm_core.c
 UNIT_SRC += test_fsm_ovsdb.c
-UNIT_SRC += ../src/fsm_ovsdb.c
-UNIT_SRC += ../src/fsm_event.c
-UNIT_SRC += ../src/fsm_service.c
-UNIT_SRC += ../src/fsm_dpi.c
-UNIT_SRC += ../src/fsm_oms.c
-UNIT_SRC += ../src/fsm_internal.c
-UNIT_SRC += ../src/fsm_dpi_client.c
-UNIT_SRC += ../src/fsm_nfqueues.c
-UNIT_SRC += ../src/fsm_raw.c
-UNIT_SRC += $(if $(CONFIG_FSM_DPI_SOCKET), ../src/fsm_dispatch_listener.c)
-UNIT_SRC += $(if $(CONFIG_FSM_TAP_INTF), ../src/fsm_pcap.c, ../src/fsm_pcap_stubs.c)
+include $(UNIT_PATH)/../fsm_src.mk
+UNIT_SRC += $(addprefix ../src/,$(FSM_CORE_SRC))
 
 UNIT_CFLAGS := -I$(UNIT_PATH)/../inc
 UNIT_CFLAGS += -Isrc/lib/imc/inc
@@ -68,6 +59,7 @@ UNIT_DEPS += src/lib/network_zone
 UNIT_DEPS += src/lib/dpi_intf
 UNIT_DEPS += src/lib/accel_evict_msg
 UNIT_DEPS += src/lib/nfe
+UNIT_DEPS += $(if $(CONFIG_FSM_IPC_USE_OSBUS), src/lib/osbus)
 
 ifeq ($(CONFIG_FSM_NO_DSO),y)
 	UNIT_DEPS += $(if $(CONFIG_LIB_LEGACY_FSM_HTTP_PARSER), src/lib/http_parse)
@@ -0,0 +1,149 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef BENCH_H_INCLUDED
+#define BENCH_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * ===========================================================================
+ *  Micro-benchmark framework
+ *
+ *  A benchmark binary (UNIT_TYPE := BENCH_BIN) registers its cases with
+ *  bench_run() between bench_init() and bench_fini():
+ *
+ *      static void bench_insert(void *ctx, size_t iter)
+ *      {
+ *          ...one operation...
+ *      }
+ *
+ *      int main(int argc, char *argv[])
+ *      {
+ *          bench_init("ds_tree", argc, argv);
+ *          BENCH_RUN(bench_insert, &ctx);
+ *          return bench_fini();
+ *      }
+ *
+ *  Each case is run for a number of warmup samples, then for a number of
+ *  measured samples of `batch` operations each. Reported per operation:
+ *  min/mean/p50/p90/p99/max time, cpu cycles (x86 only) and heap
+ *  allocations (glibc only).
+ *
+ *  Command line options of a benchmark binary:
+ *      -w <n>      warmup samples (default 10)
+ *      -n <n>      measured samples (default 100)
+ *      -b <n>      operations per sample (default 1000)
+ *      -f <str>    only run cases whose name contains <str>
+ *      -o <file>   append results as JSON lines to <file>
+ *
+ *  Each JSON line holds one case:
+ *      {"suite":"ds_tree","case":"bench_insert","samples":100,"batch":1000,
+ *       "ns_min":..,"ns_mean":..,"ns_p50":..,"ns_p90":..,"ns_p99":..,
+ *       "ns_max":..,"cycles":..,"allocs":..,"alloc_bytes":..}
+ * ===========================================================================
+ */
+
+/**
+ * @brief benchmarked operation
+ *
+ * @param ctx the context passed to bench_run()
+ * @param iter the operation index within the case, starting at 0 and
+ *        increasing through warmup and measured samples
+ */
+typedef void (*bench_fn_t)(void *ctx, size_t iter);
+
+/**
+ * @brief per operation results of a case
+ */
+struct bench_result
+{
+    const char *name;
+    size_t samples;
+    size_t batch;
+    double ns_min;
+    double ns_mean;
+    double ns_p50;
+    double ns_p90;
+    double ns_p99;
+    double ns_max;
+    double cycles;      /* 0 when cycle counting is not available */
+    double allocs;      /* < 0 when allocation counting is not available */
+    double alloc_bytes;
+};
+
+/**
+ * @brief initializes the benchmark suite
+ *
+ * @param suite the suite name, reported with every result
+ * @param argc, argv the command line options, see above
+ */
+void bench_init(const char *suite, int argc, char *argv[]);
+
+/**
+ * @brief runs and reports a benchmark case
+ *
+ * @param name the case name
+ * @param fn the benchmarked operation
+ * @param ctx opaque context passed to fn
+ * @param result if not NULL, filled with the case results
+ * @return false if the case was filtered out, true otherwise
+ */
+bool bench_run_case(const char *name, bench_fn_t fn, void *ctx,
+                    struct bench_result *result);
+
+#define BENCH_RUN(fn, ctx) bench_run_case(#fn, fn, ctx, NULL)
+
+/**
+ * @brief returns the number of operations of the next bench_run_case()
+ *
+ * (warmup + samples) * batch. Lets a case prepare its input set up front
+ * so that the preparation is not measured.
+ */
+size_t bench_num_ops(void);
+
+/**
+ * @brief prevents the compiler from optimizing out a computed value
+ */
+#define BENCH_KEEP(val) __asm__ __volatile__("" : : "g"(val) : "memory")
+
+/**
+ * @brief number of heap allocations since the process started
+ *
+ * @return the count, or -1 when the allocator could not be interposed
+ */
+int64_t bench_alloc_count(void);
+
+/**
+ * @brief terminates the benchmark suite
+ *
+ * @return the process exit code
+ */
+int bench_fini(void);
+
+#endif /* BENCH_H_INCLUDED */
@@ -0,0 +1,338 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "bench.h"
+
+#define BENCH_WARMUP_DEFAULT    10
+#define BENCH_SAMPLES_DEFAULT   100
+#define BENCH_BATCH_DEFAULT     1000
+
+struct bench_suite
+{
+    const char *name;
+    size_t warmup;
+    size_t samples;
+    size_t batch;
+    const char *filter;
+    FILE *out;
+    int num_cases;
+    int rc;
+};
+
+static struct bench_suite g_bench =
+{
+    .name = "bench",
+    .warmup = BENCH_WARMUP_DEFAULT,
+    .samples = BENCH_SAMPLES_DEFAULT,
+    .batch = BENCH_BATCH_DEFAULT,
+};
+
+
+/*
+ * ===========================================================================
+ *  Allocation counting
+ *
+ *  Benchmarks are single threaded, plain counters are good enough.
+ *  The memutil wrappers end up in malloc/calloc/realloc as well.
+ * ===========================================================================
+ */
+static uint64_t g_bench_allocs;
+static uint64_t g_bench_alloc_bytes;
+
+#if defined(__GLIBC__)
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    g_bench_allocs++;
+    g_bench_alloc_bytes += size;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    g_bench_allocs++;
+    g_bench_alloc_bytes += n * size;
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    g_bench_allocs++;
+    g_bench_alloc_bytes += size;
+    return __libc_realloc(ptr, size);
+}
+
+int64_t bench_alloc_count(void)
+{
+    return g_bench_allocs;
+}
+#else
+int64_t bench_alloc_count(void)
+{
+    return -1;
+}
+#endif
+
+
+static inline uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static inline uint64_t bench_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+
+static int bench_cmp_double(const void *a, const void *b)
+{
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+
+    return (da > db) - (da < db);
+}
+
+
+/* Nearest rank percentile of a sorted array */
+static double bench_percentile(const double *sorted, size_t n, int pct)
+{
+    size_t rank;
+
+    rank = (pct * n + 99) / 100;
+    if (rank == 0) rank = 1;
+
+    return sorted[rank - 1];
+}
+
+
+void bench_init(const char *suite, int argc, char *argv[])
+{
+    const char *out = NULL;
+    int opt;
+
+    g_bench.name = suite;
+
+    while ((opt = getopt(argc, argv, "w:n:b:f:o:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'w':
+                g_bench.warmup = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'n':
+                g_bench.samples = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'b':
+                g_bench.batch = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'f':
+                g_bench.filter = optarg;
+                break;
+
+            case 'o':
+                out = optarg;
+                break;
+
+            default:
+                fprintf(stderr,
+                        "Usage: %s [-w warmup] [-n samples] [-b batch] [-f filter] [-o results.json]\n",
+                        argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (g_bench.samples == 0) g_bench.samples = 1;
+    if (g_bench.batch == 0) g_bench.batch = 1;
+
+    if (out != NULL)
+    {
+        g_bench.out = fopen(out, "a");
+        if (g_bench.out == NULL)
+        {
+            fprintf(stderr, "%s: cannot open %s\n", suite, out);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    printf("%-32s %10s %10s %10s %10s %10s %10s %8s\n",
+           suite, "min", "mean", "p50", "p90", "p99", "cycles", "allocs");
+}
+
+
+size_t bench_num_ops(void)
+{
+    return (g_bench.warmup + g_bench.samples) * g_bench.batch;
+}
+
+
+static void bench_report(struct bench_result *res)
+{
+    char allocs[32];
+
+    if (res->allocs < 0)
+    {
+        snprintf(allocs, sizeof(allocs), "n/a");
+    }
+    else
+    {
+        snprintf(allocs, sizeof(allocs), "%.2f", res->allocs);
+    }
+
+    printf("%-32s %8.1fns %8.1fns %8.1fns %8.1fns %8.1fns %10.0f %8s\n",
+           res->name, res->ns_min, res->ns_mean, res->ns_p50, res->ns_p90,
+           res->ns_p99, res->cycles, allocs);
+
+    if (g_bench.out == NULL) return;
+
+    fprintf(g_bench.out,
+            "{\"suite\":\"%s\",\"case\":\"%s\",\"samples\":%zu,\"batch\":%zu,"
+            "\"ns_min\":%.2f,\"ns_mean\":%.2f,\"ns_p50\":%.2f,\"ns_p90\":%.2f,"
+            "\"ns_p99\":%.2f,\"ns_max\":%.2f,\"cycles\":%.1f,"
+            "\"allocs\":%.3f,\"alloc_bytes\":%.1f}\n",
+            g_bench.name, res->name, res->samples, res->batch,
+            res->ns_min, res->ns_mean, res->ns_p50, res->ns_p90,
+            res->ns_p99, res->ns_max, res->cycles,
+            res->allocs, res->alloc_bytes);
+}
+
+
+bool bench_run_case(const char *name, bench_fn_t fn, void *ctx,
+                    struct bench_result *result)
+{
+    struct bench_result res;
+    uint64_t alloc_bytes;
+    uint64_t cycles;
+    uint64_t allocs;
+    uint64_t start;
+    double total;
+    double *ns;
+    size_t iter;
+    size_t s;
+    size_t i;
+
+    if (g_bench.filter != NULL && strstr(name, g_bench.filter) == NULL) return false;
+
+    /* Allocated before the counters are sampled */
+    ns = calloc(g_bench.samples, sizeof(*ns));
+    if (ns == NULL)
+    {
+        fprintf(stderr, "%s: %s: out of memory\n", g_bench.name, name);
+        g_bench.rc = EXIT_FAILURE;
+        return false;
+    }
+
+    iter = 0;
+    for (s = 0; s < g_bench.warmup; s++)
+    {
+        for (i = 0; i < g_bench.batch; i++) fn(ctx, iter++);
+    }
+
+    allocs = g_bench_allocs;
+    alloc_bytes = g_bench_alloc_bytes;
+    cycles = 0;
+    total = 0;
+    for (s = 0; s < g_bench.samples; s++)
+    {
+        uint64_t c0 = bench_cycles();
+
+        start = bench_now_ns();
+        for (i = 0; i < g_bench.batch; i++) fn(ctx, iter++);
+        ns[s] = (double)(bench_now_ns() - start) / g_bench.batch;
+        cycles += bench_cycles() - c0;
+        total += ns[s];
+    }
+    allocs = g_bench_allocs - allocs;
+    alloc_bytes = g_bench_alloc_bytes - alloc_bytes;
+
+    qsort(ns, g_bench.samples, sizeof(*ns), bench_cmp_double);
+
+    memset(&res, 0, sizeof(res));
+    res.name = name;
+    res.samples = g_bench.samples;
+    res.batch = g_bench.batch;
+    res.ns_min = ns[0];
+    res.ns_max = ns[g_bench.samples - 1];
+    res.ns_mean = total / g_bench.samples;
+    res.ns_p50 = bench_percentile(ns, g_bench.samples, 50);
+    res.ns_p90 = bench_percentile(ns, g_bench.samples, 90);
+    res.ns_p99 = bench_percentile(ns, g_bench.samples, 99);
+    res.cycles = (double)cycles / (g_bench.samples * g_bench.batch);
+    res.allocs = (double)allocs / (g_bench.samples * g_bench.batch);
+    res.alloc_bytes = (double)alloc_bytes / (g_bench.samples * g_bench.batch);
+    if (bench_alloc_count() < 0)
+    {
+        res.allocs = -1;
+        res.alloc_bytes = -1;
+    }
+
+    free(ns);
+
+    bench_report(&res);
+    g_bench.num_cases++;
+    if (result != NULL) *result = res;
+
+    return true;
+}
+
+
+int bench_fini(void)
+{
+    if (g_bench.out != NULL) fclose(g_bench.out);
+    g_bench.out = NULL;
+
+    if (g_bench.num_cases == 0 && g_bench.filter != NULL)
+    {
+        fprintf(stderr, "%s: no case matches %s\n", g_bench.name, g_bench.filter);
+    }
+
+    return g_bench.rc;
+}
@@ -27,8 +27,72 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef BRCTL_MAC_LEARN_H_INCLUDED
 #define BRCTL_MAC_LEARN_H_INCLUDED
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <linux/netlink.h>
+
 #include "target.h"
 
+/**
+ * @brief bridge forwarding database entry carried by an rtnetlink
+ *        neighbour message
+ */
+struct brctl_mac_learn_fdb
+{
+    bool            remove;     /* RTM_DELNEIGH */
+    char            mac[18];    /* lower case, colon separated */
+    int             vlan;       /* NDA_VLAN, 0 on bridges that are not vlan aware */
+    unsigned int    ifindex;    /* bridge port */
+    unsigned int    master;     /* bridge */
+};
+
+/**
+ * @brief resolves an interface index, see if_indextoname()
+ */
+typedef char *brctl_mac_learn_ifname_fn_t(unsigned int ifindex, char *ifname);
+
 bool brctl_mac_learning_register(target_mac_learning_cb_t *omac_cb);
 
+/**
+ * @brief stops the MAC learning, closes the netlink socket and releases
+ *        the table without reporting its entries
+ */
+void brctl_mac_learning_unregister(void);
+
+/**
+ * @brief translates an rtnetlink neighbour message
+ *        (Exposed for testing)
+ *
+ * @param nh the RTM_NEWNEIGH or RTM_DELNEIGH message
+ * @param fdb filled with the message's entry
+ * @return true if the message carries an entry learned by a bridge
+ */
+bool brctl_mac_learning_nl_parse(const struct nlmsghdr *nh, struct brctl_mac_learn_fdb *fdb);
+
+/**
+ * @brief tracks the bridge forwarding database over a netlink socket
+ *        (Exposed for testing)
+ *
+ * Requests the initial dump, then processes the socket's messages from the
+ * default event loop. The socket is owned by the library on success.
+ *
+ * @param omac_cb the MAC learning callback
+ * @param fd a bound NETLINK_ROUTE socket
+ * @param ifname_fn the interface index resolver
+ * @return true on success
+ */
+bool brctl_mac_learning_nl_open(target_mac_learning_cb_t *omac_cb,
+                                int fd,
+                                brctl_mac_learn_ifname_fn_t *ifname_fn);
+
+/**
+ * @brief processes the result of a netlink socket read
+ *        (Exposed for testing)
+ *
+ * @param buf the received messages
+ * @param len the received length, or the negative errno of the read
+ */
+void brctl_mac_learning_nl_input(const void *buf, ssize_t len);
+
 #endif /* BRCTL_MAC_LEARN_H_INCLUDED */
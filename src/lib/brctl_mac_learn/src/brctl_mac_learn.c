@@ -26,12 +26,26 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 /**
  * MAC learning of wired clients on the native linux bridge
+ *
+ * The bridge forwarding database is tracked through rtnetlink: the table is
+ * populated by a single AF_BRIDGE neighbour dump at startup and then kept up
+ * to date from RTM_NEWNEIGH/RTM_DELNEIGH notifications. If the netlink socket
+ * cannot be used, the table is polled using brctl instead.
+ *
+ * A MAC address is tracked once per vlan, on the port it was last seen on.
  */
 
 #include <ctype.h>
+#include <errno.h>
 #include <ev.h>
 #include <net/if.h>
 #include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <linux/if_ether.h>
+#include <linux/neighbour.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
 
 #include "ds.h"
 #include "ds_list.h"
@@ -47,6 +61,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /*****************************************************************************/
 
 #define MAC_LEARNING_INTERVAL   10.0
+#define MAC_LEARNING_NL_RCVBUF  (256 * 1024)
+#define MAC_LEARNING_NL_RETRY   0.1     /* First dump retry delay, doubled up to MAC_LEARNING_INTERVAL */
 
 #define MODULE_ID               LOG_MODULE_ID_TARGET
 
@@ -80,6 +96,15 @@ struct mac_learning_t {
 static struct ev_timer             g_mac_learning_timer;
 static target_mac_learning_cb_t   *g_mac_learning_cb = NULL;
 
+static struct ev_io                g_mac_learning_nl_io;
+static struct ev_timer             g_mac_learning_nl_retry;
+static int                         g_mac_learning_nl_fd = -1;
+static uint32_t                    g_mac_learning_nl_seq = 0;
+static bool                        g_mac_learning_nl_dump = false;     /* Dump in progress */
+static bool                        g_mac_learning_nl_resync = false;   /* Dump again when done */
+static double                      g_mac_learning_nl_backoff = 0.0;    /* Current dump retry delay */
+static brctl_mac_learn_ifname_fn_t *g_mac_learning_nl_ifname = NULL;
+
 static ds_tree_t    g_mac_learning = DS_TREE_INIT(mac_learning_cmp,
                                                   struct mac_learning_t,
                                                   list);
@@ -103,13 +128,38 @@ static struct mac_learning_flt_t *mac_learning_flt_find(int ifnum, const char *b
     return NULL;
 }
 
+static bool mac_learning_port_is_eth(const char *brname, const char *ifname)
+{
+    const char  **iflist;
+    int           ifidx;
+
+    iflist = target_ethclient_iflist_get();
+    for (ifidx=0; iflist[ifidx]; ifidx++)
+    {
+        if (!strcmp(ifname, iflist[ifidx]))
+        {
+            return true;
+        }
+        /* For vlan, interface from the list must be found at the very beginning
+           of the ifname. Also both brname and ifname must contain dot.
+           For example: br-home.600, eth1.600, eth1 */
+        if ((strchr(brname, '.') != NULL) &&
+            (strchr(ifname, '.') != NULL) &&
+            (strstr(ifname, iflist[ifidx]) == ifname))
+        {
+            LOGT("BRCTLMAC: Found vlan interface %s matching %s", ifname, iflist[ifidx]);
+            return true;
+        }
+    }
+
+    return false;
+}
+
 static bool mac_learning_flt_get(const char *brname)
 {
     FILE         *fp;
     char          cmd[512];
     char          buf[512];
-    const char  **iflist;
-    int           ifidx;
     char          ifname[IFNAMSIZ];
 
     if (!is_input_shell_safe(brname)) return false;
@@ -144,25 +194,7 @@ static bool mac_learning_flt_get(const char *brname)
 
         // Skip non ethernet clients ports
         snprintf(ifname, sizeof(ifname), "%s", eth);
-        iflist = target_ethclient_iflist_get();
-        for (ifidx=0; iflist[ifidx]; ifidx++)
-        {
-            if (!strcmp(ifname, iflist[ifidx]))
-            {
-                break;
-            }
-            /* For vlan, interface from the list must be found at the very beginning
-               of the ifname. Also both brname and ifname must contain dot.
-               For example: br-home.600, eth1.600, eth1 */
-            if ((strchr(brname, '.') != NULL) &&
-                (strchr(ifname, '.') != NULL) &&
-                (strstr(ifname, iflist[ifidx]) == ifname))
-            {
-                LOGT("BRCTLMAC: Found vlan interface %s matching %s", ifname, iflist[ifidx]);
-                break;
-            }
-        }
-        if (iflist[ifidx] == NULL)
+        if (!mac_learning_port_is_eth(brname, ifname))
         {
             LOGT("BRCTLMAC: Skip %s", ifname);
             continue;
@@ -197,6 +229,108 @@ static bool mac_learning_flt_get(const char *brname)
     return true;
 }
 
+static int mac_learning_brname_vlan(const char *brname)
+{
+    const char *str_vlanid = strchr(brname, '.');
+
+    if (str_vlanid == NULL) return 0;
+
+    LOGT("BRCTLMAC: Setting vlan %s for %s", str_vlanid + 1, brname);
+    return atoi(str_vlanid + 1);
+}
+
+static void mac_learning_remove(struct mac_learning_t *ml)
+{
+    LOGT("BRCTLMAC: removed mac table entry :: brname=%s ifname=%s mac=%s vlan=%d",
+         ml->oml.brname,
+         ml->oml.ifname,
+         ml->oml.hwaddr,
+         ml->oml.vlan);
+
+    // Indicate deleted entry to NM
+    g_mac_learning_cb(&ml->oml, false);
+
+    // Remove our entry
+    ds_tree_remove(&g_mac_learning, ml);
+    memset(ml, 0, sizeof(*ml));
+    FREE(ml);
+}
+
+static void mac_learning_add(const char *brname, const char *ifname, const char *mac, int vlan)
+{
+    struct schema_OVS_MAC_Learning oml;
+    memset(&oml, 0, sizeof(oml));
+    strscpy(oml.hwaddr, mac, sizeof(oml.hwaddr));
+    strscpy(oml.brname, brname, sizeof(oml.brname));
+    strscpy(oml.ifname, ifname, sizeof(oml.ifname));
+    oml.vlan = vlan;
+
+    bool update = false;
+    struct mac_learning_t *ml;
+    ml = ds_tree_find(&g_mac_learning, &oml);
+
+    // The entry moved to another port
+    if (ml != NULL &&
+        (strcmp(ml->oml.ifname, ifname) != 0 || strcmp(ml->oml.brname, brname) != 0))
+    {
+        mac_learning_remove(ml);
+        ml = NULL;
+    }
+
+    // New entry
+    if (ml == NULL)
+    {
+        ml = CALLOC(1, sizeof(*ml));
+
+        memcpy(&ml->oml, &oml, sizeof(ml->oml));
+        ds_tree_insert(&g_mac_learning, ml, &ml->oml);
+
+        update = true;
+    }
+
+    ml->valid = true;
+
+    LOGT("BRCTLMAC: parsed mac table entry :: brname=%s ifname=%s mac=%s vlan=%d update=%s",
+         oml.brname,
+         oml.ifname,
+         oml.hwaddr,
+         oml.vlan,
+         update ? "true" : "false");
+
+    // Pass new entry to NM
+    if (update)
+    {
+        g_mac_learning_cb(&ml->oml, true);
+    }
+}
+
+/*
+ * Remove the entry of @p mac on @p vlan, unless it was learned on a port
+ * other than @p ifname (if not NULL)
+ */
+static void mac_learning_del(const char *mac, int vlan, const char *ifname)
+{
+    struct schema_OVS_MAC_Learning  oml;
+    struct mac_learning_t          *ml;
+
+    memset(&oml, 0, sizeof(oml));
+    strscpy(oml.hwaddr, mac, sizeof(oml.hwaddr));
+    oml.vlan = vlan;
+
+    ml = ds_tree_find(&g_mac_learning, &oml);
+    if (ml == NULL)
+    {
+        return;
+    }
+
+    if (ifname != NULL && strcmp(ml->oml.ifname, ifname) != 0)
+    {
+        return;
+    }
+
+    mac_learning_remove(ml);
+}
+
 static bool mac_learning_parse(const char *brname)
 {
     FILE *fp;
@@ -244,46 +378,7 @@ static bool mac_learning_parse(const char *brname)
             continue;
         }
 
-        struct schema_OVS_MAC_Learning oml;
-        memset(&oml, 0, sizeof(oml));
-        strscpy(oml.hwaddr, mac, sizeof(oml.hwaddr));
-        strscpy(oml.brname, brname, sizeof(oml.brname));
-        strscpy(oml.ifname, flt->ifname, sizeof(oml.ifname));
-        char *str_vlanid = strchr(brname, '.');
-        if (str_vlanid != NULL)
-        {
-            int vlanid = atoi(str_vlanid + 1);
-            LOGT("BRCTLMAC: Setting vlan %d for %s", vlanid, brname);
-            oml.vlan = vlanid;
-        }
-
-        // New entry
-        bool update = false;
-        struct mac_learning_t *ml;
-        ml = ds_tree_find(&g_mac_learning, &oml);
-        if (ml == NULL)
-        {
-            ml = CALLOC(1, sizeof(*ml));
-
-            memcpy(&ml->oml, &oml, sizeof(ml->oml));
-            ds_tree_insert(&g_mac_learning, ml, &ml->oml);
-
-            update = true;
-        }
-
-        ml->valid = true;
-
-        LOGT("BRCTLMAC: parsed mac table entry :: brname=%s ifname=%s mac=%s update=%s",
-             oml.brname,
-             oml.ifname,
-             oml.hwaddr,
-             update ? "true" : "false");
-
-        // Pass new entry to NM
-        if (update)
-        {
-            g_mac_learning_cb(&ml->oml, true);
-        }
+        mac_learning_add(brname, flt->ifname, mac, mac_learning_brname_vlan(brname));
     }
 
     if (fp)
@@ -336,7 +431,7 @@ static int mac_learning_cmp(const void *_a, const void *_b)
     {
         return result;
     }
-    return strcmp(a->ifname, b->ifname);
+    return a->vlan - b->vlan;
 }
 
 static void mac_learning_parse_vlanids(char *brname, int vlanids[], int *vlanids_len)
@@ -414,6 +509,346 @@ static void mac_learing_timer_cb(struct ev_loop *loop, ev_timer *watcher, int re
     mac_learning_flush();
 }
 
+/******************************************************************************
+ *  Netlink FDB tracking
+ *****************************************************************************/
+
+static bool mac_learning_nl_bridge_match(const char *brname)
+{
+    size_t len = strlen(BRCTL_LAN_BRIDGE);
+
+    if (strcmp(brname, BRCTL_LAN_BRIDGE) == 0)
+    {
+        return true;
+    }
+
+    /* VLAN bridges, for example: br-home.600 */
+    return (strncmp(brname, BRCTL_LAN_BRIDGE, len) == 0) &&
+           (brname[len] == '.') &&
+           isdigit((unsigned char)brname[len + 1]);
+}
+
+/*
+ * Apply a bridge forwarding database change to the table
+ */
+static void mac_learning_nl_fdb(const struct brctl_mac_learn_fdb *fdb)
+{
+    char    brname[IFNAMSIZ];
+    char    ifname[IFNAMSIZ];
+    int     vlan;
+
+    if (g_mac_learning_nl_ifname(fdb->master, brname) == NULL || !mac_learning_nl_bridge_match(brname))
+    {
+        return;
+    }
+
+    /* Vlan aware bridges report the vlan, otherwise it is the bridge's one */
+    vlan = (fdb->vlan != 0) ? fdb->vlan : mac_learning_brname_vlan(brname);
+
+    if (g_mac_learning_nl_ifname(fdb->ifindex, ifname) == NULL)
+    {
+        /* The port may be gone already */
+        if (fdb->remove) mac_learning_del(fdb->mac, vlan, NULL);
+
+        LOGD("BRCTLMAC: Unable to resolve port :: brname=%s ifindex=%u mac=%s",
+             brname, fdb->ifindex, fdb->mac);
+        return;
+    }
+
+    if (fdb->remove)
+    {
+        mac_learning_del(fdb->mac, vlan, ifname);
+        return;
+    }
+
+    if (!mac_learning_port_is_eth(brname, ifname))
+    {
+        /* The entry may have moved from an ethernet port */
+        mac_learning_del(fdb->mac, vlan, NULL);
+        return;
+    }
+
+    mac_learning_add(brname, ifname, fdb->mac, vlan);
+}
+
+/*
+ * Request a dump of the bridge forwarding database. Entries that are not
+ * part of the dump are removed when the dump completes.
+ */
+static bool mac_learning_nl_dump(void)
+{
+    struct
+    {
+        struct nlmsghdr nh;
+        struct ndmsg    ndm;
+    } req;
+
+    if (g_mac_learning_nl_dump)
+    {
+        g_mac_learning_nl_resync = true;
+        return true;
+    }
+
+    /* A retry is already scheduled */
+    if (ev_is_active(&g_mac_learning_nl_retry))
+    {
+        return true;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(req.ndm));
+    req.nh.nlmsg_type = RTM_GETNEIGH;
+    req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nh.nlmsg_seq = ++g_mac_learning_nl_seq;
+    req.ndm.ndm_family = AF_BRIDGE;
+
+    if (send(g_mac_learning_nl_fd, &req, req.nh.nlmsg_len, 0) < 0)
+    {
+        LOGE("BRCTLMAC: Unable to request the bridge FDB dump :: error=%s", strerror(errno));
+        return false;
+    }
+
+    mac_learning_invalidate();
+    g_mac_learning_nl_dump = true;
+    g_mac_learning_nl_resync = false;
+
+    return true;
+}
+
+/*
+ * Dump again later, backing off while the kernel keeps refusing the dump
+ * (for example EBUSY while a previous dump is still being sent)
+ */
+static void mac_learning_nl_dump_retry(void)
+{
+    if (ev_is_active(&g_mac_learning_nl_retry))
+    {
+        return;
+    }
+
+    if (g_mac_learning_nl_backoff == 0.0)
+    {
+        g_mac_learning_nl_backoff = MAC_LEARNING_NL_RETRY;
+    }
+    else
+    {
+        g_mac_learning_nl_backoff = MIN(g_mac_learning_nl_backoff * 2, MAC_LEARNING_INTERVAL);
+    }
+
+    LOGD("BRCTLMAC: Retrying the bridge FDB dump in %.1f seconds", g_mac_learning_nl_backoff);
+
+    ev_timer_set(&g_mac_learning_nl_retry, g_mac_learning_nl_backoff, 0.0);
+    ev_timer_start(EV_DEFAULT, &g_mac_learning_nl_retry);
+}
+
+static void mac_learning_nl_resync(void)
+{
+    if (!mac_learning_nl_dump())
+    {
+        mac_learning_nl_dump_retry();
+    }
+}
+
+static void mac_learning_nl_retry_cb(struct ev_loop *loop, ev_timer *watcher, int revents)
+{
+    (void)loop;
+    (void)watcher;
+    (void)revents;
+
+    mac_learning_nl_resync();
+}
+
+static void mac_learning_nl_dump_done(bool success)
+{
+    g_mac_learning_nl_dump = false;
+
+    if (!success)
+    {
+        mac_learning_nl_dump_retry();
+        return;
+    }
+
+    mac_learning_flush();
+    g_mac_learning_nl_backoff = 0.0;
+
+    if (g_mac_learning_nl_resync)
+    {
+        mac_learning_nl_resync();
+    }
+}
+
+static void mac_learning_nl_read_cb(struct ev_loop *loop, ev_io *watcher, int revents)
+{
+    static uint8_t      buf[16384];
+    ssize_t             rc;
+
+    (void)loop;
+    (void)watcher;
+
+    if (!(revents & EV_READ)) return;
+
+    rc = recv(g_mac_learning_nl_fd, buf, sizeof(buf), MSG_DONTWAIT);
+    brctl_mac_learning_nl_input(buf, (rc < 0) ? -errno : rc);
+}
+
+static bool mac_learning_nl_init(void)
+{
+    struct sockaddr_nl  nladdr;
+    int                 rcvbuf = MAC_LEARNING_NL_RCVBUF;
+    int                 fd;
+
+    fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0)
+    {
+        LOGE("BRCTLMAC: Unable to create netlink socket :: error=%s", strerror(errno));
+        return false;
+    }
+
+    /* Bursts of notifications are expected, for example on link down */
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    memset(&nladdr, 0, sizeof(nladdr));
+    nladdr.nl_family = AF_NETLINK;
+    nladdr.nl_groups = RTMGRP_NEIGH;
+    if (bind(fd, (struct sockaddr *)&nladdr, sizeof(nladdr)) != 0)
+    {
+        LOGE("BRCTLMAC: Unable to bind netlink socket :: error=%s", strerror(errno));
+        goto error;
+    }
+
+    if (!brctl_mac_learning_nl_open(g_mac_learning_cb, fd, if_indextoname))
+    {
+        goto error;
+    }
+
+    return true;
+
+error:
+    close(fd);
+    return false;
+}
+
+bool brctl_mac_learning_nl_parse(const struct nlmsghdr *nh, struct brctl_mac_learn_fdb *fdb)
+{
+    const struct ndmsg  *ndm = NLMSG_DATA(nh);
+    const struct rtattr *rta;
+    int                  rta_len;
+    const uint8_t       *lladdr = NULL;
+
+    if (nh->nlmsg_type != RTM_NEWNEIGH && nh->nlmsg_type != RTM_DELNEIGH)
+    {
+        return false;
+    }
+
+    rta_len = (int)nh->nlmsg_len - (int)NLMSG_LENGTH(sizeof(*ndm));
+    if (rta_len < 0 || ndm->ndm_family != AF_BRIDGE)
+    {
+        return false;
+    }
+
+    memset(fdb, 0, sizeof(*fdb));
+    for (rta = (const struct rtattr *)((const char *)ndm + NLMSG_ALIGN(sizeof(*ndm)));
+         RTA_OK(rta, rta_len);
+         rta = RTA_NEXT(rta, rta_len))
+    {
+        switch (rta->rta_type)
+        {
+            case NDA_LLADDR:
+                if (RTA_PAYLOAD(rta) == ETH_ALEN) lladdr = RTA_DATA(rta);
+                break;
+
+            case NDA_MASTER:
+                if (RTA_PAYLOAD(rta) == sizeof(uint32_t)) fdb->master = *(const uint32_t *)RTA_DATA(rta);
+                break;
+
+            case NDA_VLAN:
+                if (RTA_PAYLOAD(rta) == sizeof(uint16_t)) fdb->vlan = *(const uint16_t *)RTA_DATA(rta);
+                break;
+        }
+    }
+
+    /* Only entries learned by a bridge; local entries are the bridge's own addresses */
+    if (lladdr == NULL || fdb->master == 0 || (ndm->ndm_state & NUD_PERMANENT))
+    {
+        return false;
+    }
+
+    snprintf(fdb->mac, sizeof(fdb->mac), "%02x:%02x:%02x:%02x:%02x:%02x",
+             lladdr[0], lladdr[1], lladdr[2], lladdr[3], lladdr[4], lladdr[5]);
+    fdb->ifindex = (unsigned int)ndm->ndm_ifindex;
+    fdb->remove = (nh->nlmsg_type == RTM_DELNEIGH);
+
+    return true;
+}
+
+void brctl_mac_learning_nl_input(const void *buf, ssize_t len)
+{
+    struct brctl_mac_learn_fdb  fdb;
+    const struct nlmsghdr      *nh;
+    size_t                      left;
+
+    if (len < 0)
+    {
+        if (len == -EAGAIN || len == -EINTR) return;
+
+        /* Notifications were lost (ENOBUFS), synchronize the full table */
+        LOGI("BRCTLMAC: Netlink receive error, resyncing :: error=%s", strerror((int)-len));
+        g_mac_learning_nl_dump = false;
+        mac_learning_nl_resync();
+        return;
+    }
+
+    for (nh = buf, left = (size_t)len;
+         NLMSG_OK(nh, left);
+         nh = NLMSG_NEXT(nh, left))
+    {
+        bool is_dump = g_mac_learning_nl_dump && (nh->nlmsg_seq == g_mac_learning_nl_seq);
+
+        switch (nh->nlmsg_type)
+        {
+            case RTM_NEWNEIGH:
+            case RTM_DELNEIGH:
+                if (brctl_mac_learning_nl_parse(nh, &fdb)) mac_learning_nl_fdb(&fdb);
+                break;
+
+            case NLMSG_DONE:
+                if (is_dump) mac_learning_nl_dump_done(true);
+                break;
+
+            case NLMSG_ERROR:
+                if (is_dump)
+                {
+                    LOGE("BRCTLMAC: Bridge FDB dump failed :: error=%d",
+                         ((const struct nlmsgerr *)NLMSG_DATA(nh))->error);
+                    mac_learning_nl_dump_done(false);
+                }
+                break;
+        }
+    }
+}
+
+bool brctl_mac_learning_nl_open(target_mac_learning_cb_t *omac_cb,
+                                int fd,
+                                brctl_mac_learn_ifname_fn_t *ifname_fn)
+{
+    g_mac_learning_cb = omac_cb;
+    g_mac_learning_nl_ifname = ifname_fn;
+    g_mac_learning_nl_fd = fd;
+
+    ev_io_init(&g_mac_learning_nl_io, mac_learning_nl_read_cb, g_mac_learning_nl_fd, EV_READ);
+    ev_timer_init(&g_mac_learning_nl_retry, mac_learning_nl_retry_cb, 0.0, 0.0);
+
+    if (!mac_learning_nl_dump())
+    {
+        g_mac_learning_nl_fd = -1;
+        return false;
+    }
+
+    ev_io_start(EV_DEFAULT, &g_mac_learning_nl_io);
+
+    return true;
+}
+
 /******************************************************************************
  *  PUBLIC API definitions
  *****************************************************************************/
@@ -426,7 +861,14 @@ bool brctl_mac_learning_register(target_mac_learning_cb_t *omac_cb)
     // Init NM callback
     g_mac_learning_cb = omac_cb;
 
-    // Init timer
+    if (mac_learning_nl_init())
+    {
+        LOGN("BRCTLMAC: Successfully registered netlink MAC learning. :: brname=%s",
+                BRCTL_LAN_BRIDGE);
+        return true;
+    }
+
+    // Fall back to polling
     ev_timer_init(&g_mac_learning_timer,
                   mac_learing_timer_cb,
                   MAC_LEARNING_INTERVAL,
@@ -438,3 +880,38 @@ bool brctl_mac_learning_register(target_mac_learning_cb_t *omac_cb)
 
     return true;
 }
+
+void brctl_mac_learning_unregister(void)
+{
+    struct mac_learning_flt_t  *flt;
+    struct mac_learning_t      *ml;
+
+    ev_timer_stop(EV_DEFAULT, &g_mac_learning_timer);
+    ev_timer_stop(EV_DEFAULT, &g_mac_learning_nl_retry);
+    ev_io_stop(EV_DEFAULT, &g_mac_learning_nl_io);
+
+    if (g_mac_learning_nl_fd >= 0)
+    {
+        close(g_mac_learning_nl_fd);
+        g_mac_learning_nl_fd = -1;
+    }
+
+    g_mac_learning_nl_dump = false;
+    g_mac_learning_nl_resync = false;
+    g_mac_learning_nl_backoff = 0.0;
+
+    while ((ml = ds_tree_head(&g_mac_learning)) != NULL)
+    {
+        ds_tree_remove(&g_mac_learning, ml);
+        FREE(ml);
+    }
+
+    while ((flt = ds_dlist_remove_head(&g_mac_learning_flt)) != NULL)
+    {
+        FREE(flt);
+    }
+
+    g_mac_learning_cb = NULL;
+
+    LOGN("BRCTLMAC: Unregistered MAC learning.");
+}
@@ -0,0 +1,492 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <ev.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <linux/if_ether.h>
+#include <linux/neighbour.h>
+#include <linux/rtnetlink.h>
+
+#include "brctl_mac_learn.h"
+#include "schema_consts.h"
+#include "unity.h"
+#include "unit_test_utils.h"
+
+char *test_name = "test_brctl_mac_learn";
+
+#if defined(CONFIG_TARGET_LAN_BRIDGE_NAME)
+#define TEST_BRIDGE     CONFIG_TARGET_LAN_BRIDGE_NAME
+#else
+#define TEST_BRIDGE     SCHEMA_CONSTS_BR_NAME_HOME
+#endif
+
+/* Interface indexes known to the test resolver */
+enum
+{
+    TEST_IF_BRIDGE = 1,
+    TEST_IF_ETH0,
+    TEST_IF_ETH1,
+    TEST_IF_WIFI,
+    TEST_IF_BRIDGE_VLAN,
+    TEST_IF_OTHER_BRIDGE,
+};
+
+#define TEST_EVENTS_MAX 16
+
+struct test_event
+{
+    bool    add;
+    char    mac[18];
+    char    ifname[IFNAMSIZ];
+    int     vlan;
+};
+
+static struct test_event g_events[TEST_EVENTS_MAX];
+static int g_num_events;
+static int g_fd[2];
+
+static uint32_t g_buf[4096];
+static size_t g_len;
+
+static const uint8_t g_mac1[ETH_ALEN] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55 };
+static const uint8_t g_mac2[ETH_ALEN] = { 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb };
+
+const char **
+target_ethclient_iflist_get(void)
+{
+    static const char *iflist[] = { "eth0", "eth1", NULL };
+
+    return iflist;
+}
+
+static char *
+test_ifname(unsigned int ifindex, char *ifname)
+{
+    const char *name;
+
+    switch (ifindex)
+    {
+        case TEST_IF_BRIDGE:       name = TEST_BRIDGE; break;
+        case TEST_IF_ETH0:         name = "eth0"; break;
+        case TEST_IF_ETH1:         name = "eth1"; break;
+        case TEST_IF_WIFI:         name = "wl0"; break;
+        case TEST_IF_BRIDGE_VLAN:  name = TEST_BRIDGE ".600"; break;
+        case TEST_IF_OTHER_BRIDGE: name = "br-wan"; break;
+        default: return NULL;
+    }
+
+    snprintf(ifname, IFNAMSIZ, "%s", name);
+    return ifname;
+}
+
+static bool
+test_mac_learning_cb(struct schema_OVS_MAC_Learning *omac, bool oper_status)
+{
+    struct test_event *event;
+
+    TEST_ASSERT_TRUE(g_num_events < TEST_EVENTS_MAX);
+    event = &g_events[g_num_events++];
+    event->add = oper_status;
+    snprintf(event->mac, sizeof(event->mac), "%s", omac->hwaddr);
+    snprintf(event->ifname, sizeof(event->ifname), "%s", omac->ifname);
+    event->vlan = omac->vlan;
+
+    return true;
+}
+
+static void
+test_assert_event(int i, bool add, const char *mac, const char *ifname, int vlan)
+{
+    TEST_ASSERT_TRUE(i < g_num_events);
+    TEST_ASSERT_EQUAL(add, g_events[i].add);
+    TEST_ASSERT_EQUAL_STRING(mac, g_events[i].mac);
+    TEST_ASSERT_EQUAL_STRING(ifname, g_events[i].ifname);
+    TEST_ASSERT_EQUAL_INT(vlan, g_events[i].vlan);
+}
+
+static struct nlmsghdr *
+test_msg_add(uint16_t type, uint32_t seq, size_t payload)
+{
+    struct nlmsghdr *nh;
+
+    nh = (struct nlmsghdr *)((uint8_t *)g_buf + g_len);
+    memset(nh, 0, NLMSG_SPACE(payload));
+    nh->nlmsg_len = NLMSG_LENGTH(payload);
+    nh->nlmsg_type = type;
+    nh->nlmsg_seq = seq;
+    g_len += NLMSG_ALIGN(nh->nlmsg_len);
+
+    return nh;
+}
+
+static void
+test_rta_add(struct nlmsghdr *nh, uint16_t type, const void *data, size_t len)
+{
+    struct rtattr *rta;
+
+    rta = (struct rtattr *)((uint8_t *)nh + NLMSG_ALIGN(nh->nlmsg_len));
+    rta->rta_type = type;
+    rta->rta_len = RTA_LENGTH(len);
+    memcpy(RTA_DATA(rta), data, len);
+    nh->nlmsg_len = NLMSG_ALIGN(nh->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+    g_len = (uint8_t *)nh - (uint8_t *)g_buf + NLMSG_ALIGN(nh->nlmsg_len);
+}
+
+/* Append a bridge neighbour message, vlan 0 omits NDA_VLAN */
+static void
+test_neigh_add(uint16_t type, uint32_t seq, const uint8_t *mac,
+               uint32_t ifindex, uint32_t master, uint16_t vlan)
+{
+    struct nlmsghdr *nh;
+    struct ndmsg *ndm;
+
+    nh = test_msg_add(type, seq, sizeof(*ndm));
+    ndm = NLMSG_DATA(nh);
+    ndm->ndm_family = AF_BRIDGE;
+    ndm->ndm_ifindex = ifindex;
+    ndm->ndm_state = NUD_REACHABLE;
+
+    test_rta_add(nh, NDA_LLADDR, mac, ETH_ALEN);
+    test_rta_add(nh, NDA_MASTER, &master, sizeof(master));
+    if (vlan != 0) test_rta_add(nh, NDA_VLAN, &vlan, sizeof(vlan));
+}
+
+static void
+test_done_add(uint32_t seq)
+{
+    test_msg_add(NLMSG_DONE, seq, sizeof(int));
+}
+
+static void
+test_error_add(uint32_t seq, int error)
+{
+    struct nlmsghdr *nh;
+    struct nlmsgerr *err;
+
+    nh = test_msg_add(NLMSG_ERROR, seq, sizeof(*err));
+    err = NLMSG_DATA(nh);
+    err->error = error;
+}
+
+static void
+test_input(void)
+{
+    brctl_mac_learning_nl_input(g_buf, g_len);
+    g_len = 0;
+}
+
+/* Sequence number of the pending dump request, 0 if there is none */
+static uint32_t
+test_dump_request(void)
+{
+    struct nlmsghdr *nh;
+    uint32_t buf[64];
+    ssize_t rc;
+
+    rc = recv(g_fd[1], buf, sizeof(buf), MSG_DONTWAIT);
+    if (rc < 0) return 0;
+
+    nh = (struct nlmsghdr *)buf;
+    TEST_ASSERT_TRUE(NLMSG_OK(nh, (size_t)rc));
+    TEST_ASSERT_EQUAL_INT(RTM_GETNEIGH, nh->nlmsg_type);
+    TEST_ASSERT_TRUE(nh->nlmsg_flags & NLM_F_DUMP);
+    TEST_ASSERT_EQUAL_INT(AF_BRIDGE, ((struct ndmsg *)NLMSG_DATA(nh))->ndm_family);
+
+    return nh->nlmsg_seq;
+}
+
+/* Open the library on a socket pair and complete the initial empty dump */
+void
+test_brctl_mac_learn_setUp(void)
+{
+    uint32_t seq;
+    bool rc;
+
+    g_num_events = 0;
+    g_len = 0;
+
+    TEST_ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_DGRAM, 0, g_fd));
+    rc = brctl_mac_learning_nl_open(test_mac_learning_cb, g_fd[0], test_ifname);
+    TEST_ASSERT_TRUE(rc);
+
+    seq = test_dump_request();
+    TEST_ASSERT_NOT_EQUAL(0, seq);
+    test_done_add(seq);
+    test_input();
+}
+
+void
+test_brctl_mac_learn_tearDown(void)
+{
+    brctl_mac_learning_unregister();
+    close(g_fd[1]);
+}
+
+void
+test_brctl_mac_learn_parse(void)
+{
+    struct brctl_mac_learn_fdb fdb;
+    struct nlmsghdr *nh;
+
+    test_neigh_add(RTM_NEWNEIGH, 0, g_mac1, TEST_IF_ETH0, TEST_IF_BRIDGE, 10);
+    nh = (struct nlmsghdr *)g_buf;
+    TEST_ASSERT_TRUE(brctl_mac_learning_nl_parse(nh, &fdb));
+    TEST_ASSERT_FALSE(fdb.remove);
+    TEST_ASSERT_EQUAL_STRING("00:11:22:33:44:55", fdb.mac);
+    TEST_ASSERT_EQUAL_INT(10, fdb.vlan);
+    TEST_ASSERT_EQUAL_UINT(TEST_IF_ETH0, fdb.ifindex);
+    TEST_ASSERT_EQUAL_UINT(TEST_IF_BRIDGE, fdb.master);
+
+    nh->nlmsg_type = RTM_DELNEIGH;
+    TEST_ASSERT_TRUE(brctl_mac_learning_nl_parse(nh, &fdb));
+    TEST_ASSERT_TRUE(fdb.remove);
+
+    /* The bridge's own addresses */
+    ((struct ndmsg *)NLMSG_DATA(nh))->ndm_state = NUD_PERMANENT;
+    TEST_ASSERT_FALSE(brctl_mac_learning_nl_parse(nh, &fdb));
+
+    /* IP neighbours */
+    ((struct ndmsg *)NLMSG_DATA(nh))->ndm_state = NUD_REACHABLE;
+    ((struct ndmsg *)NLMSG_DATA(nh))->ndm_family = AF_INET;
+    TEST_ASSERT_FALSE(brctl_mac_learning_nl_parse(nh, &fdb));
+    g_len = 0;
+
+    /* Not learned by a bridge */
+    test_neigh_add(RTM_NEWNEIGH, 0, g_mac1, TEST_IF_ETH0, 0, 0);
+    TEST_ASSERT_FALSE(brctl_mac_learning_nl_parse((struct nlmsghdr *)g_buf, &fdb));
+    g_len = 0;
+
+    test_done_add(0);
+    TEST_ASSERT_FALSE(brctl_mac_learning_nl_parse((struct nlmsghdr *)g_buf, &fdb));
+    g_len = 0;
+}
+
+void
+test_brctl_mac_learn_new_del(void)
+{
+    test_neigh_add(RTM_NEWNEIGH, 0, g_mac1, TEST_IF_ETH0, TEST_IF_BRIDGE, 0);
+    test_neigh_add(RTM_NEWNEIGH, 0, g_mac1, TEST_IF_ETH0, TEST_IF_BRIDGE, 0);
+    test_input();
+    TEST_ASSERT_EQUAL_INT(1, g_num_events);
+    test_assert_event(0, true, "00:11:22:33:44:55", "eth0", 0);
+
+    /* Non ethernet ports and other bridges are not reported */
+    test_neigh_add(RTM_NEWNEIGH, 0, g_mac2, TEST_IF_WIFI, TEST_IF_BRIDGE, 0);
+    test_neigh_add(RTM_NEWNEIGH, 0, g_mac2, TEST_IF_ETH1, TEST_IF_OTHER_BRIDGE, 0);
+    test_input();
+    TEST_ASSERT_EQUAL_INT(1, g_num_events);
+
+    /* VLAN bridges report their vlan */
+    test_neigh_add(RTM_NEWNEIGH, 0, g_mac2, TEST_IF_ETH1, TEST_IF_BRIDGE_VLAN, 0);
+    test_input();
+    TEST_ASSERT_EQUAL_INT(2, g_num_events);
+    test_assert_event(1, true, "66:77:88:99:aa:bb", "eth1", 600);
+
+    test_neigh_add(RTM_DELNEIGH, 0, g_mac1, TEST_IF_ETH0, TEST_IF_BRIDGE, 0);
+    test_neigh_add(RTM_DELNEIGH, 0, g_mac1, TEST_IF_ETH0, TEST_IF_BRIDGE, 0);
+    test_input();
+    TEST_ASSERT_EQUAL_INT(3, g_num_events);
+    test_assert_event(2, false, "00:11:22:33:44:55", "eth0", 0);
+}
+
+void
+test_brctl_mac_learn_port_move(void)
+{
+    test_neigh_add(RTM_NEWNEIGH, 0, g_mac1, TEST_IF_ETH0, TEST_IF_BRIDGE, 0);
+    test_neigh_add(RTM_NEWNEIGH, 0, g_mac1, TEST_IF_ETH1, TEST_IF_BRIDGE, 0);
+    test_input();
+    TEST_ASSERT_EQUAL_INT(3, g_num_events);
+    test_assert_event(0, true, "00:11:22:33:44:55", "eth0", 0);
+    test_assert_event(1, false, "00:11:22:33:44:55", "eth0", 0);
+    test_assert_event(2, true, "00:11:22:33:44:55", "eth1", 0);
+
+    /* A late delete of the old port does not remove the moved entry */
+    test_neigh_add(RTM_DELNEIGH, 0, g_mac1, TEST_IF_ETH0, TEST_IF_BRIDGE, 0);
+    test_input();
+    TEST_ASSERT_EQUAL_INT(3, g_num_events);
+
+    /* Moving to a non ethernet port removes it */
+    test_neigh_add(RTM_NEWNEIGH, 0, g_mac1, TEST_IF_WIFI, TEST_IF_BRIDGE, 0);
+    test_input();
+    TEST_ASSERT_EQUAL_INT(4, g_num_events);
+    test_assert_event(3, false, "00:11:22:33:44:55", "eth1", 0);
+}
+
+void
+test_brctl_mac_learn_vlans(void)
+{
+    test_neigh_add(RTM_NEWNEIGH, 0, g_mac1, TEST_IF_ETH0, TEST_IF_BRIDGE, 10);
+    test_neigh_add(RTM_NEWNEIGH, 0, g_mac1, TEST_IF_ETH0, TEST_IF_BRIDGE, 20);
+    test_input();
+    TEST_ASSERT_EQUAL_INT(2, g_num_events);
+    test_assert_event(0, true, "00:11:22:33:44:55", "eth0", 10);
+    test_assert_event(1, true, "00:11:22:33:44:55", "eth0", 20);
+
+    /* Removing one vlan keeps the other one */
+    test_neigh_add(RTM_DELNEIGH, 0, g_mac1, TEST_IF_ETH0, TEST_IF_BRIDGE, 10);
+    test_input();
+    TEST_ASSERT_EQUAL_INT(3, g_num_events);
+    test_assert_event(2, false, "00:11:22:33:44:55", "eth0", 10);
+
+    /* A move on one vlan leaves the other one on its port */
+    test_neigh_add(RTM_NEWNEIGH, 0, g_mac1, TEST_IF_ETH1, TEST_IF_BRIDGE, 10);
+    test_input();
+    TEST_ASSERT_EQUAL_INT(4, g_num_events);
+    test_assert_event(3, true, "00:11:22:33:44:55", "eth1", 10);
+
+    test_neigh_add(RTM_DELNEIGH, 0, g_mac1, TEST_IF_ETH0, TEST_IF_BRIDGE, 20);
+    test_input();
+    TEST_ASSERT_EQUAL_INT(5, g_num_events);
+    test_assert_event(4, false, "00:11:22:33:44:55", "eth0", 20);
+}
+
+void
+test_brctl_mac_learn_resync(void)
+{
+    uint32_t seq;
+
+    test_neigh_add(RTM_NEWNEIGH, 0, g_mac1, TEST_IF_ETH0, TEST_IF_BRIDGE, 0);
+    test_neigh_add(RTM_NEWNEIGH, 0, g_mac2, TEST_IF_ETH1, TEST_IF_BRIDGE, 0);
+    test_input();
+    TEST_ASSERT_EQUAL_INT(2, g_num_events);
+
+    /* Notifications were lost: the table is dumped again */
+    brctl_mac_learning_nl_input(NULL, -ENOBUFS);
+    seq = test_dump_request();
+    TEST_ASSERT_NOT_EQUAL(0, seq);
+
+    /* Interrupted reads lose nothing */
+    brctl_mac_learning_nl_input(NULL, -EAGAIN);
+    TEST_ASSERT_EQUAL_UINT32(0, test_dump_request());
+
+    /* Only the entries missing from the dump are flushed */
+    test_neigh_add(RTM_NEWNEIGH, seq, g_mac1, TEST_IF_ETH0, TEST_IF_BRIDGE, 0);
+    test_input();
+    TEST_ASSERT_EQUAL_INT(2, g_num_events);
+    test_done_add(seq);
+    test_input();
+    TEST_ASSERT_EQUAL_INT(3, g_num_events);
+    test_assert_event(2, false, "66:77:88:99:aa:bb", "eth1", 0);
+
+    /* The end of a previous dump is ignored */
+    brctl_mac_learning_nl_input(NULL, -ENOBUFS);
+    seq = test_dump_request();
+    test_done_add(seq - 1);
+    test_input();
+    TEST_ASSERT_EQUAL_INT(3, g_num_events);
+    test_neigh_add(RTM_NEWNEIGH, seq, g_mac1, TEST_IF_ETH0, TEST_IF_BRIDGE, 0);
+    test_done_add(seq);
+    test_input();
+    TEST_ASSERT_EQUAL_INT(3, g_num_events);
+}
+
+void
+test_brctl_mac_learn_busy(void)
+{
+    ev_tstamp start;
+    ev_tstamp first;
+    uint32_t seq;
+
+    /* A refused dump is retried after a delay, not right away */
+    brctl_mac_learning_nl_input(NULL, -ENOBUFS);
+    seq = test_dump_request();
+    test_error_add(seq, -EBUSY);
+    test_input();
+    TEST_ASSERT_EQUAL_UINT32(0, test_dump_request());
+
+    /* Further resync requests wait for the retry */
+    brctl_mac_learning_nl_input(NULL, -ENOBUFS);
+    TEST_ASSERT_EQUAL_UINT32(0, test_dump_request());
+
+    start = ev_time();
+    ev_run(EV_DEFAULT, EVRUN_ONCE);
+    first = ev_time() - start;
+    seq = test_dump_request();
+    TEST_ASSERT_NOT_EQUAL(0, seq);
+
+    /* The delay grows while the dump keeps failing */
+    test_error_add(seq, -EBUSY);
+    test_input();
+    start = ev_time();
+    ev_run(EV_DEFAULT, EVRUN_ONCE);
+    TEST_ASSERT_TRUE((ev_time() - start) > first * 1.5);
+    seq = test_dump_request();
+    TEST_ASSERT_NOT_EQUAL(0, seq);
+
+    test_done_add(seq);
+    test_input();
+    TEST_ASSERT_EQUAL_UINT32(0, test_dump_request());
+}
+
+void
+test_brctl_mac_learn_unregister(void)
+{
+    test_neigh_add(RTM_NEWNEIGH, 0, g_mac1, TEST_IF_ETH0, TEST_IF_BRIDGE, 0);
+    test_input();
+    TEST_ASSERT_EQUAL_INT(1, g_num_events);
+
+    /* The socket is closed and the entries released without reports */
+    brctl_mac_learning_unregister();
+    TEST_ASSERT_EQUAL_INT(-1, fcntl(g_fd[0], F_GETFD));
+    TEST_ASSERT_EQUAL_INT(EBADF, errno);
+    TEST_ASSERT_EQUAL_INT(1, g_num_events);
+}
+
+void
+run_test_brctl_mac_learn(void)
+{
+    RUN_TEST(test_brctl_mac_learn_parse);
+    RUN_TEST(test_brctl_mac_learn_new_del);
+    RUN_TEST(test_brctl_mac_learn_port_move);
+    RUN_TEST(test_brctl_mac_learn_vlans);
+    RUN_TEST(test_brctl_mac_learn_resync);
+    RUN_TEST(test_brctl_mac_learn_busy);
+    RUN_TEST(test_brctl_mac_learn_unregister);
+}
+
+/*
+ * ===========================================================================
+ *  MAIN
+ * ===========================================================================
+ */
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    ut_init(test_name, NULL, NULL);
+
+    ut_setUp_tearDown(test_name, test_brctl_mac_learn_setUp, test_brctl_mac_learn_tearDown);
+
+    run_test_brctl_mac_learn();
+
+    return ut_fini();
+}
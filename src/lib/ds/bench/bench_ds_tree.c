@@ -0,0 +1,153 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "ds_tree.h"
+
+#define BENCH_TREE_SIZE 4096
+
+struct bench_node
+{
+    int key;
+    ds_tree_node_t node;
+};
+
+struct bench_tree
+{
+    ds_tree_t tree;
+    struct bench_node *nodes;
+    size_t num_nodes;
+    int *keys;
+};
+
+
+/* Deterministic pseudo-random keys, identical between runs */
+static uint32_t bench_rand(uint32_t *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 1;
+}
+
+
+static void bench_tree_setup(struct bench_tree *bt, size_t num_nodes, size_t fill)
+{
+    uint32_t seed = 1;
+    size_t i;
+
+    ds_tree_init(&bt->tree, ds_int_cmp, struct bench_node, node);
+    bt->num_nodes = num_nodes;
+    bt->nodes = calloc(num_nodes, sizeof(*bt->nodes));
+    bt->keys = calloc(num_nodes, sizeof(*bt->keys));
+    for (i = 0; i < num_nodes; i++) bt->nodes[i].key = bench_rand(&seed);
+
+    /* Lookup keys are picked among the inserted nodes */
+    for (i = 0; fill > 0 && i < num_nodes; i++)
+    {
+        bt->keys[i] = bt->nodes[bench_rand(&seed) % fill].key;
+    }
+
+    for (i = 0; i < fill; i++)
+    {
+        if (ds_tree_find(&bt->tree, &bt->nodes[i].key) != NULL) continue;
+        ds_tree_insert(&bt->tree, &bt->nodes[i], &bt->nodes[i].key);
+    }
+}
+
+
+static void bench_tree_teardown(struct bench_tree *bt)
+{
+    free(bt->nodes);
+    free(bt->keys);
+}
+
+
+static void bench_ds_tree_insert(void *ctx, size_t iter)
+{
+    struct bench_tree *bt = ctx;
+    struct bench_node *n = &bt->nodes[iter];
+
+    if (ds_tree_find(&bt->tree, &n->key) != NULL) return;
+    ds_tree_insert(&bt->tree, n, &n->key);
+}
+
+
+static void bench_ds_tree_find(void *ctx, size_t iter)
+{
+    struct bench_tree *bt = ctx;
+
+    BENCH_KEEP(ds_tree_find(&bt->tree, &bt->keys[iter % bt->num_nodes]));
+}
+
+
+static void bench_ds_tree_iter(void *ctx, size_t iter)
+{
+    struct bench_tree *bt = ctx;
+    struct bench_node *n;
+    int sum = 0;
+
+    ds_tree_foreach(&bt->tree, n)
+    {
+        sum += n->key;
+    }
+    BENCH_KEEP(sum);
+}
+
+
+/* Remove and re-insert an existing node, the tree size stays constant */
+static void bench_ds_tree_churn(void *ctx, size_t iter)
+{
+    struct bench_tree *bt = ctx;
+    struct bench_node *n;
+
+    n = ds_tree_find(&bt->tree, &bt->keys[iter % bt->num_nodes]);
+    if (n == NULL) return;
+
+    ds_tree_remove(&bt->tree, n);
+    ds_tree_insert(&bt->tree, n, &n->key);
+}
+
+
+int main(int argc, char *argv[])
+{
+    struct bench_tree bt;
+
+    bench_init("ds_tree", argc, argv);
+
+    bench_tree_setup(&bt, bench_num_ops(), 0);
+    BENCH_RUN(bench_ds_tree_insert, &bt);
+    bench_tree_teardown(&bt);
+
+    bench_tree_setup(&bt, BENCH_TREE_SIZE, BENCH_TREE_SIZE);
+    BENCH_RUN(bench_ds_tree_find, &bt);
+    BENCH_RUN(bench_ds_tree_churn, &bt);
+    BENCH_RUN(bench_ds_tree_iter, &bt);
+    bench_tree_teardown(&bt);
+
+    return bench_fini();
+}
@@ -147,15 +147,21 @@ struct fcm_filter_mgr
     void (*ovsdb_exit)(void);
 };
 
+/* Rule indexes must fit in a fcm_filter_mask_t */
 #define FCM_MAX_FILTERS 60
 #define FILTER_NAME_SIZE 32
 
+typedef uint64_t fcm_filter_mask_t;
+
+struct fcm_filter_classifier;
+
 struct filter_table
 {
     char name[FILTER_NAME_SIZE];
     ds_tree_t filters;
     ds_dlist_t filter_rules;
     struct fcm_filter *lookup_array[FCM_MAX_FILTERS];
+    struct fcm_filter_classifier *classifier; /* compiled rules, NULL when stale */
     ds_tree_node_t table_node;
 };
 
@@ -218,6 +224,18 @@ struct fcm_filter_req
 
 void fcm_apply_filter(struct fcm_session *session, struct fcm_filter_req *req);
 
+/* Rule by rule evaluation of a table, reference of the compiled classifier */
+void fcm_apply_filter_rules(struct fcm_session *session, struct fcm_filter_req *req);
+
+/* Packet count and application checks of a rule */
+bool fcm_filter_rule_stats_allow(struct fcm_filter_rule *rule, struct fcm_filter_req *req);
+
+struct fcm_filter_classifier *fcm_filter_classifier_compile(struct filter_table *table);
+bool fcm_filter_classifier_apply(struct fcm_filter_classifier *classifier,
+                                 struct fcm_filter_req *req);
+void fcm_filter_classifier_free(struct fcm_filter_classifier *classifier);
+void fcm_filter_table_invalidate(struct filter_table *table);
+
 void fcm_filter_layer2_apply(char *filter_name,
                              struct fcm_filter_l2_info *data,
                              struct fcm_filter_stats *pkts,
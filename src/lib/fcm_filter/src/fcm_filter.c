@@ -657,7 +657,53 @@ void fcm_filter_app_print(struct fcm_filter_rule *app)
     LOGT("----------------");
 }
 
+bool fcm_filter_rule_stats_allow(struct fcm_filter_rule *rule, struct fcm_filter_req *req)
+{
+    int pktcnt_allow;
+    int name_allow;
+
+    if (req->fkey)
+    {
+        name_allow = fcm_app_name_filter(rule, req->fkey);
+        if (name_allow == FCM_RULED_FALSE) return false;
+    }
+
+    /*
+     * If there is no packets count available and the the rule enforces
+     * packet count check, consider the situation as a failure
+     */
+    if (!req->pkts) return (rule->pktcnt_op == FCM_MATH_NONE);
+
+    pktcnt_allow = fcm_pkt_cnt_filter(get_filter_mgr(), rule, req->pkts);
+    return (pktcnt_allow != FCM_RULED_FALSE);
+}
+
 void fcm_apply_filter(struct fcm_session *session, struct fcm_filter_req *req)
+{
+    struct filter_table *table;
+    bool rc;
+
+    table = req->table;
+    if (table == NULL)
+    {
+        req->action = true;
+        return;
+    }
+
+    /* Compile the rules on their first use after a change */
+    if (table->classifier == NULL)
+    {
+        table->classifier = fcm_filter_classifier_compile(table);
+    }
+
+    rc = fcm_filter_classifier_apply(table->classifier, req);
+    if (rc) return;
+
+    /* The classifier could not handle the request, walk the rules */
+    fcm_apply_filter_rules(session, req);
+}
+
+void fcm_apply_filter_rules(struct fcm_session *session, struct fcm_filter_req *req)
 {
     int sport_allow, dport_allow, proto_allow;
     int vlanid_allow, pktcnt_allow;
@@ -806,6 +852,7 @@ void fcm_free_filter(struct fcm_filter *ffilter)
     free_filter_app(&ffilter->filter_rule);
     FREE(ffilter);
     table->lookup_array[idx] = NULL;
+    fcm_filter_table_invalidate(table);
 }
 
 void fcm_filter_cleanup(void)
@@ -853,6 +900,7 @@ void fcm_filter_cleanup(void)
         }
         table = ds_tree_next(tables_tree, table);
         ds_tree_remove(tables_tree, t_to_remove);
+        fcm_filter_table_invalidate(t_to_remove);
         FREE(t_to_remove);
     }
 
@@ -0,0 +1,804 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * FCM filter rules classifier
+ *
+ * The rules of a filter table are compiled into one lookup structure per
+ * matched field. Looking up a flow's field value returns the bitmap of the
+ * rules the value satisfies. The bitmaps of all fields are intersected, and
+ * the lowest rule index left wins, as with the rule by rule evaluation.
+ *
+ * Literal mac and ip addresses keep the string matching of the rule by rule
+ * evaluation: case and spelling matter. Only the tag lookups use the binary
+ * form of the flow's addresses.
+ */
+
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "memutil.h"
+#include "ovsdb_utils.h"
+#include "policy_tags.h"
+#include "fcm_filter.h"
+
+#define FCM_RULE_BIT(idx) (((fcm_filter_mask_t)1) << (idx))
+
+enum
+{
+    FCM_FIELD_SMAC = 0,
+    FCM_FIELD_DMAC,
+    FCM_FIELD_VLANID,
+    FCM_FIELD_SRC_IP,
+    FCM_FIELD_DST_IP,
+    FCM_FIELD_SPORT,
+    FCM_FIELD_DPORT,
+    FCM_FIELD_PROTO,
+    FCM_FIELD_MAX
+};
+
+/**
+ * @brief literal mac or ip address and the rules listing it
+ */
+struct fcm_filter_literal
+{
+    char *value;
+    fcm_filter_mask_t rules;
+};
+
+/**
+ * @brief tag and the rules listing it
+ */
+struct fcm_filter_tag
+{
+    struct om_tag_handle handle;
+    fcm_filter_mask_t rules;
+};
+
+/**
+ * @brief integer segment, from start up to the next segment's start
+ */
+struct fcm_filter_range
+{
+    int64_t start;
+    fcm_filter_mask_t rules;
+};
+
+/**
+ * @brief interval listed by a rule, used while compiling
+ */
+struct fcm_filter_interval
+{
+    int64_t lo;
+    int64_t hi;
+    int idx;
+};
+
+/**
+ * @brief compiled field
+ *
+ * Rules not checking the field, or with no valid operation, are neither in
+ * the in nor in the out bitmaps and always pass the field check.
+ */
+struct fcm_filter_field
+{
+    fcm_filter_mask_t in;   /* rules requiring the value to be listed */
+    fcm_filter_mask_t out;  /* rules requiring the value not to be listed */
+
+    struct fcm_filter_literal *literals;  /* sorted */
+    size_t num_literals;
+    struct fcm_filter_tag *tags;
+    size_t num_tags;
+
+    struct fcm_filter_interval *intervals;
+    size_t num_intervals;
+    struct fcm_filter_range *ranges;  /* sorted, first one starting at 0 */
+    size_t num_ranges;
+};
+
+struct fcm_filter_classifier
+{
+    struct filter_table *table;
+    fcm_filter_mask_t rules;        /* configured rules */
+    fcm_filter_mask_t stats_rules;  /* rules with app name or packet count checks */
+    struct fcm_filter_field fields[FCM_FIELD_MAX];
+};
+
+
+static int
+fcm_filter_hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+
+    return -1;
+}
+
+
+/**
+ * @brief parses a xx:xx:xx:xx:xx:xx mac string
+ *
+ * Called for every flow, hence not relying on sscanf().
+ */
+static bool
+fcm_filter_mac_to_bin(const char *mac_s, uint8_t *addr)
+{
+    int hi;
+    int lo;
+    int i;
+
+    for (i = 0; i < 6; i++)
+    {
+        hi = fcm_filter_hex_digit(mac_s[0]);
+        if (hi < 0) return false;
+        lo = fcm_filter_hex_digit(mac_s[1]);
+        if (lo < 0) return false;
+
+        addr[i] = (uint8_t)((hi << 4) | lo);
+        mac_s += 2;
+
+        if (i == 5) break;
+        if (*mac_s != ':') return false;
+        mac_s++;
+    }
+
+    return (*mac_s == '\0');
+}
+
+
+static uint8_t
+fcm_filter_ip_to_bin(const char *ip_s, uint8_t *addr, int *af)
+{
+    if (inet_pton(AF_INET, ip_s, addr) == 1)
+    {
+        *af = AF_INET;
+        return 4;
+    }
+
+    if (inet_pton(AF_INET6, ip_s, addr) == 1)
+    {
+        *af = AF_INET6;
+        return 16;
+    }
+
+    return 0;
+}
+
+
+static int
+fcm_filter_literal_cmp(const void *a, const void *b)
+{
+    const struct fcm_filter_literal *literal_a = a;
+    const struct fcm_filter_literal *literal_b = b;
+
+    return strcmp(literal_a->value, literal_b->value);
+}
+
+
+static int
+fcm_filter_int64_cmp(const void *a, const void *b)
+{
+    int64_t val_a = *(const int64_t *)a;
+    int64_t val_b = *(const int64_t *)b;
+
+    if (val_a < val_b) return -1;
+    if (val_a > val_b) return 1;
+
+    return 0;
+}
+
+
+static void
+fcm_filter_field_set_op(struct fcm_filter_field *field, bool present,
+                        int op, int idx)
+{
+    if (!present) return;
+
+    if (op == FCM_OP_IN) field->in |= FCM_RULE_BIT(idx);
+    else if (op == FCM_OP_OUT) field->out |= FCM_RULE_BIT(idx);
+}
+
+
+static bool
+fcm_filter_field_checked(struct fcm_filter_field *field, int idx)
+{
+    return ((field->in | field->out) & FCM_RULE_BIT(idx)) != 0;
+}
+
+
+/**
+ * @brief adds the entries of a rule's mac or ip set to a field
+ *
+ * Tags are kept as tag handles. Literal values are kept as strings, and
+ * matched as the rule by rule evaluation does.
+ */
+static void
+fcm_filter_field_add_addrs(struct fcm_filter_field *field,
+                           struct str_set *set, int idx)
+{
+    struct fcm_filter_literal *literal;
+    struct om_tag_handle handle;
+    struct fcm_filter_tag *tag;
+    size_t found;
+    size_t i;
+    size_t j;
+    bool rc;
+
+    if (set == NULL) return;
+    if (!fcm_filter_field_checked(field, idx)) return;
+
+    for (i = 0; i < set->nelems; i++)
+    {
+        rc = om_tag_handle_init(&handle, set->array[i]);
+        if (rc)
+        {
+            found = field->num_tags;
+            for (j = 0; j < field->num_tags; j++)
+            {
+                tag = &field->tags[j];
+                if (tag->handle.group != handle.group) continue;
+                if (tag->handle.match_flags != handle.match_flags) continue;
+                if (strcmp(tag->handle.name, handle.name)) continue;
+
+                found = j;
+                break;
+            }
+
+            if (found == field->num_tags)
+            {
+                tag = REALLOC(field->tags, (field->num_tags + 1) * sizeof(*tag));
+                field->tags = tag;
+                tag = &field->tags[field->num_tags++];
+                tag->handle = handle;
+                tag->rules = 0;
+            }
+            field->tags[found].rules |= FCM_RULE_BIT(idx);
+            continue;
+        }
+
+        literal = REALLOC(field->literals,
+                          (field->num_literals + 1) * sizeof(*literal));
+        field->literals = literal;
+        literal = &field->literals[field->num_literals++];
+        literal->value = STRDUP(set->array[i]);
+        literal->rules = FCM_RULE_BIT(idx);
+    }
+}
+
+
+static void
+fcm_filter_field_add_interval(struct fcm_filter_field *field,
+                              int64_t lo, int64_t hi, int idx)
+{
+    struct fcm_filter_interval *interval;
+
+    interval = REALLOC(field->intervals,
+                       (field->num_intervals + 1) * sizeof(*interval));
+    field->intervals = interval;
+    interval = &field->intervals[field->num_intervals++];
+    interval->lo = lo;
+    interval->hi = hi;
+    interval->idx = idx;
+}
+
+
+static void
+fcm_filter_field_add_ints(struct fcm_filter_field *field,
+                          struct int_set *set, int idx)
+{
+    size_t i;
+
+    if (set == NULL) return;
+    if (!fcm_filter_field_checked(field, idx)) return;
+
+    for (i = 0; i < set->nelems; i++)
+    {
+        fcm_filter_field_add_interval(field, set->array[i], set->array[i], idx);
+    }
+}
+
+
+static void
+fcm_filter_field_add_ports(struct fcm_filter_field *field,
+                           struct ip_port *ports, int num_ports, int idx)
+{
+    struct ip_port *port;
+    int64_t hi;
+    int i;
+
+    if (ports == NULL) return;
+    if (!fcm_filter_field_checked(field, idx)) return;
+
+    for (i = 0; i < num_ports; i++)
+    {
+        port = &ports[i];
+
+        /* A port_max of 0 means no range. An inverted range matches port_min */
+        hi = port->port_min;
+        if (port->port_max != 0 && port->port_max >= port->port_min) hi = port->port_max;
+
+        fcm_filter_field_add_interval(field, port->port_min, hi, idx);
+    }
+}
+
+
+/**
+ * @brief sorts the field literals and merges the duplicates
+ */
+static void
+fcm_filter_field_build_literals(struct fcm_filter_field *field)
+{
+    struct fcm_filter_literal *literals;
+    size_t num_literals;
+    size_t i;
+
+    if (field->num_literals == 0) return;
+
+    literals = field->literals;
+    qsort(literals, field->num_literals, sizeof(*literals),
+          fcm_filter_literal_cmp);
+
+    num_literals = 1;
+    for (i = 1; i < field->num_literals; i++)
+    {
+        if (fcm_filter_literal_cmp(&literals[num_literals - 1], &literals[i]) == 0)
+        {
+            literals[num_literals - 1].rules |= literals[i].rules;
+            FREE(literals[i].value);
+            continue;
+        }
+        literals[num_literals++] = literals[i];
+    }
+    field->num_literals = num_literals;
+}
+
+
+/**
+ * @brief splits the field intervals into disjoint segments
+ *
+ * Each segment carries the bitmap of the rules whose intervals cover it.
+ */
+static void
+fcm_filter_field_build_ranges(struct fcm_filter_field *field)
+{
+    struct fcm_filter_interval *interval;
+    struct fcm_filter_range *range;
+    size_t num_bounds;
+    int64_t *bounds;
+    size_t i;
+    size_t j;
+
+    if (field->num_intervals == 0) return;
+
+    /* Segments start at 0, at each interval start and after each interval end */
+    bounds = CALLOC((2 * field->num_intervals) + 1, sizeof(*bounds));
+    num_bounds = 0;
+    bounds[num_bounds++] = 0;
+    for (i = 0; i < field->num_intervals; i++)
+    {
+        interval = &field->intervals[i];
+        bounds[num_bounds++] = interval->lo;
+        bounds[num_bounds++] = interval->hi + 1;
+    }
+    qsort(bounds, num_bounds, sizeof(*bounds), fcm_filter_int64_cmp);
+
+    field->ranges = CALLOC(num_bounds, sizeof(*field->ranges));
+    for (i = 0; i < num_bounds; i++)
+    {
+        if (field->num_ranges != 0)
+        {
+            range = &field->ranges[field->num_ranges - 1];
+            if (range->start == bounds[i]) continue;
+        }
+
+        range = &field->ranges[field->num_ranges++];
+        range->start = bounds[i];
+        for (j = 0; j < field->num_intervals; j++)
+        {
+            interval = &field->intervals[j];
+            if (interval->lo > range->start) continue;
+            if (interval->hi < range->start) continue;
+
+            range->rules |= FCM_RULE_BIT(interval->idx);
+        }
+    }
+
+    FREE(bounds);
+    FREE(field->intervals);
+    field->intervals = NULL;
+    field->num_intervals = 0;
+}
+
+
+/**
+ * @brief returns the rules listing a value as a literal
+ *
+ * The rule by rule evaluation matches a literal starting with the value,
+ * as strncmp(value, literal, strlen(value)). Such literals are contiguous
+ * in the sorted literals, starting from the first one not lower than the
+ * value.
+ */
+static fcm_filter_mask_t
+fcm_filter_field_lookup_literal(struct fcm_filter_field *field,
+                                const char *value)
+{
+    struct fcm_filter_literal *literals;
+    fcm_filter_mask_t rules;
+    size_t len;
+    size_t lo;
+    size_t hi;
+    size_t mid;
+
+    rules = 0;
+    literals = field->literals;
+
+    lo = 0;
+    hi = field->num_literals;
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (strcmp(literals[mid].value, value) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+
+    len = strlen(value);
+    for (; lo < field->num_literals; lo++)
+    {
+        if (strncmp(literals[lo].value, value, len) != 0) break;
+        rules |= literals[lo].rules;
+    }
+
+    return rules;
+}
+
+
+/**
+ * @brief returns the rules listing a binary address through a tag
+ *
+ * @param listed the rules already listing the address
+ */
+static fcm_filter_mask_t
+fcm_filter_field_lookup_tags(struct fcm_filter_field *field,
+                             const uint8_t *addr, int af,
+                             fcm_filter_mask_t listed)
+{
+    struct fcm_filter_tag *tag;
+    fcm_filter_mask_t rules;
+    bool rc;
+    size_t i;
+
+    rules = listed;
+    for (i = 0; i < field->num_tags; i++)
+    {
+        tag = &field->tags[i];
+
+        /* The value is already listed by all the rules referring the tag */
+        if ((rules & tag->rules) == tag->rules) continue;
+
+        if (af == AF_UNSPEC) rc = om_tag_handle_in_mac(&tag->handle, (os_macaddr_t *)addr);
+        else rc = om_tag_handle_in_ip(&tag->handle, af, addr);
+        if (rc) rules |= tag->rules;
+    }
+
+    return rules;
+}
+
+
+static fcm_filter_mask_t
+fcm_filter_field_lookup_int(struct fcm_filter_field *field, int64_t val)
+{
+    struct fcm_filter_range *ranges;
+    size_t lo;
+    size_t hi;
+    size_t mid;
+
+    if (field->num_ranges == 0) return 0;
+    if (val < 0) return 0;
+
+    /* Find the last segment starting at or before val */
+    ranges = field->ranges;
+    lo = 0;
+    hi = field->num_ranges;
+    while (hi - lo > 1)
+    {
+        mid = lo + (hi - lo) / 2;
+        if (ranges[mid].start <= val) lo = mid;
+        else hi = mid;
+    }
+
+    return ranges[lo].rules;
+}
+
+
+/**
+ * @brief returns the rules passing a field check given the listing rules
+ *
+ * @param field the compiled field
+ * @param listed the rules listing the flow's value
+ */
+static fcm_filter_mask_t
+fcm_filter_field_pass(struct fcm_filter_field *field, fcm_filter_mask_t listed)
+{
+    fcm_filter_mask_t pass;
+
+    pass = ~(field->in | field->out);
+    pass |= (field->in & listed);
+    pass |= (field->out & ~listed);
+
+    return pass;
+}
+
+
+static void
+fcm_filter_field_free(struct fcm_filter_field *field)
+{
+    size_t i;
+
+    for (i = 0; i < field->num_literals; i++) FREE(field->literals[i].value);
+    FREE(field->literals);
+    FREE(field->tags);
+    FREE(field->intervals);
+    FREE(field->ranges);
+}
+
+
+void
+fcm_filter_classifier_free(struct fcm_filter_classifier *classifier)
+{
+    int i;
+
+    if (classifier == NULL) return;
+
+    for (i = 0; i < FCM_FIELD_MAX; i++)
+    {
+        fcm_filter_field_free(&classifier->fields[i]);
+    }
+
+    FREE(classifier);
+}
+
+
+void
+fcm_filter_table_invalidate(struct filter_table *table)
+{
+    if (table == NULL) return;
+
+    fcm_filter_classifier_free(table->classifier);
+    table->classifier = NULL;
+}
+
+
+struct fcm_filter_classifier *
+fcm_filter_classifier_compile(struct filter_table *table)
+{
+    struct fcm_filter_classifier *classifier;
+    struct fcm_filter_field *fields;
+    struct fcm_filter_rule *rule;
+    struct fcm_filter *ffilter;
+    int i;
+
+    if (table == NULL) return NULL;
+
+    classifier = CALLOC(1, sizeof(*classifier));
+    classifier->table = table;
+    fields = classifier->fields;
+
+    for (i = 0; i < FCM_MAX_FILTERS; i++)
+    {
+        ffilter = table->lookup_array[i];
+        if (ffilter == NULL) continue;
+
+        rule = &ffilter->filter_rule;
+        classifier->rules |= FCM_RULE_BIT(i);
+
+        if (rule->appname_present || rule->pktcnt_op != FCM_MATH_NONE)
+        {
+            classifier->stats_rules |= FCM_RULE_BIT(i);
+        }
+
+        fcm_filter_field_set_op(&fields[FCM_FIELD_SMAC], rule->smac_rule_present, rule->smac_op, i);
+        fcm_filter_field_add_addrs(&fields[FCM_FIELD_SMAC], rule->smac, i);
+
+        fcm_filter_field_set_op(&fields[FCM_FIELD_DMAC], rule->dmac_rule_present, rule->dmac_op, i);
+        fcm_filter_field_add_addrs(&fields[FCM_FIELD_DMAC], rule->dmac, i);
+
+        fcm_filter_field_set_op(&fields[FCM_FIELD_VLANID], rule->vlanid_rule_present, rule->vlanid_op, i);
+        fcm_filter_field_add_ints(&fields[FCM_FIELD_VLANID], rule->vlanid, i);
+
+        fcm_filter_field_set_op(&fields[FCM_FIELD_SRC_IP], rule->src_ip_rule_present, rule->src_ip_op, i);
+        fcm_filter_field_add_addrs(&fields[FCM_FIELD_SRC_IP], rule->src_ip, i);
+
+        fcm_filter_field_set_op(&fields[FCM_FIELD_DST_IP], rule->dst_ip_rule_present, rule->dst_ip_op, i);
+        fcm_filter_field_add_addrs(&fields[FCM_FIELD_DST_IP], rule->dst_ip, i);
+
+        fcm_filter_field_set_op(&fields[FCM_FIELD_SPORT], rule->src_port_rule_present, rule->src_port_op, i);
+        fcm_filter_field_add_ports(&fields[FCM_FIELD_SPORT], rule->src_port, rule->src_port_len, i);
+
+        fcm_filter_field_set_op(&fields[FCM_FIELD_DPORT], rule->dst_port_rule_present, rule->dst_port_op, i);
+        fcm_filter_field_add_ports(&fields[FCM_FIELD_DPORT], rule->dst_port, rule->dst_port_len, i);
+
+        fcm_filter_field_set_op(&fields[FCM_FIELD_PROTO], rule->proto_rule_present, rule->proto_op, i);
+        fcm_filter_field_add_ints(&fields[FCM_FIELD_PROTO], rule->proto, i);
+    }
+
+    for (i = 0; i < FCM_FIELD_MAX; i++)
+    {
+        fcm_filter_field_build_literals(&fields[i]);
+        fcm_filter_field_build_ranges(&fields[i]);
+    }
+
+    LOGD("%s: table %s: compiled rules 0x%" PRIx64, __func__,
+         table->name, classifier->rules);
+
+    return classifier;
+}
+
+
+/**
+ * @brief checks a flow's mac address against a field
+ *
+ * @return false if the address could not be checked against the tags
+ */
+static bool
+fcm_filter_classify_mac(struct fcm_filter_field *field, const char *mac_s,
+                        fcm_filter_mask_t *candidates)
+{
+    fcm_filter_mask_t listed;
+    uint8_t addr[6];
+    bool rc;
+
+    /* No rule checks the field */
+    if ((field->in | field->out) == 0) return true;
+
+    listed = fcm_filter_field_lookup_literal(field, mac_s);
+    if (field->num_tags != 0)
+    {
+        rc = fcm_filter_mac_to_bin(mac_s, addr);
+        if (!rc) return false;
+
+        listed = fcm_filter_field_lookup_tags(field, addr, AF_UNSPEC, listed);
+    }
+    *candidates &= fcm_filter_field_pass(field, listed);
+
+    return true;
+}
+
+
+/**
+ * @brief checks a flow's ip address against a field
+ *
+ * @return false if the address could not be checked against the tags
+ */
+static bool
+fcm_filter_classify_ip(struct fcm_filter_field *field, const char *ip_s,
+                       fcm_filter_mask_t *candidates)
+{
+    fcm_filter_mask_t listed;
+    uint8_t addr[16];
+    uint8_t len;
+    int af;
+
+    /* No rule checks the field */
+    if ((field->in | field->out) == 0) return true;
+
+    listed = fcm_filter_field_lookup_literal(field, ip_s);
+    if (field->num_tags != 0)
+    {
+        len = fcm_filter_ip_to_bin(ip_s, addr, &af);
+        if (len == 0) return false;
+
+        listed = fcm_filter_field_lookup_tags(field, addr, af, listed);
+    }
+    *candidates &= fcm_filter_field_pass(field, listed);
+
+    return true;
+}
+
+
+static void
+fcm_filter_classify_int(struct fcm_filter_field *field, int64_t val,
+                        fcm_filter_mask_t *candidates)
+{
+    fcm_filter_mask_t listed;
+
+    if ((field->in | field->out) == 0) return;
+
+    listed = fcm_filter_field_lookup_int(field, val);
+    *candidates &= fcm_filter_field_pass(field, listed);
+}
+
+
+bool
+fcm_filter_classifier_apply(struct fcm_filter_classifier *classifier,
+                            struct fcm_filter_req *req)
+{
+    struct fcm_filter_field *fields;
+    fcm_filter_mask_t candidates;
+    fcm_filter_l2_info_t *l2_info;
+    fcm_filter_l3_info_t *l3_info;
+    struct fcm_filter *ffilter;
+    bool rc;
+    int i;
+
+    if (classifier == NULL) return false;
+
+    fields = classifier->fields;
+    candidates = classifier->rules;
+
+    l3_info = req->l3_info;
+    if (l3_info != NULL)
+    {
+        rc = fcm_filter_classify_ip(&fields[FCM_FIELD_SRC_IP], l3_info->src_ip, &candidates);
+        if (!rc) return false;
+
+        rc = fcm_filter_classify_ip(&fields[FCM_FIELD_DST_IP], l3_info->dst_ip, &candidates);
+        if (!rc) return false;
+
+        fcm_filter_classify_int(&fields[FCM_FIELD_SPORT], l3_info->sport, &candidates);
+        fcm_filter_classify_int(&fields[FCM_FIELD_DPORT], l3_info->dport, &candidates);
+        fcm_filter_classify_int(&fields[FCM_FIELD_PROTO], l3_info->l4_proto, &candidates);
+    }
+
+    l2_info = req->l2_info;
+    if (l2_info != NULL)
+    {
+        rc = fcm_filter_classify_mac(&fields[FCM_FIELD_SMAC], l2_info->src_mac, &candidates);
+        if (!rc) return false;
+
+        rc = fcm_filter_classify_mac(&fields[FCM_FIELD_DMAC], l2_info->dst_mac, &candidates);
+        if (!rc) return false;
+
+        fcm_filter_classify_int(&fields[FCM_FIELD_VLANID], l2_info->vlan_id, &candidates);
+    }
+
+    /* The first rule passing all checks decides of the action */
+    req->action = false;
+    for (i = 0; i < FCM_MAX_FILTERS && candidates != 0; i++)
+    {
+        if (!(candidates & FCM_RULE_BIT(i))) continue;
+        candidates &= ~FCM_RULE_BIT(i);
+
+        ffilter = classifier->table->lookup_array[i];
+        if (classifier->stats_rules & FCM_RULE_BIT(i))
+        {
+            rc = fcm_filter_rule_stats_allow(&ffilter->filter_rule, req);
+            if (!rc) continue;
+        }
+
+        rc = (ffilter->filter_rule.action == FCM_DEFAULT_INCLUDE);
+        rc |= (ffilter->filter_rule.action == FCM_INCLUDE);
+        req->action = rc;
+        break;
+    }
+
+    return true;
+}
@@ -323,6 +323,7 @@ fcm_filter_insert_schema(struct filter_table *table,
     ffilter->table = table;
     table->lookup_array[idx] = ffilter;
     ds_dlist_insert_tail(&table->filter_rules, ffilter);
+    fcm_filter_table_invalidate(table);
 
     return ffilter;
 
@@ -35,6 +35,7 @@ UNIT_SRC := src/fcm_filter.c
 UNIT_SRC += src/fcm_filter_ovsdb.c
 UNIT_SRC += src/fcm_filter_client.c
 UNIT_SRC += src/fcm_report_filter.c
+UNIT_SRC += src/fcm_filter_classifier.c
 
 UNIT_CFLAGS := -I$(UNIT_PATH)/inc
 UNIT_CFLAGS += -Isrc/fcm/inc
@@ -28,6 +28,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <time.h>
 #include <arpa/inet.h>
 
 #include "fcm.h"
@@ -1232,6 +1233,232 @@ void test_fcm_filter_app_update(void)
     FREE(req);
 }
 
+static double
+test_flows_per_sec(struct timespec *start, struct timespec *end, int nflows)
+{
+    double elapsed;
+
+    elapsed = (end->tv_sec - start->tv_sec);
+    elapsed += (end->tv_nsec - start->tv_nsec) / 1e9;
+    if (elapsed <= 0) return 0;
+
+    return nflows / elapsed;
+}
+
+/**
+ * @brief validate the compiled classifier against the rule by rule evaluation
+ *
+ * Applies all the combinations of the test flows to both evaluations, then
+ * reports the flows per second of each.
+ */
+void test_fcm_filter_classifier(void)
+{
+    size_t nl2, nl3, npkts, nfkeys;
+    struct fcm_filter_req req;
+    struct filter_table *table;
+    struct fcm_filter_mgr *mgr;
+    const int nflows = 100000;
+    struct timespec start;
+    struct timespec end;
+    double compiled_fps;
+    double rules_fps;
+    size_t i, j, k, l;
+    bool action;
+    size_t n;
+
+    n = sizeof(g_fcm_filter) / sizeof(g_fcm_filter[0]);
+    for (i = 0; i < n; i++)
+    {
+        g_mon.mon_type = OVSDB_UPDATE_NEW;
+        callback_FCM_Filter(&g_mon, NULL, &g_fcm_filter[i]);
+    }
+
+    mgr = get_filter_mgr();
+    table = ds_tree_find(&mgr->fcm_filters, "fcm_filter_1");
+    TEST_ASSERT_NOT_NULL(table);
+
+    /* The last entry of each array stands for a missing info */
+    nl2 = (sizeof(g_flow_l2) / sizeof(g_flow_l2[0])) + 1;
+    nl3 = (sizeof(g_flow_l3) / sizeof(g_flow_l3[0])) + 1;
+    npkts = (sizeof(g_flow_pkt) / sizeof(g_flow_pkt[0])) + 1;
+    nfkeys = (sizeof(g_fkey) / sizeof(g_fkey[0])) + 1;
+
+    for (i = 0; i < nl2; i++)
+    {
+        for (j = 0; j < nl3; j++)
+        {
+            for (k = 0; k < npkts; k++)
+            {
+                for (l = 0; l < nfkeys; l++)
+                {
+                    memset(&req, 0, sizeof(req));
+                    req.table = table;
+                    req.l2_info = (i < nl2 - 1 ? &g_flow_l2[i] : NULL);
+                    req.l3_info = (j < nl3 - 1 ? &g_flow_l3[j] : NULL);
+                    req.pkts = (k < npkts - 1 ? &g_flow_pkt[k] : NULL);
+                    req.fkey = (l < nfkeys - 1 ? &g_fkey[l] : NULL);
+
+                    fcm_apply_filter(session, &req);
+                    action = req.action;
+                    TEST_ASSERT_NOT_NULL(table->classifier);
+
+                    fcm_apply_filter_rules(session, &req);
+                    TEST_ASSERT_EQUAL(req.action, action);
+                }
+            }
+        }
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.table = table;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < (size_t)nflows; i++)
+    {
+        req.l2_info = &g_flow_l2[i % (nl2 - 1)];
+        req.l3_info = &g_flow_l3[i % (nl3 - 1)];
+        req.pkts = &g_flow_pkt[i % (npkts - 1)];
+        fcm_apply_filter_rules(session, &req);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    rules_fps = test_flows_per_sec(&start, &end, nflows);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < (size_t)nflows; i++)
+    {
+        req.l2_info = &g_flow_l2[i % (nl2 - 1)];
+        req.l3_info = &g_flow_l3[i % (nl3 - 1)];
+        req.pkts = &g_flow_pkt[i % (npkts - 1)];
+        fcm_apply_filter(session, &req);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    compiled_fps = test_flows_per_sec(&start, &end, nflows);
+
+    LOGI("%s: %zu rules: rule by rule: %.0f flows/s, compiled: %.0f flows/s",
+         __func__, n, rules_fps, compiled_fps);
+
+    /* Removing a rule invalidates the compiled rules */
+    g_mon.mon_type = OVSDB_UPDATE_DEL;
+    callback_FCM_Filter(&g_mon, &g_fcm_filter[0], NULL);
+    TEST_ASSERT_NULL(table->classifier);
+}
+
+struct schema_FCM_Filter g_literal_filter[] =
+{
+    {
+        .name = "fcm_filter_literals",
+        .index = 1,
+        .smac_op_exists = true,
+        .smac_len = 1,
+        .smac[0] = "aa:bb:cc:dd:ee:ff",
+        .smac_op = "in",
+        .action = "include",
+    },
+    {
+        .name = "fcm_filter_literals",
+        .index = 2,
+        .src_ip_op_exists = true,
+        .src_ip_len = 1,
+        .src_ip[0] = "2001:db8::0001",
+        .src_ip_op = "in",
+        .action = "include",
+    },
+    {
+        .name = "fcm_filter_literals",
+        .index = 3,
+        .dst_ip_op_exists = true,
+        .dst_ip_len = 1,
+        .dst_ip[0] = "10.0.0.12",
+        .dst_ip_op = "in",
+        .action = "include",
+    },
+};
+
+static bool
+test_literal_filter_apply(struct filter_table *table, const char *smac,
+                          const char *src_ip, const char *dst_ip)
+{
+    fcm_filter_l2_info_t l2_info;
+    fcm_filter_l3_info_t l3_info;
+    struct fcm_filter_req req;
+    bool action;
+    bool rc;
+
+    memset(&l2_info, 0, sizeof(l2_info));
+    l2_info.smac_op_exists = true;
+    l2_info.dmac_op_exists = true;
+    STRSCPY(l2_info.src_mac, smac);
+    STRSCPY(l2_info.dst_mac, "11:22:33:44:55:66");
+
+    memset(&l3_info, 0, sizeof(l3_info));
+    l3_info.src_ip_op_exists = true;
+    l3_info.dst_ip_op_exists = true;
+    STRSCPY(l3_info.src_ip, src_ip);
+    STRSCPY(l3_info.dst_ip, dst_ip);
+
+    memset(&req, 0, sizeof(req));
+    req.table = table;
+    req.l2_info = &l2_info;
+    req.l3_info = &l3_info;
+
+    /* The compiled rules handle the literals */
+    if (table->classifier == NULL) table->classifier = fcm_filter_classifier_compile(table);
+    rc = fcm_filter_classifier_apply(table->classifier, &req);
+    TEST_ASSERT_TRUE(rc);
+    action = req.action;
+
+    fcm_apply_filter_rules(NULL, &req);
+    TEST_ASSERT_EQUAL(req.action, action);
+
+    return action;
+}
+
+/**
+ * @brief validate the literal mac and ip matching of the compiled rules
+ *
+ * Literals are matched as strings, as the rule by rule evaluation does.
+ */
+void test_fcm_filter_classifier_literals(void)
+{
+    struct filter_table *table;
+    struct fcm_filter_mgr *mgr;
+    size_t n;
+    size_t i;
+
+    n = sizeof(g_literal_filter) / sizeof(g_literal_filter[0]);
+    for (i = 0; i < n; i++)
+    {
+        g_mon.mon_type = OVSDB_UPDATE_NEW;
+        callback_FCM_Filter(&g_mon, NULL, &g_literal_filter[i]);
+    }
+
+    mgr = get_filter_mgr();
+    table = ds_tree_find(&mgr->fcm_filters, "fcm_filter_literals");
+    TEST_ASSERT_NOT_NULL(table);
+
+    /* No literal listed */
+    TEST_ASSERT_FALSE(test_literal_filter_apply(table, "11:22:33:44:55:77",
+                                                "2001:db8::2", "10.0.0.2"));
+
+    /* Mac literals are case sensitive */
+    TEST_ASSERT_TRUE(test_literal_filter_apply(table, "aa:bb:cc:dd:ee:ff",
+                                               "2001:db8::2", "10.0.0.2"));
+    TEST_ASSERT_FALSE(test_literal_filter_apply(table, "AA:BB:CC:DD:EE:FF",
+                                                "2001:db8::2", "10.0.0.2"));
+
+    /* Ip literals only match their own spelling */
+    TEST_ASSERT_TRUE(test_literal_filter_apply(table, "11:22:33:44:55:77",
+                                               "2001:db8::0001", "10.0.0.2"));
+    TEST_ASSERT_FALSE(test_literal_filter_apply(table, "11:22:33:44:55:77",
+                                                "2001:db8::1", "10.0.0.2"));
+
+    /* A literal starting with the flow's value matches it */
+    TEST_ASSERT_TRUE(test_literal_filter_apply(table, "11:22:33:44:55:77",
+                                               "2001:db8::2", "10.0.0.1"));
+    TEST_ASSERT_FALSE(test_literal_filter_apply(table, "11:22:33:44:55:77",
+                                                "2001:db8::2", "10.0.0.123"));
+}
+
 int main(int argc, char *argv[])
 {
     (void)argc;
@@ -1259,6 +1486,8 @@ int main(int argc, char *argv[])
     // Test fcm_apply_filter
     RUN_TEST(test_fcm_apply_filter_check_7tuple_apply);
     RUN_TEST(test_fcm_apply_filter_check_l2_apply);
+    RUN_TEST(test_fcm_filter_classifier);
+    RUN_TEST(test_fcm_filter_classifier_literals);
 
     return ut_fini();
 }
@@ -331,11 +331,14 @@ struct fsm_policy_req
  *   move on to the next check.
  * - Else the rule has failed.
  */
+struct om_tag_handle;
+
 struct fsm_policy_rules
 {
     bool mac_rule_present;
     int mac_op;
     struct str_set *macs;
+    struct om_tag_handle *mac_tags; /* resolved tags of macs, same indexes */
 
     bool fqdn_rule_present;
     int fqdn_op;
@@ -210,17 +210,26 @@ void fsm_free_url_reply(struct fsm_url_reply *reply)
 }
 
 
-bool find_mac_in_set(os_macaddr_t *mac, struct str_set *macs_set)
+/**
+ * @brief looks up a mac address in a macs set
+ *
+ * @param mac the mac address
+ * @param macs_set the set of mac addresses and tags
+ * @param tags the tag handles of the set entries, NULL to parse them
+ * @return true if found, false otherwise.
+ */
+static bool
+find_mac_in_tagged_set(os_macaddr_t *mac, struct str_set *macs_set,
+                       struct om_tag_handle *tags)
 {
+    struct om_tag_handle handle;
+    struct om_tag_handle *tag;
     char mac_s[32] = { 0 };
     size_t nelems;
     size_t i;
     bool rc;
     int ret;
 
-    snprintf(mac_s, sizeof(mac_s), PRI_os_macaddr_lower_t,
-             FMT_os_macaddr_pt(mac));
-
     nelems = macs_set->nelems;
 
     for (i = 0; i < nelems; i++)
@@ -229,8 +238,20 @@ bool find_mac_in_set(os_macaddr_t *mac, struct str_set *macs_set)
 
         set_entry = macs_set->array[i];
 
-        rc = om_tag_in(mac_s, set_entry);
-        if (rc) return true;
+        tag = (tags != NULL) ? &tags[i] : &handle;
+        if (tags == NULL) om_tag_handle_init(tag, set_entry);
+        if (tag->valid)
+        {
+            rc = om_tag_handle_in_mac(tag, mac);
+            if (rc) return true;
+            continue;
+        }
+
+        if (mac_s[0] == '\0')
+        {
+            snprintf(mac_s, sizeof(mac_s), PRI_os_macaddr_lower_t,
+                     FMT_os_macaddr_pt(mac));
+        }
 
         ret = strncmp(mac_s, set_entry, strlen(mac_s));
         if (ret != 0) continue;
@@ -242,6 +263,12 @@ bool find_mac_in_set(os_macaddr_t *mac, struct str_set *macs_set)
     return false;
 }
 
+
+bool find_mac_in_set(os_macaddr_t *mac, struct str_set *macs_set)
+{
+    return find_mac_in_tagged_set(mac, macs_set, NULL);
+}
+
 /**
  * @brief looks up a mac address in a policy's macs set.
  *
@@ -262,7 +289,7 @@ bool fsm_device_in_set(struct fsm_policy_req *req, struct fsm_policy *p)
 
     if (macs_set == NULL) return false;
 
-    return find_mac_in_set(mac, macs_set);
+    return find_mac_in_tagged_set(mac, macs_set, p->rules.mac_tags);
 }
 
 
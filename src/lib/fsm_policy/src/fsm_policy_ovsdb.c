@@ -219,6 +219,7 @@ fsm_free_rules(struct fsm_policy_rules *rules)
     rules->mac_rule_present = false;
     rules->mac_op = -1;
     free_str_set(rules->macs);
+    FREE(rules->mac_tags);
 
     /* Reset fqdn check */
     rules->fqdn_rule_present = false;
@@ -259,6 +260,7 @@ bool fsm_check_conversion(void *converted, int len)
 bool fsm_set_mac_rules(struct fsm_policy_rules *rules,
                        struct schema_FSM_Policy *spolicy)
 {
+    size_t i;
     int cmp;
     bool check;
 
@@ -278,7 +280,19 @@ bool fsm_set_mac_rules(struct fsm_policy_rules *rules,
                                  spolicy->macs_len,
                                  spolicy->macs);
     check = fsm_check_conversion(rules->macs, spolicy->macs_len);
-    return check;
+    if (!check) return false;
+    if (rules->macs == NULL) return true;
+
+    /* Parse the tags once, they are looked up again on tag changes only */
+    rules->mac_tags = CALLOC(rules->macs->nelems, sizeof(*rules->mac_tags));
+    if (rules->mac_tags == NULL) return false;
+
+    for (i = 0; i < rules->macs->nelems; i++)
+    {
+        om_tag_handle_init(&rules->mac_tags[i], rules->macs->array[i]);
+    }
+
+    return true;
 }
 
 
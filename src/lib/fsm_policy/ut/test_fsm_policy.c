@@ -1112,6 +1112,12 @@ void test_apply_mac_policies(void)
     rules_macs = rules->macs;
     TEST_ASSERT_NOT_NULL(rules_macs);
 
+    /* The tags are parsed once, the literal mac is not a tag */
+    TEST_ASSERT_NOT_NULL(rules->mac_tags);
+    TEST_ASSERT_TRUE(rules->mac_tags[0].valid);
+    TEST_ASSERT_TRUE(rules->mac_tags[1].valid);
+    TEST_ASSERT_FALSE(rules->mac_tags[2].valid);
+
         len = sizeof(macs) / sizeof(macs[0]);
 
     for (i = 0; i < len; i++)
@@ -37,6 +37,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "fsm.h"
 #include "ds_tree.h"
+#include "ds_dlist.h"
 #include "wc_telemetry.h"
 #include "gatekeeper_ecurl.h"
 
@@ -77,6 +78,27 @@ struct gk_mcurl_data
     struct timespec req_time;
     struct fsm_gk_verdict *gk_verdict;
     ds_tree_node_t mcurl_req_node;
+    char *inflight_key;                 /* set while the lookup is in flight */
+    ds_dlist_t followers;               /* requests waiting on this lookup */
+    ds_dlist_node_t follower_node;
+    ds_tree_node_t inflight_node;
+};
+
+/**
+ * @brief counters of the in-flight lookup coalescing
+ *
+ * A lookup for an attribute already being looked up for the same
+ * policy context does not issue its own cloud request. It waits
+ * for the reply of the outstanding (leader) request instead.
+ */
+struct gk_inflight_stats
+{
+    uint32_t leaders;       /* cloud requests followers could attach to */
+    uint32_t coalesced;     /* requests attached to an in-flight lookup */
+    uint32_t resolved;      /* followers resolved from the leader's reply */
+    uint32_t failed;        /* followers failed with their leader */
+    uint64_t total_wait_ms; /* summed wait of the resolved followers */
+    long max_wait_ms;       /* longest wait of a resolved follower */
 };
 
 /**
@@ -148,6 +170,8 @@ struct fsm_gk_session
     int32_t remote_lookup_retries;
     ds_tree_node_t session_node;
     ds_tree_t mcurl_data_tree;          /* tree for storing gk_mcurl_data */
+    ds_tree_t mcurl_inflight_tree;      /* in-flight lookups by attribute */
+    struct gk_inflight_stats inflight_stats;
     struct fsm_url_stats health_stats;
     time_t health_stats_report_ts;
     long health_stats_report_interval;
@@ -302,6 +326,18 @@ gk_process_using_multi_curl(struct fsm_policy_req *req, struct fsm_policy_reply
 void
 free_mcurl_data(struct gk_mcurl_data *mcurl_request);
 
+/**
+ * @brief frees the pending requests of a session
+ *
+ * (Exposed for testing)
+ *
+ * The requests still waiting on an in-flight lookup are failed.
+ *
+ * @param gk_session the gatekeeper session
+ */
+void
+gk_clean_mcurl_tree(struct fsm_gk_session *gk_session);
+
 bool
 gk_process_using_multi_curl(struct fsm_policy_req *policy_req,
                             struct fsm_policy_reply *policy_reply);
@@ -31,6 +31,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <ev.h>
 
 #include "gatekeeper_msg.h"
+#include "gatekeeper.pb-c.h"
 #include "gatekeeper.h"
 #include "ds_tree.h"
 #include "os_types.h"
@@ -96,5 +97,62 @@ gk_curl_multi_cleanup(struct gk_curl_multi_info *mcurl_info);
 bool
 gk_multi_curl_init(struct gk_curl_multi_info *mcurl_info, struct ev_loop *loop);
 
+/**
+ * @brief builds the key used to coalesce in-flight lookups
+ *
+ * Two requests with the same key get the same answer from the
+ * gatekeeper service: same request type, same normalized attribute
+ * and same policy context (network id, policy rule, features).
+ * @param req the policy request
+ * @param key buffer receiving the key
+ * @param len size of the buffer
+ * @return true if the request can be coalesced, false otherwise
+ */
+bool
+gk_mcurl_inflight_key(struct fsm_policy_req *req, char *key, size_t len);
+
+
+/**
+ * @brief attaches a request to an in-flight lookup of the same key
+ *
+ * @param gk_session the gatekeeper session
+ * @param key the coalescing key of the request
+ * @param req the policy request
+ * @param policy_reply the policy reply
+ * @return true if the request was attached and will be answered
+ *         from the leader's reply, false otherwise
+ */
+bool
+gk_mcurl_inflight_attach(struct fsm_gk_session *gk_session, const char *key,
+                         struct fsm_policy_req *req,
+                         struct fsm_policy_reply *policy_reply);
+
+
+/**
+ * @brief registers a sent request as the in-flight lookup for its key
+ *
+ * @param gk_session the gatekeeper session
+ * @param mcurl_data the leader request
+ * @param key the coalescing key of the request
+ */
+void
+gk_mcurl_inflight_add(struct fsm_gk_session *gk_session,
+                      struct gk_mcurl_data *mcurl_data, const char *key);
+
+
+/**
+ * @brief ends an in-flight lookup and answers its followers
+ *
+ * Followers are resolved from the response when one is provided,
+ * and failed otherwise.
+ * @param gk_session the gatekeeper session
+ * @param mcurl_data the leader request
+ * @param response the unpacked gatekeeper reply, or NULL on failure
+ */
+void
+gk_mcurl_inflight_release(struct fsm_gk_session *gk_session,
+                          struct gk_mcurl_data *mcurl_data,
+                          Gatekeeper__Southbound__V1__GatekeeperReply *response);
+
 
 #endif /* GK_CURL_H_INCLUDED */
@@ -24,6 +24,7 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <inttypes.h>
 #include <stdlib.h>
 #include <stddef.h>
 #include <time.h>
@@ -57,6 +58,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define GK_UNRATED_TTL (60*60*24)
 #define GK_MULTI_CURL_REQ_TIMEOUT 120
 #define GK_REDIRECT_TTL 10
+#define GK_INFLIGHT_KEY_LEN 512
 
 static ovsdb_table_t table_SSL;
 
@@ -81,6 +83,23 @@ gatekeeper_get_mgr(void)
 /* Local log interval */
 #define GATEKEEPER_LOG_PERIODIC 120
 
+static void
+gatekeeper_log_inflight_stats(struct fsm_gk_session *fsm_gk_session)
+{
+    struct gk_inflight_stats *stats;
+    uint64_t avg_wait;
+
+    stats = &fsm_gk_session->inflight_stats;
+    avg_wait = 0;
+    if (stats->resolved != 0) avg_wait = stats->total_wait_ms / stats->resolved;
+
+    LOGI("%s: coalescing lookups sent: %u", __func__, stats->leaders);
+    LOGI("%s: coalesced lookups: %u (resolved %u, failed %u)", __func__,
+         stats->coalesced, stats->resolved, stats->failed);
+    LOGI("%s: coalesced lookup wait in ms: avg %" PRIu64 ", max %ld", __func__,
+         avg_wait, stats->max_wait_ms);
+}
+
 static void
 gatekeeper_log_health_stats(struct fsm_gk_session *fsm_gk_session,
                             struct wc_health_stats *hs)
@@ -118,6 +137,7 @@ gatekeeper_log_health_stats(struct fsm_gk_session *fsm_gk_session,
          fsm_gk_session->dns_cache_hit_count);
     LOGI("%s: recycled LRU entries: %u", __func__,
          hs->lru_recycle_count);
+    gatekeeper_log_inflight_stats(fsm_gk_session);
 }
 
 /**
@@ -864,6 +884,9 @@ gk_purge_mcurl_data(struct fsm_gk_session* gk_session)
         to_remove = mcurl_data;
         mcurl_data = ds_tree_next(&gk_session->mcurl_data_tree, mcurl_data);
 
+        /* fail the requests still waiting on this lookup */
+        gk_mcurl_inflight_release(gk_session, to_remove, NULL);
+
         /* remove current node from the tree */
         ds_tree_remove(&gk_session->mcurl_data_tree, to_remove);
         /* free up the memory */
@@ -911,6 +934,7 @@ gk_add_mcurl_data(struct fsm_session *session,
     clock_gettime(CLOCK_REALTIME, &mcurl_data->req_time);
     mcurl_data->req_type   = policy_req->req_type;
     mcurl_data->gk_verdict = gk_verdict;
+    ds_dlist_init(&mcurl_data->followers, struct gk_mcurl_data, follower_node);
     LOGT("%s(): added curl data for request type: %d, with id %d, gk_verdict: %p, policy_req: %p, policy reply:%p",
          __func__,
          mcurl_data->req_type,
@@ -935,6 +959,9 @@ gk_process_using_multi_curl(struct fsm_policy_req *policy_req,
     struct fsm_gk_session *fsm_gk_session;
     struct gk_mcurl_data *mcurl_data;
     struct fsm_session *session;
+    char key[GK_INFLIGHT_KEY_LEN];
+    bool coalesce;
+    bool sent;
 
     session = policy_req->session;
 
@@ -942,11 +969,22 @@ gk_process_using_multi_curl(struct fsm_policy_req *policy_req,
     fsm_gk_session = gatekeeper_lookup_session(session->service);
     if (fsm_gk_session == NULL) return false;
 
+    /* wait for the reply of an identical lookup already in flight */
+    coalesce = gk_mcurl_inflight_key(policy_req, key, sizeof(key));
+    if (coalesce && gk_mcurl_inflight_attach(fsm_gk_session, key, policy_req, policy_reply))
+    {
+        return true;
+    }
+
     mcurl_data = gk_add_mcurl_data(session, policy_req, policy_reply);
     if (mcurl_data == NULL) return false;
     LOGT("%s(): returning mcurl_data == %p, mcurl_data->gk_verdict == %p", __func__, mcurl_data, mcurl_data->gk_verdict);
 
-    gk_send_mcurl_request(fsm_gk_session, mcurl_data);
+    if (coalesce) gk_mcurl_inflight_add(fsm_gk_session, mcurl_data, key);
+
+    sent = gk_send_mcurl_request(fsm_gk_session, mcurl_data);
+    if (!sent) gk_mcurl_inflight_release(fsm_gk_session, mcurl_data, NULL);
+
     return true;
 }
 
@@ -1222,6 +1260,11 @@ gatekeeper_init_curl(struct fsm_session *session)
                     struct gk_mcurl_data,
                     mcurl_req_node);
 
+    ds_tree_init(&fsm_gk_session->mcurl_inflight_tree,
+                    ds_str_cmp,
+                    struct gk_mcurl_data,
+                    inflight_node);
+
     if (fsm_gk_session->enable_multi_curl)
     {
         LOGI("%s(): initializing multi curl", __func__);
@@ -1745,6 +1788,8 @@ gatekeeper_periodic(struct fsm_session *session)
         stats = &fsm_gk_session->health_stats;
         memset(stats, 0, sizeof(*stats));
         stats->min_lookup_latency = LONG_MAX;
+        memset(&fsm_gk_session->inflight_stats, 0,
+               sizeof(fsm_gk_session->inflight_stats));
     }
 
     /* Now check for hero stats */
@@ -1875,9 +1920,20 @@ void
 free_mcurl_data(struct gk_mcurl_data *mcurl_request)
 {
     struct fsm_gk_verdict *gk_verdict;
+    struct gk_mcurl_data *follower;
 
     if (mcurl_request == NULL) return;
 
+    /* followers are only queued while the lookup is in flight */
+    if (mcurl_request->inflight_key != NULL)
+    {
+        while ((follower = ds_dlist_remove_head(&mcurl_request->followers)) != NULL)
+        {
+            free_mcurl_data(follower);
+        }
+        FREE(mcurl_request->inflight_key);
+    }
+
     if (mcurl_request->gk_verdict)
     {
         gk_verdict = mcurl_request->gk_verdict;
@@ -1893,24 +1949,32 @@ free_mcurl_data(struct gk_mcurl_data *mcurl_request)
 /**
  * @brief frees memory used by mcurl_data_tree
  *
- * @param tree pointer to mcurl_data_tree
+ * The requests still waiting on an in-flight lookup are failed.
+ *
+ * @param gk_session the gatekeeper session
  */
 void
-gk_clean_mcurl_tree(ds_tree_t *tree)
+gk_clean_mcurl_tree(struct fsm_gk_session *gk_session)
 {
     struct gk_mcurl_data *to_remove;
     struct gk_mcurl_data *current;
+    ds_tree_t *tree;
 
-    if (tree == NULL) return;
+    if (gk_session == NULL) return;
 
+    tree = &gk_session->mcurl_data_tree;
     current = ds_tree_head(tree);
     while (current != NULL)
     {
         to_remove = current;
         current = ds_tree_next(tree, current);
+        gk_mcurl_inflight_release(gk_session, to_remove, NULL);
         ds_tree_remove(tree, to_remove);
         free_mcurl_data(to_remove);
     }
+
+    ds_tree_init(&gk_session->mcurl_inflight_tree, ds_str_cmp,
+                 struct gk_mcurl_data, inflight_node);
 }
 
 /**
@@ -1975,7 +2039,7 @@ gatekeeper_delete_session(struct fsm_session *session)
 
     LOGD("%s: removing session %s", __func__, session->name);
     ds_tree_remove(sessions, gk_session);
-    gk_clean_mcurl_tree(&gk_session->mcurl_data_tree);
+    gk_clean_mcurl_tree(gk_session);
     gatekeeper_free_session(gk_session);
 }
 
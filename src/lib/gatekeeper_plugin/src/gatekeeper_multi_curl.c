@@ -26,13 +26,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 
 #include <curl/curl.h>
+#include <ctype.h>
 #include <ev.h>
+#include <inttypes.h>
 #include <time.h>
 #include <mxml.h>
 
 #include "gatekeeper_single_curl.h"
 #include "gatekeeper_multi_curl.h"
 #include "gatekeeper.pb-c.h"
+#include "fsm_dpi_utils.h"
 #include "memutil.h"
 #include "log.h"
 
@@ -290,6 +293,202 @@ gk_lookup_curl_data(struct fsm_gk_session *gk_session,
     return mcurl_data;
 }
 
+/**
+ * @brief builds the key used to coalesce in-flight lookups
+ *
+ * Only name based requests are coalesced. IP requests carry the
+ * flow they were issued for and are always sent on their own.
+ */
+bool
+gk_mcurl_inflight_key(struct fsm_policy_req *req, char *key, size_t len)
+{
+    const char *network_id;
+    const char *rule_name;
+    size_t offset;
+    bool lower;
+    int req_type;
+    char *p;
+    int rc;
+
+    if (req == NULL || key == NULL) return false;
+    if (req->url == NULL) return false;
+
+    req_type = fsm_policy_get_req_type(req);
+    switch (req_type)
+    {
+        case FSM_FQDN_REQ:
+        case FSM_SNI_REQ:
+        case FSM_HOST_REQ:
+            lower = true;
+            break;
+
+        case FSM_URL_REQ:
+        case FSM_APP_REQ:
+            lower = false;
+            break;
+
+        default:
+            return false;
+    }
+
+    network_id = fsm_ops_get_network_id(req->session, req->device_id);
+    rule_name = (req->policy != NULL ? req->policy->rule_name : NULL);
+
+    rc = snprintf(key, len, "%d|%s|%s|%" PRIx64 "|",
+                  req_type,
+                  network_id ? network_id : "",
+                  rule_name ? rule_name : "",
+                  req->supported_features);
+    if (rc < 0 || (size_t)rc >= len) return false;
+    offset = rc;
+
+    rc = snprintf(key + offset, len - offset, "%s", req->url);
+    if (rc < 0 || (size_t)rc >= (len - offset)) return false;
+
+    if (!lower) return true;
+
+    /* host names are case insensitive, and may be fully qualified */
+    for (p = key + offset; *p != '\0'; p++) *p = tolower((unsigned char)*p);
+    if (p > (key + offset) && p[-1] == '.') p[-1] = '\0';
+
+    return true;
+}
+
+
+bool
+gk_mcurl_inflight_attach(struct fsm_gk_session *gk_session, const char *key,
+                         struct fsm_policy_req *req,
+                         struct fsm_policy_reply *policy_reply)
+{
+    struct fsm_gk_verdict *gk_verdict;
+    struct gk_mcurl_data *follower;
+    struct gk_mcurl_data *leader;
+
+    if (gk_session == NULL || key == NULL) return false;
+
+    leader = ds_tree_find(&gk_session->mcurl_inflight_tree, key);
+    if (leader == NULL) return false;
+
+    follower = CALLOC(1, sizeof(*follower));
+    if (follower == NULL) return false;
+
+    gk_verdict = CALLOC(1, sizeof(*gk_verdict));
+    if (gk_verdict == NULL)
+    {
+        FREE(follower);
+        return false;
+    }
+
+    gk_verdict->policy_req = req;
+    gk_verdict->policy_reply = policy_reply;
+    gk_verdict->gk_session_context = gk_session;
+
+    follower->timestamp = time(NULL);
+    clock_gettime(CLOCK_REALTIME, &follower->req_time);
+    follower->req_type = req->req_type;
+    follower->req_id = leader->req_id;
+    follower->gk_verdict = gk_verdict;
+
+    ds_dlist_insert_tail(&leader->followers, follower);
+    gk_session->inflight_stats.coalesced++;
+
+    LOGT("%s(): request %p for '%s' attached to in-flight request type %d, id %d",
+         __func__, req, req->url, leader->req_type, leader->req_id);
+
+    return true;
+}
+
+
+void
+gk_mcurl_inflight_add(struct fsm_gk_session *gk_session,
+                      struct gk_mcurl_data *mcurl_data, const char *key)
+{
+    if (gk_session == NULL || mcurl_data == NULL || key == NULL) return;
+    if (mcurl_data->inflight_key != NULL) return;
+
+    /* a lookup for this key is already in flight */
+    if (ds_tree_find(&gk_session->mcurl_inflight_tree, key) != NULL) return;
+
+    mcurl_data->inflight_key = STRDUP(key);
+    ds_tree_insert(&gk_session->mcurl_inflight_tree, mcurl_data,
+                   mcurl_data->inflight_key);
+    gk_session->inflight_stats.leaders++;
+}
+
+
+/**
+ * @brief answers a request which waited on an in-flight lookup
+ *
+ * @param gk_session the gatekeeper session
+ * @param follower the waiting request
+ * @param response the leader's reply, or NULL if the lookup failed
+ */
+static void
+gk_mcurl_inflight_resolve(struct fsm_gk_session *gk_session,
+                          struct gk_mcurl_data *follower,
+                          Gatekeeper__Southbound__V1__GatekeeperReply *response)
+{
+    struct gk_inflight_stats *stats;
+    struct fsm_policy_reply *policy_reply;
+    struct fsm_policy_req *policy_req;
+    struct timespec now;
+    long wait_ms;
+    bool ret;
+
+    stats = &gk_session->inflight_stats;
+    policy_req = follower->gk_verdict->policy_req;
+    policy_reply = follower->gk_verdict->policy_reply;
+
+    ret = (response != NULL);
+    if (ret) ret = gk_set_policy(response, follower->gk_verdict);
+    if (!ret || policy_reply->gatekeeper_response == NULL)
+    {
+        stats->failed++;
+        policy_reply->categorized = FSM_FQDN_CAT_FAILED;
+        if (policy_reply->policy_response == NULL) return;
+
+        policy_reply->policy_response(policy_req, policy_reply);
+        return;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    wait_ms = (now.tv_sec - follower->req_time.tv_sec) * 1000;
+    wait_ms += (now.tv_nsec - follower->req_time.tv_nsec) / 1000000;
+    stats->resolved++;
+    stats->total_wait_ms += wait_ms;
+    if (wait_ms > stats->max_wait_ms) stats->max_wait_ms = wait_ms;
+
+    LOGT("%s(): '%s' resolved from in-flight lookup after %ld ms", __func__,
+         policy_req->url, wait_ms);
+
+    gk_update_uncategorized_count(gk_session, follower->gk_verdict);
+    gk_add_policy_to_cache(policy_req, policy_reply);
+    policy_reply->gatekeeper_response(policy_req, policy_reply);
+}
+
+
+void
+gk_mcurl_inflight_release(struct fsm_gk_session *gk_session,
+                          struct gk_mcurl_data *mcurl_data,
+                          Gatekeeper__Southbound__V1__GatekeeperReply *response)
+{
+    struct gk_mcurl_data *follower;
+
+    if (gk_session == NULL || mcurl_data == NULL) return;
+    if (mcurl_data->inflight_key == NULL) return;
+
+    /* no more followers once the reply is in */
+    ds_tree_remove(&gk_session->mcurl_inflight_tree, mcurl_data);
+    FREE(mcurl_data->inflight_key);
+    mcurl_data->inflight_key = NULL;
+
+    while ((follower = ds_dlist_remove_head(&mcurl_data->followers)) != NULL)
+    {
+        gk_mcurl_inflight_resolve(gk_session, follower, response);
+        free_mcurl_data(follower);
+    }
+}
+
 void
 gk_process_fail_response(struct gk_conn_info *conn)
 {
@@ -322,6 +521,9 @@ gk_process_fail_response(struct gk_conn_info *conn)
     offline = &gk_session->gk_offline;
     offline->connection_failures++;
 
+    /* requests waiting on this lookup fail along with it */
+    gk_mcurl_inflight_release(gk_session, mcurl_data, NULL);
+
     if (mcurl_data->gk_verdict->policy_reply == NULL)
     {
         LOGD("%s(): policy reply is NULL", __func__);
@@ -377,6 +579,10 @@ gk_process_response(struct gk_conn_info *conn)
     if (unpacked_data == NULL)
     {
         LOGD("%s(): http2: error in unpacking data", __func__);
+        mcurl_data = gk_find_curl_data(&gk_session->mcurl_data_tree,
+                                       conn->req_key.req_type,
+                                       conn->req_key.req_id);
+        gk_mcurl_inflight_release(gk_session, mcurl_data, NULL);
         return false;
     }
 
@@ -430,6 +636,8 @@ gk_process_response(struct gk_conn_info *conn)
     policy_reply->gatekeeper_response(mcurl_data->gk_verdict->policy_req, policy_reply);
 
 error:
+    /* answer the requests which waited on this lookup */
+    gk_mcurl_inflight_release(gk_session, mcurl_data, unpacked_data);
     gatekeeper__southbound__v1__gatekeeper_reply__free_unpacked(unpacked_data, NULL);
 
     return ret;
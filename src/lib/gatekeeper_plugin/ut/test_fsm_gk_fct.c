@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "gatekeeper.h"
 #include "gatekeeper_cache.h"
+#include "gatekeeper_multi_curl.h"
 
 #include "test_gatekeeper_plugin.h"
 
@@ -114,10 +115,178 @@ test_gk_populate_redirect_entry(void)
     FREE(req.fqdn_req);
 }
 
+void
+test_gk_mcurl_inflight_key(void)
+{
+    struct fsm_policy_req req;
+    char key2[512];
+    char key[512];
+    bool rc;
+
+    memset(&req, 0, sizeof(req));
+
+    /* Host names differing by case and trailing dot share a key */
+    req.req_type = FSM_SNI_REQ;
+    req.url = "WWW.Example.com.";
+    rc = gk_mcurl_inflight_key(&req, key, sizeof(key));
+    TEST_ASSERT_TRUE(rc);
+
+    req.url = "www.example.com";
+    rc = gk_mcurl_inflight_key(&req, key2, sizeof(key2));
+    TEST_ASSERT_TRUE(rc);
+    TEST_ASSERT_EQUAL_STRING(key, key2);
+
+    /* Same name, other request type */
+    req.req_type = FSM_HOST_REQ;
+    rc = gk_mcurl_inflight_key(&req, key2, sizeof(key2));
+    TEST_ASSERT_TRUE(rc);
+    TEST_ASSERT_NOT_EQUAL(0, strcmp(key, key2));
+
+    /* Same name, other policy context */
+    req.req_type = FSM_SNI_REQ;
+    req.supported_features = 1;
+    rc = gk_mcurl_inflight_key(&req, key2, sizeof(key2));
+    TEST_ASSERT_TRUE(rc);
+    TEST_ASSERT_NOT_EQUAL(0, strcmp(key, key2));
+
+    /* URLs keep their case */
+    req.req_type = FSM_URL_REQ;
+    req.url = "www.example.com/Path";
+    rc = gk_mcurl_inflight_key(&req, key, sizeof(key));
+    TEST_ASSERT_TRUE(rc);
+    TEST_ASSERT_NOT_NULL(strstr(key, "/Path"));
+
+    /* Key not fitting the buffer */
+    rc = gk_mcurl_inflight_key(&req, key, 8);
+    TEST_ASSERT_FALSE(rc);
+
+    /* IP requests are not coalesced */
+    req.req_type = FSM_IPV4_REQ;
+    rc = gk_mcurl_inflight_key(&req, key, sizeof(key));
+    TEST_ASSERT_FALSE(rc);
+}
+
+static int gk_test_policy_responses;
+
+static void
+gk_test_policy_response(struct fsm_policy_req *req,
+                        struct fsm_policy_reply *policy_reply)
+{
+    gk_test_policy_responses++;
+}
+
+void
+test_gk_mcurl_inflight_attach(void)
+{
+    struct fsm_policy_reply policy_reply;
+    struct fsm_gk_session gk_session;
+    struct gk_mcurl_data *leader;
+    struct fsm_policy_req req;
+    bool rc;
+
+    memset(&gk_session, 0, sizeof(gk_session));
+    ds_tree_init(&gk_session.mcurl_inflight_tree, ds_str_cmp,
+                 struct gk_mcurl_data, inflight_node);
+
+    memset(&req, 0, sizeof(req));
+    req.req_type = FSM_SNI_REQ;
+    req.url = "www.example.com";
+
+    memset(&policy_reply, 0, sizeof(policy_reply));
+    policy_reply.policy_response = gk_test_policy_response;
+    gk_test_policy_responses = 0;
+
+    /* Nothing in flight yet */
+    rc = gk_mcurl_inflight_attach(&gk_session, "key", &req, &policy_reply);
+    TEST_ASSERT_FALSE(rc);
+
+    leader = CALLOC(1, sizeof(*leader));
+    leader->req_type = FSM_SNI_REQ;
+    leader->req_id = 7;
+    ds_dlist_init(&leader->followers, struct gk_mcurl_data, follower_node);
+    gk_mcurl_inflight_add(&gk_session, leader, "key");
+    TEST_ASSERT_NOT_NULL(leader->inflight_key);
+    TEST_ASSERT_EQUAL_UINT32(1, gk_session.inflight_stats.leaders);
+
+    rc = gk_mcurl_inflight_attach(&gk_session, "key", &req, &policy_reply);
+    TEST_ASSERT_TRUE(rc);
+    rc = gk_mcurl_inflight_attach(&gk_session, "key", &req, &policy_reply);
+    TEST_ASSERT_TRUE(rc);
+    rc = gk_mcurl_inflight_attach(&gk_session, "other", &req, &policy_reply);
+    TEST_ASSERT_FALSE(rc);
+    TEST_ASSERT_EQUAL_UINT32(2, gk_session.inflight_stats.coalesced);
+
+    /* A failed lookup fails its followers, and is no longer joinable */
+    gk_mcurl_inflight_release(&gk_session, leader, NULL);
+    TEST_ASSERT_EQUAL_INT(2, gk_test_policy_responses);
+    TEST_ASSERT_EQUAL_UINT32(2, gk_session.inflight_stats.failed);
+    TEST_ASSERT_EQUAL_UINT32(0, gk_session.inflight_stats.resolved);
+    TEST_ASSERT_EQUAL_INT(FSM_FQDN_CAT_FAILED, policy_reply.categorized);
+    TEST_ASSERT_NULL(leader->inflight_key);
+    TEST_ASSERT_TRUE(ds_dlist_is_empty(&leader->followers));
+    TEST_ASSERT_NULL(ds_tree_head(&gk_session.mcurl_inflight_tree));
+
+    rc = gk_mcurl_inflight_attach(&gk_session, "key", &req, &policy_reply);
+    TEST_ASSERT_FALSE(rc);
+
+    free_mcurl_data(leader);
+}
+
+void
+test_gk_clean_mcurl_tree(void)
+{
+    struct fsm_policy_reply policy_reply;
+    struct fsm_gk_session gk_session;
+    struct gk_mcurl_data *leader;
+    struct fsm_policy_req req;
+    bool rc;
+
+    memset(&gk_session, 0, sizeof(gk_session));
+    ds_tree_init(&gk_session.mcurl_data_tree, ds_int_cmp,
+                 struct gk_mcurl_data, mcurl_req_node);
+    ds_tree_init(&gk_session.mcurl_inflight_tree, ds_str_cmp,
+                 struct gk_mcurl_data, inflight_node);
+
+    memset(&req, 0, sizeof(req));
+    req.req_type = FSM_SNI_REQ;
+    req.url = "www.example.com";
+
+    memset(&policy_reply, 0, sizeof(policy_reply));
+    policy_reply.policy_response = gk_test_policy_response;
+    gk_test_policy_responses = 0;
+
+    leader = CALLOC(1, sizeof(*leader));
+    leader->req_type = FSM_SNI_REQ;
+    leader->req_id = 9;
+    ds_dlist_init(&leader->followers, struct gk_mcurl_data, follower_node);
+    ds_tree_insert(&gk_session.mcurl_data_tree, leader, &leader->req_id);
+    gk_mcurl_inflight_add(&gk_session, leader, "key");
+
+    rc = gk_mcurl_inflight_attach(&gk_session, "key", &req, &policy_reply);
+    TEST_ASSERT_TRUE(rc);
+    rc = gk_mcurl_inflight_attach(&gk_session, "key", &req, &policy_reply);
+    TEST_ASSERT_TRUE(rc);
+
+    /* Tearing the session down answers the waiting requests */
+    gk_clean_mcurl_tree(&gk_session);
+    TEST_ASSERT_EQUAL_INT(2, gk_test_policy_responses);
+    TEST_ASSERT_EQUAL_UINT32(2, gk_session.inflight_stats.failed);
+    TEST_ASSERT_EQUAL_INT(FSM_FQDN_CAT_FAILED, policy_reply.categorized);
+    TEST_ASSERT_NULL(ds_tree_head(&gk_session.mcurl_data_tree));
+    TEST_ASSERT_NULL(ds_tree_head(&gk_session.mcurl_inflight_tree));
+
+    /* The lookup is no longer joinable */
+    rc = gk_mcurl_inflight_attach(&gk_session, "key", &req, &policy_reply);
+    TEST_ASSERT_FALSE(rc);
+}
+
 void
 run_test_fsm_gk_fct(void)
 {
     RUN_TEST(test_gatekeeper_get_mgr);
     RUN_TEST(test_gatekeeper_init);
     RUN_TEST(test_gk_populate_redirect_entry);
+    RUN_TEST(test_gk_mcurl_inflight_key);
+    RUN_TEST(test_gk_mcurl_inflight_attach);
+    RUN_TEST(test_gk_clean_mcurl_tree);
 }
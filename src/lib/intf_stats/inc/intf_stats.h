@@ -46,6 +46,7 @@ typedef struct
 {
     char                ifname[IFNAME_LEN];
     char                role[INTF_ROLE_LEN];
+    int                 ifindex;    /*<! Last seen ifindex, 0 if unresolved */
 
     uint64_t            tx_bytes;
     uint64_t            rx_bytes;
@@ -33,6 +33,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <sys/types.h>
 #include <ifaddrs.h>
+#include <net/if.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <netdb.h>
@@ -53,6 +54,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "interface_stats.pb-c.h"
 #include "intf_stats.h"
 #include "util.h"
+#include "rtnl_stats.h"
 
 static  ds_dlist_t               cloud_intf_list;
 static  intf_stats_report_data_t report;
@@ -489,18 +491,23 @@ intf_stats_get_node_info(fcm_collect_plugin_t *collector)
 
 /******************************************************************************/
 
-static uint32_t
-intf_stats_calculate_delta(unsigned int new_count, uint64_t old_count)
+/*
+ * Counters are 64-bit when read over rtnetlink (max == UINT64_MAX): going
+ * backwards then means the device reset its counters, so the new value is
+ * the delta. The 32-bit getifaddrs() counters (max == UINT_MAX) may wrap.
+ */
+static uint64_t
+intf_stats_calculate_delta(uint64_t new_count, uint64_t old_count, uint64_t max)
 {
-    uint32_t count;
+    if (new_count >= old_count) return new_count - old_count;
+    if (max == UINT64_MAX) return new_count;
 
-    count = (new_count >= old_count) ? (new_count - old_count) : (UINT_MAX - old_count) + new_count;
-    return count;
+    return (max - old_count) + new_count;
 }
 
 
 static void
-intf_stats_calculate_stats(intf_stats_t *stats_old, struct rtnl_link_stats *stats_new)
+intf_stats_calculate_stats(intf_stats_t *stats_old, const struct rtnl_link_stats64 *stats_new, uint64_t max)
 {
     intf_stats_window_t *window_entry     = NULL;
     intf_stats_t        *intf_entry       = NULL;
@@ -536,10 +543,10 @@ intf_stats_calculate_stats(intf_stats_t *stats_old, struct rtnl_link_stats *stat
     if (report_type == FCM_RPT_FMT_DELTA)
     {
         // Calculate the stat deltas
-        intf_entry->tx_bytes   = intf_stats_calculate_delta(stats_new->tx_bytes, stats_old->tx_bytes);
-        intf_entry->rx_bytes   = intf_stats_calculate_delta(stats_new->rx_bytes, stats_old->rx_bytes);
-        intf_entry->tx_packets = intf_stats_calculate_delta(stats_new->tx_packets, stats_old->tx_packets);
-        intf_entry->rx_packets = intf_stats_calculate_delta(stats_new->rx_packets, stats_old->rx_packets);
+        intf_entry->tx_bytes   = intf_stats_calculate_delta(stats_new->tx_bytes, stats_old->tx_bytes, max);
+        intf_entry->rx_bytes   = intf_stats_calculate_delta(stats_new->rx_bytes, stats_old->rx_bytes, max);
+        intf_entry->tx_packets = intf_stats_calculate_delta(stats_new->tx_packets, stats_old->tx_packets, max);
+        intf_entry->rx_packets = intf_stats_calculate_delta(stats_new->rx_packets, stats_old->rx_packets, max);
     }
     else if (report_type == FCM_RPT_FMT_CUMUL)
     {
@@ -553,7 +560,35 @@ intf_stats_calculate_stats(intf_stats_t *stats_old, struct rtnl_link_stats *stat
 }
 
 static void
-intf_stats_fetch_stats(bool set_baseline)
+intf_stats_update_stats(intf_stats_t *stats_old, const struct rtnl_link_stats64 *stats_new,
+                        uint64_t max, bool set_baseline)
+{
+    LOGT("------Stats retreived for %s-------", stats_old->ifname);
+    LOGT("tx_packets = %10" PRIu64 "; rx_packets = %10" PRIu64,
+                                (uint64_t)stats_new->tx_packets, (uint64_t)stats_new->rx_packets);
+    LOGT("tx_bytes   = %10" PRIu64 "; rx_bytes   = %10" PRIu64,
+                                (uint64_t)stats_new->tx_bytes, (uint64_t)stats_new->rx_bytes);
+    LOGT("----------------------------------------------");
+
+    /* Calculate the deltas */
+    if (!set_baseline)
+    {
+        intf_stats_calculate_stats(stats_old, stats_new, max);
+    }
+
+    /* Replace the old stats */
+    stats_old->tx_bytes   = stats_new->tx_bytes;
+    stats_old->rx_bytes   = stats_new->rx_bytes;
+    stats_old->tx_packets = stats_new->tx_packets;
+    stats_old->rx_packets = stats_new->rx_packets;
+}
+
+/*
+ * Fallback for kernels without RTM_GETSTATS: walks every address of every
+ * interface and only provides 32-bit counters.
+ */
+static void
+intf_stats_fetch_stats_ifaddrs(bool set_baseline)
 {
     intf_stats_t     *stats_old = NULL;
     struct  ifaddrs  *ifaddr, *ifa;
@@ -576,31 +611,107 @@ intf_stats_fetch_stats(bool set_baseline)
 
         if (ifa->ifa_data != NULL)
         {
-            struct rtnl_link_stats *stats_new = ifa->ifa_data;
+            struct rtnl_link_stats *stats32 = ifa->ifa_data;
+            struct rtnl_link_stats64 stats_new = { 0 };
 
-            LOGT("------Stats retreived from getifaddrs()-------");
-            LOGT("tx_packets = %10u; rx_packets = %10u\n",
-                                        stats_new->tx_packets, stats_new->rx_packets);
-            LOGT("tx_bytes   = %10u; rx_bytes   = %10u\n",
-                                        stats_new->tx_bytes, stats_new->rx_bytes);
-            LOGT("----------------------------------------------");
+            stats_new.tx_bytes   = stats32->tx_bytes;
+            stats_new.rx_bytes   = stats32->rx_bytes;
+            stats_new.tx_packets = stats32->tx_packets;
+            stats_new.rx_packets = stats32->rx_packets;
 
-            /* Calculate the deltas */
-            if (!set_baseline)
+            intf_stats_update_stats(stats_old, &stats_new, UINT_MAX, set_baseline);
+        }
+    }
+
+    freeifaddrs(ifaddr);
+
+    return;
+}
+
+struct intf_stats_fetch_ctx
+{
+    bool    set_baseline;
+};
+
+static void
+intf_stats_fetch_stats_fn(void *ctx, const struct rtnl_stats_link *link)
+{
+    struct intf_stats_fetch_ctx *fctx = ctx;
+    intf_stats_t                *intf = NULL;
+    ds_dlist_iter_t              intf_iter;
+
+    for ( intf = ds_dlist_ifirst(&intf_iter, &cloud_intf_list);
+          intf != NULL;
+          intf = ds_dlist_inext(&intf_iter))
+    {
+        if (intf->ifindex == link->rl_ifindex) break;
+    }
+
+    if (intf == NULL) return;
+
+    intf_stats_update_stats(intf, &link->rl_stats, UINT64_MAX, fctx->set_baseline);
+}
+
+static void
+intf_stats_fetch_stats(bool set_baseline)
+{
+    struct intf_stats_fetch_ctx  fctx;
+    intf_stats_t                *intf = NULL;
+    ds_dlist_iter_t              intf_iter;
+    int                         *ifindex;
+    size_t                       n = 0;
+    int                          idx;
+
+    ifindex = CALLOC(intf_stats_get_num_intfs() + 1, sizeof(*ifindex));
+
+    /*
+     * Resolve the monitored interfaces to their ifindex so that only their
+     * counters are requested from the kernel. An interface that was
+     * recreated gets a new ifindex and its counters restart from zero,
+     * so it is re-baselined instead of reporting a bogus delta.
+     */
+    for ( intf = ds_dlist_ifirst(&intf_iter, &cloud_intf_list);
+          intf != NULL;
+          intf = ds_dlist_inext(&intf_iter))
+    {
+        idx = if_nametoindex(intf->ifname);
+        if (idx == 0)
+        {
+            intf->ifindex = 0;
+            continue;
+        }
+
+        if (intf->ifindex != idx)
+        {
+            if (intf->ifindex != 0)
             {
-                intf_stats_calculate_stats(stats_old, stats_new);
+                LOGD("Interface '%s' was recreated, resetting its baseline", intf->ifname);
             }
 
-            /* Replace the old stats */
-            stats_old->tx_bytes   = stats_new->tx_bytes;
-            stats_old->rx_bytes   = stats_new->rx_bytes;
-            stats_old->tx_packets = stats_new->tx_packets;
-            stats_old->rx_packets = stats_new->rx_packets;
+            intf->ifindex    = idx;
+            intf->tx_bytes   = 0;
+            intf->rx_bytes   = 0;
+            intf->tx_packets = 0;
+            intf->rx_packets = 0;
         }
+
+        ifindex[n++] = idx;
     }
 
-exit:
-    freeifaddrs(ifaddr);
+    fctx.set_baseline = set_baseline;
+    if (n > 0 && !rtnl_stats_get(ifindex, n, 0, intf_stats_fetch_stats_fn, &fctx))
+    {
+        if (errno == EOPNOTSUPP)
+        {
+            intf_stats_fetch_stats_ifaddrs(set_baseline);
+        }
+        else
+        {
+            LOGE("Unable to fetch interface stats, errno = '%d'", errno);
+        }
+    }
+
+    FREE(ifindex);
 
     return;
 }
@@ -681,6 +792,7 @@ intf_stats_plugin_close_cb(fcm_collect_plugin_t *collector)
     LOGN("Interface Stats plugin shutting down");
     intf_stats_remove_all_intfs(&cloud_intf_list);
     intf_stats_reset_report(&report);
+    rtnl_stats_fini();
 
     /* Deregister monitor events */
     ovsdb_update_monitor_cancel(&intf_stats_inet_config_ovsdb_update, SCHEMA_TABLE(Wifi_Inet_Config));
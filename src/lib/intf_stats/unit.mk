@@ -54,3 +54,4 @@ UNIT_DEPS += src/lib/ovsdb
 UNIT_DEPS += src/lib/network_metadata
 UNIT_DEPS += src/lib/fcm_filter
 UNIT_DEPS += src/lib/protobuf
+UNIT_DEPS += src/lib/rtnl_stats
@@ -33,8 +33,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <limits.h>
 #include <openssl/ssl.h>
 
+#include "ds_dlist.h"
+
 #define MOSQEV_CID_SZ       64
 #define MOSQEV_TLS_VERSION  "tlsv1.2"
+#define MOSQEV_INFLIGHT_MAX 20      /* Default in-flight window, same as libmosquitto */
 
 static const char mosqev_ciphers[] = TLS1_TXT_DHE_DSS_WITH_AES_128_SHA256
                                   ":"TLS1_TXT_DHE_RSA_WITH_AES_128_SHA256
@@ -66,6 +69,7 @@ typedef void mosqev_cbk_t(mosqev_t *self, void *data, int result);
 typedef void mosqev_message_cbk_t(mosqev_t *self, void *data, const char *topic, void *msg, size_t msglen);
 typedef void mosqev_subscribe_cbk_t(mosqev_t *self, void *data, int mid, int qos_n, const int *qos_v);
 typedef void mosqev_pwd_cbk_t(char *buf, int size, int rwflags, void *data);
+typedef void mosqev_publish_done_cbk_t(mosqev_t *self, void *ctx, int result);
 
 struct mosqev
 {
@@ -92,6 +96,12 @@ struct mosqev
     mosqev_subscribe_cbk_t
                        *me_subscribe_cbk;       /* Subscribe handler */
     mosqev_cbk_t       *me_unsubscribe_cbk;     /* Unsubscribe handler */
+    /* In-flight publishes */
+    ds_dlist_t          me_inflight;            /* Publishes waiting for completion, oldest first */
+    int                 me_inflight_cnt;        /* Number of in-flight publishes */
+    int                 me_inflight_max;        /* In-flight window size */
+    struct mosqev_inflight
+                       *me_inflight_new;        /* Publish being handed to libmosquitto */
     /* Memoized settings for reinit */
     char              *me_cafile;
     char              *me_capath;
@@ -124,6 +134,13 @@ extern bool mosqev_tls_opts_set(mosqev_t *self, int cert_reqs,
 extern bool mosqev_publish(mosqev_t *self, int *mid, const char *topic,
         size_t msglen, void *msg, int qos, bool retain);
 
+extern bool mosqev_publish_async(mosqev_t *self, int *mid, const char *topic,
+        size_t msglen, void *msg, int qos, bool retain,
+        mosqev_publish_done_cbk_t *cbk, void *ctx);
+
+extern int mosqev_inflight_avail(mosqev_t *self);
+extern void mosqev_inflight_max_set(mosqev_t *self, int max);
+
 extern void mosqev_connect_cbk_set(mosqev_t *self, mosqev_cbk_t *cbk);
 extern void mosqev_disconnect_cbk_set(mosqev_t *self, mosqev_cbk_t *cbk);
 extern void mosqev_publish_cbk_set(mosqev_t *self, mosqev_cbk_t *cbk);
@@ -51,7 +51,19 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /* Most of Mosquitto callbacks are in this format */
 typedef void mosquitto_cbk_t(mosqev_t *self, void *data, int result);
 
+/* A publish waiting for completion */
+struct mosqev_inflight
+{
+    int                         mi_mid;     /* Message ID */
+    bool                        mi_done;    /* Completed before mosquitto_publish() returned */
+    mosqev_publish_done_cbk_t  *mi_cbk;     /* Completion handler */
+    void                       *mi_ctx;     /* Completion handler context */
+    ds_dlist_node_t             mi_node;
+};
+
 static void mosqev_wio_check(mosqev_t *self);
+static void mosqev_inflight_done(mosqev_t *self, int mid);
+static void mosqev_inflight_flush(mosqev_t *self, int result);
 static bool mosqev_watcher_start(mosqev_t *self);
 static bool mosqev_watcher_stop(mosqev_t *self);
 static bool mosqev_watcher_io_set(mosqev_t *self, int fd, int flags);
@@ -100,6 +112,10 @@ static int mosqev_reinit_settings(mosqev_t *self)
 {
     int rc;
 
+    /* Plain connection, TLS was not configured */
+    if (self->me_cafile == NULL && self->me_capath == NULL)
+        return 0;
+
     LOG(TRACE, "Reinit: cafile=%s capath=%s certfile=%s keyfile=%s pwcb=%p certreqs=%d tls=%s ciphers=%s",
         self->me_cafile,
         self->me_capath,
@@ -137,8 +153,12 @@ static int mosqev_reinit(mosqev_t *self)
 {
     int rc;
 
+    /* Publishes queued in the previous session are dropped */
+    mosqev_inflight_flush(self, MOSQ_ERR_NO_CONN);
+
     mosquitto_reinitialise(self->me_mosq, self->me_cid, true, self);
     mosqev_init_cbk(self);
+    mosquitto_max_inflight_messages_set(self->me_mosq, self->me_inflight_max);
 
     rc = mosqev_reinit_settings(self);
     if (rc) {
@@ -175,6 +195,9 @@ bool mosqev_init(mosqev_t *self, const char *cid, struct ev_loop *ev, void *data
     STRSCPY(self->me_host, "unkown");
     self->me_port = -1;
 
+    ds_dlist_init(&self->me_inflight, struct mosqev_inflight, mi_node);
+    self->me_inflight_max = MOSQEV_INFLIGHT_MAX;
+
     /*
      * Initialize watchers
      * */
@@ -200,6 +223,7 @@ bool mosqev_init(mosqev_t *self, const char *cid, struct ev_loop *ev, void *data
     }
 
     mosqev_init_cbk(self);
+    mosquitto_max_inflight_messages_set(self->me_mosq, self->me_inflight_max);
 
     return true;
 }
@@ -211,6 +235,8 @@ void mosqev_del(mosqev_t *self)
 {
     mosqev_watcher_stop(self);
 
+    mosqev_inflight_flush(self, MOSQ_ERR_NO_CONN);
+
     if (self->me_mosq != NULL)
     {
         if (self->me_connected)
@@ -310,7 +336,7 @@ bool mosqev_connect(mosqev_t *self, char *host, int port)
     rc = mosqev_reinit(self);
     if (rc) {
         LOG(ERR, "Connection failed due to reinit: %s", mosquitto_strerror(rc));
-        return rc;
+        return false;
     }
 
     self->me_connecting = false;
@@ -400,16 +426,76 @@ bool mosqev_publish(mosqev_t *self,
                     int qos,
                     bool retain)
 {
+    return mosqev_publish_async(self, mid, topic, msglen, msg, qos, retain, NULL, NULL);
+}
+
+/*
+ * Publish a message without waiting for it to be sent; @p msg is copied.
+ *
+ * Whatever libmosquitto cannot write right away is flushed by the I/O watcher,
+ * together with any other pending publish. If @p cbk is not NULL, the publish
+ * takes a slot of the in-flight window until it completes -- when written for
+ * QoS 0, acknowledged by the broker for QoS 1 and 2 -- and @p cbk is then
+ * called with MOSQ_ERR_SUCCESS. If the connection is lost or reinitialized
+ * first, @p cbk is called with an error, newest publish first, so that the
+ * caller can put them back in front of its queue in their original order.
+ * @p cbk may be called before this function returns.
+ *
+ * Returns false if the message could not be queued or the window is full.
+ */
+bool mosqev_publish_async(mosqev_t *self,
+                          int *mid,
+                          const char *topic,
+                          size_t msglen,
+                          void *msg,
+                          int qos,
+                          bool retain,
+                          mosqev_publish_done_cbk_t *cbk,
+                          void *ctx)
+{
+    struct mosqev_inflight *mi;
+    int lmid;
     int rc;
 
-    rc = mosquitto_publish(self->me_mosq, mid, topic, msglen, msg, qos, retain);
+    if (cbk != NULL && mosqev_inflight_avail(self) <= 0)
+    {
+        LOG(DEBUG, "Message publish deferred, in-flight window full: Topic: %s", topic);
+        return false;
+    }
+
+    /*
+     * Publishes without a handler are tracked as well, but do not count
+     * against the window: a completion for an unknown mid can only be the
+     * one of this publish, as libmosquitto may complete a QoS 0 publish
+     * before returning its mid.
+     */
+    mi = CALLOC(1, sizeof(*mi));
+    mi->mi_cbk = cbk;
+    mi->mi_ctx = ctx;
+
+    self->me_inflight_new = mi;
+    rc = mosquitto_publish(self->me_mosq, &lmid, topic, msglen, msg, qos, retain);
+    self->me_inflight_new = NULL;
     if (rc != MOSQ_ERR_SUCCESS)
     {
         LOG(ERR, "Message publish failed: Topic: %s", topic);
+        FREE(mi);
         return false;
     }
 
-    mosquitto_loop(self->me_mosq, 0, 1);
+    if (mid != NULL) *mid = lmid;
+
+    if (mi->mi_done)
+    {
+        if (mi->mi_cbk != NULL) mi->mi_cbk(self, mi->mi_ctx, MOSQ_ERR_SUCCESS);
+        FREE(mi);
+    }
+    else
+    {
+        mi->mi_mid = lmid;
+        ds_dlist_insert_tail(&self->me_inflight, mi);
+        if (mi->mi_cbk != NULL) self->me_inflight_cnt++;
+    }
 
     /* Start monitoring WRITE events if data is still pending to be sent */
     if (mosquitto_want_write(self->me_mosq))
@@ -420,6 +506,72 @@ bool mosqev_publish(mosqev_t *self,
     return true;
 }
 
+/*
+ * Returns the number of publishes that can be added to the in-flight window
+ */
+int mosqev_inflight_avail(mosqev_t *self)
+{
+    return self->me_inflight_max - self->me_inflight_cnt;
+}
+
+/*
+ * Set the in-flight window size; libmosquitto limits its own QoS 1 and 2
+ * in-flight messages accordingly.
+ */
+void mosqev_inflight_max_set(mosqev_t *self, int max)
+{
+    if (max <= 0) max = MOSQEV_INFLIGHT_MAX;
+
+    self->me_inflight_max = max;
+    mosquitto_max_inflight_messages_set(self->me_mosq, max);
+}
+
+/*
+ * Complete the in-flight publish @p mid
+ */
+void mosqev_inflight_done(mosqev_t *self, int mid)
+{
+    struct mosqev_inflight *mi;
+
+    ds_dlist_foreach(&self->me_inflight, mi)
+    {
+        if (mi->mi_mid != mid) continue;
+
+        ds_dlist_remove(&self->me_inflight, mi);
+        if (mi->mi_cbk != NULL)
+        {
+            self->me_inflight_cnt--;
+            mi->mi_cbk(self, mi->mi_ctx, MOSQ_ERR_SUCCESS);
+        }
+        FREE(mi);
+        return;
+    }
+
+    /* Not tracked yet: completed from within mosquitto_publish() */
+    if (self->me_inflight_new != NULL)
+    {
+        self->me_inflight_new->mi_done = true;
+    }
+}
+
+/*
+ * Fail all in-flight publishes, newest first
+ */
+void mosqev_inflight_flush(mosqev_t *self, int result)
+{
+    struct mosqev_inflight *mi;
+
+    while ((mi = ds_dlist_remove_tail(&self->me_inflight)) != NULL)
+    {
+        if (mi->mi_cbk != NULL)
+        {
+            self->me_inflight_cnt--;
+            mi->mi_cbk(self, mi->mi_ctx, result);
+        }
+        FREE(mi);
+    }
+}
+
 /*
  * Set the connection callback
  */
@@ -550,6 +702,8 @@ void mosqev_mosquitto_disconnect_cbk(struct mosquitto *mosq, void *__self, int r
     self->me_connected = false;
     self->me_connecting = false;
 
+    mosqev_inflight_flush(self, rc != MOSQ_ERR_SUCCESS ? rc : MOSQ_ERR_NO_CONN);
+
     if (self->me_disconnect_cbk != NULL)
     {
         self->me_disconnect_cbk(self, self->me_data, rc);
@@ -565,9 +719,11 @@ void mosqev_mosquitto_publish_cbk(struct mosquitto *mosq, void *__self, int mid)
 
     mosqev_t *self = (mosqev_t *)__self;
 
+    mosqev_inflight_done(self, mid);
+
     if (self->me_publish_cbk != NULL)
     {
-        self->me_publish_cbk(self, self->me_publish_cbk, mid);
+        self->me_publish_cbk(self, self->me_data, mid);
     }
 }
 
@@ -0,0 +1,478 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <ev.h>
+
+#include "log.h"
+#include "mosqev.h"
+#include "unity.h"
+#include "unit_test_utils.h"
+
+char *test_name = "test_mosqev";
+
+/*
+ * ===========================================================================
+ *  Broker stand-in
+ *
+ *  Speaks just enough MQTT 3.1.1 for a single client: accepts the
+ *  connection, counts publishes and acknowledges QoS 1 ones, unless the
+ *  acknowledgements are held back by the test.
+ * ===========================================================================
+ */
+#define BROKER_ACKS_MAX 64
+
+struct broker
+{
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    int             lfd;
+    int             fd;
+    int             port;
+    bool            stop;
+    /* Shared with the test, under lock */
+    int             published;
+    bool            hold_acks;
+    bool            drop;
+    int             acks[BROKER_ACKS_MAX];
+    int             acks_n;
+};
+
+static struct broker g_broker;
+
+static bool broker_write(struct broker *b, const uint8_t *buf, size_t len)
+{
+    return write(b->fd, buf, len) == (ssize_t)len;
+}
+
+static bool broker_read(struct broker *b, uint8_t *buf, size_t len)
+{
+    ssize_t rc;
+
+    while (len > 0)
+    {
+        rc = read(b->fd, buf, len);
+        if (rc <= 0) return false;
+        buf += rc;
+        len -= rc;
+    }
+    return true;
+}
+
+/* Handle one control packet, returns false when the connection is over */
+static bool broker_packet(struct broker *b)
+{
+    static uint8_t body[65536];
+    uint8_t hdr;
+    uint8_t byte;
+    size_t len = 0;
+    size_t off;
+    int shift = 0;
+    int qos;
+
+    if (!broker_read(b, &hdr, 1)) return false;
+    do
+    {
+        if (!broker_read(b, &byte, 1)) return false;
+        len |= (size_t)(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    if (len > sizeof(body) || !broker_read(b, body, len)) return false;
+
+    switch (hdr >> 4)
+    {
+        case 1: /* CONNECT */
+            return broker_write(b, (const uint8_t []){ 0x20, 0x02, 0x00, 0x00 }, 4);
+
+        case 3: /* PUBLISH */
+            qos = (hdr >> 1) & 0x03;
+            off = 2 + ((body[0] << 8) | body[1]);
+            pthread_mutex_lock(&b->lock);
+            b->published++;
+            if (qos > 0 && b->acks_n < BROKER_ACKS_MAX)
+            {
+                b->acks[b->acks_n++] = (body[off] << 8) | body[off + 1];
+            }
+            pthread_mutex_unlock(&b->lock);
+            return true;
+
+        case 12: /* PINGREQ */
+            return broker_write(b, (const uint8_t []){ 0xd0, 0x00 }, 2);
+
+        case 14: /* DISCONNECT */
+            return false;
+
+        default:
+            return true;
+    }
+}
+
+static void broker_flush_acks(struct broker *b)
+{
+    uint8_t puback[4] = { 0x40, 0x02 };
+    int ii;
+
+    pthread_mutex_lock(&b->lock);
+    if (!b->hold_acks)
+    {
+        for (ii = 0; ii < b->acks_n; ii++)
+        {
+            puback[2] = b->acks[ii] >> 8;
+            puback[3] = b->acks[ii] & 0xff;
+            broker_write(b, puback, sizeof(puback));
+        }
+        b->acks_n = 0;
+    }
+    pthread_mutex_unlock(&b->lock);
+}
+
+static void *broker_run(void *arg)
+{
+    struct broker *b = arg;
+    struct pollfd pfd;
+    bool drop;
+
+    while (!b->stop)
+    {
+        if (b->fd < 0)
+        {
+            pfd.fd = b->lfd;
+            pfd.events = POLLIN;
+            if (poll(&pfd, 1, 10) > 0) b->fd = accept(b->lfd, NULL, NULL);
+            continue;
+        }
+
+        pthread_mutex_lock(&b->lock);
+        drop = b->drop;
+        b->drop = false;
+        pthread_mutex_unlock(&b->lock);
+
+        pfd.fd = b->fd;
+        pfd.events = POLLIN;
+        if (!drop && poll(&pfd, 1, 10) > 0 && broker_packet(b))
+        {
+            broker_flush_acks(b);
+            continue;
+        }
+        else if (!drop && !(pfd.revents & POLLIN))
+        {
+            broker_flush_acks(b);
+            continue;
+        }
+
+        close(b->fd);
+        b->fd = -1;
+    }
+
+    return NULL;
+}
+
+static void broker_start(struct broker *b)
+{
+    struct sockaddr_in addr;
+    socklen_t alen = sizeof(addr);
+
+    memset(b, 0, sizeof(*b));
+    pthread_mutex_init(&b->lock, NULL);
+    b->fd = -1;
+
+    b->lfd = socket(AF_INET, SOCK_STREAM, 0);
+    TEST_ASSERT_TRUE(b->lfd >= 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    TEST_ASSERT_EQUAL_INT(0, bind(b->lfd, (struct sockaddr *)&addr, sizeof(addr)));
+    TEST_ASSERT_EQUAL_INT(0, listen(b->lfd, 1));
+    TEST_ASSERT_EQUAL_INT(0, getsockname(b->lfd, (struct sockaddr *)&addr, &alen));
+    b->port = ntohs(addr.sin_port);
+
+    TEST_ASSERT_EQUAL_INT(0, pthread_create(&b->thread, NULL, broker_run, b));
+}
+
+static void broker_stop(struct broker *b)
+{
+    b->stop = true;
+    pthread_join(b->thread, NULL);
+    if (b->fd >= 0) close(b->fd);
+    close(b->lfd);
+    pthread_mutex_destroy(&b->lock);
+}
+
+static int broker_published(struct broker *b)
+{
+    int n;
+
+    pthread_mutex_lock(&b->lock);
+    n = b->published;
+    pthread_mutex_unlock(&b->lock);
+    return n;
+}
+
+static void broker_hold_acks(struct broker *b, bool hold)
+{
+    pthread_mutex_lock(&b->lock);
+    b->hold_acks = hold;
+    pthread_mutex_unlock(&b->lock);
+}
+
+static void broker_drop(struct broker *b)
+{
+    pthread_mutex_lock(&b->lock);
+    b->drop = true;
+    pthread_mutex_unlock(&b->lock);
+}
+
+/*
+ * ===========================================================================
+ *  Client side
+ * ===========================================================================
+ */
+#define TEST_PUBLISH_MAX 16
+
+static mosqev_t g_mqtt;
+static struct ev_loop *g_loop;
+
+static int g_mqtt_data;
+static int g_done[TEST_PUBLISH_MAX];
+static int g_done_n;
+static int g_done_result[TEST_PUBLISH_MAX];
+
+static void test_publish_done(mosqev_t *self, void *ctx, int result)
+{
+    (void)self;
+
+    TEST_ASSERT_TRUE(g_done_n < TEST_PUBLISH_MAX);
+    g_done[g_done_n] = (int)(intptr_t)ctx;
+    g_done_result[g_done_n] = result;
+    g_done_n++;
+}
+
+/* Run the event loop until @p cond holds, for at most 5 seconds */
+#define RUN_UNTIL(cond) \
+    do { \
+        ev_tstamp __end = ev_time() + 5.0; \
+        while (!(cond) && ev_time() < __end) \
+        { \
+            ev_run(g_loop, EVRUN_NOWAIT); \
+            usleep(1000); \
+        } \
+        TEST_ASSERT_TRUE_MESSAGE((cond), #cond); \
+    } while (0)
+
+static void test_connect(int window)
+{
+    g_done_n = 0;
+    broker_start(&g_broker);
+
+    g_loop = ev_loop_new(EVFLAG_AUTO);
+    TEST_ASSERT_TRUE(mosqev_init(&g_mqtt, "test_mosqev", g_loop, &g_mqtt_data));
+    mosqev_inflight_max_set(&g_mqtt, window);
+
+    TEST_ASSERT_TRUE(mosqev_connect(&g_mqtt, "127.0.0.1", g_broker.port));
+    RUN_UNTIL(mosqev_is_connected(&g_mqtt));
+}
+
+static void test_disconnect(void)
+{
+    mosqev_del(&g_mqtt);
+    ev_loop_destroy(g_loop);
+    broker_stop(&g_broker);
+}
+
+static bool test_publish(int id, int qos)
+{
+    char msg[32];
+
+    snprintf(msg, sizeof(msg), "report %d", id);
+    return mosqev_publish_async(&g_mqtt, NULL, "test/topic", strlen(msg), msg, qos, false,
+                                test_publish_done, (void *)(intptr_t)id);
+}
+
+/*
+ * QoS 1 publishes are sent back to back up to the window size, and
+ * complete as the broker acknowledges them.
+ */
+void test_mosqev_inflight_window(void)
+{
+    int ii;
+
+    test_connect(4);
+    broker_hold_acks(&g_broker, true);
+
+    for (ii = 0; ii < 4; ii++)
+    {
+        TEST_ASSERT_TRUE(test_publish(ii, 1));
+    }
+    TEST_ASSERT_EQUAL_INT(0, mosqev_inflight_avail(&g_mqtt));
+    TEST_ASSERT_FALSE(test_publish(4, 1));
+
+    /* All of them reach the broker before the first acknowledgement */
+    RUN_UNTIL(broker_published(&g_broker) == 4);
+    TEST_ASSERT_EQUAL_INT(0, g_done_n);
+
+    broker_hold_acks(&g_broker, false);
+    RUN_UNTIL(g_done_n == 4);
+    for (ii = 0; ii < 4; ii++)
+    {
+        TEST_ASSERT_EQUAL_INT(ii, g_done[ii]);
+        TEST_ASSERT_EQUAL_INT(MOSQ_ERR_SUCCESS, g_done_result[ii]);
+    }
+    TEST_ASSERT_EQUAL_INT(4, mosqev_inflight_avail(&g_mqtt));
+
+    test_disconnect();
+}
+
+/*
+ * QoS 0 publishes complete once written, possibly before
+ * mosqev_publish_async() returns.
+ */
+void test_mosqev_qos0(void)
+{
+    int ii;
+
+    test_connect(2);
+
+    for (ii = 0; ii < 8; ii++)
+    {
+        RUN_UNTIL(mosqev_inflight_avail(&g_mqtt) > 0);
+        TEST_ASSERT_TRUE(test_publish(ii, 0));
+    }
+
+    RUN_UNTIL(g_done_n == 8);
+    RUN_UNTIL(broker_published(&g_broker) == 8);
+    for (ii = 0; ii < 8; ii++)
+    {
+        TEST_ASSERT_EQUAL_INT(ii, g_done[ii]);
+        TEST_ASSERT_EQUAL_INT(MOSQ_ERR_SUCCESS, g_done_result[ii]);
+    }
+
+    test_disconnect();
+}
+
+/*
+ * Losing the connection fails the in-flight publishes, newest first.
+ */
+void test_mosqev_inflight_conn_lost(void)
+{
+    int ii;
+
+    test_connect(4);
+    broker_hold_acks(&g_broker, true);
+
+    for (ii = 0; ii < 3; ii++)
+    {
+        TEST_ASSERT_TRUE(test_publish(ii, 1));
+    }
+    RUN_UNTIL(broker_published(&g_broker) == 3);
+
+    broker_drop(&g_broker);
+    RUN_UNTIL(!mosqev_is_connected(&g_mqtt));
+
+    TEST_ASSERT_EQUAL_INT(3, g_done_n);
+    for (ii = 0; ii < 3; ii++)
+    {
+        TEST_ASSERT_EQUAL_INT(2 - ii, g_done[ii]);
+        TEST_ASSERT_NOT_EQUAL(MOSQ_ERR_SUCCESS, g_done_result[ii]);
+    }
+    TEST_ASSERT_EQUAL_INT(4, mosqev_inflight_avail(&g_mqtt));
+
+    test_disconnect();
+}
+
+static void *g_publish_data;
+static int g_publish_mid;
+
+static void test_publish_cbk(mosqev_t *self, void *data, int mid)
+{
+    (void)self;
+
+    g_publish_data = data;
+    g_publish_mid = mid;
+}
+
+/*
+ * The publish callback receives the user data passed to mosqev_init()
+ */
+void test_mosqev_publish_cbk_data(void)
+{
+    char msg[] = "report";
+    int mid;
+
+    g_publish_data = NULL;
+    g_publish_mid = -1;
+
+    test_connect(4);
+    mosqev_publish_cbk_set(&g_mqtt, test_publish_cbk);
+
+    TEST_ASSERT_TRUE(mosqev_publish(&g_mqtt, &mid, "test/topic", strlen(msg), msg, 1, false));
+    RUN_UNTIL(g_publish_mid == mid);
+    TEST_ASSERT_TRUE(g_publish_data == &g_mqtt_data);
+
+    test_disconnect();
+}
+
+void run_test_mosqev(void)
+{
+    RUN_TEST(test_mosqev_inflight_window);
+    RUN_TEST(test_mosqev_qos0);
+    RUN_TEST(test_mosqev_inflight_conn_lost);
+    RUN_TEST(test_mosqev_publish_cbk_data);
+}
+
+/*
+ * ===========================================================================
+ *  MAIN
+ * ===========================================================================
+ */
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    ut_init(test_name, NULL, NULL);
+
+    ut_setUp_tearDown(test_name, NULL, NULL);
+
+    mosquitto_lib_init();
+
+    run_test_mosqev();
+
+    mosquitto_lib_cleanup();
+
+    return ut_fini();
+}
@@ -32,8 +32,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <netinet/in.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <jansson.h>
 
+#include "ds_dlist.h"
 #include "ds_tree.h"
+#include "evx.h"
 #include "os.h"
 #include "os_types.h"
 #include "nf_utils.h"
@@ -69,6 +72,33 @@ struct neigh_interface
     ds_tree_node_t intf_node;
 };
 
+/*
+ * OVSDB update queued for the next batched write-back.
+ * Updates are keyed by the columns selecting their row: the MAC address
+ * of IPv4 rows, the IP address of IPv6 rows, and the interface name.
+ */
+struct neigh_ovsdb_update
+{
+    struct neighbour_entry entry;  // private copy of the neighbor entry
+    bool remove;                   // pending operation
+    bool added_in_window;          // first queued operation inserted a new row
+    ds_tree_node_t update_node;    // tree node structure
+    ds_dlist_node_t fifo_node;     // position in the write-back order
+};
+
+/*
+ * Batched OVSDB write-back statistics
+ */
+struct neigh_ovsdb_batch_stats
+{
+    uint64_t requested;     // OVSDB updates requested by the cache
+    uint64_t coalesced;     // requests merged into an already queued update
+    uint64_t cancelled;     // insert/delete pairs cancelled within a window
+    uint64_t flushes;       // number of flushed windows
+    uint64_t transactions;  // OVSDB transactions issued by flushes
+    uint64_t saved;         // transactions saved versus per-entry updates
+};
+
 struct neigh_table_mgr
 {
     bool initialized;
@@ -78,6 +108,15 @@ struct neigh_table_mgr
     bool system_event;
     uint32_t ovsdb_event;
     bool (*update_ovsdb_tables)(struct neighbour_entry *key, bool remove);
+    int (*flush_ovsdb_updates)(ds_dlist_t *updates);
+    struct ev_loop *loop;
+    double ovsdb_batch_delay;
+    ev_debounce ovsdb_batch_timer;
+    ds_tree_t ovsdb_updates;
+    ds_dlist_t ovsdb_updates_fifo; // queued updates, oldest event first
+    int ovsdb_updates_count;
+    uint64_t window_requests;
+    struct neigh_ovsdb_batch_stats ovsdb_stats;
 };
 
 
@@ -107,6 +146,7 @@ enum ovsdb_table_lookup
 enum neigh_entry_flags
 {
     NEIGH_CACHED = 1 << 0,
+    NEIGH_NEW    = 1 << 1,  // added to the cache, not yet written to ovsdb
 };
 
 
@@ -154,6 +194,54 @@ int neigh_intf_cmp(const void *a, const void *b);
 
 bool update_ip_in_ovsdb_table(struct neighbour_entry *key, bool remove);
 
+/**
+ * @brief write a set of queued neighbor updates to OVSDB
+ *
+ * @param updates the list of struct neigh_ovsdb_update to write,
+ *        in event order
+ * @return the number of OVSDB transactions issued, -1 on failure
+ */
+int neigh_src_flush_ovsdb_updates(ds_dlist_t *updates);
+
+/**
+ * @brief build the transaction writing a list of queued neighbor updates
+ *
+ * (Exposed for testing)
+ *
+ * @param updates the list of struct neigh_ovsdb_update to write
+ * @param rows filled with the rows of the update operations
+ * @param tables filled with the tables of the update operations
+ * @param index filled with the result index of the update operations
+ * @param nrows filled with the number of update operations
+ * @return the transaction, NULL if there is nothing to write
+ *
+ * The arrays are sized for the number of queued updates. The rows hold
+ * a reference owned by the caller.
+ */
+json_t *neigh_src_ovsdb_updates_tran(ds_dlist_t *updates, json_t **rows,
+                                     const char **tables, size_t *index,
+                                     size_t *nrows);
+
+/**
+ * @brief set the OVSDB write-back coalescing window
+ *
+ * @param delay the debounce delay in seconds. 0 disables batching,
+ *        OVSDB updates are then issued synchronously per entry.
+ */
+void neigh_table_set_ovsdb_batch_delay(double delay);
+
+/**
+ * @brief write all queued neighbor updates to OVSDB
+ *
+ * Called when the coalescing window expires, and on cleanup.
+ */
+void neigh_table_flush_ovsdb_updates(void);
+
+/**
+ * @brief return the batched OVSDB write-back statistics
+ */
+struct neigh_ovsdb_batch_stats *neigh_table_get_ovsdb_batch_stats(void);
+
 /**
  * @brief lookup for a neighbor table entry.
  *
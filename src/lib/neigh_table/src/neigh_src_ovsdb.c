@@ -92,34 +92,46 @@ neigh_entry_to_ipv6_neighbor_schema(struct neighbour_entry *key,
 }
 
 
+static json_t *
+neigh_ipv6_where(struct neighbour_entry *key,
+                 struct schema_IPv6_Neighbors *ipv6entry)
+{
+    json_t *where;
+    json_t *cond;
+
+    where = json_array();
+
+    cond = ovsdb_tran_cond_single("address", OFUNC_EQ, ipv6entry->address);
+    json_array_append_new(where, cond);
+
+    if (key->ifname)
+    {
+        cond = ovsdb_tran_cond_single("if_name", OFUNC_EQ, key->ifname);
+        json_array_append_new(where, cond);
+    }
+
+    return where;
+}
+
+
 static bool
 update_ipv6_neigh_in_ovsdb(struct neighbour_entry *key, bool remove)
 {
     struct schema_IPv6_Neighbors    ipv6entry;
     pjs_errmsg_t    perr;
-    json_t      *cond;
     json_t      *where;
     json_t      *row;
     bool         ret;
 
     if (!key) return false;
 
-    where = json_array();
-
     if (!neigh_entry_to_ipv6_neighbor_schema(key, &ipv6entry))
     {
         LOGD("%s: Couldn't convert neighbor_entry to schema.", __func__);
         return false;
     }
 
-    cond = ovsdb_tran_cond_single("address", OFUNC_EQ, ipv6entry.address);
-    json_array_append_new(where, cond);
-
-    if (key->ifname)
-    {
-        cond = ovsdb_tran_cond_single("if_name", OFUNC_EQ, key->ifname);
-        json_array_append_new(where, cond);
-    }
+    where = neigh_ipv6_where(key, &ipv6entry);
 
     if (remove)
     {
@@ -259,20 +271,45 @@ neigh_entry_to_ipv4_neighbor_schema(struct neighbour_entry *key,
     return true;
 }
 
+static json_t *
+neigh_ipv4_where(struct neighbour_entry *key,
+                 struct schema_IPv4_Neighbors *ipv4entry)
+{
+    json_t *where;
+    json_t *cond;
+
+    where = json_array();
+
+    cond = ovsdb_tran_cond_single("hwaddr", OFUNC_EQ, ipv4entry->hwaddr);
+    json_array_append_new(where, cond);
+
+    if (key->ifname)
+    {
+        cond = ovsdb_tran_cond_single("if_name", OFUNC_EQ, key->ifname);
+        json_array_append_new(where, cond);
+    }
+
+    if (strlen(ipv4entry->source) != 0)
+    {
+        cond = ovsdb_tran_cond_single("source", OFUNC_EQ,
+                                      (char *)ipv4entry->source);
+        json_array_append_new(where, cond);
+    }
+
+    return where;
+}
+
 static bool
 update_ipv4_neigh_in_ovsdb(struct neighbour_entry *key, bool remove)
 {
     struct schema_IPv4_Neighbors    ipv4entry;
     pjs_errmsg_t    perr;
-    json_t      *cond;
     json_t      *where;
     json_t      *row;
     bool         ret;
 
     if (!key) return false;
 
-    where = json_array();
-
     ret = neigh_entry_to_ipv4_neighbor_schema(key, &ipv4entry);
     if (!ret)
     {
@@ -280,21 +317,7 @@ update_ipv4_neigh_in_ovsdb(struct neighbour_entry *key, bool remove)
         return false;
     }
 
-    cond = ovsdb_tran_cond_single("hwaddr", OFUNC_EQ, ipv4entry.hwaddr);
-    json_array_append_new(where, cond);
-
-    if (key->ifname)
-    {
-        cond = ovsdb_tran_cond_single("if_name", OFUNC_EQ, key->ifname);
-        json_array_append_new(where, cond);
-    }
-
-    if (strlen(ipv4entry.source) != 0)
-    {
-        cond = ovsdb_tran_cond_single("source", OFUNC_EQ,
-                                      (char *)ipv4entry.source);
-        json_array_append_new(where, cond);
-    }
+    where = neigh_ipv4_where(key, &ipv4entry);
 
     if (remove)
     {
@@ -350,6 +373,223 @@ update_ip_in_ovsdb_table(struct neighbour_entry *key, bool remove)
 }
 
 
+/**
+ * @brief translate a queued update in a table, where clause and row
+ *
+ * @param update the queued update
+ * @param table the updated table name
+ * @param where the where clause selecting the entry's row
+ * @param row the row to write, NULL for a removal
+ * @return true if the translation succeeded, false otherwise
+ */
+static bool
+neigh_ovsdb_update_to_tran(struct neigh_ovsdb_update *update,
+                           const char **table, json_t **where, json_t **row)
+{
+    struct schema_IPv4_Neighbors ipv4entry;
+    struct schema_IPv6_Neighbors ipv6entry;
+    struct neighbour_entry *key;
+    pjs_errmsg_t perr;
+    bool ret;
+
+    key = &update->entry;
+    *row = NULL;
+    if (key->ipaddr->ss_family == AF_INET6)
+    {
+        ret = neigh_entry_to_ipv6_neighbor_schema(key, &ipv6entry);
+        if (!ret) return false;
+
+        if (!update->remove)
+        {
+            *row = schema_IPv6_Neighbors_to_json(&ipv6entry, perr);
+            if (*row == NULL) return false;
+        }
+        *table = SCHEMA_TABLE(IPv6_Neighbors);
+        *where = neigh_ipv6_where(key, &ipv6entry);
+    }
+    else if (key->ipaddr->ss_family == AF_INET)
+    {
+        ret = neigh_entry_to_ipv4_neighbor_schema(key, &ipv4entry);
+        if (!ret) return false;
+
+        if (!update->remove)
+        {
+            *row = schema_IPv4_Neighbors_to_json(&ipv4entry, perr);
+            if (*row == NULL) return false;
+        }
+        *table = SCHEMA_TABLE(IPv4_Neighbors);
+        *where = neigh_ipv4_where(key, &ipv4entry);
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief build the transaction of a set of queued neighbor updates
+ *
+ * @param updates the list of struct neigh_ovsdb_update, in event order
+ * @param rows the rows of the updates, for a later insertion
+ * @param tables the tables of the rows
+ * @param index the index of the rows' update in the transaction
+ * @param nrows the number of rows
+ * @return the transaction, NULL if there is nothing to write
+ *
+ * The arrays are sized for the number of queued updates. The removals
+ * and updates are written in event order, as a later event on a row
+ * must prevail. The rows hold a reference owned by the caller.
+ */
+json_t *
+neigh_src_ovsdb_updates_tran(ds_dlist_t *updates, json_t **rows,
+                             const char **tables, size_t *index,
+                             size_t *nrows)
+{
+    struct neigh_ovsdb_update *update;
+    const char *table;
+    json_t *where;
+    json_t *tran;
+    json_t *row;
+
+    tran = NULL;
+    *nrows = 0;
+    ds_dlist_foreach(updates, update)
+    {
+        if (!neigh_ovsdb_update_to_tran(update, &table, &where, &row))
+        {
+            LOGD("%s: Couldn't convert neighbor_entry to schema.", __func__);
+            continue;
+        }
+
+        if (update->remove)
+        {
+            tran = ovsdb_tran_multi(tran, NULL, table, OTR_DELETE, where, NULL);
+            continue;
+        }
+
+        /* Keep a reference on the row for a possible insertion */
+        tran = ovsdb_tran_multi(tran, NULL, table, OTR_UPDATE, where, json_incref(row));
+        rows[*nrows] = row;
+        tables[*nrows] = table;
+        /* The first element of the transaction is the database name */
+        index[*nrows] = json_array_size(tran) - 2;
+        (*nrows)++;
+    }
+
+    return tran;
+}
+
+/**
+ * @brief write a set of queued neighbor updates to OVSDB
+ *
+ * @param updates the list of struct neigh_ovsdb_update, in event order
+ * @return the number of OVSDB transactions issued, -1 on failure
+ *
+ * All removals and updates are issued in a single transaction.
+ * Additions whose update did not match an existing row are then
+ * inserted in a second transaction, mirroring ovsdb_sync_upsert_where().
+ */
+int
+neigh_src_flush_ovsdb_updates(ds_dlist_t *updates)
+{
+    struct neigh_ovsdb_update *update;
+    json_t **rows = NULL;
+    const char **tables = NULL;
+    size_t *index = NULL;
+    json_t *inserts;
+    json_t *result;
+    json_t *status;
+    json_t *count;
+    json_t *tran;
+    size_t nupdates;
+    size_t nrows;
+    size_t i;
+    int ntrans;
+
+    nupdates = 0;
+    ds_dlist_foreach(updates, update) nupdates++;
+    if (nupdates == 0) return 0;
+
+    rows = CALLOC(nupdates, sizeof(*rows));
+    tables = CALLOC(nupdates, sizeof(*tables));
+    index = CALLOC(nupdates, sizeof(*index));
+    if (rows == NULL || tables == NULL || index == NULL) goto err_free;
+
+    /* Build the removals and updates transaction */
+    tran = neigh_src_ovsdb_updates_tran(updates, rows, tables, index, &nrows);
+    if (tran == NULL) goto err_free;
+
+    result = ovsdb_method_send_s(MT_TRANS, tran);
+    if (result == NULL)
+    {
+        LOGE("%s: Failed to write %zu entries to the neighbor tables.",
+             __func__, nupdates);
+        goto err_free;
+    }
+    ntrans = 1;
+
+    /* The transaction is atomic, nothing was written on error */
+    json_array_foreach(result, i, status)
+    {
+        if (json_object_get(status, "error") == NULL) continue;
+
+        LOGE("%s: Failed to write the neighbor tables: %s", __func__,
+             json_dumps_static(status, 0));
+        json_decref(result);
+        goto err_free;
+    }
+
+    /* Insert the rows which did not match on update */
+    inserts = NULL;
+    for (i = 0; i < nrows; i++)
+    {
+        status = json_array_get(result, index[i]);
+        count = json_object_get(status, "count");
+        if (json_integer_value(count) != 0) continue;
+
+        inserts = ovsdb_tran_multi(inserts, NULL, tables[i], OTR_INSERT,
+                                   NULL, rows[i]);
+        rows[i] = NULL;
+    }
+    json_decref(result);
+
+    if (inserts != NULL)
+    {
+        result = ovsdb_method_send_s(MT_TRANS, inserts);
+        if (result == NULL)
+        {
+            LOGE("%s: Failed to insert entries in the neighbor tables.",
+                 __func__);
+        }
+        json_decref(result);
+        ntrans++;
+    }
+
+    for (i = 0; i < nrows; i++) json_decref(rows[i]);
+    FREE(rows);
+    FREE(tables);
+    FREE(index);
+
+    LOGD("%s: %zu neighbor entries written in %d transactions", __func__,
+         nupdates, ntrans);
+
+    return ntrans;
+
+err_free:
+    if (rows != NULL)
+    {
+        for (i = 0; i < nupdates; i++) json_decref(rows[i]);
+    }
+    FREE(rows);
+    FREE(tables);
+    FREE(index);
+
+    return -1;
+}
+
+
 /**
  * @brief add or update a dhcp cache entry
  *
@@ -884,18 +1124,21 @@ neigh_src_init(uint32_t ovsdb_event)
     if (ovsdb_event & DHCP_LEASED_IP)
     {
         OVSDB_TABLE_INIT_NO_KEY(DHCP_leased_IP);
+        ovsdb_table_monitor_stream(&table_DHCP_leased_IP, true);
         OVSDB_TABLE_MONITOR(DHCP_leased_IP, false);
     }
 
     if (ovsdb_event & IPV4_NEIGHBORS)
     {
         OVSDB_TABLE_INIT_NO_KEY(IPv4_Neighbors);
+        ovsdb_table_monitor_stream(&table_IPv4_Neighbors, true);
         OVSDB_TABLE_MONITOR(IPv4_Neighbors, false);
     }
 
     if (ovsdb_event & IPV6_NEIGHBORS)
     {
         OVSDB_TABLE_INIT_NO_KEY(IPv6_Neighbors);
+        ovsdb_table_monitor_stream(&table_IPv6_Neighbors, true);
         OVSDB_TABLE_MONITOR(IPv6_Neighbors, false);
     }
 
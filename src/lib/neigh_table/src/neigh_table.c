@@ -43,11 +43,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "os_types.h"
 #include "log.h"
 #include "ds_tree.h"
+#include "kconfig.h"
 #include "neigh_table.h"
 #include "nf_utils.h"
 #include "memutil.h"
 #include "sockaddr_storage.h"
 
+#if !defined(CONFIG_NEIGH_TABLE_OVSDB_BATCH_DELAY_MS)
+#define CONFIG_NEIGH_TABLE_OVSDB_BATCH_DELAY_MS 0
+#endif
+
 static struct neigh_table_mgr mgr =
 {
     .initialized = false,
@@ -100,6 +105,52 @@ neigh_intf_cmp(const void *a, const void *b)
     return (*idx_a - *idx_b);
 }
 
+/**
+ * @brief compare queued ovsdb updates.
+ *
+ * Updates are keyed by the columns of the where clause selecting their
+ * row, so that all the updates of a row are coalesced: the source and
+ * MAC address of IPv4 rows, the IP address of IPv6 rows, and the
+ * interface name.
+ */
+static int
+neigh_ovsdb_update_cmp(const void *a, const void *b)
+{
+    const struct neighbour_entry *e_a = a;
+    const struct neighbour_entry *e_b = b;
+    int diff;
+
+    diff = (e_a->af_family - e_b->af_family);
+    if (diff != 0) return diff;
+
+    if (e_a->af_family == AF_INET)
+    {
+        diff = (e_a->source - e_b->source);
+        if (diff != 0) return diff;
+
+        if (e_a->mac == NULL || e_b->mac == NULL)
+        {
+            diff = ((e_a->mac != NULL) - (e_b->mac != NULL));
+        }
+        else
+        {
+            diff = memcmp(e_a->mac, e_b->mac, sizeof(os_macaddr_t));
+        }
+    }
+    else
+    {
+        diff = memcmp(e_a->ip_tbl, e_b->ip_tbl, 16);
+    }
+    if (diff != 0) return diff;
+
+    if (e_a->ifname == NULL || e_b->ifname == NULL)
+    {
+        return ((e_a->ifname != NULL) - (e_b->ifname != NULL));
+    }
+
+    return strcmp(e_a->ifname, e_b->ifname);
+}
+
 struct neigh_table_mgr *
 neigh_table_get_mgr(void)
 {
@@ -256,6 +307,295 @@ neigh_table_get_intf(int ifindex)
     return intf;
 }
 
+static void
+free_ovsdb_update(struct neigh_ovsdb_update *update)
+{
+    if (update == NULL) return;
+
+    FREE(update->entry.ipaddr);
+    FREE(update->entry.mac);
+    FREE(update->entry.ifname);
+    FREE(update);
+}
+
+/**
+ * @brief copy the contents of a cache entry in a queued update
+ *
+ * The address or MAC address of a coalesced update may change,
+ * the latest event is written.
+ */
+static bool
+set_ovsdb_update_entry(struct neigh_ovsdb_update *update,
+                       struct neighbour_entry *entry)
+{
+    char *ifname = NULL;
+
+    if (entry->ifname != NULL)
+    {
+        ifname = STRDUP(entry->ifname);
+        if (ifname == NULL) return false;
+    }
+    FREE(update->entry.ifname);
+    update->entry.ifname = ifname;
+
+    sockaddr_storage_populate(entry->af_family, entry->ip_tbl,
+                              update->entry.ipaddr);
+    memcpy(update->entry.mac, entry->mac, sizeof(os_macaddr_t));
+    update->entry.af_family = entry->af_family;
+    update->entry.source = entry->source;
+    update->entry.ifindex = entry->ifindex;
+    update->entry.cache_valid_ts = entry->cache_valid_ts;
+    neigh_table_set_entry(&update->entry);
+
+    return true;
+}
+
+/**
+ * @brief allocate a queued ovsdb update from a cache entry
+ *
+ * The cache entry may be freed before the update is flushed,
+ * hence the update holds its own copy of the entry.
+ */
+static struct neigh_ovsdb_update *
+alloc_ovsdb_update(struct neighbour_entry *entry, bool remove, bool fresh)
+{
+    struct neigh_ovsdb_update *update;
+
+    update = CALLOC(1, sizeof(*update));
+    if (update == NULL) return NULL;
+
+    update->entry.ipaddr = CALLOC(1, sizeof(*update->entry.ipaddr));
+    if (update->entry.ipaddr == NULL) goto err_free_update;
+
+    update->entry.mac = CALLOC(1, sizeof(*update->entry.mac));
+    if (update->entry.mac == NULL) goto err_free_update;
+
+    if (!set_ovsdb_update_entry(update, entry)) goto err_free_update;
+
+    update->remove = remove;
+    update->added_in_window = (!remove && fresh);
+
+    return update;
+
+err_free_update:
+    free_ovsdb_update(update);
+
+    return NULL;
+}
+
+/**
+ * @brief check if another cache entry is written to the row of an entry
+ *
+ * IPv4 rows are selected by MAC address and IPv6 rows by IP address,
+ * several cache entries may map to the same row.
+ */
+static bool
+neigh_table_ovsdb_row_shared(struct neighbour_entry *entry)
+{
+    struct neigh_table_mgr *mgr = neigh_table_get_mgr();
+    struct neighbour_entry *other;
+
+    ds_tree_foreach(&mgr->neigh_table, other)
+    {
+        if (other == entry) continue;
+        if (neigh_table_cmp(other, entry) == 0) continue;
+        if (neigh_ovsdb_update_cmp(other, entry) == 0) return true;
+    }
+
+    return false;
+}
+
+static void
+neigh_table_ovsdb_batch_cb(struct ev_loop *loop, ev_debounce *w, int revents)
+{
+    neigh_table_flush_ovsdb_updates();
+}
+
+static bool
+neigh_table_ovsdb_batch_enabled(void)
+{
+    struct neigh_table_mgr *mgr = neigh_table_get_mgr();
+
+    if (mgr->loop == NULL) return false;
+
+    return (mgr->ovsdb_batch_delay > 0);
+}
+
+/**
+ * @brief queue an ovsdb update for the next batched write-back
+ *
+ * @param entry the neighbor entry to write
+ * @param remove true if the entry is to be removed
+ * @param fresh true if the entry was just created in the cache
+ *
+ * Updates of the same row are coalesced within the window, the last
+ * one is written, in the order of the last event. The queued addition
+ * is an upsert: a removal only cancels it when the entry was freshly
+ * created in the cache within the same window and no other cache entry
+ * is written to the same row, as the row may otherwise predate the
+ * window and must be deleted.
+ */
+static bool
+neigh_table_queue_ovsdb_update(struct neighbour_entry *entry, bool remove,
+                               bool fresh)
+{
+    struct neigh_table_mgr *mgr = neigh_table_get_mgr();
+    struct neigh_ovsdb_update *update;
+
+    if (entry->mac == NULL) return false;
+
+    mgr->ovsdb_stats.requested++;
+    mgr->window_requests++;
+
+    update = ds_tree_find(&mgr->ovsdb_updates, entry);
+    if (update == NULL)
+    {
+        update = alloc_ovsdb_update(entry, remove, fresh);
+        if (update == NULL) return false;
+
+        ds_tree_insert(&mgr->ovsdb_updates, update, &update->entry);
+        ds_dlist_insert_tail(&mgr->ovsdb_updates_fifo, update);
+        mgr->ovsdb_updates_count++;
+        ev_debounce_start(mgr->loop, &mgr->ovsdb_batch_timer);
+
+        return true;
+    }
+
+    /* The row was inserted and removed within the window, drop both */
+    if (remove && update->added_in_window &&
+        !neigh_table_ovsdb_row_shared(entry))
+    {
+        ds_tree_remove(&mgr->ovsdb_updates, update);
+        ds_dlist_remove(&mgr->ovsdb_updates_fifo, update);
+        free_ovsdb_update(update);
+        mgr->ovsdb_updates_count--;
+        mgr->ovsdb_stats.cancelled++;
+
+        return true;
+    }
+
+    mgr->ovsdb_stats.coalesced++;
+    if (!set_ovsdb_update_entry(update, entry)) return false;
+    update->remove = remove;
+
+    /* The row deletion is now pending, a later removal must not drop it */
+    if (remove) update->added_in_window = false;
+
+    /* Written in the order of its latest event */
+    ds_dlist_remove(&mgr->ovsdb_updates_fifo, update);
+    ds_dlist_insert_tail(&mgr->ovsdb_updates_fifo, update);
+
+    return true;
+}
+
+/**
+ * @brief update the ovsdb tables for a cache entry
+ *
+ * The update is either queued for the next batched write-back
+ * or issued synchronously when batching is disabled.
+ */
+static bool
+neigh_table_update_ovsdb(struct neighbour_entry *entry, bool remove)
+{
+    struct neigh_table_mgr *mgr = neigh_table_get_mgr();
+    bool fresh;
+
+    /* Only the first write of a new cache entry inserts a row */
+    fresh = ((entry->flags & NEIGH_NEW) != 0);
+    entry->flags &= ~NEIGH_NEW;
+
+    if (mgr->update_ovsdb_tables == NULL) return true;
+
+    if (!neigh_table_ovsdb_batch_enabled())
+    {
+        return mgr->update_ovsdb_tables(entry, remove);
+    }
+
+    return neigh_table_queue_ovsdb_update(entry, remove, fresh);
+}
+
+/**
+ * @brief write all queued neighbor updates to OVSDB
+ *
+ * Called when the coalescing window expires, and on cleanup.
+ */
+void
+neigh_table_flush_ovsdb_updates(void)
+{
+    struct neigh_table_mgr *mgr = neigh_table_get_mgr();
+    struct neigh_ovsdb_update *update;
+    uint64_t requests;
+    int ntrans;
+
+    if (mgr->loop != NULL) ev_debounce_stop(mgr->loop, &mgr->ovsdb_batch_timer);
+
+    requests = mgr->window_requests;
+    mgr->window_requests = 0;
+    if (mgr->ovsdb_updates_count == 0) return;
+
+    ntrans = 0;
+    if (mgr->flush_ovsdb_updates != NULL)
+    {
+        ntrans = mgr->flush_ovsdb_updates(&mgr->ovsdb_updates_fifo);
+        if (ntrans < 0)
+        {
+            LOGD("%s: failed to write %d entries to ovsdb", __func__,
+                 mgr->ovsdb_updates_count);
+            ntrans = 0;
+        }
+    }
+    else if (mgr->update_ovsdb_tables != NULL)
+    {
+        ds_dlist_foreach(&mgr->ovsdb_updates_fifo, update)
+        {
+            mgr->update_ovsdb_tables(&update->entry, update->remove);
+            ntrans++;
+        }
+    }
+
+    mgr->ovsdb_stats.flushes++;
+    mgr->ovsdb_stats.transactions += ntrans;
+    if (requests > (uint64_t)ntrans) mgr->ovsdb_stats.saved += (requests - ntrans);
+
+    LOGT("%s: %d entries flushed in %d transactions, %" PRIu64 " requests, "
+         "%" PRIu64 " transactions saved so far", __func__,
+         mgr->ovsdb_updates_count, ntrans, requests, mgr->ovsdb_stats.saved);
+
+    while ((update = ds_dlist_remove_head(&mgr->ovsdb_updates_fifo)) != NULL)
+    {
+        ds_tree_remove(&mgr->ovsdb_updates, update);
+        free_ovsdb_update(update);
+    }
+    mgr->ovsdb_updates_count = 0;
+}
+
+/**
+ * @brief set the OVSDB write-back coalescing window
+ *
+ * @param delay the debounce delay in seconds. 0 disables batching.
+ */
+void
+neigh_table_set_ovsdb_batch_delay(double delay)
+{
+    struct neigh_table_mgr *mgr = neigh_table_get_mgr();
+
+    /* Write back what was queued with the previous settings */
+    neigh_table_flush_ovsdb_updates();
+
+    mgr->ovsdb_batch_delay = delay;
+
+    /* Do not postpone the write-back more than 5 times the window */
+    ev_debounce_set2(&mgr->ovsdb_batch_timer, delay, delay * 5);
+}
+
+struct neigh_ovsdb_batch_stats *
+neigh_table_get_ovsdb_batch_stats(void)
+{
+    struct neigh_table_mgr *mgr = neigh_table_get_mgr();
+
+    return &mgr->ovsdb_stats;
+}
+
 void
 neigh_table_init_monitor(struct ev_loop *loop, bool system_event, uint32_t ovsdb_event)
 {
@@ -267,6 +607,7 @@ neigh_table_init_monitor(struct ev_loop *loop, bool system_event, uint32_t ovsdb
 
     if (loop == NULL) return;
 
+    mgr->loop = loop;
     mgr->system_event = system_event;
     mgr->ovsdb_event = ovsdb_event;
 
@@ -295,12 +636,25 @@ neigh_table_init_manager(void)
     if (mgr->initialized) return;
 
     mgr->update_ovsdb_tables = update_ip_in_ovsdb_table;
+    mgr->flush_ovsdb_updates = neigh_src_flush_ovsdb_updates;
 
     ds_tree_init(&mgr->neigh_table, neigh_table_cmp,
                  struct neighbour_entry, entry_node);
 
     ds_tree_init(&mgr->interfaces, neigh_intf_cmp,
                  struct neigh_interface, intf_node);
+
+    ds_tree_init(&mgr->ovsdb_updates, neigh_ovsdb_update_cmp,
+                 struct neigh_ovsdb_update, update_node);
+    ds_dlist_init(&mgr->ovsdb_updates_fifo, struct neigh_ovsdb_update,
+                  fifo_node);
+    mgr->ovsdb_updates_count = 0;
+    mgr->window_requests = 0;
+    MEMZERO(mgr->ovsdb_stats);
+
+    mgr->ovsdb_batch_delay = (double)CONFIG_NEIGH_TABLE_OVSDB_BATCH_DELAY_MS / 1000.0;
+    ev_debounce_init2(&mgr->ovsdb_batch_timer, neigh_table_ovsdb_batch_cb,
+                      mgr->ovsdb_batch_delay, mgr->ovsdb_batch_delay * 5);
 }
 
 /**
@@ -355,10 +709,7 @@ neigh_table_cache_cleanup(void)
     {
         remove_node = entry_node;
 
-        if (mgr->update_ovsdb_tables)
-        {
-            mgr->update_ovsdb_tables(remove_node, true);
-        }
+        neigh_table_update_ovsdb(remove_node, true);
 
         entry_node = ds_tree_next(tree, entry_node);
         ds_tree_remove(tree, remove_node);
@@ -366,6 +717,9 @@ neigh_table_cache_cleanup(void)
         mgr->count--;
     }
 
+    /* Write back the removals in one go */
+    neigh_table_flush_ovsdb_updates();
+
     tree = &mgr->interfaces;
     intf_node = ds_tree_head(tree);
     while (intf_node != NULL)
@@ -396,6 +750,7 @@ neigh_table_cleanup(void)
     if (ovsdb_event) neigh_src_exit(ovsdb_event);
 
     neigh_table_cache_cleanup();
+    mgr->loop = NULL;
     mgr->initialized = false;
 }
 
@@ -522,22 +877,23 @@ err_free_entry:
 bool
 neigh_table_add(struct neighbour_entry *to_add)
 {
-    struct neigh_table_mgr *mgr = neigh_table_get_mgr();
     struct neighbour_entry *entry;
+    bool fresh;
 
     if (to_add == NULL) return false;
 
     neigh_table_set_entry(to_add);
 
+    fresh = (neigh_table_cache_lookup(to_add) == NULL);
     entry = neigh_table_add_to_cache(to_add);
     if (entry == NULL)
     {
         return ((to_add->flags & NEIGH_CACHED) ? true : false);
     }
+    if (fresh) entry->flags |= NEIGH_NEW;
 
     // Update ovsdb tables if required.
-    if (mgr->update_ovsdb_tables &&
-        !mgr->update_ovsdb_tables(entry, false))
+    if (!neigh_table_update_ovsdb(entry, false))
     {
         LOGD("%s: Failed to add entry into ovsdb table.", __func__);
         return false;
@@ -587,8 +943,7 @@ neigh_table_delete(struct neighbour_entry *to_del)
     ds_tree_remove(&mgr->neigh_table, lookup);
 
     // Update ovsdb tables if required.
-    if (mgr->update_ovsdb_tables &&
-        !mgr->update_ovsdb_tables(lookup, true))
+    if (!neigh_table_update_ovsdb(lookup, true))
     {
         LOGD("%s: Failed to delete entry from ovsdb table.", __func__);
         return;
@@ -774,10 +1129,7 @@ neigh_table_ttl_cleanup(int64_t ttl, uint32_t source_mask)
 
         remove_node = entry_node;
 
-        if (mgr->update_ovsdb_tables)
-        {
-            mgr->update_ovsdb_tables(remove_node, true);
-        }
+        neigh_table_update_ovsdb(remove_node, true);
 
         entry_node = ds_tree_next(tree, entry_node);
         LOGT("%s(): deleting IPv4_Neighbors entry " PRI_os_macaddr_lower_t " due to TTL expiry %" PRId64, __func__, FMT_os_macaddr_pt(remove_node->mac), ttl);
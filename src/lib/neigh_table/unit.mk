@@ -47,5 +47,6 @@ UNIT_EXPORT_LDFLAGS := $(UNIT_LDFLAGS)
 
 UNIT_DEPS += src/lib/log
 UNIT_DEPS += src/lib/ds
+UNIT_DEPS += src/lib/evx
 UNIT_DEPS += src/lib/ovsdb
 UNIT_DEPS += src/lib/nf_utils
@@ -0,0 +1,431 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "neigh_table.h"
+#include "memutil.h"
+#include "sockaddr_storage.h"
+#include "unity.h"
+
+#include "test_neigh_table.h"
+#include "unit_test_utils.h"
+
+static struct
+{
+    int update_calls;
+    int flush_calls;
+    int flushed_adds;
+    int flushed_removes;
+    json_t *tran;
+    size_t nrows;
+} g_batch;
+
+static struct sockaddr_storage g_ipaddr[2];
+static os_macaddr_t g_mac[2];
+static struct neighbour_entry g_entry[2];
+
+#define TEST_BATCH_MAX_ROWS 8
+
+static bool
+test_batch_update_ovsdb_tables(struct neighbour_entry *key, bool remove)
+{
+    g_batch.update_calls++;
+
+    return true;
+}
+
+/**
+ * @brief test flush hook, keeps the transaction the real flush would send
+ */
+static int
+test_batch_flush_ovsdb_updates(ds_dlist_t *updates)
+{
+    const char *tables[TEST_BATCH_MAX_ROWS];
+    size_t index[TEST_BATCH_MAX_ROWS];
+    json_t *rows[TEST_BATCH_MAX_ROWS];
+    struct neigh_ovsdb_update *update;
+    size_t i;
+
+    g_batch.flush_calls++;
+    ds_dlist_foreach(updates, update)
+    {
+        if (update->remove) g_batch.flushed_removes++;
+        else g_batch.flushed_adds++;
+    }
+
+    TEST_ASSERT_TRUE(g_batch.flushed_adds + g_batch.flushed_removes <= TEST_BATCH_MAX_ROWS);
+
+    json_decref(g_batch.tran);
+    g_batch.tran = neigh_src_ovsdb_updates_tran(updates, rows, tables, index,
+                                                &g_batch.nrows);
+    for (i = 0; i < g_batch.nrows; i++) json_decref(rows[i]);
+
+    return 1;
+}
+
+/**
+ * @brief get the nth operation of the last flushed transaction
+ *
+ * Comments and the database name are skipped.
+ */
+static json_t *
+test_batch_tran_op(size_t n)
+{
+    json_t *op;
+    size_t i;
+
+    json_array_foreach(g_batch.tran, i, op)
+    {
+        if (!json_is_object(op)) continue;
+        if (!strcmp(json_string_value(json_object_get(op, "op")), "comment")) continue;
+        if (n-- == 0) return op;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief check an operation of the last flushed transaction
+ */
+static void
+test_batch_check_op(size_t n, const char *name, const char *column,
+                    const char *value)
+{
+    json_t *where;
+    json_t *cond;
+    json_t *op;
+
+    op = test_batch_tran_op(n);
+    TEST_ASSERT_NOT_NULL(op);
+    TEST_ASSERT_EQUAL_STRING(name, json_string_value(json_object_get(op, "op")));
+    TEST_ASSERT_EQUAL_STRING("IPv4_Neighbors",
+                             json_string_value(json_object_get(op, "table")));
+
+    /* The first condition selects the row, as the coalescing key */
+    where = json_object_get(op, "where");
+    cond = json_array_get(where, 0);
+    TEST_ASSERT_EQUAL_STRING(column, json_string_value(json_array_get(cond, 0)));
+    TEST_ASSERT_EQUAL_STRING(value, json_string_value(json_array_get(cond, 2)));
+}
+
+void
+test_neigh_batch_setUp(void)
+{
+    struct neigh_table_mgr *mgr;
+    uint32_t v4ip;
+    size_t i;
+
+    neigh_table_init();
+    mgr = neigh_table_get_mgr();
+    mgr->loop = EV_DEFAULT;
+    mgr->update_ovsdb_tables = test_batch_update_ovsdb_tables;
+    mgr->flush_ovsdb_updates = test_batch_flush_ovsdb_updates;
+    neigh_table_set_ovsdb_batch_delay(1.0);
+
+    MEMZERO(g_batch);
+    memset(neigh_table_get_ovsdb_batch_stats(), 0,
+           sizeof(struct neigh_ovsdb_batch_stats));
+
+    for (i = 0; i < 2; i++)
+    {
+        v4ip = htonl(0x0a000001 + i);
+        sockaddr_storage_populate(AF_INET, &v4ip, &g_ipaddr[i]);
+        memset(&g_mac[i], 0, sizeof(g_mac[i]));
+        g_mac[i].addr[0] = 0xaa;
+        g_mac[i].addr[5] = i + 1;
+
+        memset(&g_entry[i], 0, sizeof(g_entry[i]));
+        g_entry[i].ipaddr = &g_ipaddr[i];
+        g_entry[i].mac = &g_mac[i];
+        g_entry[i].ifname = "br-home";
+        g_entry[i].source = FSM_ARP;
+    }
+}
+
+void
+test_neigh_batch_tearDown(void)
+{
+    struct neigh_table_mgr *mgr = neigh_table_get_mgr();
+
+    mgr->update_ovsdb_tables = NULL;
+    neigh_table_cleanup();
+    json_decref(g_batch.tran);
+    g_batch.tran = NULL;
+    mgr->update_ovsdb_tables = update_ip_in_ovsdb_table;
+    mgr->flush_ovsdb_updates = neigh_src_flush_ovsdb_updates;
+}
+
+void
+test_neigh_batch_cancel(void)
+{
+    struct neigh_ovsdb_batch_stats *stats;
+    bool rc;
+
+    /* Add two entries, remove one of them within the window */
+    rc = neigh_table_add(&g_entry[0]);
+    TEST_ASSERT_TRUE(rc);
+    rc = neigh_table_add(&g_entry[1]);
+    TEST_ASSERT_TRUE(rc);
+    neigh_table_delete(&g_entry[1]);
+
+    /* Nothing is written before the window expires */
+    TEST_ASSERT_EQUAL(0, g_batch.update_calls);
+    TEST_ASSERT_EQUAL(0, g_batch.flush_calls);
+
+    neigh_table_flush_ovsdb_updates();
+    TEST_ASSERT_EQUAL(1, g_batch.flush_calls);
+    TEST_ASSERT_EQUAL(1, g_batch.flushed_adds);
+    TEST_ASSERT_EQUAL(0, g_batch.flushed_removes);
+    TEST_ASSERT_EQUAL(0, g_batch.update_calls);
+
+    stats = neigh_table_get_ovsdb_batch_stats();
+    TEST_ASSERT_EQUAL(3, stats->requested);
+    TEST_ASSERT_EQUAL(1, stats->cancelled);
+    TEST_ASSERT_EQUAL(1, stats->transactions);
+    TEST_ASSERT_EQUAL(2, stats->saved);
+
+    /* Nothing left to flush */
+    neigh_table_flush_ovsdb_updates();
+    TEST_ASSERT_EQUAL(1, g_batch.flush_calls);
+}
+
+void
+test_neigh_batch_coalesce(void)
+{
+    struct neigh_ovsdb_batch_stats *stats;
+    bool rc;
+
+    rc = neigh_table_add(&g_entry[0]);
+    TEST_ASSERT_TRUE(rc);
+    neigh_table_flush_ovsdb_updates();
+    TEST_ASSERT_EQUAL(1, g_batch.flushed_adds);
+
+    /* A removal followed by an addition of a written entry is an update */
+    neigh_table_delete(&g_entry[0]);
+    rc = neigh_table_add(&g_entry[0]);
+    TEST_ASSERT_TRUE(rc);
+
+    neigh_table_flush_ovsdb_updates();
+    TEST_ASSERT_EQUAL(2, g_batch.flush_calls);
+    TEST_ASSERT_EQUAL(2, g_batch.flushed_adds);
+    TEST_ASSERT_EQUAL(0, g_batch.flushed_removes);
+
+    stats = neigh_table_get_ovsdb_batch_stats();
+    TEST_ASSERT_EQUAL(3, stats->requested);
+    TEST_ASSERT_EQUAL(1, stats->coalesced);
+    TEST_ASSERT_EQUAL(0, stats->cancelled);
+
+    /* A removal of a written entry is flushed */
+    neigh_table_delete(&g_entry[0]);
+    neigh_table_flush_ovsdb_updates();
+    TEST_ASSERT_EQUAL(1, g_batch.flushed_removes);
+}
+
+void
+test_neigh_batch_preexisting(void)
+{
+    struct neigh_ovsdb_batch_stats *stats;
+    os_macaddr_t mac;
+    bool rc;
+
+    /* The entry mirrors a row already present in ovsdb */
+    rc = neigh_table_cache_update(&g_entry[0]);
+    TEST_ASSERT_TRUE(rc);
+
+    /* Its MAC address changes, then it goes away within the window */
+    memcpy(&mac, &g_mac[0], sizeof(mac));
+    g_mac[0].addr[4] = 0x42;
+    rc = neigh_table_add(&g_entry[0]);
+    TEST_ASSERT_TRUE(rc);
+    neigh_table_delete(&g_entry[0]);
+
+    /* The upserted row may predate the window, it must be deleted */
+    neigh_table_flush_ovsdb_updates();
+    TEST_ASSERT_EQUAL(1, g_batch.flush_calls);
+    TEST_ASSERT_EQUAL(0, g_batch.flushed_adds);
+    TEST_ASSERT_EQUAL(1, g_batch.flushed_removes);
+
+    stats = neigh_table_get_ovsdb_batch_stats();
+    TEST_ASSERT_EQUAL(0, stats->cancelled);
+    TEST_ASSERT_EQUAL(1, stats->coalesced);
+
+    memcpy(&g_mac[0], &mac, sizeof(mac));
+}
+
+void
+test_neigh_batch_disabled(void)
+{
+    struct neigh_ovsdb_batch_stats *stats;
+    bool rc;
+
+    neigh_table_set_ovsdb_batch_delay(0);
+
+    /* Updates are written synchronously */
+    rc = neigh_table_add(&g_entry[0]);
+    TEST_ASSERT_TRUE(rc);
+    TEST_ASSERT_EQUAL(1, g_batch.update_calls);
+    neigh_table_delete(&g_entry[0]);
+    TEST_ASSERT_EQUAL(2, g_batch.update_calls);
+
+    neigh_table_flush_ovsdb_updates();
+    TEST_ASSERT_EQUAL(0, g_batch.flush_calls);
+
+    stats = neigh_table_get_ovsdb_batch_stats();
+    TEST_ASSERT_EQUAL(0, stats->requested);
+}
+
+void
+test_neigh_batch_timer(void)
+{
+    bool rc;
+
+    neigh_table_set_ovsdb_batch_delay(0.1);
+
+    rc = neigh_table_add(&g_entry[0]);
+    TEST_ASSERT_TRUE(rc);
+    rc = neigh_table_add(&g_entry[1]);
+    TEST_ASSERT_TRUE(rc);
+
+    /* The window expiry flushes both entries at once */
+    ev_run(EV_DEFAULT, 0);
+    TEST_ASSERT_EQUAL(1, g_batch.flush_calls);
+    TEST_ASSERT_EQUAL(2, g_batch.flushed_adds);
+}
+
+void
+test_neigh_batch_interleaved(void)
+{
+    json_t *row;
+    bool rc;
+
+    rc = neigh_table_add(&g_entry[0]);
+    TEST_ASSERT_TRUE(rc);
+    rc = neigh_table_add(&g_entry[1]);
+    TEST_ASSERT_TRUE(rc);
+    neigh_table_flush_ovsdb_updates();
+    TEST_ASSERT_EQUAL(2, g_batch.flushed_adds);
+    test_batch_check_op(0, "update", "hwaddr", "AA:00:00:00:00:01");
+    test_batch_check_op(1, "update", "hwaddr", "AA:00:00:00:00:02");
+
+    /* The second entry goes away, then the first one is replaced */
+    neigh_table_delete(&g_entry[1]);
+    neigh_table_delete(&g_entry[0]);
+    rc = neigh_table_add(&g_entry[0]);
+    TEST_ASSERT_TRUE(rc);
+
+    neigh_table_flush_ovsdb_updates();
+    TEST_ASSERT_EQUAL(3, g_batch.flushed_adds);
+    TEST_ASSERT_EQUAL(1, g_batch.flushed_removes);
+    test_batch_check_op(0, "delete", "hwaddr", "AA:00:00:00:00:02");
+    test_batch_check_op(1, "update", "hwaddr", "AA:00:00:00:00:01");
+    TEST_ASSERT_NULL(test_batch_tran_op(2));
+    TEST_ASSERT_EQUAL(1, g_batch.nrows);
+
+    /* The second entry comes back, then the first one is replaced again */
+    rc = neigh_table_add(&g_entry[1]);
+    TEST_ASSERT_TRUE(rc);
+    neigh_table_delete(&g_entry[0]);
+    rc = neigh_table_add(&g_entry[0]);
+    TEST_ASSERT_TRUE(rc);
+
+    /* The coalesced update is written in the order of its latest event */
+    neigh_table_flush_ovsdb_updates();
+    TEST_ASSERT_EQUAL(5, g_batch.flushed_adds);
+    test_batch_check_op(0, "update", "hwaddr", "AA:00:00:00:00:02");
+    test_batch_check_op(1, "update", "hwaddr", "AA:00:00:00:00:01");
+    row = json_object_get(test_batch_tran_op(1), "row");
+    TEST_ASSERT_EQUAL_STRING("10.0.0.1",
+                             json_string_value(json_object_get(row, "address")));
+    TEST_ASSERT_NULL(test_batch_tran_op(2));
+}
+
+void
+test_neigh_batch_address_move(void)
+{
+    struct neigh_ovsdb_batch_stats *stats;
+    struct sockaddr_storage ipaddr;
+    struct neighbour_entry moved;
+    json_t *row;
+    uint32_t v4ip;
+    bool rc;
+
+    rc = neigh_table_add(&g_entry[0]);
+    TEST_ASSERT_TRUE(rc);
+    neigh_table_flush_ovsdb_updates();
+
+    /* The device moves to a new IP address */
+    moved = g_entry[0];
+    v4ip = htonl(0x0a000003);
+    sockaddr_storage_populate(AF_INET, &v4ip, &ipaddr);
+    moved.ipaddr = &ipaddr;
+    moved.ip_tbl = NULL;
+    neigh_table_delete(&g_entry[0]);
+    rc = neigh_table_add(&moved);
+    TEST_ASSERT_TRUE(rc);
+
+    /* Both events select the same row, the latest one is written */
+    neigh_table_flush_ovsdb_updates();
+    TEST_ASSERT_EQUAL(2, g_batch.flushed_adds);
+    TEST_ASSERT_EQUAL(0, g_batch.flushed_removes);
+    test_batch_check_op(0, "update", "hwaddr", "AA:00:00:00:00:01");
+    TEST_ASSERT_NULL(test_batch_tran_op(1));
+    row = json_object_get(test_batch_tran_op(0), "row");
+    TEST_ASSERT_EQUAL_STRING("10.0.0.3",
+                             json_string_value(json_object_get(row, "address")));
+
+    stats = neigh_table_get_ovsdb_batch_stats();
+    TEST_ASSERT_EQUAL(1, stats->coalesced);
+    TEST_ASSERT_EQUAL(0, stats->cancelled);
+
+    /* A fresh entry sharing the row of another one doesn't cancel its write */
+    moved.ipaddr = &g_ipaddr[1];
+    moved.ip_tbl = NULL;
+    rc = neigh_table_add(&moved);
+    TEST_ASSERT_TRUE(rc);
+    neigh_table_delete(&moved);
+    neigh_table_flush_ovsdb_updates();
+    TEST_ASSERT_EQUAL(1, g_batch.flushed_removes);
+    test_batch_check_op(0, "delete", "hwaddr", "AA:00:00:00:00:01");
+    TEST_ASSERT_EQUAL(0, stats->cancelled);
+}
+
+void
+run_test_neigh_batch(void)
+{
+    ut_setUp_tearDown(__func__, test_neigh_batch_setUp, test_neigh_batch_tearDown);
+
+    RUN_TEST(test_neigh_batch_cancel);
+    RUN_TEST(test_neigh_batch_coalesce);
+    RUN_TEST(test_neigh_batch_preexisting);
+    RUN_TEST(test_neigh_batch_disabled);
+    RUN_TEST(test_neigh_batch_timer);
+    RUN_TEST(test_neigh_batch_interleaved);
+    RUN_TEST(test_neigh_batch_address_move);
+
+    ut_setUp_tearDown(NULL, NULL, NULL);
+}
@@ -31,5 +31,6 @@ extern char *test_name;
 
 extern void run_test_neigh_table(void);
 extern void run_test_neigh_intf(void);
+extern void run_test_neigh_batch(void);
 
 #endif /* TEST_NEIGH_TABLE_H */
@@ -47,6 +47,7 @@ main(int argc, char *argv[])
 
     run_test_neigh_table();
     run_test_neigh_intf();
+    run_test_neigh_batch();
 
     return ut_fini();
 }
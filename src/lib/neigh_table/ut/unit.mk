@@ -31,6 +31,7 @@ UNIT_TYPE := TEST_BIN
 UNIT_SRC := test_neigh_table_main.c
 UNIT_SRC += test_neigh_table.c
 UNIT_SRC += test_neigh_intf.c
+UNIT_SRC += test_neigh_batch.c
 
 UNIT_CFLAGS := -I$(UNIT_PATH)/../inc
 UNIT_EXPORT_CFLAGS := $(UNIT_CFLAGS)
@@ -47,4 +48,5 @@ UNIT_DEPS += src/lib/ovsdb
 UNIT_DEPS += src/lib/unity
 UNIT_DEPS += src/lib/neigh_table
 UNIT_DEPS += src/lib/nf_utils
+UNIT_DEPS += src/lib/evx
 UNIT_DEPS += src/lib/unit_test_utils
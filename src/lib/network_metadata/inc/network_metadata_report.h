@@ -106,6 +106,8 @@ struct net_md_stats_accumulator
     time_t last_updated;
     void (*free_plugins)(struct net_md_stats_accumulator *);
     ds_tree_t *dpi_plugins;
+    void *dpi_slots;                       /* flat array of dpi_plugins */
+    void *tcp_stream;                      /* dpi tcp stream reassembly */
     int dpi_done;                          /* All dpi engines are done */
     int mark_done;                         /* last known pushed mark to ct() */
     int refcnt;                            /* # of entities accessing the acc */
@@ -102,6 +102,7 @@ struct nfq_pkt_info
     void               *payload;
     int                flow_mark;
     uint32_t           mark_policy;
+    uint32_t           ct_mark;      /* conntrack mark of the queued packet */
     uint16_t           rx_vidx;
     uint16_t           tx_vidx;
     uint16_t           rx_pidx;
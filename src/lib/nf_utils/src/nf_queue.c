@@ -112,6 +112,22 @@ nf_record_err(struct nfqueue_ctxt *nfq, int err, const char *caller, int line)
 }
 
 
+static int
+nf_queue_parse_ct_attr_cb(const struct nlattr *attr, void *data)
+{
+    struct nfq_pkt_info *pi;
+
+    pi = (struct nfq_pkt_info *)data;
+
+    if (mnl_attr_get_type(attr) != CTA_MARK) return MNL_CB_OK;
+    if (mnl_attr_validate(attr, MNL_TYPE_U32) < 0) return MNL_CB_OK;
+
+    pi->ct_mark = ntohl(mnl_attr_get_u32(attr));
+
+    return MNL_CB_OK;
+}
+
+
 static int
 nf_queue_parse_attr_cb(const struct nlattr *attr, void *data)
 {
@@ -134,6 +150,9 @@ nf_queue_parse_attr_cb(const struct nlattr *attr, void *data)
     {
     case NFQA_MARK:
         break;
+    case NFQA_CT:
+        mnl_attr_parse_nested(attr, nf_queue_parse_ct_attr_cb, pi);
+        break;
     case NFQA_IFINDEX_INDEV:
         rc = mnl_attr_validate(attr, MNL_TYPE_U32);
         if (rc < 0)
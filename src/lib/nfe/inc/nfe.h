@@ -35,11 +35,25 @@ extern "C" {
 
 int nfe_conntrack_dump(nfe_conntrack_t conntrack, nfe_get_conntrack_cb_t cb, void *data);
 
+/* nfe_conntrack_stats()
+ *
+ * Fill @param stats with the load factor and chain length statistics of
+ * the conntrack hash table. Walks every bucket, so it is meant for periodic
+ * reporting alongside nfe_conntrack_dump().
+ *
+ * Returns the number of tracked connections or a negative error code.
+ */
+int nfe_conntrack_stats(nfe_conntrack_t conntrack, struct nfe_conntrack_stats *stats);
+
 /* nfe_conntrack_create()
  *
  * Create a conntrack for use by a thread, where @param size is the number of
  * hash buckets to use, increased to the next power of 2 when necessary. 
  *
+ * The table then grows and shrinks with the number of connections, within
+ * nfe_conntrack_min_buckets and nfe_conntrack_max_buckets. Buckets move to
+ * the resized table a few at a time on each lookup.
+ *
  * This operation will allocate memory through nfe_ext_alloc().
  * 
  * Returns 0 on success or a negative error code on failure.
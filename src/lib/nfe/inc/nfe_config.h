@@ -33,5 +33,7 @@ extern int nfe_conntrack_tcp_midflow;
 extern int nfe_conntrack_tcp_timeout_syn;
 extern int nfe_conntrack_tcp_timeout_est;
 extern int nfe_conntrack_ether_timeout;
+extern int nfe_conntrack_min_buckets;
+extern int nfe_conntrack_max_buckets;
 
 #endif
@@ -40,11 +40,14 @@ enum {
     NEXT_BYPASS_ETH  = 5
 };
 
+struct nfe_conntrack;
+
 struct nfe_conn {
 
     struct nfe_tuple tuple;
     struct nfe_list_head list;
     struct nfe_list_head lru;
+    struct nfe_conntrack *ct;
 
     union {
         struct nfe_tcp tcp;
@@ -56,7 +59,6 @@ struct nfe_conn {
     uint64_t timestamp;
 };
 
-struct nfe_conntrack;
 struct nfe_packet;
 
 struct nfe_conn *nfe_conn_lookup_next(struct nfe_conntrack *ct, struct nfe_packet *packet);
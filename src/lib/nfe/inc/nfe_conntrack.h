@@ -55,10 +55,22 @@ struct nfe_hash_bucket {
     struct nfe_list_head list;
 };
 
+/* The hash is resized incrementally: while @old is set, buckets below
+ * @migrate have been moved to @bucket, the others are still looked up in
+ * @old. New connections always go to @bucket.
+ */
 struct nfe_conntrack {
     int size;
+    uint32_t count;
+    struct nfe_hash_bucket *bucket;
+    struct nfe_hash_bucket *old;
+    uint32_t old_size;
+    uint32_t migrate;
+    uint32_t min_size;
+    uint32_t max_size;
+    uint32_t grows;
+    uint32_t shrinks;
     struct nfe_hash_lru lru[LRU_PROTO_MAX];
-    struct nfe_hash_bucket bucket[0];
 };
 
 struct nfe_conn *nfe_conntrack_lookup_hash(struct nfe_conntrack *conntrack, 
@@ -67,6 +79,7 @@ struct nfe_conn *nfe_conntrack_lookup_hash(struct nfe_conntrack *conntrack,
 struct nfe_conn *nfe_conntrack_lookup(struct nfe_conntrack *conntrack,
     struct nfe_packet *packet, int alloc_policy);
 
+struct nfe_hash_bucket *nfe_conntrack_table_alloc(uint32_t size);
 void nfe_conntrack_lru_expire(struct nfe_conntrack *conntrack, int lru, uint64_t timestamp);
 void nfe_conntrack_lru_update(struct nfe_conntrack *conntrack, int lru, struct nfe_list_head *item);
 
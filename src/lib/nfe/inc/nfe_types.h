@@ -42,6 +42,31 @@ typedef struct nfe_conn *nfe_conn_t;
 
 typedef void (*nfe_get_conntrack_cb_t)(nfe_conn_t conn, void *data);
 
+/* conntrack hash table statistics
+ *
+ * @buckets number of buckets of the active table
+ * @entries number of tracked connections
+ * @load_factor entries per 100 buckets
+ * @used_buckets non-empty buckets (both tables while rehashing)
+ * @max_chain length of the longest bucket chain
+ * @long_chains chains longer than NFE_CONNTRACK_LONG_CHAIN
+ * @rehash_pending buckets of the previous table not migrated yet
+ * @grows/@shrinks number of resizes since creation
+ */
+#define NFE_CONNTRACK_LONG_CHAIN 8
+
+struct nfe_conntrack_stats {
+    uint32_t buckets;
+    uint32_t entries;
+    uint32_t load_factor;
+    uint32_t used_buckets;
+    uint32_t max_chain;
+    uint32_t long_chains;
+    uint32_t rehash_pending;
+    uint32_t grows;
+    uint32_t shrinks;
+};
+
 /* 16 bytes */
 struct nfe_ipaddr {
     union {
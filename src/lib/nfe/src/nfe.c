@@ -79,6 +79,50 @@ nfe_conntrack_dump(nfe_conntrack_t conntrack, nfe_get_conntrack_cb_t cb, void *d
     return cnt;
 }
 
+static void
+conntrack_chain_stats(struct nfe_hash_bucket *table, uint32_t first, uint32_t size,
+    struct nfe_conntrack_stats *stats)
+{
+    struct nfe_list_head *pos;
+    uint32_t i, len;
+
+    for (i = first; i < size; i++) {
+        len = 0;
+        nfe_list_for_each(pos, &table[i].list) {
+            len++;
+        }
+        if (!len)
+            continue;
+
+        stats->used_buckets++;
+        if (len > stats->max_chain)
+            stats->max_chain = len;
+        if (len > NFE_CONNTRACK_LONG_CHAIN)
+            stats->long_chains++;
+    }
+}
+
+EXPORT int
+nfe_conntrack_stats(nfe_conntrack_t conntrack, struct nfe_conntrack_stats *stats)
+{
+    if (!conntrack || !stats)
+        return -EINVAL;
+
+    __builtin_memset(stats, 0, sizeof(*stats));
+    stats->buckets = conntrack->size;
+    stats->entries = conntrack->count;
+    stats->load_factor = (uint32_t)(((uint64_t)conntrack->count * 100) / conntrack->size);
+    stats->grows = conntrack->grows;
+    stats->shrinks = conntrack->shrinks;
+
+    conntrack_chain_stats(conntrack->bucket, 0, conntrack->size, stats);
+    if (conntrack->old) {
+        stats->rehash_pending = conntrack->old_size - conntrack->migrate;
+        conntrack_chain_stats(conntrack->old, conntrack->migrate, conntrack->old_size, stats);
+    }
+    return conntrack->count;
+}
+
 
 EXPORT int
 nfe_conntrack_update_timeouts(nfe_conntrack_t ct)
@@ -98,20 +142,29 @@ nfe_conntrack_update_timeouts(nfe_conntrack_t ct)
 EXPORT int
 nfe_conntrack_create(nfe_conntrack_t *h, uint32_t size)
 {
-    size_t sz;
-    uint32_t i;
     struct nfe_conntrack *ct;
 
     size = clp2(size);
-    sz = sizeof(*ct) + (sizeof(*ct->bucket) * size);
 
     if (!h || !size)
         return -EINVAL;
 
-    if (!(ct = nfe_ext_alloc(sz)))
+    if (!(ct = nfe_ext_alloc(sizeof(*ct))))
         return -ENOMEM;
 
+    __builtin_memset(ct, 0, sizeof(*ct));
+    if (!(ct->bucket = nfe_conntrack_table_alloc(size))) {
+        nfe_ext_free(ct);
+        return -ENOMEM;
+    }
+
     ct->size = size;
+    ct->min_size = clp2(nfe_conntrack_min_buckets);
+    ct->max_size = clp2(nfe_conntrack_max_buckets);
+    if (ct->min_size > size)
+        ct->min_size = size;
+    if (ct->max_size < size)
+        ct->max_size = size;
 
     ct->lru[LRU_PROTO_ICMP].expiry = nfe_conntrack_icmp_timeout * 1000;
     nfe_list_init(&ct->lru[LRU_PROTO_ICMP].list);
@@ -128,10 +181,6 @@ nfe_conntrack_create(nfe_conntrack_t *h, uint32_t size)
     ct->lru[LRU_PROTO_ETHER].expiry = nfe_conntrack_ether_timeout * 1000;
     nfe_list_init(&ct->lru[LRU_PROTO_ETHER].list);
 
-    for (i = 0; i < size; i++) {
-        nfe_list_init(&ct->bucket[i].list);
-    }
-
     *h = ct;
     return 0;
 }
@@ -149,9 +198,13 @@ nfe_conntrack_destroy(struct nfe_conntrack *ct)
         nfe_list_for_each_entry_safe(conn, tmp, &ct->lru[i].list, lru) {
             nfe_list_remove(&conn->lru);
             nfe_list_remove(&conn->list);
+            /* the conn may outlive the conntrack if still referenced */
+            conn->ct = NULL;
             nfe_conn_release(conn);
         }
     }
+    nfe_ext_free(ct->old);
+    nfe_ext_free(ct->bucket);
     nfe_ext_free(ct);
     return 0;
 }
@@ -265,6 +318,8 @@ nfe_conn_release(nfe_conn_t conn)
 
     nfe_assert(conn->lockref >= 1);
     if (--(conn->lockref) == 0) {
+        if (conn->ct)
+            conn->ct->count--;
         nfe_list_remove(&conn->list);
         nfe_list_remove(&conn->lru);
         nfe_ext_conn_free(conn, &conn->tuple);
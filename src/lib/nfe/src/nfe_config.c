@@ -38,4 +38,8 @@ EXPORT int nfe_conntrack_udp_timeout = 180;
 EXPORT int nfe_conntrack_icmp_timeout = 30;
 /* Timeout idle ether connections */
 EXPORT int nfe_conntrack_ether_timeout = 30;
+/* Smallest size the conntrack hash shrinks to */
+EXPORT int nfe_conntrack_min_buckets = 64;
+/* Largest size the conntrack hash grows to */
+EXPORT int nfe_conntrack_max_buckets = 65536;
 
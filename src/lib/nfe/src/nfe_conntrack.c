@@ -24,16 +24,115 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include "nfe.h"
 #include "nfe_list.h"
 #include "nfe_conn.h"
 #include "nfe_flow.h"
 #include "nfe_conntrack.h"
 #include "nfe_priv.h"
+#include "nfe_config.h"
+
+/* Buckets migrated to the resized table per lookup, and empty buckets
+ * skipped per lookup, bounding the work any single packet does.
+ */
+#define CT_REHASH_STEP   4
+#define CT_REHASH_EMPTY  16
+
+struct nfe_hash_bucket *
+nfe_conntrack_table_alloc(uint32_t size)
+{
+    struct nfe_hash_bucket *table;
+    uint32_t i;
+
+    table = nfe_ext_alloc(sizeof(*table) * size);
+    if (!table)
+        return NULL;
+
+    for (i = 0; i < size; i++) {
+        nfe_list_init(&table[i].list);
+    }
+    return table;
+}
+
+/* Move a few buckets of the previous table to the active one, and release
+ * the previous table once all of them have moved.
+ */
+static void
+ct_rehash_step(struct nfe_conntrack *ct)
+{
+    struct nfe_conn *conn, *tmp;
+    struct nfe_hash_bucket *b;
+    int moved = 0, empty = 0;
+    uint32_t hash;
+
+    while (ct->migrate < ct->old_size) {
+        b = &ct->old[ct->migrate];
+        if (nfe_list_empty(&b->list)) {
+            ct->migrate++;
+            if (++empty == CT_REHASH_EMPTY)
+                return;
+            continue;
+        }
+
+        nfe_list_for_each_entry_safe(conn, tmp, &b->list, list) {
+            hash = nfe_tuple_hash(&conn->tuple);
+            nfe_list_remove(&conn->list);
+            nfe_list_insert(&ct->bucket[hash & (ct->size-1)].list, &conn->list);
+        }
+        ct->migrate++;
+        if (++moved == CT_REHASH_STEP)
+            return;
+    }
+
+    nfe_ext_free(ct->old);
+    ct->old = NULL;
+    ct->old_size = 0;
+    ct->migrate = 0;
+}
+
+/* Start migrating to a table of @param size buckets. Failing to allocate
+ * it is not fatal: the current table keeps being used.
+ */
+static void
+ct_resize(struct nfe_conntrack *ct, uint32_t size)
+{
+    struct nfe_hash_bucket *table;
+
+    table = nfe_conntrack_table_alloc(size);
+    if (!table)
+        return;
+
+    if (size > (uint32_t)ct->size)
+        ct->grows++;
+    else
+        ct->shrinks++;
+
+    ct->old = ct->bucket;
+    ct->old_size = ct->size;
+    ct->migrate = 0;
+    ct->bucket = table;
+    ct->size = size;
+}
+
+/* Keep the load factor between 1/8 and 1 entry per bucket */
+static inline void
+ct_resize_check(struct nfe_conntrack *ct)
+{
+    uint32_t size = ct->size;
+
+    if (ct->old)
+        return;
+
+    if (ct->count > size && size < ct->max_size)
+        ct_resize(ct, size << 1);
+    else if (ct->count < (size >> 3) && size > ct->min_size)
+        ct_resize(ct, size >> 1);
+}
 
 /* Private lookup
  *
  * Returns the nfe_conn for the given tuple. Out @param b is always
- * set to point to the hashed bucket.
+ * set to point to the hashed bucket of the active table.
  *
  * The returned nfe_conn will have the lockref incremented by 1 with
  * each successful lookup.
@@ -42,9 +141,26 @@ static inline struct nfe_conn *
 ct_lookup_hash(struct nfe_conntrack *ct, const struct nfe_tuple *tuple, uint32_t hash, struct nfe_hash_bucket **b)
 {
     struct nfe_conn *conn;
+    uint32_t idx;
+
+    if (ct->old) {
+        ct_rehash_step(ct);
+    }
 
     *b = &ct->bucket[hash & (ct->size-1)];
 
+    if (ct->old) {
+        idx = hash & (ct->old_size-1);
+        if (idx >= ct->migrate) {
+            nfe_list_for_each_entry(conn, &ct->old[idx].list, list) {
+                if (nfe_tuple_equal(&conn->tuple, tuple)) {
+                    conn->lockref++;
+                    return conn;
+                }
+            }
+        }
+    }
+
     nfe_list_for_each_entry(conn, &(*b)->list, list) {
         if (nfe_tuple_equal(&conn->tuple, tuple)) {
             conn->lockref++;
@@ -72,10 +188,13 @@ nfe_conntrack_lookup(struct nfe_conntrack *ct, struct nfe_packet *packet, int al
             conn = nfe_conn_alloc(packet, alloc_policy == NFE_ALLOC_POLICY_INVERT);
             if (conn) {
                 nfe_list_insert(&b->list, &conn->list);
+                conn->ct = ct;
+                ct->count++;
                 conn->lockref++;
             }
         }
     }
+    ct_resize_check(ct);
     return conn;
 }
 
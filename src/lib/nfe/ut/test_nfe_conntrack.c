@@ -0,0 +1,304 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nfe.h"
+#include "nfe_config.h"
+#include "nfe_conntrack.h"
+#include "nfe_flow.h"
+#include "unity.h"
+#include "unit_test_utils.h"
+
+char *test_name = "test_nfe_conntrack";
+
+#define TEST_CT_SIZE 64
+#define TEST_CT_CONNS (TEST_CT_SIZE + 2)
+
+static nfe_conntrack_t g_ct;
+static struct nfe_packet g_pkt[TEST_CT_CONNS];
+static struct nfe_conn *g_conn[TEST_CT_CONNS];
+static int g_conns;
+
+void *
+nfe_ext_conn_alloc(size_t size, const struct nfe_tuple *tuple)
+{
+    g_conns++;
+    return malloc(size);
+}
+
+void
+nfe_ext_conn_free(void *p, const struct nfe_tuple *tuple)
+{
+    g_conns--;
+    free(p);
+}
+
+static void
+test_ct_packet(struct nfe_packet *packet, int i)
+{
+    memset(packet, 0, sizeof(*packet));
+    packet->tuple.domain = NFE_AF_INET;
+    packet->tuple.proto = 17;
+    packet->tuple.addr[0].addr32[0] = htonl(0x0a000000 + i);
+    packet->tuple.addr[1].addr32[0] = htonl(0x08080808);
+    packet->tuple.port[0] = htons(1024 + i);
+    packet->tuple.port[1] = htons(53);
+    packet->hash = nfe_tuple_hash(&packet->tuple);
+}
+
+/* Look up connection @param i without creating it, dropping the reference */
+static struct nfe_conn *
+test_ct_find(int i)
+{
+    struct nfe_conn *conn;
+
+    conn = nfe_conntrack_lookup(g_ct, &g_pkt[i], NFE_ALLOC_POLICY_NONE);
+    if (conn) nfe_conn_release(conn);
+
+    return conn;
+}
+
+static void
+test_ct_insert(int i)
+{
+    g_conn[i] = nfe_conntrack_lookup(g_ct, &g_pkt[i], NFE_ALLOC_POLICY_CREATE);
+    TEST_ASSERT_NOT_NULL(g_conn[i]);
+}
+
+/* Drop the reference taken at insertion, freeing the connection */
+static void
+test_ct_delete(int i)
+{
+    nfe_conn_release(g_conn[i]);
+    g_conn[i] = NULL;
+}
+
+/* Index of a connection whose bucket has not been migrated yet */
+static int
+test_ct_unmigrated(void)
+{
+    struct nfe_conntrack *ct = g_ct;
+    uint32_t idx;
+    int i;
+
+    for (i = 0; i < TEST_CT_CONNS; i++) {
+        if (g_conn[i] == NULL) continue;
+        idx = g_pkt[i].hash & (ct->old_size - 1);
+        if (idx >= ct->migrate) return i;
+    }
+
+    return -1;
+}
+
+static void
+test_ct_grow(int nconns)
+{
+    struct nfe_conntrack *ct = g_ct;
+    int i;
+
+    /* More than one connection per bucket starts a resize */
+    for (i = 0; i < nconns; i++) test_ct_insert(i);
+    TEST_ASSERT_NOT_NULL(ct->old);
+    TEST_ASSERT_EQUAL_UINT32(TEST_CT_SIZE, ct->old_size);
+    TEST_ASSERT_EQUAL_INT(TEST_CT_SIZE * 2, ct->size);
+    TEST_ASSERT_EQUAL_UINT32(1, ct->grows);
+}
+
+static void
+test_nfe_conntrack_setUp(void)
+{
+    int i;
+
+    /* Keep the sparse table from shrinking while it fills up */
+    nfe_conntrack_min_buckets = TEST_CT_SIZE;
+    nfe_conntrack_max_buckets = 1024;
+    TEST_ASSERT_EQUAL_INT(0, nfe_conntrack_create(&g_ct, TEST_CT_SIZE));
+
+    for (i = 0; i < TEST_CT_CONNS; i++) {
+        test_ct_packet(&g_pkt[i], i);
+        g_conn[i] = NULL;
+    }
+    g_conns = 0;
+}
+
+static void
+test_nfe_conntrack_tearDown(void)
+{
+    int i;
+
+    for (i = 0; i < TEST_CT_CONNS; i++) {
+        if (g_conn[i]) test_ct_delete(i);
+    }
+    TEST_ASSERT_EQUAL_INT(0, g_conns);
+    TEST_ASSERT_EQUAL_UINT32(0, g_ct->count);
+    nfe_conntrack_destroy(g_ct);
+}
+
+void
+test_nfe_conntrack_rehash_lookup(void)
+{
+    struct nfe_conntrack_stats stats;
+    struct nfe_conntrack *ct;
+    int i;
+
+    test_ct_grow(TEST_CT_SIZE + 1);
+    ct = g_ct;
+
+    /* Every connection is found while the rehash is half done */
+    for (i = 0; i <= TEST_CT_SIZE; i++) {
+        TEST_ASSERT_TRUE(test_ct_find(i) == g_conn[i]);
+        if (i == 1) {
+            TEST_ASSERT_NOT_NULL(ct->old);
+            TEST_ASSERT_TRUE(ct->migrate > 0);
+            TEST_ASSERT_TRUE(ct->migrate < ct->old_size);
+
+            TEST_ASSERT_EQUAL_INT(TEST_CT_SIZE + 1, nfe_conntrack_stats(g_ct, &stats));
+            TEST_ASSERT_EQUAL_UINT32(ct->old_size - ct->migrate, stats.rehash_pending);
+        }
+    }
+
+    /* Lookups complete the migration */
+    for (i = 0; i < TEST_CT_SIZE && ct->old; i++) test_ct_find(i);
+    TEST_ASSERT_NULL(ct->old);
+    for (i = 0; i <= TEST_CT_SIZE; i++) {
+        TEST_ASSERT_TRUE(test_ct_find(i) == g_conn[i]);
+    }
+    TEST_ASSERT_EQUAL_UINT32(TEST_CT_SIZE + 1, ct->count);
+}
+
+void
+test_nfe_conntrack_rehash_insert_delete(void)
+{
+    struct nfe_conntrack *ct;
+    int last = TEST_CT_CONNS - 1;
+    int i;
+
+    test_ct_grow(TEST_CT_SIZE + 1);
+    ct = g_ct;
+    test_ct_find(0);
+    TEST_ASSERT_NOT_NULL(ct->old);
+
+    /* New connections go to the active table */
+    test_ct_insert(last);
+    TEST_ASSERT_TRUE(test_ct_find(last) == g_conn[last]);
+    TEST_ASSERT_EQUAL_UINT32(TEST_CT_SIZE + 2, ct->count);
+
+    /* A connection still in the previous table can be deleted */
+    i = test_ct_unmigrated();
+    TEST_ASSERT_TRUE(i >= 0);
+    test_ct_delete(i);
+    TEST_ASSERT_NULL(test_ct_find(i));
+    TEST_ASSERT_EQUAL_UINT32(TEST_CT_SIZE + 1, ct->count);
+
+    /* And created again */
+    test_ct_insert(i);
+    TEST_ASSERT_TRUE(test_ct_find(i) == g_conn[i]);
+    TEST_ASSERT_EQUAL_UINT32(TEST_CT_SIZE + 2, ct->count);
+
+    while (ct->old) test_ct_find(last);
+    for (i = 0; i < TEST_CT_CONNS; i++) {
+        TEST_ASSERT_TRUE(test_ct_find(i) == g_conn[i]);
+    }
+}
+
+void
+test_nfe_conntrack_shrink(void)
+{
+    struct nfe_conntrack *ct;
+    int keep = 8;
+    int i;
+
+    test_ct_grow(TEST_CT_SIZE + 1);
+    ct = g_ct;
+    ct->min_size = TEST_CT_SIZE / 4;
+    while (ct->old) test_ct_find(0);
+
+    /* Dropping below 1/8 entries per bucket starts a shrink */
+    for (i = keep; i <= TEST_CT_SIZE; i++) test_ct_delete(i);
+    TEST_ASSERT_EQUAL_UINT32(keep, ct->count);
+    test_ct_find(0);
+    TEST_ASSERT_NOT_NULL(ct->old);
+    TEST_ASSERT_EQUAL_INT(TEST_CT_SIZE, ct->size);
+    TEST_ASSERT_EQUAL_UINT32(1, ct->shrinks);
+
+    for (i = 0; i < keep; i++) {
+        TEST_ASSERT_TRUE(test_ct_find(i) == g_conn[i]);
+    }
+    for (i = keep; i <= TEST_CT_SIZE; i++) {
+        TEST_ASSERT_NULL(test_ct_find(i));
+    }
+    TEST_ASSERT_NULL(ct->old);
+}
+
+void
+test_nfe_conntrack_bounds(void)
+{
+    struct nfe_conntrack *ct;
+    int i;
+
+    /* The table does not grow past its maximum size */
+    nfe_conntrack_destroy(g_ct);
+    nfe_conntrack_max_buckets = TEST_CT_SIZE;
+    TEST_ASSERT_EQUAL_INT(0, nfe_conntrack_create(&g_ct, TEST_CT_SIZE));
+    ct = g_ct;
+
+    for (i = 0; i < TEST_CT_CONNS; i++) test_ct_insert(i);
+    TEST_ASSERT_NULL(ct->old);
+    TEST_ASSERT_EQUAL_INT(TEST_CT_SIZE, ct->size);
+    TEST_ASSERT_EQUAL_UINT32(0, ct->grows);
+}
+
+void
+run_test_nfe_conntrack(void)
+{
+    RUN_TEST(test_nfe_conntrack_rehash_lookup);
+    RUN_TEST(test_nfe_conntrack_rehash_insert_delete);
+    RUN_TEST(test_nfe_conntrack_shrink);
+    RUN_TEST(test_nfe_conntrack_bounds);
+}
+
+/*
+ * ===========================================================================
+ *  MAIN
+ * ===========================================================================
+ */
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    ut_init(test_name, NULL, NULL);
+
+    ut_setUp_tearDown(test_name, test_nfe_conntrack_setUp, test_nfe_conntrack_tearDown);
+
+    run_test_nfe_conntrack();
+
+    return ut_fini();
+}
@@ -48,7 +48,7 @@ UNIT_DIR := lib
 # dependent lib units from all bin units
 
 # get all bin deps
-BIN_DEPS := $(foreach BIN,$(UNIT_ALL_BIN_UNITS) $(UNIT_ALL_TEST_BIN_UNITS),$(sort $(DEPS_$(BIN))))
+BIN_DEPS := $(foreach BIN,$(UNIT_ALL_BIN_UNITS) $(UNIT_ALL_TEST_BIN_UNITS) $(UNIT_ALL_BENCH_BIN_UNITS),$(sort $(DEPS_$(BIN))))
 # $(sort) also removes duplicates
 BIN_DEPS := $(sort $(BIN_DEPS))
 # only interested in deps of lib type
@@ -74,5 +74,6 @@ UNIT_BIN_LDFLAGS += $(foreach DEP,$(sort $(UNIT_DEPS)),$(LDFLAGS_$(DEP)))
 
 $(UNIT_ALL_BIN_FILES): $(call UNIT_MARK_FILE,$(UNIT_PATH))
 $(UNIT_ALL_TEST_BIN_FILES): $(call UNIT_MARK_FILE,$(UNIT_PATH))
+$(UNIT_ALL_BENCH_BIN_FILES): $(call UNIT_MARK_FILE,$(UNIT_PATH))
 
 endif
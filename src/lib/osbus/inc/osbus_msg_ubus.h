@@ -37,5 +37,73 @@ bool osbus_msg_from_blob_buf(osbus_msg_t **data, struct blob_buf *bb);
 bool osbus_msg_from_blob_attr(osbus_msg_t **data, struct blob_attr *attr);
 void osbus_msg_free_blob_buf(struct blob_buf *b);
 
+// read-only view of a blobmsg message
+// walks the blob buffer in place, nothing is allocated or copied,
+// a view is valid only as long as the underlying blob buffer
+typedef struct osbus_msg_view
+{
+    struct blob_attr *attr;
+    bool head; // top level blob without blobmsg header
+} osbus_msg_view_t;
+
+bool            osbus_msg_view_from_blob_attr(osbus_msg_view_t *view, struct blob_attr *attr);
+bool            osbus_msg_view_from_blob_buf (osbus_msg_view_t *view, struct blob_buf *bb);
+bool            osbus_msg_view_to_msg        (const osbus_msg_view_t *view, osbus_msg_t **data);
+
+osbus_msg_type  osbus_msg_view_get_type        (const osbus_msg_view_t *view);
+const char*     osbus_msg_view_get_name        (const osbus_msg_view_t *view);
+bool            osbus_msg_view_is_container    (const osbus_msg_view_t *view);
+bool            osbus_msg_view_next            (const osbus_msg_view_t *view, osbus_msg_view_t *item);
+int             osbus_msg_view_item_count      (const osbus_msg_view_t *view);
+bool            osbus_msg_view_get_item        (const osbus_msg_view_t *view, int i, osbus_msg_view_t *item);
+bool            osbus_msg_view_get_bool        (const osbus_msg_view_t *view, bool *val);
+bool            osbus_msg_view_get_int         (const osbus_msg_view_t *view, int *val);
+bool            osbus_msg_view_get_int64       (const osbus_msg_view_t *view, int64_t *val);
+bool            osbus_msg_view_get_double      (const osbus_msg_view_t *view, double *val);
+bool            osbus_msg_view_get_string      (const osbus_msg_view_t *view, const char **val); // reference to string
+bool            osbus_msg_view_get_string_fixed(const osbus_msg_view_t *view, char *str, int size);
+bool            osbus_msg_view_get_binary_alloc(const osbus_msg_view_t *view, uint8_t **buf, int *size);
+bool            osbus_msg_view_get_binary_fixed(const osbus_msg_view_t *view, uint8_t *buf, int max_buf_size, int *size);
+
+bool            osbus_msg_view_get_prop             (const osbus_msg_view_t *view, const char *name, osbus_msg_view_t *prop);
+bool            osbus_msg_view_get_prop_bool        (const osbus_msg_view_t *view, const char *name, bool *val);
+bool            osbus_msg_view_get_prop_int         (const osbus_msg_view_t *view, const char *name, int *val);
+bool            osbus_msg_view_get_prop_int64       (const osbus_msg_view_t *view, const char *name, int64_t *val);
+bool            osbus_msg_view_get_prop_double      (const osbus_msg_view_t *view, const char *name, double *val);
+bool            osbus_msg_view_get_prop_string      (const osbus_msg_view_t *view, const char *name, const char **val);
+bool            osbus_msg_view_get_prop_string_fixed(const osbus_msg_view_t *view, const char *name, char *str, int size);
+bool            osbus_msg_view_get_prop_binary_alloc(const osbus_msg_view_t *view, const char *name, uint8_t **buf, int *size);
+bool            osbus_msg_view_get_prop_binary_fixed(const osbus_msg_view_t *view, const char *name, uint8_t *buf, int max_buf_size, int *size);
+
+// ITEM is a osbus_msg_view_t
+#define osbus_msg_view_foreach(VIEW, ITEM) \
+    for ((ITEM).attr = NULL, (ITEM).head = false; osbus_msg_view_next((VIEW), &(ITEM)); )
+
+// streaming builder, writes directly to a blob_buf without an intermediate osbus_msg_t
+// name is required for properties of an object and must be NULL for array items
+#define OSBUS_MSG_BUILDER_MAX_DEPTH 16
+
+typedef struct osbus_msg_builder
+{
+    struct blob_buf *b;
+    void *cookie[OSBUS_MSG_BUILDER_MAX_DEPTH];
+    bool is_array[OSBUS_MSG_BUILDER_MAX_DEPTH];
+    int depth;
+    bool error;
+} osbus_msg_builder_t;
+
+bool            osbus_msg_builder_init        (osbus_msg_builder_t *mb, struct blob_buf *b); // b is (re)initialized
+bool            osbus_msg_builder_open_object (osbus_msg_builder_t *mb, const char *name);
+bool            osbus_msg_builder_open_array  (osbus_msg_builder_t *mb, const char *name);
+bool            osbus_msg_builder_close       (osbus_msg_builder_t *mb);
+bool            osbus_msg_builder_set_null    (osbus_msg_builder_t *mb, const char *name);
+bool            osbus_msg_builder_set_bool    (osbus_msg_builder_t *mb, const char *name, bool val);
+bool            osbus_msg_builder_set_int     (osbus_msg_builder_t *mb, const char *name, int val);
+bool            osbus_msg_builder_set_int64   (osbus_msg_builder_t *mb, const char *name, int64_t val);
+bool            osbus_msg_builder_set_double  (osbus_msg_builder_t *mb, const char *name, double val);
+bool            osbus_msg_builder_set_string  (osbus_msg_builder_t *mb, const char *name, const char *val);
+bool            osbus_msg_builder_set_binary  (osbus_msg_builder_t *mb, const char *name, const uint8_t *buf, int size);
+bool            osbus_msg_builder_finish      (osbus_msg_builder_t *mb); // false on any error or unclosed container
+
 #endif /* OSBUS_DATA_UBUS_H_INCLUDED */
 
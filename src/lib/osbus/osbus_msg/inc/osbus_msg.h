@@ -186,6 +186,7 @@ osbus_msg_t*    osbus_msg_copy(const osbus_msg_t *data);
 bool            osbus_msg_assign(osbus_msg_t *dest, osbus_msg_t *src);
 int             osbus_msg_compare(osbus_msg_t *a, osbus_msg_t *b);
 
+size_t          base64_encode_size(size_t input_size);
 bool            osbus_msg_encode_binary_obj(const osbus_msg_t *data, osbus_msg_t **encoded);
 bool            osbus_msg_decode_binary_obj(const osbus_msg_t *data, osbus_msg_t **decoded);
 
@@ -315,3 +315,483 @@ bool osbus_msg_from_blob_buf(osbus_msg_t **data, struct blob_buf *bb)
 }
 
 
+// views
+
+bool osbus_msg_view_from_blob_attr(osbus_msg_view_t *view, struct blob_attr *attr)
+{
+    if (!view) return false;
+    view->attr = NULL;
+    view->head = false;
+    if (!attr) return false;
+    if (blob_is_extended(attr)) {
+        if (!blobmsg_check_attr(attr, false)) return false;
+    } else {
+        view->head = true;
+    }
+    view->attr = attr;
+    return true;
+}
+
+bool osbus_msg_view_from_blob_buf(osbus_msg_view_t *view, struct blob_buf *bb)
+{
+    if (!bb) return false;
+    return osbus_msg_view_from_blob_attr(view, bb->head);
+}
+
+static void* _osbus_msg_view_data(const osbus_msg_view_t *view, size_t *len)
+{
+    if (view->head) {
+        *len = blob_len(view->attr);
+        return blob_data(view->attr);
+    }
+    *len = blobmsg_data_len(view->attr);
+    return blobmsg_data(view->attr);
+}
+
+bool osbus_msg_view_next(const osbus_msg_view_t *view, osbus_msg_view_t *item)
+{
+    if (!view || !item) return false;
+    if (!osbus_msg_view_is_container(view)) goto end;
+    struct blob_attr *pos;
+    size_t len;
+    char *data = _osbus_msg_view_data(view, &len);
+    char *end = data + len;
+    if (!item->attr) {
+        pos = (struct blob_attr*)data;
+    } else {
+        pos = blob_next(item->attr);
+    }
+    if ((char*)pos < data || (char*)pos + sizeof(struct blob_attr) > end) goto end;
+    if ((char*)pos + blob_pad_len(pos) > end) goto end;
+    if (!blobmsg_check_attr(pos, false)) goto end;
+    item->attr = pos;
+    item->head = false;
+    return true;
+end:
+    item->attr = NULL;
+    item->head = false;
+    return false;
+}
+
+// matches the encoding of osbus_msg_encode_binary_obj()
+static bool _osbus_msg_view_get_binary_data(const osbus_msg_view_t *view, char **s_data)
+{
+    osbus_msg_view_t e;
+    const char *str;
+    bool has_type = false;
+    bool has_enc = false;
+    int num = 0;
+    *s_data = NULL;
+    if (view->head || blobmsg_type(view->attr) != BLOBMSG_TYPE_TABLE) return false;
+    osbus_msg_view_foreach(view, e) {
+        if (++num > 3) return false;
+        if (blobmsg_type(e.attr) != BLOBMSG_TYPE_STRING) return false;
+        str = blobmsg_get_string(e.attr);
+        if (!strcmp(blobmsg_name(e.attr), "#_type")) {
+            if (strcmp(str, "bin") != 0) return false;
+            has_type = true;
+        } else if (!strcmp(blobmsg_name(e.attr), "#_enc")) {
+            if (strcmp(str, "base64") != 0) return false;
+            has_enc = true;
+        } else if (!strcmp(blobmsg_name(e.attr), "#_data")) {
+            *s_data = blobmsg_get_string(e.attr);
+        } else {
+            return false;
+        }
+    }
+    return has_type && has_enc && *s_data;
+}
+
+osbus_msg_type osbus_msg_view_get_type(const osbus_msg_view_t *view)
+{
+    char *s_data;
+    if (!view || !view->attr) return OSBUS_DATA_TYPE_NULL;
+    if (view->head) return OSBUS_DATA_TYPE_OBJECT;
+    if (_osbus_msg_view_get_binary_data(view, &s_data)) return OSBUS_DATA_TYPE_BINARY;
+    return osbus_msg_type_from_blobmsg_type(blobmsg_type(view->attr));
+}
+
+const char* osbus_msg_view_get_name(const osbus_msg_view_t *view)
+{
+    if (!view || !view->attr || view->head) return NULL;
+    return blobmsg_name(view->attr);
+}
+
+bool osbus_msg_view_is_container(const osbus_msg_view_t *view)
+{
+    if (!view || !view->attr) return false;
+    if (view->head) return true;
+    switch (blobmsg_type(view->attr)) {
+        case BLOBMSG_TYPE_TABLE:
+        case BLOBMSG_TYPE_ARRAY:
+            return true;
+        default:
+            return false;
+    }
+}
+
+int osbus_msg_view_item_count(const osbus_msg_view_t *view)
+{
+    osbus_msg_view_t e;
+    int num = 0;
+    osbus_msg_view_foreach(view, e) {
+        num++;
+    }
+    return num;
+}
+
+bool osbus_msg_view_get_item(const osbus_msg_view_t *view, int i, osbus_msg_view_t *item)
+{
+    if (!item) return false;
+    if (i < 0) i = -1; // not found
+    osbus_msg_view_foreach(view, *item) {
+        if (i-- == 0) return true;
+    }
+    return false;
+}
+
+// linear scan, first match
+bool osbus_msg_view_get_prop(const osbus_msg_view_t *view, const char *name, osbus_msg_view_t *prop)
+{
+    if (!name || !prop) return false;
+    if (!view || !view->attr) return false;
+    if (!view->head && blobmsg_type(view->attr) != BLOBMSG_TYPE_TABLE) return false;
+    osbus_msg_view_foreach(view, *prop) {
+        if (!strcmp(blobmsg_name(prop->attr), name)) return true;
+    }
+    return false;
+}
+
+static inline bool _osbus_msg_view_is_value(const osbus_msg_view_t *view)
+{
+    return view && view->attr && !view->head;
+}
+
+bool osbus_msg_view_get_bool(const osbus_msg_view_t *view, bool *val)
+{
+    if (!val) return false;
+    *val = false;
+    if (!_osbus_msg_view_is_value(view)) return false;
+    if (blobmsg_type(view->attr) != BLOBMSG_TYPE_BOOL) return false;
+    *val = blobmsg_get_bool(view->attr);
+    return true;
+}
+
+// same implicit casts as osbus_msg_get_int64()
+bool osbus_msg_view_get_int64(const osbus_msg_view_t *view, int64_t *val)
+{
+    if (!val) return false;
+    *val = 0;
+    if (!_osbus_msg_view_is_value(view)) return false;
+    switch (blobmsg_type(view->attr)) {
+        case BLOBMSG_TYPE_INT16:  *val = (int)blobmsg_get_u16(view->attr); break;
+        case BLOBMSG_TYPE_INT32:  *val = (int)blobmsg_get_u32(view->attr); break;
+        case BLOBMSG_TYPE_INT64:  *val = (int64_t)blobmsg_get_u64(view->attr); break;
+        case BLOBMSG_TYPE_DOUBLE: *val = blobmsg_get_double(view->attr); break;
+        default: return false;
+    }
+    return true;
+}
+
+bool osbus_msg_view_get_int(const osbus_msg_view_t *view, int *val)
+{
+    int64_t v64;
+    if (!val) return false;
+    *val = 0;
+    if (!osbus_msg_view_get_int64(view, &v64)) return false;
+    *val = v64;
+    return true;
+}
+
+bool osbus_msg_view_get_double(const osbus_msg_view_t *view, double *val)
+{
+    int64_t v64;
+    if (!val) return false;
+    *val = 0;
+    if (!_osbus_msg_view_is_value(view)) return false;
+    if (blobmsg_type(view->attr) == BLOBMSG_TYPE_DOUBLE) {
+        *val = blobmsg_get_double(view->attr);
+        return true;
+    }
+    if (!osbus_msg_view_get_int64(view, &v64)) return false;
+    *val = v64;
+    return true;
+}
+
+// returns a reference to string held by the blob buffer, must not be freed
+bool osbus_msg_view_get_string(const osbus_msg_view_t *view, const char **val)
+{
+    if (!val) return false;
+    *val = NULL;
+    if (!_osbus_msg_view_is_value(view)) return false;
+    if (blobmsg_type(view->attr) != BLOBMSG_TYPE_STRING) return false;
+    *val = blobmsg_get_string(view->attr);
+    return true;
+}
+
+bool osbus_msg_view_get_string_fixed(const osbus_msg_view_t *view, char *str, int size)
+{
+    const char *tmp_str = NULL;
+    *str = 0;
+    if (!osbus_msg_view_get_string(view, &tmp_str)) return false;
+    if (strscpy(str, tmp_str ?: "", size) < 0) return false;
+    return true;
+}
+
+// binary is transported base64 encoded, so it has to be decoded to a buffer
+bool osbus_msg_view_get_binary_fixed(const osbus_msg_view_t *view, uint8_t *buf, int max_buf_size, int *size)
+{
+    char *s_data = NULL;
+    ssize_t len;
+    if (!size) return false;
+    *size = 0;
+    if (!_osbus_msg_view_is_value(view)) return false;
+    if (!_osbus_msg_view_get_binary_data(view, &s_data)) return false;
+    len = base64_decode(buf, max_buf_size, s_data);
+    if (len < 0) return false;
+    *size = len;
+    return true;
+}
+
+bool osbus_msg_view_get_binary_alloc(const osbus_msg_view_t *view, uint8_t **buf, int *size)
+{
+    char *s_data = NULL;
+    int max_size;
+    if (!buf || !size) return false;
+    *buf = NULL;
+    *size = 0;
+    if (!_osbus_msg_view_is_value(view)) return false;
+    if (!_osbus_msg_view_get_binary_data(view, &s_data)) return false;
+    max_size = strlen(s_data);
+    if (max_size == 0) return true;
+    *buf = MALLOC(max_size);
+    if (!osbus_msg_view_get_binary_fixed(view, *buf, max_size, size)) {
+        FREE(*buf);
+        *buf = NULL;
+        return false;
+    }
+    return true;
+}
+
+#define _OSBUS_VIEW_GET_PROP(_METHOD, ...) \
+    osbus_msg_view_t prop; \
+    if (!osbus_msg_view_get_prop(view, name, &prop)) prop.attr = NULL; \
+    return _METHOD(&prop, __VA_ARGS__)
+
+bool osbus_msg_view_get_prop_bool(const osbus_msg_view_t *view, const char *name, bool *val)
+{
+    _OSBUS_VIEW_GET_PROP(osbus_msg_view_get_bool, val);
+}
+
+bool osbus_msg_view_get_prop_int(const osbus_msg_view_t *view, const char *name, int *val)
+{
+    _OSBUS_VIEW_GET_PROP(osbus_msg_view_get_int, val);
+}
+
+bool osbus_msg_view_get_prop_int64(const osbus_msg_view_t *view, const char *name, int64_t *val)
+{
+    _OSBUS_VIEW_GET_PROP(osbus_msg_view_get_int64, val);
+}
+
+bool osbus_msg_view_get_prop_double(const osbus_msg_view_t *view, const char *name, double *val)
+{
+    _OSBUS_VIEW_GET_PROP(osbus_msg_view_get_double, val);
+}
+
+bool osbus_msg_view_get_prop_string(const osbus_msg_view_t *view, const char *name, const char **val)
+{
+    _OSBUS_VIEW_GET_PROP(osbus_msg_view_get_string, val);
+}
+
+bool osbus_msg_view_get_prop_string_fixed(const osbus_msg_view_t *view, const char *name, char *str, int size)
+{
+    _OSBUS_VIEW_GET_PROP(osbus_msg_view_get_string_fixed, str, size);
+}
+
+bool osbus_msg_view_get_prop_binary_alloc(const osbus_msg_view_t *view, const char *name, uint8_t **buf, int *size)
+{
+    _OSBUS_VIEW_GET_PROP(osbus_msg_view_get_binary_alloc, buf, size);
+}
+
+bool osbus_msg_view_get_prop_binary_fixed(const osbus_msg_view_t *view, const char *name, uint8_t *buf, int max_buf_size, int *size)
+{
+    _OSBUS_VIEW_GET_PROP(osbus_msg_view_get_binary_fixed, buf, max_buf_size, size);
+}
+
+// materialize a view to a newly allocated osbus_msg_t
+bool osbus_msg_view_to_msg(const osbus_msg_view_t *view, osbus_msg_t **data)
+{
+    if (!view || !view->attr || !data) return false;
+    bool retval = false;
+    osbus_msg_t *d = NULL;
+
+    *data = NULL;
+    if (view->head) {
+        return osbus_msg_from_blob_attr(data, view->attr);
+    }
+    // decode into a temporary array and detach the single item
+    d = osbus_msg_new_array();
+    if (!d) goto out;
+    if (!osbus_msg_add_blob_attr_item(d, view->attr)) goto out;
+    if (osbus_msg_item_count(d) != 1) goto out;
+    *data = d->val.list[0];
+    d->val.list[0] = NULL;
+    d->num = 0;
+    retval = true;
+out:
+    osbus_msg_free(d);
+    return retval;
+}
+
+// builder
+
+bool osbus_msg_builder_init(osbus_msg_builder_t *mb, struct blob_buf *b)
+{
+    if (!mb || !b) return false;
+    MEMZERO(*mb);
+    mb->b = b;
+    if (blob_buf_init(b, 0) < 0) {
+        mb->error = true;
+        return false;
+    }
+    return true;
+}
+
+static bool _osbus_msg_builder_check(osbus_msg_builder_t *mb, const char *name)
+{
+    if (!mb) return false;
+    if (mb->error || !mb->b) return false;
+    bool in_array = mb->depth > 0 && mb->is_array[mb->depth - 1];
+    if (in_array ? name != NULL : name == NULL) {
+        LOGE("%s: %s name '%s' depth %d", __func__, in_array ? "array" : "object", name ?: "", mb->depth);
+        mb->error = true;
+        return false;
+    }
+    return true;
+}
+
+static bool _osbus_msg_builder_result(osbus_msg_builder_t *mb, int rc)
+{
+    if (rc < 0) mb->error = true;
+    return !mb->error;
+}
+
+static bool _osbus_msg_builder_open(osbus_msg_builder_t *mb, const char *name, bool is_array)
+{
+    void *cookie;
+    if (!_osbus_msg_builder_check(mb, name)) return false;
+    if (mb->depth >= OSBUS_MSG_BUILDER_MAX_DEPTH) {
+        LOGE("%s: max depth %d", __func__, mb->depth);
+        mb->error = true;
+        return false;
+    }
+    if (is_array) {
+        cookie = blobmsg_open_array(mb->b, name);
+    } else {
+        cookie = blobmsg_open_table(mb->b, name);
+    }
+    if (!cookie) {
+        mb->error = true;
+        return false;
+    }
+    mb->cookie[mb->depth] = cookie;
+    mb->is_array[mb->depth] = is_array;
+    mb->depth++;
+    return true;
+}
+
+bool osbus_msg_builder_open_object(osbus_msg_builder_t *mb, const char *name)
+{
+    return _osbus_msg_builder_open(mb, name, false);
+}
+
+bool osbus_msg_builder_open_array(osbus_msg_builder_t *mb, const char *name)
+{
+    return _osbus_msg_builder_open(mb, name, true);
+}
+
+bool osbus_msg_builder_close(osbus_msg_builder_t *mb)
+{
+    if (!mb || mb->error) return false;
+    if (mb->depth <= 0) {
+        mb->error = true;
+        return false;
+    }
+    mb->depth--;
+    if (mb->is_array[mb->depth]) {
+        blobmsg_close_array(mb->b, mb->cookie[mb->depth]);
+    } else {
+        blobmsg_close_table(mb->b, mb->cookie[mb->depth]);
+    }
+    return true;
+}
+
+bool osbus_msg_builder_set_null(osbus_msg_builder_t *mb, const char *name)
+{
+    if (!_osbus_msg_builder_check(mb, name)) return false;
+    return _osbus_msg_builder_result(mb, blobmsg_add_field(mb->b, BLOBMSG_TYPE_UNSPEC, name, NULL, 0));
+}
+
+bool osbus_msg_builder_set_bool(osbus_msg_builder_t *mb, const char *name, bool val)
+{
+    if (!_osbus_msg_builder_check(mb, name)) return false;
+    return _osbus_msg_builder_result(mb, blobmsg_add_u8(mb->b, name, val));
+}
+
+bool osbus_msg_builder_set_int(osbus_msg_builder_t *mb, const char *name, int val)
+{
+    if (!_osbus_msg_builder_check(mb, name)) return false;
+    return _osbus_msg_builder_result(mb, blobmsg_add_u32(mb->b, name, val));
+}
+
+bool osbus_msg_builder_set_int64(osbus_msg_builder_t *mb, const char *name, int64_t val)
+{
+    if (!_osbus_msg_builder_check(mb, name)) return false;
+    return _osbus_msg_builder_result(mb, blobmsg_add_u64(mb->b, name, val));
+}
+
+bool osbus_msg_builder_set_double(osbus_msg_builder_t *mb, const char *name, double val)
+{
+    if (!_osbus_msg_builder_check(mb, name)) return false;
+    return _osbus_msg_builder_result(mb, blobmsg_add_double(mb->b, name, val));
+}
+
+bool osbus_msg_builder_set_string(osbus_msg_builder_t *mb, const char *name, const char *val)
+{
+    if (!_osbus_msg_builder_check(mb, name)) return false;
+    return _osbus_msg_builder_result(mb, blobmsg_add_string(mb->b, name, val ?: ""));
+}
+
+// same encoding as osbus_msg_encode_binary_obj(),
+// base64 is written directly into the blob buffer
+bool osbus_msg_builder_set_binary(osbus_msg_builder_t *mb, const char *name, const uint8_t *buf, int size)
+{
+    char *estr;
+    int esize;
+    if (size < 0 || (size > 0 && !buf)) {
+        if (mb) mb->error = true;
+        return false;
+    }
+    if (!_osbus_msg_builder_open(mb, name, false)) return false;
+    if (!osbus_msg_builder_set_string(mb, "#_type", "bin")) return false;
+    if (!osbus_msg_builder_set_string(mb, "#_enc", "base64")) return false;
+    esize = base64_encode_size(size);
+    estr = blobmsg_alloc_string_buffer(mb->b, "#_data", esize);
+    if (!estr || base64_encode(estr, esize, (void*)buf, size) < 0) {
+        mb->error = true;
+        return false;
+    }
+    blobmsg_add_string_buffer(mb->b);
+    return osbus_msg_builder_close(mb);
+}
+
+bool osbus_msg_builder_finish(osbus_msg_builder_t *mb)
+{
+    if (!mb || mb->error) return false;
+    if (mb->depth != 0) {
+        LOGE("%s: unclosed depth %d", __func__, mb->depth);
+        mb->error = true;
+        return false;
+    }
+    return true;
+}
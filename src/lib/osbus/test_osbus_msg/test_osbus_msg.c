@@ -36,6 +36,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "kconfig.h"
 #include "osbus_msg.h"
+#include "os_time.h"
 #include "log.h"
 #include "json_util.h"
 #include "unity.h"
@@ -273,6 +274,305 @@ out:
 #endif
 }
 
+void data_test_ubus_view(void)
+{
+#ifdef CONFIG_OSBUS_UBUS
+    osbus_msg_t *d = g_msg;
+    osbus_msg_t *d2 = NULL;
+    struct blob_buf *b = NULL;
+    osbus_msg_view_t v, e, a;
+    const char *s = NULL;
+    int i = 0;
+    int64_t i64 = 0;
+    double dbl = 0;
+    bool bval = false;
+    uint8_t bin[16];
+    int size_bin = 0;
+    int n;
+    bool res;
+
+    LOGN("\n\n === data_view_from_blob_buf === \n\n");
+    res = osbus_msg_to_blob_buf(d, &b);
+    TEST_ASSERT_TRUE(res && b != NULL);
+    if (!b) return;
+    res = osbus_msg_view_from_blob_buf(&v, b);
+    TEST_ASSERT_TRUE(res);
+    TEST_ASSERT_EQUAL(OSBUS_DATA_TYPE_OBJECT, osbus_msg_view_get_type(&v));
+    TEST_ASSERT_EQUAL(osbus_msg_item_count(d), osbus_msg_view_item_count(&v));
+
+    TEST_ASSERT_TRUE(osbus_msg_view_get_prop_string(&v, "prop_str", &s));
+    TEST_ASSERT_EQUAL_STRING("Abc", s);
+    // string is referenced in place
+    TEST_ASSERT_TRUE((char*)s > (char*)b->head && (char*)s < (char*)b->head + blob_raw_len(b->head));
+    TEST_ASSERT_TRUE(osbus_msg_view_get_prop_int(&v, "prop_int", &i));
+    TEST_ASSERT_EQUAL_INT(55, i);
+    TEST_ASSERT_TRUE(osbus_msg_view_get_prop_int64(&v, "prop_i64", &i64));
+    TEST_ASSERT_TRUE(i64 == 0x7FFFFFFFFFFFFFFF);
+    TEST_ASSERT_TRUE(osbus_msg_view_get_prop_double(&v, "prop_dbl2", &dbl));
+    TEST_ASSERT_TRUE(dbl == M_PI);
+    TEST_ASSERT_TRUE(osbus_msg_view_get_prop_double(&v, "prop_int", &dbl));
+    TEST_ASSERT_TRUE(dbl == 55);
+    TEST_ASSERT_TRUE(osbus_msg_view_get_prop_bool(&v, "prop_bool", &bval));
+    TEST_ASSERT_TRUE(bval);
+    TEST_ASSERT_FALSE(osbus_msg_view_get_prop_int(&v, "prop_str", &i));
+    TEST_ASSERT_FALSE(osbus_msg_view_get_prop_string(&v, "no_such_prop", &s));
+    TEST_ASSERT_NULL(s);
+
+    TEST_ASSERT_TRUE(osbus_msg_view_get_prop(&v, "prop_null", &e));
+    TEST_ASSERT_EQUAL(OSBUS_DATA_TYPE_NULL, osbus_msg_view_get_type(&e));
+
+    TEST_ASSERT_TRUE(osbus_msg_view_get_prop(&v, "prop_bin", &e));
+    TEST_ASSERT_EQUAL(OSBUS_DATA_TYPE_BINARY, osbus_msg_view_get_type(&e));
+    TEST_ASSERT_TRUE(osbus_msg_view_get_prop_binary_fixed(&v, "prop_bin", bin, sizeof(bin), &size_bin));
+    TEST_ASSERT_EQUAL_INT(7, size_bin);
+    TEST_ASSERT_EQUAL_MEMORY("sample\n", bin, 7);
+    TEST_ASSERT_TRUE(osbus_msg_view_get_prop_binary_fixed(&v, "empty_bin", bin, sizeof(bin), &size_bin));
+    TEST_ASSERT_EQUAL_INT(0, size_bin);
+
+    TEST_ASSERT_TRUE(osbus_msg_view_get_prop(&v, "prop_array", &a));
+    TEST_ASSERT_EQUAL(OSBUS_DATA_TYPE_ARRAY, osbus_msg_view_get_type(&a));
+    TEST_ASSERT_EQUAL_INT(3, osbus_msg_view_item_count(&a));
+    TEST_ASSERT_TRUE(osbus_msg_view_get_item(&a, 2, &e));
+    TEST_ASSERT_TRUE(osbus_msg_view_get_int(&e, &i));
+    TEST_ASSERT_EQUAL_INT(66, i);
+    TEST_ASSERT_FALSE(osbus_msg_view_get_item(&a, 3, &e));
+    TEST_ASSERT_FALSE(osbus_msg_view_get_prop(&a, "x", &e));
+
+    TEST_ASSERT_TRUE(osbus_msg_view_get_prop(&v, "prop_object", &a));
+    TEST_ASSERT_TRUE(osbus_msg_view_get_prop_string(&a, "pb", &s));
+    TEST_ASSERT_EQUAL_STRING("j", s);
+    TEST_ASSERT_TRUE(osbus_msg_view_get_prop(&v, "empty_object", &a));
+    TEST_ASSERT_EQUAL_INT(0, osbus_msg_view_item_count(&a));
+
+    n = 0;
+    osbus_msg_view_foreach(&v, e) {
+        TEST_ASSERT_EQUAL_STRING(osbus_msg_get_name(osbus_msg_get_item(d, n)), osbus_msg_view_get_name(&e));
+        TEST_ASSERT_EQUAL(osbus_msg_get_type(osbus_msg_get_item(d, n)), osbus_msg_view_get_type(&e));
+        n++;
+    }
+    TEST_ASSERT_EQUAL_INT(osbus_msg_item_count(d), n);
+
+    res = osbus_msg_view_to_msg(&v, &d2);
+    TEST_ASSERT_TRUE(res && d2 != NULL);
+    TEST_ASSERT_TRUE(osbus_msg_compare(d, d2) == 0);
+    osbus_msg_free(d2);
+    d2 = NULL;
+
+    TEST_ASSERT_TRUE(osbus_msg_view_get_prop(&v, "prop_object", &a));
+    res = osbus_msg_view_to_msg(&a, &d2);
+    TEST_ASSERT_TRUE(res && d2 != NULL);
+    TEST_ASSERT_TRUE(osbus_msg_compare(osbus_msg_get_prop(d, "prop_object"), d2) == 0);
+    osbus_msg_free(d2);
+
+    osbus_msg_free_blob_buf(b);
+#endif
+}
+
+void data_test_ubus_builder(void)
+{
+#ifdef CONFIG_OSBUS_UBUS
+    osbus_msg_t *d = g_msg;
+    osbus_msg_t *d2 = NULL;
+    struct blob_buf b = {0};
+    osbus_msg_builder_t mb;
+    bool res = true;
+
+    LOGN("\n\n === data_builder === \n\n");
+    // same content as data_test_basic
+    res = res && osbus_msg_builder_init(&mb, &b);
+    res = res && osbus_msg_builder_set_string(&mb, "prop_str", "Abc");
+    res = res && osbus_msg_builder_set_int(&mb, "prop_int", 55);
+    res = res && osbus_msg_builder_set_int(&mb, "prop_uint", UINT_MAX);
+    res = res && osbus_msg_builder_set_int64(&mb, "prop_i64", 0x7FFFFFFFFFFFFFFF);
+    res = res && osbus_msg_builder_set_int64(&mb, "prop_u64", 0xFFFFFFFFFFFFFFFF);
+    res = res && osbus_msg_builder_set_double(&mb, "prop_dbl1", 1);
+    res = res && osbus_msg_builder_set_double(&mb, "prop_dbl2", M_PI);
+    res = res && osbus_msg_builder_set_double(&mb, "prop_dbl3", DBL_MAX);
+    res = res && osbus_msg_builder_set_null(&mb, "prop_null");
+    res = res && osbus_msg_builder_set_bool(&mb, "prop_bool", true);
+    res = res && osbus_msg_builder_open_array(&mb, "prop_array");
+    res = res && osbus_msg_builder_set_string(&mb, NULL, "x");
+    res = res && osbus_msg_builder_set_string(&mb, NULL, "y");
+    res = res && osbus_msg_builder_set_int(&mb, NULL, 66);
+    res = res && osbus_msg_builder_close(&mb);
+    res = res && osbus_msg_builder_open_object(&mb, "prop_object");
+    res = res && osbus_msg_builder_set_string(&mb, "pa", "i");
+    res = res && osbus_msg_builder_set_string(&mb, "pb", "j");
+    res = res && osbus_msg_builder_set_int(&mb, "pn", 77);
+    res = res && osbus_msg_builder_close(&mb);
+    res = res && osbus_msg_builder_open_array(&mb, "empty_array");
+    res = res && osbus_msg_builder_close(&mb);
+    res = res && osbus_msg_builder_open_object(&mb, "empty_object");
+    res = res && osbus_msg_builder_close(&mb);
+    res = res && osbus_msg_builder_set_binary(&mb, "prop_bin", (uint8_t*)"sample\n", 7);
+    res = res && osbus_msg_builder_set_binary(&mb, "empty_bin", NULL, 0);
+    res = res && osbus_msg_builder_finish(&mb);
+    TEST_ASSERT_TRUE(res);
+
+    res = osbus_msg_from_blob_buf(&d2, &b);
+    TEST_ASSERT_TRUE(res && d2 != NULL);
+    TEST_ASSERT_TRUE(osbus_msg_compare(d, d2) == 0);
+    osbus_msg_free(d2);
+
+    // errors are sticky
+    TEST_ASSERT_TRUE(osbus_msg_builder_init(&mb, &b));
+    TEST_ASSERT_FALSE(osbus_msg_builder_set_int(&mb, NULL, 1));
+    TEST_ASSERT_FALSE(osbus_msg_builder_set_int(&mb, "a", 1));
+    TEST_ASSERT_FALSE(osbus_msg_builder_finish(&mb));
+    TEST_ASSERT_TRUE(osbus_msg_builder_init(&mb, &b));
+    TEST_ASSERT_TRUE(osbus_msg_builder_open_array(&mb, "a"));
+    TEST_ASSERT_FALSE(osbus_msg_builder_set_int(&mb, "a", 1));
+    TEST_ASSERT_TRUE(osbus_msg_builder_init(&mb, &b));
+    TEST_ASSERT_TRUE(osbus_msg_builder_open_object(&mb, "a"));
+    TEST_ASSERT_FALSE(osbus_msg_builder_finish(&mb));
+    TEST_ASSERT_TRUE(osbus_msg_builder_init(&mb, &b));
+    TEST_ASSERT_FALSE(osbus_msg_builder_close(&mb));
+
+    blob_buf_free(&b);
+#endif
+}
+
+#ifdef CONFIG_OSBUS_UBUS
+
+#define DATA_BENCH_ITER  20000
+#define DATA_BENCH_ITEMS 16
+
+// a typical stats event
+static osbus_msg_t* data_bench_msg(void)
+{
+    osbus_msg_t *d = osbus_msg_new_object();
+    osbus_msg_t *arr;
+    osbus_msg_t *e;
+    int i;
+    osbus_msg_set_prop_string(d, "ifname", "wl0.1");
+    osbus_msg_set_prop_int64(d, "timestamp", 1700000000000);
+    arr = osbus_msg_set_prop_array(d, "clients");
+    for (i = 0; i < DATA_BENCH_ITEMS; i++) {
+        e = osbus_msg_add_item_object(arr);
+        osbus_msg_set_prop_string(e, "mac", "00:11:22:33:44:55");
+        osbus_msg_set_prop_int(e, "rssi", -40 - i);
+        osbus_msg_set_prop_int64(e, "rx_bytes", 1000000 + i);
+        osbus_msg_set_prop_int64(e, "tx_bytes", 2000000 + i);
+        osbus_msg_set_prop_bool(e, "connected", true);
+    }
+    return d;
+}
+
+static bool data_bench_build(osbus_msg_builder_t *mb, struct blob_buf *b)
+{
+    int i;
+    osbus_msg_builder_init(mb, b);
+    osbus_msg_builder_set_string(mb, "ifname", "wl0.1");
+    osbus_msg_builder_set_int64(mb, "timestamp", 1700000000000);
+    osbus_msg_builder_open_array(mb, "clients");
+    for (i = 0; i < DATA_BENCH_ITEMS; i++) {
+        osbus_msg_builder_open_object(mb, NULL);
+        osbus_msg_builder_set_string(mb, "mac", "00:11:22:33:44:55");
+        osbus_msg_builder_set_int(mb, "rssi", -40 - i);
+        osbus_msg_builder_set_int64(mb, "rx_bytes", 1000000 + i);
+        osbus_msg_builder_set_int64(mb, "tx_bytes", 2000000 + i);
+        osbus_msg_builder_set_bool(mb, "connected", true);
+        osbus_msg_builder_close(mb);
+    }
+    osbus_msg_builder_close(mb);
+    return osbus_msg_builder_finish(mb);
+}
+
+static int64_t data_bench_sum_dom(osbus_msg_t *d)
+{
+    osbus_msg_t *arr = osbus_msg_get_prop(d, "clients");
+    osbus_msg_t *e;
+    int64_t sum = 0;
+    int64_t rx;
+    osbus_msg_foreach(arr, e) {
+        if (osbus_msg_get_prop_int64(e, "rx_bytes", &rx)) sum += rx;
+    }
+    return sum;
+}
+
+static int64_t data_bench_sum_view(osbus_msg_view_t *v)
+{
+    osbus_msg_view_t arr;
+    osbus_msg_view_t e;
+    int64_t sum = 0;
+    int64_t rx;
+    if (!osbus_msg_view_get_prop(v, "clients", &arr)) return 0;
+    osbus_msg_view_foreach(&arr, e) {
+        if (osbus_msg_view_get_prop_int64(&e, "rx_bytes", &rx)) sum += rx;
+    }
+    return sum;
+}
+
+#endif
+
+// encode/decode rates, DOM conversion vs. builder and view
+void data_test_ubus_bench(void)
+{
+#ifdef CONFIG_OSBUS_UBUS
+    osbus_msg_t *d = data_bench_msg();
+    osbus_msg_t *d2 = NULL;
+    struct blob_buf *bb = NULL;
+    struct blob_buf b = {0};
+    osbus_msg_builder_t mb;
+    osbus_msg_view_t v;
+    int64_t sum_dom = 0;
+    int64_t sum_view = 0;
+    double t0, t_enc_dom, t_enc_build, t_dec_dom, t_dec_view;
+    bool res = true;
+    int i;
+
+    LOGN("\n\n === data_ubus_bench === \n\n");
+    t0 = clock_mono_double();
+    for (i = 0; i < DATA_BENCH_ITER && res; i++) {
+        res = osbus_msg_to_blob_buf(d, &bb);
+        osbus_msg_free_blob_buf(bb);
+    }
+    t_enc_dom = clock_mono_double() - t0;
+    TEST_ASSERT_TRUE(res);
+
+    t0 = clock_mono_double();
+    for (i = 0; i < DATA_BENCH_ITER && res; i++) {
+        res = data_bench_build(&mb, &b);
+    }
+    t_enc_build = clock_mono_double() - t0;
+    TEST_ASSERT_TRUE(res);
+
+    // both encoders produce the same message
+    res = osbus_msg_from_blob_buf(&d2, &b);
+    TEST_ASSERT_TRUE(res);
+    TEST_ASSERT_TRUE(osbus_msg_compare(d, d2) == 0);
+    osbus_msg_free(d2);
+    d2 = NULL;
+
+    t0 = clock_mono_double();
+    for (i = 0; i < DATA_BENCH_ITER && res; i++) {
+        res = osbus_msg_from_blob_buf(&d2, &b);
+        sum_dom += data_bench_sum_dom(d2);
+        osbus_msg_free(d2);
+    }
+    t_dec_dom = clock_mono_double() - t0;
+    TEST_ASSERT_TRUE(res);
+
+    t0 = clock_mono_double();
+    for (i = 0; i < DATA_BENCH_ITER && res; i++) {
+        res = osbus_msg_view_from_blob_buf(&v, &b);
+        sum_view += data_bench_sum_view(&v);
+    }
+    t_dec_view = clock_mono_double() - t0;
+    TEST_ASSERT_TRUE(res);
+    TEST_ASSERT_TRUE(sum_dom == sum_view);
+
+    LOGN("%d msgs, %d items, %d bytes\n", DATA_BENCH_ITER, DATA_BENCH_ITEMS, (int)blob_raw_len(b.head));
+    LOGN("encode dom:     %10.0f msg/s\n", DATA_BENCH_ITER / (t_enc_dom ?: 1e-9));
+    LOGN("encode builder: %10.0f msg/s\n", DATA_BENCH_ITER / (t_enc_build ?: 1e-9));
+    LOGN("decode dom:     %10.0f msg/s\n", DATA_BENCH_ITER / (t_dec_dom ?: 1e-9));
+    LOGN("decode view:    %10.0f msg/s\n", DATA_BENCH_ITER / (t_dec_view ?: 1e-9));
+
+    blob_buf_free(&b);
+    osbus_msg_free(d);
+#endif
+}
+
 void data_test_rbus(void)
 {
 #ifdef CONFIG_OSBUS_RBUS
@@ -358,6 +658,9 @@ void data_test(void)
     RUN_TEST(data_test_basic);
     RUN_TEST(data_test_json);
     RUN_TEST(data_test_ubus);
+    RUN_TEST(data_test_ubus_view);
+    RUN_TEST(data_test_ubus_builder);
+    RUN_TEST(data_test_ubus_bench);
     RUN_TEST(data_test_rbus);
     RUN_TEST(data_test_util);
     osbus_msg_free(g_msg);
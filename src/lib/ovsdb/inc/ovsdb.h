@@ -33,6 +33,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "ds_tree.h"
 #include "c_tricks.h"
+#include "pjs_stream.h"
 
 /* Generate C-headers from PJS defines */
 #include "ovsdb_jsonrpc.pjs.h"
@@ -132,6 +133,21 @@ typedef void json_rpc_response_t(int id, bool is_error, json_t *js, void * data)
 
 typedef void ovsdb_update_process_t(int id, json_t *js, void * data);
 
+/*
+ * Streaming variant of ovsdb_update_process_t, @p ps is positioned at the
+ * update object (the 2nd element of "params"). The handler returns false
+ * if it declines the update without consuming the stream, in which case
+ * the message is parsed using jansson and passed to ovsdb_update_process_t.
+ */
+typedef bool ovsdb_update_stream_t(int id, struct pjs_stream *ps, void * data);
+
+/*
+ * Called after the connection to OVSDB was re-established; the handler must
+ * re-issue its monitor request. Returns false if the monitor cannot be
+ * resumed.
+ */
+typedef bool ovsdb_update_resume_t(int id, void * data);
+
 /*
  * Supported methods
  */
@@ -141,7 +157,9 @@ typedef enum
     MT_MONITOR,
     MT_MONITOR_CANCEL,
     MT_TRANS,
-    MT_GET_SCHEMA
+    MT_GET_SCHEMA,
+    MT_MONITOR_COND,
+    MT_MONITOR_COND_SINCE
 }ovsdb_mt_t;
 
 
@@ -200,6 +218,12 @@ ovsdb_col_t;
 
 #define OMT_ALL         (OMT_INITIAL | OMT_INSERT | OMT_DELETE | OMT_MODIFY)
 
+/*
+ * Transaction id used with monitor_cond_since when no transaction was seen yet
+ */
+#define OVSDB_TXN_ID_NONE   "00000000-0000-0000-0000-000000000000"
+#define OVSDB_TXN_ID_SZ     40
+
 
 /*
  * Printing UUIDs utilities
@@ -302,6 +326,26 @@ bool OVSDB_VA_DECL(ovsdb_monit_call,
         char *table,
         int mon_flags);
 
+/*
+ * Create a single <monitor-request> object for the monitor methods; @p where
+ * is an optional condition (reference is stolen) and is valid only with
+ * MT_MONITOR_COND and MT_MONITOR_COND_SINCE
+ */
+json_t *ovsdb_monit_request_argv(int mon_flags, json_t *where, int argc, char *argv[]);
+
+/*
+ * Send a monitor request using method @p mt (MT_MONITOR, MT_MONITOR_COND or
+ * MT_MONITOR_COND_SINCE); @p jreqs is an object that maps table names to
+ * monitor requests. @p last_txn is the last transaction id seen and is used
+ * only with MT_MONITOR_COND_SINCE, NULL requests all rows.
+ */
+bool ovsdb_monit_req_call(json_rpc_response_t *cb,
+        void *data,
+        ovsdb_mt_t mt,
+        int monid,
+        json_t *jreqs,
+        const char *last_txn);
+
 /* Cancel a monitor request */
 bool ovsdb_monitor_cancel_call(json_rpc_response_t *callback, void *data, int monid, const char *table);
 
@@ -462,6 +506,8 @@ int ovsdb_get_jsonrpc_id(void);
 int ovsdb_register_update_cb(ovsdb_update_process_t *fn, void *data);
 int ovsdb_unregister_update_cb(int mon_id);
 bool ovsdb_change_update_cb(int mon_id, ovsdb_update_process_t *fn, void *data);
+bool ovsdb_set_update_stream_cb(int mon_id, ovsdb_update_stream_t *fn);
+bool ovsdb_set_update_resume_cb(int mon_id, ovsdb_update_resume_t *fn);
 
 /*
  * Global list of JSON-RPC handlers
@@ -481,6 +527,8 @@ struct rpc_update_handler
 {
     int                     rrh_id;                     /**< Response ID */
     ovsdb_update_process_t *rrh_callback;               /**< Callback   */
+    ovsdb_update_stream_t  *rrh_stream;                 /**< Streaming callback, optional */
+    ovsdb_update_resume_t  *rrh_resume;                 /**< Resume after reconnect, optional */
     void                   *data;                       /**< User data  */
     ds_tree_node_t          rrh_node;                   /**< Node structure */
 };
@@ -74,5 +74,84 @@ void* ovsdb_cache_get_by_key2(ovsdb_table_t *table, const char *key2, void *reco
 int ovsdb_cache_upsert(ovsdb_table_t *table, void *record);
 int ovsdb_cache_upsert_get_uuid(ovsdb_table_t *table, void *record, ovs_uuid_t *uuid);
 int ovsdb_cache_pre_fetch(ovsdb_table_t *table, char *key);
+void ovsdb_cache_fini(ovsdb_table_t *table);
+
+// ovsdb cache secondary indexes
+//
+// A secondary index is a hash of the values of a single column and is
+// maintained on every cache insert, update and delete. Basic and set
+// columns of any type can be indexed; each element of a set column is
+// indexed separately, so a row can be found by any of its set values.
+//
+// An index can be added before or after the table is monitored, the rows
+// already in the cache are indexed when it is added. The key and key2
+// columns of a table are indexed automatically by ovsdb_cache_monitor*(),
+// ovsdb_cache_find_*_by_key*() use these indexes when present.
+//
+// For string and uuid columns the lookup key is a C string, for other
+// columns it is a pointer to a value of the column type (int, bool,
+// int64_t or double).
+//
+// Example:
+//
+//      OVSDB_CACHE_INDEX(Wifi_VIF_Config, bridge, false);
+//      ...
+//      ovsdb_cache_index_foreach(&table_Wifi_VIF_Config, "bridge", "br-home", iter, row)
+//      {
+//          struct schema_Wifi_VIF_Config *vconf = (void *)row->record;
+//          ...
+//      }
+
+struct ovsdb_cache_index_entry;
+
+struct ovsdb_cache_index
+{
+    ds_dlist_node_t                 node;
+    char                            column[OVSDB_TABLE_KEY_SIZE];
+    const struct pjs_desc_field     *field;
+    bool                            unique; // warn on duplicate values
+    struct ovsdb_cache_index_entry  **buckets;
+    unsigned                        nbuckets; // power of 2
+    unsigned                        count; // number of indexed values
+};
+
+typedef struct ovsdb_cache_index_iter
+{
+    ovsdb_cache_index_t             *index;
+    const void                      *key;
+    uint32_t                        hash;
+    struct ovsdb_cache_index_entry  *next;
+} ovsdb_cache_index_iter_t;
+
+#define OVSDB_CACHE_INDEX(TABLE, COLUMN, UNIQUE) \
+    ovsdb_cache_index_add(&table_ ## TABLE, #COLUMN, UNIQUE)
+
+#define ovsdb_cache_index_foreach(table, column, key, iter, row) \
+    for (row = ovsdb_cache_index_first(table, column, key, &(iter)); \
+         row != NULL; \
+         row = ovsdb_cache_index_next(&(iter)))
+
+ovsdb_cache_index_t* ovsdb_cache_index_add(ovsdb_table_t *table, const char *column, bool unique);
+ovsdb_cache_index_t* ovsdb_cache_index_get(ovsdb_table_t *table, const char *column);
+ovsdb_cache_row_t* ovsdb_cache_index_first(ovsdb_table_t *table, const char *column,
+        const void *key, ovsdb_cache_index_iter_t *iter);
+ovsdb_cache_row_t* ovsdb_cache_index_next(ovsdb_cache_index_iter_t *iter);
+ovsdb_cache_row_t* ovsdb_cache_find_row_by_index(ovsdb_table_t *table, const char *column, const void *key);
+void* ovsdb_cache_find_by_index(ovsdb_table_t *table, const char *column, const void *key);
+
+// ovsdb cache memory accounting
+
+typedef struct ovsdb_cache_mem
+{
+    int     rows; // number of cached rows
+    size_t  rows_bytes; // memory used by the cached rows
+    int     indexes; // number of secondary indexes
+    size_t  index_entries; // number of indexed values
+    size_t  index_bytes; // memory used by the secondary indexes
+    size_t  total_bytes;
+} ovsdb_cache_mem_t;
+
+void ovsdb_cache_mem_get(ovsdb_table_t *table, ovsdb_cache_mem_t *mem);
+size_t ovsdb_cache_mem_report(void);
 
 #endif /* OVSDB_CACHE_H_INCLUDED */
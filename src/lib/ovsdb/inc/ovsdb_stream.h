@@ -29,6 +29,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <jansson.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 struct ovsdb_stream;
 
@@ -40,6 +41,10 @@ int ovsdb_stream_recv(struct ovsdb_stream *st, int fd);
 
 json_t *ovsdb_stream_next_json(struct ovsdb_stream *st);
 
+/* Optional handler that is offered each complete message before it is
+ * parsed with jansson; returns true if the message was consumed */
+void ovsdb_stream_set_raw_handler(struct ovsdb_stream *st, bool (*fn)(const char *buf, size_t len));
+
 void ovsdb_stream_free(struct ovsdb_stream *st);
 
 #endif /* OVSDB_STREAM_H_INCLUDED */
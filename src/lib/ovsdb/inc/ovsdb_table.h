@@ -35,6 +35,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "ovsdb_update.h"
 #include "schema.h"
 #include "ds.h"
+#include "ds_dlist.h"
 #include "json_util.h"
 
 // ovsdb table api
@@ -60,6 +61,8 @@ typedef void ovsdb_table_callback_t(ovsdb_update_monitor_t *self,
 typedef void ovsdb_cache_callback_t(ovsdb_update_monitor_t *self,
         void *old_rec, void *record, ovsdb_cache_row_t *row);
 
+typedef struct ovsdb_cache_index ovsdb_cache_index_t;
+
 #define OVSDB_TABLE_KEY_SIZE 64
 #define OVSDB_TABLE_NAME_SIZE 64
 
@@ -77,9 +80,11 @@ typedef struct ovsdb_table
     schema_from_json_t      *from_json;
     schema_to_json_t        *to_json;
     schema_mark_changed_t   *mark_changed;
+    const struct pjs_desc   *desc; // schema structure layout, used by the streaming parser
     ovsdb_update_monitor_t  monitor;
     char                    **columns; // all schema columns, null term
     bool                    partial_update;
+    bool                    stream_update; // parse monitor updates without jansson
     ovsdb_update_cbk_t      *monitor_callback;
     ovsdb_table_callback_t  *table_callback;
     // cache:
@@ -88,6 +93,10 @@ typedef struct ovsdb_table
     ds_tree_t               rows; // uuid key
     ds_tree_t               rows_k; // primary key
     ds_tree_t               rows_k2; // alternate key2
+    int                     rows_count; // number of cached rows
+    ds_dlist_t              indexes; // secondary indexes, see ovsdb_cache_index_add()
+    ds_dlist_node_t         cache_node; // ovsdb_cache_mem_report() list
+    bool                    cache_listed;
 } ovsdb_table_t;
 
 
@@ -101,6 +110,7 @@ int ovsdb_table_init(
     schema_from_json_t  *from_json,
     schema_to_json_t    *to_json,
     schema_mark_changed_t *mark_changed,
+    const struct pjs_desc *desc,
     char                **columns);
 
 void ovsdb_table_fini(ovsdb_table_t *table);
@@ -116,6 +126,7 @@ void ovsdb_table_fini(ovsdb_table_t *table);
         (schema_from_json_t*)schema_ ## TABLE ## _from_json, \
         (schema_to_json_t*)schema_ ## TABLE ## _to_json, \
         (schema_mark_changed_t*)schema_ ## TABLE ## _mark_changed, \
+        schema_ ## TABLE ## _pjs_desc(), \
         SCHEMA_COLUMNS_ARRAY(TABLE))
 
 #define OVSDB_TABLE_INIT_NO_KEY(TABLE) \
@@ -162,6 +173,9 @@ SCHEMA_LISTX(DECL_TABLE_CALLBACK_CAST)
 #define OVSDB_TABLE_MONITOR_F(TABLE, FILTER) \
     ovsdb_table_monitor_filter(&table_ ## TABLE, table_cb_cast_##TABLE(callback_ ## TABLE), FILTER)
 
+#define OVSDB_TABLE_MONITOR_COND(TABLE, WHERE) \
+    ovsdb_table_monitor_cond(&table_ ## TABLE, table_cb_cast_##TABLE(callback_ ## TABLE), NULL, WHERE)
+
 json_t* ovsdb_table_filter_row(json_t *row, char *columns[]);
 bool    ovsdb_table_from_json(ovsdb_table_t *table, json_t *jrow, void *record);
 json_t* ovsdb_table_to_json(ovsdb_table_t *table, void *record);
@@ -201,4 +215,15 @@ bool ovsdb_table_monitor(ovsdb_table_t *table, ovsdb_table_callback_t *callback,
 bool ovsdb_table_monitor_columns(ovsdb_table_t *table, ovsdb_table_callback_t *callback, char **columns);
 bool ovsdb_table_monitor_filter(ovsdb_table_t *table, ovsdb_table_callback_t *callback, char **filter);
 
+// Monitor only the rows matching the condition @p where (reference is stolen),
+// for example: ovsdb_tran_cond(OCLM_STR, "if_name", OFUNC_EQ, "br-home").
+// Rows that stop matching the condition are reported as deleted.
+bool ovsdb_table_monitor_cond(ovsdb_table_t *table, ovsdb_table_callback_t *callback,
+        char **columns, json_t *where);
+
+// Parse monitor updates of the table directly from the socket buffer into the
+// schema structures. The table callback must not use mon_json_new/mon_json_old,
+// these are NULL for updates received this way. Not supported for cache tables.
+bool ovsdb_table_monitor_stream(ovsdb_table_t *table, bool enable);
+
 #endif /* OVSDB_TABLE_H_INCLUDED */
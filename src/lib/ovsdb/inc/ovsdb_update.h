@@ -117,7 +117,17 @@ struct ovsdb_update_monitor_s
     json_t                 *mon_json_new;       /* JSON message containing the update */
     json_t                 *mon_json_old;       /* JSON message containing old data */
     void                   *mon_old_rec;
+    const struct pjs_desc  *mon_desc;           /* Layout of mon_old_rec, set for streamed updates */
     int                    mon_id;              /* JSON update monitor id */
+
+    /* Conditional monitor state, see ovsdb_update_monitor_cond() */
+    const struct pjs_desc  *mon_cond_desc;      /* Table layout, used for default column values */
+    json_t                 *mon_cond_req;       /* <monitor-cond-requests>, re-sent on resume */
+    json_t                 *mon_cond_rows;      /* Copy of the monitored rows, by UUID */
+    json_t                 *mon_cond_defaults;  /* Default values of the monitored columns */
+    ovsdb_mt_t              mon_cond_method;    /* Monitor method currently in use */
+    bool                    mon_cond_resync;    /* The next full reply replaces mon_cond_rows */
+    char                    mon_cond_txn[OVSDB_TXN_ID_SZ]; /* Last seen transaction id */
 };
 
 /*
@@ -140,6 +150,32 @@ extern bool ovsdb_update_monitor(
         char *mon_table,
         int mon_flags);
 
+/*
+ * Start a conditional monitor on a table. Updates are reported the same way
+ * as with ovsdb_update_monitor_ex(), but the monitor_cond_since method is
+ * used when available (see CONFIG_OVSDB_MONITOR_COND_SINCE):
+ *
+ *  -- only rows matching @p where are reported; @p where uses the same
+ *     format as the transaction conditions (see ovsdb_tran_cond()), can be
+ *     NULL to monitor all rows; the reference is stolen
+ *  -- a copy of the monitored rows is kept so that the update2/update3
+ *     differences can be converted to full rows and old values
+ *  -- after a reconnect the monitor is resumed from the last seen
+ *     transaction, only rows that changed in the meantime are reported
+ *
+ * The server omits columns that have default values, @p desc is used to
+ * fill them in.
+ */
+extern bool ovsdb_update_monitor_cond(
+        ovsdb_update_monitor_t *self,
+        ovsdb_update_cbk_t *callback,
+        char *mon_table,
+        const struct pjs_desc *desc,
+        json_t *where,
+        int mon_flags,
+        int colc,
+        char *colv[]);
+
 bool ovsdb_update_monitor_cancel(ovsdb_update_monitor_t *self, const char *table_name);
 
 bool ovsdb_update_changed(ovsdb_update_monitor_t *self, char *field);
@@ -44,6 +44,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "json_util.h"
 #include "memutil.h"
 #include "os_ev_trace.h"
+#include "kconfig.h"
 
 #include "ovsdb_stream.h"
 
@@ -54,6 +55,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define OVSDB_SLEEP_TIME             1
 #define OVSDB_WAIT_TIME              30   /* in s (0 = infinity) */
 
+#if !defined(CONFIG_OVSDB_RECONNECT_TIMEOUT)
+#define CONFIG_OVSDB_RECONNECT_TIMEOUT 0
+#endif
+
 /*****************************************************************************/
 
 /*global to avoid any potential issues with stack */
@@ -80,18 +85,28 @@ struct ovsdb_ready {
 
 static struct ds_dlist g_ovsdb_ready = DS_DLIST_INIT(struct ovsdb_ready, node);
 
+/* Reconnect state */
+static struct ev_loop *ovsdb_loop;
+static ev_timer ovsdb_reconnect_timer;
+static ev_tstamp ovsdb_reconnect_ts;
+
 /******************************************************************************
  *  PROTECTED declarations
  *****************************************************************************/
 
 static bool ovsdb_process_recv(json_t *js);
+static bool ovsdb_process_recv_stream(const char *buf, size_t len);
 static bool ovsdb_process_event(json_t *js);
 static bool ovsdb_process_result(json_t *id, json_t *js);
 static bool ovsdb_process_error(json_t *id, json_t *js);
 static bool ovsdb_process_update(json_t *jsup);
 static bool ovsdb_rpc_callback(int id, bool is_error, json_t *jsmsg);
+static bool ovsdb_resume_possible(void);
+static void ovsdb_reconnect_start(struct ev_loop *loop);
+static void ovsdb_ready_notify(void);
 
 static void cb_ovsdb_read(struct ev_loop *loop, struct ev_io *watcher, int revents);
+static void cb_ovsdb_reconnect(struct ev_loop *loop, ev_timer *w, int revents);
 
 /******************************************************************************
  *  PROTECTED definitions
@@ -107,7 +122,16 @@ static void cb_ovsdb_read(struct ev_loop *loop, struct ev_io *watcher, int reven
     }
 
     int err = ovsdb_stream_run(st, watcher->fd, ovsdb_process_recv);
-    if (err)
+    if (err && ovsdb_resume_possible())
+    {
+        /*
+         * All monitors can be resumed from the last seen transaction,
+         * try to reconnect instead of restarting
+         */
+        LOG(WARN, "Connection to OVSDB is lost, reconnecting.");
+        ovsdb_reconnect_start(loop);
+    }
+    else if (err)
     {
         /* During Opensync restart OVSDB may end up getting
          * stopped before Opensync itself. In such case the
@@ -152,7 +176,9 @@ bool ovsdb_process_recv(json_t *jsrpc)
     {
         const char * method;
         method = json_string_value(jst);
-        if (!strcmp(method, "update")) {
+        if (!strcmp(method, "update") ||
+                !strcmp(method, "update2") ||
+                !strcmp(method, "update3")) {
             return ovsdb_process_update(jsrpc);
         } else  {
             LOG(ERR, "Received unsupported SYNCHRONOUS method request.::method=%s", json_string_value(jst));
@@ -189,6 +215,58 @@ bool ovsdb_process_recv(json_t *jsrpc)
     return false;
 }
 
+/**
+ * Dispatch a raw JSON-RPC "update" message to a streaming update handler
+ *
+ * Returns false if the message is not handled, in which case it is parsed
+ * with jansson and passed to ovsdb_process_recv(). This has to be decided
+ * before the update object itself is consumed.
+ */
+static bool ovsdb_process_recv_stream(const char *buf, size_t len)
+{
+    struct rpc_update_handler *rh;
+    struct pjs_stream ps;
+    bool is_update = false;
+    char key[16];
+    int64_t mon_id;
+    int id;
+    bool end;
+
+    pjs_stream_init(&ps, buf, len);
+    if (pjs_stream_next(&ps) != PJS_TOK_OBJ_START) return false;
+
+    for (;;)
+    {
+        if (!pjs_stream_key(&ps, key, sizeof(key), &end) || end) return false;
+
+        if (strcmp(key, "method") == 0)
+        {
+            pjs_stream_next(&ps);
+            if (!pjs_stream_str_eq(&ps, "update")) return false;
+            is_update = true;
+            continue;
+        }
+
+        /* The "method" must precede "params", otherwise fall back to jansson */
+        if (strcmp(key, "params") == 0) break;
+
+        if (!pjs_stream_skip(&ps)) return false;
+    }
+
+    if (!is_update) return false;
+
+    /* The params array is in the following format: [ value, {} ] */
+    if (pjs_stream_next(&ps) != PJS_TOK_ARR_START) return false;
+    pjs_stream_next(&ps);
+    if (!pjs_stream_int64(&ps, &mon_id)) return false;
+
+    id = (int)mon_id;
+    rh = ds_tree_find(&json_rpc_update_handler_list, &id);
+    if (rh == NULL || rh->rrh_stream == NULL) return false;
+
+    return rh->rrh_stream(id, &ps, rh->data);
+}
+
 /**
  * Process signle JSON-RPC "event" message (asynchronous method call)
  */
@@ -253,6 +331,8 @@ int ovsdb_register_update_cb(ovsdb_update_process_t *fn, void *data)
     /* Not thread-safe */
     rh->rrh_id = json_update_monitor_id;
     rh->rrh_callback = fn;
+    rh->rrh_stream = NULL;
+    rh->rrh_resume = NULL;
     rh->data = data;
 
     ds_tree_insert(&json_rpc_update_handler_list, rh, &rh->rrh_id);
@@ -283,6 +363,8 @@ bool ovsdb_change_update_cb(int mon_id, ovsdb_update_process_t *fn, void *data)
     if (rh)
     {
         rh->rrh_callback = fn;
+        rh->rrh_stream = NULL;
+        rh->rrh_resume = NULL;
         rh->data = data;
         return true;
     }
@@ -290,8 +372,39 @@ bool ovsdb_change_update_cb(int mon_id, ovsdb_update_process_t *fn, void *data)
     return false;
 }
 
+/*
+ * Set an optional streaming update handler; it receives the same user data
+ * as the regular update handler
+ */
+bool ovsdb_set_update_stream_cb(int mon_id, ovsdb_update_stream_t *fn)
+{
+    struct rpc_update_handler *rh;
+
+    rh = ds_tree_find(&json_rpc_update_handler_list, &mon_id);
+    if (rh == NULL) return false;
+
+    rh->rrh_stream = fn;
+    return true;
+}
+
+/*
+ * Set the handler that re-issues the monitor request after a reconnect; if
+ * any of the registered monitors does not have one, a lost connection
+ * results in a restart
+ */
+bool ovsdb_set_update_resume_cb(int mon_id, ovsdb_update_resume_t *fn)
+{
+    struct rpc_update_handler *rh;
+
+    rh = ds_tree_find(&json_rpc_update_handler_list, &mon_id);
+    if (rh == NULL) return false;
+
+    rh->rrh_resume = fn;
+    return true;
+}
+
 /**
- * Process single JSON-RPC "update" message
+ * Process single JSON-RPC "update", "update2" or "update3" message
  */
 static bool ovsdb_process_update(json_t *jsup)
 {
@@ -348,6 +461,114 @@ bool ovsdb_rpc_callback(int id, bool is_error, json_t *jsmsg)
 }
 
 
+/*
+ * Check if all monitors can be resumed after a reconnect
+ */
+static bool ovsdb_resume_possible(void)
+{
+    struct rpc_update_handler *rh;
+
+    if (!kconfig_enabled(CONFIG_OVSDB_MONITOR_COND_SINCE)) return false;
+    if (CONFIG_OVSDB_RECONNECT_TIMEOUT <= 0) return false;
+    if (ovsdb_loop == NULL) return false;
+
+    ds_tree_foreach(&json_rpc_update_handler_list, rh)
+    {
+        if (rh->rrh_resume == NULL) return false;
+    }
+
+    return true;
+}
+
+/*
+ * Close the connection and fail all pending requests
+ */
+static void ovsdb_disconnect(struct ev_loop *loop)
+{
+    struct rpc_response_handler *rh;
+    json_t *jerr;
+
+    ev_io_stop(loop, &wovsdb);
+    close(json_rpc_fd);
+    json_rpc_fd = -1;
+
+    ovsdb_stream_free(wovsdb.data);
+    wovsdb.data = NULL;
+
+    jerr = json_pack("{s:s}", "error", "connection lost");
+    while ((rh = ds_tree_head(&json_rpc_handler_list)) != NULL)
+    {
+        ds_tree_remove(&json_rpc_handler_list, rh);
+        rh->rrh_callback(rh->rrh_id, true, jerr, rh->data);
+        FREE(rh);
+    }
+    json_decref(jerr);
+}
+
+static bool ovsdb_connect(struct ev_loop *loop)
+{
+    int priority;
+
+    json_rpc_fd = ovsdb_conn();
+    if (json_rpc_fd <= 0)
+    {
+        json_rpc_fd = -1;
+        return false;
+    }
+
+    /* ev_io_init() resets the priority */
+    priority = ev_priority(&wovsdb);
+    OS_EV_TRACE_MAP(cb_ovsdb_read);
+    ev_io_init(&wovsdb, cb_ovsdb_read, json_rpc_fd, EV_READ);
+    ev_set_priority(&wovsdb, priority);
+    ev_io_start(loop, &wovsdb);
+    wovsdb.data = ovsdb_stream_alloc();
+    ovsdb_stream_set_raw_handler(wovsdb.data, ovsdb_process_recv_stream);
+
+    return true;
+}
+
+static void ovsdb_reconnect_start(struct ev_loop *loop)
+{
+    ovsdb_disconnect(loop);
+
+    ovsdb_reconnect_ts = ev_now(loop);
+    OS_EV_TRACE_MAP(cb_ovsdb_reconnect);
+    ev_timer_init(&ovsdb_reconnect_timer, cb_ovsdb_reconnect, OVSDB_SLEEP_TIME, OVSDB_SLEEP_TIME);
+    ev_timer_start(loop, &ovsdb_reconnect_timer);
+}
+
+static void cb_ovsdb_reconnect(struct ev_loop *loop, ev_timer *w, int revents)
+{
+    struct rpc_update_handler *rh;
+    struct rpc_update_handler *tmp;
+
+    if (!ovsdb_connect(loop))
+    {
+        if (ev_now(loop) - ovsdb_reconnect_ts < CONFIG_OVSDB_RECONNECT_TIMEOUT) return;
+
+        ev_timer_stop(loop, w);
+        LOGEM("Unable to reconnect to OVSDB, restarting OpenSync");
+        target_managers_restart();
+        return;
+    }
+
+    ev_timer_stop(loop, w);
+    LOG(NOTICE, "OVSDB connection re-established, resuming monitors.");
+
+    ds_tree_foreach_safe(&json_rpc_update_handler_list, rh, tmp)
+    {
+        if (rh->rrh_resume == NULL || !rh->rrh_resume(rh->rrh_id, rh->data))
+        {
+            LOGEM("Unable to resume OVSDB monitor %d, restarting OpenSync", rh->rrh_id);
+            target_managers_restart();
+            return;
+        }
+    }
+
+    ovsdb_ready_notify();
+}
+
 /******************************************************************************
  *  PUBLIC definitions
  *****************************************************************************/
@@ -393,6 +614,7 @@ bool ovsdb_init_loop(struct ev_loop *loop, const char *name)
     if (loop == NULL) {
         loop = ev_default_loop(0);
     }
+    ovsdb_loop = loop;
 
     json_rpc_fd = ovsdb_conn();
 
@@ -403,6 +625,7 @@ bool ovsdb_init_loop(struct ev_loop *loop, const char *name)
         ev_io_init(&wovsdb, cb_ovsdb_read, json_rpc_fd, EV_READ);
         ev_io_start(loop, &wovsdb);
         wovsdb.data = ovsdb_stream_alloc();
+        ovsdb_stream_set_raw_handler(wovsdb.data, ovsdb_process_recv_stream);
 
         success = true;
         ovsdb_ready_notify();
@@ -434,6 +657,7 @@ bool ovsdb_init_loop_with_priority(struct ev_loop *loop, const char *name, int p
     if (loop == NULL) {
         loop = ev_default_loop(0);
     }
+    ovsdb_loop = loop;
 
     json_rpc_fd = ovsdb_conn();
 
@@ -447,6 +671,7 @@ bool ovsdb_init_loop_with_priority(struct ev_loop *loop, const char *name, int p
              name, ev_priority(&wovsdb));
         ev_io_start(loop, &wovsdb);
         wovsdb.data = ovsdb_stream_alloc();
+        ovsdb_stream_set_raw_handler(wovsdb.data, ovsdb_process_recv_stream);
 
         success = true;
         ovsdb_ready_notify();
@@ -498,6 +723,7 @@ bool ovsdb_stop_loop(struct ev_loop *loop)
     }
 
     ev_io_stop(loop, &wovsdb);
+    ev_timer_stop(loop, &ovsdb_reconnect_timer);
     ovsdb_comment = NULL;
 
     close(json_rpc_fd);
@@ -44,11 +44,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "ds.h"
 #include "json_util.h"
 #include "ovsdb_table.h"
+#include "ovsdb_cache.h"
 #include "ovsdb_sync.h"
 
 #define MODULE_ID LOG_MODULE_ID_OVSDB
 
 void ovsdb_cache_update_cb(ovsdb_update_monitor_t *self);
+static void ovsdb_cache_table_init(ovsdb_table_t *table);
 
 // ignore_version can be used if we are not interested in receiving
 // updates for when a referenced table has been modified
@@ -57,6 +59,7 @@ bool ovsdb_cache_monitor_columns(ovsdb_table_t *table,
 {
     table->monitor_callback = ovsdb_cache_update_cb;
     table->cache_callback = callback;
+    ovsdb_cache_table_init(table);
     return ovsdb_table_monitor_columns(table, NULL, columns);
 }
 
@@ -65,6 +68,7 @@ bool ovsdb_cache_monitor(ovsdb_table_t *table,
 {
     table->monitor_callback = ovsdb_cache_update_cb;
     table->cache_callback = callback;
+    ovsdb_cache_table_init(table);
     return ovsdb_table_monitor(table, NULL, ignore_version);
 }
 
@@ -73,6 +77,7 @@ bool ovsdb_cache_monitor_filter(ovsdb_table_t *table,
 {
     table->monitor_callback = ovsdb_cache_update_cb;
     table->cache_callback = callback;
+    ovsdb_cache_table_init(table);
     return ovsdb_table_monitor_filter(table, NULL, filter);
 }
 
@@ -107,6 +112,398 @@ void ovsdb_cache_dump_table(ovsdb_table_t *table, char *str)
     }
 }
 
+/*
+ * ===========================================================================
+ *  Secondary indexes
+ * ===========================================================================
+ */
+
+#define OVSDB_CACHE_INDEX_BUCKETS_MIN   16
+
+struct ovsdb_cache_index_entry
+{
+    struct ovsdb_cache_index_entry  *next;
+    ovsdb_cache_row_t               *row;
+    const void                      *key; // points into row->record
+    uint32_t                        hash;
+};
+
+// tables with cached rows, for ovsdb_cache_mem_report()
+static ds_dlist_t ovsdb_cache_tables = DS_DLIST_INIT(ovsdb_table_t, cache_node);
+
+static bool ovsdb_cache_index_is_str(const ovsdb_cache_index_t *idx)
+{
+    return idx->field->type == PJS_DESC_T_STRING || idx->field->type == PJS_DESC_T_UUID;
+}
+
+// FNV-1a
+static uint32_t ovsdb_cache_index_hash(const ovsdb_cache_index_t *idx, const void *key)
+{
+    const uint8_t *p = key;
+    uint32_t hash = 2166136261u;
+    size_t len;
+
+    len = ovsdb_cache_index_is_str(idx) ? strlen(key) : idx->field->elem_sz;
+    while (len-- > 0)
+    {
+        hash ^= *p++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static bool ovsdb_cache_index_key_eq(const ovsdb_cache_index_t *idx, const void *a, const void *b)
+{
+    if (ovsdb_cache_index_is_str(idx)) return strcmp(a, b) == 0;
+    return memcmp(a, b, idx->field->elem_sz) == 0;
+}
+
+// return the number of column values in the record, *keys is set to the first one
+static int ovsdb_cache_index_keys(const ovsdb_cache_index_t *idx, const char *record, const char **keys)
+{
+    const struct pjs_desc_field *f = idx->field;
+
+    *keys = record + f->off;
+
+    if (f->kind == PJS_DESC_OVS_SET)
+    {
+        int len = *(const int *)(record + f->off_len);
+        return (len < 0) ? 0 : (len > f->max ? f->max : len);
+    }
+
+    if (f->optional && !*(const bool *)(record + f->off_exists))
+    {
+        return 0;
+    }
+
+    return 1;
+}
+
+static void ovsdb_cache_index_grow(ovsdb_cache_index_t *idx)
+{
+    struct ovsdb_cache_index_entry **buckets;
+    struct ovsdb_cache_index_entry *e;
+    unsigned nbuckets;
+    unsigned i;
+
+    nbuckets = idx->nbuckets ? idx->nbuckets * 2 : OVSDB_CACHE_INDEX_BUCKETS_MIN;
+    buckets = CALLOC(nbuckets, sizeof(*buckets));
+
+    for (i = 0; i < idx->nbuckets; i++)
+    {
+        while ((e = idx->buckets[i]) != NULL)
+        {
+            idx->buckets[i] = e->next;
+            e->next = buckets[e->hash & (nbuckets - 1)];
+            buckets[e->hash & (nbuckets - 1)] = e;
+        }
+    }
+
+    FREE(idx->buckets);
+    idx->buckets = buckets;
+    idx->nbuckets = nbuckets;
+}
+
+static void ovsdb_cache_index_insert(ovsdb_table_t *table, ovsdb_cache_index_t *idx, ovsdb_cache_row_t *row)
+{
+    struct ovsdb_cache_index_entry *e;
+    const char *keys;
+    int nkeys;
+    int i;
+
+    nkeys = ovsdb_cache_index_keys(idx, row->record, &keys);
+    for (i = 0; i < nkeys; i++)
+    {
+        const void *key = keys + i * idx->field->elem_sz;
+
+        if (idx->count >= idx->nbuckets) ovsdb_cache_index_grow(idx);
+
+        e = MALLOC(sizeof(*e));
+        e->row = row;
+        e->key = key;
+        e->hash = ovsdb_cache_index_hash(idx, key);
+
+        if (idx->unique && ovsdb_cache_find_row_by_index(table, idx->column, key) != NULL)
+        {
+            LOG(WARNING, "Table %s index %s: duplicate value in row %s",
+                    table->table_name, idx->column, row->record + table->uuid_offset);
+        }
+
+        e->next = idx->buckets[e->hash & (idx->nbuckets - 1)];
+        idx->buckets[e->hash & (idx->nbuckets - 1)] = e;
+        idx->count++;
+    }
+}
+
+// row->record has to hold the values that were indexed
+static void ovsdb_cache_index_remove(ovsdb_cache_index_t *idx, ovsdb_cache_row_t *row)
+{
+    struct ovsdb_cache_index_entry **pe;
+    struct ovsdb_cache_index_entry *e;
+    const char *keys;
+    int nkeys;
+    int i;
+
+    if (idx->nbuckets == 0) return;
+
+    nkeys = ovsdb_cache_index_keys(idx, row->record, &keys);
+    for (i = 0; i < nkeys; i++)
+    {
+        const void *key = keys + i * idx->field->elem_sz;
+
+        pe = &idx->buckets[ovsdb_cache_index_hash(idx, key) & (idx->nbuckets - 1)];
+        while ((e = *pe) != NULL)
+        {
+            if (e->row == row && e->key == key)
+            {
+                *pe = e->next;
+                FREE(e);
+                idx->count--;
+                break;
+            }
+            pe = &e->next;
+        }
+    }
+}
+
+static void ovsdb_cache_index_free(ovsdb_cache_index_t *idx)
+{
+    struct ovsdb_cache_index_entry *e;
+    unsigned i;
+
+    for (i = 0; i < idx->nbuckets; i++)
+    {
+        while ((e = idx->buckets[i]) != NULL)
+        {
+            idx->buckets[i] = e->next;
+            FREE(e);
+        }
+    }
+    FREE(idx->buckets);
+    FREE(idx);
+}
+
+ovsdb_cache_index_t* ovsdb_cache_index_get(ovsdb_table_t *table, const char *column)
+{
+    ovsdb_cache_index_t *idx;
+
+    ds_dlist_foreach(&table->indexes, idx)
+    {
+        if (strcmp(idx->column, column) == 0) return idx;
+    }
+
+    return NULL;
+}
+
+ovsdb_cache_index_t* ovsdb_cache_index_add(ovsdb_table_t *table, const char *column, bool unique)
+{
+    const struct pjs_desc_field *field;
+    ovsdb_cache_index_t *idx;
+    ovsdb_cache_row_t *row;
+
+    idx = ovsdb_cache_index_get(table, column);
+    if (idx != NULL)
+    {
+        idx->unique = idx->unique || unique;
+        return idx;
+    }
+
+    field = table->desc ? pjs_desc_find(table->desc, column) : NULL;
+    if (field == NULL || (field->kind != PJS_DESC_OVS_BASIC && field->kind != PJS_DESC_OVS_SET))
+    {
+        LOG(ERR, "Table %s index %s: column type cannot be indexed",
+                table->table_name, column);
+        return NULL;
+    }
+
+    idx = CALLOC(1, sizeof(*idx));
+    STRSCPY(idx->column, column);
+    idx->field = field;
+    idx->unique = unique;
+    ds_dlist_insert_tail(&table->indexes, idx);
+
+    ds_tree_foreach(&table->rows, row)
+    {
+        ovsdb_cache_index_insert(table, idx, row);
+    }
+
+    LOG(DEBUG, "Table %s index %s: added, %u values", table->table_name, column, idx->count);
+
+    return idx;
+}
+
+ovsdb_cache_row_t* ovsdb_cache_index_next(ovsdb_cache_index_iter_t *iter)
+{
+    struct ovsdb_cache_index_entry *e;
+
+    // the next match is looked up in advance so the current row may be removed
+    e = iter->next;
+    if (e == NULL) return NULL;
+
+    for (iter->next = e->next; iter->next != NULL; iter->next = iter->next->next)
+    {
+        if (iter->next->hash == iter->hash &&
+                ovsdb_cache_index_key_eq(iter->index, iter->next->key, iter->key))
+        {
+            break;
+        }
+    }
+
+    return e->row;
+}
+
+ovsdb_cache_row_t* ovsdb_cache_index_first(ovsdb_table_t *table, const char *column,
+        const void *key, ovsdb_cache_index_iter_t *iter)
+{
+    ovsdb_cache_index_t *idx;
+
+    memset(iter, 0, sizeof(*iter));
+
+    idx = ovsdb_cache_index_get(table, column);
+    if (idx == NULL)
+    {
+        if (table->rows_count > 0)
+        {
+            LOG(ERR, "Table %s index %s: not found", table->table_name, column);
+        }
+        return NULL;
+    }
+    if (idx->nbuckets == 0) return NULL;
+
+    iter->index = idx;
+    iter->key = key;
+    iter->hash = ovsdb_cache_index_hash(idx, key);
+
+    for (iter->next = idx->buckets[iter->hash & (idx->nbuckets - 1)];
+            iter->next != NULL;
+            iter->next = iter->next->next)
+    {
+        if (iter->next->hash == iter->hash && ovsdb_cache_index_key_eq(idx, iter->next->key, key))
+        {
+            break;
+        }
+    }
+
+    return ovsdb_cache_index_next(iter);
+}
+
+ovsdb_cache_row_t* ovsdb_cache_find_row_by_index(ovsdb_table_t *table, const char *column, const void *key)
+{
+    ovsdb_cache_index_iter_t iter;
+
+    return ovsdb_cache_index_first(table, column, key, &iter);
+}
+
+void* ovsdb_cache_find_by_index(ovsdb_table_t *table, const char *column, const void *key)
+{
+    ovsdb_cache_row_t *row = ovsdb_cache_find_row_by_index(table, column, key);
+    if (row) return row->record;
+    return NULL;
+}
+
+/*
+ * ===========================================================================
+ *  Memory accounting
+ * ===========================================================================
+ */
+
+void ovsdb_cache_mem_get(ovsdb_table_t *table, ovsdb_cache_mem_t *mem)
+{
+    ovsdb_cache_index_t *idx;
+
+    memset(mem, 0, sizeof(*mem));
+
+    mem->rows = table->rows_count;
+    mem->rows_bytes = (size_t)table->rows_count * table->row_size;
+
+    ds_dlist_foreach(&table->indexes, idx)
+    {
+        mem->indexes++;
+        mem->index_entries += idx->count;
+        mem->index_bytes += sizeof(*idx);
+        mem->index_bytes += idx->nbuckets * sizeof(*idx->buckets);
+        mem->index_bytes += idx->count * sizeof(struct ovsdb_cache_index_entry);
+    }
+
+    mem->total_bytes = mem->rows_bytes + mem->index_bytes;
+}
+
+// log the cache memory usage of every cached table, return the total
+// nothing is logged by processes without cached tables
+size_t ovsdb_cache_mem_report(void)
+{
+    ovsdb_cache_mem_t mem;
+    ovsdb_table_t *table;
+    size_t total = 0;
+
+    if (ds_dlist_is_empty(&ovsdb_cache_tables)) return 0;
+
+    ds_dlist_foreach(&ovsdb_cache_tables, table)
+    {
+        ovsdb_cache_mem_get(table, &mem);
+        LOG(INFO, "Table cache: %s rows: %d (%zu bytes) indexes: %d values: %zu (%zu bytes) total: %zu bytes",
+                table->table_name, mem.rows, mem.rows_bytes, mem.indexes,
+                mem.index_entries, mem.index_bytes, mem.total_bytes);
+        total += mem.total_bytes;
+    }
+    LOG(INFO, "Table cache: total: %zu bytes", total);
+
+    return total;
+}
+
+static void ovsdb_cache_list_table(ovsdb_table_t *table)
+{
+    if (table->cache_listed) return;
+    ds_dlist_insert_tail(&ovsdb_cache_tables, table);
+    table->cache_listed = true;
+}
+
+// prepare the table for caching, index the key columns
+static void ovsdb_cache_table_init(ovsdb_table_t *table)
+{
+    ovsdb_cache_list_table(table);
+    if (table->key_offset >= 0) ovsdb_cache_index_add(table, table->key_name, false);
+    if (table->key2_offset >= 0) ovsdb_cache_index_add(table, table->key2_name, false);
+}
+
+void ovsdb_cache_fini(ovsdb_table_t *table)
+{
+    ovsdb_cache_index_t *idx;
+
+    while ((idx = ds_dlist_remove_head(&table->indexes)) != NULL)
+    {
+        ovsdb_cache_index_free(idx);
+    }
+
+    if (table->cache_listed)
+    {
+        ds_dlist_remove(&ovsdb_cache_tables, table);
+        table->cache_listed = false;
+    }
+    table->rows_count = 0;
+}
+
+static void _ovsdb_cache_index_row(ovsdb_table_t *table, ovsdb_cache_row_t *row)
+{
+    ovsdb_cache_index_t *idx;
+
+    ds_dlist_foreach(&table->indexes, idx)
+    {
+        ovsdb_cache_index_insert(table, idx, row);
+    }
+}
+
+static void _ovsdb_cache_unindex_row(ovsdb_table_t *table, ovsdb_cache_row_t *row)
+{
+    ovsdb_cache_index_t *idx;
+
+    ds_dlist_foreach(&table->indexes, idx)
+    {
+        ovsdb_cache_index_remove(idx, row);
+    }
+}
+
 void _ovsdb_cache_insert_row(ovsdb_table_t *table, ovsdb_cache_row_t *row)
 {
     char *row_uuid = row->record + table->uuid_offset;
@@ -125,10 +522,28 @@ void _ovsdb_cache_insert_row(ovsdb_table_t *table, ovsdb_cache_row_t *row)
         key2 = row->record + table->key2_offset;
         ds_tree_insert(&table->rows_k2, row, key2);
     }
+    _ovsdb_cache_index_row(table, row);
+    table->rows_count++;
+    ovsdb_cache_list_table(table);
     snprintf(msg, sizeof(msg), "insert %s key: %s", row_uuid, key);
     ovsdb_cache_dump_table(table, msg);
 }
 
+static void _ovsdb_cache_remove_row(ovsdb_table_t *table, ovsdb_cache_row_t *row)
+{
+    _ovsdb_cache_unindex_row(table, row);
+    ds_tree_remove(&table->rows, row);
+    if (table->key_offset >= 0)
+    {
+        ds_tree_remove(&table->rows_k, row);
+    }
+    if (table->key2_offset >= 0)
+    {
+        ds_tree_remove(&table->rows_k2, row);
+    }
+    table->rows_count--;
+}
+
 void ovsdb_cache_update_cb(ovsdb_update_monitor_t *self)
 {
     ovsdb_table_t *table;
@@ -294,7 +709,9 @@ void ovsdb_cache_update_cb(ovsdb_update_monitor_t *self)
                 // mark _changed
                 table->mark_changed(old_record, record);
             }
+            _ovsdb_cache_unindex_row(table, row);
             memcpy(row->record, record, sizeof(record));
+            _ovsdb_cache_index_row(table, row);
             break;
 
         case OVSDB_UPDATE_DEL:
@@ -305,15 +722,7 @@ void ovsdb_cache_update_cb(ovsdb_update_monitor_t *self)
                 return;
             }
             // remove row from the list
-            ds_tree_remove(&table->rows, row);
-            if (table->key_offset >= 0)
-            {
-                ds_tree_remove(&table->rows_k, row);
-            }
-            if (table->key2_offset >= 0)
-            {
-                ds_tree_remove(&table->rows_k2, row);
-            }
+            _ovsdb_cache_remove_row(table, row);
             // callback
             if (table->cache_callback) table->cache_callback(self, old_record, row->record, row);
             // free row
@@ -339,6 +748,16 @@ ovsdb_cache_row_t* _ovsdb_cache_find_row_by_offset(ovsdb_table_t *table, int off
     char *row_key;
     if (offset < 0) return NULL;
 
+    // use the key column index when available
+    ovsdb_cache_index_t *idx = ovsdb_cache_index_get(table,
+            (offset == table->key_offset) ? table->key_name : table->key2_name);
+    if (idx != NULL && idx->field->off == (size_t)offset && ovsdb_cache_index_is_str(idx))
+    {
+        row = ovsdb_cache_find_row_by_index(table, idx->column, key);
+        LOG(TRACE, "%sfound table: %s %s: %s", row ? "" : "NOT ", table->table_name, kname, key);
+        return row;
+    }
+
     ds_tree_foreach(&table->rows, row)
     {
         row_key = row->record + offset;
@@ -354,7 +773,8 @@ ovsdb_cache_row_t* _ovsdb_cache_find_row_by_offset(ovsdb_table_t *table, int off
 
 ovsdb_cache_row_t* ovsdb_cache_find_row_by_uuid(ovsdb_table_t *table, const char *uuid)
 {
-    return _ovsdb_cache_find_row_by_offset(table, table->uuid_offset, "uuid", uuid);
+    // rows are keyed by uuid
+    return ds_tree_find(&table->rows, (void *)uuid);
 }
 
 ovsdb_cache_row_t* ovsdb_cache_find_row_by_key(ovsdb_table_t *table, const char *key)
@@ -470,7 +890,9 @@ int ovsdb_cache_upsert(ovsdb_table_t *table, void *record)
     if (row)
     {
         // update existing
+        _ovsdb_cache_unindex_row(table, row);
         memcpy(row->record, record, table->schema_size);
+        _ovsdb_cache_index_row(table, row);
     }
     else
     {
@@ -292,6 +292,14 @@ bool ovsdb_method_send(json_rpc_response_t *callback,
             method = "monitor_cancel";
             break;
 
+        case MT_MONITOR_COND:
+            method = "monitor_cond";
+            break;
+
+        case MT_MONITOR_COND_SINCE:
+            method = "monitor_cond_since";
+            break;
+
         case MT_TRANS:
             method = "transact";
             break;
@@ -441,6 +449,60 @@ bool OVSDB_VA_DECL(ovsdb_monit_call, json_rpc_response_t *callback, void *data,
     OVSDB_VA_CALL(ovsdb_monit_call, callback, data, monid, table, mon_flags);
 }
 
+json_t *ovsdb_monit_request_argv(int mon_flags, json_t *where, int argc, char *argv[])
+{
+    json_t *jreq;
+
+    jreq = ovsdb_mon_tbl_val(mon_flags, argc, argv);
+    if (where != NULL)
+    {
+        json_object_set_new(jreq, "where", where);
+    }
+
+    return jreq;
+}
+
+/**
+ * Send a monitor request, the format of "params" depends on the method:
+ *
+ *  monitor:            [<db-name>, <json-value>, <monitor-requests>]
+ *  monitor_cond:       [<db-name>, <json-value>, <monitor-cond-requests>]
+ *  monitor_cond_since: [<db-name>, <json-value>, <monitor-cond-requests>, <last-txn-id>]
+ *
+ * The reply to monitor_cond_since is [<found>, <last-txn-id>, <table-updates2>]
+ * and the updates are delivered as "update3" notifications. If <last-txn-id>
+ * is unknown to the server, <found> is false and all rows are returned.
+ */
+bool ovsdb_monit_req_call(json_rpc_response_t *callback,
+        void *data,
+        ovsdb_mt_t mt,
+        int monid,
+        json_t *jreqs,
+        const char *last_txn)
+{
+    json_t *jparams;
+
+    if (mt != MT_MONITOR && mt != MT_MONITOR_COND && mt != MT_MONITOR_COND_SINCE)
+    {
+        LOG(ERR, "Invalid monitor method: %d", mt);
+        return false;
+    }
+
+    jparams = json_array();
+    json_array_append_new(jparams, json_string(OVSDB_DEF_DB));
+    json_array_append_new(jparams, json_integer(monid));
+    json_array_append(jparams, jreqs);
+
+    if (mt == MT_MONITOR_COND_SINCE)
+    {
+        json_array_append_new(jparams, json_string(last_txn != NULL ? last_txn : OVSDB_TXN_ID_NONE));
+    }
+
+    LOGT("OVSDB MONITOR method: %d monid: %d params: %s", mt, monid, json_dumps_static(jparams, 0));
+
+    return ovsdb_method_send(callback, data, mt, jparams);
+}
+
 /**
  * Cancel monitoring
  * monid - monitor id, as provided in a previous successful monitor call
@@ -48,18 +48,43 @@ struct ovsdb_stream_chunk
     size_t remaining;
 };
 
+/*
+ * Messages are framed incrementally as data arrives: the scanner keeps
+ * track of the nesting depth and string state across recv() calls, so
+ * an incomplete message is never re-parsed. Only complete messages are
+ * handed over to the raw handler and/or jansson.
+ */
 struct ovsdb_stream
 {
     struct ds_dlist chunks;
-    struct ovsdb_stream_chunk *iter;
-    size_t position;
+    struct ovsdb_stream_chunk *scan_chunk;
+    size_t scan_off;
+    size_t scan_len;
+    int scan_depth;
+    bool scan_str;
+    bool scan_esc;
+    char *msg;
+    size_t msg_size;
+    bool (*raw_fn)(const char *buf, size_t len);
 };
 
+static void ovsdb_stream_scan_reset(struct ovsdb_stream *st)
+{
+    st->scan_chunk = NULL;
+    st->scan_off = 0;
+    st->scan_len = 0;
+    st->scan_depth = 0;
+    st->scan_str = false;
+    st->scan_esc = false;
+}
+
 static void ovsdb_stream_init(struct ovsdb_stream *st)
 {
     ds_dlist_init(&st->chunks, struct ovsdb_stream_chunk, node);
-    st->iter = NULL;
-    st->position = 0;
+    ovsdb_stream_scan_reset(st);
+    st->msg = NULL;
+    st->msg_size = 0;
+    st->raw_fn = NULL;
 }
 
 static void ovsdb_stream_chunk_free(struct ovsdb_stream_chunk *c)
@@ -104,31 +129,113 @@ int ovsdb_stream_recv(struct ovsdb_stream *st, int fd)
     return 0;
 }
 
-static void ovsdb_stream_iter_init(struct ovsdb_stream *st)
+/*
+ * Scan the chunk from the last position; returns true and sets @p len to
+ * the length of the message if the end of the top level value is found
+ */
+static bool ovsdb_stream_scan_chunk(struct ovsdb_stream *st, struct ovsdb_stream_chunk *c, size_t *len)
 {
-    st->iter = ds_dlist_head(&st->chunks);
-    st->position = 0;
+    const char *p = c->pos;
+    size_t i;
+
+    for (i = st->scan_off; i < c->remaining; i++)
+    {
+        const char ch = p[i];
+
+        if (st->scan_str)
+        {
+            if (st->scan_esc) st->scan_esc = false;
+            else if (ch == '\\') st->scan_esc = true;
+            else if (ch == '"') st->scan_str = false;
+            continue;
+        }
+
+        switch (ch)
+        {
+            case '"':
+                st->scan_str = true;
+                break;
+            case '{':
+            case '[':
+                st->scan_depth++;
+                break;
+            case '}':
+            case ']':
+                st->scan_depth--;
+                if (st->scan_depth > 0) break;
+                *len = st->scan_len + (i - st->scan_off) + 1;
+                return true;
+            default:
+                break;
+        }
+    }
+
+    st->scan_len += c->remaining - st->scan_off;
+    st->scan_off = c->remaining;
+    return false;
 }
 
-static void ovsdb_stream_iter_next(struct ovsdb_stream *st, struct ovsdb_stream_chunk *c)
+/*
+ * Return the length of the next complete message, or 0 if more data is
+ * needed. The message starts at the head chunk and may span several chunks.
+ */
+static size_t ovsdb_stream_scan(struct ovsdb_stream *st)
 {
-    if (st->position < c->remaining) return;
-    st->iter = ds_dlist_next(&st->chunks, c);
-    st->position = 0;
+    struct ovsdb_stream_chunk *c = st->scan_chunk;
+    size_t len;
+
+    if (c == NULL)
+    {
+        c = ds_dlist_head(&st->chunks);
+        st->scan_off = 0;
+    }
+
+    while (c != NULL)
+    {
+        st->scan_chunk = c;
+        if (ovsdb_stream_scan_chunk(st, c, &len)) return len;
+
+        c = ds_dlist_next(&st->chunks, c);
+        if (c == NULL) break;
+        st->scan_off = 0;
+    }
+
+    return 0;
 }
 
-static size_t ovsdb_stream_next_json_cb(void *buf, size_t len, void *priv)
+/*
+ * Return a contiguous buffer with the next complete message; messages that
+ * fit into the head chunk are not copied
+ */
+static size_t ovsdb_stream_next_msg(struct ovsdb_stream *st, const char **buf)
 {
-    struct ovsdb_stream *st = priv;
-    struct ovsdb_stream_chunk *c = st->iter;
-    if (c == NULL) return 0;
+    struct ovsdb_stream_chunk *c;
+    const size_t len = ovsdb_stream_scan(st);
+    size_t off = 0;
 
-    const size_t remaining = c->remaining - st->position;
-    len = MIN(len, remaining);
-    memcpy(buf, c->pos + st->position, len);
-    st->position += len;
+    if (len == 0) return 0;
 
-    ovsdb_stream_iter_next(st, c);
+    c = ds_dlist_head(&st->chunks);
+    if (c->remaining >= len)
+    {
+        *buf = c->pos;
+        return len;
+    }
+
+    if (st->msg_size < len)
+    {
+        st->msg_size = mem_optimized_size(len);
+        st->msg = REALLOC(st->msg, st->msg_size);
+    }
+
+    for (; c != NULL && off < len; c = ds_dlist_next(&st->chunks, c))
+    {
+        const size_t n = MIN(len - off, c->remaining);
+        memcpy(st->msg + off, c->pos, n);
+        off += n;
+    }
+
+    *buf = st->msg;
     return len;
 }
 
@@ -177,32 +284,58 @@ static void ovsdb_stream_advance(struct ovsdb_stream *st, size_t bytes)
 
         ovsdb_stream_chunk_gc(st, c);
     }
+
+    ovsdb_stream_scan_reset(st);
 }
 
-json_t *ovsdb_stream_next_json(struct ovsdb_stream *st)
+static json_t *ovsdb_stream_parse(const char *buf, size_t len)
 {
-    const size_t flags = JSON_DISABLE_EOF_CHECK;
     json_error_t error;
     MEMZERO(error);
 
-    ovsdb_stream_iter_init(st);
-    json_t *json = json_load_callback(ovsdb_stream_next_json_cb, st, flags, &error);
-    if (json != NULL)
+    json_t *json = json_loadb(buf, len, 0, &error);
+    if (json == NULL)
     {
-        ovsdb_stream_advance(st, error.position);
+        LOG(ERR, "JSON RECV: Error parsing message: %s (position %d)", error.text, error.position);
     }
     return json;
 }
 
-static void ovsdb_stream_consume(struct ovsdb_stream *st, bool (*fn)(json_t *))
+json_t *ovsdb_stream_next_json(struct ovsdb_stream *st)
 {
+    const char *buf;
+    json_t *json;
+
     for (;;)
     {
-        json_t *json = ovsdb_stream_next_json(st);
-        if (json == NULL) break;
-        const bool handled = fn(json);
-        WARN_ON(handled == false);
-        json_decref(json);
+        const size_t len = ovsdb_stream_next_msg(st, &buf);
+        if (len == 0) return NULL;
+
+        json = ovsdb_stream_parse(buf, len);
+        ovsdb_stream_advance(st, len);
+        if (json != NULL) return json;
+    }
+}
+
+static void ovsdb_stream_consume(struct ovsdb_stream *st, bool (*fn)(json_t *))
+{
+    const char *buf;
+    size_t len;
+
+    while ((len = ovsdb_stream_next_msg(st, &buf)) > 0)
+    {
+        const bool raw = (st->raw_fn != NULL) && st->raw_fn(buf, len);
+        if (!raw)
+        {
+            json_t *json = ovsdb_stream_parse(buf, len);
+            if (json != NULL)
+            {
+                const bool handled = fn(json);
+                WARN_ON(handled == false);
+                json_decref(json);
+            }
+        }
+        ovsdb_stream_advance(st, len);
     }
 }
 
@@ -214,6 +347,11 @@ int ovsdb_stream_run(struct ovsdb_stream *st, int fd, bool (*fn)(json_t *))
     return 0;
 }
 
+void ovsdb_stream_set_raw_handler(struct ovsdb_stream *st, bool (*fn)(const char *buf, size_t len))
+{
+    st->raw_fn = fn;
+}
+
 struct ovsdb_stream *ovsdb_stream_alloc(void)
 {
     struct ovsdb_stream *st = MALLOC(sizeof(*st));
@@ -234,5 +372,6 @@ void ovsdb_stream_free(struct ovsdb_stream *st)
 {
     if (st == NULL) return;
     ovsdb_stream_free_chunks(&st->chunks);
+    FREE(st->msg);
     FREE(st);
 }
@@ -33,15 +33,20 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "memutil.h"
 #include "log.h"
 #include "json_util.h"
+#include "kconfig.h"
 #include "ovsdb.h"
 #include "ovsdb_priv.h"
 #include "ovsdb_update.h"
 #include "ovsdb_table.h"
+#include "ovsdb_cache.h"
 #include "ovsdb_sync.h"
 
 #define MODULE_ID LOG_MODULE_ID_OVSDB
 
 void ovsdb_table_update_cb(ovsdb_update_monitor_t *self);
+static ovsdb_update_stream_t ovsdb_table_update_stream_cb;
+static void ovsdb_table_update_notify(ovsdb_update_monitor_t *self, ovsdb_table_t *table,
+        const char *typestr, char *old_record, char *record);
 
 int ovsdb_table_init(
     char                *table_name,
@@ -53,6 +58,7 @@ int ovsdb_table_init(
     schema_from_json_t  *from_json,
     schema_to_json_t    *to_json,
     schema_mark_changed_t *mark_changed,
+    const struct pjs_desc *desc,
     char                **columns)
 {
     memset(table, 0, sizeof(*table));
@@ -66,6 +72,7 @@ int ovsdb_table_init(
     table->from_json = from_json;
     table->to_json = to_json;
     table->mark_changed = mark_changed;
+    table->desc = desc;
     table->columns = columns;
     table->monitor_callback = ovsdb_table_update_cb;
     // cache
@@ -73,6 +80,7 @@ int ovsdb_table_init(
     ds_tree_init(&table->rows, (ds_key_cmp_t*)strcmp, ovsdb_cache_row_t, node);
     ds_tree_init(&table->rows_k, (ds_key_cmp_t*)strcmp, ovsdb_cache_row_t, node_k);
     ds_tree_init(&table->rows_k2, (ds_key_cmp_t*)strcmp, ovsdb_cache_row_t, node_k2);
+    ds_dlist_init(&table->indexes, ovsdb_cache_index_t, node);
     return 0;
 }
 
@@ -101,6 +109,7 @@ static void ovsdb_table_fini_monitor(ovsdb_update_monitor_t *mon, const char *ta
 
 void ovsdb_table_fini(ovsdb_table_t *table)
 {
+    ovsdb_cache_fini(table);
     ovsdb_table_fini_rows_unlink(&table->rows_k);
     ovsdb_table_fini_rows_unlink(&table->rows_k2);
     ovsdb_table_fini_rows_drop(&table->rows);
@@ -460,13 +469,43 @@ int ovsdb_table_delete_where_with_parent(ovsdb_table_t *table, json_t *where,
 // MONITOR
 
 
-bool ovsdb_table_monitor_columns(ovsdb_table_t *table,
-        ovsdb_table_callback_t *callback, char **columns)
+static bool ovsdb_table_monitor_where(ovsdb_table_t *table,
+        ovsdb_table_callback_t *callback, char **columns, json_t *where)
 {
     bool ret;
     int count = count_nt_array(columns);
+    // conditional monitors need the table layout to fill in omitted default
+    // values; stream parsing is supported only with plain monitors
+    bool cond = where != NULL || (kconfig_enabled(CONFIG_OVSDB_MONITOR_COND_SINCE)
+            && table->desc != NULL && !table->stream_update);
 
     if (!columns || !count)
+    {
+        count = 0;
+        columns = NULL;
+    }
+    else if (!is_array_in_array(table->columns, columns))
+    {
+        // not all schema columns present, enable partial updates in monitor callback
+        table->partial_update = true;
+    }
+
+    if (cond)
+    {
+        LOG(NOTICE, "Monitor: %s: cond where: %s partial: %s columns: %d", table->table_name,
+                where ? json_dumps_static(where, 0) : "true",
+                table->partial_update ? "true" : "false", count);
+        ret = ovsdb_update_monitor_cond(
+                &table->monitor,
+                table->monitor_callback,
+                table->table_name,
+                table->desc,
+                where,
+                OMT_ALL,
+                count,
+                columns);
+    }
+    else if (!columns)
     {
         LOG(NOTICE, "Monitor: %s: ALL", table->table_name);
         ret = ovsdb_update_monitor(
@@ -477,12 +516,6 @@ bool ovsdb_table_monitor_columns(ovsdb_table_t *table,
     }
     else
     {
-        // are all schema columns present?
-        if (!is_array_in_array(table->columns, columns))
-        {
-            // no, enable partial updates in monitor callback
-            table->partial_update = true;
-        }
         bool have_version = is_inarray("_version", count, columns);
         char tmp[1024];
         LOG(NOTICE, "Monitor: %s _version: %s partial: %s columns: %d %s", table->table_name,
@@ -504,9 +537,50 @@ bool ovsdb_table_monitor_columns(ovsdb_table_t *table,
     }
     table->monitor.mon_data = table;
     table->table_callback = callback;
+    if (table->stream_update && !cond)
+    {
+        ovsdb_set_update_stream_cb(table->monitor.mon_id, ovsdb_table_update_stream_cb);
+    }
     return true;
 }
 
+bool ovsdb_table_monitor_columns(ovsdb_table_t *table,
+        ovsdb_table_callback_t *callback, char **columns)
+{
+    return ovsdb_table_monitor_where(table, callback, columns, NULL);
+}
+
+bool ovsdb_table_monitor_cond(ovsdb_table_t *table,
+        ovsdb_table_callback_t *callback, char **columns, json_t *where)
+{
+    if (table->stream_update)
+    {
+        LOG(NOTICE, "Monitor: %s: stream parsing disabled for conditional monitor", table->table_name);
+        table->stream_update = false;
+    }
+    return ovsdb_table_monitor_where(table, callback, columns, where);
+}
+
+bool ovsdb_table_monitor_stream(ovsdb_table_t *table, bool enable)
+{
+    if (enable && !pjs_desc_is_streamable(table->desc))
+    {
+        LOG(WARN, "Monitor: %s: stream parsing not supported", table->table_name);
+        enable = false;
+    }
+    if (enable && table->monitor_callback != ovsdb_table_update_cb)
+    {
+        LOG(WARN, "Monitor: %s: stream parsing not supported for cache tables", table->table_name);
+        enable = false;
+    }
+    table->stream_update = enable;
+    if (table->monitor.mon_id != 0)
+    {
+        ovsdb_set_update_stream_cb(table->monitor.mon_id, enable ? ovsdb_table_update_stream_cb : NULL);
+    }
+    return enable;
+}
+
 // ignore_version can be used if we are not interested in receiving
 // updates for when a referenced table has been modified
 bool ovsdb_table_monitor(ovsdb_table_t *table,
@@ -560,7 +634,6 @@ void ovsdb_table_update_cb(ovsdb_update_monitor_t *self)
     ovsdb_table_t *table;
     pjs_errmsg_t perr;
     char *mon_uuid;
-    char *row_uuid;
     char *typestr;
     bool ret;
     int mon_type = self->mon_type;
@@ -645,6 +718,21 @@ void ovsdb_table_update_cb(ovsdb_update_monitor_t *self)
                 table->table_name, typestr, mon_uuid, perr);
         return;
     }
+
+    ovsdb_table_update_notify(self, table, typestr, old_record, record);
+}
+
+static void ovsdb_table_update_notify(
+        ovsdb_update_monitor_t *self,
+        ovsdb_table_t *table,
+        const char *typestr,
+        char *old_record,
+        char *record)
+{
+    const char *mon_uuid = self->mon_uuid;
+    int mon_type = self->mon_type;
+    char *row_uuid;
+
     // set _update_type
     int *_update_type = (int*)(record + table->upd_type_offset);
     *_update_type = mon_type;
@@ -665,6 +753,205 @@ void ovsdb_table_update_cb(ovsdb_update_monitor_t *self)
 
     LOG(DEBUG, "<<< DONE: MON upd: %s table: %s row: %s ver: %s",
         typestr, table->table_name, mon_uuid, record + table->version_offset);
+}
+
+/*
+ * The _uuid is not part of the row data in update notifications, it is the
+ * key of the row -- see ovsdb_update_monitor_process()
+ */
+static void ovsdb_table_stream_set_uuid(ovsdb_table_t *table, char *record, const char *uuid)
+{
+    const struct pjs_desc_field *f = pjs_desc_find(table->desc, "_uuid");
+    if (f == NULL) return;
+
+    strscpy(record + f->off, uuid, f->elem_sz);
+    *(bool *)(record + f->off_exists) = true;
+    *(bool *)(record + f->off_present) = true;
+}
+
+/*
+ * Parse a row object in the stream into @p record; on error the rest of the
+ * object is skipped so the stream stays in sync
+ */
+static bool ovsdb_table_stream_parse(
+        ovsdb_table_t *table,
+        struct pjs_stream *ps,
+        char *record,
+        bool update,
+        pjs_errmsg_t perr)
+{
+    struct pjs_stream save = *ps;
+
+    if (pjs_stream_from_json(table->desc, record, ps, update, perr)) return true;
+
+    *ps = save;
+    pjs_stream_skip(ps);
+    return false;
+}
+
+/*
+ * Process a single row of a streamed update:
+ *
+ * "UUID" : { "old": { ... }, "new": { ... } }
+ */
+static bool ovsdb_table_update_stream_row(
+        ovsdb_update_monitor_t *self,
+        ovsdb_table_t *table,
+        const char *mon_uuid,
+        struct pjs_stream *ps)
+{
+    char record[table->schema_size];
+    char old_record[table->schema_size];
+    bool partial = table->partial_update;
+    struct pjs_stream ps_old;
+    bool has_new = false;
+    bool has_old = false;
+    bool ok_new = true;
+    bool ok_old = true;
+    pjs_errmsg_t perr_new;
+    pjs_errmsg_t perr_old;
+    char *typestr;
+    char key[8];
+    bool end;
+
+    memset(old_record, 0, sizeof(old_record));
+    memset(record, 0, sizeof(record));
+
+    if (pjs_stream_next(ps) != PJS_TOK_OBJ_START)
+    {
+        LOG(ERR, "UPDATE: Row data is not an object!");
+        return false;
+    }
+
+    for (;;)
+    {
+        if (!pjs_stream_key(ps, key, sizeof(key), &end)) return false;
+        if (end) break;
+
+        if (strcmp(key, "new") == 0)
+        {
+            has_new = true;
+            ok_new = ovsdb_table_stream_parse(table, ps, record, partial, perr_new);
+        }
+        else if (strcmp(key, "old") == 0)
+        {
+            has_old = true;
+            ps_old = *ps;
+            ok_old = ovsdb_table_stream_parse(table, ps, old_record, true, perr_old);
+        }
+        else if (!pjs_stream_skip(ps))
+        {
+            return false;
+        }
+    }
+
+    if (has_new && !has_old)
+    {
+        self->mon_type = OVSDB_UPDATE_NEW;
+        typestr = "NEW";
+    }
+    else if (has_new && has_old)
+    {
+        self->mon_type = OVSDB_UPDATE_MODIFY;
+        typestr = "MOD";
+    }
+    else if (has_old)
+    {
+        // on DELETE the record is the full old record, parse it again
+        self->mon_type = OVSDB_UPDATE_DEL;
+        typestr = "DEL";
+        ok_new = ovsdb_table_stream_parse(table, &ps_old, record, partial, perr_new);
+    }
+    else
+    {
+        LOG(ERR, "Table %s update %s type error", table->table_name, mon_uuid);
+        return true;
+    }
 
-    return;
+    LOG(INFO, "MON upd: %s table: %s row: %s", typestr, table->table_name, mon_uuid);
+
+    if (!ok_old)
+    {
+        LOG(ERR, "Table %s %s parsing OLD %s error: %s",
+                table->table_name, typestr, mon_uuid, perr_old);
+        return true;
+    }
+    if (!ok_new)
+    {
+        LOG(ERR, "Table %s %s parsing %s error: %s",
+                table->table_name, typestr, mon_uuid, perr_new);
+        return true;
+    }
+
+    if (has_old) ovsdb_table_stream_set_uuid(table, old_record, mon_uuid);
+    ovsdb_table_stream_set_uuid(table, record, mon_uuid);
+
+    self->mon_uuid = mon_uuid;
+    self->mon_json_new = NULL;
+    self->mon_json_old = NULL;
+    self->mon_old_rec = old_record;
+    self->mon_desc = table->desc;
+
+    ovsdb_table_update_notify(self, table, typestr, old_record, record);
+
+    self->mon_old_rec = NULL;
+    self->mon_desc = NULL;
+    return true;
+}
+
+/*
+ * Streaming update handler, this replaces both ovsdb_update_monitor_process()
+ * and ovsdb_table_update_cb() for tables with stream_update enabled:
+ *
+ * { "TABLE": { "UUID": { ... }, ... }, ... }
+ */
+static bool ovsdb_table_update_stream_cb(int id, struct pjs_stream *ps, void *data)
+{
+    ovsdb_update_monitor_t *self = data;
+    ovsdb_table_t *table = self->mon_data;
+    char mon_table[OVSDB_TABLE_NAME_SIZE];
+    char mon_uuid[sizeof(ovs_uuid_t)];
+    bool end;
+
+    if (table == NULL || !table->stream_update) return false;
+
+    if (pjs_stream_next(ps) != PJS_TOK_OBJ_START)
+    {
+        LOG(ERR, "UPDATE: Update notification is not an object.");
+        return true;
+    }
+
+    for (;;)
+    {
+        if (!pjs_stream_key(ps, mon_table, sizeof(mon_table), &end)) goto error;
+        if (end) break;
+
+        // table integrity check
+        if (strcmp(table->table_name, mon_table))
+        {
+            LOG(ERR, "Table %s mismatch %s", table->table_name, mon_table);
+            if (!pjs_stream_skip(ps)) goto error;
+            continue;
+        }
+
+        if (pjs_stream_next(ps) != PJS_TOK_OBJ_START)
+        {
+            LOG(ERR, "UPDATE: Row is not an object.");
+            goto error;
+        }
+
+        self->mon_table = table->table_name;
+        for (;;)
+        {
+            if (!pjs_stream_key(ps, mon_uuid, sizeof(mon_uuid), &end)) goto error;
+            if (end) break;
+            if (!ovsdb_table_update_stream_row(self, table, mon_uuid, ps)) goto error;
+        }
+    }
+
+    return true;
+
+error:
+    LOG(ERR, "Table %s: malformed update notification", table->table_name);
+    return true;
 }
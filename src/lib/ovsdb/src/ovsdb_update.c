@@ -34,8 +34,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "log.h"
 #include "util.h"
 #include "json_util.h"
+#include "kconfig.h"
 #include "ovsdb.h"
 #include "ovsdb_update.h"
+#include "pjs_stream.h"
 
 /*
  * ===========================================================================
@@ -153,6 +155,7 @@ static ovsdb_update_process_t   ovsdb_update_monitor_call_cbk;
 static json_rpc_response_t      ovsdb_update_monitor_resp_cbk;
 static void                     ovsdb_update_monitor_process(ovsdb_update_monitor_t *self, json_t *js);
 static void                     ovsdb_update_monitor_error(ovsdb_update_monitor_t *self);
+static void                     ovsdb_update_cond_process(ovsdb_update_monitor_t *self, json_t *jtables, bool full);
 
 /*
  * ovsdb_update_monitor(_ex) -- Start monitoring an OVS table. For each update to the table, call the
@@ -243,6 +246,13 @@ void ovsdb_update_monitor_cancel_resp_cb(int id, bool is_error, json_t *js, void
     }
 }
 
+// a cancelled monitor does not need to be resumed after a reconnect
+static bool ovsdb_update_monitor_cancel_resume_cb(int id, void *data)
+{
+    ovsdb_unregister_update_cb(id);
+    return true;
+}
+
 bool ovsdb_update_monitor_cancel(ovsdb_update_monitor_t *self, const char *table_name)
 {
     bool ret;
@@ -253,6 +263,13 @@ bool ovsdb_update_monitor_cancel(ovsdb_update_monitor_t *self, const char *table
     }
     // change cb to drop queued updates
     ovsdb_change_update_cb(self->mon_id, ovsdb_update_monitor_cancel_drop_cb, NULL);
+    ovsdb_set_update_resume_cb(self->mon_id, ovsdb_update_monitor_cancel_resume_cb);
+    json_decref(self->mon_cond_req);
+    json_decref(self->mon_cond_rows);
+    json_decref(self->mon_cond_defaults);
+    self->mon_cond_req = NULL;
+    self->mon_cond_rows = NULL;
+    self->mon_cond_defaults = NULL;
     void *data = (void*)(intptr_t)self->mon_id;
     ret = ovsdb_monitor_cancel_call(ovsdb_update_monitor_cancel_resp_cb, data, self->mon_id, table_name);
     return ret;
@@ -280,12 +297,6 @@ void ovsdb_update_monitor_call_cbk(int id, json_t *js, void *data)
     }
 
 
-    if (strcmp(method, "update") != 0)
-    {
-        LOG(ERR, "UPDATE: Method is not \"update\": method=%s", method);
-        goto error;
-    }
-
     /* Inspect the "parameters" field */
     jparams = json_object_get(js, "params");
     if (jparams == NULL)
@@ -294,6 +305,26 @@ void ovsdb_update_monitor_call_cbk(int id, json_t *js, void *data)
         goto error;
     }
 
+    /* Conditional monitor updates, the params array is: [ value, {} ] or [ value, txn, {} ] */
+    if (strcmp(method, "update2") == 0 && json_array_size(jparams) == 2)
+    {
+        ovsdb_update_cond_process(self, json_array_get(jparams, 1), false);
+        return;
+    }
+
+    if (strcmp(method, "update3") == 0 && json_array_size(jparams) == 3)
+    {
+        STRSCPY_WARN(self->mon_cond_txn, json_string_value(json_array_get(jparams, 1)) ?: OVSDB_TXN_ID_NONE);
+        ovsdb_update_cond_process(self, json_array_get(jparams, 2), false);
+        return;
+    }
+
+    if (strcmp(method, "update") != 0)
+    {
+        LOG(ERR, "UPDATE: Method is not \"update\": method=%s", method);
+        goto error;
+    }
+
     /* The params array is in the following format: [ value, {} ] */
     if (json_array_size(jparams) != 2)
     {
@@ -440,6 +471,621 @@ void ovsdb_update_monitor_error(ovsdb_update_monitor_t *self)
     self->mon_cb(self);
 }
 
+/*
+ * ===========================================================================
+ *  OVSDB Conditional Monitor
+ * ===========================================================================
+ *
+ * The monitor_cond and monitor_cond_since methods report changes in the
+ * update2 format:
+ *
+ *  -- "initial" and "insert" rows omit columns with default values
+ *  -- "modify" contains only the differences; the new value for scalar
+ *     columns, the symmetric difference for sets and the changed key-value
+ *     pairs for maps
+ *  -- "delete" does not contain the row
+ *
+ * A copy of the monitored rows is kept and the differences are converted
+ * to the "update" format ("new" with the full row and "old" with the old
+ * values of the changed columns), so the existing update callbacks can be
+ * used as they are.
+ *
+ * The copy is also used to resume the monitor after a reconnect -- if the
+ * server does not know the last transaction id, it replies with all rows
+ * and only rows that actually differ from the copy are reported.
+ */
+
+static json_rpc_response_t      ovsdb_update_cond_resp_cbk;
+static ovsdb_update_resume_t    ovsdb_update_cond_resume_cb;
+
+/* Best monitor method supported by the server, downgraded on "unknown method" errors */
+static ovsdb_mt_t ovsdb_update_cond_method = MT_MONITOR_COND_SINCE;
+
+/*
+ * Create the default values of the monitored columns
+ */
+static json_t *ovsdb_update_cond_defaults(const struct pjs_desc *desc, int colc, char *colv[])
+{
+    const struct pjs_desc_field *f;
+    json_t *jdef;
+    json_t *jval;
+
+    jdef = json_object();
+    if (desc == NULL) return jdef;
+
+    for (f = desc->fields; f < desc->fields + desc->num; f++)
+    {
+        /* _uuid and _version are never omitted */
+        if (f->name[0] == '_') continue;
+        if (colc > 0 && !is_inarray(f->name, colc, colv)) continue;
+
+        jval = NULL;
+        switch (f->kind)
+        {
+            case PJS_DESC_OVS_BASIC:
+                if (f->optional)
+                {
+                    jval = json_pack("[s[]]", "set");
+                    break;
+                }
+
+                switch (f->type)
+                {
+                    case PJS_DESC_T_INT:
+                    case PJS_DESC_T_INT64:
+                        jval = json_integer(0);
+                        break;
+
+                    case PJS_DESC_T_BOOL:
+                        jval = json_false();
+                        break;
+
+                    case PJS_DESC_T_REAL:
+                        jval = json_real(0.0);
+                        break;
+
+                    case PJS_DESC_T_STRING:
+                        jval = json_string("");
+                        break;
+
+                    case PJS_DESC_T_UUID:
+                        jval = json_pack("[ss]", "uuid", "00000000-0000-0000-0000-000000000000");
+                        break;
+                }
+                break;
+
+            case PJS_DESC_OVS_SET:
+                jval = json_pack("[s[]]", "set");
+                break;
+
+            case PJS_DESC_OVS_SMAP:
+            case PJS_DESC_OVS_DMAP:
+                jval = json_pack("[s[]]", "map");
+                break;
+
+            default:
+                break;
+        }
+
+        if (jval != NULL) json_object_set_new(jdef, f->name, jval);
+    }
+
+    return jdef;
+}
+
+/*
+ * Return the elements of an OVS set or map value, or NULL if @p jval is
+ * not of type @p type ("set" or "map")
+ */
+static json_t *ovsdb_update_cond_elems(json_t *jval, const char *type)
+{
+    if (!json_is_array(jval) || json_array_size(jval) != 2) return NULL;
+    if (!json_is_string(json_array_get(jval, 0))) return NULL;
+    if (strcmp(json_string_value(json_array_get(jval, 0)), type) != 0) return NULL;
+    return json_array_get(jval, 1);
+}
+
+/*
+ * Single element sets are encoded as the element itself
+ */
+static json_t *ovsdb_update_cond_set_new(json_t *jelems)
+{
+    if (json_array_size(jelems) == 1)
+    {
+        json_t *jval = json_incref(json_array_get(jelems, 0));
+        json_decref(jelems);
+        return jval;
+    }
+
+    return json_pack("[so]", "set", jelems);
+}
+
+static int ovsdb_update_cond_find(json_t *jelems, json_t *jval, bool map)
+{
+    size_t ii;
+
+    for (ii = 0; ii < json_array_size(jelems); ii++)
+    {
+        json_t *jel = json_array_get(jelems, ii);
+        if (map) jel = json_array_get(jel, 0);
+        if (json_equal(jel, jval)) return (int)ii;
+    }
+
+    return -1;
+}
+
+/*
+ * Apply the update2 difference @p jdiff to the column value @p jold; the
+ * column type is derived from the default value @p jdef
+ */
+static json_t *ovsdb_update_cond_apply(json_t *jold, json_t *jdiff, json_t *jdef)
+{
+    json_t *jelems;
+    json_t *jdelems;
+    json_t *jel;
+    size_t ii;
+    int idx;
+
+    if (jdef != NULL && ovsdb_update_cond_elems(jdef, "map") != NULL)
+    {
+        jdelems = ovsdb_update_cond_elems(jdiff, "map");
+        jelems = json_copy(ovsdb_update_cond_elems(jold, "map"));
+        if (jdelems == NULL || jelems == NULL)
+        {
+            json_decref(jelems);
+            return NULL;
+        }
+
+        /* Key with the same value: removed, different value: changed, new key: added */
+        json_array_foreach(jdelems, ii, jel)
+        {
+            idx = ovsdb_update_cond_find(jelems, json_array_get(jel, 0), true);
+            if (idx < 0)
+            {
+                json_array_append(jelems, jel);
+            }
+            else if (json_equal(json_array_get(json_array_get(jelems, idx), 1), json_array_get(jel, 1)))
+            {
+                json_array_remove(jelems, idx);
+            }
+            else
+            {
+                json_array_set_new(jelems, idx, json_incref(jel));
+            }
+        }
+
+        return json_pack("[so]", "map", jelems);
+    }
+
+    if (jdef != NULL && ovsdb_update_cond_elems(jdef, "set") != NULL)
+    {
+        jelems = ovsdb_update_cond_elems(jold, "set");
+        jelems = (jelems != NULL) ? json_copy(jelems) : json_pack("[O]", jold);
+
+        jdelems = ovsdb_update_cond_elems(jdiff, "set");
+        if (jdelems == NULL)
+        {
+            /* Single element difference */
+            idx = ovsdb_update_cond_find(jelems, jdiff, false);
+            if (idx < 0) json_array_append(jelems, jdiff);
+            else json_array_remove(jelems, idx);
+            return ovsdb_update_cond_set_new(jelems);
+        }
+
+        /* Symmetric difference */
+        json_array_foreach(jdelems, ii, jel)
+        {
+            idx = ovsdb_update_cond_find(jelems, jel, false);
+            if (idx < 0) json_array_append(jelems, jel);
+            else json_array_remove(jelems, idx);
+        }
+
+        return ovsdb_update_cond_set_new(jelems);
+    }
+
+    /* Scalar, the difference is the new value */
+    return json_incref(jdiff);
+}
+
+/*
+ * Compare two column values, ignoring the order of set and map elements
+ */
+static bool ovsdb_update_cond_equal(json_t *ja, json_t *jb)
+{
+    json_t *jea;
+    json_t *jeb;
+    json_t *jel;
+    bool map = false;
+    size_t ii;
+    int idx;
+
+    if (json_equal(ja, jb)) return true;
+
+    jea = ovsdb_update_cond_elems(ja, "set");
+    jeb = ovsdb_update_cond_elems(jb, "set");
+    if (jea == NULL || jeb == NULL)
+    {
+        jea = ovsdb_update_cond_elems(ja, "map");
+        jeb = ovsdb_update_cond_elems(jb, "map");
+        map = true;
+    }
+
+    if (jea == NULL || jeb == NULL) return false;
+    if (json_array_size(jea) != json_array_size(jeb)) return false;
+
+    json_array_foreach(jea, ii, jel)
+    {
+        idx = ovsdb_update_cond_find(jeb, map ? json_array_get(jel, 0) : jel, map);
+        if (idx < 0) return false;
+        if (map && !json_equal(json_array_get(json_array_get(jeb, idx), 1), json_array_get(jel, 1))) return false;
+    }
+
+    return true;
+}
+
+/*
+ * Add a row in the "update" format to @p jtbl; the reference to @p jnew is
+ * stolen, @p jold is copied
+ */
+static void ovsdb_update_cond_emit(json_t *jtbl, const char *uuid, json_t *jnew, json_t *jold)
+{
+    json_t *jrow = json_object();
+
+    /* ovsdb_update_monitor_process() adds the _uuid, do not touch the stored rows */
+    if (jnew != NULL) json_object_set_new(jrow, "new", jnew);
+    if (jold != NULL) json_object_set_new(jrow, "old", json_copy(jold));
+
+    json_object_set_new(jtbl, uuid, jrow);
+}
+
+/*
+ * Convert a single row from the update2 to the update format and update the
+ * stored copy of the row
+ */
+static void ovsdb_update_cond_row(
+        ovsdb_update_monitor_t *self,
+        json_t *jtbl,
+        const char *uuid,
+        json_t *jrow2)
+{
+    const char *col;
+    json_t *jstored;
+    json_t *jdiff;
+    json_t *jnew;
+    json_t *jold;
+    json_t *jval;
+    json_t *jdef;
+
+    jstored = json_object_get(self->mon_cond_rows, uuid);
+
+    jval = json_object_get(jrow2, "initial");
+    if (jval == NULL) jval = json_object_get(jrow2, "insert");
+    if (json_is_object(jval))
+    {
+        jnew = json_copy(jval);
+        json_object_foreach(self->mon_cond_defaults, col, jdef)
+        {
+            if (json_object_get(jnew, col) == NULL) json_object_set(jnew, col, jdef);
+        }
+
+        if (jstored == NULL)
+        {
+            ovsdb_update_cond_emit(jtbl, uuid, json_copy(jnew), NULL);
+        }
+        else
+        {
+            /* Known row (resync), report only the changed columns */
+            jold = json_object();
+            json_object_foreach(jstored, col, jval)
+            {
+                if (!ovsdb_update_cond_equal(jval, json_object_get(jnew, col)))
+                {
+                    json_object_set(jold, col, jval);
+                }
+            }
+
+            if (json_object_size(jold) > 0)
+            {
+                ovsdb_update_cond_emit(jtbl, uuid, json_copy(jnew), jold);
+            }
+            json_decref(jold);
+        }
+
+        json_object_set_new(self->mon_cond_rows, uuid, jnew);
+        return;
+    }
+
+    jdiff = json_object_get(jrow2, "modify");
+    if (json_is_object(jdiff))
+    {
+        if (jstored == NULL)
+        {
+            LOG(ERR, "UPDATE: Modify of unknown row %s in table %s.",
+                    uuid, json_object_iter_key(json_object_iter(self->mon_cond_req)));
+            return;
+        }
+
+        jnew = json_copy(jstored);
+        jold = json_object();
+        json_object_foreach(jdiff, col, jval)
+        {
+            json_t *jprev = json_object_get(jstored, col);
+            json_t *jnext;
+
+            jdef = json_object_get(self->mon_cond_defaults, col);
+            if (jprev == NULL) jprev = jdef;
+
+            jnext = (jprev != NULL) ? ovsdb_update_cond_apply(jprev, jval, jdef) : json_incref(jval);
+            if (jnext == NULL)
+            {
+                LOG(ERR, "UPDATE: Invalid difference for column %s of row %s.", col, uuid);
+                continue;
+            }
+
+            if (jprev != NULL) json_object_set(jold, col, jprev);
+            json_object_set_new(jnew, col, jnext);
+        }
+
+        ovsdb_update_cond_emit(jtbl, uuid, json_copy(jnew), jold);
+        json_decref(jold);
+
+        json_object_set_new(self->mon_cond_rows, uuid, jnew);
+        return;
+    }
+
+    if (json_object_get(jrow2, "delete") != NULL)
+    {
+        if (jstored == NULL) return;
+
+        ovsdb_update_cond_emit(jtbl, uuid, NULL, jstored);
+        json_object_del(self->mon_cond_rows, uuid);
+        return;
+    }
+
+    LOG(ERR, "UPDATE: Unsupported row update for row %s.", uuid);
+}
+
+/*
+ * Process <table-updates2>; if @p full is set, @p jtables contains all rows
+ * and the stored rows that are missing are reported as deleted
+ */
+static void ovsdb_update_cond_process(ovsdb_update_monitor_t *self, json_t *jtables, bool full)
+{
+    const char *table;
+    const char *uuid;
+    json_t *jrows;
+    json_t *jrow;
+    json_t *jtbl;
+    json_t *jup;
+    void *iter;
+
+    if (self->mon_cond_rows == NULL)
+    {
+        LOG(ERR, "UPDATE: Conditional update on a regular monitor, ignoring.");
+        return;
+    }
+
+    if (!json_is_object(jtables))
+    {
+        LOG(ERR, "UPDATE: Error parsing OVSDB update2 notification.");
+        ovsdb_update_monitor_error(self);
+        return;
+    }
+
+    jup = json_object();
+    json_object_foreach(jtables, table, jrows)
+    {
+        jtbl = json_object();
+        json_object_foreach(jrows, uuid, jrow)
+        {
+            ovsdb_update_cond_row(self, jtbl, uuid, jrow);
+        }
+
+        if (full)
+        {
+            /* Rows that were deleted while the monitor was not active */
+            iter = json_object_iter(self->mon_cond_rows);
+            while (iter != NULL)
+            {
+                uuid = json_object_iter_key(iter);
+                jrow = json_object_iter_value(iter);
+                iter = json_object_iter_next(self->mon_cond_rows, iter);
+
+                if (json_object_get(jrows, uuid) != NULL) continue;
+
+                ovsdb_update_cond_emit(jtbl, uuid, NULL, jrow);
+                json_object_del(self->mon_cond_rows, uuid);
+            }
+        }
+
+        json_object_set_new(jup, table, jtbl);
+    }
+
+    /* An empty full reply means that all stored rows were deleted */
+    if (full && json_object_size(jtables) == 0 && json_object_size(self->mon_cond_rows) > 0)
+    {
+        table = json_object_iter_key(json_object_iter(self->mon_cond_req));
+        jtbl = json_object();
+        json_object_foreach(self->mon_cond_rows, uuid, jrow)
+        {
+            ovsdb_update_cond_emit(jtbl, uuid, NULL, jrow);
+        }
+        json_object_clear(self->mon_cond_rows);
+        json_object_set_new(jup, table, jtbl);
+    }
+
+    ovsdb_update_monitor_process(self, jup);
+    json_decref(jup);
+}
+
+static bool ovsdb_update_cond_send(ovsdb_update_monitor_t *self)
+{
+    return ovsdb_monit_req_call(
+            ovsdb_update_cond_resp_cbk,
+            self,
+            self->mon_cond_method,
+            self->mon_id,
+            self->mon_cond_req,
+            self->mon_cond_txn);
+}
+
+static bool ovsdb_update_cond_unknown_method(json_t *js)
+{
+    const char *err;
+
+    err = json_is_object(js) ? json_string_value(json_object_get(js, "error")) : json_string_value(js);
+    return err != NULL && strcmp(err, "unknown method") == 0;
+}
+
+/*
+ * Response to the monitor request
+ */
+static void ovsdb_update_cond_resp_cbk(int id, bool is_error, json_t *js, void *data)
+{
+    ovsdb_update_monitor_t *self = data;
+    bool full;
+
+    if (is_error && ovsdb_update_cond_unknown_method(js))
+    {
+        /* Older server, downgrade the method and retry */
+        if (self->mon_cond_method == MT_MONITOR_COND_SINCE)
+        {
+            self->mon_cond_method = MT_MONITOR_COND;
+        }
+        else if (self->mon_cond_method == MT_MONITOR_COND &&
+                 json_object_get(json_object_iter_value(json_object_iter(self->mon_cond_req)), "where") == NULL)
+        {
+            /* Plain monitor, the update format is handled by ovsdb_update_monitor_process() */
+            self->mon_cond_method = MT_MONITOR;
+            json_decref(self->mon_cond_rows);
+            self->mon_cond_rows = NULL;
+            ovsdb_set_update_resume_cb(self->mon_id, NULL);
+        }
+        else
+        {
+            LOG(ERR, "UPDATE: Conditional monitors not supported by the server.");
+            ovsdb_update_monitor_error(self);
+            return;
+        }
+
+        LOG(NOTICE, "UPDATE: Server does not support the monitor method, downgrading to %d.",
+                self->mon_cond_method);
+        ovsdb_update_cond_method = self->mon_cond_method;
+
+        if (!ovsdb_update_cond_send(self))
+        {
+            LOG(ERR, "UPDATE: Error sending monitor request.");
+            ovsdb_update_monitor_error(self);
+        }
+        return;
+    }
+
+    if (is_error)
+    {
+        LOG(ERR, "UPDATE: Response JSON-RPC returned error (rpc_id = %d).", id);
+        ovsdb_update_monitor_error(self);
+        return;
+    }
+
+    full = self->mon_cond_resync;
+    self->mon_cond_resync = false;
+
+    switch (self->mon_cond_method)
+    {
+        case MT_MONITOR_COND_SINCE:
+            /* [<found>, <last-txn-id>, <table-updates2>] */
+            if (!json_is_array(js) || json_array_size(js) != 3)
+            {
+                LOG(ERR, "UPDATE: Invalid monitor_cond_since response.");
+                ovsdb_update_monitor_error(self);
+                return;
+            }
+
+            STRSCPY_WARN(self->mon_cond_txn, json_string_value(json_array_get(js, 1)) ?: OVSDB_TXN_ID_NONE);
+            if (json_is_true(json_array_get(js, 0)))
+            {
+                LOG(INFO, "UPDATE: Monitor %d resumed, transaction %s", self->mon_id, self->mon_cond_txn);
+                full = false;
+            }
+            ovsdb_update_cond_process(self, json_array_get(js, 2), full);
+            break;
+
+        case MT_MONITOR_COND:
+            ovsdb_update_cond_process(self, js, full);
+            break;
+
+        default:
+            ovsdb_update_monitor_process(self, js);
+            break;
+    }
+}
+
+/*
+ * Re-issue the monitor after a reconnect
+ */
+static bool ovsdb_update_cond_resume_cb(int id, void *data)
+{
+    ovsdb_update_monitor_t *self = data;
+
+    if (self->mon_cond_rows == NULL) return false;
+
+    self->mon_cond_resync = true;
+    LOG(INFO, "UPDATE: Resuming monitor %d, transaction %s", id, self->mon_cond_txn);
+
+    return ovsdb_update_cond_send(self);
+}
+
+bool ovsdb_update_monitor_cond(
+        ovsdb_update_monitor_t *self,
+        ovsdb_update_cbk_t *callback,
+        char *mon_table,
+        const struct pjs_desc *desc,
+        json_t *where,
+        int mon_flags,
+        int colc,
+        char *colv[])
+{
+    memset(self, 0, sizeof(*self));
+    self->mon_cb = callback;
+    self->mon_cond_desc = desc;
+    self->mon_cond_rows = json_object();
+    self->mon_cond_defaults = ovsdb_update_cond_defaults(desc, colc, colv);
+    self->mon_cond_req = json_object();
+    json_object_set_new(self->mon_cond_req, mon_table, ovsdb_monit_request_argv(mon_flags, where, colc, colv));
+    STRSCPY(self->mon_cond_txn, OVSDB_TXN_ID_NONE);
+
+    self->mon_cond_method = ovsdb_update_cond_method;
+    if (!kconfig_enabled(CONFIG_OVSDB_MONITOR_COND_SINCE) && self->mon_cond_method == MT_MONITOR_COND_SINCE)
+    {
+        self->mon_cond_method = MT_MONITOR_COND;
+    }
+    /* A plain monitor cannot filter rows */
+    if (self->mon_cond_method == MT_MONITOR && where != NULL)
+    {
+        self->mon_cond_method = MT_MONITOR_COND;
+    }
+    if (self->mon_cond_method == MT_MONITOR)
+    {
+        json_decref(self->mon_cond_rows);
+        self->mon_cond_rows = NULL;
+    }
+
+    self->mon_id = ovsdb_register_update_cb(ovsdb_update_monitor_call_cbk, self);
+    if (self->mon_cond_rows != NULL)
+    {
+        ovsdb_set_update_resume_cb(self->mon_id, ovsdb_update_cond_resume_cb);
+    }
+
+    if (!ovsdb_update_cond_send(self))
+    {
+        LOG(ERR, "UPDATE: Error sending monitor request.");
+        return false;
+    }
+    LOG(INFO, "OVSDB monitor %s (method %d)", mon_table, self->mon_cond_method);
+
+    return true;
+}
+
 // return true if a field has changed in an update
 bool ovsdb_update_changed(ovsdb_update_monitor_t *self, char *field)
 {
@@ -464,6 +1110,15 @@ bool ovsdb_update_changed(ovsdb_update_monitor_t *self, char *field)
             // on MODIFY mark as changed if it exists in old
             // ovsdb will always send old values for fields that changed
             tname = "MOD";
+            if (self->mon_json_old == NULL && self->mon_desc != NULL)
+            {
+                // streamed update, the JSON is not available; old values
+                // were parsed in update mode and only the changed fields
+                // are marked as present
+                const struct pjs_desc_field *f = pjs_desc_find(self->mon_desc, field);
+                changed = (f != NULL) && *(bool *)((char *)self->mon_old_rec + f->off_present);
+                break;
+            }
             j_old = json_object_get(self->mon_json_old, field);
             if (j_old != NULL)
             {
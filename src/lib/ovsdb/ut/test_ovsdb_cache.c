@@ -0,0 +1,247 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stddef.h>
+#include <string.h>
+
+#include <jansson.h>
+
+#include "log.h"
+#include "memutil.h"
+#include "ovsdb.h"
+#include "ovsdb_cache.h"
+#include "ovsdb_table.h"
+#include "pjs_stream.h"
+#include "unity.h"
+#include "util.h"
+
+#define TEST_CACHE_PJS                          \
+    PJS(test_cache_row,                         \
+        PJS_OVS_UUID_Q(_uuid)                   \
+        PJS_OVS_UUID_Q(_version)                \
+        PJS_OVS_STRING(if_name, 16)             \
+        PJS_OVS_INT(mtu)                        \
+        PJS_OVS_STRING_Q(parent, 16)            \
+        PJS_OVS_SET_STRING(tags, 16, 4)         \
+        PJS_OVS_SMAP_STRING(other, 32, 4))
+
+#define PJS_GEN_TABLE TEST_CACHE_PJS
+#include "pjs_gen_h.h"
+#define PJS_GEN_TABLE TEST_CACHE_PJS
+#include "pjs_gen_c.h"
+#define PJS_GEN_TABLE TEST_CACHE_PJS
+#include "pjs_gen_desc.h"
+
+static ovsdb_table_t test_cache_table;
+
+static void test_cache_mark_changed(void *old, void *rec)
+{
+    (void)old;
+    (void)rec;
+}
+
+static void test_cache_setup(void)
+{
+    ovsdb_table_init(
+            "Test_Cache",
+            &test_cache_table,
+            sizeof(struct test_cache_row),
+            offsetof(struct test_cache_row, _update_type),
+            offsetof(struct test_cache_row, _uuid),
+            offsetof(struct test_cache_row, _version),
+            (schema_from_json_t *)test_cache_row_from_json,
+            NULL,
+            test_cache_mark_changed,
+            test_cache_row_pjs_desc(),
+            NULL);
+
+    test_cache_table.key_offset = offsetof(struct test_cache_row, if_name);
+    STRSCPY(test_cache_table.key_name, "if_name");
+    test_cache_table.monitor_callback = ovsdb_cache_update_cb;
+}
+
+/*
+ * Deliver a monitor update of @p type to the cache, @p jnew is a full row
+ */
+static void test_cache_update(ovsdb_update_type_t type, const char *uuid, const char *jnew)
+{
+    ovsdb_update_monitor_t mon;
+    json_error_t jerr;
+
+    memset(&mon, 0, sizeof(mon));
+    mon.mon_type = type;
+    mon.mon_table = "Test_Cache";
+    mon.mon_uuid = uuid;
+    mon.mon_data = &test_cache_table;
+    mon.mon_json_new = json_loads(jnew, 0, &jerr);
+    mon.mon_json_old = json_pack("{s:[s,s]}", "_uuid", "uuid", uuid);
+    TEST_ASSERT_NOT_NULL(mon.mon_json_new);
+
+    ovsdb_cache_update_cb(&mon);
+
+    json_decref(mon.mon_json_new);
+    json_decref(mon.mon_json_old);
+}
+
+static int test_cache_count(const char *column, const void *key)
+{
+    ovsdb_cache_index_iter_t iter;
+    ovsdb_cache_row_t *row;
+    int count = 0;
+
+    ovsdb_cache_index_foreach(&test_cache_table, column, key, iter, row)
+    {
+        count++;
+    }
+
+    return count;
+}
+
+#define TEST_CACHE_ROW(uuid, name, mtu, tags) \
+    "{\"_uuid\":[\"uuid\",\"" uuid "\"],\"_version\":[\"uuid\",\"v-" uuid "\"]," \
+    "\"if_name\":\"" name "\",\"mtu\":" #mtu ",\"parent\":[\"set\",[]]," \
+    "\"tags\":" tags ",\"other\":[\"map\",[]]}"
+
+void test_ovsdb_cache_index(void)
+{
+    struct test_cache_row *rec;
+    ovsdb_cache_mem_t mem;
+    int mtu;
+
+    test_cache_setup();
+
+    /* Index added before the rows are cached */
+    TEST_ASSERT_NOT_NULL(ovsdb_cache_index_add(&test_cache_table, "if_name", true));
+    TEST_ASSERT_NOT_NULL(ovsdb_cache_index_add(&test_cache_table, "tags", false));
+
+    /* Maps and unknown columns cannot be indexed */
+    TEST_ASSERT_NULL(ovsdb_cache_index_add(&test_cache_table, "other", false));
+    TEST_ASSERT_NULL(ovsdb_cache_index_add(&test_cache_table, "nothere", false));
+
+    test_cache_update(OVSDB_UPDATE_NEW, "u-1", TEST_CACHE_ROW("u-1", "eth0", 1500, "[\"set\",[\"a\",\"b\"]]"));
+    test_cache_update(OVSDB_UPDATE_NEW, "u-2", TEST_CACHE_ROW("u-2", "eth1", 1500, "\"a\""));
+    test_cache_update(OVSDB_UPDATE_NEW, "u-3", TEST_CACHE_ROW("u-3", "eth2", 9000, "[\"set\",[]]"));
+
+    /* Index added after the rows are cached */
+    TEST_ASSERT_NOT_NULL(ovsdb_cache_index_add(&test_cache_table, "mtu", false));
+
+    rec = ovsdb_cache_find_by_key(&test_cache_table, "eth1");
+    TEST_ASSERT_NOT_NULL(rec);
+    TEST_ASSERT_EQUAL_STRING("u-2", rec->_uuid.uuid);
+    TEST_ASSERT_NULL(ovsdb_cache_find_by_key(&test_cache_table, "eth9"));
+
+    rec = ovsdb_cache_find_by_uuid(&test_cache_table, "u-3");
+    TEST_ASSERT_NOT_NULL(rec);
+    TEST_ASSERT_EQUAL_STRING("eth2", rec->if_name);
+
+    TEST_ASSERT_EQUAL_INT(2, test_cache_count("tags", "a"));
+    TEST_ASSERT_EQUAL_INT(1, test_cache_count("tags", "b"));
+    TEST_ASSERT_EQUAL_INT(0, test_cache_count("tags", "c"));
+    mtu = 1500;
+    TEST_ASSERT_EQUAL_INT(2, test_cache_count("mtu", &mtu));
+    mtu = 9000;
+    TEST_ASSERT_EQUAL_INT(1, test_cache_count("mtu", &mtu));
+
+    /* Modify re-indexes the row */
+    test_cache_update(OVSDB_UPDATE_MODIFY, "u-1", TEST_CACHE_ROW("u-1", "eth0", 9000, "\"c\""));
+    TEST_ASSERT_EQUAL_INT(1, test_cache_count("tags", "a"));
+    TEST_ASSERT_EQUAL_INT(0, test_cache_count("tags", "b"));
+    TEST_ASSERT_EQUAL_INT(1, test_cache_count("tags", "c"));
+    mtu = 9000;
+    TEST_ASSERT_EQUAL_INT(2, test_cache_count("mtu", &mtu));
+
+    /* Delete removes the row from all indexes */
+    test_cache_update(OVSDB_UPDATE_DEL, "u-2", TEST_CACHE_ROW("u-2", "eth1", 1500, "\"a\""));
+    TEST_ASSERT_EQUAL_INT(0, test_cache_count("tags", "a"));
+    TEST_ASSERT_NULL(ovsdb_cache_find_by_key(&test_cache_table, "eth1"));
+    TEST_ASSERT_NULL(ovsdb_cache_find_by_uuid(&test_cache_table, "u-2"));
+    mtu = 1500;
+    TEST_ASSERT_EQUAL_INT(0, test_cache_count("mtu", &mtu));
+
+    /* Memory accounting: 2 rows, values: if_name 2 + tags 1 + mtu 2 */
+    ovsdb_cache_mem_get(&test_cache_table, &mem);
+    TEST_ASSERT_EQUAL_INT(2, mem.rows);
+    TEST_ASSERT_EQUAL_INT(2 * test_cache_table.row_size, mem.rows_bytes);
+    TEST_ASSERT_EQUAL_INT(3, mem.indexes);
+    TEST_ASSERT_EQUAL_INT(5, mem.index_entries);
+    TEST_ASSERT_TRUE(mem.index_bytes > 0);
+    TEST_ASSERT_EQUAL_INT(mem.rows_bytes + mem.index_bytes, mem.total_bytes);
+    TEST_ASSERT_TRUE(ovsdb_cache_mem_report() >= mem.total_bytes);
+
+    ovsdb_table_fini(&test_cache_table);
+}
+
+void test_ovsdb_cache_index_grow(void)
+{
+    ovsdb_cache_mem_t mem;
+    char uuid[32];
+    char name[16];
+    char row[512];
+    int ii;
+
+    test_cache_setup();
+    TEST_ASSERT_NOT_NULL(ovsdb_cache_index_add(&test_cache_table, "if_name", true));
+    TEST_ASSERT_NOT_NULL(ovsdb_cache_index_add(&test_cache_table, "mtu", false));
+
+    for (ii = 0; ii < 500; ii++)
+    {
+        snprintf(uuid, sizeof(uuid), "u-%d", ii);
+        snprintf(name, sizeof(name), "if%d", ii);
+        snprintf(row, sizeof(row),
+                "{\"_uuid\":[\"uuid\",\"%s\"],\"if_name\":\"%s\",\"mtu\":%d,"
+                "\"parent\":[\"set\",[]],\"tags\":[\"set\",[]],\"other\":[\"map\",[]]}",
+                uuid, name, ii % 10);
+        test_cache_update(OVSDB_UPDATE_NEW, uuid, row);
+    }
+
+    for (ii = 0; ii < 500; ii++)
+    {
+        struct test_cache_row *rec;
+
+        snprintf(name, sizeof(name), "if%d", ii);
+        rec = ovsdb_cache_find_by_index(&test_cache_table, "if_name", name);
+        TEST_ASSERT_NOT_NULL(rec);
+        TEST_ASSERT_EQUAL_INT(ii % 10, rec->mtu);
+    }
+
+    for (ii = 0; ii < 10; ii++)
+    {
+        TEST_ASSERT_EQUAL_INT(50, test_cache_count("mtu", &ii));
+    }
+
+    ovsdb_cache_mem_get(&test_cache_table, &mem);
+    TEST_ASSERT_EQUAL_INT(500, mem.rows);
+    TEST_ASSERT_EQUAL_INT(1000, mem.index_entries);
+
+    ovsdb_table_fini(&test_cache_table);
+    TEST_ASSERT_EQUAL_INT(0, ovsdb_cache_mem_report());
+}
+
+void run_test_ovsdb_cache(void)
+{
+    RUN_TEST(test_ovsdb_cache_index);
+    RUN_TEST(test_ovsdb_cache_index_grow);
+}
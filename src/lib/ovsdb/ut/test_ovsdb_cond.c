@@ -0,0 +1,386 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <jansson.h>
+
+#include "ds_tree.h"
+#include "log.h"
+#include "memutil.h"
+#include "ovsdb.h"
+#include "ovsdb_update.h"
+#include "pjs_stream.h"
+#include "unity.h"
+#include "util.h"
+
+#define TEST_COND_PJS                           \
+    PJS(test_cond_row,                          \
+        PJS_OVS_UUID_Q(_uuid)                   \
+        PJS_OVS_STRING(if_name, 16)             \
+        PJS_OVS_INT(mtu)                        \
+        PJS_OVS_STRING_Q(parent, 16)            \
+        PJS_OVS_SET_STRING(tags, 16, 4)         \
+        PJS_OVS_SMAP_STRING(other, 32, 4))
+
+#define PJS_GEN_TABLE TEST_COND_PJS
+#include "pjs_gen_h.h"
+#define PJS_GEN_TABLE TEST_COND_PJS
+#include "pjs_gen_c.h"
+#define PJS_GEN_TABLE TEST_COND_PJS
+#include "pjs_gen_desc.h"
+
+#define TEST_COND_MAX_EVENTS    8
+
+/* Exported by ovsdb.c */
+extern int json_rpc_fd;
+extern ds_tree_t json_rpc_handler_list;
+extern ds_tree_t json_rpc_update_handler_list;
+
+struct test_cond_event
+{
+    ovsdb_update_type_t     type;
+    char                    uuid[40];
+    struct test_cond_row    rec;
+    bool                    mtu_changed;
+    bool                    tags_changed;
+};
+
+static struct test_cond_event test_cond_events[TEST_COND_MAX_EVENTS];
+static int test_cond_nevents;
+static int test_cond_fd[2];
+
+static void test_cond_cb(ovsdb_update_monitor_t *self)
+{
+    struct test_cond_event *ev;
+    pjs_errmsg_t err;
+    json_t *jrec;
+
+    TEST_ASSERT_TRUE(test_cond_nevents < TEST_COND_MAX_EVENTS);
+    ev = &test_cond_events[test_cond_nevents++];
+    memset(ev, 0, sizeof(*ev));
+
+    ev->type = self->mon_type;
+    if (ev->type == OVSDB_UPDATE_ERROR) return;
+
+    STRSCPY(ev->uuid, self->mon_uuid);
+    ev->mtu_changed = ovsdb_update_changed(self, "mtu");
+    ev->tags_changed = ovsdb_update_changed(self, "tags");
+
+    /* Rows must be complete, even though the server omits default values */
+    jrec = (ev->type == OVSDB_UPDATE_DEL) ? self->mon_json_old : self->mon_json_new;
+    TEST_ASSERT_TRUE_MESSAGE(test_cond_row_from_json(&ev->rec, jrec, false, err), err);
+}
+
+static void test_cond_setup(void)
+{
+    TEST_ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, test_cond_fd));
+    fcntl(test_cond_fd[1], F_SETFL, O_NONBLOCK);
+    json_rpc_fd = test_cond_fd[0];
+    test_cond_nevents = 0;
+}
+
+static void test_cond_teardown(void)
+{
+    json_rpc_fd = -1;
+    close(test_cond_fd[0]);
+    close(test_cond_fd[1]);
+}
+
+/*
+ * Read the request sent to the server, returns the JSON-RPC id
+ */
+static int test_cond_request(const char *method, const char *txn)
+{
+    char buf[4096];
+    json_error_t jerr;
+    json_t *jparams;
+    json_t *js;
+    ssize_t len;
+    int id;
+
+    len = read(test_cond_fd[1], buf, sizeof(buf) - 1);
+    TEST_ASSERT_TRUE(len > 0);
+    buf[len] = '\0';
+
+    js = json_loads(buf, 0, &jerr);
+    TEST_ASSERT_NOT_NULL_MESSAGE(js, buf);
+    TEST_ASSERT_EQUAL_STRING(method, json_string_value(json_object_get(js, "method")));
+
+    jparams = json_object_get(js, "params");
+    if (txn != NULL)
+    {
+        TEST_ASSERT_EQUAL_INT(4, json_array_size(jparams));
+        TEST_ASSERT_EQUAL_STRING(txn, json_string_value(json_array_get(jparams, 3)));
+    }
+    else
+    {
+        TEST_ASSERT_EQUAL_INT(3, json_array_size(jparams));
+    }
+    TEST_ASSERT_NOT_NULL(json_object_get(json_array_get(jparams, 2), "Test_Table"));
+
+    id = json_integer_value(json_object_get(js, "id"));
+    json_decref(js);
+
+    return id;
+}
+
+/*
+ * Deliver a response to the request @p id
+ */
+static void test_cond_reply(int id, bool is_error, const char *str)
+{
+    struct rpc_response_handler *rh;
+    json_error_t jerr;
+    json_t *js;
+
+    js = json_loads(str, JSON_DECODE_ANY, &jerr);
+    TEST_ASSERT_NOT_NULL_MESSAGE(js, str);
+
+    rh = ds_tree_find(&json_rpc_handler_list, &id);
+    TEST_ASSERT_NOT_NULL(rh);
+    ds_tree_remove(&json_rpc_handler_list, rh);
+
+    test_cond_nevents = 0;
+    rh->rrh_callback(id, is_error, js, rh->data);
+
+    FREE(rh);
+    json_decref(js);
+}
+
+/*
+ * Deliver an update notification
+ */
+static void test_cond_notify(int mon_id, const char *str)
+{
+    struct rpc_update_handler *rh;
+    json_error_t jerr;
+    json_t *js;
+
+    js = json_loads(str, 0, &jerr);
+    TEST_ASSERT_NOT_NULL_MESSAGE(js, str);
+
+    rh = ds_tree_find(&json_rpc_update_handler_list, &mon_id);
+    TEST_ASSERT_NOT_NULL(rh);
+
+    test_cond_nevents = 0;
+    rh->rrh_callback(mon_id, js, rh->data);
+
+    json_decref(js);
+}
+
+static struct test_cond_event *test_cond_find(const char *uuid)
+{
+    int ii;
+
+    for (ii = 0; ii < test_cond_nevents; ii++)
+    {
+        if (strcmp(test_cond_events[ii].uuid, uuid) == 0) return &test_cond_events[ii];
+    }
+
+    return NULL;
+}
+
+void test_ovsdb_cond_monitor(void)
+{
+    ovsdb_update_monitor_t mon;
+    struct test_cond_event *ev;
+    char str[1024];
+    int id;
+
+    test_cond_setup();
+
+    TEST_ASSERT_TRUE(ovsdb_update_monitor_cond(
+            &mon,
+            test_cond_cb,
+            "Test_Table",
+            test_cond_row_pjs_desc(),
+            ovsdb_tran_cond(OCLM_STR, "if_name", OFUNC_NEQ, "lo"),
+            OMT_ALL,
+            0,
+            NULL));
+
+    id = test_cond_request("monitor_cond_since", OVSDB_TXN_ID_NONE);
+
+    /* Initial rows, default values omitted */
+    test_cond_reply(id, false,
+            "[false,\"txn-1\",{\"Test_Table\":{"
+            "\"u1\":{\"initial\":{\"if_name\":\"eth0\",\"mtu\":1500}},"
+            "\"u2\":{\"initial\":{\"if_name\":\"eth1\",\"mtu\":1500,\"tags\":\"x\"}}}}]");
+    TEST_ASSERT_EQUAL_INT(2, test_cond_nevents);
+    ev = test_cond_find("u1");
+    TEST_ASSERT_NOT_NULL(ev);
+    TEST_ASSERT_EQUAL(OVSDB_UPDATE_NEW, ev->type);
+    TEST_ASSERT_EQUAL_STRING("eth0", ev->rec.if_name);
+    TEST_ASSERT_FALSE(ev->rec.parent_exists);
+    TEST_ASSERT_EQUAL_INT(0, ev->rec.tags_len);
+    TEST_ASSERT_EQUAL_STRING("txn-1", mon.mon_cond_txn);
+
+    /* Differences: scalar, set and map */
+    test_cond_notify(mon.mon_id,
+            "{\"method\":\"update3\",\"params\":[1,\"txn-2\",{\"Test_Table\":{"
+            "\"u1\":{\"modify\":{\"mtu\":1400,\"tags\":[\"set\",[\"a\",\"b\"]],"
+            "\"other\":[\"map\",[[\"k1\",\"v1\"],[\"k2\",\"v2\"]]]}}}}]}");
+    TEST_ASSERT_EQUAL_INT(1, test_cond_nevents);
+    ev = &test_cond_events[0];
+    TEST_ASSERT_EQUAL(OVSDB_UPDATE_MODIFY, ev->type);
+    TEST_ASSERT_TRUE(ev->mtu_changed);
+    TEST_ASSERT_EQUAL_INT(1400, ev->rec.mtu);
+    TEST_ASSERT_EQUAL_INT(2, ev->rec.tags_len);
+    TEST_ASSERT_EQUAL_INT(2, ev->rec.other_len);
+    TEST_ASSERT_EQUAL_STRING("eth0", ev->rec.if_name);
+    TEST_ASSERT_EQUAL_STRING("txn-2", mon.mon_cond_txn);
+
+    /* Symmetric difference of sets, map key removal and change */
+    test_cond_notify(mon.mon_id,
+            "{\"method\":\"update3\",\"params\":[1,\"txn-3\",{\"Test_Table\":{"
+            "\"u1\":{\"modify\":{\"tags\":[\"set\",[\"a\",\"c\"]],\"parent\":\"br0\","
+            "\"other\":[\"map\",[[\"k1\",\"v1\"],[\"k2\",\"v3\"]]]}}}}]}");
+    TEST_ASSERT_EQUAL_INT(1, test_cond_nevents);
+    ev = &test_cond_events[0];
+    TEST_ASSERT_FALSE(ev->mtu_changed);
+    TEST_ASSERT_TRUE(ev->tags_changed);
+    TEST_ASSERT_EQUAL_INT(2, ev->rec.tags_len);
+    TEST_ASSERT_EQUAL_STRING("b", ev->rec.tags[0]);
+    TEST_ASSERT_EQUAL_STRING("c", ev->rec.tags[1]);
+    TEST_ASSERT_TRUE(ev->rec.parent_exists);
+    TEST_ASSERT_EQUAL_STRING("br0", ev->rec.parent);
+    TEST_ASSERT_EQUAL_INT(1, ev->rec.other_len);
+    TEST_ASSERT_EQUAL_STRING("k2", ev->rec.other_keys[0]);
+    TEST_ASSERT_EQUAL_STRING("v3", ev->rec.other[0]);
+
+    /* Optional value removed: the difference contains the old value */
+    test_cond_notify(mon.mon_id,
+            "{\"method\":\"update3\",\"params\":[1,\"txn-4\",{\"Test_Table\":{"
+            "\"u1\":{\"modify\":{\"parent\":\"br0\"}},"
+            "\"u3\":{\"insert\":{\"if_name\":\"eth2\",\"mtu\":9000}}}}]}");
+    TEST_ASSERT_EQUAL_INT(2, test_cond_nevents);
+    ev = test_cond_find("u1");
+    TEST_ASSERT_FALSE(ev->rec.parent_exists);
+    ev = test_cond_find("u3");
+    TEST_ASSERT_EQUAL(OVSDB_UPDATE_NEW, ev->type);
+
+    /* Delete, the old row is reported in full */
+    test_cond_notify(mon.mon_id,
+            "{\"method\":\"update3\",\"params\":[1,\"txn-5\",{\"Test_Table\":{"
+            "\"u2\":{\"delete\":null}}}]}");
+    TEST_ASSERT_EQUAL_INT(1, test_cond_nevents);
+    TEST_ASSERT_EQUAL(OVSDB_UPDATE_DEL, test_cond_events[0].type);
+    TEST_ASSERT_EQUAL_STRING("eth1", test_cond_events[0].rec.if_name);
+    TEST_ASSERT_EQUAL_STRING("x", test_cond_events[0].rec.tags[0]);
+
+    /*
+     * Reconnect, the server does not know the transaction: only the rows
+     * that differ from the stored copy are reported
+     */
+    {
+        struct rpc_update_handler *rh = ds_tree_find(&json_rpc_update_handler_list, &mon.mon_id);
+        TEST_ASSERT_NOT_NULL(rh->rrh_resume);
+        TEST_ASSERT_TRUE(rh->rrh_resume(mon.mon_id, rh->data));
+    }
+    id = test_cond_request("monitor_cond_since", "txn-5");
+    snprintf(str, sizeof(str),
+            "[false,\"txn-9\",{\"Test_Table\":{"
+            "\"u1\":{\"initial\":{\"if_name\":\"eth0\",\"mtu\":1400,\"tags\":[\"set\",[\"c\",\"b\"]],"
+                    "\"other\":[\"map\",[[\"k2\",\"v3\"]]]}},"
+            "\"u4\":{\"initial\":{\"if_name\":\"eth4\",\"mtu\":1500}}}}]");
+    test_cond_reply(id, false, str);
+    TEST_ASSERT_EQUAL_INT(2, test_cond_nevents);
+    TEST_ASSERT_NULL(test_cond_find("u1"));
+    ev = test_cond_find("u3");
+    TEST_ASSERT_NOT_NULL(ev);
+    TEST_ASSERT_EQUAL(OVSDB_UPDATE_DEL, ev->type);
+    ev = test_cond_find("u4");
+    TEST_ASSERT_NOT_NULL(ev);
+    TEST_ASSERT_EQUAL(OVSDB_UPDATE_NEW, ev->type);
+
+    /* Reconnect, transaction found: only the changes are sent */
+    {
+        struct rpc_update_handler *rh = ds_tree_find(&json_rpc_update_handler_list, &mon.mon_id);
+        TEST_ASSERT_TRUE(rh->rrh_resume(mon.mon_id, rh->data));
+    }
+    id = test_cond_request("monitor_cond_since", "txn-9");
+    test_cond_reply(id, false,
+            "[true,\"txn-10\",{\"Test_Table\":{"
+            "\"u4\":{\"modify\":{\"mtu\":1280}}}}]");
+    TEST_ASSERT_EQUAL_INT(1, test_cond_nevents);
+    TEST_ASSERT_EQUAL(OVSDB_UPDATE_MODIFY, test_cond_events[0].type);
+    TEST_ASSERT_EQUAL_INT(1280, test_cond_events[0].rec.mtu);
+    TEST_ASSERT_EQUAL_STRING("txn-10", mon.mon_cond_txn);
+
+    TEST_ASSERT_TRUE(ovsdb_update_monitor_cancel(&mon, "Test_Table"));
+    test_cond_teardown();
+}
+
+/*
+ * Older servers: monitor_cond_since -> monitor_cond -> monitor
+ */
+void test_ovsdb_cond_fallback(void)
+{
+    ovsdb_update_monitor_t mon;
+    int id;
+
+    test_cond_setup();
+
+    TEST_ASSERT_TRUE(ovsdb_update_monitor_cond(
+            &mon,
+            test_cond_cb,
+            "Test_Table",
+            test_cond_row_pjs_desc(),
+            NULL,
+            OMT_ALL,
+            0,
+            NULL));
+
+    id = test_cond_request("monitor_cond_since", OVSDB_TXN_ID_NONE);
+    test_cond_reply(id, true, "\"unknown method\"");
+    TEST_ASSERT_EQUAL_INT(0, test_cond_nevents);
+
+    id = test_cond_request("monitor_cond", NULL);
+    test_cond_reply(id, true, "{\"error\":\"unknown method\"}");
+    TEST_ASSERT_EQUAL_INT(0, test_cond_nevents);
+
+    /* Plain monitor, update format */
+    id = test_cond_request("monitor", NULL);
+    test_cond_reply(id, false,
+            "{\"Test_Table\":{\"u1\":{\"new\":{\"if_name\":\"eth0\",\"mtu\":1500,"
+            "\"parent\":[\"set\",[]],\"tags\":[\"set\",[]],\"other\":[\"map\",[]]}}}}");
+    TEST_ASSERT_EQUAL_INT(1, test_cond_nevents);
+    TEST_ASSERT_EQUAL(OVSDB_UPDATE_NEW, test_cond_events[0].type);
+
+    TEST_ASSERT_TRUE(ovsdb_update_monitor_cancel(&mon, "Test_Table"));
+    test_cond_teardown();
+}
+
+void run_test_ovsdb_cond(void)
+{
+    RUN_TEST(test_ovsdb_cond_monitor);
+    /* Must be last, the downgraded method is remembered */
+    RUN_TEST(test_ovsdb_cond_fallback);
+}
@@ -0,0 +1,397 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <jansson.h>
+
+#include "log.h"
+#include "util.h"
+#include "ovsdb_stream.h"
+#include "pjs_stream.h"
+#include "unity.h"
+
+/*
+ * Local test structure; covers all field kinds supported by the streaming
+ * parser
+ */
+#define TEST_STREAM_PJS                         \
+    PJS(test_stream_row,                        \
+        PJS_OVS_UUID_Q(_uuid)                   \
+        PJS_OVS_UUID_Q(_version)                \
+        PJS_OVS_STRING(hwaddr, 32)              \
+        PJS_OVS_STRING_Q(hostname, 64)          \
+        PJS_OVS_INT(lease_time)                 \
+        PJS_OVS_INT64_Q(bytes)                  \
+        PJS_OVS_BOOL(enabled)                   \
+        PJS_OVS_REAL(rssi)                      \
+        PJS_OVS_SET_STRING(tags, 32, 4)         \
+        PJS_OVS_SET_UUID(refs, 4)               \
+        PJS_OVS_SMAP_STRING(info, 64, 8)        \
+        PJS_OVS_DMAP_INT(ports, 4))
+
+#define PJS_GEN_TABLE TEST_STREAM_PJS
+#include "pjs_gen_h.h"
+#define PJS_GEN_TABLE TEST_STREAM_PJS
+#include "pjs_gen_c.h"
+#define PJS_GEN_TABLE TEST_STREAM_PJS
+#include "pjs_gen_desc.h"
+
+#define TEST_UUID1  "0a7d3e6e-1f8c-4b6a-9d2e-3c4b5a697801"
+#define TEST_UUID2  "0a7d3e6e-1f8c-4b6a-9d2e-3c4b5a697802"
+
+#define TEST_ROW_FULL                                                       \
+    "{\"_uuid\":[\"uuid\",\"" TEST_UUID1 "\"],"                             \
+    "\"_version\":[\"uuid\",\"" TEST_UUID2 "\"],"                           \
+    "\"hwaddr\":\"aa:bb:cc:dd:ee:ff\","                                     \
+    "\"hostname\":\"caf\\u00e9 \\\"host\\\"\\n\","                          \
+    "\"lease_time\":3600,"                                                  \
+    "\"bytes\":8589934592,"                                                 \
+    "\"enabled\":true,"                                                     \
+    "\"rssi\":-61.5,"                                                       \
+    "\"tags\":[\"set\",[\"a\",\"b\",\"c\"]],"                               \
+    "\"refs\":[\"set\",[[\"uuid\",\"" TEST_UUID1 "\"],"                     \
+                       "[\"uuid\",\"" TEST_UUID2 "\"]]],"                   \
+    "\"info\":[\"map\",[[\"vendor\",\"ACME\"],[\"model\",\"X1\"]]],"        \
+    "\"ports\":[\"map\",[[80,1],[443,2]]],"                                 \
+    "\"unknown\":{\"nested\":[1,2,{\"x\":\"]}\"}]}}"
+
+static const char *test_name = "test_ovsdb_stream";
+
+/*
+ * Parse @p str using both the jansson and the streaming path and verify that
+ * the results are identical
+ */
+static void test_stream_compare(const char *str, bool update, bool expect)
+{
+    struct test_stream_row rj;
+    struct test_stream_row rs;
+    struct pjs_stream ps;
+    pjs_errmsg_t err;
+    json_error_t jerr;
+    bool rvj;
+    bool rvs;
+    json_t *js;
+
+    memset(&rj, 0, sizeof(rj));
+    memset(&rs, 0, sizeof(rs));
+
+    js = json_loads(str, 0, &jerr);
+    TEST_ASSERT_NOT_NULL_MESSAGE(js, str);
+    rvj = test_stream_row_from_json(&rj, js, update, err);
+    json_decref(js);
+
+    pjs_stream_init(&ps, str, strlen(str));
+    rvs = pjs_stream_from_json(test_stream_row_pjs_desc(), &rs, &ps, update, err);
+
+    TEST_ASSERT_EQUAL_MESSAGE(expect, rvj, str);
+    TEST_ASSERT_EQUAL_MESSAGE(expect, rvs, str);
+    if (!expect) return;
+
+    TEST_ASSERT_EQUAL_MEMORY_MESSAGE(&rj, &rs, sizeof(rj), str);
+    /* The stream must be positioned right after the object */
+    TEST_ASSERT_EQUAL(PJS_TOK_EOF, pjs_stream_next(&ps));
+}
+
+void test_ovsdb_stream_tokenizer(void)
+{
+    static const char str[] = "{\"k\\u0041\":[1,-2.5e3,true,false,null,{\"a\":[]}],\"s\":\"\\ud83d\\ude00\\t\"}";
+    struct pjs_stream ps;
+    char key[16];
+    char buf[16];
+    int64_t i64;
+    double dbl;
+    bool end;
+
+    pjs_stream_init(&ps, str, strlen(str));
+
+    TEST_ASSERT_EQUAL(PJS_TOK_OBJ_START, pjs_stream_next(&ps));
+    TEST_ASSERT_TRUE(pjs_stream_key(&ps, key, sizeof(key), &end));
+    TEST_ASSERT_FALSE(end);
+    TEST_ASSERT_EQUAL_STRING("kA", key);
+
+    TEST_ASSERT_EQUAL(PJS_TOK_ARR_START, pjs_stream_next(&ps));
+    TEST_ASSERT_EQUAL(PJS_TOK_NUMBER, pjs_stream_next(&ps));
+    TEST_ASSERT_TRUE(pjs_stream_int64(&ps, &i64));
+    TEST_ASSERT_EQUAL_INT64(1, i64);
+    TEST_ASSERT_EQUAL(PJS_TOK_NUMBER, pjs_stream_next(&ps));
+    TEST_ASSERT_FALSE(pjs_stream_int64(&ps, &i64));
+    TEST_ASSERT_TRUE(pjs_stream_real(&ps, &dbl));
+    TEST_ASSERT_TRUE(dbl == -2500.0);
+    TEST_ASSERT_EQUAL(PJS_TOK_TRUE, pjs_stream_next(&ps));
+    TEST_ASSERT_EQUAL(PJS_TOK_FALSE, pjs_stream_next(&ps));
+    TEST_ASSERT_EQUAL(PJS_TOK_NULL, pjs_stream_next(&ps));
+    TEST_ASSERT_TRUE(pjs_stream_skip(&ps));
+    TEST_ASSERT_EQUAL(PJS_TOK_ARR_END, pjs_stream_next(&ps));
+
+    TEST_ASSERT_TRUE(pjs_stream_key(&ps, key, sizeof(key), &end));
+    TEST_ASSERT_EQUAL_STRING("s", key);
+    TEST_ASSERT_EQUAL(PJS_TOK_STRING, pjs_stream_next(&ps));
+    TEST_ASSERT_TRUE(pjs_stream_str(&ps, buf, sizeof(buf)));
+    TEST_ASSERT_EQUAL_STRING("\xf0\x9f\x98\x80\t", buf);
+    /* Output buffer too short */
+    TEST_ASSERT_FALSE(pjs_stream_str(&ps, buf, 5));
+
+    TEST_ASSERT_TRUE(pjs_stream_key(&ps, key, sizeof(key), &end));
+    TEST_ASSERT_TRUE(end);
+    TEST_ASSERT_EQUAL(PJS_TOK_EOF, pjs_stream_next(&ps));
+
+    /* Unterminated input */
+    pjs_stream_init(&ps, "{\"a\":\"abc", 9);
+    TEST_ASSERT_FALSE(pjs_stream_skip(&ps));
+}
+
+void test_ovsdb_stream_from_json(void)
+{
+    struct test_stream_row row;
+    struct pjs_stream ps;
+    pjs_errmsg_t err;
+    const char *str;
+
+    TEST_ASSERT_TRUE(pjs_desc_is_streamable(test_stream_row_pjs_desc()));
+    TEST_ASSERT_NOT_NULL(pjs_desc_find(test_stream_row_pjs_desc(), "ports"));
+    TEST_ASSERT_NULL(pjs_desc_find(test_stream_row_pjs_desc(), "nope"));
+
+    /* Full row, insert and modify semantics */
+    test_stream_compare(TEST_ROW_FULL, false, true);
+    test_stream_compare(TEST_ROW_FULL, true, true);
+
+    /* Partial row: fine in update mode, required columns missing otherwise */
+    test_stream_compare("{\"hostname\":\"x\",\"tags\":[\"set\",[]]}", true, true);
+    test_stream_compare("{\"hostname\":\"x\"}", false, false);
+
+    /* Optional values as empty sets, single element sets */
+    test_stream_compare(
+            "{\"hwaddr\":\"m\",\"hostname\":[\"set\",[]],\"lease_time\":0,"
+            "\"bytes\":[\"set\",[]],\"enabled\":false,\"rssi\":1.25,"
+            "\"tags\":\"single\",\"refs\":[\"uuid\",\"" TEST_UUID1 "\"],"
+            "\"info\":[\"map\",[]],\"ports\":[\"map\",[]]}",
+            false, true);
+
+    /* Errors: string too long, set overflow, type mismatch */
+    test_stream_compare("{\"hwaddr\":\"0123456789012345678901234567890123456789\"}", true, false);
+    test_stream_compare("{\"tags\":[\"set\",[\"1\",\"2\",\"3\",\"4\",\"5\"]]}", true, false);
+    test_stream_compare("{\"lease_time\":\"3600\"}", true, false);
+    test_stream_compare("{\"enabled\":1}", true, false);
+    test_stream_compare("{\"ports\":[\"map\",[[\"80\",1]]]}", true, false);
+
+    /* null values are treated as missing */
+    memset(&row, 0, sizeof(row));
+    STRSCPY(row.hostname, "keep");
+    row.hostname_exists = true;
+    str = "{\"hostname\":null,\"lease_time\":7}";
+    pjs_stream_init(&ps, str, strlen(str));
+    TEST_ASSERT_TRUE(pjs_stream_from_json(test_stream_row_pjs_desc(), &row, &ps, true, err));
+    TEST_ASSERT_FALSE(row.hostname_present);
+    TEST_ASSERT_TRUE(row.hostname_exists);
+    TEST_ASSERT_EQUAL_STRING("keep", row.hostname);
+    TEST_ASSERT_EQUAL_INT(7, row.lease_time);
+
+    /* Integral reals are converted by the streaming parser */
+    memset(&row, 0, sizeof(row));
+    str = "{\"rssi\":-70}";
+    pjs_stream_init(&ps, str, strlen(str));
+    TEST_ASSERT_TRUE(pjs_stream_from_json(test_stream_row_pjs_desc(), &row, &ps, true, err));
+    TEST_ASSERT_TRUE(row.rssi_present);
+    TEST_ASSERT_TRUE(row.rssi == -70.0);
+}
+
+void test_ovsdb_stream_framing(void)
+{
+    static const char msg1[] = "{\"id\":1,\"s\":\"}{\\\"\"}";
+    static const char msg2[] = " [1,{\"a\":[2]}]\n";
+    struct ovsdb_stream *st;
+    json_t *js;
+    int fd[2];
+
+    TEST_ASSERT_EQUAL_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fd));
+    st = ovsdb_stream_alloc();
+
+    /* Partial message */
+    TEST_ASSERT_EQUAL_INT(10, write(fd[1], msg1, 10));
+    TEST_ASSERT_EQUAL_INT(0, ovsdb_stream_recv(st, fd[0]));
+    TEST_ASSERT_NULL(ovsdb_stream_next_json(st));
+
+    /* Rest of the first message and the second message in one chunk */
+    TEST_ASSERT_EQUAL_INT(sizeof(msg1) - 11, write(fd[1], msg1 + 10, sizeof(msg1) - 11));
+    TEST_ASSERT_EQUAL_INT(sizeof(msg2) - 1, write(fd[1], msg2, sizeof(msg2) - 1));
+    TEST_ASSERT_EQUAL_INT(0, ovsdb_stream_recv(st, fd[0]));
+
+    js = ovsdb_stream_next_json(st);
+    TEST_ASSERT_TRUE(json_is_object(js));
+    TEST_ASSERT_EQUAL_STRING("}{\"", json_string_value(json_object_get(js, "s")));
+    json_decref(js);
+
+    js = ovsdb_stream_next_json(st);
+    TEST_ASSERT_TRUE(json_is_array(js));
+    TEST_ASSERT_EQUAL_INT(2, json_array_size(js));
+    json_decref(js);
+
+    TEST_ASSERT_NULL(ovsdb_stream_next_json(st));
+
+    ovsdb_stream_free(st);
+    close(fd[0]);
+    close(fd[1]);
+}
+
+/*
+ * Compare the jansson and the streaming path on a large monitor update
+ */
+#define TEST_BENCH_ROWS     2000
+
+static size_t test_bench_allocs;
+
+static void *test_bench_malloc(size_t sz)
+{
+    test_bench_allocs++;
+    return malloc(sz);
+}
+
+static double test_bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static char *test_bench_update(size_t *len)
+{
+    size_t rowsz = sizeof(TEST_ROW_FULL) + 128;
+    size_t bufsz = rowsz * TEST_BENCH_ROWS + 128;
+    char *buf = malloc(bufsz);
+    size_t off;
+    int ii;
+
+    TEST_ASSERT_NOT_NULL(buf);
+
+    off = (size_t)snprintf(buf, bufsz, "{\"Test_Stream_Row\":{");
+    for (ii = 0; ii < TEST_BENCH_ROWS; ii++)
+    {
+        off += (size_t)snprintf(
+                buf + off,
+                bufsz - off,
+                "%s\"%08x-0000-0000-0000-000000000000\":{\"new\":" TEST_ROW_FULL "}",
+                ii == 0 ? "" : ",",
+                ii);
+    }
+    off += (size_t)snprintf(buf + off, bufsz - off, "}}");
+
+    *len = off;
+    return buf;
+}
+
+void test_ovsdb_stream_bench(void)
+{
+    struct test_stream_row rj;
+    struct test_stream_row rs;
+    struct pjs_stream ps;
+    pjs_errmsg_t err;
+    json_error_t jerr;
+    double tj;
+    double ts;
+    size_t len;
+    size_t aj;
+    size_t as;
+    char key[64];
+    char *buf;
+    bool end;
+    int rows;
+
+    buf = test_bench_update(&len);
+    json_set_alloc_funcs(test_bench_malloc, free);
+
+    /* jansson: DOM + _from_json() */
+    test_bench_allocs = 0;
+    tj = test_bench_now();
+    {
+        json_t *jtbl;
+        json_t *jrow;
+        json_t *js;
+        const char *k;
+
+        js = json_loadb(buf, len, 0, &jerr);
+        TEST_ASSERT_NOT_NULL(js);
+
+        rows = 0;
+        jtbl = json_object_get(js, "Test_Stream_Row");
+        json_object_foreach(jtbl, k, jrow)
+        {
+            memset(&rj, 0, sizeof(rj));
+            TEST_ASSERT_TRUE(test_stream_row_from_json(&rj, json_object_get(jrow, "new"), false, err));
+            rows++;
+        }
+        json_decref(js);
+    }
+    tj = test_bench_now() - tj;
+    aj = test_bench_allocs;
+    TEST_ASSERT_EQUAL_INT(TEST_BENCH_ROWS, rows);
+
+    /* Streaming parser */
+    test_bench_allocs = 0;
+    ts = test_bench_now();
+    pjs_stream_init(&ps, buf, len);
+    TEST_ASSERT_EQUAL(PJS_TOK_OBJ_START, pjs_stream_next(&ps));
+    TEST_ASSERT_TRUE(pjs_stream_key(&ps, key, sizeof(key), &end));
+    TEST_ASSERT_EQUAL(PJS_TOK_OBJ_START, pjs_stream_next(&ps));
+    rows = 0;
+    while (pjs_stream_key(&ps, key, sizeof(key), &end) && !end)
+    {
+        TEST_ASSERT_EQUAL(PJS_TOK_OBJ_START, pjs_stream_next(&ps));
+        TEST_ASSERT_TRUE(pjs_stream_key(&ps, key, sizeof(key), &end));
+        TEST_ASSERT_EQUAL_STRING("new", key);
+        memset(&rs, 0, sizeof(rs));
+        TEST_ASSERT_TRUE(pjs_stream_from_json(test_stream_row_pjs_desc(), &rs, &ps, false, err));
+        TEST_ASSERT_TRUE(pjs_stream_key(&ps, key, sizeof(key), &end));
+        TEST_ASSERT_TRUE(end);
+        rows++;
+    }
+    ts = test_bench_now() - ts;
+    as = test_bench_allocs;
+    TEST_ASSERT_EQUAL_INT(TEST_BENCH_ROWS, rows);
+
+    json_set_alloc_funcs(malloc, free);
+    free(buf);
+
+    TEST_ASSERT_EQUAL_MEMORY(&rj, &rs, sizeof(rj));
+    TEST_ASSERT_EQUAL_INT(0, as);
+
+    LOG(INFO, "%s: %d rows, %zu bytes: jansson %.3f ms %zu allocs, stream %.3f ms %zu allocs",
+            test_name, rows, len, tj * 1000.0, aj, ts * 1000.0, as);
+}
+
+void run_test_ovsdb_stream(void)
+{
+    RUN_TEST(test_ovsdb_stream_tokenizer);
+    RUN_TEST(test_ovsdb_stream_from_json);
+    RUN_TEST(test_ovsdb_stream_framing);
+    RUN_TEST(test_ovsdb_stream_bench);
+}
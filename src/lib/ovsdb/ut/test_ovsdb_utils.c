@@ -236,6 +236,10 @@ test_schema2itree(void)
     free_str_itree(converted);
 }
 
+extern void run_test_ovsdb_stream(void);
+extern void run_test_ovsdb_cond(void);
+extern void run_test_ovsdb_cache(void);
+
 int main(int argc, char *argv[])
 {
     (void)argc;
@@ -250,5 +254,9 @@ int main(int argc, char *argv[])
     RUN_TEST(test_schema2int_set);
     RUN_TEST(test_schema2itree);
 
+    run_test_ovsdb_stream();
+    run_test_ovsdb_cond();
+    run_test_ovsdb_cache();
+
     return ut_fini();
 }
@@ -27,6 +27,9 @@ UNIT_NAME := test_ovsdb_utils
 UNIT_TYPE := TEST_BIN
 
 UNIT_SRC := test_ovsdb_utils.c
+UNIT_SRC += test_ovsdb_stream.c
+UNIT_SRC += test_ovsdb_cond.c
+UNIT_SRC += test_ovsdb_cache.c
 UNIT_DEPS := src/lib/common
 UNIT_DEPS += src/lib/log
 UNIT_DEPS += src/lib/osa
@@ -1417,10 +1417,11 @@ ow_ovsdb_vifstate_fill_ap_radius(struct schema_Wifi_VIF_State *schema,
 {
     size_t i;
     ovsdb_cache_row_t *rrow;
+    ovsdb_cache_index_iter_t iter;
 
     for (i = 0; i < radlist->count; i++) {
         const struct osw_radius *rad = &radlist->list[i];
-        ds_tree_foreach(&table_RADIUS.rows, rrow) {
+        ovsdb_cache_index_foreach(&table_RADIUS, "ip_addr", rad->server, iter, rrow) {
             const struct schema_RADIUS *radius = (const void*)rrow->record;
             if (ow_ovsdb_radius_is_equal(radius, rad) == true) {
                 if (i == 0) {
@@ -1434,7 +1435,7 @@ ow_ovsdb_vifstate_fill_ap_radius(struct schema_Wifi_VIF_State *schema,
 
     for (i = 0; i < acctlist->count; i++) {
         const struct osw_radius *rad = &acctlist->list[i];
-        ds_tree_foreach(&table_RADIUS.rows, rrow) {
+        ovsdb_cache_index_foreach(&table_RADIUS, "ip_addr", rad->server, iter, rrow) {
             const struct schema_RADIUS *radius = (const void*)rrow->record;
             if (ow_ovsdb_radius_is_equal(radius, rad) == true) {
                 if (i == 0) {
@@ -4380,6 +4381,7 @@ ow_ovsdb_retry_cb(EV_P_ ev_timer *arg, int events)
     OVSDB_CACHE_MONITOR(Wifi_VIF_Config, true);
     OVSDB_CACHE_MONITOR(Wifi_VIF_State, true);
     OVSDB_CACHE_MONITOR(Wifi_VIF_Neighbors, true);
+    OVSDB_CACHE_INDEX(RADIUS, ip_addr, false);
     OVSDB_CACHE_MONITOR(RADIUS, true);
     OVSDB_CACHE_MONITOR(Passpoint_Config, true);
 
@@ -54,6 +54,9 @@ typedef char pjs_errmsg_t[128];
 typedef bool pjs_sub_from_json_cb_t(void *data, json_t *jsval, bool update, pjs_errmsg_t err);
 typedef json_t *pjs_sub_to_json_cb_t(void *data, pjs_errmsg_t err);
 
+/* Field layout descriptor of a PJS structure, see pjs_stream.h */
+struct pjs_desc;
+
 /*
  * =============================================================
  *  BASIC types
@@ -0,0 +1,181 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * This file is used to generate pjs structure descriptors from PJS_* macros
+ *
+ * The descriptors are used by the streaming parser (pjs_stream.h) to
+ * populate the structures directly from the JSON text.
+ */
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <jansson.h>
+
+#include "pjs_common.h"
+#include "pjs_stream.h"
+#include "pjs_undef.h"
+
+// The descriptor table is defined in the function scope so the field macros
+// can refer to the structure through the local pjs_desc_t typedef
+
+#define PJS(name, ...)                                                                  \
+const struct pjs_desc *name ## _pjs_desc(void)                                          \
+{                                                                                       \
+    typedef struct name pjs_desc_t;                                                     \
+                                                                                        \
+    static const struct pjs_desc_field fields[] =                                       \
+    {                                                                                   \
+        __VA_ARGS__                                                                     \
+    };                                                                                  \
+                                                                                        \
+    static const struct pjs_desc desc =                                                 \
+    {                                                                                   \
+        #name,                                                                          \
+        sizeof(pjs_desc_t),                                                             \
+        fields,                                                                         \
+        (int)(sizeof(fields) / sizeof(fields[0]))                                       \
+    };                                                                                  \
+                                                                                        \
+    return &desc;                                                                       \
+}
+
+#define PJS_DESC_NONE(f)                                                                \
+    {                                                                                   \
+        .name = #f,                                                                     \
+        .kind = PJS_DESC_UNSUPPORTED,                                                   \
+    },
+
+#define PJS_DESC_BASIC(f, t, q)                                                         \
+    {                                                                                   \
+        .name = #f,                                                                     \
+        .kind = PJS_DESC_OVS_BASIC,                                                     \
+        .type = t,                                                                      \
+        .optional = q,                                                                  \
+        .max = 1,                                                                       \
+        .elem_sz = sizeof(((pjs_desc_t *)NULL)->f),                                     \
+        .off = offsetof(pjs_desc_t, f),                                                 \
+        .off_exists = offsetof(pjs_desc_t, f ## _exists),                               \
+        .off_present = offsetof(pjs_desc_t, f ## _present),                             \
+    },
+
+#define PJS_DESC_SET(f, t, sz)                                                          \
+    {                                                                                   \
+        .name = #f,                                                                     \
+        .kind = PJS_DESC_OVS_SET,                                                       \
+        .type = t,                                                                      \
+        .max = sz,                                                                      \
+        .elem_sz = sizeof(((pjs_desc_t *)NULL)->f[0]),                                  \
+        .off = offsetof(pjs_desc_t, f),                                                 \
+        .off_present = offsetof(pjs_desc_t, f ## _present),                             \
+        .off_len = offsetof(pjs_desc_t, f ## _len),                                     \
+    },
+
+#define PJS_DESC_MAP(f, k, t, sz)                                                       \
+    {                                                                                   \
+        .name = #f,                                                                     \
+        .kind = k,                                                                      \
+        .type = t,                                                                      \
+        .max = sz,                                                                      \
+        .elem_sz = sizeof(((pjs_desc_t *)NULL)->f[0]),                                  \
+        .off = offsetof(pjs_desc_t, f),                                                 \
+        .off_present = offsetof(pjs_desc_t, f ## _present),                             \
+        .off_len = offsetof(pjs_desc_t, f ## _len),                                     \
+        .off_keys = offsetof(pjs_desc_t, f ## _keys),                                   \
+    },
+
+/*
+ * =============================================================
+ *  Standard types -- not supported by the streaming parser
+ * =============================================================
+ */
+#define PJS_INT(name)                       PJS_DESC_NONE(name)
+#define PJS_INT64(name)                     PJS_DESC_NONE(name)
+#define PJS_BOOL(name)                      PJS_DESC_NONE(name)
+#define PJS_REAL(name)                      PJS_DESC_NONE(name)
+#define PJS_STRING(name, len)               PJS_DESC_NONE(name)
+#define PJS_SUB(name, sub)                  PJS_DESC_NONE(name)
+
+#define PJS_INT_Q(name)                     PJS_DESC_NONE(name)
+#define PJS_INT64_Q(name)                   PJS_DESC_NONE(name)
+#define PJS_BOOL_Q(name)                    PJS_DESC_NONE(name)
+#define PJS_STRING_Q(name, sz)              PJS_DESC_NONE(name)
+#define PJS_REAL_Q(name)                    PJS_DESC_NONE(name)
+#define PJS_SUB_Q(name, sub)                PJS_DESC_NONE(name)
+
+#define PJS_INT_A(name, sz)                 PJS_DESC_NONE(name)
+#define PJS_BOOL_A(name, sz)                PJS_DESC_NONE(name)
+#define PJS_STRING_A(name, len, sz)         PJS_DESC_NONE(name)
+#define PJS_REAL_A(name, sz)                PJS_DESC_NONE(name)
+#define PJS_SUB_A(name, sub, sz)            PJS_DESC_NONE(name)
+
+#define PJS_INT_QA(name, sz)                PJS_DESC_NONE(name)
+#define PJS_BOOL_QA(name, sz)               PJS_DESC_NONE(name)
+#define PJS_STRING_QA(name, len, sz)        PJS_DESC_NONE(name)
+#define PJS_REAL_QA(name, sz)               PJS_DESC_NONE(name)
+#define PJS_SUB_QA(name, sub, sz)           PJS_DESC_NONE(name)
+
+/*
+ * =============================================================
+ *  OVS Basic Types
+ * =============================================================
+ */
+#define PJS_OVS_INT(name)                   PJS_DESC_BASIC(name, PJS_DESC_T_INT, false)
+#define PJS_OVS_INT64(name)                 PJS_DESC_BASIC(name, PJS_DESC_T_INT64, false)
+#define PJS_OVS_BOOL(name)                  PJS_DESC_BASIC(name, PJS_DESC_T_BOOL, false)
+#define PJS_OVS_REAL(name)                  PJS_DESC_BASIC(name, PJS_DESC_T_REAL, false)
+#define PJS_OVS_STRING(name, len)           PJS_DESC_BASIC(name, PJS_DESC_T_STRING, false)
+#define PJS_OVS_UUID(name)                  PJS_DESC_BASIC(name, PJS_DESC_T_UUID, false)
+
+#define PJS_OVS_INT_Q(name)                 PJS_DESC_BASIC(name, PJS_DESC_T_INT, true)
+#define PJS_OVS_INT64_Q(name)               PJS_DESC_BASIC(name, PJS_DESC_T_INT64, true)
+#define PJS_OVS_BOOL_Q(name)                PJS_DESC_BASIC(name, PJS_DESC_T_BOOL, true)
+#define PJS_OVS_STRING_Q(name, sz)          PJS_DESC_BASIC(name, PJS_DESC_T_STRING, true)
+#define PJS_OVS_REAL_Q(name)                PJS_DESC_BASIC(name, PJS_DESC_T_REAL, true)
+#define PJS_OVS_UUID_Q(name)                PJS_DESC_BASIC(name, PJS_DESC_T_UUID, true)
+
+/*
+ * =============================================================
+ *  OVS SET, SMAP and DMAP types
+ * =============================================================
+ */
+#define PJS_OVS_SET_INT(name, sz)           PJS_DESC_SET(name, PJS_DESC_T_INT, sz)
+#define PJS_OVS_SET_BOOL(name, sz)          PJS_DESC_SET(name, PJS_DESC_T_BOOL, sz)
+#define PJS_OVS_SET_REAL(name, sz)          PJS_DESC_SET(name, PJS_DESC_T_REAL, sz)
+#define PJS_OVS_SET_STRING(name, len, sz)   PJS_DESC_SET(name, PJS_DESC_T_STRING, sz)
+#define PJS_OVS_SET_UUID(name, sz)          PJS_DESC_SET(name, PJS_DESC_T_UUID, sz)
+
+#define PJS_OVS_SMAP_INT(name, sz)          PJS_DESC_MAP(name, PJS_DESC_OVS_SMAP, PJS_DESC_T_INT, sz)
+#define PJS_OVS_SMAP_BOOL(name, sz)         PJS_DESC_MAP(name, PJS_DESC_OVS_SMAP, PJS_DESC_T_BOOL, sz)
+#define PJS_OVS_SMAP_REAL(name, sz)         PJS_DESC_MAP(name, PJS_DESC_OVS_SMAP, PJS_DESC_T_REAL, sz)
+#define PJS_OVS_SMAP_STRING(name, len, sz)  PJS_DESC_MAP(name, PJS_DESC_OVS_SMAP, PJS_DESC_T_STRING, sz)
+#define PJS_OVS_SMAP_UUID(name, sz)         PJS_DESC_MAP(name, PJS_DESC_OVS_SMAP, PJS_DESC_T_UUID, sz)
+
+#define PJS_OVS_DMAP_INT(name, sz)          PJS_DESC_MAP(name, PJS_DESC_OVS_DMAP, PJS_DESC_T_INT, sz)
+#define PJS_OVS_DMAP_BOOL(name, sz)         PJS_DESC_MAP(name, PJS_DESC_OVS_DMAP, PJS_DESC_T_BOOL, sz)
+#define PJS_OVS_DMAP_REAL(name, sz)         PJS_DESC_MAP(name, PJS_DESC_OVS_DMAP, PJS_DESC_T_REAL, sz)
+#define PJS_OVS_DMAP_STRING(name, len, sz)  PJS_DESC_MAP(name, PJS_DESC_OVS_DMAP, PJS_DESC_T_STRING, sz)
+#define PJS_OVS_DMAP_UUID(name, sz)         PJS_DESC_MAP(name, PJS_DESC_OVS_DMAP, PJS_DESC_T_UUID, sz)
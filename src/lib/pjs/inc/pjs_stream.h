@@ -0,0 +1,160 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef PJS_STREAM_H_INCLUDED
+#define PJS_STREAM_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pjs_common.h"
+
+/*
+ * ===========================================================================
+ *  Streaming JSON parser
+ * ===========================================================================
+ *
+ * The regular PJS _from_json() functions operate on a jansson DOM, which
+ * means that the whole message must be parsed into a json_t tree before
+ * the structure can be populated. For large OVSDB updates this doubles
+ * the number of allocations and the peak memory usage.
+ *
+ * The functions below work directly on a (complete) JSON text buffer. The
+ * tokenizer does not allocate -- string tokens reference the input buffer
+ * and are decoded only when copied into the destination structure. The
+ * structure layout is described by a pjs_desc table, which is generated
+ * from the same PJS_* macros as the structure itself (see pjs_gen_desc.h).
+ *
+ * The tokenizer is lenient regarding separators (',' and ':'), the input is
+ * expected to be well-formed JSON produced by ovsdb-server.
+ *
+ * Only the OVS types are supported by the streaming parser, structures that
+ * contain standard PJS types should be parsed using the jansson path.
+ * ===========================================================================
+ */
+
+enum pjs_stream_tok
+{
+    PJS_TOK_ERROR,
+    PJS_TOK_EOF,
+    PJS_TOK_OBJ_START,
+    PJS_TOK_OBJ_END,
+    PJS_TOK_ARR_START,
+    PJS_TOK_ARR_END,
+    PJS_TOK_STRING,
+    PJS_TOK_NUMBER,
+    PJS_TOK_TRUE,
+    PJS_TOK_FALSE,
+    PJS_TOK_NULL,
+};
+
+struct pjs_stream
+{
+    const char             *ps_pos;         /* Current position */
+    const char             *ps_end;         /* End of the input buffer */
+    enum pjs_stream_tok     ps_tok;         /* Last token */
+    const char             *ps_tok_s;       /* Start of last token value */
+    const char             *ps_tok_e;       /* End of last token value */
+    bool                    ps_tok_esc;     /* String token contains escapes */
+};
+
+/*
+ * Field kinds and types of the structure descriptors
+ */
+enum pjs_desc_kind
+{
+    PJS_DESC_UNSUPPORTED,                   /* Standard PJS type */
+    PJS_DESC_OVS_BASIC,                     /* OVS basic type, SET of max 1 */
+    PJS_DESC_OVS_SET,                       /* OVS SET */
+    PJS_DESC_OVS_SMAP,                      /* OVS MAP with string keys */
+    PJS_DESC_OVS_DMAP,                      /* OVS MAP with integer keys */
+};
+
+enum pjs_desc_type
+{
+    PJS_DESC_T_INT,
+    PJS_DESC_T_INT64,
+    PJS_DESC_T_BOOL,
+    PJS_DESC_T_REAL,
+    PJS_DESC_T_STRING,
+    PJS_DESC_T_UUID,
+};
+
+struct pjs_desc_field
+{
+    const char             *name;           /* Field (column) name */
+    uint8_t                 kind;           /* enum pjs_desc_kind */
+    uint8_t                 type;           /* enum pjs_desc_type */
+    bool                    optional;       /* Basic optional (_Q) type */
+    int                     max;            /* Max number of elements */
+    size_t                  elem_sz;        /* Size of a single element */
+    size_t                  off;            /* Offset of value */
+    size_t                  off_exists;     /* Offset of _exists, basic types only */
+    size_t                  off_present;    /* Offset of _present */
+    size_t                  off_len;        /* Offset of _len, SET and MAP types only */
+    size_t                  off_keys;       /* Offset of _keys, MAP types only */
+};
+
+struct pjs_desc
+{
+    const char                     *name;   /* Structure name */
+    size_t                          size;   /* Structure size */
+    const struct pjs_desc_field    *fields; /* Field descriptors */
+    int                             num;    /* Number of fields */
+};
+
+/*
+ * Tokenizer
+ */
+extern void pjs_stream_init(struct pjs_stream *ps, const char *buf, size_t len);
+extern enum pjs_stream_tok pjs_stream_next(struct pjs_stream *ps);
+extern bool pjs_stream_skip(struct pjs_stream *ps);
+extern bool pjs_stream_str(struct pjs_stream *ps, char *out, size_t outsz);
+extern bool pjs_stream_str_eq(struct pjs_stream *ps, const char *str);
+extern bool pjs_stream_int64(struct pjs_stream *ps, int64_t *out);
+extern bool pjs_stream_real(struct pjs_stream *ps, double *out);
+extern bool pjs_stream_key(struct pjs_stream *ps, char *key, size_t keysz, bool *end);
+
+/*
+ * Structure descriptors
+ */
+extern const struct pjs_desc_field *pjs_desc_find(const struct pjs_desc *desc, const char *name);
+extern bool pjs_desc_is_streamable(const struct pjs_desc *desc);
+
+/*
+ * Populate the structure described by @p desc from the JSON object at the
+ * current stream position. The semantics of @p update are the same as with
+ * the regular _from_json() functions.
+ */
+extern bool pjs_stream_from_json(
+        const struct pjs_desc *desc,
+        void *out,
+        struct pjs_stream *ps,
+        bool update,
+        pjs_errmsg_t err);
+
+#endif /* PJS_STREAM_H_INCLUDED */
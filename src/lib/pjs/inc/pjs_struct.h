@@ -55,7 +55,9 @@ extern bool name ## _from_json(
                                                                                     \
 extern json_t *name ## _to_json(                                                    \
         struct name *in,                                                            \
-        pjs_errmsg_t err);
+        pjs_errmsg_t err);                                                          \
+                                                                                    \
+extern const struct pjs_desc *name ## _pjs_desc(void);
 
 /*
  * =============================================================
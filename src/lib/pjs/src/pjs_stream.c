@@ -0,0 +1,900 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pjs_common.h"
+#include "pjs_stream.h"
+#include "util.h"
+
+#define PJS_STREAM_NUM_MAX          64      /* Max length of a number token */
+#define PJS_STREAM_KEY_MAX          64      /* Max length of a matched object key */
+#define PJS_STREAM_UUID_ZERO        "00000000-0000-0000-0000-000000000000"
+
+/*
+ * ===========================================================================
+ *  Tokenizer
+ * ===========================================================================
+ */
+void pjs_stream_init(struct pjs_stream *ps, const char *buf, size_t len)
+{
+    ps->ps_pos = buf;
+    ps->ps_end = buf + len;
+    ps->ps_tok = PJS_TOK_EOF;
+    ps->ps_tok_s = buf;
+    ps->ps_tok_e = buf;
+    ps->ps_tok_esc = false;
+}
+
+static inline bool pjs_stream_is_sep(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == ',' || c == ':';
+}
+
+static inline bool pjs_stream_is_num(char c)
+{
+    return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+static enum pjs_stream_tok pjs_stream_tok_set(
+        struct pjs_stream *ps,
+        enum pjs_stream_tok tok,
+        const char *s,
+        const char *e)
+{
+    ps->ps_tok = tok;
+    ps->ps_tok_s = s;
+    ps->ps_tok_e = e;
+
+    /* Stop at the first error */
+    if (tok == PJS_TOK_ERROR) ps->ps_pos = ps->ps_end;
+
+    return tok;
+}
+
+static enum pjs_stream_tok pjs_stream_literal(
+        struct pjs_stream *ps,
+        const char *lit,
+        enum pjs_stream_tok tok)
+{
+    const char *s = ps->ps_pos;
+    size_t len = strlen(lit);
+
+    if ((size_t)(ps->ps_end - s) < len || memcmp(s, lit, len) != 0)
+    {
+        return pjs_stream_tok_set(ps, PJS_TOK_ERROR, s, s);
+    }
+
+    ps->ps_pos += len;
+    return pjs_stream_tok_set(ps, tok, s, ps->ps_pos);
+}
+
+/**
+ * Return the next token from the stream
+ */
+enum pjs_stream_tok pjs_stream_next(struct pjs_stream *ps)
+{
+    const char *p = ps->ps_pos;
+    const char *e = ps->ps_end;
+    const char *s;
+
+    while (p < e && pjs_stream_is_sep(*p)) p++;
+
+    ps->ps_pos = p;
+    ps->ps_tok_esc = false;
+
+    if (p >= e) return pjs_stream_tok_set(ps, PJS_TOK_EOF, p, p);
+
+    switch (*p)
+    {
+        case '{':
+            ps->ps_pos++;
+            return pjs_stream_tok_set(ps, PJS_TOK_OBJ_START, p, p + 1);
+
+        case '}':
+            ps->ps_pos++;
+            return pjs_stream_tok_set(ps, PJS_TOK_OBJ_END, p, p + 1);
+
+        case '[':
+            ps->ps_pos++;
+            return pjs_stream_tok_set(ps, PJS_TOK_ARR_START, p, p + 1);
+
+        case ']':
+            ps->ps_pos++;
+            return pjs_stream_tok_set(ps, PJS_TOK_ARR_END, p, p + 1);
+
+        case '"':
+            /* Strings are decoded lazily, just find the closing quote */
+            s = ++p;
+            while (p < e && *p != '"')
+            {
+                if (*p == '\\')
+                {
+                    ps->ps_tok_esc = true;
+                    if (++p >= e) break;
+                }
+                p++;
+            }
+            if (p >= e) return pjs_stream_tok_set(ps, PJS_TOK_ERROR, s, s);
+
+            ps->ps_pos = p + 1;
+            return pjs_stream_tok_set(ps, PJS_TOK_STRING, s, p);
+
+        case 't':
+            return pjs_stream_literal(ps, "true", PJS_TOK_TRUE);
+
+        case 'f':
+            return pjs_stream_literal(ps, "false", PJS_TOK_FALSE);
+
+        case 'n':
+            return pjs_stream_literal(ps, "null", PJS_TOK_NULL);
+
+        default:
+            break;
+    }
+
+    if (*p != '-' && (*p < '0' || *p > '9'))
+    {
+        return pjs_stream_tok_set(ps, PJS_TOK_ERROR, p, p);
+    }
+
+    s = p;
+    while (p < e && pjs_stream_is_num(*p)) p++;
+
+    ps->ps_pos = p;
+    return pjs_stream_tok_set(ps, PJS_TOK_NUMBER, s, p);
+}
+
+/*
+ * Skip the rest of the value that starts with the current token
+ */
+static bool pjs_stream_skip_value(struct pjs_stream *ps)
+{
+    int depth = 0;
+
+    for (;;)
+    {
+        switch (ps->ps_tok)
+        {
+            case PJS_TOK_OBJ_START:
+            case PJS_TOK_ARR_START:
+                depth++;
+                break;
+
+            case PJS_TOK_OBJ_END:
+            case PJS_TOK_ARR_END:
+                depth--;
+                break;
+
+            case PJS_TOK_ERROR:
+            case PJS_TOK_EOF:
+                return false;
+
+            default:
+                break;
+        }
+
+        if (depth < 0) return false;
+        if (depth == 0) return true;
+
+        pjs_stream_next(ps);
+    }
+}
+
+/**
+ * Skip the next value in the stream, including all nested objects and arrays
+ */
+bool pjs_stream_skip(struct pjs_stream *ps)
+{
+    pjs_stream_next(ps);
+    return pjs_stream_skip_value(ps);
+}
+
+static int pjs_stream_hex4(const char *p)
+{
+    int val = 0;
+    int ii;
+
+    for (ii = 0; ii < 4; ii++)
+    {
+        val <<= 4;
+        if (p[ii] >= '0' && p[ii] <= '9') val |= p[ii] - '0';
+        else if (p[ii] >= 'a' && p[ii] <= 'f') val |= p[ii] - 'a' + 10;
+        else if (p[ii] >= 'A' && p[ii] <= 'F') val |= p[ii] - 'A' + 10;
+        else return -1;
+    }
+
+    return val;
+}
+
+/*
+ * Decode a \uXXXX escape sequence (with an optional surrogate pair) at @p p
+ * and return the code point or -1 on error
+ */
+static int32_t pjs_stream_unicode(const char **p, const char *e)
+{
+    int32_t cp;
+    int lo;
+
+    if (e - *p < 4) return -1;
+    cp = pjs_stream_hex4(*p);
+    *p += 4;
+    if (cp < 0) return -1;
+
+    if (cp >= 0xD800 && cp <= 0xDBFF)
+    {
+        if (e - *p < 6 || (*p)[0] != '\\' || (*p)[1] != 'u') return -1;
+        lo = pjs_stream_hex4(*p + 2);
+        if (lo < 0xDC00 || lo > 0xDFFF) return -1;
+        *p += 6;
+        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+    }
+    else if (cp >= 0xDC00 && cp <= 0xDFFF)
+    {
+        return -1;
+    }
+
+    return cp;
+}
+
+static size_t pjs_stream_utf8(int32_t cp, char *buf)
+{
+    if (cp < 0x80)
+    {
+        buf[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800)
+    {
+        buf[0] = (char)(0xC0 | (cp >> 6));
+        buf[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000)
+    {
+        buf[0] = (char)(0xE0 | (cp >> 12));
+        buf[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        buf[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+
+    buf[0] = (char)(0xF0 | (cp >> 18));
+    buf[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    buf[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    buf[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+/**
+ * Decode the current string token into @p out; returns false if the
+ * current token is not a string or if it doesn't fit into @p out
+ */
+bool pjs_stream_str(struct pjs_stream *ps, char *out, size_t outsz)
+{
+    const char *p = ps->ps_tok_s;
+    const char *e = ps->ps_tok_e;
+    char utf8[4];
+    size_t len;
+    int32_t cp;
+    size_t n = 0;
+    char c;
+
+    if (ps->ps_tok != PJS_TOK_STRING || outsz == 0) return false;
+
+    if (!ps->ps_tok_esc)
+    {
+        len = e - p;
+        if (len >= outsz) return false;
+        memcpy(out, p, len);
+        out[len] = '\0';
+        return true;
+    }
+
+    while (p < e)
+    {
+        c = *p++;
+        if (c != '\\')
+        {
+            if (n >= outsz - 1) return false;
+            out[n++] = c;
+            continue;
+        }
+
+        if (p >= e) return false;
+
+        switch ((c = *p++))
+        {
+            case '"':
+            case '\\':
+            case '/':
+                break;
+
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+
+            case 'u':
+                cp = pjs_stream_unicode(&p, e);
+                /* Embedded NUL characters are not allowed, same as jansson */
+                if (cp <= 0) return false;
+                len = pjs_stream_utf8(cp, utf8);
+                if (n + len >= outsz) return false;
+                memcpy(out + n, utf8, len);
+                n += len;
+                continue;
+
+            default:
+                return false;
+        }
+
+        if (n >= outsz - 1) return false;
+        out[n++] = c;
+    }
+
+    out[n] = '\0';
+    return true;
+}
+
+/**
+ * Compare the current string token to @p str
+ */
+bool pjs_stream_str_eq(struct pjs_stream *ps, const char *str)
+{
+    char buf[PJS_STREAM_KEY_MAX];
+    size_t len;
+
+    if (ps->ps_tok != PJS_TOK_STRING) return false;
+
+    if (!ps->ps_tok_esc)
+    {
+        len = ps->ps_tok_e - ps->ps_tok_s;
+        return strlen(str) == len && memcmp(ps->ps_tok_s, str, len) == 0;
+    }
+
+    if (!pjs_stream_str(ps, buf, sizeof(buf))) return false;
+
+    return strcmp(buf, str) == 0;
+}
+
+/*
+ * Copy the current number token into a NUL-terminated buffer
+ */
+static bool pjs_stream_num(struct pjs_stream *ps, char *buf, size_t bufsz)
+{
+    size_t len = ps->ps_tok_e - ps->ps_tok_s;
+
+    if (ps->ps_tok != PJS_TOK_NUMBER || len >= bufsz) return false;
+
+    memcpy(buf, ps->ps_tok_s, len);
+    buf[len] = '\0';
+
+    return true;
+}
+
+/**
+ * Convert the current token to an integer; fractions and exponents are
+ * rejected, same as json_is_integer() would for a jansson value
+ */
+bool pjs_stream_int64(struct pjs_stream *ps, int64_t *out)
+{
+    char buf[PJS_STREAM_NUM_MAX];
+    char *end;
+    long long val;
+
+    if (!pjs_stream_num(ps, buf, sizeof(buf))) return false;
+    if (strpbrk(buf, ".eE") != NULL) return false;
+
+    errno = 0;
+    val = strtoll(buf, &end, 10);
+    if (errno != 0 || *end != '\0') return false;
+
+    *out = val;
+    return true;
+}
+
+/**
+ * Convert the current token to a real number
+ */
+bool pjs_stream_real(struct pjs_stream *ps, double *out)
+{
+    char buf[PJS_STREAM_NUM_MAX];
+    char *end;
+    double val;
+
+    if (!pjs_stream_num(ps, buf, sizeof(buf))) return false;
+
+    errno = 0;
+    val = strtod(buf, &end);
+    if (errno != 0 || *end != '\0') return false;
+
+    *out = val;
+    return true;
+}
+
+/**
+ * Read the next object key into @p key; @p end is set to true when the end
+ * of the object is reached instead. Keys that do not fit into @p key are
+ * returned as an empty string so they can be skipped by the caller.
+ */
+bool pjs_stream_key(struct pjs_stream *ps, char *key, size_t keysz, bool *end)
+{
+    switch (pjs_stream_next(ps))
+    {
+        case PJS_TOK_OBJ_END:
+            *end = true;
+            return true;
+
+        case PJS_TOK_STRING:
+            *end = false;
+            if (!pjs_stream_str(ps, key, keysz)) key[0] = '\0';
+            return true;
+
+        default:
+            break;
+    }
+
+    return false;
+}
+
+/*
+ * ===========================================================================
+ *  Structure descriptors
+ * ===========================================================================
+ */
+
+/*
+ * Find the field index, starting at @p hint. Columns are usually sent in the
+ * same order as they are defined in the schema so this is typically a hit
+ * on the first try.
+ */
+static int pjs_desc_index(const struct pjs_desc *desc, const char *name, int hint)
+{
+    int ii;
+
+    if (hint >= desc->num) hint = 0;
+
+    for (ii = hint; ii < desc->num; ii++)
+    {
+        if (strcmp(desc->fields[ii].name, name) == 0) return ii;
+    }
+
+    for (ii = 0; ii < hint; ii++)
+    {
+        if (strcmp(desc->fields[ii].name, name) == 0) return ii;
+    }
+
+    return -1;
+}
+
+const struct pjs_desc_field *pjs_desc_find(const struct pjs_desc *desc, const char *name)
+{
+    int idx = pjs_desc_index(desc, name, 0);
+
+    return idx < 0 ? NULL : &desc->fields[idx];
+}
+
+/**
+ * Returns true if all fields of the structure can be handled by the
+ * streaming parser
+ */
+bool pjs_desc_is_streamable(const struct pjs_desc *desc)
+{
+    int ii;
+
+    if (desc == NULL) return false;
+
+    for (ii = 0; ii < desc->num; ii++)
+    {
+        if (desc->fields[ii].kind == PJS_DESC_UNSUPPORTED) return false;
+    }
+
+    return true;
+}
+
+/*
+ * ===========================================================================
+ *  Structure population
+ * ===========================================================================
+ */
+static void pjs_stream_elem_default(uint8_t type, void *dst)
+{
+    switch (type)
+    {
+        case PJS_DESC_T_INT:
+            *(int *)dst = 0;
+            break;
+
+        case PJS_DESC_T_INT64:
+            *(int64_t *)dst = 0;
+            break;
+
+        case PJS_DESC_T_BOOL:
+            *(bool *)dst = false;
+            break;
+
+        case PJS_DESC_T_REAL:
+            *(double *)dst = 0.0;
+            break;
+
+        case PJS_DESC_T_STRING:
+            *(char *)dst = '\0';
+            break;
+
+        case PJS_DESC_T_UUID:
+            STRSCPY(((ovs_uuid_t *)dst)->uuid, PJS_STREAM_UUID_ZERO);
+            break;
+    }
+}
+
+/*
+ * Convert a single element that starts with the current token
+ */
+static bool pjs_stream_elem(struct pjs_stream *ps, uint8_t type, void *dst, size_t elem_sz)
+{
+    int64_t ival;
+
+    switch (type)
+    {
+        case PJS_DESC_T_INT:
+            if (!pjs_stream_int64(ps, &ival)) return false;
+            *(int *)dst = ival;
+            return true;
+
+        case PJS_DESC_T_INT64:
+            return pjs_stream_int64(ps, dst);
+
+        case PJS_DESC_T_BOOL:
+            if (ps->ps_tok != PJS_TOK_TRUE && ps->ps_tok != PJS_TOK_FALSE) return false;
+            *(bool *)dst = (ps->ps_tok == PJS_TOK_TRUE);
+            return true;
+
+        case PJS_DESC_T_REAL:
+            /* Unlike json_real_value(), integer values are converted as well */
+            return pjs_stream_real(ps, dst);
+
+        case PJS_DESC_T_STRING:
+            return pjs_stream_str(ps, dst, elem_sz);
+
+        case PJS_DESC_T_UUID:
+            /* [ "uuid", "<actual UUID data>" ] */
+            if (ps->ps_tok != PJS_TOK_ARR_START) return false;
+            if (pjs_stream_next(ps) != PJS_TOK_STRING || !pjs_stream_str_eq(ps, "uuid")) return false;
+            pjs_stream_next(ps);
+            if (!pjs_stream_str(ps, ((ovs_uuid_t *)dst)->uuid, sizeof(ovs_uuid_t))) return false;
+            return pjs_stream_next(ps) == PJS_TOK_ARR_END;
+    }
+
+    return false;
+}
+
+/*
+ * Parse an OVS SET or a single value into @p base; the current token is the
+ * first token of the value
+ */
+static bool pjs_stream_ovs_set(
+        struct pjs_stream *ps,
+        const struct pjs_desc_field *f,
+        char *base,
+        int *out_len,
+        pjs_errmsg_t err)
+{
+    struct pjs_stream save = *ps;
+    enum pjs_stream_tok tok;
+    int len = 0;
+
+    /* Check if we're dealing with a SET: [ "set", [ ... ]] */
+    if (ps->ps_tok != PJS_TOK_ARR_START ||
+            pjs_stream_next(ps) != PJS_TOK_STRING ||
+            !pjs_stream_str_eq(ps, "set"))
+    {
+        /* Doesn't look like it's a SET, try to parse it as it was a basic value */
+        *ps = save;
+        if (!pjs_stream_elem(ps, f->type, base, f->elem_sz))
+        {
+            PJS_ERR(err, "'%s' cannot convert JSON to type.", f->name);
+            return false;
+        }
+
+        *out_len = 1;
+        return true;
+    }
+
+    if (pjs_stream_next(ps) != PJS_TOK_ARR_START)
+    {
+        PJS_ERR(err, "OVS_SET '%s' malformed set.", f->name);
+        return false;
+    }
+
+    while ((tok = pjs_stream_next(ps)) != PJS_TOK_ARR_END)
+    {
+        if (tok == PJS_TOK_ERROR || tok == PJS_TOK_EOF)
+        {
+            PJS_ERR(err, "OVS_SET '%s' malformed set.", f->name);
+            return false;
+        }
+
+        if (len >= f->max)
+        {
+            PJS_ERR(err, "OVS_SET '%s' set size too big. Max %d.", f->name, f->max);
+            return false;
+        }
+
+        if (!pjs_stream_elem(ps, f->type, base + len * f->elem_sz, f->elem_sz))
+        {
+            PJS_ERR(err, "'%s' error converting JSON to type.", f->name);
+            return false;
+        }
+
+        len++;
+    }
+
+    if (pjs_stream_next(ps) != PJS_TOK_ARR_END)
+    {
+        PJS_ERR(err, "OVS_SET '%s' malformed set.", f->name);
+        return false;
+    }
+
+    *out_len = len;
+    return true;
+}
+
+/*
+ * Parse an OVS MAP: [ "map", [ [ key, value ], ... ]]
+ */
+static bool pjs_stream_ovs_map(
+        struct pjs_stream *ps,
+        const struct pjs_desc_field *f,
+        char *out,
+        pjs_errmsg_t err)
+{
+    char *base = out + f->off;
+    char *keys = out + f->off_keys;
+    enum pjs_stream_tok tok;
+    int64_t ival;
+    int len = 0;
+    bool ok;
+
+    if (ps->ps_tok != PJS_TOK_ARR_START ||
+            pjs_stream_next(ps) != PJS_TOK_STRING ||
+            !pjs_stream_str_eq(ps, "map") ||
+            pjs_stream_next(ps) != PJS_TOK_ARR_START)
+    {
+        PJS_ERR(err, "OVS_MAP: Object '%s' is not a map.", f->name);
+        return false;
+    }
+
+    while ((tok = pjs_stream_next(ps)) != PJS_TOK_ARR_END)
+    {
+        if (tok != PJS_TOK_ARR_START)
+        {
+            PJS_ERR(err, "OVS_MAP: Object '%s' doesn't contain array tuples.", f->name);
+            return false;
+        }
+
+        if (len >= f->max)
+        {
+            PJS_ERR(err, "OVS_MAP: Object '%s'  map size too big. Max %d.", f->name, f->max);
+            return false;
+        }
+
+        /* Parse and store the key */
+        pjs_stream_next(ps);
+        if (f->kind == PJS_DESC_OVS_SMAP)
+        {
+            ok = pjs_stream_str(ps, keys + len * PJS_OVS_MAP_KEYSZ, PJS_OVS_MAP_KEYSZ);
+        }
+        else
+        {
+            ok = pjs_stream_int64(ps, &ival);
+            if (ok) ((int *)keys)[len] = ival;
+        }
+
+        if (!ok)
+        {
+            PJS_ERR(err, "'%s' key cannot convert to JSON.", f->name);
+            return false;
+        }
+
+        /* Parse and store the data */
+        pjs_stream_next(ps);
+        if (!pjs_stream_elem(ps, f->type, base + len * f->elem_sz, f->elem_sz) ||
+                pjs_stream_next(ps) != PJS_TOK_ARR_END)
+        {
+            PJS_ERR(err, "'%s' type cannot convert to JSON.", f->name);
+            return false;
+        }
+
+        len++;
+    }
+
+    if (pjs_stream_next(ps) != PJS_TOK_ARR_END)
+    {
+        PJS_ERR(err, "OVS_MAP: Object '%s' malformed map.", f->name);
+        return false;
+    }
+
+    *(int *)(out + f->off_len) = len;
+    return true;
+}
+
+static bool pjs_stream_field(
+        struct pjs_stream *ps,
+        const struct pjs_desc_field *f,
+        char *out,
+        bool update,
+        pjs_errmsg_t err)
+{
+    bool *exists;
+    int len;
+
+    // mark presence of field
+    *(bool *)(out + f->off_present) = true;
+
+    switch (f->kind)
+    {
+        case PJS_DESC_OVS_BASIC:
+            if (!pjs_stream_ovs_set(ps, f, out + f->off, &len, err)) return false;
+
+            exists = (bool *)(out + f->off_exists);
+            *exists = (len > 0);
+            if (*exists) return true;
+
+            pjs_stream_elem_default(f->type, out + f->off);
+            if (!f->optional && !update)
+            {
+                PJS_ERR(err, "Required OVS element '%s' does not exist.", f->name);
+                return false;
+            }
+            return true;
+
+        case PJS_DESC_OVS_SET:
+            return pjs_stream_ovs_set(ps, f, out + f->off, (int *)(out + f->off_len), err);
+
+        case PJS_DESC_OVS_SMAP:
+        case PJS_DESC_OVS_DMAP:
+            return pjs_stream_ovs_map(ps, f, out, err);
+
+        default:
+            break;
+    }
+
+    PJS_ERR(err, "'%s' type not supported by the stream parser.", f->name);
+    return false;
+}
+
+/*
+ * Handle a field that was not present in the object, this applies only
+ * to non-update mode
+ */
+static bool pjs_stream_field_missing(const struct pjs_desc_field *f, char *out, pjs_errmsg_t err)
+{
+    /*
+     * Some internal types are just plain missing, for example _uuid in
+     * update notifications -- see pjs_ovs_set_from_json()
+     */
+    if (f->name[0] != '_' || f->kind == PJS_DESC_OVS_SMAP || f->kind == PJS_DESC_OVS_DMAP)
+    {
+        PJS_ERR(err, "Object '%s' does not exist.", f->name);
+        return false;
+    }
+
+    switch (f->kind)
+    {
+        case PJS_DESC_OVS_BASIC:
+            pjs_stream_elem_default(f->type, out + f->off);
+            *(bool *)(out + f->off_exists) = false;
+            if (!f->optional)
+            {
+                PJS_ERR(err, "Required OVS element '%s' does not exist.", f->name);
+                return false;
+            }
+            return true;
+
+        case PJS_DESC_OVS_SET:
+            *(int *)(out + f->off_len) = 0;
+            return true;
+
+        default:
+            break;
+    }
+
+    PJS_ERR(err, "'%s' type not supported by the stream parser.", f->name);
+    return false;
+}
+
+bool pjs_stream_from_json(
+        const struct pjs_desc *desc,
+        void *out,
+        struct pjs_stream *ps,
+        bool update,
+        pjs_errmsg_t err)
+{
+    char key[PJS_STREAM_KEY_MAX];
+    uint8_t seen[desc->num + 1];
+    const struct pjs_desc_field *f;
+    bool end;
+    int hint = 0;
+    int idx;
+    int ii;
+
+    if (pjs_stream_next(ps) != PJS_TOK_OBJ_START)
+    {
+        PJS_ERR(err, "%s: JSON object expected.", desc->name);
+        return false;
+    }
+
+    memset(seen, 0, sizeof(seen));
+
+    for (;;)
+    {
+        if (!pjs_stream_key(ps, key, sizeof(key), &end))
+        {
+            PJS_ERR(err, "%s: malformed JSON object.", desc->name);
+            return false;
+        }
+
+        if (end) break;
+
+        idx = pjs_desc_index(desc, key, hint);
+        if (idx < 0)
+        {
+            /* Not part of the structure */
+            if (!pjs_stream_skip(ps))
+            {
+                PJS_ERR(err, "%s: malformed JSON value of '%s'.", desc->name, key);
+                return false;
+            }
+            continue;
+        }
+
+        hint = idx + 1;
+        f = &desc->fields[idx];
+
+        /* null values are treated as non-existent */
+        if (pjs_stream_next(ps) == PJS_TOK_NULL) continue;
+
+        if (!pjs_stream_field(ps, f, out, update, err)) return false;
+
+        seen[idx] = 1;
+    }
+
+    /* In update mode, non-existent fields are not touched */
+    if (update) return true;
+
+    for (ii = 0; ii < desc->num; ii++)
+    {
+        if (seen[ii]) continue;
+        if (!pjs_stream_field_missing(&desc->fields[ii], out, err)) return false;
+    }
+
+    return true;
+}
@@ -36,6 +36,7 @@ UNIT_SRC += src/pjs_array.c
 UNIT_SRC += src/pjs_ovs_basic.c
 UNIT_SRC += src/pjs_ovs_set.c
 UNIT_SRC += src/pjs_ovs_map.c
+UNIT_SRC += src/pjs_stream.c
 
 UNIT_CFLAGS := -I$(UNIT_PATH)/inc
 UNIT_DEPS += src/lib/common
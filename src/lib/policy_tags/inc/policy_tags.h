@@ -32,6 +32,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define POLICY_TAGS_H_INCLUDED
 
 #include "os.h"
+#include "os_types.h"
 #include "ovsdb.h"
 #include "ovsdb_table.h"
 #include "ovsdb_update.h"
@@ -129,11 +130,14 @@ struct om_mapping_tle_flag
 
 #define OM_TLE_VAR_FLAGS(x)     (x & (OM_TLE_FLAG_LOCAL | OM_TLE_FLAG_DEVICE | OM_TLE_FLAG_CLOUD))
 
+struct om_tag_set;
+
 typedef struct {
     char            *name;
     bool            group;
 
     ds_tree_t       values; // Tree of om_tag_list_entry_t
+    struct om_tag_set *set; // Binary mac/ip values, built on first lookup
 
     ds_tree_node_t  dst_node;
 } om_tag_t;
@@ -152,6 +156,7 @@ extern om_tag_t *
                 om_tag_alloc(const char *name, bool group);
 extern om_tag_t *
                 om_tag_find_by_name(const char *name, bool group);
+extern uint32_t om_tag_get_generation(void);
 
 
 struct tag_mgr {
@@ -209,7 +214,9 @@ om_get_type_of_tag(char *name);
 /**
  * @brief checks if a string is included in an opensync tag
  *
- * The tag can be a tag or a group tag
+ * The tag can be a tag or a group tag. The tag name is parsed and looked up
+ * on each call: callers checking the same tag repeatedly should keep an
+ * om_tag_handle instead.
  * @param value the string checked for inclusion
  * @param tag_name the tag name to check
  */
@@ -225,6 +232,99 @@ om_tag_in(char *value, char *tag_name);
 om_tag_t *
 om_tag_find(char *tag_name);
 
+
+/******************************************************************************
+ * Tag Handle Definitions
+ *****************************************************************************/
+/**
+ * @brief pre-resolved reference to a tag
+ *
+ * A handle parses a tag name once and caches the tag it refers to.
+ * The cached tag is looked up again whenever the tags generation changes,
+ * so a handle stays valid across tag updates, additions and removals.
+ * Handles hold no allocated memory and can be embedded in the caller's
+ * structures.
+ */
+struct om_tag_handle
+{
+    bool valid;       /* initialized from an opensync tag name */
+    char name[256];   /* tag name, without markers nor source char */
+    bool group;       /* group tag */
+    int match_flags;  /* source flags a value must carry, 0 for any */
+    om_tag_t *tag;    /* cached tag, valid for generation gen */
+    uint32_t gen;     /* tags generation the cached tag was resolved at */
+    bool resolved;    /* tag lookup performed at least once */
+};
+
+
+/**
+ * @brief initializes a tag handle
+ *
+ * @param handle the handle to initialize
+ * @param tag_name the tag name, i.e ${tag}, ${@tag}, $[group]
+ * @return true if tag_name is an opensync tag, false otherwise
+ */
+bool
+om_tag_handle_init(struct om_tag_handle *handle, const char *tag_name);
+
+
+/**
+ * @brief returns the tag a handle refers to
+ *
+ * @param handle the tag handle
+ * @return the tag if it exists, NULL otherwise
+ */
+om_tag_t *
+om_tag_handle_resolve(struct om_tag_handle *handle);
+
+
+/**
+ * @brief checks if a string is included in the tag a handle refers to
+ *
+ * @param handle the tag handle
+ * @param value the string checked for inclusion
+ * @return true if included, false otherwise
+ */
+bool
+om_tag_handle_in(struct om_tag_handle *handle, const char *value);
+
+
+/**
+ * @brief checks if a mac address is included in the tag a handle refers to
+ *
+ * The lookup is performed on the binary representation of the tag values.
+ * As with om_tag_in() on a formatted address, only values spelled the way
+ * PRI_os_macaddr_lower_t formats them match.
+ * @param handle the tag handle
+ * @param mac the mac address checked for inclusion
+ * @return true if included, false otherwise
+ */
+bool
+om_tag_handle_in_mac(struct om_tag_handle *handle, const os_macaddr_t *mac);
+
+
+/**
+ * @brief checks if an ip address is included in the tag a handle refers to
+ *
+ * Only values spelled the way inet_ntop() formats them match.
+ * @param handle the tag handle
+ * @param af the address family, AF_INET or AF_INET6
+ * @param ip the address in network order
+ * @return true if included, false otherwise
+ */
+bool
+om_tag_handle_in_ip(struct om_tag_handle *handle, int af, const void *ip);
+
+
+/**
+ * @brief frees the binary value set of a tag
+ *
+ * @param tag the tag
+ */
+void
+om_tag_set_free(om_tag_t *tag);
+
+
 /**
  * @brief registers standard callback for OpenFlow_Tag table monitor
  *
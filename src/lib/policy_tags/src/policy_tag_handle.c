@@ -0,0 +1,370 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Tag handles and binary tag value sets
+ */
+
+#include <arpa/inet.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "log.h"
+#include "memutil.h"
+#include "policy_tags.h"
+
+/* Initial number of slots of a tag value set, must be a power of 2 */
+#define OM_TAG_SET_MIN_SIZE 16
+
+/**
+ * @brief binary tag value
+ *
+ * A mac (6 bytes), an ipv4 (4 bytes) or an ipv6 (16 bytes) address.
+ * A zero length marks an empty slot.
+ */
+struct om_tag_set_entry
+{
+    uint8_t addr[16];
+    uint8_t len;
+    uint8_t flags;
+};
+
+/**
+ * @brief open addressing hash set of the binary values of a tag
+ */
+struct om_tag_set
+{
+    size_t size;   /* number of slots, power of 2 */
+    size_t count;  /* number of used slots */
+    struct om_tag_set_entry *entries;
+};
+
+
+static uint32_t
+om_tag_set_hash(const uint8_t *addr, uint8_t len)
+{
+    uint32_t hash;
+    uint8_t i;
+
+    /* FNV-1a */
+    hash = 2166136261U;
+    hash = (hash ^ len) * 16777619U;
+    for (i = 0; i < len; i++) hash = (hash ^ addr[i]) * 16777619U;
+
+    return hash;
+}
+
+
+static struct om_tag_set_entry *
+om_tag_set_slot(struct om_tag_set *set, const uint8_t *addr, uint8_t len)
+{
+    struct om_tag_set_entry *entry;
+    size_t mask;
+    size_t idx;
+
+    mask = set->size - 1;
+    idx = om_tag_set_hash(addr, len) & mask;
+    for (;;)
+    {
+        entry = &set->entries[idx];
+        if (entry->len == 0) return entry;
+        if (entry->len == len && !memcmp(entry->addr, addr, len)) return entry;
+        idx = (idx + 1) & mask;
+    }
+}
+
+
+static void
+om_tag_set_add(struct om_tag_set *set, const uint8_t *addr, uint8_t len,
+               uint8_t flags)
+{
+    struct om_tag_set_entry *entry;
+
+    entry = om_tag_set_slot(set, addr, len);
+    if (entry->len == 0)
+    {
+        memcpy(entry->addr, addr, len);
+        entry->len = len;
+        set->count++;
+    }
+
+    /* The same address can be spelled differently in several values */
+    entry->flags |= flags;
+}
+
+
+/**
+ * @brief converts a tag value to its binary representation
+ *
+ * Values are string compared against formatted addresses, so only the
+ * canonical spelling of an address is converted: an upper case mac or a
+ * non compressed ipv6 address would not have matched, and does not here.
+ * @param value the tag value
+ * @param addr the binary address, at least 16 bytes
+ * @return the address length, 0 if the value is not a mac nor an ip address
+ */
+static uint8_t
+om_tag_value_to_bin(const char *value, uint8_t *addr)
+{
+    char canonical[INET6_ADDRSTRLEN];
+    unsigned int m[6];
+    uint8_t len;
+    char end;
+    int af;
+    int rc;
+    int i;
+
+    af = AF_UNSPEC;
+    len = 0;
+    if (inet_pton(AF_INET, value, addr) == 1)
+    {
+        af = AF_INET;
+        len = 4;
+    }
+    else if (inet_pton(AF_INET6, value, addr) == 1)
+    {
+        af = AF_INET6;
+        len = 16;
+    }
+
+    if (af != AF_UNSPEC)
+    {
+        if (inet_ntop(af, addr, canonical, sizeof(canonical)) == NULL) return 0;
+        if (strcmp(canonical, value)) return 0;
+
+        return len;
+    }
+
+    rc = sscanf(value, "%2x:%2x:%2x:%2x:%2x:%2x%c",
+                &m[0], &m[1], &m[2], &m[3], &m[4], &m[5], &end);
+    if (rc != 6) return 0;
+
+    for (i = 0; i < 6; i++) addr[i] = (uint8_t)m[i];
+
+    snprintf(canonical, sizeof(canonical), PRI_os_macaddr_lower_t,
+             FMT_os_macaddr_pt((os_macaddr_t *)addr));
+    if (strcmp(canonical, value)) return 0;
+
+    return 6;
+}
+
+
+/**
+ * @brief builds the binary value set of a tag
+ *
+ * Values which are neither a mac nor an ip address are skipped.
+ * @param tag the tag
+ * @return the set, NULL on allocation failure
+ */
+static struct om_tag_set *
+om_tag_set_build(om_tag_t *tag)
+{
+    om_tag_list_entry_t *tle;
+    struct om_tag_set *set;
+    uint8_t addr[16];
+    size_t nvalues;
+    uint8_t len;
+
+    nvalues = 0;
+    ds_tree_foreach(&tag->values, tle) nvalues++;
+
+    set = CALLOC(1, sizeof(*set));
+    if (set == NULL) return NULL;
+
+    /* Keep the load factor under 50% */
+    set->size = OM_TAG_SET_MIN_SIZE;
+    while (set->size < (nvalues * 2)) set->size <<= 1;
+
+    set->entries = CALLOC(set->size, sizeof(*set->entries));
+    if (set->entries == NULL)
+    {
+        FREE(set);
+        return NULL;
+    }
+
+    ds_tree_foreach(&tag->values, tle)
+    {
+        len = om_tag_value_to_bin(tle->value, addr);
+        if (len == 0) continue;
+
+        om_tag_set_add(set, addr, len, tle->flags);
+    }
+
+    LOGT("%s: tag %s: %zu binary values out of %zu", __func__,
+         tag->name, set->count, nvalues);
+
+    return set;
+}
+
+
+void
+om_tag_set_free(om_tag_t *tag)
+{
+    struct om_tag_set *set;
+
+    if (tag == NULL) return;
+
+    set = tag->set;
+    if (set == NULL) return;
+
+    FREE(set->entries);
+    FREE(set);
+    tag->set = NULL;
+}
+
+
+bool
+om_tag_handle_init(struct om_tag_handle *handle, const char *tag_name)
+{
+    const char *tag_s;
+    int tag_type;
+
+    if (handle == NULL) return false;
+    if (tag_name == NULL) return false;
+
+    memset(handle, 0, sizeof(*handle));
+
+    tag_type = om_tag_get_type((char *)tag_name);
+    if (tag_type == NOT_A_OPENSYNC_TAG) return false;
+
+    tag_s = tag_name + 2;
+    if (*tag_s == TEMPLATE_DEVICE_CHAR)
+    {
+        handle->match_flags = OM_TLE_FLAG_DEVICE;
+        tag_s += 1;
+    }
+    else if (*tag_s == TEMPLATE_CLOUD_CHAR)
+    {
+        handle->match_flags = OM_TLE_FLAG_CLOUD;
+        tag_s += 1;
+    }
+    else if (*tag_s == TEMPLATE_LOCAL_CHAR)
+    {
+        handle->match_flags = OM_TLE_FLAG_LOCAL;
+        tag_s += 1;
+    }
+
+    /* Copy tag name, remove end marker */
+    STRSCPY_LEN(handle->name, tag_s, -1);
+
+    handle->group = (tag_type == OPENSYNC_GROUP_TAG);
+    handle->valid = true;
+
+    return true;
+}
+
+
+om_tag_t *
+om_tag_handle_resolve(struct om_tag_handle *handle)
+{
+    uint32_t gen;
+
+    if (handle == NULL) return NULL;
+
+    gen = om_tag_get_generation();
+    if (handle->resolved && handle->gen == gen) return handle->tag;
+
+    handle->tag = om_tag_find_by_name(handle->name, handle->group);
+    handle->gen = gen;
+    handle->resolved = true;
+
+    return handle->tag;
+}
+
+
+bool
+om_tag_handle_in(struct om_tag_handle *handle, const char *value)
+{
+    om_tag_list_entry_t *e;
+    om_tag_t *tag;
+
+    if (value == NULL) return false;
+
+    tag = om_tag_handle_resolve(handle);
+    if (tag == NULL) return false;
+
+    e = om_tag_list_entry_find_by_value(&tag->values, (char *)value);
+    if (e == NULL) return false;
+
+    if (handle->match_flags && !(e->flags & handle->match_flags)) return false;
+
+    LOGT("%s: found %s in tag %s", __func__, value, handle->name);
+
+    return true;
+}
+
+
+/**
+ * @brief looks up a binary address in the tag a handle refers to
+ *
+ * @param handle the tag handle
+ * @param addr the binary address
+ * @param len the address length
+ * @return true if included, false otherwise
+ */
+static bool
+om_tag_handle_in_bin(struct om_tag_handle *handle, const uint8_t *addr,
+                     uint8_t len)
+{
+    struct om_tag_set_entry *entry;
+    om_tag_t *tag;
+
+    tag = om_tag_handle_resolve(handle);
+    if (tag == NULL) return false;
+
+    if (tag->set == NULL) tag->set = om_tag_set_build(tag);
+    if (tag->set == NULL) return false;
+
+    entry = om_tag_set_slot(tag->set, addr, len);
+    if (entry->len == 0) return false;
+
+    if (handle->match_flags && !(entry->flags & handle->match_flags)) return false;
+
+    return true;
+}
+
+
+bool
+om_tag_handle_in_mac(struct om_tag_handle *handle, const os_macaddr_t *mac)
+{
+    if (mac == NULL) return false;
+
+    return om_tag_handle_in_bin(handle, mac->addr, sizeof(mac->addr));
+}
+
+
+bool
+om_tag_handle_in_ip(struct om_tag_handle *handle, int af, const void *ip)
+{
+    if (ip == NULL) return false;
+
+    if (af == AF_INET) return om_tag_handle_in_bin(handle, ip, 4);
+    if (af == AF_INET6) return om_tag_handle_in_bin(handle, ip, 16);
+
+    return false;
+}
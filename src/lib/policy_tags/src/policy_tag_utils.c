@@ -182,54 +182,15 @@ om_tag_find(char *tag_name)
 bool
 om_tag_in(char *value, char *tag_name)
 {
-    om_tag_list_entry_t *e;
-    int match_flags;
-    char name[256];
-    om_tag_t *tag;
-    bool is_gtag;
-    int tag_type;
-    char *tag_s;
+    struct om_tag_handle handle;
+    bool rc;
 
     /* Sanity checks */
     if (tag_name == NULL) return false;
     if (value == NULL) return false;
 
-    tag_type = om_tag_get_type(tag_name);
-    if (tag_type == NOT_A_OPENSYNC_TAG) return false;
-
-    match_flags = 0;
-    tag_s = tag_name + 2;
-    if (*tag_s == TEMPLATE_DEVICE_CHAR)
-    {
-        match_flags = OM_TLE_FLAG_DEVICE;
-        tag_s += 1;
-    }
-    else if (*tag_s == TEMPLATE_CLOUD_CHAR)
-    {
-        match_flags = OM_TLE_FLAG_CLOUD;
-        tag_s += 1;
-    }
-    else if (*tag_s == TEMPLATE_LOCAL_CHAR)
-    {
-        match_flags = OM_TLE_FLAG_LOCAL;
-        tag_s += 1;
-    }
-
-    /* Copy tag name, remove end marker */
-    STRSCPY_LEN(name, tag_s, -1);
-
-    is_gtag = (tag_type == OPENSYNC_GROUP_TAG);
-
-    tag = om_tag_find_by_name(name, is_gtag);
-    if (tag == NULL) return false;
-
-
-    e = om_tag_list_entry_find_by_value(&tag->values, value);
-    if (e == NULL) return false;
-
-    if (match_flags && !(e->flags & match_flags)) return false;
-
-    LOGT("%s: found %s in tag %s", __func__, value, tag_name);
+    rc = om_tag_handle_init(&handle, tag_name);
+    if (!rc) return false;
 
-    return true;
+    return om_tag_handle_in(&handle, value);
 }
@@ -59,6 +59,9 @@ static ds_tree_t            om_tags = DS_TREE_INIT((ds_key_cmp_t *)strcmp,
                                                                    om_tag_t, dst_node);
 
 
+/* Bumped on any tag change, invalidates the tag handles */
+static uint32_t             om_tag_gen;
+
 static struct tag_mgr my_mgr_s = { 0 };
 static struct tag_mgr *my_mgr = &my_mgr_s;
 
@@ -193,6 +196,9 @@ om_tag_free(om_tag_t *tag)
             vp = ds_tree_inext(&iter);
         }
 
+        // Binary values
+        om_tag_set_free(tag);
+
         // Name
         FREE(tag->name);
 
@@ -255,6 +261,13 @@ om_tag_find_by_name(const char *name, bool group)
     return NULL;
 }
 
+// Get the tags generation
+uint32_t
+om_tag_get_generation(void)
+{
+    return om_tag_gen;
+}
+
 // Add a tag to the global tree
 bool
 om_tag_add(om_tag_t *tag)
@@ -268,6 +281,7 @@ om_tag_add(om_tag_t *tag)
     }
 
     ds_tree_insert(&om_tags, tag, tag->name);
+    om_tag_gen++;
 
     om_tag_list_to_buf(&tag->values, 0, dbuf, sizeof(dbuf)-1);
     LOGN("[%s] %sTag added, values:%s",
@@ -290,6 +304,7 @@ om_tag_remove(om_tag_t *tag)
     char                dbuf[2048];
 
     ds_tree_remove(&om_tags, tag);
+    om_tag_gen++;
 
     om_tag_list_to_buf(&tag->values, 0, dbuf, sizeof(dbuf)-1);
     LOGN("[%s] %sTag removed, values:%s",
@@ -343,6 +358,10 @@ om_tag_update(om_tag_t *tag, ds_tree_t *new_values)
 
     om_tag_list_diff_free(&diff);
 
+    // The binary values get rebuilt on the next lookup
+    om_tag_set_free(tag);
+    om_tag_gen++;
+
     if (!tag->group) {
         om_tag_group_update_by_tag(tag->name);
     }
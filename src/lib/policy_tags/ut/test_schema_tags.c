@@ -24,12 +24,17 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <time.h>
+
 #include "json_util.h"
 #include "log.h"
 #include "policy_tags.h"
 #include "target.h"
 #include "unity.h"
 #include "unit_test_utils.h"
+#include "memutil.h"
 
 char *test_name = "test_policy_tags";
 
@@ -347,6 +352,203 @@ void test_val_in_tag_group(void)
 }
 
 
+/**
+ * @brief creates a tag holding a given number of mac addresses
+ *
+ * The device values are the even entries, the cloud values the odd ones.
+ */
+static om_tag_t *
+test_create_mac_tag(const char *name, int nmacs)
+{
+    char mac_s[32];
+    om_tag_t *tag;
+    uint8_t flags;
+    bool ret;
+    int i;
+
+    tag = om_tag_alloc(name, false);
+    TEST_ASSERT_NOT_NULL(tag);
+
+    for (i = 0; i < nmacs; i++)
+    {
+        snprintf(mac_s, sizeof(mac_s), "02:00:00:%02x:%02x:%02x",
+                 (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff);
+        flags = (i & 1) ? OM_TLE_FLAG_CLOUD : OM_TLE_FLAG_DEVICE;
+        ret = om_tag_list_entry_add(&tag->values, mac_s, flags);
+        TEST_ASSERT_TRUE(ret);
+    }
+
+    ret = om_tag_add(tag);
+    TEST_ASSERT_TRUE(ret);
+
+    return tag;
+}
+
+
+void
+test_tag_handle(void)
+{
+    struct om_tag_handle handle;
+    os_macaddr_t mac = { { 0x02, 0x00, 0x00, 0x00, 0x00, 0x02 } };
+    struct in6_addr ip6;
+    struct in_addr ip;
+    ds_tree_t values;
+    om_tag_t *tag;
+    bool ret;
+
+    /* Not a tag */
+    ret = om_tag_handle_init(&handle, "02:00:00:00:00:02");
+    TEST_ASSERT_FALSE(ret);
+    TEST_ASSERT_FALSE(handle.valid);
+
+    /* Unknown tag */
+    ret = om_tag_handle_init(&handle, "${@mac_tag}");
+    TEST_ASSERT_TRUE(ret);
+    TEST_ASSERT_TRUE(handle.valid);
+    TEST_ASSERT_NULL(om_tag_handle_resolve(&handle));
+    TEST_ASSERT_FALSE(om_tag_handle_in_mac(&handle, &mac));
+
+    /* The handle picks up the tag once created */
+    tag = test_create_mac_tag("mac_tag", 4);
+    TEST_ASSERT_TRUE(om_tag_handle_resolve(&handle) == tag);
+    TEST_ASSERT_TRUE(om_tag_handle_in_mac(&handle, &mac));
+    TEST_ASSERT_TRUE(om_tag_handle_in(&handle, "02:00:00:00:00:02"));
+
+    /* 02:00:00:00:00:03 is a cloud value */
+    mac.addr[5] = 3;
+    TEST_ASSERT_FALSE(om_tag_handle_in_mac(&handle, &mac));
+    ret = om_tag_handle_init(&handle, "${mac_tag}");
+    TEST_ASSERT_TRUE(ret);
+    TEST_ASSERT_TRUE(om_tag_handle_in_mac(&handle, &mac));
+
+    /* Binary lookups match the same values as formatted string lookups */
+    om_tag_list_init(&values);
+    ret = om_tag_list_entry_add(&values, "02:00:00:00:00:AB", OM_TLE_FLAG_DEVICE);
+    TEST_ASSERT_TRUE(ret);
+    ret = om_tag_list_entry_add(&values, "02:00:00:00:00:cd", OM_TLE_FLAG_DEVICE);
+    TEST_ASSERT_TRUE(ret);
+    ret = om_tag_list_entry_add(&values, "2001:db8:0:0:0:0:0:2", OM_TLE_FLAG_DEVICE);
+    TEST_ASSERT_TRUE(ret);
+    ret = om_tag_list_entry_add(&values, "10.1.2.3", OM_TLE_FLAG_DEVICE);
+    TEST_ASSERT_TRUE(ret);
+    ret = om_tag_list_entry_add(&values, "2001:db8::1", OM_TLE_FLAG_CLOUD);
+    TEST_ASSERT_TRUE(ret);
+    ret = om_tag_update(tag, &values);
+    TEST_ASSERT_TRUE(ret);
+    om_tag_list_free(&values);
+
+    /* The update invalidated the former values */
+    TEST_ASSERT_FALSE(om_tag_handle_in_mac(&handle, &mac));
+    mac.addr[5] = 0xcd;
+    TEST_ASSERT_TRUE(om_tag_handle_in_mac(&handle, &mac));
+    TEST_ASSERT_TRUE(om_tag_in("02:00:00:00:00:cd", "${mac_tag}"));
+
+    /* Upper case values are not matched by a formatted mac address */
+    mac.addr[5] = 0xab;
+    TEST_ASSERT_FALSE(om_tag_handle_in_mac(&handle, &mac));
+    TEST_ASSERT_FALSE(om_tag_in("02:00:00:00:00:ab", "${mac_tag}"));
+
+    inet_pton(AF_INET, "10.1.2.3", &ip);
+    TEST_ASSERT_TRUE(om_tag_handle_in_ip(&handle, AF_INET, &ip));
+    inet_pton(AF_INET, "10.1.2.4", &ip);
+    TEST_ASSERT_FALSE(om_tag_handle_in_ip(&handle, AF_INET, &ip));
+    inet_pton(AF_INET6, "2001:db8::1", &ip6);
+    TEST_ASSERT_TRUE(om_tag_handle_in_ip(&handle, AF_INET6, &ip6));
+
+    /* Neither are non canonical ipv6 spellings */
+    inet_pton(AF_INET6, "2001:db8::2", &ip6);
+    TEST_ASSERT_FALSE(om_tag_handle_in_ip(&handle, AF_INET6, &ip6));
+    inet_pton(AF_INET6, "2001:db8::1", &ip6);
+
+    /* Device values only */
+    ret = om_tag_handle_init(&handle, "${@mac_tag}");
+    TEST_ASSERT_TRUE(ret);
+    TEST_ASSERT_FALSE(om_tag_handle_in_ip(&handle, AF_INET6, &ip6));
+
+    /* The handle drops the tag once removed */
+    ret = om_tag_remove(tag);
+    TEST_ASSERT_TRUE(ret);
+    TEST_ASSERT_NULL(om_tag_handle_resolve(&handle));
+    TEST_ASSERT_FALSE(om_tag_handle_in_mac(&handle, &mac));
+}
+
+
+static int64_t
+test_elapsed_ns(struct timespec *start, struct timespec *end)
+{
+    int64_t elapsed_ns;
+
+    elapsed_ns = (end->tv_sec - start->tv_sec) * 1000000000LL;
+    elapsed_ns += (end->tv_nsec - start->tv_nsec);
+
+    return elapsed_ns;
+}
+
+
+/**
+ * @brief compares the string and binary membership checks
+ *
+ * Looks up the members, and as many non members, of a tag holding
+ * thousands of mac addresses.
+ */
+void
+test_tag_membership_bench(void)
+{
+    const int nmacs = 4096;
+    struct om_tag_handle handle;
+    struct timespec start;
+    struct timespec end;
+    int64_t string_ns;
+    int64_t bin_ns;
+    os_macaddr_t mac;
+    char mac_s[32];
+    om_tag_t *tag;
+    int found;
+    int i;
+
+    tag = test_create_mac_tag("bench_tag", nmacs);
+
+    found = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < 2 * nmacs; i++)
+    {
+        snprintf(mac_s, sizeof(mac_s), "02:00:00:%02x:%02x:%02x",
+                 (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff);
+        found += om_tag_in(mac_s, "${bench_tag}");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    string_ns = test_elapsed_ns(&start, &end);
+    TEST_ASSERT_EQUAL_INT(nmacs, found);
+
+    om_tag_handle_init(&handle, "${bench_tag}");
+    memset(&mac, 0, sizeof(mac));
+    mac.addr[0] = 0x02;
+
+    /* Build the tag's binary values ahead of the measurement */
+    TEST_ASSERT_TRUE(om_tag_handle_in_mac(&handle, &mac));
+
+    found = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < 2 * nmacs; i++)
+    {
+        mac.addr[3] = (i >> 16) & 0xff;
+        mac.addr[4] = (i >> 8) & 0xff;
+        mac.addr[5] = i & 0xff;
+        found += om_tag_handle_in_mac(&handle, &mac);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    bin_ns = test_elapsed_ns(&start, &end);
+    TEST_ASSERT_EQUAL_INT(nmacs, found);
+
+    LOGI("%s: %d members: om_tag_in: %" PRId64 " ns/lookup, "
+         "om_tag_handle_in_mac: %" PRId64 " ns/lookup", __func__, nmacs,
+         string_ns / (2 * nmacs), bin_ns / (2 * nmacs));
+
+    om_tag_remove(tag);
+}
+
+
+
 int
 main(int argc, char *argv[])
 {
@@ -361,6 +563,8 @@ main(int argc, char *argv[])
     RUN_TEST(test_type_of_tag);
     RUN_TEST(test_val_in_tag);
     RUN_TEST(test_val_in_tag_group);
+    RUN_TEST(test_tag_handle);
+    RUN_TEST(test_tag_membership_bench);
 
     return ut_fini();
 }
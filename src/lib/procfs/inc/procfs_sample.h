@@ -0,0 +1,169 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef PROCFS_SAMPLE_H_INCLUDED
+#define PROCFS_SAMPLE_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * ===========================================================================
+ *  Cached /proc and /sys sampler
+ *
+ *  Files are opened once and re-read with pread() at offset 0. The
+ *  contents are cached for one sampling epoch (PROCFS_SAMPLE_EPOCH_MS), so
+ *  all the consumers in a process that sample the same file within an epoch
+ *  share a single read. The typed getters and the scanners parse the cached
+ *  text in place and never allocate.
+ *
+ *  Like the rest of the event loop libraries, this is not thread safe.
+ * ===========================================================================
+ */
+
+/** Load averages, as in /proc/loadavg */
+struct procfs_loadavg
+{
+    double  la_one;
+    double  la_five;
+    double  la_fifteen;
+};
+
+/** A subset of /proc/meminfo, in kB */
+struct procfs_meminfo
+{
+    uint64_t    mi_mem_total;
+    uint64_t    mi_mem_free;
+    uint64_t    mi_mem_available;       /**< 0 on kernels older than 3.14 */
+    uint64_t    mi_buffers;
+    uint64_t    mi_cached;
+    uint64_t    mi_swap_total;
+    uint64_t    mi_swap_free;
+};
+
+/** A cpu line of /proc/stat, in USER_HZ */
+struct procfs_cpu
+{
+    uint64_t    cpu_user;
+    uint64_t    cpu_nice;
+    uint64_t    cpu_system;
+    uint64_t    cpu_idle;
+    uint64_t    cpu_iowait;
+    uint64_t    cpu_irq;
+    uint64_t    cpu_softirq;
+    uint64_t    cpu_steal;
+    uint64_t    cpu_guest;
+    uint64_t    cpu_guest_nice;
+};
+
+/** A subset of /proc/<pid>/status, in kB */
+struct procfs_pid_status
+{
+    uint64_t    ps_vm_size;
+    uint64_t    ps_vm_rss;
+};
+
+/**
+ * Return the contents of @p path, read at most once per epoch
+ *
+ * The returned buffer is NUL terminated and owned by the library. It stays
+ * valid until the next call into the library.
+ *
+ * @param[in]   path    absolute path of a /proc or /sys file
+ * @param[out]  len     if not NULL, the length of the contents
+ *
+ * @return the contents or NULL if the file cannot be read
+ */
+const char *procfs_sample_read(const char *path, size_t *len);
+
+/**
+ * Start a new sampling epoch; the next read of any file goes to the kernel
+ */
+void procfs_sample_epoch_next(void);
+
+/**
+ * Close @p path and drop its cached contents
+ *
+ * Files of processes that exited are dropped automatically, this is only
+ * needed to release files that will not be sampled anymore.
+ */
+void procfs_sample_close(const char *path);
+
+/**
+ * Close all files
+ */
+void procfs_sample_fini(void);
+
+/*
+ * ===========================================================================
+ *  Typed getters
+ * ===========================================================================
+ */
+bool procfs_loadavg_get(struct procfs_loadavg *la);
+
+/** System uptime in seconds, from /proc/uptime */
+bool procfs_uptime_get(double *uptime);
+
+bool procfs_meminfo_get(struct procfs_meminfo *mi);
+
+/**
+ * Statistics of @p cpu from /proc/stat, or the aggregate if @p cpu is -1
+ *
+ * Offline CPUs are not listed in /proc/stat, false is returned for them.
+ */
+bool procfs_cpu_get(int cpu, struct procfs_cpu *stat);
+
+/**
+ * Highest CPU number listed in /proc/stat plus one, or -1 on error
+ */
+int procfs_cpu_count(void);
+
+bool procfs_pid_status_get(pid_t pid, struct procfs_pid_status *st);
+
+/*
+ * ===========================================================================
+ *  Zero-allocation scanners, for files without a typed getter
+ * ===========================================================================
+ */
+
+/** Beginning of the line after @p p, or NULL if @p p is on the last line */
+const char *procfs_line_next(const char *p);
+
+/** The rest of the first line of @p buf starting with @p prefix, or NULL */
+const char *procfs_line_find(const char *buf, const char *prefix);
+
+/** Skip blanks and parse an unsigned decimal at @p *p, advancing @p *p past it */
+bool procfs_scan_u64(const char **p, uint64_t *val);
+
+/** Skip blanks and parse a floating point number at @p *p, advancing @p *p past it */
+bool procfs_scan_double(const char **p, double *val);
+
+/** Skip blanks and the following word at @p *p */
+bool procfs_scan_skip(const char **p);
+
+#endif /* PROCFS_SAMPLE_H_INCLUDED */
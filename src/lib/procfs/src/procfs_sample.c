@@ -0,0 +1,475 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "const.h"
+#include "ds_tree.h"
+#include "kconfig.h"
+#include "log.h"
+#include "memutil.h"
+#include "os_time.h"
+
+#include "procfs_sample.h"
+
+#if !defined(CONFIG_PROCFS_SAMPLE_EPOCH_MS)
+#define CONFIG_PROCFS_SAMPLE_EPOCH_MS 200
+#endif
+
+#define PROCFS_BUF_INIT     4096                /* Initial buffer size, grown as needed */
+#define PROCFS_BUF_MAX      (1024 * 1024)       /* Largest file that will be read */
+#define PROCFS_IDLE_MS      (5 * 60 * 1000)     /* Files not sampled for this long are closed */
+
+struct procfs_sample_file
+{
+    char               *pf_path;
+    int                 pf_fd;
+    char               *pf_buf;
+    size_t              pf_size;                /* Size of pf_buf */
+    size_t              pf_len;                 /* Length of the cached contents */
+    int64_t             pf_stamp;               /* Time of the last read, in ms */
+    unsigned            pf_epoch;               /* Epoch of the last read */
+    bool                pf_valid;
+    ds_tree_node_t      pf_tnode;
+};
+
+static ds_tree_t procfs_sample_files = DS_TREE_INIT(ds_str_cmp, struct procfs_sample_file, pf_tnode);
+static unsigned procfs_sample_epoch = 1;
+
+/*
+ * ===========================================================================
+ *  File cache
+ * ===========================================================================
+ */
+static void procfs_sample_file_free(struct procfs_sample_file *pf)
+{
+    ds_tree_remove(&procfs_sample_files, pf);
+    if (pf->pf_fd >= 0) close(pf->pf_fd);
+    FREE(pf->pf_buf);
+    FREE(pf->pf_path);
+    FREE(pf);
+}
+
+static bool procfs_sample_file_open(struct procfs_sample_file *pf)
+{
+    if (pf->pf_fd >= 0) close(pf->pf_fd);
+
+    pf->pf_fd = open(pf->pf_path, O_RDONLY | O_CLOEXEC);
+    if (pf->pf_fd < 0)
+    {
+        LOG(DEBUG, "procfs: %s: Error opening: %s", pf->pf_path, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Read the whole file into pf_buf. /proc files report a size of 0, so the
+ * buffer is grown until a read comes back short.
+ */
+static bool procfs_sample_file_pread(struct procfs_sample_file *pf)
+{
+    ssize_t rc;
+
+    while (true)
+    {
+        rc = pread(pf->pf_fd, pf->pf_buf, pf->pf_size - 1, 0);
+        if (rc < 0) return false;
+        if ((size_t)rc < pf->pf_size - 1) break;
+
+        if (pf->pf_size >= PROCFS_BUF_MAX)
+        {
+            LOG(WARN, "procfs: %s: Contents truncated to %zu bytes.", pf->pf_path, pf->pf_size - 1);
+            break;
+        }
+
+        pf->pf_size *= 2;
+        pf->pf_buf = REALLOC(pf->pf_buf, pf->pf_size);
+    }
+
+    pf->pf_buf[rc] = '\0';
+    pf->pf_len = rc;
+
+    return true;
+}
+
+/*
+ * Close files nobody sampled in a while, for example those of processes that
+ * were restarted under a different PID
+ */
+static void procfs_sample_sweep(int64_t now)
+{
+    struct procfs_sample_file *pf;
+    struct procfs_sample_file *tmp;
+
+    ds_tree_foreach_safe(&procfs_sample_files, pf, tmp)
+    {
+        if (now - pf->pf_stamp < PROCFS_IDLE_MS) continue;
+
+        LOG(DEBUG, "procfs: %s: Closing idle file.", pf->pf_path);
+        procfs_sample_file_free(pf);
+    }
+}
+
+static struct procfs_sample_file *procfs_sample_file_get(const char *path)
+{
+    struct procfs_sample_file *pf;
+    int64_t now;
+
+    now = clock_mono_ms();
+
+    pf = ds_tree_find(&procfs_sample_files, path);
+    if (pf == NULL)
+    {
+        procfs_sample_sweep(now);
+
+        pf = CALLOC(1, sizeof(*pf));
+        pf->pf_path = STRDUP(path);
+        pf->pf_fd = -1;
+        pf->pf_size = PROCFS_BUF_INIT;
+        pf->pf_buf = MALLOC(pf->pf_size);
+        ds_tree_insert(&procfs_sample_files, pf, pf->pf_path);
+
+        if (!procfs_sample_file_open(pf)) goto error;
+    }
+    else if (pf->pf_valid &&
+             pf->pf_epoch == procfs_sample_epoch &&
+             now - pf->pf_stamp < CONFIG_PROCFS_SAMPLE_EPOCH_MS)
+    {
+        return pf;
+    }
+
+    /*
+     * A failed read usually means the file went away underneath, for example
+     * the process behind /proc/<pid>/ exited. Reopen it once to pick up a new
+     * instance, if any.
+     */
+    if (!procfs_sample_file_pread(pf))
+    {
+        if (!procfs_sample_file_open(pf) || !procfs_sample_file_pread(pf)) goto error;
+    }
+
+    pf->pf_stamp = now;
+    pf->pf_epoch = procfs_sample_epoch;
+    pf->pf_valid = true;
+
+    return pf;
+
+error:
+    procfs_sample_file_free(pf);
+    return NULL;
+}
+
+const char *procfs_sample_read(const char *path, size_t *len)
+{
+    struct procfs_sample_file *pf;
+
+    pf = procfs_sample_file_get(path);
+    if (pf == NULL) return NULL;
+
+    if (len != NULL) *len = pf->pf_len;
+    return pf->pf_buf;
+}
+
+void procfs_sample_epoch_next(void)
+{
+    procfs_sample_epoch++;
+}
+
+void procfs_sample_close(const char *path)
+{
+    struct procfs_sample_file *pf;
+
+    pf = ds_tree_find(&procfs_sample_files, path);
+    if (pf == NULL) return;
+
+    procfs_sample_file_free(pf);
+}
+
+void procfs_sample_fini(void)
+{
+    struct procfs_sample_file *pf;
+
+    while ((pf = ds_tree_head(&procfs_sample_files)) != NULL)
+    {
+        procfs_sample_file_free(pf);
+    }
+}
+
+/*
+ * ===========================================================================
+ *  Scanners
+ * ===========================================================================
+ */
+static const char *procfs_skip_blanks(const char *p)
+{
+    while (*p == ' ' || *p == '\t') p++;
+    return p;
+}
+
+const char *procfs_line_next(const char *p)
+{
+    p = strchr(p, '\n');
+    if (p == NULL || p[1] == '\0') return NULL;
+
+    return p + 1;
+}
+
+const char *procfs_line_find(const char *buf, const char *prefix)
+{
+    size_t plen = strlen(prefix);
+    const char *p;
+
+    for (p = buf; p != NULL; p = procfs_line_next(p))
+    {
+        if (strncmp(p, prefix, plen) == 0) return p + plen;
+    }
+
+    return NULL;
+}
+
+bool procfs_scan_u64(const char **p, uint64_t *val)
+{
+    const char *s;
+    uint64_t v = 0;
+
+    s = procfs_skip_blanks(*p);
+    if (!isdigit((unsigned char)*s)) return false;
+
+    for (; isdigit((unsigned char)*s); s++)
+    {
+        v = v * 10 + (*s - '0');
+    }
+
+    *val = v;
+    *p = s;
+
+    return true;
+}
+
+bool procfs_scan_double(const char **p, double *val)
+{
+    const char *s;
+    char *end;
+
+    s = procfs_skip_blanks(*p);
+    *val = strtod(s, &end);
+    if (end == s) return false;
+
+    *p = end;
+
+    return true;
+}
+
+bool procfs_scan_skip(const char **p)
+{
+    const char *s;
+
+    s = procfs_skip_blanks(*p);
+    if (*s == '\0' || *s == '\n') return false;
+
+    while (*s != '\0' && !isspace((unsigned char)*s)) s++;
+    *p = s;
+
+    return true;
+}
+
+/*
+ * ===========================================================================
+ *  Typed getters
+ * ===========================================================================
+ */
+bool procfs_loadavg_get(struct procfs_loadavg *la)
+{
+    const char *p;
+
+    p = procfs_sample_read("/proc/loadavg", NULL);
+    if (p == NULL) return false;
+
+    return procfs_scan_double(&p, &la->la_one) &&
+           procfs_scan_double(&p, &la->la_five) &&
+           procfs_scan_double(&p, &la->la_fifteen);
+}
+
+bool procfs_uptime_get(double *uptime)
+{
+    const char *p;
+
+    p = procfs_sample_read("/proc/uptime", NULL);
+    if (p == NULL) return false;
+
+    return procfs_scan_double(&p, uptime);
+}
+
+bool procfs_meminfo_get(struct procfs_meminfo *mi)
+{
+    static const struct
+    {
+        const char *key;
+        size_t      off;
+    }
+    fields[] =
+    {
+        { "MemTotal:",      offsetof(struct procfs_meminfo, mi_mem_total)       },
+        { "MemFree:",       offsetof(struct procfs_meminfo, mi_mem_free)        },
+        { "MemAvailable:",  offsetof(struct procfs_meminfo, mi_mem_available)   },
+        { "Buffers:",       offsetof(struct procfs_meminfo, mi_buffers)         },
+        { "Cached:",        offsetof(struct procfs_meminfo, mi_cached)          },
+        { "SwapTotal:",     offsetof(struct procfs_meminfo, mi_swap_total)      },
+        { "SwapFree:",      offsetof(struct procfs_meminfo, mi_swap_free)       },
+    };
+    const char *line;
+    const char *p;
+    size_t found;
+    size_t ii;
+
+    line = procfs_sample_read("/proc/meminfo", NULL);
+    if (line == NULL) return false;
+
+    memset(mi, 0, sizeof(*mi));
+
+    for (found = 0; line != NULL && found < ARRAY_SIZE(fields); line = procfs_line_next(line))
+    {
+        for (ii = 0; ii < ARRAY_SIZE(fields); ii++)
+        {
+            size_t klen = strlen(fields[ii].key);
+
+            if (strncmp(line, fields[ii].key, klen) != 0) continue;
+
+            p = line + klen;
+            if (!procfs_scan_u64(&p, (uint64_t *)((char *)mi + fields[ii].off))) return false;
+            found++;
+            break;
+        }
+    }
+
+    /* MemAvailable is missing on older kernels, MemTotal is always there */
+    return mi->mi_mem_total != 0;
+}
+
+/*
+ * Find the line of @p cpu in /proc/stat and return the text after the name
+ */
+static const char *procfs_cpu_line(const char *stat, int cpu)
+{
+    const char *line;
+    const char *p;
+    uint64_t num;
+
+    for (line = stat; line != NULL; line = procfs_line_next(line))
+    {
+        if (strncmp(line, "cpu", 3) != 0) continue;
+
+        p = line + 3;
+        if (cpu < 0)
+        {
+            if (*p == ' ') return p;
+            continue;
+        }
+
+        if (procfs_scan_u64(&p, &num) && num == (uint64_t)cpu) return p;
+    }
+
+    return NULL;
+}
+
+bool procfs_cpu_get(int cpu, struct procfs_cpu *stat)
+{
+    uint64_t *fields = &stat->cpu_user;
+    const char *stat_buf;
+    const char *p;
+    size_t ii;
+
+    stat_buf = procfs_sample_read("/proc/stat", NULL);
+    if (stat_buf == NULL) return false;
+
+    p = procfs_cpu_line(stat_buf, cpu);
+    if (p == NULL) return false;
+
+    memset(stat, 0, sizeof(*stat));
+
+    /* Older kernels report fewer columns, the first four are always there */
+    for (ii = 0; ii < sizeof(*stat) / sizeof(*fields); ii++)
+    {
+        if (!procfs_scan_u64(&p, &fields[ii])) break;
+    }
+
+    return ii >= 4;
+}
+
+int procfs_cpu_count(void)
+{
+    const char *line;
+    const char *p;
+    uint64_t num;
+    int count = 0;
+
+    line = procfs_sample_read("/proc/stat", NULL);
+    if (line == NULL) return -1;
+
+    for (; line != NULL; line = procfs_line_next(line))
+    {
+        if (strncmp(line, "cpu", 3) != 0) continue;
+
+        p = line + 3;
+        if (*p == ' ') continue;
+
+        if (procfs_scan_u64(&p, &num) && (int)num >= count) count = num + 1;
+    }
+
+    return count;
+}
+
+bool procfs_pid_status_get(pid_t pid, struct procfs_pid_status *st)
+{
+    char path[64];
+    const char *buf;
+    const char *p;
+
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+
+    buf = procfs_sample_read(path, NULL);
+    if (buf == NULL) return false;
+
+    memset(st, 0, sizeof(*st));
+
+    /* Kernel threads have no Vm* lines */
+    p = procfs_line_find(buf, "VmSize:");
+    if (p != NULL) procfs_scan_u64(&p, &st->ps_vm_size);
+
+    p = procfs_line_find(buf, "VmRSS:");
+    if (p != NULL) procfs_scan_u64(&p, &st->ps_vm_rss);
+
+    return true;
+}
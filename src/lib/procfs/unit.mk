@@ -32,6 +32,7 @@ UNIT_NAME := procfs
 UNIT_TYPE := LIB
 
 UNIT_SRC += src/procfs.c
+UNIT_SRC += src/procfs_sample.c
 
 UNIT_EXPORT_CFLAGS := -I$(UNIT_PATH)/inc
 UNIT_CFLAGS := $(UNIT_EXPORT_CFLAGS)
@@ -40,6 +41,7 @@ UNIT_DEPS += src/lib/common
 UNIT_DEPS += src/lib/ds
 UNIT_DEPS += src/lib/const
 UNIT_DEPS += src/lib/log
+UNIT_DEPS += src/lib/kconfig
 
 UNIT_DEPS_CFLAGS += src/lib/log
 
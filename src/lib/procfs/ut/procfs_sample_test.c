@@ -0,0 +1,196 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "procfs_sample.h"
+#include "unity.h"
+#include "unit_test_utils.h"
+
+static char g_path[64];
+
+static void test_file_write(const char *text)
+{
+    FILE *f;
+
+    f = fopen(g_path, "w");
+    TEST_ASSERT_NOT_NULL(f);
+    fputs(text, f);
+    fclose(f);
+}
+
+static void test_procfs_sample_setUp(void)
+{
+    snprintf(g_path, sizeof(g_path), "/tmp/test_procfs_sample.%d", (int)getpid());
+}
+
+static void test_procfs_sample_tearDown(void)
+{
+    procfs_sample_fini();
+    unlink(g_path);
+}
+
+/*
+ * Reads within an epoch are served from the cache, a new epoch re-reads the
+ * file through the descriptor that was kept open.
+ */
+void test_procfs_sample_epoch(void)
+{
+    const char *buf;
+    size_t len;
+
+    test_file_write("first\n");
+
+    buf = procfs_sample_read(g_path, &len);
+    TEST_ASSERT_NOT_NULL(buf);
+    TEST_ASSERT_EQUAL_STRING("first\n", buf);
+    TEST_ASSERT_EQUAL_INT(6, len);
+
+    test_file_write("second\n");
+    TEST_ASSERT_EQUAL_STRING("first\n", procfs_sample_read(g_path, NULL));
+
+    procfs_sample_epoch_next();
+    TEST_ASSERT_EQUAL_STRING("second\n", procfs_sample_read(g_path, NULL));
+}
+
+/*
+ * Files larger than the initial buffer are read whole.
+ */
+void test_procfs_sample_large(void)
+{
+    static char text[20000];
+    const char *buf;
+    size_t len;
+
+    memset(text, 'x', sizeof(text) - 1);
+    test_file_write(text);
+
+    buf = procfs_sample_read(g_path, &len);
+    TEST_ASSERT_NOT_NULL(buf);
+    TEST_ASSERT_EQUAL_INT(sizeof(text) - 1, len);
+    TEST_ASSERT_EQUAL_STRING(text, buf);
+}
+
+void test_procfs_sample_scan(void)
+{
+    const char *text = "cpu  10 20 30 40\ncpu0 1 2\nintr 5\nload 0.25 word 7";
+    const char *p;
+    uint64_t u64;
+    double dbl;
+
+    p = procfs_line_find(text, "cpu0");
+    TEST_ASSERT_NOT_NULL(p);
+    TEST_ASSERT_TRUE(procfs_scan_u64(&p, &u64));
+    TEST_ASSERT_EQUAL_UINT64(1, u64);
+    TEST_ASSERT_TRUE(procfs_scan_u64(&p, &u64));
+    TEST_ASSERT_EQUAL_UINT64(2, u64);
+    TEST_ASSERT_FALSE(procfs_scan_u64(&p, &u64));
+
+    p = procfs_line_find(text, "load");
+    TEST_ASSERT_NOT_NULL(p);
+    TEST_ASSERT_TRUE(procfs_scan_double(&p, &dbl));
+    TEST_ASSERT_TRUE(dbl == 0.25);
+    TEST_ASSERT_FALSE(procfs_scan_u64(&p, &u64));
+    TEST_ASSERT_TRUE(procfs_scan_skip(&p));
+    TEST_ASSERT_TRUE(procfs_scan_u64(&p, &u64));
+    TEST_ASSERT_EQUAL_UINT64(7, u64);
+    TEST_ASSERT_FALSE(procfs_scan_skip(&p));
+
+    TEST_ASSERT_NULL(procfs_line_find(text, "ctxt"));
+    TEST_ASSERT_NULL(procfs_line_next(p));
+}
+
+void test_procfs_sample_system(void)
+{
+    struct procfs_loadavg la;
+    struct procfs_meminfo mi;
+    struct procfs_cpu cpu;
+    struct procfs_pid_status ps;
+    double uptime;
+
+    TEST_ASSERT_TRUE(procfs_loadavg_get(&la));
+    TEST_ASSERT_TRUE(la.la_one >= 0.0);
+
+    TEST_ASSERT_TRUE(procfs_uptime_get(&uptime));
+    TEST_ASSERT_TRUE(uptime > 0.0);
+
+    TEST_ASSERT_TRUE(procfs_meminfo_get(&mi));
+    TEST_ASSERT_TRUE(mi.mi_mem_total > 0);
+    TEST_ASSERT_TRUE(mi.mi_mem_free <= mi.mi_mem_total);
+
+    TEST_ASSERT_TRUE(procfs_cpu_count() > 0);
+    TEST_ASSERT_TRUE(procfs_cpu_get(-1, &cpu));
+    TEST_ASSERT_TRUE(cpu.cpu_user + cpu.cpu_system + cpu.cpu_idle > 0);
+    TEST_ASSERT_FALSE(procfs_cpu_get(100000, &cpu));
+
+    TEST_ASSERT_TRUE(procfs_pid_status_get(getpid(), &ps));
+    TEST_ASSERT_TRUE(ps.ps_vm_rss > 0);
+    TEST_ASSERT_TRUE(ps.ps_vm_size >= ps.ps_vm_rss);
+}
+
+/*
+ * The file of a process that exited is dropped on the next epoch.
+ */
+void test_procfs_sample_pid_exit(void)
+{
+    struct procfs_pid_status ps;
+    pid_t pid;
+
+    pid = fork();
+    TEST_ASSERT_TRUE(pid >= 0);
+    if (pid == 0)
+    {
+        pause();
+        _exit(0);
+    }
+
+    TEST_ASSERT_TRUE(procfs_pid_status_get(pid, &ps));
+
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+
+    TEST_ASSERT_TRUE(procfs_pid_status_get(pid, &ps));
+    procfs_sample_epoch_next();
+    TEST_ASSERT_FALSE(procfs_pid_status_get(pid, &ps));
+}
+
+void run_test_procfs_sample(void)
+{
+    ut_setUp_tearDown("test_procfs_sample", test_procfs_sample_setUp, test_procfs_sample_tearDown);
+
+    RUN_TEST(test_procfs_sample_epoch);
+    RUN_TEST(test_procfs_sample_large);
+    RUN_TEST(test_procfs_sample_scan);
+    RUN_TEST(test_procfs_sample_system);
+    RUN_TEST(test_procfs_sample_pid_exit);
+
+    ut_setUp_tearDown("test_procfs_sample", NULL, NULL);
+}
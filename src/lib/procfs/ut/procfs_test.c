@@ -44,6 +44,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 char *test_name = "test_procfs_test";
 int opt_verbose = 0;
 
+extern void run_test_procfs_sample(void);
+
 bool parse_opts(int argc, char *argv[])
 {
     int o;
@@ -235,6 +237,7 @@ int main(int argc, char *argv[])
         log_open("PROCFS_TEST", LOG_OPEN_STDOUT);
 
     run_test_procfs();
+    run_test_procfs_sample();
 
     return ut_fini();
 }
@@ -34,6 +34,7 @@ UNIT_TYPE := TEST_BIN
 
 # List of source files
 UNIT_SRC := procfs_test.c
+UNIT_SRC += procfs_sample_test.c
 
 # Other units that this unit may depend on
 UNIT_DEPS += src/lib/procfs
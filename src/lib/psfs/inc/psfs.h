@@ -28,6 +28,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define PSFS_H_INCLUDED
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
 
 #include "ds_tree.h"
 
@@ -41,6 +43,8 @@ struct psfs
     struct psfs_record *psfs_next;          /* Next element to return with psfs_next() */
     ssize_t             psfs_used;          /* Number of bytes used by "good" records */
     ssize_t             psfs_wasted;        /* Number of bytes used by deleted records */
+    void               *psfs_map;           /* Read-only mapping of the store file or NULL */
+    size_t              psfs_map_sz;        /* Size of the mapping */
 };
 
 typedef struct psfs psfs_t;
@@ -51,6 +55,7 @@ struct psfs_record
     uint8_t        *pr_data;            /* Data */
     size_t          pr_datasz;          /* Data size in bytes */
     bool            pr_dirty;           /* True if record is dirty */
+    bool            pr_mapped;          /* True if pr_key/pr_data point into psfs_map */
     ds_tree_node_t  pr_tnode;           /* Tree node */
     ssize_t         pr_used;            /* On-disk bytes used by disk record */
     off_t           pr_off;             /* Record offset */
@@ -67,4 +72,18 @@ ssize_t psfs_get(psfs_t *ps, const char *key, void *value, size_t value_sz);
 void psfs_rewind(psfs_t *ps);
 const char *psfs_next(psfs_t *ps);
 
+/**
+ * Parse the record at offset @p off of the mapped store @p buf
+ *
+ * (Exposed for testing)
+ */
+ssize_t psfs_record_parse(const uint8_t *buf, size_t bufsz, size_t *off, struct psfs_record *pr);
+
+/**
+ * Update the CRC32 value @p crc with @p bufsz bytes of @p buf
+ *
+ * (Exposed for testing)
+ */
+uint32_t psfs_crc32(uint32_t crc, const void *buf, ssize_t bufsz);
+
 #endif /* PSFS_H_INCLUDED */
@@ -24,6 +24,7 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/statvfs.h>
 #include <arpa/inet.h>
@@ -37,6 +38,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <errno.h>
 #include <dirent.h>
 
+#if defined(__ARM_FEATURE_CRC32) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#include <arm_acle.h>
+#define PSFS_CRC32_ARM
+#endif
+
 #include "log.h"
 #include "os.h"
 #include "osp_ps.h"
@@ -81,6 +87,9 @@ static bool psfs_sync_prune(psfs_t *ps);
 static bool psfs_file_lock(int fd, bool exclusive);
 static bool psfs_file_unlock(int fd);
 static void psfs_drop_record(psfs_t *ps, struct psfs_record *pr, ds_tree_iter_t *iter);
+static void psfs_load_record(psfs_t *ps, struct psfs_record *pr);
+static bool psfs_load_map(psfs_t *ps);
+static void psfs_unmap(psfs_t *ps);
 static bool wipe_dir(const char *path, bool remove_entire_dir, bool recurse);
 static bool psfs_wipe(bool recurse);
 ssize_t psfs_record_write(int fd, struct psfs_record *pr);
@@ -88,8 +97,6 @@ ssize_t psfs_record_read(int fd, struct psfs_record *pr);
 void psfs_record_init(struct psfs_record *pr, const char *key, const void *data, size_t datasz);
 void psfs_record_fini(struct psfs_record *pr);
 
-static uint32_t psfs_crc32(uint32_t crc, void *buf, ssize_t bufsz);
-
 /*
  * ===========================================================================
  *  Public API implementation
@@ -268,6 +275,9 @@ bool psfs_close(psfs_t *ps)
         psfs_drop_record(ps, pr, &iter);
     }
 
+    /* Records may reference the mapping, release it only after they are gone */
+    psfs_unmap(ps);
+
     if (!psfs_dir_close(ps->psfs_flags & OSP_PS_PRESERVE))
     {
         retval = false;
@@ -400,6 +410,12 @@ bool psfs_sync(psfs_t *ps, bool force_prune)
  * Load all current data from physical media to memory. This function must
  * be called before psfs_get() can be used to read stored data.
  *
+ * The store file is memory mapped whenever possible; in that case records
+ * are only indexed and their keys and values are referenced directly from
+ * the mapping, so the data is paged in on first access instead of being
+ * copied to the heap. If the file cannot be mapped, the records are read
+ * using read().
+ *
  * @param[in]   ps      Store object as previously acquired by psfs_open()
  *
  * @return
@@ -411,6 +427,12 @@ bool psfs_load(psfs_t *ps)
 
     struct psfs_record *pr = NULL;
 
+    if (psfs_load_map(ps))
+    {
+        psfs_rewind(ps);
+        return true;
+    }
+
     /*
      * Cache all records in the database to RAM
      */
@@ -425,26 +447,7 @@ bool psfs_load(psfs_t *ps)
             continue;
         }
 
-        struct psfs_record *opr;
-
-        opr = ds_tree_find(&ps->psfs_root, pr->pr_key);
-        if (opr != NULL)
-        {
-            /* Replace the old record -- remove it from the store cache */
-            psfs_drop_record(ps, opr, NULL);
-        }
-
-        /* Do not cache deleted keys */
-        if (pr->pr_datasz == 0)
-        {
-            psfs_record_fini(pr);
-            FREE(pr);
-            continue;
-        }
-
-        ds_tree_insert(&ps->psfs_root, pr, pr->pr_key);
-        /* Account read data */
-        ps->psfs_used += pr->pr_used;
+        psfs_load_record(ps, pr);
     }
     while (rc != 0);
 
@@ -476,20 +479,6 @@ bool psfs_erase(psfs_t *ps)
         return false;
     }
 
-    /* Truncate file to 0 bytes  */
-    if (ftruncate(ps->psfs_fd, 0) != 0)
-    {
-        LOG(ERR, "psfs: %s: Error truncating store (erase).", ps->psfs_name);
-        return false;
-    }
-
-    /* Move file pointer to the beginning of the file */
-    if (lseek(ps->psfs_fd, 0, SEEK_SET) != 0)
-    {
-        LOG(ERR, "psfs: %s: Error seeking to the beginning of file (erase).", ps->psfs_name);
-        return false;
-    }
-
     /* Drop all in-memory records */
     ds_tree_foreach_iter(&ps->psfs_root, pr, &iter)
     {
@@ -497,6 +486,17 @@ bool psfs_erase(psfs_t *ps)
         psfs_drop_record(ps, pr, &iter);
     }
 
+    /*
+     * Replace the store with an empty file instead of truncating it. Other
+     * handles in this process may still have the old file mapped and
+     * accessing a mapping past the end of a truncated file raises SIGBUS.
+     */
+    if (!psfs_sync_prune(ps))
+    {
+        LOG(ERR, "psfs: %s: Error replacing store (erase).", ps->psfs_name);
+        return false;
+    }
+
     return true;
 }
 
@@ -878,6 +878,111 @@ void psfs_drop_record(psfs_t *ps, struct psfs_record *pr, ds_tree_iter_t *iter)
     FREE(pr);
 }
 
+/**
+ * Add a record that was just read from physical media to the store cache,
+ * replacing any previous record with the same key.
+ *
+ * Records with no data (deleted keys) are not cached and are freed.
+ */
+void psfs_load_record(psfs_t *ps, struct psfs_record *pr)
+{
+    struct psfs_record *opr;
+
+    opr = ds_tree_find(&ps->psfs_root, pr->pr_key);
+    if (opr != NULL)
+    {
+        /* Replace the old record -- remove it from the store cache */
+        psfs_drop_record(ps, opr, NULL);
+    }
+
+    /* Do not cache deleted keys */
+    if (pr->pr_datasz == 0)
+    {
+        psfs_record_fini(pr);
+        FREE(pr);
+        return;
+    }
+
+    ds_tree_insert(&ps->psfs_root, pr, pr->pr_key);
+    /* Account read data */
+    ps->psfs_used += pr->pr_used;
+}
+
+/**
+ * Map the store file to memory and index all records in the mapping.
+ *
+ * The mapping is kept until psfs_close(). This is safe with respect to
+ * psfs_sync() since the store file is never modified in place: append mode
+ * only writes past the mapped area and prune mode replaces the file with a
+ * new one, while the mapping keeps referencing the old one.
+ *
+ * @return
+ * This function returns false if the file could not be mapped, in which case
+ * the caller should fall back to psfs_record_read().
+ */
+bool psfs_load_map(psfs_t *ps)
+{
+    struct psfs_record *pr;
+    struct stat st;
+    void *map;
+    size_t off;
+    ssize_t rc;
+
+    if (ps->psfs_map != NULL) return false;
+
+    if (fstat(ps->psfs_fd, &st) != 0 || st.st_size <= 0)
+    {
+        return false;
+    }
+
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, ps->psfs_fd, 0);
+    if (map == MAP_FAILED)
+    {
+        LOG(DEBUG, "psfs: %s: Unable to map store, using read(). Error: %s",
+                ps->psfs_name,
+                strerror(errno));
+        return false;
+    }
+
+    ps->psfs_map = map;
+    ps->psfs_map_sz = (size_t)st.st_size;
+
+    off = 0;
+    do
+    {
+        pr = CALLOC(1, sizeof(*pr));
+
+        rc = psfs_record_parse(ps->psfs_map, ps->psfs_map_sz, &off, pr);
+        if (rc <= 0)
+        {
+            FREE(pr);
+            continue;
+        }
+
+        psfs_load_record(ps, pr);
+    }
+    while (rc != 0);
+
+    return true;
+}
+
+/**
+ * Release the store file mapping, if any. All records referencing the mapping
+ * must be dropped before calling this function.
+ */
+void psfs_unmap(psfs_t *ps)
+{
+    if (ps->psfs_map == NULL) return;
+
+    if (munmap(ps->psfs_map, ps->psfs_map_sz) != 0)
+    {
+        LOG(WARN, "psfs: %s: Error unmapping store. Error: %s", ps->psfs_name, strerror(errno));
+    }
+
+    ps->psfs_map = NULL;
+    ps->psfs_map_sz = 0;
+}
+
 /**
  * Initialize a record using @p key and @p data.
  *
@@ -921,6 +1026,14 @@ void psfs_record_init(
  */
 void psfs_record_fini(struct psfs_record *pr)
 {
+    /* Mapped records reference the store mapping, there's nothing to free */
+    if (pr->pr_mapped)
+    {
+        pr->pr_key = NULL;
+        pr->pr_data = NULL;
+        return;
+    }
+
     /*
      * No need to free pr->pr_data as it is allocated in the same buffer as
      * pr_key -- see psfs_record_init()
@@ -1241,6 +1354,110 @@ seek_on_error:
     return -1;
 }
 
+/**
+ * Parse a single record from a memory buffer at offset @p off. This is the
+ * equivalent of psfs_record_read() for a memory mapped store, except that the
+ * key and data are not copied -- they point directly into @p buf.
+ *
+ * On success @p off is set to the end of the record. If the record is invalid,
+ * @p off is set to the next potential record location.
+ *
+ * @param[in]       buf     Store file contents
+ * @param[in]       bufsz   Size of @p buf
+ * @param[in,out]   off     Offset of the record in @p buf
+ * @param[out]      pr      Pointer to an uninitialized record
+ *
+ * @return
+ * This function returns the total number of bytes parsed, 0 on EOF, or a
+ * negative number if the record is invalid.
+ */
+ssize_t psfs_record_parse(const uint8_t *buf, size_t bufsz, size_t *off, struct psfs_record *pr)
+{
+    uint32_t pr_magic;
+    uint32_t pr_size;
+    ssize_t retval;
+    size_t coff;
+    size_t doff;
+
+    /* Clear all data */
+    pr->pr_key = NULL;
+    pr->pr_data = NULL;
+    pr->pr_datasz = 0;
+
+    /* Align offset to 4 bytes */
+    coff = *off + PSFS_PAD_LEN(*off);
+    if (coff >= bufsz)
+    {
+        *off = bufsz;
+        return 0;
+    }
+
+    if (bufsz - coff < sizeof(pr_magic) + sizeof(pr_size))
+    {
+        LOG(ERR, "psfs: record_parse: Short record at offset %zu.", coff);
+        *off = bufsz;
+        return -1;
+    }
+
+    memcpy(&pr_magic, buf + coff, sizeof(pr_magic));
+    if (pr_magic != ntohl(PSFS_MAGIC))
+    {
+        LOG(DEBUG, "psfs: record_parse: Invalid record at offset %zu, skipping.", coff);
+        goto skip;
+    }
+
+    memcpy(&pr_size, buf + coff + sizeof(pr_magic), sizeof(pr_size));
+    pr_size = ntohl(pr_size);
+
+    /*
+     * Compare the record size with the space left for the key, data and CRC.
+     * The short record check above guarantees that the subtraction of the
+     * header size does not wrap; avoid adding pr_size to the header size as
+     * that may wrap on 32-bit targets.
+     */
+    if (bufsz - coff - sizeof(pr_magic) - sizeof(pr_size) < sizeof(uint32_t) ||
+            pr_size > bufsz - coff - sizeof(pr_magic) - sizeof(pr_size) - sizeof(uint32_t))
+    {
+        LOG(ERR, "psfs: record_parse: Corrupted record size points past end of file.");
+        goto skip;
+    }
+
+    retval = sizeof(pr_magic) + sizeof(pr_size) + pr_size + sizeof(uint32_t);
+
+    /* The magic, size, key, data and CRC fields are contiguous */
+    if (psfs_crc32(0, buf + coff, retval) != PSFS_CRC32_VERIFY)
+    {
+        LOG(ERR, "psfs: record_parse: Invalid record CRC at offset %zu.", coff);
+        goto skip;
+    }
+
+    pr->pr_key = (char *)buf + coff + sizeof(pr_magic) + sizeof(pr_size);
+
+    /* Get the data offset relative to the key by calculating the key length */
+    doff = strnlen(pr->pr_key, pr_size);
+    if (doff >= pr_size)
+    {
+        LOG(ERR, "psfs: record_parse: Key is corrupted.");
+        pr->pr_key = NULL;
+        goto skip;
+    }
+    doff++;
+
+    pr->pr_data = (uint8_t *)pr->pr_key + doff;
+    pr->pr_datasz = pr_size - doff;
+    pr->pr_mapped = true;
+    /* Include the padding size */
+    pr->pr_used = retval + PSFS_PAD_LEN(retval);
+
+    *off = coff + retval;
+
+    return retval;
+
+skip:
+    *off = coff + sizeof(pr_magic);
+    return -1;
+}
+
 /**
  * Transfer all dirty records to physical media (flush). This function works
  * in "append" mode, which just appends dirty records to the journal.
@@ -1422,8 +1639,50 @@ const char *psfs_next(psfs_t *ps)
     return retval;
 }
 
+#if !defined(PSFS_CRC32_ARM)
+/* Slice-by-8 lookup tables, initialized by psfs_crc32_init() */
+static uint32_t psfs_crc32_table[8][256];
+static bool psfs_crc32_table_init = false;
+
+static void psfs_crc32_init(void)
+{
+    uint32_t crc;
+    int ii;
+    int jj;
+
+    for (ii = 0; ii < 256; ii++)
+    {
+        crc = ii;
+        for (jj = 0; jj < 8; jj++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ PSFS_CRC32_POLY : crc >> 1;
+        }
+        psfs_crc32_table[0][ii] = crc;
+    }
+
+    for (ii = 0; ii < 256; ii++)
+    {
+        for (jj = 1; jj < 8; jj++)
+        {
+            crc = psfs_crc32_table[jj - 1][ii];
+            psfs_crc32_table[jj][ii] = (crc >> 8) ^ psfs_crc32_table[0][crc & 0xFF];
+        }
+    }
+
+    psfs_crc32_table_init = true;
+}
+
+static inline uint32_t psfs_crc32_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+#endif
+
 /**
- * Table-less CRC32 function implementation.
+ * CRC32 function implementation.
+ *
+ * Uses the ARMv8 CRC32 instructions when available, otherwise the slice-by-8
+ * table driven algorithm, which processes 8 bytes per iteration.
  *
  * @param[in]   crc     Previous CRC value
  * @param[in]   buf     Data
@@ -1436,20 +1695,50 @@ const char *psfs_next(psfs_t *ps)
  * By appending the CRC in big-endian order to a buffer and re-calculating the
  * CRC, this function should always yield PSFS_CRC32_VERIFY
  */
-uint32_t psfs_crc32(uint32_t crc, void *buf, ssize_t bufsz)
+uint32_t psfs_crc32(uint32_t crc, const void *buf, ssize_t bufsz)
 {
-    uint8_t *pbuf;
-    int ii;
+    const uint8_t *pbuf = buf;
 
     crc = ~crc;
-    for (pbuf = buf; bufsz-- > 0; pbuf++)
+
+#if defined(PSFS_CRC32_ARM)
+    uint64_t d;
+
+    for (; bufsz >= 8; bufsz -= 8, pbuf += 8)
     {
-        crc ^= *pbuf;
-        for (ii = 0; ii < 8; ii++)
-        {
-            crc = (crc & 1) ? (crc >> 1) ^ PSFS_CRC32_POLY : crc >> 1;
-        }
+        memcpy(&d, pbuf, sizeof(d));
+        crc = __crc32d(crc, d);
+    }
+
+    for (; bufsz > 0; bufsz--, pbuf++)
+    {
+        crc = __crc32b(crc, *pbuf);
+    }
+#else
+    uint32_t one;
+    uint32_t two;
+
+    if (!psfs_crc32_table_init) psfs_crc32_init();
+
+    for (; bufsz >= 8; bufsz -= 8, pbuf += 8)
+    {
+        one = psfs_crc32_le32(pbuf) ^ crc;
+        two = psfs_crc32_le32(pbuf + 4);
+        crc = psfs_crc32_table[7][one & 0xFF] ^
+              psfs_crc32_table[6][(one >> 8) & 0xFF] ^
+              psfs_crc32_table[5][(one >> 16) & 0xFF] ^
+              psfs_crc32_table[4][one >> 24] ^
+              psfs_crc32_table[3][two & 0xFF] ^
+              psfs_crc32_table[2][(two >> 8) & 0xFF] ^
+              psfs_crc32_table[1][(two >> 16) & 0xFF] ^
+              psfs_crc32_table[0][two >> 24];
+    }
+
+    for (; bufsz > 0; bufsz--, pbuf++)
+    {
+        crc = (crc >> 8) ^ psfs_crc32_table[0][(crc ^ *pbuf) & 0xFF];
     }
+#endif
 
     return ~crc;
 }
@@ -0,0 +1,374 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+
+#include "unity.h"
+#include "unit_test_utils.h"
+
+#include "const.h"
+#include "log.h"
+#include "osp_ps.h"
+#include "psfs.h"
+
+#define TEST_STORE          "test_psfs"
+#define TEST_BENCH_STORE    "test_psfs_bench"
+#define TEST_BENCH_RECORDS  8192
+#define TEST_BENCH_ITERS    10
+
+/* Generate a deterministic value for record @p idx and generation @p gen */
+static size_t test_psfs_value(int idx, int gen, uint8_t *buf, size_t bufsz)
+{
+    size_t sz;
+    size_t ii;
+
+    sz = 64 + ((idx * 37) % 900);
+    if (sz > bufsz) sz = bufsz;
+
+    for (ii = 0; ii < sz; ii++)
+    {
+        buf[ii] = (uint8_t)(idx * 7 + ii + gen);
+    }
+
+    return sz;
+}
+
+/* Write @p nrec records, overwrite them and delete every 10th record */
+static void test_psfs_populate(const char *store, int nrec)
+{
+    uint8_t val[1024];
+    char key[32];
+    psfs_t ps;
+    size_t sz;
+    int gen;
+    int ii;
+
+    for (gen = 0; gen < 2; gen++)
+    {
+        TEST_ASSERT_TRUE(psfs_open(&ps, store, OSP_PS_RDWR));
+        TEST_ASSERT_TRUE(psfs_load(&ps));
+
+        for (ii = 0; ii < nrec; ii++)
+        {
+            snprintf(key, sizeof(key), "key-%d", ii);
+            sz = test_psfs_value(ii, gen, val, sizeof(val));
+            TEST_ASSERT_EQUAL_INT(sz, psfs_set(&ps, key, val, sz));
+        }
+
+        if (gen == 1)
+        {
+            for (ii = 0; ii < nrec; ii += 10)
+            {
+                snprintf(key, sizeof(key), "key-%d", ii);
+                psfs_set(&ps, key, NULL, 0);
+            }
+        }
+
+        /* Force append mode on the first pass so the store has shadowed records */
+        TEST_ASSERT_TRUE(psfs_sync(&ps, gen == 1));
+        TEST_ASSERT_TRUE(psfs_close(&ps));
+    }
+}
+
+/* Verify the content of a store written by test_psfs_populate() */
+static void test_psfs_verify(psfs_t *ps, int nrec)
+{
+    uint8_t val[1024];
+    uint8_t got[1024];
+    char key[32];
+    const char *k;
+    ssize_t rc;
+    size_t sz;
+    int cnt;
+    int ii;
+
+    for (ii = 0; ii < nrec; ii++)
+    {
+        snprintf(key, sizeof(key), "key-%d", ii);
+        rc = psfs_get(ps, key, got, sizeof(got));
+        if ((ii % 10) == 0)
+        {
+            TEST_ASSERT_EQUAL_INT(0, rc);
+            continue;
+        }
+
+        sz = test_psfs_value(ii, 1, val, sizeof(val));
+        TEST_ASSERT_EQUAL_INT(sz, rc);
+        TEST_ASSERT_EQUAL_MEMORY(val, got, sz);
+    }
+
+    cnt = 0;
+    psfs_rewind(ps);
+    while ((k = psfs_next(ps)) != NULL) cnt++;
+    TEST_ASSERT_EQUAL_INT(nrec - (nrec + 9) / 10, cnt);
+}
+
+void test_psfs_erase(void)
+{
+    TEST_ASSERT_TRUE(osp_ps_erase_store_name(TEST_STORE, 0));
+    TEST_ASSERT_TRUE(osp_ps_erase_store_name(TEST_BENCH_STORE, 0));
+}
+
+void test_psfs_load(void)
+{
+    psfs_t ps;
+
+    test_psfs_populate(TEST_STORE, 100);
+
+    TEST_ASSERT_TRUE(psfs_open(&ps, TEST_STORE, OSP_PS_READ));
+    TEST_ASSERT_TRUE(psfs_load(&ps));
+    test_psfs_verify(&ps, 100);
+    TEST_ASSERT_TRUE(psfs_close(&ps));
+}
+
+/*
+ * Erasing a store must not invalidate the data of another handle that has the
+ * same store loaded (mapped)
+ */
+void test_psfs_erase_loaded(void)
+{
+    uint8_t got[1024];
+    psfs_t rps;
+    psfs_t wps;
+
+    test_psfs_populate(TEST_STORE, 100);
+
+    TEST_ASSERT_TRUE(psfs_open(&rps, TEST_STORE, OSP_PS_READ));
+    TEST_ASSERT_TRUE(psfs_load(&rps));
+
+    TEST_ASSERT_TRUE(psfs_open(&wps, TEST_STORE, OSP_PS_RDWR));
+    TEST_ASSERT_TRUE(psfs_load(&wps));
+    TEST_ASSERT_TRUE(psfs_erase(&wps));
+    TEST_ASSERT_EQUAL_INT(0, psfs_get(&wps, "key-1", got, sizeof(got)));
+    TEST_ASSERT_TRUE(psfs_close(&wps));
+
+    test_psfs_verify(&rps, 100);
+    TEST_ASSERT_TRUE(psfs_close(&rps));
+
+    TEST_ASSERT_TRUE(psfs_open(&rps, TEST_STORE, OSP_PS_READ));
+    TEST_ASSERT_TRUE(psfs_load(&rps));
+    TEST_ASSERT_EQUAL_INT(0, psfs_get(&rps, "key-1", got, sizeof(got)));
+    TEST_ASSERT_TRUE(psfs_close(&rps));
+}
+
+/* Bit-wise reference CRC32 (IEEE 802.3, reflected) */
+static uint32_t test_psfs_crc32_ref(const uint8_t *buf, size_t bufsz)
+{
+    uint32_t crc = ~0U;
+    size_t ii;
+    int jj;
+
+    for (ii = 0; ii < bufsz; ii++)
+    {
+        crc ^= buf[ii];
+        for (jj = 0; jj < 8; jj++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+        }
+    }
+
+    return ~crc;
+}
+
+/*
+ * Check the CRC32 implementation against known vectors and the bit-wise
+ * algorithm, for all alignments and lengths around the 8-byte stride
+ */
+void test_psfs_crc32(void)
+{
+    uint8_t buf[128];
+    uint32_t crc;
+    size_t len;
+    size_t ii;
+
+    TEST_ASSERT_EQUAL_HEX32(0x00000000, psfs_crc32(0, "", 0));
+    TEST_ASSERT_EQUAL_HEX32(0xE8B7BE43, psfs_crc32(0, "a", 1));
+    TEST_ASSERT_EQUAL_HEX32(0xCBF43926, psfs_crc32(0, "123456789", 9));
+    TEST_ASSERT_EQUAL_HEX32(
+            0x414FA339,
+            psfs_crc32(0, "The quick brown fox jumps over the lazy dog", 43));
+
+    /* Incremental updates must match a single pass */
+    crc = psfs_crc32(0, "1234", 4);
+    TEST_ASSERT_EQUAL_HEX32(0xCBF43926, psfs_crc32(crc, "56789", 5));
+
+    for (ii = 0; ii < sizeof(buf); ii++)
+    {
+        buf[ii] = (uint8_t)(ii * 31 + 7);
+    }
+
+    for (ii = 0; ii < 8; ii++)
+    {
+        for (len = 0; len <= sizeof(buf) - ii; len++)
+        {
+            TEST_ASSERT_EQUAL_HEX32(test_psfs_crc32_ref(buf + ii, len), psfs_crc32(0, buf + ii, len));
+        }
+    }
+
+    /* Appending the CRC (LSB first) yields the verification residue */
+    crc = psfs_crc32(0, buf, 64);
+    buf[64] = (crc >> 0) & 0xFF;
+    buf[65] = (crc >> 8) & 0xFF;
+    buf[66] = (crc >> 16) & 0xFF;
+    buf[67] = (crc >> 24) & 0xFF;
+    TEST_ASSERT_EQUAL_HEX32(0x2144DF1C, psfs_crc32(0, buf, 68));
+}
+
+/* Build a record in @p buf as written by psfs_record_write(), return its size */
+static size_t test_psfs_record_build(uint8_t *buf, uint32_t size, const char *key, const char *data)
+{
+    uint32_t crc;
+    uint32_t w;
+    size_t off;
+
+    off = 0;
+    w = htonl(0x50534653);
+    memcpy(buf + off, &w, sizeof(w));
+    off += sizeof(w);
+
+    w = htonl(size);
+    memcpy(buf + off, &w, sizeof(w));
+    off += sizeof(w);
+
+    memcpy(buf + off, key, strlen(key) + 1);
+    off += strlen(key) + 1;
+    memcpy(buf + off, data, strlen(data));
+    off += strlen(data);
+
+    crc = psfs_crc32(0, buf, off);
+    buf[off++] = (crc >> 0) & 0xFF;
+    buf[off++] = (crc >> 8) & 0xFF;
+    buf[off++] = (crc >> 16) & 0xFF;
+    buf[off++] = (crc >> 24) & 0xFF;
+
+    return off;
+}
+
+/*
+ * A record with a corrupted size field must be rejected without reading past
+ * the end of the buffer, including sizes that wrap the end-of-record offset
+ */
+void test_psfs_record_corrupted_size(void)
+{
+    static const uint32_t bad_sizes[] =
+    {
+        0xFFFFFFFF,
+        0xFFFFFFF4,     /* header + size + CRC wraps to 0 on 32-bit targets */
+        0xFFFFFFF8,
+        0x80000000,
+        11,             /* One byte past the end of the buffer */
+    };
+
+    struct psfs_record pr;
+    uint8_t buf[64];
+    size_t bufsz;
+    size_t off;
+    size_t ii;
+
+    /* Sanity check, a valid record: "key\0" + "value" */
+    bufsz = test_psfs_record_build(buf, 9, "key", "value");
+    off = 0;
+    TEST_ASSERT_EQUAL_INT(bufsz, psfs_record_parse(buf, bufsz, &off, &pr));
+    TEST_ASSERT_EQUAL_STRING("key", pr.pr_key);
+    TEST_ASSERT_EQUAL_INT(5, pr.pr_datasz);
+    TEST_ASSERT_EQUAL_MEMORY("value", pr.pr_data, 5);
+    TEST_ASSERT_EQUAL_INT(bufsz, off);
+
+    /* EOF */
+    TEST_ASSERT_EQUAL_INT(0, psfs_record_parse(buf, bufsz, &off, &pr));
+
+    for (ii = 0; ii < ARRAY_SIZE(bad_sizes); ii++)
+    {
+        bufsz = test_psfs_record_build(buf, bad_sizes[ii], "key", "value");
+        off = 0;
+        TEST_ASSERT_EQUAL_INT(-1, psfs_record_parse(buf, bufsz, &off, &pr));
+        TEST_ASSERT_NULL(pr.pr_key);
+        /* Skip the magic and resume scanning */
+        TEST_ASSERT_EQUAL_INT(4, off);
+    }
+
+    /* Only the header is present */
+    test_psfs_record_build(buf, 0, "", "");
+    off = 0;
+    TEST_ASSERT_EQUAL_INT(-1, psfs_record_parse(buf, 8, &off, &pr));
+    TEST_ASSERT_EQUAL_INT(4, off);
+}
+
+/*
+ * Measure open+load time of a multi-MB store
+ */
+void test_psfs_load_bench(void)
+{
+    struct timespec start;
+    struct timespec end;
+    int64_t elapsed_us;
+    psfs_t ps;
+    int ii;
+
+    test_psfs_populate(TEST_BENCH_STORE, TEST_BENCH_RECORDS);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (ii = 0; ii < TEST_BENCH_ITERS; ii++)
+    {
+        TEST_ASSERT_TRUE(psfs_open(&ps, TEST_BENCH_STORE, OSP_PS_READ));
+        TEST_ASSERT_TRUE(psfs_load(&ps));
+        TEST_ASSERT_TRUE(psfs_close(&ps));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    elapsed_us = (int64_t)(end.tv_sec - start.tv_sec) * 1000000 +
+                 (end.tv_nsec - start.tv_nsec) / 1000;
+
+    LOGI("psfs: open+load of %d records: %" PRId64 " us per iteration",
+            TEST_BENCH_RECORDS,
+            elapsed_us / TEST_BENCH_ITERS);
+
+    TEST_ASSERT_TRUE(psfs_open(&ps, TEST_BENCH_STORE, OSP_PS_READ));
+    TEST_ASSERT_TRUE(psfs_load(&ps));
+    test_psfs_verify(&ps, TEST_BENCH_RECORDS);
+    TEST_ASSERT_TRUE(psfs_close(&ps));
+}
+
+int main(void)
+{
+    log_open("test_psfs", LOG_OPEN_STDOUT);
+    log_severity_set(LOG_SEVERITY_INFO);
+
+    ut_init("test_psfs", NULL, NULL);
+
+    RUN_TEST(test_psfs_crc32);
+    RUN_TEST(test_psfs_record_corrupted_size);
+    RUN_TEST(test_psfs_erase);
+    RUN_TEST(test_psfs_load);
+    RUN_TEST(test_psfs_erase_loaded);
+    RUN_TEST(test_psfs_load_bench);
+    RUN_TEST(test_psfs_erase);
+
+    return ut_fini();
+}
@@ -0,0 +1,92 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef RTNL_STATS_H_INCLUDED
+#define RTNL_STATS_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <linux/if_link.h>
+
+/*
+ * ===========================================================================
+ *  64-bit interface counters over rtnetlink
+ *
+ *  Counters are fetched with RTM_GETSTATS over a persistent NETLINK_ROUTE
+ *  socket, asking only for IFLA_STATS_LINK_64 and optionally the offload
+ *  counters. Unlike getifaddrs() or a RTM_GETLINK dump, this does not
+ *  serialize every attribute and address of every link, and the counters do
+ *  not wrap at 32 bits.
+ *
+ *  RTM_GETSTATS needs Linux 4.7 or later; on older kernels the requests fail
+ *  with errno set to EOPNOTSUPP and callers are expected to fall back to
+ *  their previous source.
+ * ===========================================================================
+ */
+
+/** Also request IFLA_OFFLOAD_XSTATS_CPU_HIT */
+#define RTNL_STATS_OFFLOAD      (1 << 0)
+
+struct rtnl_stats_link
+{
+    int                         rl_ifindex;
+    struct rtnl_link_stats64    rl_stats;           /**< All traffic of the link */
+    bool                        rl_has_cpu_hit;     /**< True if rl_cpu_hit is valid */
+    struct rtnl_link_stats64    rl_cpu_hit;         /**< Traffic that was not offloaded */
+};
+
+typedef void rtnl_stats_fn_t(void *ctx, const struct rtnl_stats_link *link);
+
+/**
+ * Fetch the counters of the links in @p ifindex, or of all links if @p n is 0
+ *
+ * When @p n is not 0, one request per link is sent and all of them are
+ * batched into a single datagram. Links that do not exist are skipped.
+ * @p fn is called once per link.
+ *
+ * @param[in]   ifindex     interface indexes, may be NULL if @p n is 0
+ * @param[in]   n           number of interface indexes
+ * @param[in]   flags       a combination of RTNL_STATS_ flags
+ * @param[in]   fn          called with the counters of each link
+ * @param[in]   ctx         passed to @p fn
+ *
+ * @return false on error, with errno set
+ */
+bool rtnl_stats_get(const int *ifindex, size_t n, int flags, rtnl_stats_fn_t *fn, void *ctx);
+
+/**
+ * Fetch the counters of a single link
+ *
+ * @return false if the link does not exist or on error
+ */
+bool rtnl_stats_link_get(int ifindex, int flags, struct rtnl_stats_link *link);
+
+/**
+ * Close the netlink socket, it is reopened by the next request
+ */
+void rtnl_stats_fini(void);
+
+#endif /* RTNL_STATS_H_INCLUDED */
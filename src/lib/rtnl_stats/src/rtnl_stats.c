@@ -0,0 +1,308 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include "log.h"
+#include "util.h"
+
+#include "rtnl_stats.h"
+
+#define RTNL_STATS_BATCH        64              /* Maximum number of requests per datagram */
+#define RTNL_STATS_RCVBUF       32768           /* Large enough for a dump part */
+#define RTNL_STATS_TIMEOUT_MS   1000            /* Receive timeout, guards against lost replies */
+
+struct rtnl_stats_req
+{
+    struct nlmsghdr     nh;
+    struct if_stats_msg ifsm;
+};
+
+static int rtnl_stats_sock = -1;
+static uint32_t rtnl_stats_seq;
+static uint8_t rtnl_stats_buf[RTNL_STATS_RCVBUF] __attribute__((aligned(NLMSG_ALIGNTO)));
+
+/*
+ * ===========================================================================
+ *  Socket handling
+ * ===========================================================================
+ */
+static bool rtnl_stats_sock_open(void)
+{
+    struct sockaddr_nl addr;
+    struct timeval tv;
+
+    if (rtnl_stats_sock >= 0) return true;
+
+    rtnl_stats_sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (rtnl_stats_sock < 0)
+    {
+        LOG(ERR, "rtnl_stats: Error creating netlink socket: %s", strerror(errno));
+        return false;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    if (bind(rtnl_stats_sock, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        LOG(ERR, "rtnl_stats: Error binding netlink socket: %s", strerror(errno));
+        goto error;
+    }
+
+    tv.tv_sec = RTNL_STATS_TIMEOUT_MS / 1000;
+    tv.tv_usec = (RTNL_STATS_TIMEOUT_MS % 1000) * 1000;
+    if (setsockopt(rtnl_stats_sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) != 0)
+    {
+        LOG(ERR, "rtnl_stats: Error setting the receive timeout: %s", strerror(errno));
+        goto error;
+    }
+
+    return true;
+
+error:
+    close(rtnl_stats_sock);
+    rtnl_stats_sock = -1;
+    return false;
+}
+
+void rtnl_stats_fini(void)
+{
+    if (rtnl_stats_sock < 0) return;
+
+    close(rtnl_stats_sock);
+    rtnl_stats_sock = -1;
+}
+
+static void rtnl_stats_req_init(struct rtnl_stats_req *req, int ifindex, int flags, uint32_t seq)
+{
+    memset(req, 0, sizeof(*req));
+
+    req->nh.nlmsg_len = NLMSG_LENGTH(sizeof(req->ifsm));
+    req->nh.nlmsg_type = RTM_GETSTATS;
+    req->nh.nlmsg_flags = NLM_F_REQUEST;
+    req->nh.nlmsg_seq = seq;
+
+    req->ifsm.family = AF_UNSPEC;
+    req->ifsm.ifindex = ifindex;
+    req->ifsm.filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64);
+    if (flags & RTNL_STATS_OFFLOAD)
+    {
+        req->ifsm.filter_mask |= IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_OFFLOAD_XSTATS);
+    }
+}
+
+/*
+ * ===========================================================================
+ *  Reply parsing
+ * ===========================================================================
+ */
+static void rtnl_stats_parse_offload(struct rtnl_stats_link *link, struct rtattr *nest)
+{
+    struct rtattr *rta;
+    int len;
+
+    len = RTA_PAYLOAD(nest);
+    for (rta = RTA_DATA(nest); RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+    {
+        if (rta->rta_type != IFLA_OFFLOAD_XSTATS_CPU_HIT) continue;
+
+        memcpy(&link->rl_cpu_hit, RTA_DATA(rta), MIN(RTA_PAYLOAD(rta), sizeof(link->rl_cpu_hit)));
+        link->rl_has_cpu_hit = true;
+    }
+}
+
+static void rtnl_stats_parse(struct nlmsghdr *nh, rtnl_stats_fn_t *fn, void *ctx)
+{
+    struct rtnl_stats_link link;
+    struct if_stats_msg *ifsm;
+    struct rtattr *rta;
+    bool has_stats = false;
+    int len;
+
+    if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifsm))) return;
+
+    ifsm = NLMSG_DATA(nh);
+
+    memset(&link, 0, sizeof(link));
+    link.rl_ifindex = ifsm->ifindex;
+
+    len = nh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifsm));
+    rta = (struct rtattr *)((uint8_t *)ifsm + NLMSG_ALIGN(sizeof(*ifsm)));
+    for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len))
+    {
+        switch (rta->rta_type)
+        {
+            case IFLA_STATS_LINK_64:
+                /* The payload is not necessarily 64-bit aligned */
+                memcpy(&link.rl_stats, RTA_DATA(rta), MIN(RTA_PAYLOAD(rta), sizeof(link.rl_stats)));
+                has_stats = true;
+                break;
+
+            case IFLA_STATS_LINK_OFFLOAD_XSTATS:
+                rtnl_stats_parse_offload(&link, rta);
+                break;
+        }
+    }
+
+    if (has_stats) fn(ctx, &link);
+}
+
+/*
+ * Receive replies to the requests with sequence numbers in [seq, seq + n).
+ * For a dump, @p n is 1 and the request is complete on NLMSG_DONE.
+ */
+static bool rtnl_stats_recv(uint32_t seq, size_t n, bool dump, rtnl_stats_fn_t *fn, void *ctx)
+{
+    struct nlmsghdr *nh;
+    struct nlmsgerr *err;
+    size_t pending = n;
+    ssize_t len;
+
+    while (pending > 0)
+    {
+        len = recv(rtnl_stats_sock, rtnl_stats_buf, sizeof(rtnl_stats_buf), 0);
+        if (len < 0)
+        {
+            if (errno == EINTR) continue;
+            LOG(ERR, "rtnl_stats: Error receiving netlink replies: %s", strerror(errno));
+            return false;
+        }
+
+        for (nh = (struct nlmsghdr *)rtnl_stats_buf; NLMSG_OK(nh, (size_t)len); nh = NLMSG_NEXT(nh, len))
+        {
+            /* Stale replies of a request that was abandoned */
+            if (nh->nlmsg_seq - seq >= n) continue;
+
+            switch (nh->nlmsg_type)
+            {
+                case RTM_NEWSTATS:
+                    rtnl_stats_parse(nh, fn, ctx);
+                    if (!dump) pending--;
+                    break;
+
+                case NLMSG_DONE:
+                    pending--;
+                    break;
+
+                case NLMSG_ERROR:
+                    err = NLMSG_DATA(nh);
+                    pending--;
+                    if (err->error == -EOPNOTSUPP)
+                    {
+                        /* Kernels older than 4.7 have no RTM_GETSTATS */
+                        errno = EOPNOTSUPP;
+                        return false;
+                    }
+                    /* -ENODEV: the link went away, skip it */
+                    break;
+            }
+        }
+    }
+
+    return true;
+}
+
+/*
+ * ===========================================================================
+ *  Public API
+ * ===========================================================================
+ */
+static bool rtnl_stats_dump(int flags, rtnl_stats_fn_t *fn, void *ctx)
+{
+    struct rtnl_stats_req req;
+    uint32_t seq;
+
+    seq = ++rtnl_stats_seq;
+    rtnl_stats_req_init(&req, 0, flags, seq);
+    req.nh.nlmsg_flags |= NLM_F_DUMP;
+
+    if (send(rtnl_stats_sock, &req, req.nh.nlmsg_len, 0) < 0)
+    {
+        LOG(ERR, "rtnl_stats: Error sending the stats dump request: %s", strerror(errno));
+        return false;
+    }
+
+    return rtnl_stats_recv(seq, 1, true, fn, ctx);
+}
+
+bool rtnl_stats_get(const int *ifindex, size_t n, int flags, rtnl_stats_fn_t *fn, void *ctx)
+{
+    struct rtnl_stats_req req[RTNL_STATS_BATCH];
+    uint32_t seq;
+    size_t batch;
+    size_t ii;
+
+    if (!rtnl_stats_sock_open()) return false;
+
+    if (n == 0) return rtnl_stats_dump(flags, fn, ctx);
+
+    for (; n > 0; ifindex += batch, n -= batch)
+    {
+        batch = MIN(n, (size_t)RTNL_STATS_BATCH);
+
+        seq = rtnl_stats_seq + 1;
+        rtnl_stats_seq += batch;
+
+        for (ii = 0; ii < batch; ii++)
+        {
+            rtnl_stats_req_init(&req[ii], ifindex[ii], flags, seq + ii);
+        }
+
+        /* The requests are a fixed size multiple of NLMSG_ALIGNTO, so they pack back to back */
+        if (send(rtnl_stats_sock, req, batch * sizeof(req[0]), 0) < 0)
+        {
+            LOG(ERR, "rtnl_stats: Error sending stats requests: %s", strerror(errno));
+            return false;
+        }
+
+        if (!rtnl_stats_recv(seq, batch, false, fn, ctx)) return false;
+    }
+
+    return true;
+}
+
+static void rtnl_stats_link_get_fn(void *ctx, const struct rtnl_stats_link *link)
+{
+    struct rtnl_stats_link *out = ctx;
+
+    *out = *link;
+}
+
+bool rtnl_stats_link_get(int ifindex, int flags, struct rtnl_stats_link *link)
+{
+    memset(link, 0, sizeof(*link));
+
+    if (!rtnl_stats_get(&ifindex, 1, flags, rtnl_stats_link_get_fn, link)) return false;
+
+    return link->rl_ifindex == ifindex && ifindex != 0;
+}
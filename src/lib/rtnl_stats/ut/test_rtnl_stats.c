@@ -0,0 +1,177 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "const.h"
+#include "rtnl_stats.h"
+#include "unity.h"
+#include "unit_test_utils.h"
+
+char *test_name = "test_rtnl_stats";
+
+static int g_lo;
+static int g_calls;
+static int g_lo_calls;
+
+static void test_rtnl_stats_setUp(void)
+{
+    g_lo = if_nametoindex("lo");
+    TEST_ASSERT_TRUE(g_lo > 0);
+
+    g_calls = 0;
+    g_lo_calls = 0;
+}
+
+static void test_rtnl_stats_tearDown(void)
+{
+    rtnl_stats_fini();
+}
+
+static void test_rtnl_stats_count_fn(void *ctx, const struct rtnl_stats_link *link)
+{
+    (void)ctx;
+
+    g_calls++;
+    if (link->rl_ifindex == g_lo) g_lo_calls++;
+}
+
+/* Send @p count datagrams over the loopback interface */
+static void test_send_lo(int count)
+{
+    struct sockaddr_in addr;
+    int fd;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    TEST_ASSERT_TRUE(fd >= 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(9);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    while (count-- > 0)
+    {
+        sendto(fd, "x", 1, 0, (struct sockaddr *)&addr, sizeof(addr));
+    }
+
+    close(fd);
+}
+
+/*
+ * Counters are 64-bit and follow the traffic.
+ */
+void test_rtnl_stats_link(void)
+{
+    struct rtnl_stats_link before;
+    struct rtnl_stats_link after;
+
+    TEST_ASSERT_TRUE(rtnl_stats_link_get(g_lo, 0, &before));
+    TEST_ASSERT_EQUAL_INT(g_lo, before.rl_ifindex);
+
+    test_send_lo(10);
+
+    TEST_ASSERT_TRUE(rtnl_stats_link_get(g_lo, 0, &after));
+    TEST_ASSERT_TRUE(after.rl_stats.tx_packets >= before.rl_stats.tx_packets + 10);
+    TEST_ASSERT_TRUE(after.rl_stats.rx_bytes > before.rl_stats.rx_bytes);
+    TEST_ASSERT_FALSE(after.rl_has_cpu_hit);
+}
+
+void test_rtnl_stats_missing(void)
+{
+    struct rtnl_stats_link link;
+    int ifindex[] = { g_lo, 0x7ffffff0, g_lo };
+
+    TEST_ASSERT_FALSE(rtnl_stats_link_get(0x7ffffff0, 0, &link));
+
+    /* Missing links are skipped, the rest of the batch is answered */
+    TEST_ASSERT_TRUE(rtnl_stats_get(ifindex, 3, 0, test_rtnl_stats_count_fn, NULL));
+    TEST_ASSERT_EQUAL_INT(2, g_calls);
+    TEST_ASSERT_EQUAL_INT(2, g_lo_calls);
+}
+
+/*
+ * Requests are split in batches, each sent as a single datagram.
+ */
+void test_rtnl_stats_batch(void)
+{
+    int ifindex[150];
+    size_t ii;
+
+    for (ii = 0; ii < ARRAY_SIZE(ifindex); ii++)
+    {
+        ifindex[ii] = g_lo;
+    }
+
+    TEST_ASSERT_TRUE(rtnl_stats_get(ifindex, ARRAY_SIZE(ifindex), 0, test_rtnl_stats_count_fn, NULL));
+    TEST_ASSERT_EQUAL_INT(ARRAY_LEN(ifindex), g_lo_calls);
+}
+
+void test_rtnl_stats_dump(void)
+{
+    TEST_ASSERT_TRUE(rtnl_stats_get(NULL, 0, RTNL_STATS_OFFLOAD, test_rtnl_stats_count_fn, NULL));
+    TEST_ASSERT_EQUAL_INT(1, g_lo_calls);
+    TEST_ASSERT_TRUE(g_calls >= 1);
+
+    /* The socket is reopened after rtnl_stats_fini() */
+    rtnl_stats_fini();
+    g_calls = g_lo_calls = 0;
+    TEST_ASSERT_TRUE(rtnl_stats_get(NULL, 0, 0, test_rtnl_stats_count_fn, NULL));
+    TEST_ASSERT_EQUAL_INT(1, g_lo_calls);
+}
+
+void run_test_rtnl_stats(void)
+{
+    RUN_TEST(test_rtnl_stats_link);
+    RUN_TEST(test_rtnl_stats_missing);
+    RUN_TEST(test_rtnl_stats_batch);
+    RUN_TEST(test_rtnl_stats_dump);
+}
+
+/*
+ * ===========================================================================
+ *  MAIN
+ * ===========================================================================
+ */
+
+int main(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    ut_init(test_name, NULL, NULL);
+
+    ut_setUp_tearDown(test_name, test_rtnl_stats_setUp, test_rtnl_stats_tearDown);
+
+    run_test_rtnl_stats();
+
+    return ut_fini();
+}
@@ -175,6 +175,65 @@ int rts_stream_scan(rts_stream_t stream, const void *buf, uint16_t len, int dir,
  */
 int rts_stream_matching(rts_stream_t stream);
 
+/* rts_stream_hibernate()
+ *
+ * Save the state of an idle stream and release it.
+ *
+ * The state needed to resume matching (automaton state, offsets, captured
+ * variables) is serialized into a compact blob and the stream, with the
+ * handle memory it holds, is released as by rts_stream_destroy(). The caller
+ * MUST not access the rts_stream_t afterwards. Hibernating streams that wait
+ * for more packets keeps the handle memory for the active ones.
+ *
+ * @param stream   The stream to hibernate. It must still be matching.
+ * @param blob     An out parameter returning the blob, allocated through
+ *                 rts_ext_alloc(). The caller releases it with rts_ext_free().
+ * @param bloblen  An out parameter returning the blob length.
+ *
+ * Returns 0 on success or a negative error code on failure, in which case the
+ * stream is left untouched.
+ *
+ * An error code can have the following value:
+ *
+ * -ENOMEM
+ *     The external memory allocation call was unsuccessful.
+ *
+ * -EBUSY
+ *     The stream is in the middle of a scan.
+ *
+ * -EINVAL
+ *     The stream is invalid or no longer matching.
+ */
+int rts_stream_hibernate(rts_stream_t stream, void **blob, size_t *bloblen);
+
+/* rts_stream_restore()
+ *
+ * Re-create a stream from a blob returned by rts_stream_hibernate(), so that
+ * scanning continues where it stopped. The blob is not modified and remains
+ * owned by the caller. The handle need not be the one the stream was created
+ * with. If the signatures were updated in between, the restored stream stops
+ * matching at its next rts_stream_scan(), as a live stream would.
+ *
+ * @param stream   A pointer to a valid rts_stream_t.
+ * @param handle   The handle this stream will be attached to.
+ * @param blob     The blob.
+ * @param bloblen  The blob length.
+ * @param user     The opaque pointer relayed in rts_subscribe callbacks.
+ *
+ * Returns 0 on success or a negative error code on failure.
+ *
+ * An error code can have the following value:
+ *
+ * -ENOMEM
+ *     There was no space to allocate the stream.
+ *
+ * -EINVAL
+ *     The stream or handle pointer is invalid, no signatures are loaded or
+ *     the blob is corrupt.
+ */
+int rts_stream_restore(rts_stream_t *stream, rts_handle_t handle,
+    const void *blob, size_t bloblen, void *user);
+
 /* rts_lookup()
  *
  * Lookup a string by its index.
@@ -238,6 +297,62 @@ int rts_lookup(int index, const char **value, rts_stream_t stream);
  */
 int rts_load(const void *mp, size_t ml);
 
+/* rts_image_create()
+ *
+ * Convert a signature file into a load image.
+ *
+ * A load image holds the same sections as the signature file, converted to
+ * host byte order and aligned to RTS_IMAGE_ALIGN, so that rts_load_image()
+ * can use them in place. The image is meant to be written to a file once
+ * and mapped read-only (MAP_SHARED) by every process loading the same
+ * signatures, which then share the page cache pages instead of each holding
+ * a private copy of the automaton.
+ *
+ * @param mp       The signature file contents, as passed to rts_load().
+ * @param ml       The signature file length.
+ * @param image    An out parameter returning the image, allocated through
+ *                 rts_ext_alloc(). The caller releases it with rts_ext_free().
+ * @param imagelen An out parameter returning the image length.
+ *
+ * Returns 0 on success or a negative error code on failure.
+ *
+ * An error code can have the following value:
+ *
+ * -ENOMEM
+ *     The external memory allocation calls were unsuccessful.
+ *
+ * -EINVAL
+ *     The signatures are either corrupt or incompatible with this version of
+ *     the library.
+ */
+#define RTS_IMAGE_ALIGN 64
+
+int rts_image_create(const void *mp, size_t ml, void **image, size_t *imagelen);
+
+/* rts_load_image()
+ *
+ * Load new signatures from an image created by rts_image_create().
+ *
+ * Behaves like rts_load(), except that the signature sections are used in
+ * place: the image must stay mapped and unmodified until the release
+ * callback is called, which happens once the signatures are replaced or
+ * unloaded and all handles referencing them released their hold. On
+ * failure the release callback is not called and the caller keeps the
+ * ownership of the image.
+ *
+ * @param image    The image, aligned to RTS_IMAGE_ALIGN. A page aligned mmap()
+ *                 of an image file is suitable.
+ * @param imagelen The image length.
+ * @param release  Called with the image, its length and @param arg when the
+ *                 image is no longer used. Can be NULL.
+ * @param arg      Opaque pointer passed to @param release.
+ *
+ * Returns 0 on success or a negative error code on failure, with the same
+ * error codes as rts_load().
+ */
+int rts_load_image(const void *image, size_t imagelen,
+    void (*release)(const void *image, size_t imagelen, void *arg), void *arg);
+
 /* rts_subscribe()
  *
  * Subscribe to a key exported by the loaded signatures. The key names are
@@ -272,6 +272,8 @@ struct rts_thread {
     unsigned scan_started;
     unsigned scan_stopped;
     unsigned scan_bytes;
+    unsigned hibernated;
+    unsigned restored;
 };
 
 struct rts_bundle {
@@ -287,6 +289,12 @@ struct rts_bundle {
     struct rts_itab *ftab;
     struct rts_stab *stab;
     const char *keylist;
+
+    /* sections used in place from an rts_load_image() image */
+    const void *image;
+    size_t imagelen;
+    void (*release)(const void *image, size_t imagelen, void *arg);
+    void *release_arg;
 };
 
 static inline void
@@ -70,6 +70,8 @@ struct rts_rusage {
     unsigned scan_started;    /* number of scans started */
     unsigned scan_stopped;    /* number of scans stopped */
     unsigned scan_bytes;      /* number of bytes scanned */
+    unsigned hibernated;      /* streams hibernated      */
+    unsigned restored;        /* streams restored        */
 };
 
 #endif
@@ -82,6 +82,18 @@ int  rts_vm_exec(struct rts_vm *vm, unsigned ip, struct rts_data *, struct rts_b
 void rts_vm_buffer_push(struct rts_vm *vm, unsigned id, struct rts_buffer *, unsigned off, unsigned len);
 int  rts_vm_pop(struct rts_vm *vm, struct rts_value *res);
 
+/* Serialize the resumable state of @vm into @dst, which may be NULL when
+ * only the size is needed. Returns the number of bytes the state requires;
+ * nothing is written if @len is short of it. The vm must be synced.
+ */
+size_t rts_vm_save(struct rts_vm *vm, void *dst, size_t len);
+
+/* Restore a state saved by rts_vm_save() into a freshly initialized @vm.
+ * Returns 0, -EINVAL if the state is malformed or -ENOMEM. On failure the
+ * vm holds a partial state and must be released with rts_vm_exit().
+ */
+int  rts_vm_load(struct rts_vm *vm, const void *src, size_t len);
+
 /* implemented in rts.c, called from rts_vm.c */
 void rts_value_publish(struct rts_vm *vm, struct rts_value *v, unsigned id);
 
@@ -250,23 +250,183 @@ set_bundle_var_names(const struct rts_bundle *bundle)
     return true;
 }
 
+/*
+ * Validation of the sections of a load image, which are already in host
+ * byte order and are used in place.
+ */
 static int
-bundle_load(struct rts_bundle **bundlep, const unsigned char *buf, size_t len)
+itab_check(const void *data, unsigned size)
+{
+    unsigned i, end;
+    const unsigned *idata;
+    const struct rts_itab *p = data;
+
+    if (size < sizeof(p->size) ||
+            size < sizeof(p->size) + p->size * sizeof(p->data[0]))
+        return -EINVAL;
+
+    if (p->size == 0)
+        return 0;
+
+    idata = p->data[p->size-1].data;
+
+    for (i = 0; i < p->size; i++) {
+        end = p->data[i].offset + p->data[i].length;
+        if (p->data[i].length > 0 && (const char*)(idata + end - 1) >= (const char*)data + size)
+            return -EINVAL;
+    }
+
+    return 0;
+}
+
+static int
+stab_check(const void *data, unsigned size)
+{
+    const struct rts_stab *s = data;
+
+    if (size < sizeof(s->size))
+        return -EINVAL;
+
+    return size != sizeof(s->size) + s->size * RTS_STAB_MAXLEN ? -EINVAL : 0;
+}
+
+static int
+keys_check(const void *data, unsigned size)
+{
+    const char *keys = data;
+
+    /* the keylist is terminated by an empty key */
+    return size == 0 || keys[size-1] != '\0' ? -EINVAL : 0;
+}
+
+static int
+section_check(unsigned section, const void *data, unsigned size)
+{
+    switch (section) {
+        case RTS_SECTION_VARS:
+            return size % sizeof(struct rts_var) ? -EINVAL : 0;
+        case RTS_SECTION_TEXT:
+            return 0;
+        case RTS_SECTION_AUTM:
+            return size % sizeof(struct rts_state_map) ? -EINVAL : 0;
+        case RTS_SECTION_AUTR:
+            return size % sizeof(struct rts_state_ran) ? -EINVAL : 0;
+        case RTS_SECTION_CTAB:
+        case RTS_SECTION_FTAB:
+            return itab_check(data, size);
+        case RTS_SECTION_STAB:
+            return stab_check(data, size);
+        case RTS_SECTION_TRT0:
+            return size % sizeof(struct rts_tran8) ? -EINVAL : 0;
+        case RTS_SECTION_TRT1:
+            return size % sizeof(struct rts_tran4fc) ? -EINVAL : 0;
+        case RTS_SECTION_TRT2:
+            return size % sizeof(struct rts_tran4f) ? -EINVAL : 0;
+        case RTS_SECTION_TRT3:
+            return size % sizeof(struct rts_tran4c) ? -EINVAL : 0;
+        case RTS_SECTION_TRT4:
+            return size % sizeof(struct rts_tran2) ? -EINVAL : 0;
+        case RTS_SECTION_KEYS:
+            return keys_check(data, size);
+        default:
+            return -EINVAL;
+    }
+}
+
+/*
+ * Convert a section read from a signature file to host byte order
+ */
+static int
+section_ntoh(unsigned section, void *data, unsigned size)
+{
+    switch (section) {
+        case RTS_SECTION_VARS:
+            return vars_ntoh(data, size);
+        case RTS_SECTION_TEXT:
+        case RTS_SECTION_KEYS:
+            return 0;
+        case RTS_SECTION_AUTM:
+            return auto_map_ntoh(data, size);
+        case RTS_SECTION_AUTR:
+            return auto_ran_ntoh(data, size);
+        case RTS_SECTION_CTAB:
+        case RTS_SECTION_FTAB:
+            return itab_ntoh(data, size);
+        case RTS_SECTION_STAB:
+            return stab_ntoh(data, size);
+        case RTS_SECTION_TRT0:
+            return tran8_ntoh(data, size);
+        case RTS_SECTION_TRT1:
+            return tran4fc_ntoh(data, size);
+        case RTS_SECTION_TRT2:
+            return tran4f_ntoh(data, size);
+        case RTS_SECTION_TRT3:
+            return tran4c_ntoh(data, size);
+        case RTS_SECTION_TRT4:
+            return tran2_ntoh(data, size);
+        default:
+            return -EINVAL;
+    }
+}
+
+static int
+bundle_set_section(struct rts_bundle *bundle, unsigned section, void *data, unsigned size)
+{
+    switch (section) {
+        case RTS_SECTION_VARS:
+            bundle->vars = data;
+            bundle->numvars = size / sizeof(*bundle->vars);
+            break;
+        case RTS_SECTION_TEXT:
+            bundle->code = data;
+            bundle->codelen = size;
+            break;
+        case RTS_SECTION_AUTM:
+            bundle->dfa.sm = data;
+            break;
+        case RTS_SECTION_AUTR:
+            bundle->dfa.sr = data;
+            bundle->dfa.num_sr = size / sizeof(*bundle->dfa.sr);
+            break;
+        case RTS_SECTION_CTAB:
+            bundle->ctab = data;
+            break;
+        case RTS_SECTION_FTAB:
+            bundle->ftab = data;
+            break;
+        case RTS_SECTION_STAB:
+            bundle->stab = data;
+            break;
+        case RTS_SECTION_TRT0:
+            bundle->trans.t8 = data;
+            break;
+        case RTS_SECTION_TRT1:
+            bundle->trans.t4fc = data;
+            break;
+        case RTS_SECTION_TRT2:
+            bundle->trans.t4f = data;
+            break;
+        case RTS_SECTION_TRT3:
+            bundle->trans.t4c = data;
+            break;
+        case RTS_SECTION_TRT4:
+            bundle->trans.t2 = data;
+            break;
+        case RTS_SECTION_KEYS:
+            bundle->keylist = data;
+            break;
+        default:
+            return -EINVAL;
+    }
+
+    return 0;
+}
+
+static int
+bundle_check_header(struct rts_file *f, const char *expected)
 {
-    static unsigned loads;
-    struct rts_bundle *bundle;
-    int res = -EINVAL;
-    unsigned section, size;
-    void *data;
     char magic[4];
     unsigned char version[4];
-    struct rts_file *f, file = {
-        .buf = buf,
-        .off = 0,
-        .len = len
-    };
-
-    f = &file;
 
     if (rts_read(f, magic, sizeof(magic)) != sizeof(magic))
         return -EINVAL;
@@ -274,7 +434,7 @@ bundle_load(struct rts_bundle **bundlep, const unsigned char *buf, size_t len)
     if (rts_read(f, version, sizeof(version)) != sizeof(version))
         return -EINVAL;
 
-    if (rts_strncmp(magic, "RTS", 4)) {
+    if (rts_strncmp(magic, expected, 4)) {
         rts_printf("error: corrupt file: bad magic\n");
         return -EINVAL;
     }
@@ -285,10 +445,18 @@ bundle_load(struct rts_bundle **bundlep, const unsigned char *buf, size_t len)
         return -EINVAL;
     }
 
+    return 0;
+}
+
+static struct rts_bundle *
+bundle_alloc(void)
+{
+    static unsigned loads;
+    struct rts_bundle *bundle;
+
     bundle = rts_ext_alloc(sizeof(*bundle));
-    if (!bundle) {
-        return -ENOMEM;
-    }
+    if (!bundle)
+        return NULL;
 
     bundle->refcount = 0;
     bundle->generation = __sync_add_and_fetch(&loads, 1);
@@ -307,106 +475,27 @@ bundle_load(struct rts_bundle **bundlep, const unsigned char *buf, size_t len)
     bundle->trans.t4c = NULL;
     bundle->trans.t2 = NULL;
     bundle->keylist = NULL;
+    bundle->image = NULL;
+    bundle->imagelen = 0;
+    bundle->release = NULL;
+    bundle->release_arg = NULL;
 
-    for (;;) {
-        section = read_section(f, &size);
-        if (!section)
-            break;
-
-        if (!(data = rts_ext_alloc(size))) {
-            res = -ENOMEM;
-            goto bundle_cleanup;
-        }
-
-        if (rts_read(f, data, size) != size) {
-            res = -EINVAL;
-            rts_ext_free(data);
-            goto bundle_cleanup;
-        }
-
-        switch (section) {
-            case RTS_SECTION_VARS:
-                bundle->vars = data;
-                bundle->numvars = size / sizeof(*bundle->vars);
-                if ((res = vars_ntoh(data, size)))
-                    goto bundle_cleanup;
-                break;
-            case RTS_SECTION_TEXT:
-                bundle->code = data;
-                bundle->codelen = size;
-                break;
-            case RTS_SECTION_AUTM:
-                bundle->dfa.sm = data;
-                if ((res = auto_map_ntoh(data, size)))
-                    goto bundle_cleanup;
-                break;
-            case RTS_SECTION_AUTR:
-                bundle->dfa.sr = data;
-                bundle->dfa.num_sr = size / sizeof(*bundle->dfa.sr);
-                if ((res = auto_ran_ntoh(data, size)))
-                    goto bundle_cleanup;
-                break;
-            case RTS_SECTION_CTAB:
-                bundle->ctab = data;
-                if ((res = itab_ntoh(data, size)))
-                    goto bundle_cleanup;
-                break;
-            case RTS_SECTION_FTAB:
-                bundle->ftab = data;
-                if ((res = itab_ntoh(data, size)))
-                    goto bundle_cleanup;
-                break;
-            case RTS_SECTION_STAB:
-                bundle->stab = data;
-                if ((res = stab_ntoh(data, size)))
-                    goto bundle_cleanup;
-                break;
-            case RTS_SECTION_TRT0:
-                bundle->trans.t8 = data;
-                if ((res = tran8_ntoh(data, size)))
-                    goto bundle_cleanup;
-                break;
-            case RTS_SECTION_TRT1:
-                bundle->trans.t4fc = data;
-                if ((res = tran4fc_ntoh(data, size)))
-                    goto bundle_cleanup;
-                break;
-            case RTS_SECTION_TRT2:
-                bundle->trans.t4f = data;
-                if ((res = tran4f_ntoh(data, size)))
-                    goto bundle_cleanup;
-                break;
-            case RTS_SECTION_TRT3:
-                bundle->trans.t4c = data;
-                if ((res = tran4c_ntoh(data, size)))
-                    goto bundle_cleanup;
-                break;
-            case RTS_SECTION_TRT4:
-                bundle->trans.t2 = data;
-                if ((res = tran2_ntoh(data, size)))
-                    goto bundle_cleanup;
-                break;
-            case RTS_SECTION_KEYS:
-                bundle->keylist = data;
-                break;
-            default:
-                res = -EINVAL;
-                rts_ext_free(data);
-                goto bundle_cleanup;
-        }
-    }
+    return bundle;
+}
 
-    if (!set_bundle_var_names(bundle))
-    {
-        res = -1;
-        goto bundle_cleanup;
+static void
+bundle_free(struct rts_bundle *bundle)
+{
+    /* Image sections are not owned by the bundle, except the variables */
+    if (bundle->image) {
+        if (bundle->vars)
+            rts_ext_free(bundle->vars);
+        if (bundle->release)
+            bundle->release(bundle->image, bundle->imagelen, bundle->release_arg);
+        rts_ext_free(bundle);
+        return;
     }
 
-    *bundlep = bundle;
-    return 0;
-
-bundle_cleanup:
-    LOGE("%s:%d: error: bundle_load failed", __func__, __LINE__);
     if (bundle->vars)
         rts_ext_free(bundle->vars);
     if (bundle->code)
@@ -434,6 +523,242 @@ bundle_cleanup:
     if (bundle->keylist)
         rts_ext_free((void *)bundle->keylist);
     rts_ext_free(bundle);
+}
+
+static int
+bundle_load(struct rts_bundle **bundlep, const unsigned char *buf, size_t len)
+{
+    struct rts_bundle *bundle;
+    int res = -EINVAL;
+    unsigned section, size;
+    void *data;
+    struct rts_file *f, file = {
+        .buf = buf,
+        .off = 0,
+        .len = len
+    };
+
+    f = &file;
+
+    if ((res = bundle_check_header(f, "RTS")) != 0)
+        return res;
+
+    if (!(bundle = bundle_alloc()))
+        return -ENOMEM;
+
+    for (;;) {
+        section = read_section(f, &size);
+        if (!section)
+            break;
+
+        if (!(data = rts_ext_alloc(size))) {
+            res = -ENOMEM;
+            goto bundle_cleanup;
+        }
+
+        if (rts_read(f, data, size) != size) {
+            res = -EINVAL;
+            rts_ext_free(data);
+            goto bundle_cleanup;
+        }
+
+        if ((res = bundle_set_section(bundle, section, data, size))) {
+            rts_ext_free(data);
+            goto bundle_cleanup;
+        }
+
+        if ((res = section_ntoh(section, data, size)))
+            goto bundle_cleanup;
+    }
+
+    if (!set_bundle_var_names(bundle))
+    {
+        res = -1;
+        goto bundle_cleanup;
+    }
+
+    *bundlep = bundle;
+    return 0;
+
+bundle_cleanup:
+    LOGE("%s:%d: error: bundle_load failed", __func__, __LINE__);
+    bundle_free(bundle);
+    return res;
+}
+
+/*
+ * Load image layout, all in host byte order:
+ *
+ *   header:  "RTSI", version[4], byte order mark, padded to RTS_IMAGE_ALIGN
+ *   section: type, size, padded to RTS_IMAGE_ALIGN
+ *            data, padded to RTS_IMAGE_ALIGN
+ *   ...
+ *   end:     type 0, size 0
+ */
+#define RTS_IMAGE_BOM 0x01020304
+
+struct rts_image_section {
+    unsigned section;
+    unsigned size;
+};
+
+static inline size_t
+image_align(size_t off)
+{
+    return (off + RTS_IMAGE_ALIGN - 1) & ~((size_t)RTS_IMAGE_ALIGN - 1);
+}
+
+EXPORT int
+rts_image_create(const void *sig, size_t siglen, void **imagep, size_t *imagelenp)
+{
+    struct rts_image_section *hdr;
+    unsigned section, size;
+    unsigned char *image;
+    unsigned bom;
+    size_t total, off;
+    int res;
+    struct rts_file *f, file = {
+        .buf = sig,
+        .off = 0,
+        .len = siglen
+    };
+
+    if (!sig || !imagep || !imagelenp)
+        return -EINVAL;
+
+    f = &file;
+
+    /* First pass: validate the layout and compute the image size */
+    if ((res = bundle_check_header(f, "RTS")) != 0)
+        return res;
+
+    total = image_align(8 + sizeof(bom));
+    for (;;) {
+        if (f->len - f->off < 8)
+            return -EINVAL;
+        section = read_section(f, &size);
+        if (!section)
+            break;
+        if (size > f->len - f->off)
+            return -EINVAL;
+        f->off += size;
+        total += image_align(sizeof(*hdr)) + image_align(size);
+    }
+    total += sizeof(*hdr);
+
+    if (!(image = rts_ext_alloc(total)))
+        return -ENOMEM;
+    __builtin_memset(image, 0, total);
+
+    /* Second pass: copy and convert the sections */
+    f->off = 0;
+    rts_read(f, image, 8);
+    __builtin_memcpy(image, "RTSI", 4);
+    bom = RTS_IMAGE_BOM;
+    __builtin_memcpy(image + 8, &bom, sizeof(bom));
+    off = image_align(8 + sizeof(bom));
+
+    for (;;) {
+        section = read_section(f, &size);
+        hdr = (struct rts_image_section *)(image + off);
+        hdr->section = section;
+        hdr->size = size;
+        if (!section)
+            break;
+
+        off += image_align(sizeof(*hdr));
+        rts_read(f, image + off, size);
+        if ((res = section_ntoh(section, image + off, size))) {
+            rts_ext_free(image);
+            return res;
+        }
+        off += image_align(size);
+    }
+
+    *imagep = image;
+    *imagelenp = total;
+    return 0;
+}
+
+static int
+bundle_load_image(struct rts_bundle **bundlep, const unsigned char *image, size_t len)
+{
+    const struct rts_image_section *hdr;
+    struct rts_bundle *bundle;
+    unsigned bom;
+    void *data;
+    size_t off;
+    int res;
+    struct rts_file file = {
+        .buf = image,
+        .off = 0,
+        .len = len
+    };
+
+    if (((uintptr_t)image & (RTS_IMAGE_ALIGN - 1)) != 0)
+        return -EINVAL;
+
+    if ((res = bundle_check_header(&file, "RTSI")) != 0)
+        return res;
+
+    if (rts_read(&file, &bom, sizeof(bom)) != sizeof(bom) || bom != RTS_IMAGE_BOM)
+        return -EINVAL;
+
+    if (!(bundle = bundle_alloc()))
+        return -ENOMEM;
+
+    bundle->image = image;
+    bundle->imagelen = len;
+
+    off = image_align(8 + sizeof(bom));
+    for (;;) {
+        res = -EINVAL;
+        if (off + sizeof(*hdr) > len)
+            goto bundle_cleanup;
+
+        hdr = (const struct rts_image_section *)(image + off);
+        if (!hdr->section)
+            break;
+
+        off += image_align(sizeof(*hdr));
+        if (hdr->size > len - off)
+            goto bundle_cleanup;
+
+        data = (void *)(image + off);
+        if ((res = section_check(hdr->section, data, hdr->size)))
+            goto bundle_cleanup;
+
+        /* Variables get their names and subscriptions set at runtime */
+        if (hdr->section == RTS_SECTION_VARS) {
+            if (bundle->vars) {
+                res = -EINVAL;
+                goto bundle_cleanup;
+            }
+            if (!(data = rts_ext_alloc(hdr->size))) {
+                res = -ENOMEM;
+                goto bundle_cleanup;
+            }
+            __builtin_memcpy(data, image + off, hdr->size);
+        }
+
+        bundle_set_section(bundle, hdr->section, data, hdr->size);
+        off += image_align(hdr->size);
+    }
+
+    if (!set_bundle_var_names(bundle))
+    {
+        res = -EINVAL;
+        goto bundle_cleanup;
+    }
+
+    *bundlep = bundle;
+    return 0;
+
+bundle_cleanup:
+    LOGE("%s:%d: error: bundle_load_image failed", __func__, __LINE__);
+    /* The caller keeps the ownership of the image on failure */
+    bundle->release = NULL;
+    bundle_free(bundle);
     return res;
 }
 
@@ -714,20 +1039,7 @@ static inline void
 rts_bundle_put(struct rts_bundle *bundle)
 {
     if (__sync_sub_and_fetch(&bundle->refcount, 1) == 0) {
-        rts_ext_free(bundle->dfa.sm);
-        rts_ext_free(bundle->dfa.sr);
-        rts_ext_free(bundle->trans.t8);
-        rts_ext_free(bundle->trans.t4fc);
-        rts_ext_free(bundle->trans.t4f);
-        rts_ext_free(bundle->trans.t4c);
-        rts_ext_free(bundle->trans.t2);
-        rts_ext_free(bundle->vars);
-        rts_ext_free(bundle->ctab);
-        rts_ext_free(bundle->ftab);
-        rts_ext_free(bundle->stab);
-        rts_ext_free(bundle->code);
-        rts_ext_free((void *)bundle->keylist);
-        rts_ext_free(bundle);
+        bundle_free(bundle);
     }
 }
 
@@ -848,19 +1160,16 @@ bundle_release(void)
     return 0;
 }
 
-EXPORT int
-rts_load(const void *sig, size_t siglen)
+/*
+ * Make the bundle the active one. Threads switch to it on their next
+ * message poll; the previous bundle is freed once its last reference
+ * is put. On failure the bundle is freed, without releasing its image.
+ */
+static int
+bundle_install(struct rts_bundle *next)
 {
-    int res;
     struct rts_msg_bundle *msg;
     struct rts_mpmc_node *empty;
-    struct rts_bundle *next;
-
-    if (!sig || !siglen)
-        return bundle_release();
-
-    if ((res = bundle_load(&next, sig, siglen)) != 0)
-        return res;
 
     if (next->refcount != 0)
     {
@@ -878,12 +1187,14 @@ rts_load(const void *sig, size_t siglen)
     if (mq.consumer) {
         if (!(msg = rts_ext_alloc(sizeof(*msg)))) {
             spinlock_unlock(&mq.spinlock);
+            next->release = NULL;
             rts_bundle_put(next);
             return -ENOMEM;
         }
         if (!(empty = rts_ext_alloc(sizeof(*empty)))) {
             spinlock_unlock(&mq.spinlock);
             rts_ext_free(msg);
+            next->release = NULL;
             rts_bundle_put(next);
             return -ENOMEM;
         }
@@ -905,6 +1216,40 @@ rts_load(const void *sig, size_t siglen)
     return 0;
 }
 
+EXPORT int
+rts_load(const void *sig, size_t siglen)
+{
+    struct rts_bundle *next;
+    int res;
+
+    if (!sig || !siglen)
+        return bundle_release();
+
+    if ((res = bundle_load(&next, sig, siglen)) != 0)
+        return res;
+
+    return bundle_install(next);
+}
+
+EXPORT int
+rts_load_image(const void *image, size_t imagelen,
+    void (*release)(const void *image, size_t imagelen, void *arg), void *arg)
+{
+    struct rts_bundle *next;
+    int res;
+
+    if (!image || !imagelen)
+        return -EINVAL;
+
+    if ((res = bundle_load_image(&next, image, imagelen)) != 0)
+        return res;
+
+    next->release = release;
+    next->release_arg = arg;
+
+    return bundle_install(next);
+}
+
 static bool
 rts_ftentry_equal(const void *lhs, const struct rts_lruhash_item *rhs)
 {
@@ -924,6 +1269,8 @@ rts_thread_rusage(struct rts_thread *thread, struct rts_rusage *rusage)
     rusage->scan_started += thread->scan_started; thread->scan_started = 0;
     rusage->scan_stopped += thread->scan_stopped; thread->scan_stopped = 0;
     rusage->scan_bytes += thread->scan_bytes; thread->scan_bytes = 0;
+    rusage->hibernated += thread->hibernated; thread->hibernated = 0;
+    rusage->restored += thread->restored; thread->restored = 0;
     return 0;
 }
 
@@ -983,6 +1330,8 @@ rts_thread_create(struct rts_thread **threadp, unsigned group)
 
     thread->timestamp = 0;
     thread->scan_bytes = 0;
+    thread->hibernated = 0;
+    thread->restored = 0;
     thread->scan_started = 0;
     thread->scan_stopped = 0;
 
@@ -1211,6 +1560,98 @@ rts_stream_destroy(rts_stream_t stream)
     return 0;
 }
 
+/* Hibernated stream header, followed by the rts_vm_save() state */
+#define RTS_STREAM_MAGIC 0x48535452 /* "RTSH" */
+
+struct rts_stream_blob {
+    uint32_t magic;
+    struct rts_data data;
+};
+
+EXPORT int
+rts_stream_hibernate(rts_stream_t stream, void **blob, size_t *bloblen)
+{
+    struct rts_stream_blob hdr;
+    struct rts_thread *thread;
+    unsigned char *p;
+    size_t len;
+
+    if (!stream || !blob || !bloblen || !stream->data.state)
+        return -EINVAL;
+
+    /* Still referencing packet data, only possible within a scan */
+    if (stream->vm.sync)
+        return -EBUSY;
+
+    thread = stream->vm.thread;
+    len = sizeof(hdr) + rts_vm_save(&stream->vm, NULL, 0);
+    if (!(p = rts_ext_alloc(len)))
+        return -ENOMEM;
+
+    hdr.magic = RTS_STREAM_MAGIC;
+    hdr.data = stream->data;
+    __builtin_memcpy(p, &hdr, sizeof(hdr));
+    rts_vm_save(&stream->vm, p + sizeof(hdr), len - sizeof(hdr));
+
+    thread->hibernated++;
+
+    rts_vm_exit(&stream->vm);
+    stream->vm.thread = 0;
+    stream->data.state = 0;
+    rts_pool_free(&thread->mp, stream);
+
+    *blob = p;
+    *bloblen = len;
+    return 0;
+}
+
+EXPORT int
+rts_stream_restore(rts_stream_t *state, rts_handle_t handle, const void *blob,
+    size_t bloblen, void *user)
+{
+    struct rts_stream_blob hdr;
+    struct rts_thread *thread;
+    struct rts_stream *stream;
+    int res;
+
+    if (!state || !handle || !blob || bloblen < sizeof(hdr))
+        return -EINVAL;
+
+    __builtin_memcpy(&hdr, blob, sizeof(hdr));
+    if (hdr.magic != RTS_STREAM_MAGIC)
+        return -EINVAL;
+
+    thread = rts_container_of(handle, struct rts_thread, handle);
+
+    rts_msg_dispatch(thread);
+
+    if (!thread->bundle)
+        return -EINVAL;
+
+    stream = rts_pool_alloc(&thread->mp, sizeof(*stream));
+    if (!stream)
+        return -ENOMEM;
+
+    stream->user = user;
+    stream->data = hdr.data;
+    rts_vm_init(&stream->vm, thread);
+
+    /* A state saved against previous signatures is restored as is, the
+     * next rts_stream_scan() notices the generation change and stops */
+    res = rts_vm_load(&stream->vm, (const unsigned char *)blob + sizeof(hdr),
+        bloblen - sizeof(hdr));
+    if (res) {
+        rts_vm_exit(&stream->vm);
+        rts_pool_free(&thread->mp, stream);
+        return res;
+    }
+
+    thread->restored++;
+
+    *state = stream;
+    return 0;
+}
+
 EXPORT int
 rts_stream_scan(rts_stream_t stream, const void *ptr, uint16_t len, int dir, uint64_t timestamp)
 {
@@ -28,6 +28,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rts_ipaddr.h"
 #include "rts_buffer.h"
 
+#ifdef KERNEL
+#include <linux/errno.h>
+#else
+#include <errno.h>
+#endif
+
 static inline int16_t
 read16(const unsigned char *src)
 {
@@ -558,6 +564,193 @@ rts_vm_sync(struct rts_vm *vm)
     return true;
 }
 
+/* Serialized vm state
+ *
+ * The layout is private to the library and in host byte order:
+ *
+ *   u32 generation, u32 resume, u32 resume_fun
+ *   u32 sp,     sp values       (evaluation stack, bottom first)
+ *   u32 nlist,  nlist objects   (heap, list order)
+ *   u32 nshared, nshared objects
+ *
+ * An object is a u32 id followed by a value. A value is a u16 type followed
+ * by an i64 for numbers, or a u32 length and the bytes for buffers. Buffers
+ * are flattened: zero copy references into another object are saved as
+ * private copies of the bytes they reference.
+ */
+struct vm_image {
+    unsigned char *data;
+    size_t cap;
+    size_t len;
+};
+
+static void
+image_put(struct vm_image *img, const void *src, size_t len)
+{
+    if (img->data && img->len + len <= img->cap)
+        __builtin_memcpy(img->data + img->len, src, len);
+    img->len += len;
+}
+
+static bool
+image_get(struct vm_image *img, void *dst, size_t len)
+{
+    if (img->len + len > img->cap)
+        return false;
+    __builtin_memcpy(dst, img->data + img->len, len);
+    img->len += len;
+    return true;
+}
+
+static void
+image_put_value(struct vm_image *img, struct rts_value *v, uint16_t type)
+{
+    uint32_t len;
+
+    image_put(img, &type, sizeof(type));
+    if (type == RTS_VALUE_TYPE_NUMBER) {
+        image_put(img, &v->number.data, sizeof(v->number.data));
+    } else {
+        len = rts_buffer_size(&v->buffer);
+        image_put(img, &len, sizeof(len));
+        if (len)
+            image_put(img, rts_buffer_data(&v->buffer, 0), len);
+    }
+}
+
+/* The value must be initialized, i.e. zeroed or an empty buffer. Unless
+ * @number is negative, the saved value must be a number when @number is
+ * set and a buffer otherwise. */
+static int
+image_get_value(struct vm_image *img, struct rts_value *v, int number, struct rts_pool *mp)
+{
+    uint16_t type;
+    uint32_t len;
+
+    if (!image_get(img, &type, sizeof(type)))
+        return -EINVAL;
+    if (number >= 0 && number != (type == RTS_VALUE_TYPE_NUMBER))
+        return -EINVAL;
+    if (type == RTS_VALUE_TYPE_NUMBER) {
+        if (!image_get(img, &v->number.data, sizeof(v->number.data)))
+            return -EINVAL;
+    } else {
+        if (!image_get(img, &len, sizeof(len)) || len > img->cap - img->len)
+            return -EINVAL;
+        if (!rts_buffer_write(&v->buffer, img->data + img->len, len, mp))
+            return -ENOMEM;
+        img->len += len;
+    }
+    v->type = type;
+    return 0;
+}
+
+static void
+image_put_heap(struct vm_image *img, struct rts_object *heap)
+{
+    struct rts_object *obj;
+    uint32_t count = 0;
+
+    for (obj = heap; obj; obj = obj->next)
+        count++;
+    image_put(img, &count, sizeof(count));
+
+    /* Heap objects only carry a meaningful type in their id */
+    for (obj = heap; obj; obj = obj->next) {
+        image_put(img, &obj->id, sizeof(obj->id));
+        image_put_value(img, &obj->value,
+            BUFFER_GET_TYPE(obj->id) == RTS_VALUE_TYPE_NUMBER ?
+                RTS_VALUE_TYPE_NUMBER : RTS_VALUE_TYPE_BINARY);
+    }
+}
+
+static int
+image_get_heap(struct vm_image *img, struct rts_object **heap, struct rts_pool *mp)
+{
+    struct rts_object **ptpn = heap;
+    uint32_t count, id;
+    int res;
+
+    if (!image_get(img, &count, sizeof(count)))
+        return -EINVAL;
+
+    /* Append, so the list order and thus multipart objects are preserved */
+    while (count--) {
+        if (!image_get(img, &id, sizeof(id)))
+            return -EINVAL;
+        if (!object_create(ptpn, id, mp))
+            return -ENOMEM;
+        res = image_get_value(img, &(*ptpn)->value,
+            BUFFER_GET_TYPE(id) == RTS_VALUE_TYPE_NUMBER, mp);
+        if (res != 0)
+            return res;
+        ptpn = &(*ptpn)->next;
+    }
+    return 0;
+}
+
+size_t
+rts_vm_save(struct rts_vm *vm, void *dst, size_t len)
+{
+    struct vm_image img = { .data = dst, .cap = len, .len = 0 };
+    uint32_t u32;
+    unsigned i;
+
+    rts_assert(vm->sync == 0);
+
+    image_put(&img, &vm->generation, sizeof(uint32_t));
+    image_put(&img, &vm->resume, sizeof(uint32_t));
+    image_put(&img, &vm->resume_fun, sizeof(uint32_t));
+
+    u32 = vm->sp;
+    image_put(&img, &u32, sizeof(u32));
+    for (i = 0; i < vm->sp; i++)
+        image_put_value(&img, &vm->s[i], vm->s[i].type);
+
+    image_put_heap(&img, vm->list);
+    image_put_heap(&img, vm->shared);
+    return img.len;
+}
+
+int
+rts_vm_load(struct rts_vm *vm, const void *src, size_t len)
+{
+    struct vm_image img = { .data = (unsigned char *)src, .cap = len, .len = 0 };
+    struct rts_pool *mp = &vm->thread->mp;
+    uint32_t u32;
+    int res;
+
+    if (!image_get(&img, &u32, sizeof(u32)))
+        return -EINVAL;
+    vm->generation = u32;
+    if (!image_get(&img, &u32, sizeof(u32)))
+        return -EINVAL;
+    vm->resume = u32;
+    if (!image_get(&img, &u32, sizeof(u32)))
+        return -EINVAL;
+    vm->resume_fun = u32;
+
+    if (!image_get(&img, &u32, sizeof(u32)))
+        return -EINVAL;
+    if (u32 > sizeof(vm->s) / sizeof(vm->s[0]) || (u32 && !vm->resume_fun))
+        return -EINVAL;
+    while (vm->sp < u32) {
+        struct rts_value *v = &vm->s[vm->sp];
+        __builtin_memset(v, 0, sizeof(*v));
+        if ((res = image_get_value(&img, v, -1, mp)) != 0) {
+            rts_buffer_exit(&v->buffer, mp);
+            return res;
+        }
+        vm->sp++;
+    }
+
+    if ((res = image_get_heap(&img, &vm->list, mp)) != 0)
+        return res;
+    if ((res = image_get_heap(&img, &vm->shared, mp)) != 0)
+        return res;
+    return img.len == len ? 0 : -EINVAL;
+}
+
 static void
 rts_vm_expect(struct rts_vm *vm, int argc, struct rts_value *argv)
 {
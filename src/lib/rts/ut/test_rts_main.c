@@ -24,9 +24,13 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <endian.h>
+#include <errno.h>
 #include <libgen.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "rts.h"
 #include "rts_slob.h"
@@ -35,6 +39,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "unity.h"
 #include "rts_priv.h"
 #include "rts_slob.h"
+#include "rts_buffer.h"
+#include "rts_vm.h"
 
 void (*g_setUp)(void) = NULL;
 void (*g_tearDown)(void) = NULL;
@@ -167,6 +173,261 @@ void test_alloc(void)
     rts_ext_free(mem);
 }
 
+/*
+ * Minimal signature file: two variables, one service name and one
+ * exported key, no automaton.
+ */
+static size_t build_signature(uint8_t *buf, size_t len)
+{
+    static const char keys[] = "x.y\0" "1\0" "3\0";
+    uint32_t hdr[2];
+    size_t off = 0;
+
+    memcpy(buf, "RTS", 4);
+    buf[4] = RTS_MAJOR;
+    buf[5] = RTS_MINOR;
+    buf[6] = RTS_PATCH;
+    buf[7] = 0;
+    off = 8;
+
+    hdr[0] = htobe32(RTS_SECTION_VARS);
+    hdr[1] = htobe32(2 * sizeof(struct rts_var));
+    memcpy(buf + off, hdr, sizeof(hdr));
+    off += sizeof(hdr);
+    memset(buf + off, 0, 2 * sizeof(struct rts_var));
+    off += 2 * sizeof(struct rts_var);
+
+    hdr[0] = htobe32(RTS_SECTION_STAB);
+    hdr[1] = htobe32(sizeof(uint32_t) + RTS_STAB_MAXLEN);
+    memcpy(buf + off, hdr, sizeof(hdr));
+    off += sizeof(hdr);
+    hdr[0] = htobe32(1);
+    memcpy(buf + off, hdr, sizeof(uint32_t));
+    off += sizeof(uint32_t);
+    memset(buf + off, 0, RTS_STAB_MAXLEN);
+    strcpy((char *)buf + off, "svc");
+    off += RTS_STAB_MAXLEN;
+
+    /* the keylist ends with an empty key */
+    hdr[0] = htobe32(RTS_SECTION_KEYS);
+    hdr[1] = htobe32(sizeof(keys));
+    memcpy(buf + off, hdr, sizeof(hdr));
+    off += sizeof(hdr);
+    memcpy(buf + off, keys, sizeof(keys));
+    off += sizeof(keys);
+
+    memset(buf + off, 0, sizeof(hdr));
+    off += sizeof(hdr);
+
+    TEST_ASSERT_TRUE(off <= len);
+    return off;
+}
+
+static int g_image_released;
+
+static void image_release(const void *image, size_t len, void *arg)
+{
+    g_image_released++;
+    TEST_ASSERT_EQUAL_PTR(&g_image_released, arg);
+    free((void *)image);
+}
+
+static void key_callback(rts_stream_t stream, void *user, const char *key,
+                         uint8_t type, uint16_t length, const void *value)
+{
+}
+
+static void *image_copy(const void *image, size_t len)
+{
+    void *copy;
+
+    /* room for a misaligned copy */
+    copy = aligned_alloc(RTS_IMAGE_ALIGN, (len + 2 * RTS_IMAGE_ALIGN - 1) & ~(RTS_IMAGE_ALIGN - 1));
+    TEST_ASSERT_NOT_NULL(copy);
+    memcpy(copy, image, len);
+
+    return copy;
+}
+
+void test_rts_load_file(void)
+{
+    uint8_t sig[512];
+    const char *name;
+    size_t len;
+
+    len = build_signature(sig, sizeof(sig));
+
+    TEST_ASSERT_EQUAL_INT(0, rts_load(sig, len));
+    TEST_ASSERT_EQUAL_INT(1, rts_lookup(-1, NULL, NULL));
+    TEST_ASSERT_EQUAL_INT(0, rts_lookup(0, &name, NULL));
+    TEST_ASSERT_EQUAL_STRING("svc", name);
+    TEST_ASSERT_EQUAL_INT(0, rts_subscribe("x.y", key_callback));
+    TEST_ASSERT_EQUAL_INT(-EINVAL, rts_subscribe("x.z", key_callback));
+    TEST_ASSERT_EQUAL_INT(0, rts_load(NULL, 0));
+}
+
+void test_rts_load_image(void)
+{
+    uint8_t sig[512];
+    size_t imagelen;
+    const char *name;
+    uint8_t *first;
+    uint8_t *next;
+    void *image;
+    size_t len;
+
+    len = build_signature(sig, sizeof(sig));
+    TEST_ASSERT_EQUAL_INT(0, rts_image_create(sig, len, &image, &imagelen));
+
+    g_image_released = 0;
+    first = image_copy(image, imagelen);
+
+    /* Misaligned images are rejected and left to the caller */
+    memmove(first + 8, first, imagelen);
+    TEST_ASSERT_EQUAL_INT(-EINVAL, rts_load_image(first + 8, imagelen, image_release, &g_image_released));
+    TEST_ASSERT_EQUAL_INT(0, g_image_released);
+    memcpy(first, image, imagelen);
+
+    TEST_ASSERT_EQUAL_INT(0, rts_load_image(first, imagelen, image_release, &g_image_released));
+    TEST_ASSERT_EQUAL_INT(1, rts_lookup(-1, NULL, NULL));
+
+    /* Service names are used in place */
+    TEST_ASSERT_EQUAL_INT(0, rts_lookup(0, &name, NULL));
+    TEST_ASSERT_EQUAL_STRING("svc", name);
+    TEST_ASSERT_TRUE((const uint8_t *)name > first && (const uint8_t *)name < first + imagelen);
+
+    /* Subscriptions do not write to the image */
+    TEST_ASSERT_EQUAL_INT(0, rts_subscribe("x.y", key_callback));
+    TEST_ASSERT_EQUAL_MEMORY(image, first, imagelen);
+
+    /* Hot swap: the previous image is released once unreferenced */
+    next = image_copy(image, imagelen);
+    TEST_ASSERT_EQUAL_INT(0, rts_load_image(next, imagelen, image_release, &g_image_released));
+    TEST_ASSERT_EQUAL_INT(1, g_image_released);
+
+    TEST_ASSERT_EQUAL_INT(0, rts_load(NULL, 0));
+    TEST_ASSERT_EQUAL_INT(2, g_image_released);
+
+    /* A signature file is not an image */
+    first = image_copy(sig, len);
+    TEST_ASSERT_EQUAL_INT(-EINVAL, rts_load_image(first, len, image_release, &g_image_released));
+    TEST_ASSERT_EQUAL_INT(2, g_image_released);
+    free(first);
+
+    rts_ext_free(image);
+}
+
+/*
+ * Builds a stream waiting in a suspended function, with values on the
+ * evaluation stack and shared regions referencing each other.
+ */
+static rts_stream_t build_stream(rts_handle_t handle)
+{
+    struct rts_thread *thread;
+    struct rts_stream *stream;
+    unsigned char *shm;
+    size_t off;
+
+    thread = rts_container_of(handle, struct rts_thread, handle);
+    stream = rts_pool_alloc(&thread->mp, sizeof(*stream));
+    TEST_ASSERT_NOT_NULL(stream);
+
+    stream->user = NULL;
+    stream->data.state = 5;
+    stream->data.flags = DATA_FLAG_INV;
+    stream->data.offset[0] = 10;
+    stream->data.offset[1] = 20;
+    rts_vm_init(&stream->vm, thread);
+
+    shm = rts_vm_shm_get(&stream->vm, 0, 8);
+    TEST_ASSERT_NOT_NULL(shm);
+    memcpy(shm, "\x0a\x00\x00\x01\x0a\x00\x00\x02", 8);
+    off = 0;
+    TEST_ASSERT_TRUE(rts_vm_shm_zcopy(&stream->vm, shm, 4, 1, &off));
+    TEST_ASSERT_TRUE(rts_vm_shm_zcopy(&stream->vm, shm, 4, 2, &off));
+
+    stream->vm.resume = 3;
+    stream->vm.resume_fun = 7;
+    stream->vm.s[0].type = RTS_VALUE_TYPE_NUMBER;
+    stream->vm.s[0].number.data = -42;
+    rts_buffer_init(&stream->vm.s[1].buffer);
+    TEST_ASSERT_TRUE(rts_buffer_write(&stream->vm.s[1].buffer, "host", 4, &thread->mp));
+    stream->vm.s[1].type = RTS_VALUE_TYPE_STRING;
+    stream->vm.sp = 2;
+
+    return stream;
+}
+
+void test_rts_stream_hibernate(void)
+{
+    struct rts_rusage usage;
+    rts_stream_t stream;
+    rts_handle_t handle;
+    unsigned curr_alloc;
+    uint8_t sig[512];
+    size_t bloblen;
+    size_t len;
+    void *blob2;
+    void *blob;
+    int user;
+
+    len = build_signature(sig, sizeof(sig));
+    TEST_ASSERT_EQUAL_INT(0, rts_load(sig, len));
+    TEST_ASSERT_EQUAL_INT(0, rts_handle_create(&handle));
+
+    memset(&usage, 0, sizeof(usage));
+    rts_handle_rusage(handle, &usage);
+    curr_alloc = usage.curr_alloc;
+
+    /* Hibernation releases all the handle memory of the stream */
+    stream = build_stream(handle);
+    TEST_ASSERT_EQUAL_INT(0, rts_stream_hibernate(stream, &blob, &bloblen));
+    memset(&usage, 0, sizeof(usage));
+    rts_handle_rusage(handle, &usage);
+    TEST_ASSERT_EQUAL_UINT(curr_alloc, usage.curr_alloc);
+    TEST_ASSERT_EQUAL_UINT(1, usage.hibernated);
+
+    TEST_ASSERT_EQUAL_INT(0, rts_stream_restore(&stream, handle, blob, bloblen, &user));
+    TEST_ASSERT_EQUAL_PTR(&user, stream->user);
+    TEST_ASSERT_EQUAL_UINT(5, stream->data.state);
+    TEST_ASSERT_EQUAL_UINT(DATA_FLAG_INV, stream->data.flags);
+    TEST_ASSERT_EQUAL_UINT(10, stream->data.offset[0]);
+    TEST_ASSERT_EQUAL_UINT(20, stream->data.offset[1]);
+    TEST_ASSERT_EQUAL_UINT(3, stream->vm.resume);
+    TEST_ASSERT_EQUAL_UINT(7, stream->vm.resume_fun);
+    TEST_ASSERT_EQUAL_UINT(2, stream->vm.sp);
+    TEST_ASSERT_EQUAL_INT(RTS_VALUE_TYPE_NUMBER, stream->vm.s[0].type);
+    TEST_ASSERT_EQUAL_INT64(-42, stream->vm.s[0].number.data);
+    TEST_ASSERT_EQUAL_INT(RTS_VALUE_TYPE_STRING, stream->vm.s[1].type);
+    TEST_ASSERT_EQUAL_UINT(4, rts_buffer_size(&stream->vm.s[1].buffer));
+    TEST_ASSERT_EQUAL_MEMORY("host", rts_buffer_data(&stream->vm.s[1].buffer, 0), 4);
+
+    /* The restored stream saves to the same state */
+    TEST_ASSERT_EQUAL_INT(0, rts_stream_hibernate(stream, &blob2, &len));
+    TEST_ASSERT_EQUAL_size_t(bloblen, len);
+    TEST_ASSERT_EQUAL_MEMORY(blob, blob2, bloblen);
+    rts_ext_free(blob2);
+
+    /* A corrupt blob does not leak handle memory */
+    TEST_ASSERT_EQUAL_INT(-EINVAL, rts_stream_restore(&stream, handle, blob, bloblen - 1, NULL));
+    TEST_ASSERT_EQUAL_INT(-EINVAL, rts_stream_restore(&stream, handle, blob, 4, NULL));
+    memset(&usage, 0, sizeof(usage));
+    rts_handle_rusage(handle, &usage);
+    TEST_ASSERT_EQUAL_UINT(curr_alloc, usage.curr_alloc);
+    TEST_ASSERT_EQUAL_UINT(1, usage.hibernated);
+    TEST_ASSERT_EQUAL_UINT(1, usage.restored);
+
+    /* Streams done matching have nothing to resume */
+    TEST_ASSERT_EQUAL_INT(0, rts_stream_restore(&stream, handle, blob, bloblen, NULL));
+    stream->data.state = 0;
+    TEST_ASSERT_EQUAL_INT(-EINVAL, rts_stream_hibernate(stream, &blob2, &len));
+    TEST_ASSERT_EQUAL_INT(0, rts_stream_destroy(stream));
+
+    rts_ext_free(blob);
+    TEST_ASSERT_EQUAL_INT(0, rts_handle_destroy(handle));
+    TEST_ASSERT_EQUAL_INT(0, rts_load(NULL, 0));
+}
+
 int main(int argc, char *argv[])
 {
     (void)argc;
@@ -179,6 +440,9 @@ int main(int argc, char *argv[])
 
     RUN_TEST(test_alloc);
     RUN_TEST(test_rts_pool_alloc);
+    RUN_TEST(test_rts_load_file);
+    RUN_TEST(test_rts_load_image);
+    RUN_TEST(test_rts_stream_hibernate);
 
     return UNITY_END();
 }
@@ -32,6 +32,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "schema_gen.h"
 #include "pjs_gen_c.h"
 
+#include "schema_gen.h"
+#include "pjs_gen_desc.h"
+
 SCHEMA_LISTX(_SCHEMA_COL_IMPL)
 
 SCHEMA_LISTX(_SCHEMA_IMPL_MARK_CHANGED)
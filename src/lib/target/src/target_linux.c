@@ -45,19 +45,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "osp_power.h"
 #include "memutil.h"
 #include "os.h"
+#include "procfs_sample.h"
 
 
 #define MODULE_ID LOG_MODULE_ID_TARGET
 
-#define LINUX_PROC_LOADAVG_FILE  "/proc/loadavg"
-#define LINUX_PROC_UPTIME_FILE   "/proc/uptime"
-#define LINUX_PROC_MEMINFO_FILE  "/proc/meminfo"
-#define LINUX_PROC_STAT_FILE     "/proc/stat"
-
-#define STR_BEGINS_WITH(buf, token)  \
-            (strncmp(buf, token, strlen(token)) == 0)
-
-
 #define PID_BUF_NUM      128
 
 
@@ -139,30 +131,17 @@ static const pid_util_t* sysutil_prev_find(uint32_t pid);
 
 static bool linux_device_load_get(dpp_device_record_t *record)
 {
-    int32_t     rc;
-    const char  *filename = LINUX_PROC_LOADAVG_FILE;
-    FILE        *proc_file = NULL;
+    struct procfs_loadavg la;
 
-    proc_file = fopen(filename, "r");
-    if (proc_file == NULL)
+    if (!procfs_loadavg_get(&la))
     {
-        LOG(ERR, "Parsing device stats (Failed to open %s)", filename);
+        LOG(ERR, "Parsing device stats (Failed to read /proc/loadavg)");
         return false;
     }
 
-    rc = fscanf(proc_file,
-            "%lf %lf %lf",
-            &record->load[DPP_DEVICE_LOAD_AVG_ONE],
-            &record->load[DPP_DEVICE_LOAD_AVG_FIVE],
-            &record->load[DPP_DEVICE_LOAD_AVG_FIFTEEN]);
-
-    fclose(proc_file);
-
-    if (rc != DPP_DEVICE_LOAD_AVG_QTY)
-    {
-        LOG(ERR, "Parsing device stats (Failed to read %s)", filename);
-        return false;
-    }
+    record->load[DPP_DEVICE_LOAD_AVG_ONE] = la.la_one;
+    record->load[DPP_DEVICE_LOAD_AVG_FIVE] = la.la_five;
+    record->load[DPP_DEVICE_LOAD_AVG_FIFTEEN] = la.la_fifteen;
 
     LOG(TRACE, "Parsed device load %0.2f %0.2f %0.2f",
             record->load[DPP_DEVICE_LOAD_AVG_ONE],
@@ -175,26 +154,15 @@ static bool linux_device_load_get(dpp_device_record_t *record)
 
 static bool linux_device_uptime_get(dpp_device_record_t *record)
 {
-    int32_t     rc;
-    const char  *filename = LINUX_PROC_UPTIME_FILE;
-    FILE        *proc_file = NULL;
+    double uptime;
 
-    proc_file = fopen(filename, "r");
-    if (proc_file == NULL)
+    if (!procfs_uptime_get(&uptime))
     {
-        LOG(ERR, "Parsing device stats (Failed to open %s)", filename);
+        LOG(ERR, "Parsing device stats (Failed to read /proc/uptime)");
         return false;
     }
 
-    rc = fscanf(proc_file, "%u", &record->uptime);
-
-    fclose(proc_file);
-
-    if (rc != 1)
-    {
-        LOG(ERR, "Parsing device stats (Failed to read %s)", filename);
-        return false;
-    }
+    record->uptime = (uint32_t)uptime;
 
     LOG(TRACE, "Parsed device uptime %u", record->uptime);
 
@@ -259,181 +227,93 @@ static bool linux_device_powerinfo_get(dpp_device_powerinfo_t *powerinfo)
 
 static bool linux_device_cpuutil_get(dpp_device_cpuutil_t *cpuutil)
 {
-    const char *filename = LINUX_PROC_STAT_FILE;
-    FILE *proc_file = NULL;
-    char buf[256] = { 0 };
+    struct procfs_cpu cpu;
+    cpu_stats_hz_t now;
+    cpu_stats_hz_t diff;
+    uint64_t hz_total_diff;
+    double busy;
 
 
     memset(cpuutil, 0, sizeof(*cpuutil));
 
-    proc_file = fopen(filename, "r");
-    if (proc_file == NULL)
+    /* The aggregate 'cpu' line */
+    if (!procfs_cpu_get(-1, &cpu))
     {
-        LOG(ERROR, "Failed opening file: %s", filename);
+        LOG(ERROR, "Error parsing /proc/stat.");
         return false;
     }
 
-    while (fgets(buf, sizeof(buf), proc_file) != NULL)
-    {
-        cpu_stats_hz_t now;
-        cpu_stats_hz_t diff;
-        uint64_t hz_total_diff;
-        double busy;
+    now.hz_user   = cpu.cpu_user;
+    now.hz_nice   = cpu.cpu_nice;
+    now.hz_system = cpu.cpu_system;
+    now.hz_idle   = cpu.cpu_idle;
 
-        /* Check for 'cpu', but not 'cpu0', 'cpu1', and such */
-        if (!STR_BEGINS_WITH(buf, "cpu ")) continue;  // not the right line
+    diff.hz_user   = now.hz_user   - g_cpu_stats_prev.hz_user;
+    diff.hz_nice   = now.hz_nice   - g_cpu_stats_prev.hz_nice;
+    diff.hz_system = now.hz_system - g_cpu_stats_prev.hz_system;
+    diff.hz_idle   = now.hz_idle   - g_cpu_stats_prev.hz_idle;
 
-        if (sscanf(buf, "cpu %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64"",
-                    &(now.hz_user), &(now.hz_nice), &(now.hz_system), &(now.hz_idle)) != 4)
-        {
-            goto parse_error;
-        }
-
-        diff.hz_user   = now.hz_user   - g_cpu_stats_prev.hz_user;
-        diff.hz_nice   = now.hz_nice   - g_cpu_stats_prev.hz_nice;
-        diff.hz_system = now.hz_system - g_cpu_stats_prev.hz_system;
-        diff.hz_idle   = now.hz_idle   - g_cpu_stats_prev.hz_idle;
-
-        g_cpu_stats_prev = now;  // store current values
+    g_cpu_stats_prev = now;  // store current values
 
-        hz_total_diff = diff.hz_user
-                        + diff.hz_nice
-                        + diff.hz_system
-                        + diff.hz_idle;
-
-        if (hz_total_diff == 0)
-        {
-            LOG(ERROR, "%s: Unexpected hz_total value: %"PRIu64"",
-                        __func__, hz_total_diff);
-            return false;
-        }
+    hz_total_diff = diff.hz_user
+                    + diff.hz_nice
+                    + diff.hz_system
+                    + diff.hz_idle;
 
-        /* Calculate percentage and round */
-        busy = (1.0 - ((double)diff.hz_idle / (double)hz_total_diff)) * 100.0;
+    if (hz_total_diff == 0)
+    {
+        LOG(ERROR, "%s: Unexpected hz_total value: %"PRIu64"",
+                    __func__, hz_total_diff);
+        return false;
+    }
 
-        cpuutil->cpu_util = (uint32_t) (busy + 0.5);
+    /* Calculate percentage and round */
+    busy = (1.0 - ((double)diff.hz_idle / (double)hz_total_diff)) * 100.0;
 
-        break;  // found the aggregate 'cpu' line, exit loop
-    }
+    cpuutil->cpu_util = (uint32_t) (busy + 0.5);
 
-    fclose(proc_file);
     return true;
-
-parse_error:
-    fclose(proc_file);
-    LOG(ERROR, "Error parsing %s.", filename);
-    return false;
 }
 
 
 /* Get system uptime [clock ticks]. */
 static int proc_parse_uptime(uint64_t *uptime)
 {
-    const char *filename = LINUX_PROC_UPTIME_FILE;
-    FILE *proc_file = NULL;
-    char buf[256];
     double sys_time;
 
-
-    proc_file = fopen(filename, "r");
-    if (proc_file == NULL)
+    if (!procfs_uptime_get(&sys_time))
     {
-        LOG(ERROR, "Failed opening file: %s", filename);
+        LOG(ERROR, "Error reading /proc/uptime");
         return -1;
     }
 
-    if (fgets(buf, sizeof(buf), proc_file) == NULL)
-    {
-        goto read_error;
-    }
-
-    if (sscanf(buf, "%lf", &sys_time) != 1)
-    {
-        goto parse_error;
-    }
-
     *uptime = (uint64_t) (sys_time * CLOCK_TCK);
 
-    fclose(proc_file);
     return 0;
-
-parse_error:
-    LOG(ERROR, "Error parsing %s", filename);
-    fclose(proc_file);
-    return -1;
-
-read_error:
-    LOG(ERROR, "Error reading %s (%d)", filename, errno);
-    fclose(proc_file);
-    return -1;
 }
 
 
 static int proc_parse_meminfo(system_util_t *system_util)
 {
-    const char *filename = LINUX_PROC_MEMINFO_FILE;
-    FILE *proc_file = NULL;
-    char buf[256];
-    uint32_t mem_total;
-    uint32_t mem_avail;
-    uint32_t mem_free;
-    uint32_t swap_total;
-    uint32_t swap_free;
-
+    struct procfs_meminfo mi;
 
-    proc_file = fopen(filename, "r");
-    if (proc_file == NULL)
+    if (!procfs_meminfo_get(&mi))
     {
-        LOG(ERROR, "Failed opening file: %s", filename);
+        LOG(ERROR, "Error parsing /proc/meminfo.");
         return -1;
     }
 
-    while (fgets(buf, sizeof(buf), proc_file) != NULL)
-    {
-        if (STR_BEGINS_WITH(buf, "MemTotal:"))
-        {
-            if (sscanf(buf, "MemTotal: %u", &mem_total) != 1)
-                goto parse_error;
-        }
-        else if (STR_BEGINS_WITH(buf, "MemFree:"))
-        {
-            if (sscanf(buf, "MemFree: %u", &mem_free) != 1)
-                goto parse_error;
-        }
-        else if (STR_BEGINS_WITH(buf, "MemAvailable:"))
-        {
-            if (sscanf(buf, "MemAvailable: %u", &mem_avail) != 1)
-                goto parse_error;
-        }
-        else if (STR_BEGINS_WITH(buf, "SwapTotal:"))
-        {
-            if (sscanf(buf, "SwapTotal: %u", &swap_total) != 1)
-                goto parse_error;
-        }
-        else if (STR_BEGINS_WITH(buf, "SwapFree:"))
-        {
-            if (sscanf(buf, "SwapFree: %u", &swap_free) != 1)
-                goto parse_error;
-        }
-    }
-
-    system_util->mem_total = mem_total;
-    if (mem_avail > 0) {
-        system_util->mem_used = mem_total - mem_avail;
+    system_util->mem_total = mi.mi_mem_total;
+    if (mi.mi_mem_available > 0) {
+        system_util->mem_used = mi.mi_mem_total - mi.mi_mem_available;
     } else {
-        system_util->mem_used = mem_total - mem_free;   /* older kernels */
+        system_util->mem_used = mi.mi_mem_total - mi.mi_mem_free;   /* older kernels */
     }
 
-    system_util->swap_total = swap_total;
-    system_util->swap_used  = swap_total - swap_free;
+    system_util->swap_total = mi.mi_swap_total;
+    system_util->swap_used  = mi.mi_swap_total - mi.mi_swap_free;
 
-    fclose(proc_file);
     return 0;
-
-parse_error:
-    fclose(proc_file);
-    LOG(ERROR, "Error parsing %s.", filename);
-    return -1;
 }
 
 
@@ -875,44 +755,28 @@ err_out:
 
 static bool linux_device_file_handles_get(dpp_device_record_t *record)
 {
-    const char *filename = "/proc/sys/fs/file-nr";
-    FILE *fp = NULL;
-    char buf[128];
-    bool retval = false;
-    size_t len;
-    uint32_t used, total;
-
-    used = total = 0;
-
-    fp = fopen(filename, "r");
-    if (fp == NULL)
-    {
-        goto out;
-    }
+    const char *p;
+    uint64_t used, total;
 
-    /* Read the stream and check there was no error and everything was read */
-    len = fread(buf, sizeof(*buf), sizeof(buf), fp);
-    (void)len;
-    if (ferror(fp) || !feof(fp))
+    p = procfs_sample_read("/proc/sys/fs/file-nr", NULL);
+    if (p == NULL)
     {
-        goto cleanup;
+        return false;
     }
 
-    /* Use <inttypes.h> macros for reliable reading into u32 vars */
-    if (sscanf(buf, "%" SCNu32 " %*s %" SCNu32, &used, &total) < 2)
+    /* Allocated, unused (always 0 since 2.6) and maximum number of handles */
+    if (!procfs_scan_u64(&p, &used) ||
+        !procfs_scan_skip(&p) ||
+        !procfs_scan_u64(&p, &total))
     {
-        goto cleanup;
+        return false;
     }
 
     /* Record the total/used counts of file handles */
     record->used_file_handles  = used;
     record->total_file_handles = total;
-    retval = true;
 
-cleanup:
-    fclose(fp);
-out:
-    return retval;
+    return true;
 }
 
 
@@ -63,6 +63,7 @@ UNIT_DEPS += src/lib/version
 UNIT_DEPS += src/lib/hw_acc
 UNIT_DEPS += src/lib/brctl_mac_learn
 UNIT_DEPS += src/lib/execsh
+UNIT_DEPS += src/lib/procfs
 
 UNIT_DEPS_CFLAGS += src/lib/datapipeline
 
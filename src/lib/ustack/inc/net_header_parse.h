@@ -135,6 +135,7 @@ struct net_header_parser
     char *tap_intf;
     int sock_fd;
     bool payload_updated;
+    uint32_t ct_mark;              /* conntrack mark, NFQ packets only */
 };
 
 
@@ -82,6 +82,10 @@ struct dpi_session
     uint32_t err_length;
     uint32_t err_create;
     uint32_t err_scan;
+    uint32_t hibernate_idle;
+    uint32_t hib_streams;
+    uint32_t hibernated;
+    uint32_t restored;
     char *wc_topic;
     int wc_interval;
     ds_tree_t dpi_conns;
@@ -124,6 +128,10 @@ struct dpi_conn {
     /* An rts stream is connection specific context for the scan */
     rts_stream_t stream;
 
+    /* The saved stream state while the connection is idle */
+    void *hib_blob;
+    size_t hib_len;
+
     /* Connection context for tracking time online */
     uint64_t toldata;
 
@@ -28,8 +28,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stddef.h>
 #include <time.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
 
 /* To load signature file */
+#include <dirent.h>
 #include <dlfcn.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -57,6 +60,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "kconfig.h"
 #include "fsm_fn_trace.h"
 
+#if !defined(CONFIG_WALLEYE_DPI_ENGINE_IMAGE_DIR)
+#define CONFIG_WALLEYE_DPI_ENGINE_IMAGE_DIR ""
+#endif
+
+#if !defined(CONFIG_WALLEYE_DPI_ENGINE_HIBERNATE_IDLE)
+#define CONFIG_WALLEYE_DPI_ENGINE_HIBERNATE_IDLE 0
+#endif
+
 /* Walleye library config */
 extern int rts_handle_isolate;
 extern int rts_handle_memory_size;
@@ -335,12 +346,171 @@ walleye_dpi_mkdir(char *path)
     return true;
 }
 
+/* 64-bit FNV-1a hash of the signature contents, names the image file */
+static uint64_t
+walleye_image_hash(const uint8_t *data, size_t len)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+
+static void
+walleye_image_release(const void *image, size_t len, void *arg)
+{
+    munmap((void *)image, len);
+}
+
+
+/* Removes the images other than current, all of them if current is NULL */
+static void
+walleye_image_cleanup(const char *current)
+{
+    const char *dir = CONFIG_WALLEYE_DPI_ENGINE_IMAGE_DIR;
+    char path[PATH_MAX];
+    struct dirent *de;
+    DIR *d;
+
+    d = opendir(dir);
+    if (d == NULL) return;
+
+    /* Processes still mapping an unlinked image keep their pages */
+    while ((de = readdir(d)) != NULL)
+    {
+        if (strncmp(de->d_name, "signature-", strlen("signature-"))) continue;
+        if (current != NULL && !strcmp(de->d_name, current)) continue;
+
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        unlink(path);
+    }
+    closedir(d);
+}
+
+
+static bool
+walleye_image_write(const char *path, const void *sig, size_t siglen)
+{
+    char tmp[PATH_MAX + 16];
+    size_t imagelen;
+    void *image;
+    size_t off;
+    ssize_t rc;
+    int res;
+    int fd;
+
+    res = rts_image_create(sig, siglen, &image, &imagelen);
+    if (res != 0)
+    {
+        LOGE("%s: failed to create the signature image: %d", __func__, res);
+        return false;
+    }
+
+    /* Write then rename, concurrent loaders never see a partial image */
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0444);
+    if (fd == -1)
+    {
+        LOGE("%s: failed to create %s: %s", __func__, tmp, strerror(errno));
+        rts_ext_free(image);
+        return false;
+    }
+
+    for (off = 0; off < imagelen; off += rc)
+    {
+        rc = write(fd, (uint8_t *)image + off, imagelen - off);
+        if (rc <= 0) break;
+    }
+    close(fd);
+    rts_ext_free(image);
+
+    if (off != imagelen || rename(tmp, path) != 0)
+    {
+        LOGE("%s: failed to write %s: %s", __func__, path, strerror(errno));
+        unlink(tmp);
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief maps the shared load image of a signature file
+ *
+ * The image is created on first use. Its name derives from the signature
+ * contents, so all processes loading the same signatures map the same file
+ * and share its page cache pages.
+ *
+ * @param sig the signature file contents
+ * @param siglen the signature file length
+ * @param name returns the image file name
+ * @param len returns the mapping length
+ * @return the read-only mapping, or NULL if not available
+ */
+static void *
+walleye_image_map(const void *sig, size_t siglen, char *name, size_t name_len, size_t *len)
+{
+    const char *dir = CONFIG_WALLEYE_DPI_ENGINE_IMAGE_DIR;
+    char path[PATH_MAX];
+    struct stat sb;
+    void *image;
+    int fd;
+
+    if (dir[0] == '\0') return NULL;
+
+    snprintf(name, name_len, "signature-%zx-%016" PRIx64 ".img",
+             siglen, walleye_image_hash(sig, siglen));
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+        {
+            LOGE("%s: failed to create %s: %s", __func__, dir, strerror(errno));
+            return NULL;
+        }
+        if (!walleye_image_write(path, sig, siglen)) return NULL;
+
+        fd = open(path, O_RDONLY);
+        if (fd == -1) return NULL;
+    }
+
+    image = MAP_FAILED;
+    if (fstat(fd, &sb) == 0 && sb.st_size > 0)
+    {
+        image = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if (image == MAP_FAILED)
+    {
+        LOGE("%s: failed to map %s", __func__, path);
+        return NULL;
+    }
+
+    *len = sb.st_size;
+    return image;
+}
+
+
 static int
 load_signatures(struct fsm_session *session, char *store)
 {
     struct fsm_dpi_plugin_ops *dpi_plugin_ops;
     int fd, res;
     struct stat sb;
+    char image_name[NAME_MAX + 1];
+    size_t imagelen;
+    void *image;
     void *sig;
     const char * const path = "/usr/walleye/etc/signature.bin";
     const char * const compressed_file = "data.tar.gz";
@@ -420,7 +590,26 @@ load_signatures(struct fsm_session *session, char *store)
         dpi_plugin_ops->unregister_clients(session);
     }
 
-    if ((res = rts_load(sig, sb.st_size)) != 0)
+    /* Use the shared image in place, fall back to a private copy */
+    image = walleye_image_map(sig, sb.st_size, image_name, sizeof(image_name), &imagelen);
+    if (image != NULL)
+    {
+        res = rts_load_image(image, imagelen, walleye_image_release, NULL);
+        if (res == 0)
+        {
+            LOGI("%s: loaded signature image %s", __func__, image_name);
+            walleye_image_cleanup(image_name);
+        }
+        else
+        {
+            LOGE("%s: failed to load signature image %s: %d", __func__, image_name, res);
+            munmap(image, imagelen);
+            image = NULL;
+            walleye_image_cleanup(NULL);
+        }
+    }
+
+    if (image == NULL && (res = rts_load(sig, sb.st_size)) != 0)
     {
         LOGE("%s: failed to load signatures %d\n", __func__, res);
     }
@@ -457,6 +646,29 @@ shared_free()
 }
 
 
+/**
+ * @brief returns the idle time after which streams are hibernated
+ *
+ * @param session the fsm session
+ * @return the idle time in seconds, 0 if hibernation is disabled
+ */
+static uint32_t
+walleye_dpi_get_hibernate_idle(struct fsm_session *session)
+{
+    long value;
+    char *str;
+
+    str = session->ops.get_config(session, "stream_hibernate_idle");
+    if (str == NULL) return CONFIG_WALLEYE_DPI_ENGINE_HIBERNATE_IDLE;
+
+    errno = 0;
+    value = strtol(str, NULL, 10);
+    if (errno != 0 || value < 0) return CONFIG_WALLEYE_DPI_ENGINE_HIBERNATE_IDLE;
+
+    return (uint32_t)value;
+}
+
+
 static void
 dpi_plugin_update(struct fsm_session *session)
 {
@@ -499,6 +711,7 @@ dpi_plugin_update(struct fsm_session *session)
     fsm_set_dpi_health_stats_cfg(session);
     dpi_session->wc_topic = session->dpi_stats_report_topic;
     dpi_session->wc_interval = session->dpi_stats_report_interval;
+    dpi_session->hibernate_idle = walleye_dpi_get_hibernate_idle(session);
 
     return;
 }
@@ -957,9 +1170,29 @@ walleye_dpi_plugin_init(struct fsm_session *session)
     dpi_session->wc_topic = session->dpi_stats_report_topic;
     dpi_session->wc_interval = session->dpi_stats_report_interval;
 
+    /* Connections with a live or hibernated stream */
+    ds_tree_init(&dpi_session->dpi_conns, ds_void_cmp,
+                 struct dpi_conn, conn_node);
+    dpi_session->hibernate_idle = walleye_dpi_get_hibernate_idle(session);
+
     dpi_session->initialized = true;
     LOGD("%s: added session %s", __func__, session->name);
 
+    /* Load a local signature bundle, bypassing the object manager */
+    str = session->ops.get_config(session, "signature_store");
+    if (str != NULL)
+    {
+        res = load_signatures(session, (char *)str);
+        if (res != 0)
+        {
+            LOGE("%s: failed to load signatures from %s: %d", __func__, str, res);
+            return 0;
+        }
+        dpi_session->signature_loaded = true;
+        LOGI("%s: loaded signatures from %s", __func__, str);
+        return 0;
+    }
+
     if (session->ops.best_obj_cb == NULL) return 0;
 
     /* Register app_signatures object monitoring */
@@ -1405,6 +1638,96 @@ dpi_plugin_tag_stream(struct dpi_session *dpi_session,
 }
 
 
+/**
+ * @brief hibernates the stream of an idle connection
+ *
+ * The stream scan state is saved and the stream released, freeing the
+ * rts handle memory it holds until the next packet of the connection.
+ * @param dpi_session the dpi session
+ * @param dpi the connection
+ * @return true if the stream was hibernated
+ */
+static bool
+dpi_conn_hibernate(struct dpi_session *dpi_session, struct dpi_conn *dpi)
+{
+    int res;
+
+    res = rts_stream_hibernate(dpi->stream, &dpi->hib_blob, &dpi->hib_len);
+    if (res != 0)
+    {
+        LOGT("%s: error %d in rts_stream_hibernate", __func__, res);
+        return false;
+    }
+
+    dpi->stream = NULL;
+    dpi_session->streams--;
+    dpi_session->hib_streams++;
+    dpi_session->hibernated++;
+    return true;
+}
+
+
+/**
+ * @brief restores the hibernated stream of a connection
+ *
+ * The saved state is released whether the restoration succeeds or not.
+ * @param dpi_session the dpi session
+ * @param dpi the connection
+ * @param acc the flow accumulator, relayed to the rts callbacks
+ * @return true if the stream was restored
+ */
+static bool
+dpi_conn_restore(struct dpi_session *dpi_session, struct dpi_conn *dpi,
+                 struct net_md_stats_accumulator *acc)
+{
+    int res;
+
+    res = rts_stream_restore(&dpi->stream, dpi_session->handle,
+                             dpi->hib_blob, dpi->hib_len, acc);
+    rts_ext_free(dpi->hib_blob);
+    dpi->hib_blob = NULL;
+    dpi->hib_len = 0;
+    dpi_session->hib_streams--;
+
+    if (res != 0)
+    {
+        LOGD("%s: error %d in rts_stream_restore", __func__, res);
+        ds_tree_remove(&dpi_session->dpi_conns, dpi);
+        dpi->stream = NULL;
+        dpi_session->err_create++;
+        dpi->scan_error |= SCAN_ERROR_CREATE;
+        return false;
+    }
+
+    dpi_session->streams++;
+    dpi_session->restored++;
+    return true;
+}
+
+
+/**
+ * @brief hibernates the streams idle for longer than the configured time
+ *
+ * @param dpi_session the dpi session
+ * @param now the current monotonic time in seconds
+ */
+static void
+dpi_hibernate_idle_streams(struct dpi_session *dpi_session, time_t now)
+{
+    struct dpi_conn *dpi;
+
+    if (dpi_session->hibernate_idle == 0) return;
+
+    ds_tree_foreach(&dpi_session->dpi_conns, dpi)
+    {
+        if (dpi->stream == NULL) continue;
+        if ((now - dpi->last_updated) < (time_t)dpi_session->hibernate_idle) continue;
+
+        dpi_conn_hibernate(dpi_session, dpi);
+    }
+}
+
+
 /**
  * @brief session packet processing entry point
  *
@@ -1493,6 +1816,7 @@ dpi_plugin_handler(struct fsm_session *session,
         else
         {
             dpi_session->streams++;
+            ds_tree_insert(&dpi_session->dpi_conns, dpi, dpi);
             if (rts_stream_matching(dpi->stream) == 0)
             {
                 dpi_plugin_tag_stream(dpi_session, net_parser, dpi);
@@ -1510,6 +1834,13 @@ dpi_plugin_handler(struct fsm_session *session,
     dpi->bytes[packet->direction] += len;
     dpi->data_packets[packet->direction] += 1;
     dpi->dpi_sess->parser.net_parser = net_parser;
+    dpi->last_updated = now.tv_sec;
+
+    if (dpi->hib_blob != NULL && !dpi_conn_restore(dpi_session, dpi, acc))
+    {
+        /* Mark the flow as passthrough as no resource is available */
+        fsm_dpi_set_plugin_decision(session, acc, FSM_DPI_PASSTHRU);
+    }
 
     if (!dpi->stream)
     {
@@ -1618,13 +1949,24 @@ dpi_plugin_periodic(struct fsm_session *session)
 
     dpi_session = session->handler_ctxt;
 
+    dpi_hibernate_idle_streams(dpi_session, now.tv_sec);
+
     threshold = dpi_session->wc_interval;
     if (!threshold) threshold = WALLEYE_PERIODIC_INTERVAL;
 
     if ((now.tv_sec - mgr->periodic_ts) < threshold) return;
 
-    LOGI("%s: %s: active connections: %u active streams: %u", __func__,
-        session->name, dpi_session->connections,dpi_session->streams);
+    LOGI("%s: %s: active connections: %u active streams: %u hibernated streams: %u",
+         __func__, session->name, dpi_session->connections,
+         dpi_session->streams, dpi_session->hib_streams);
+
+    if (dpi_session->hibernated > 0 || dpi_session->restored > 0)
+    {
+        LOGI("%s:%s: streams hibernated: %u restored: %u", __func__,
+             session->name, dpi_session->hibernated, dpi_session->restored);
+        dpi_session->hibernated = 0;
+        dpi_session->restored = 0;
+    }
 
     if (dpi_session->err_incomplete > 0)
     {
@@ -1796,11 +2138,20 @@ dpi_conn_free(struct dpi_conn *dpi)
     struct dpi_session *dpi_sess;
 
     dpi_sess = dpi->dpi_sess;
+    if (dpi->stream || dpi->hib_blob)
+    {
+        ds_tree_remove(&dpi_sess->dpi_conns, dpi);
+    }
     if (dpi->stream)
     {
         rts_stream_destroy(dpi->stream);
         dpi_sess->streams--;
     }
+    if (dpi->hib_blob)
+    {
+        rts_ext_free(dpi->hib_blob);
+        dpi_sess->hib_streams--;
+    }
     dpi_sess->connections--;
     FREE(dpi);
 }
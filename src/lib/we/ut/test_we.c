@@ -25,7 +25,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <errno.h>
+#include <inttypes.h>
 #include <libgen.h>
+#include <time.h>
 
 #include "log.h"
 #include "target.h"
@@ -33,6 +35,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "vm.h"
 #include "we.h"
+#include "we_prof.h"
 
 void (*g_setUp)(void) = NULL;
 void (*g_tearDown)(void) = NULL;
@@ -149,6 +152,100 @@ static void test_einval()
     TEST_ASSERT_TRUE(we_destroy(state) == 0);
 }
 
+/*
+ * Count down from n to 0:
+ *
+ *  0: mov 1; num 1; sub; pop 1; mov 1; brz +9 (hlt); jmp -15 (mov 1); hlt
+ */
+static const uint8_t test_loop_insn[] = {
+    WE_OP_MOV, 1,
+    WE_OP_NUM, 1,
+    WE_OP_SUB,
+    WE_OP_POP, 1,
+    WE_OP_MOV, 1,
+    WE_OP_BRZ, 0x00, 0x00, 0x00, 0x09,
+    WE_OP_JMP, 0xff, 0xff, 0xff, 0xf1,
+    WE_OP_HLT};
+
+#define TEST_LOOP_OPS_PER_ITER 7
+
+/* Run the count down loop and return the number of ns per instruction */
+static double test_loop_run(int64_t n)
+{
+    struct timespec start;
+    struct timespec end;
+    we_state_t state;
+    int64_t result;
+    double ns;
+
+    TEST_ASSERT_TRUE(we_create(&state, 32, MEMPOOL_SIZE) == 0);
+    TEST_ASSERT_TRUE(we_pushbuf(state, sizeof(test_loop_insn), (void *)test_loop_insn) == 0);
+    TEST_ASSERT_TRUE(we_pushnum(state, n) == 1);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    TEST_ASSERT_TRUE(we_call(&state, NULL) == 0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    TEST_ASSERT_TRUE(we_read(state, 1, WE_NUM, &result) == 8);
+    TEST_ASSERT_TRUE(result == 0);
+    TEST_ASSERT_TRUE(we_destroy(state) == 0);
+
+    ns = (double)(end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    return ns / (double)(n * TEST_LOOP_OPS_PER_ITER);
+}
+
+static void test_prof()
+{
+    struct we_prof_func funcs[4];
+
+    if (!we_prof_enable(true, 101))
+    {
+        TEST_ASSERT_EQUAL_STRING("unknown", we_prof_op_name(WE_OP_SUB));
+        TEST_IGNORE_MESSAGE("WE VM profiler not enabled");
+    }
+
+    we_prof_reset();
+    test_loop_run(1000);
+    we_prof_enable(false, 0);
+
+    TEST_ASSERT_EQUAL_UINT64(1000, we_prof_op_count(WE_OP_SUB));
+    TEST_ASSERT_EQUAL_UINT64(1000, we_prof_op_count(WE_OP_BRZ));
+    TEST_ASSERT_EQUAL_UINT64(999, we_prof_op_count(WE_OP_JMP));
+    TEST_ASSERT_EQUAL_UINT64(1, we_prof_op_count(WE_OP_HLT));
+    TEST_ASSERT_EQUAL_STRING("sub", we_prof_op_name(WE_OP_SUB));
+    TEST_ASSERT_EQUAL_INT(1, we_prof_funcs(funcs, 4));
+    TEST_ASSERT_EQUAL_UINT64(1, funcs[0].calls);
+    TEST_ASSERT_NOT_NULL(funcs[0].code);
+    TEST_ASSERT_EQUAL_UINT64(7000 / 101, we_prof_samples());
+    TEST_ASSERT_EQUAL_UINT64(0, we_prof_dropped());
+    TEST_ASSERT_TRUE(we_prof_dump_folded(stdout) > 0);
+
+    we_prof_reset();
+}
+
+/*
+ * Instruction dispatch cost with the profiler disabled and, if it is built
+ * in, enabled
+ */
+static void test_prof_bench()
+{
+    double ns_off;
+    double ns_on;
+
+    we_prof_enable(false, 0);
+    test_loop_run(100000);
+    ns_off = test_loop_run(10000000);
+    LOGI("WE VM: %.2f ns/insn (profiler off)", ns_off);
+
+    if (!we_prof_enable(true, 10007)) return;
+
+    we_prof_reset();
+    ns_on = test_loop_run(10000000);
+    we_prof_enable(false, 0);
+    we_prof_reset();
+    LOGI("WE VM: %.2f ns/insn (profiler on)", ns_on);
+}
+
 int main(int argc, char *argv[])
 {
     (void)argc;
@@ -166,6 +263,8 @@ int main(int argc, char *argv[])
     RUN_TEST(test_mul);
     RUN_TEST(test_ext);
     RUN_TEST(test_einval);
+    RUN_TEST(test_prof);
+    RUN_TEST(test_prof_bench);
 
     return UNITY_END();
 }
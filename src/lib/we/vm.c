@@ -26,13 +26,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "vm.h"
 #include "we.h"
+#include "we_prof.h"
 #include <assert.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "memutil.h"
 #include <string.h>
+#include <time.h>
 #include <kconfig.h>
 #include "log.h"
 
@@ -1670,6 +1673,306 @@ static int we_op_rusage(struct we_obj *obj)
     return 0;
 }
 
+#if defined(CONFIG_WE_VM_PROFILER)
+
+#define WE_PROF_FUNCS 64
+#define WE_PROF_STACKS 512
+#define WE_PROF_DEPTH 8
+
+static const char *we_prof_op_names[WE_PROF_OPS] = {
+    "nil", "num", "buf", "tab", "arr", "get", "set", "mov", "pop", "add", "sub", "mul", "cmp",
+    "div", "mod", "and", "ior", "xor", "shl", "shr", "eql", "hlt", "jmp", "brz", "ext", "tid",
+    "len", "ref", "siz", "ord", "chr", "int", "str", "cat", "com", "sel", "idx", "val", "tie",
+    "off", "oid", "csp", "bin", "gmt", "smt", "lbf", "lbt", "rsz", "wea", "res", "eva", "rus"};
+
+const char *we_prof_op_name(int op)
+{
+    if (op < 0 || op >= WE_PROF_OPS || we_prof_op_names[op] == NULL) return "unknown";
+    return we_prof_op_names[op];
+}
+
+struct we_prof_stack
+{
+    uint64_t count;
+    uint8_t depth;
+    uint8_t op;
+    const void *frames[WE_PROF_DEPTH];
+};
+
+static struct
+{
+    bool enabled;
+    uint32_t period;
+    uint32_t countdown;
+    uint64_t ops[WE_PROF_OPS];
+    struct we_prof_func funcs[WE_PROF_FUNCS];
+    int nfuncs;
+    struct we_prof_stack stacks[WE_PROF_STACKS];
+    uint64_t samples;
+    uint64_t dropped;
+    struct we_prof_func *cur;
+    uint64_t ts;
+} we_prof;
+
+static uint64_t we_prof_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * The VM has no symbol names; identify a coroutine by its bytecode buffer,
+ * which is shared by all instances of the same coroutine and, unlike the
+ * state, is not reused for a different coroutine when a state is released.
+ */
+static inline const void *we_prof_code(const struct we_arr *state)
+{
+    return state->data[0].u.buf;
+}
+
+static struct we_prof_func *we_prof_func_get(const struct we_arr *state)
+{
+    const void *code = we_prof_code(state);
+    int ii;
+
+    for (ii = 0; ii < we_prof.nfuncs; ii++)
+    {
+        if (we_prof.funcs[ii].code == code) return &we_prof.funcs[ii];
+    }
+
+    if (we_prof.nfuncs >= WE_PROF_FUNCS) return NULL;
+
+    we_prof.funcs[we_prof.nfuncs].code = code;
+    return &we_prof.funcs[we_prof.nfuncs++];
+}
+
+/* Account the time spent in the current coroutine and switch to @p state */
+static void we_prof_switch(const struct we_arr *state)
+{
+    uint64_t now = we_prof_now();
+    uint64_t delta;
+
+    if (we_prof.cur != NULL)
+    {
+        delta = now - we_prof.ts;
+        we_prof.cur->ns += delta;
+        if (delta > we_prof.cur->max_ns) we_prof.cur->max_ns = delta;
+    }
+
+    we_prof.cur = NULL;
+    if (state != NULL && (we_prof.cur = we_prof_func_get(state)) != NULL)
+    {
+        we_prof.cur->calls++;
+    }
+    we_prof.ts = now;
+}
+
+/* Record the coroutine stack of @p state executing opcode @p op */
+static void we_prof_sample(const struct we_arr *state, uint8_t op)
+{
+    const void *frames[WE_PROF_DEPTH];
+    struct we_prof_stack *st;
+    uint32_t hash = op;
+    uint8_t depth = 0;
+    uint32_t ii;
+
+    for (; state != NULL && depth < WE_PROF_DEPTH; state = state->prev)
+    {
+        frames[depth] = we_prof_code(state);
+        hash = (hash ^ (uint32_t)(uintptr_t)frames[depth]) * 16777619;
+        depth++;
+    }
+
+    we_prof.samples++;
+
+    /* Open addressing, linear probing */
+    for (ii = 0; ii < WE_PROF_STACKS; ii++)
+    {
+        st = &we_prof.stacks[(hash + ii) % WE_PROF_STACKS];
+        if (st->count == 0)
+        {
+            st->depth = depth;
+            st->op = op;
+            memcpy(st->frames, frames, depth * sizeof(frames[0]));
+            st->count = 1;
+            return;
+        }
+
+        if (st->op == op && st->depth == depth && memcmp(st->frames, frames, depth * sizeof(frames[0])) == 0)
+        {
+            st->count++;
+            return;
+        }
+    }
+
+    we_prof.dropped++;
+}
+
+static inline void we_prof_op(const struct we_arr *state, uint8_t op)
+{
+    we_prof.ops[op]++;
+
+    if (we_prof.period == 0 || --we_prof.countdown > 0) return;
+
+    we_prof.countdown = we_prof.period;
+    we_prof_sample(state, op);
+}
+
+bool we_prof_enable(bool enable, uint32_t sample_period)
+{
+    we_prof.enabled = enable;
+    we_prof.period = sample_period;
+    we_prof.countdown = sample_period;
+    return true;
+}
+
+bool we_prof_enabled(void)
+{
+    return we_prof.enabled;
+}
+
+void we_prof_reset(void)
+{
+    memset(we_prof.ops, 0, sizeof(we_prof.ops));
+    memset(we_prof.funcs, 0, sizeof(we_prof.funcs));
+    memset(we_prof.stacks, 0, sizeof(we_prof.stacks));
+    we_prof.nfuncs = 0;
+    we_prof.samples = 0;
+    we_prof.dropped = 0;
+    we_prof.cur = NULL;
+}
+
+uint64_t we_prof_op_count(int op)
+{
+    if (op < 0 || op >= WE_PROF_OPS) return 0;
+    return we_prof.ops[op];
+}
+
+int we_prof_funcs(struct we_prof_func *funcs, int nfuncs)
+{
+    if (nfuncs > we_prof.nfuncs) nfuncs = we_prof.nfuncs;
+    memcpy(funcs, we_prof.funcs, nfuncs * sizeof(*funcs));
+    return nfuncs;
+}
+
+uint64_t we_prof_samples(void)
+{
+    return we_prof.samples;
+}
+
+uint64_t we_prof_dropped(void)
+{
+    return we_prof.dropped;
+}
+
+/*
+ * Write the sampled stacks in the folded format: frames are listed from the
+ * outermost caller to the innermost coroutine, followed by the opcode that
+ * was being executed and the number of samples.
+ */
+int we_prof_dump_folded(FILE *f)
+{
+    struct we_prof_stack *st;
+    int nlines = 0;
+    int ii;
+    int jj;
+
+    for (ii = 0; ii < WE_PROF_STACKS; ii++)
+    {
+        st = &we_prof.stacks[ii];
+        if (st->count == 0) continue;
+
+        for (jj = st->depth - 1; jj >= 0; jj--)
+        {
+            fprintf(f, "co_%p;", st->frames[jj]);
+        }
+        fprintf(f, "op_%s %" PRIu64 "\n", we_prof_op_name(st->op), st->count);
+        nlines++;
+    }
+
+    if (we_prof.dropped > 0)
+    {
+        fprintf(f, "dropped %" PRIu64 "\n", we_prof.dropped);
+    }
+
+    return nlines;
+}
+
+#define WE_PROF_CALL(state) \
+    if (we_prof.enabled) \
+    { \
+        we_prof.cur = NULL; \
+        we_prof_switch(state); \
+    }
+#define WE_PROF_ENTER(state) \
+    if (we_prof.enabled) we_prof_switch(state)
+#define WE_PROF_LEAVE() \
+    if (we_prof.enabled) we_prof_switch(NULL)
+#define WE_PROF_OP(state, op) \
+    if (we_prof.enabled) we_prof_op(state, op)
+
+#else /* CONFIG_WE_VM_PROFILER */
+
+bool we_prof_enable(bool enable, uint32_t sample_period)
+{
+    (void)enable;
+    (void)sample_period;
+    return false;
+}
+
+bool we_prof_enabled(void)
+{
+    return false;
+}
+
+void we_prof_reset(void)
+{
+}
+
+uint64_t we_prof_op_count(int op)
+{
+    (void)op;
+    return 0;
+}
+
+int we_prof_funcs(struct we_prof_func *funcs, int nfuncs)
+{
+    (void)funcs;
+    (void)nfuncs;
+    return 0;
+}
+
+const char *we_prof_op_name(int op)
+{
+    (void)op;
+    return "unknown";
+}
+
+uint64_t we_prof_samples(void)
+{
+    return 0;
+}
+
+uint64_t we_prof_dropped(void)
+{
+    return 0;
+}
+
+int we_prof_dump_folded(FILE *f)
+{
+    (void)f;
+    return 0;
+}
+
+#define WE_PROF_CALL(state)
+#define WE_PROF_ENTER(state)
+#define WE_PROF_LEAVE()
+#define WE_PROF_OP(state, op)
+
+#endif /* CONFIG_WE_VM_PROFILER */
+
 static inline int16_t read16(const unsigned char *src)
 {
     return ((int16_t)src[0] << 8) | ((int16_t)src[1]);
@@ -1707,12 +2010,18 @@ int we_call(struct we_arr **state, void *arg)
     {
         return -EINVAL;
     }
-#define DISPATCH() goto *dispatch[prog[pc++] & 0x3f]
+#define DISPATCH() \
+    { \
+        WE_PROF_OP(*state, prog[pc] & 0x3f); \
+        goto *dispatch[prog[pc++] & 0x3f]; \
+    }
 #define RETURN(err) \
     { \
+        WE_PROF_LEAVE(); \
         (*state)->items = sp; \
         return -(err); \
     }
+    WE_PROF_CALL(*state);
     DISPATCH();
 /* Memory */
 we_op_nil:
@@ -1830,6 +2139,7 @@ we_op_hlt:
     /* yield (restore caller) */
     if (s[0].len)
     {
+        WE_PROF_LEAVE();
         return 0;
     }
     if ((*state)->prev)
@@ -1837,10 +2147,12 @@ we_op_hlt:
         struct we_arr *prev = (*state)->prev;
         (*state)->prev = NULL;
         *state = prev;
+        WE_PROF_ENTER(*state);
     }
     else
     {
         /* return to host */
+        WE_PROF_LEAVE();
         return 0;
     }
     /* resume (restore caller) */
@@ -1973,6 +2285,7 @@ we_op_eva:
 
     // Setup callee
     *state = s[sp - 1].u.arr;
+    WE_PROF_ENTER(*state);
     s = (*state)->data;
     sp = (*state)->items;
     pc = 0;
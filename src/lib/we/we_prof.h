@@ -0,0 +1,77 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef WE_PROF_H_INCLUDED
+#define WE_PROF_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "we.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * WE VM profiler
+ *
+ * Available only when the VM is built with CONFIG_WE_VM_PROFILER, otherwise
+ * we_prof_enable() returns false and all other functions are no-ops.
+ *
+ * The profiler state is global and is not thread-safe; the caller must
+ * serialize it with we_call(), the same way access to a WE state is
+ * serialized.
+ */
+
+/* Number of opcode slots, the dispatch table is indexed by the low 6 bits */
+#define WE_PROF_OPS 64
+
+/* Per-coroutine accounting */
+struct we_prof_func
+{
+    const void *code;   /* Coroutine bytecode buffer, used as the function identity */
+    uint64_t calls;     /* Number of times the coroutine was entered or resumed */
+    uint64_t ns;        /* Time spent executing the coroutine */
+    uint64_t max_ns;    /* Longest single run of the coroutine */
+};
+
+bool we_prof_enable(bool enable, uint32_t sample_period);
+bool we_prof_enabled(void);
+void we_prof_reset(void);
+const char *we_prof_op_name(int op);
+uint64_t we_prof_op_count(int op);
+int we_prof_funcs(struct we_prof_func *funcs, int nfuncs);
+uint64_t we_prof_samples(void);
+uint64_t we_prof_dropped(void);
+int we_prof_dump_folded(FILE *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WE_PROF_H_INCLUDED */
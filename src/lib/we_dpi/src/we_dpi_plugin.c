@@ -25,9 +25,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <errno.h>
+#include <inttypes.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include "dpi_stats.h"
@@ -47,6 +49,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "kconfig.h"
 
 #include "we.h"
+#include "we_prof.h"
 
 #define WE_AGENT_CORO_PRIV "r"
 #define WE_AGENT_CORO_UPDATE "update_coroutine"
@@ -61,6 +64,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define WE_AGENT_BIN_PATH "usr/we/etc/agent.bin"
 #define WE_AGENT_BIN_PATH_LEN (PATH_MAX + 1)
 
+#define WE_PROF_REPORT_INTERVAL 30
+
 static void *we_ct_task(void *args);
 void we_dpi_plugin_exit(struct fsm_session *fsm);
 void we_dpi_plugin_periodic(struct fsm_session *fsm);
@@ -621,6 +626,10 @@ int we_dpi_plugin_init(struct fsm_session *fsm)
 
     dpi_session->initialized = true;
 
+#if defined(CONFIG_WE_VM_PROFILER)
+    we_prof_enable(true, CONFIG_WE_VM_PROFILER_SAMPLE_PERIOD);
+#endif
+
     pthread_mutex_init(&dpi_session->lock, NULL);
     pthread_create(&dpi_session->thread, NULL, we_ct_task, dpi_session);
 
@@ -668,6 +677,101 @@ void we_dpi_plugin_handler(struct fsm_session *fsm, struct net_header_parser *np
     }
 }
 
+#if defined(CONFIG_WE_VM_PROFILER)
+/**
+ * @brief report and reset the WE VM profile
+ *
+ * Opcode counters and per-coroutine times are sent through the DPI call
+ * trace stats, sampled stacks are written to a folded stack file that can
+ * be fed to flamegraph.pl. Must be called with the session lock held.
+ * @param fsm the fsm session
+ */
+static void we_dpi_prof_report(struct fsm_session *fsm)
+{
+    static time_t report_ts;
+    struct we_prof_func funcs[64];
+    struct dpi_stats_packed_buffer *pb;
+    struct fn_tracer_stats trace_stats;
+    struct dpi_stats_report report;
+    char name[64];
+    time_t now;
+    FILE *fp;
+    int nfuncs;
+    int ii;
+
+    now = time(NULL);
+    if ((now - report_ts) < WE_PROF_REPORT_INTERVAL) return;
+    report_ts = now;
+
+    for (ii = 0; ii < WE_PROF_OPS; ii++)
+    {
+        MEMZERO(trace_stats);
+        trace_stats.call_count = we_prof_op_count(ii);
+        if (trace_stats.call_count == 0) continue;
+
+        snprintf(name, sizeof(name), "we_op_%s", we_prof_op_name(ii));
+        trace_stats.fn_name = STRDUP(name);
+        dpi_stats_store_call_trace_stats(&trace_stats);
+        FREE(trace_stats.fn_name);
+    }
+
+    nfuncs = we_prof_funcs(funcs, ARRAY_SIZE(funcs));
+    for (ii = 0; ii < nfuncs; ii++)
+    {
+        LOGI("%s: coroutine %p: calls: %" PRIu64 ", max: %" PRIu64 "us, total: %" PRIu64 "us",
+             __func__,
+             funcs[ii].code,
+             funcs[ii].calls,
+             funcs[ii].max_ns / 1000,
+             funcs[ii].ns / 1000);
+
+        MEMZERO(trace_stats);
+        snprintf(name, sizeof(name), "we_co_%p", funcs[ii].code);
+        trace_stats.fn_name = STRDUP(name);
+        trace_stats.call_count = funcs[ii].calls;
+        trace_stats.max_duration = funcs[ii].max_ns / 1000;
+        trace_stats.total_duration = funcs[ii].ns / 1000;
+        dpi_stats_store_call_trace_stats(&trace_stats);
+        FREE(trace_stats.fn_name);
+    }
+
+    /* Samples that did not fit in the stack table */
+    if (we_prof_dropped() > 0)
+    {
+        LOGI("%s: dropped %" PRIu64 " of %" PRIu64 " samples", __func__, we_prof_dropped(), we_prof_samples());
+
+        MEMZERO(trace_stats);
+        trace_stats.fn_name = STRDUP("we_prof_dropped");
+        trace_stats.call_count = we_prof_dropped();
+        dpi_stats_store_call_trace_stats(&trace_stats);
+        FREE(trace_stats.fn_name);
+    }
+
+    fp = fopen(CONFIG_WE_VM_PROFILER_FOLDED_PATH, "w");
+    if (fp != NULL)
+    {
+        we_prof_dump_folded(fp);
+        fclose(fp);
+    }
+    else
+    {
+        LOGD("%s: unable to open %s: %s", __func__, CONFIG_WE_VM_PROFILER_FOLDED_PATH, strerror(errno));
+    }
+
+    we_prof_reset();
+
+    MEMZERO(report);
+    report.location_id = fsm->location_id;
+    report.node_id = fsm->node_id;
+
+    pb = dpi_stats_serialize_call_trace_stats(&report);
+    if (pb == NULL) return;
+
+    fsm->ops.send_pb_report(fsm, fsm->dpi_stats_report_topic, pb->buf, pb->len);
+    dpi_stats_free_packed_buffer(pb);
+}
+#endif
+
 /**
  * @brief session packet periodic processing entry point
  *
@@ -696,6 +800,9 @@ void we_dpi_plugin_periodic(struct fsm_session *fsm)
         LOGT("Failed to run the agent periodic");
         exit(EXIT_SUCCESS);
     }
+#if defined(CONFIG_WE_VM_PROFILER)
+    we_dpi_prof_report(fsm);
+#endif
     mutex_status = pthread_mutex_unlock(&dpi->lock);
     if (mutex_status != 0)
     {
@@ -33,13 +33,19 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "ds_tree.h"
 #include "ds_util.h"
 #include "evx.h"
+#include "json_util.h"
 #include "log.h"
 #include "nm2.h"
 #include "os_time.h"
+#include "ovsdb_sync.h"
 #include "ovsdb_table.h"
 
 #define MODULE_ID LOG_MODULE_ID_ARES
 
+#if !defined(CONFIG_MANAGER_NM_FQDN_INFLIGHT_MAX)
+#define CONFIG_MANAGER_NM_FQDN_INFLIGHT_MAX 32
+#endif
+
 static ovsdb_table_t table_FQDN_Resolve;
 static ovsdb_table_t table_Openflow_Tag;
 static ovsdb_table_t table_Openflow_Local_Tag;
@@ -49,6 +55,8 @@ static struct evx_ares g_ares;
 #define NM2_FQDN_DELAY_NOW 0
 #define NM2_FQDN_DELAY_BUSY 5
 #define NM2_FQDN_DELAY_TTL_MIN 60
+// collect tag updates of a refresh cycle before writing them to ovsdb
+#define NM2_FQDN_TAG_FLUSH_DELAY 0.2
 
 // exponential retry delay on error
 // 15 sec, 1 minute, 4 min, 15 min, 1 hour
@@ -56,6 +64,7 @@ static const int nm2_fqdn_delay_table[] = {15, 60, 4 * 60, 15 * 60, 60 * 60};
 static const int nm2_fqdn_delay_table_len = ARRAY_LEN(nm2_fqdn_delay_table);
 
 static ev_timer g_nm2_fqdn_resolve_timer;
+static ev_timer g_nm2_fqdn_tag_timer;
 
 typedef enum fqdn_entry_state
 {
@@ -75,6 +84,7 @@ struct fqdn_entry_af  // address family
     char *tag;
     char (*result)[INET6_ADDRSTRLEN];
     int num_result;
+    bool dirty;  // the last tag write failed, rewrite even if results match
 };
 
 struct fqdn_entry
@@ -94,11 +104,30 @@ struct fqdn_entry
     time_t retry_at_mono;
     int retry_count;
     int ttl;
+    int heap_idx;  // position in g_fqdn_heap, -1 if not scheduled
     struct evx_ares *e_ares;
 };
 
+// pending Openflow_Tag / Openflow_Local_Tag update
+typedef struct fqdn_tag_update
+{
+    ds_tree_node_t node;
+    char *key;  // "@tag" or "*tag"
+    ovsdb_table_t *table;
+    json_t *row;
+} fqdn_tag_update_t;
+
 ds_tree_t g_fqdn_list = DS_TREE_INIT(ds_str_cmp, fqdn_entry_t, node);
 ds_tree_t g_fqdn_discard = DS_TREE_INIT(ds_str_cmp, fqdn_entry_t, node);
+ds_tree_t g_fqdn_tag_pending = DS_TREE_INIT(ds_str_cmp, fqdn_tag_update_t, node);
+
+// min-heap of scheduled entries ordered by retry_at_mono
+static fqdn_entry_t **g_fqdn_heap;
+static int g_fqdn_heap_len;
+static int g_fqdn_heap_size;
+
+// number of outstanding ares queries
+static int g_fqdn_inflight;
 
 void callback_FQDN_Resolve(
         ovsdb_update_monitor_t *mon,
@@ -106,6 +135,7 @@ void callback_FQDN_Resolve(
         struct schema_FQDN_Resolve *new);
 
 void nm2_fqdn_schedule_update(double delay);
+static void nm2_fqdn_tag_write_failed(fqdn_tag_update_t *u);
 
 // address family to IPvN str
 static char *af_ip_str(int af)
@@ -157,6 +187,7 @@ fqdn_entry_t *nm2_fqdn_entry_new(struct schema_FQDN_Resolve *rec)
     ds_tree_insert(&g_fqdn_list, e, e->key);
     e->ipv4.af_type = AF_INET;
     e->ipv6.af_type = AF_INET6;
+    e->heap_idx = -1;
     if (rec->interval_exists)
     {
         // interval defined: override ttl value,
@@ -200,6 +231,88 @@ void nm2_fqdn_entry_free(fqdn_entry_t *e)
     free(e);
 }
 
+/*
+ * Min-heap of scheduled entries keyed by retry_at_mono, the top entry
+ * is the next one due for a (re)resolve.
+ */
+static void nm2_fqdn_heap_swap(int a, int b)
+{
+    fqdn_entry_t *tmp = g_fqdn_heap[a];
+    g_fqdn_heap[a] = g_fqdn_heap[b];
+    g_fqdn_heap[b] = tmp;
+    g_fqdn_heap[a]->heap_idx = a;
+    g_fqdn_heap[b]->heap_idx = b;
+}
+
+static void nm2_fqdn_heap_up(int i)
+{
+    while (i > 0)
+    {
+        int parent = (i - 1) / 2;
+        if (g_fqdn_heap[parent]->retry_at_mono <= g_fqdn_heap[i]->retry_at_mono) break;
+        nm2_fqdn_heap_swap(i, parent);
+        i = parent;
+    }
+}
+
+static void nm2_fqdn_heap_down(int i)
+{
+    while (true)
+    {
+        int min = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < g_fqdn_heap_len && g_fqdn_heap[left]->retry_at_mono < g_fqdn_heap[min]->retry_at_mono)
+        {
+            min = left;
+        }
+        if (right < g_fqdn_heap_len && g_fqdn_heap[right]->retry_at_mono < g_fqdn_heap[min]->retry_at_mono)
+        {
+            min = right;
+        }
+        if (min == i) break;
+        nm2_fqdn_heap_swap(i, min);
+        i = min;
+    }
+}
+
+// insert entry or move it to the position matching its retry_at_mono
+void nm2_fqdn_heap_set(fqdn_entry_t *e)
+{
+    if (e->heap_idx < 0)
+    {
+        if (g_fqdn_heap_len >= g_fqdn_heap_size)
+        {
+            g_fqdn_heap_size = g_fqdn_heap_size ? g_fqdn_heap_size * 2 : 16;
+            g_fqdn_heap = REALLOC(g_fqdn_heap, g_fqdn_heap_size * sizeof(g_fqdn_heap[0]));
+        }
+        e->heap_idx = g_fqdn_heap_len++;
+        g_fqdn_heap[e->heap_idx] = e;
+    }
+    nm2_fqdn_heap_up(e->heap_idx);
+    nm2_fqdn_heap_down(e->heap_idx);
+}
+
+void nm2_fqdn_heap_remove(fqdn_entry_t *e)
+{
+    fqdn_entry_t *last;
+    int i = e->heap_idx;
+    if (i < 0) return;
+    e->heap_idx = -1;
+    last = g_fqdn_heap[--g_fqdn_heap_len];
+    if (last == e) return;
+    g_fqdn_heap[i] = last;
+    last->heap_idx = i;
+    nm2_fqdn_heap_up(i);
+    nm2_fqdn_heap_down(last->heap_idx);
+}
+
+fqdn_entry_t *nm2_fqdn_heap_top(void)
+{
+    if (g_fqdn_heap_len == 0) return NULL;
+    return g_fqdn_heap[0];
+}
+
 fqdn_entry_t *nm2_fqdn_entry_find(struct schema_FQDN_Resolve *rec)
 {
     char *key = nm2_fqdn_entry_key(rec);
@@ -212,6 +325,7 @@ void nm2_fqdn_entry_discard(fqdn_entry_t *e)
 {
     if (!e) return;
     if (e->discarded) return;
+    nm2_fqdn_heap_remove(e);
     ds_tree_remove(&g_fqdn_list, e);
     ds_tree_insert(&g_fqdn_discard, e, e->key);
     e->discarded = true;
@@ -315,9 +429,171 @@ void nm2_fqdn_get_addrinfo_results(
     *ttl = minttl;
 }
 
+static void nm2_fqdn_tag_update_free(fqdn_tag_update_t *u)
+{
+    json_decref(u->row);
+    free(u->key);
+    free(u);
+}
+
+// single tag upsert, used when the batched transaction fails
+static bool nm2_fqdn_tag_upsert(fqdn_tag_update_t *u)
+{
+    json_t *where = ovsdb_where_simple("name", u->key + 1);
+    bool ret = ovsdb_sync_upsert_where(u->table->table_name, where, json_incref(u->row), NULL);
+    if (!ret)
+    {
+        LOGE("fqdn tag %s '%s' upsert failed", u->table->table_name, u->key + 1);
+    }
+    return ret;
+}
+
+// check that the transaction result is complete and has no errors
+static bool nm2_fqdn_tag_result_ok(json_t *tran, json_t *result)
+{
+    json_t *jres;
+    size_t ii;
+    if (!json_is_array(result)) return false;
+    // first element of the transaction is the database name
+    if (json_array_size(result) < json_array_size(tran) - 1) return false;
+    json_array_foreach (result, ii, jres)
+    {
+        if (json_object_get(jres, "error") != NULL)
+        {
+            LOGW("fqdn tag transaction error: %s", json_dumps_static(jres, 0));
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Write all pending tag updates collected during a refresh cycle with a
+ * single transaction of update operations. Tags that do not exist yet
+ * (update count 0) are then created with a single insert transaction.
+ * Tags that could not be written are reported to the entries using them.
+ */
+void nm2_fqdn_tag_flush(void)
+{
+    fqdn_tag_update_t *u;
+    fqdn_tag_update_t *tmp;
+    fqdn_tag_update_t **ops;
+    json_t *tran = NULL;
+    json_t *ins = NULL;
+    json_t *result;
+    json_t *jres;
+    const char *op;
+    size_t num_ops = 0;
+    int num_ins = 0;
+    size_t iu = 0;
+    size_t ii;
+
+    ev_timer_stop(EV_DEFAULT, &g_nm2_fqdn_tag_timer);
+    if (ds_tree_is_empty(&g_fqdn_tag_pending)) return;
+
+    ds_tree_foreach (&g_fqdn_tag_pending, u)
+    {
+        num_ops++;
+    }
+    ops = CALLOC(num_ops, sizeof(ops[0]));
+    ds_tree_foreach (&g_fqdn_tag_pending, u)
+    {
+        ops[iu++] = u;
+        tran = ovsdb_tran_multi(
+                tran,
+                NULL,
+                u->table->table_name,
+                OTR_UPDATE,
+                ovsdb_where_simple("name", u->key + 1),
+                json_incref(u->row));
+    }
+    // ovsdb_method_send_s() steals the reference, keep the transaction
+    // to match results to operations as comments may be interleaved
+    result = ovsdb_method_send_s(MT_TRANS, json_incref(tran));
+    if (!nm2_fqdn_tag_result_ok(tran, result))
+    {
+        // the transaction is atomic, nothing was written: fall back to
+        // one upsert per tag
+        LOGW("fqdn tag batch update failed, upsert %zu tags", num_ops);
+        for (iu = 0; iu < num_ops; iu++)
+        {
+            if (!nm2_fqdn_tag_upsert(ops[iu])) nm2_fqdn_tag_write_failed(ops[iu]);
+        }
+        goto out;
+    }
+    iu = 0;
+    json_array_foreach (result, ii, jres)
+    {
+        op = json_string_value(json_object_get(json_array_get(tran, ii + 1), "op"));
+        if (op == NULL || strcmp(op, "update") != 0) continue;
+        if (iu >= num_ops) break;
+        u = ops[iu++];
+        if (json_integer_value(json_object_get(jres, "count")) != 0) continue;
+        // tag does not exist, insert it
+        ins = ovsdb_tran_multi(ins, NULL, u->table->table_name, OTR_INSERT, NULL, json_incref(u->row));
+        // keep the inserted ones first to report a failure
+        ops[num_ins++] = u;
+    }
+    if (ins != NULL)
+    {
+        json_t *ins_result = ovsdb_method_send_s(MT_TRANS, json_incref(ins));
+        if (!nm2_fqdn_tag_result_ok(ins, ins_result))
+        {
+            LOGE("fqdn tag batch insert of %d tags failed", num_ins);
+            for (ii = 0; ii < (size_t)num_ins; ii++)
+            {
+                nm2_fqdn_tag_write_failed(ops[ii]);
+            }
+        }
+        json_decref(ins_result);
+        json_decref(ins);
+    }
+    LOGD("fqdn tags updated: %zu inserted: %d", num_ops - num_ins, num_ins);
+
+out:
+    json_decref(result);
+    json_decref(tran);
+    free(ops);
+    ds_tree_foreach_safe (&g_fqdn_tag_pending, u, tmp)
+    {
+        ds_tree_remove(&g_fqdn_tag_pending, u);
+        nm2_fqdn_tag_update_free(u);
+    }
+}
+
+void nm2_fqdn_tag_timer_cb(struct ev_loop *loop, ev_timer *t, int revents)
+{
+    nm2_fqdn_tag_flush();
+}
+
+// queue tag row, a newer result for the same tag replaces the pending one
+bool nm2_fqdn_tag_queue(ovsdb_table_t *table, const char *key, void *record)
+{
+    fqdn_tag_update_t *u;
+    json_t *row = ovsdb_table_to_json(table, record);
+    if (row == NULL) return false;
+    u = ds_tree_find(&g_fqdn_tag_pending, key);
+    if (u == NULL)
+    {
+        u = CALLOC(1, sizeof(*u));
+        u->key = STRDUP(key);
+        u->table = table;
+        ds_tree_insert(&g_fqdn_tag_pending, u, u->key);
+    }
+    json_decref(u->row);
+    u->row = row;
+    if (!ev_is_active(&g_nm2_fqdn_tag_timer))
+    {
+        ev_timer_init(&g_nm2_fqdn_tag_timer, nm2_fqdn_tag_timer_cb, NM2_FQDN_TAG_FLUSH_DELAY, 0);
+        ev_timer_start(EV_DEFAULT, &g_nm2_fqdn_tag_timer);
+    }
+    return true;
+}
+
 bool nm2_fqdn_update_ovsdb_openflow_tag(char *tag, char ips[][INET6_ADDRSTRLEN], int num)
 {
     struct schema_Openflow_Tag s;
+    char key[sizeof(s.name) + 1];
     int i;
     if (!*tag)
     {
@@ -335,12 +611,14 @@ bool nm2_fqdn_update_ovsdb_openflow_tag(char *tag, char ips[][INET6_ADDRSTRLEN],
     // if there are no ip entries (num_ips == 0)
     s.device_value_present = true;
     // upsert: insert if tag name does not exist
-    return ovsdb_table_upsert(&table_Openflow_Tag, &s, false);
+    snprintf(key, sizeof(key), "@%s", s.name);
+    return nm2_fqdn_tag_queue(&table_Openflow_Tag, key, &s);
 }
 
 bool nm2_fqdn_update_ovsdb_openflow_local_tag(char *tag, char ips[][INET6_ADDRSTRLEN], int num)
 {
     struct schema_Openflow_Local_Tag s;
+    char key[sizeof(s.name) + 1];
     int i;
     if (!*tag)
     {
@@ -358,7 +636,8 @@ bool nm2_fqdn_update_ovsdb_openflow_local_tag(char *tag, char ips[][INET6_ADDRST
     // if there are no ip entries (num_ips == 0)
     s.values_present = true;
     // upsert: insert if tag name does not exist
-    return ovsdb_table_upsert(&table_Openflow_Local_Tag, &s, false);
+    snprintf(key, sizeof(key), "*%s", s.name);
+    return nm2_fqdn_tag_queue(&table_Openflow_Local_Tag, key, &s);
 }
 
 char *nm2_fqdn_get_tag_and_type(char *tag, bool *local_tag)
@@ -383,7 +662,7 @@ bool nm2_fqdn_update_ovsdb_tag(fqdn_entry_t *e, fqdn_entry_af_t *af, char ips[][
     bool local_tag;
     char *tag = nm2_fqdn_get_tag_and_type(af->tag, &local_tag);
     // compare results, if they are equal, skip ovsdb update
-    if (nm2_fqdn_entry_compare_results(af, ips, num_ips))
+    if (!af->dirty && nm2_fqdn_entry_compare_results(af, ips, num_ips))
     {
         LOGT("fqdn %s '%s' '%s' same results [%d], skip ovsdb update",
              af_ip_str(af->af_type),
@@ -394,6 +673,7 @@ bool nm2_fqdn_update_ovsdb_tag(fqdn_entry_t *e, fqdn_entry_af_t *af, char ips[][
     }
     // else, store new results
     nm2_fqdn_entry_set_results(af, ips, num_ips);
+    af->dirty = false;
     // update ovsdb
     if (local_tag)
     {
@@ -405,17 +685,34 @@ bool nm2_fqdn_update_ovsdb_tag(fqdn_entry_t *e, fqdn_entry_af_t *af, char ips[][
     }
 }
 
+// schedule entry resolve after delay seconds, delay < 0 unschedules it
+void nm2_fqdn_schedule_entry_delay(fqdn_entry_t *e, double delay)
+{
+    if (delay < 0)
+    {
+        e->retry_at_mono = 0;
+        nm2_fqdn_heap_remove(e);
+        return;
+    }
+    e->retry_at_mono = time_monotonic() + delay;
+    nm2_fqdn_heap_set(e);
+    nm2_fqdn_schedule_update(delay);
+}
+
 void nm2_fqdn_schedule_entry(fqdn_entry_t *e)
 {
     double delay = -1;
     int i;
     if (e->discarded)
     {
+        // discarded entries are deleted by nm2_fqdn_update_all()
+        nm2_fqdn_heap_remove(e);
+        e->retry_at_mono = 0;
         if (!e->busy)
         {
-            delay = NM2_FQDN_DELAY_NOW;
+            nm2_fqdn_schedule_update(NM2_FQDN_DELAY_NOW);
         }
-        goto update_timer;
+        return;
     }
     switch (e->state)
     {
@@ -437,6 +734,8 @@ void nm2_fqdn_schedule_entry(fqdn_entry_t *e)
             {
                 delay = e->ttl;
             }
+            // interval 0 or an ip address (ttl 0): no refresh
+            if (delay == 0) delay = -1;
             break;
         case FQDN_ENTRY_ERROR:
             // on error retry with exponentially increasing delay
@@ -446,15 +745,41 @@ void nm2_fqdn_schedule_entry(fqdn_entry_t *e)
             delay = nm2_fqdn_delay_table[i];
             break;
     }
-update_timer:
-    if (delay >= 0)
-    {
-        nm2_fqdn_schedule_update(delay);
-        e->retry_at_mono = time_monotonic() + delay;
-    }
-    else
+    nm2_fqdn_schedule_entry_delay(e, delay);
+}
+
+// mark the entry tag dirty if it is written by the tag update key
+static bool nm2_fqdn_af_tag_failed(fqdn_entry_af_t *af, const char *key)
+{
+    char af_key[C_FIELD_SZ(struct schema_Openflow_Tag, name) + 1];
+    bool local_tag;
+    char *tag;
+    if (!*af->tag) return false;
+    tag = nm2_fqdn_get_tag_and_type(af->tag, &local_tag);
+    snprintf(af_key, sizeof(af_key), "%c%s", local_tag ? '*' : '@', tag);
+    if (strcmp(af_key, key) != 0) return false;
+    af->dirty = true;
+    return true;
+}
+
+/*
+ * A tag write failed: the entries using the tag retry like after a resolve
+ * error and rewrite the tag even if the results did not change. Entries
+ * being resolved are rescheduled by their callback.
+ */
+static void nm2_fqdn_tag_write_failed(fqdn_tag_update_t *u)
+{
+    fqdn_entry_t *e;
+    bool failed;
+    ds_tree_foreach (&g_fqdn_list, e)
     {
-        e->retry_at_mono = 0;
+        failed = nm2_fqdn_af_tag_failed(&e->ipv4, u->key);
+        failed |= nm2_fqdn_af_tag_failed(&e->ipv6, u->key);
+        if (!failed || e->busy) continue;
+        LOGD("fqdn '%s' tag %s write failed, retry", e->fqdn, u->key);
+        e->state = FQDN_ENTRY_ERROR;
+        e->retry_count++;
+        nm2_fqdn_schedule_entry(e);
     }
 }
 
@@ -503,13 +828,23 @@ void nm2_fqdn_ares_addrinfo_cb(void *arg, int status, int timeouts, struct ares_
     if (min_ttl < NM2_FQDN_DELAY_TTL_MIN) min_ttl = NM2_FQDN_DELAY_TTL_MIN;
     e->ttl = min_ttl;
 out:
-    e->busy = false;
+    if (e->busy)
+    {
+        e->busy = false;
+        g_fqdn_inflight--;
+    }
     nm2_fqdn_schedule_entry(e);
+    // a slot in the in-flight window is free, resolve entries
+    // that became due while the window was full
+    if (nm2_fqdn_heap_top() && nm2_fqdn_heap_top()->retry_at_mono <= time_monotonic())
+    {
+        nm2_fqdn_schedule_update(NM2_FQDN_DELAY_NOW);
+    }
 ares_free:
     if (result) ares_freeaddrinfo(result);
 }
 
-bool nm2_fqdn_check_ip_address(fqdn_entry_t *e, double *delay)
+bool nm2_fqdn_check_ip_address(fqdn_entry_t *e)
 {
     osn_ip_addr_t ip_addr;
     osn_ip6_addr_t ip6_addr;
@@ -554,9 +889,10 @@ bool nm2_fqdn_check_ip_address(fqdn_entry_t *e, double *delay)
     return true;
 }
 
-bool nm2_fqdn_update_active_entry(fqdn_entry_t *e, double *delay)
+// resolve a due entry, returns false if ares is busy and the entry
+// needs to be retried later
+bool nm2_fqdn_update_active_entry(fqdn_entry_t *e)
 {
-    time_t time_mono = time_monotonic();
     if (!*e->ipv4.tag && !*e->ipv6.tag)
     {
         // no tag specified, nothing needs to be done.
@@ -567,6 +903,10 @@ bool nm2_fqdn_update_active_entry(fqdn_entry_t *e, double *delay)
     {
         case FQDN_ENTRY_INIT:
             // initial state, go to resolve
+        case FQDN_ENTRY_SUCCESS:
+            // refresh after interval or ttl
+        case FQDN_ENTRY_ERROR:
+            // retry after error
             goto L_resolve;
         case FQDN_ENTRY_NOP:
             // no tag provided, nothing to do
@@ -574,51 +914,27 @@ bool nm2_fqdn_update_active_entry(fqdn_entry_t *e, double *delay)
         case FQDN_ENTRY_PROGRESS:
             // resolution in progress, wait for results
             return true;
-        case FQDN_ENTRY_SUCCESS:
-            // resolve successful
-            // if interval is 0 nothing else to do
-            // otherwise check schedule for refresh
-            if (e->interval == 0) return true;
-            goto L_check_schedule;
-        case FQDN_ENTRY_ERROR:
-            // resolve error, check schedule for retry
-            goto L_check_schedule;
         default:
             LOGW("%s unexpeted state %d '%s'", __func__, e->state, e->fqdn);
     }
     return true;
 
-L_check_schedule:
-    if (e->retry_at_mono == 0)
-    {
-        // no interval scheduled
-        return true;
-    }
-    if (e->retry_at_mono > time_mono)
-    {
-        // reschedule
-        *delay = e->retry_at_mono - time_mono;
-        return true;
-    }
-    // time is up, follow through to ares resolve
-
 L_resolve:
     // check if name is already an IP address
-    if (nm2_fqdn_check_ip_address(e, delay))
+    if (nm2_fqdn_check_ip_address(e))
     {
         return true;
     }
     // not an IP address, resolve name using ares.
     if (!nm2_fqdn_start_ares_check_busy(e))
     {
-        // if ares is busy reschedule for later
-        *delay = NM2_FQDN_DELAY_BUSY;
-        e->retry_at_mono = time_mono + *delay;
         return false;
     }
+    // the callback can be invoked before ares_getaddrinfo() returns
     e->state = FQDN_ENTRY_PROGRESS;
     e->busy = true;
     e->retry_at_mono = 0;
+    g_fqdn_inflight++;
 
     // ares_addrinfo_hints:
     //  AF_UNSPEC       means return both AF_INET and AF_INET6.
@@ -656,17 +972,31 @@ void nm2_fqdn_update_all()
 {
     fqdn_entry_t *e;
     fqdn_entry_t *tmp;
+    time_t time_mono = time_monotonic();
     double delay = 0;
     double min_delay = -1;
 
-    // update active entries
-    ds_tree_foreach (&g_fqdn_list, e)
+    // resolve due entries, bounded by the in-flight window
+    while ((e = nm2_fqdn_heap_top()) != NULL)
     {
-        delay = -1;
-        nm2_fqdn_update_active_entry(e, &delay);
-        if (delay >= 0)
+        if (e->retry_at_mono > time_mono)
         {
-            if (min_delay < 0 || delay < min_delay) min_delay = delay;
+            min_delay = e->retry_at_mono - time_mono;
+            break;
+        }
+        if (g_fqdn_inflight >= CONFIG_MANAGER_NM_FQDN_INFLIGHT_MAX)
+        {
+            // window full, the completion callbacks restart the timer
+            LOGD("fqdn in-flight window full: %d pending: %d", g_fqdn_inflight, g_fqdn_heap_len);
+            break;
+        }
+        nm2_fqdn_heap_remove(e);
+        e->retry_at_mono = 0;
+        if (!nm2_fqdn_update_active_entry(e))
+        {
+            // if ares is busy reschedule for later
+            e->retry_at_mono = time_mono + NM2_FQDN_DELAY_BUSY;
+            nm2_fqdn_heap_set(e);
         }
     }
     // remove discarded if not busy
@@ -760,7 +1090,7 @@ void nm2_fqdn_resolve_new(struct schema_FQDN_Resolve *rec)
     }
     LOGD("FQDN_Resolve new: %s, %s, %s, %s", rec->fqdn, rec->ipv4_tag, rec->ipv6_tag, rec->server);
 
-    nm2_fqdn_schedule_update(NM2_FQDN_DELAY_NOW);
+    nm2_fqdn_schedule_entry(p);
 }
 
 void nm2_fqdn_resolve_delete(struct schema_FQDN_Resolve *rec)
@@ -846,6 +1176,11 @@ bool nm2_fqdn_resolve_init(void)
 bool nm2_fqdn_resolve_stop(void)
 {
     evx_stop_ares(&g_ares);
+    nm2_fqdn_tag_flush();
+    free(g_fqdn_heap);
+    g_fqdn_heap = NULL;
+    g_fqdn_heap_len = 0;
+    g_fqdn_heap_size = 0;
     return true;
 }
 
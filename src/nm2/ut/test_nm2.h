@@ -44,4 +44,9 @@ void test_bridge_port_first(void);
 void test_bridge_port_second(void);
 void test_interface_table(void);
 void test_wifi_inet_table(void);
+
+void test_fqdn_heap_order(void);
+void test_fqdn_inflight_window(void);
+void test_fqdn_tag_batch_flush(void);
+void test_fqdn_tag_write_failed(void);
 #endif
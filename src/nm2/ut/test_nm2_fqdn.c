@@ -0,0 +1,298 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "os_types.h"
+#include "kconfig.h"
+#include "target.h"
+#include "unity.h"
+#include "log.h"
+#include "unit_test_utils.h"
+
+#ifdef CONFIG_LIBEVX_USE_CARES
+
+// Include the file to be unit tested
+#include "nm2_fqdn.c"
+
+#define LINE_BUFF_LEN           (256)
+#define FQDN_UT_NUM_ENTRIES     (40)
+#define FQDN_UT_OLD_TAG         "fqdn_ut_old"
+#define FQDN_UT_NEW_TAG         "fqdn_ut_new"
+
+static fqdn_entry_t *fqdn_ut_entry_new(const char *fqdn, const char *ipv4_tag, const char *ipv6_tag)
+{
+    struct schema_FQDN_Resolve rec;
+
+    MEMZERO(rec);
+    STRSCPY(rec.fqdn, fqdn);
+    STRSCPY(rec.ipv4_tag, ipv4_tag);
+    STRSCPY(rec.ipv6_tag, ipv6_tag);
+    return nm2_fqdn_entry_new(&rec);
+}
+
+// the tag tables are normally set up by nm2_fqdn_resolve_init()
+static void fqdn_ut_tables_init(void)
+{
+    OVSDB_TABLE_INIT(Openflow_Tag, name);
+    OVSDB_TABLE_INIT(Openflow_Local_Tag, name);
+}
+
+// release the entries and the pending tag updates without writing them
+static void fqdn_ut_cleanup(void)
+{
+    fqdn_tag_update_t *u;
+    fqdn_tag_update_t *utmp;
+    fqdn_entry_t *e;
+    fqdn_entry_t *tmp;
+
+    ev_timer_stop(EV_DEFAULT, &g_nm2_fqdn_tag_timer);
+    ev_timer_stop(EV_DEFAULT, &g_nm2_fqdn_resolve_timer);
+    ds_tree_foreach_safe (&g_fqdn_tag_pending, u, utmp)
+    {
+        ds_tree_remove(&g_fqdn_tag_pending, u);
+        nm2_fqdn_tag_update_free(u);
+    }
+    ds_tree_foreach_safe (&g_fqdn_list, e, tmp)
+    {
+        nm2_fqdn_heap_remove(e);
+        ds_tree_remove(&g_fqdn_list, e);
+        nm2_fqdn_entry_free(e);
+    }
+    g_fqdn_inflight = 0;
+}
+
+static void fqdn_ut_ovsh(const char *cmd)
+{
+    FILE *fp = popen(cmd, "r");
+    if (fp == NULL)
+    {
+        LOGE("popen error");
+        return;
+    }
+    pclose(fp);
+}
+
+static int fqdn_ut_ovsh_tag_has(const char *table, const char *tag, const char *column, const char *value)
+{
+    char cmd[LINE_BUFF_LEN];
+    char buf[LINE_BUFF_LEN] = {0};
+    FILE *fp;
+    int ret = -1;
+
+    snprintf(cmd, sizeof(cmd), "ovsh s %s -w name==%s -c %s | grep %s", table, tag, column, column);
+    fp = popen(cmd, "r");
+    if (fp == NULL) return -1;
+    if (fgets(buf, sizeof(buf), fp) != NULL && strstr(buf, value) != NULL) ret = 0;
+    pclose(fp);
+    return ret;
+}
+
+/*
+ * Entries come out of the heap by increasing retry time, including after
+ * removals from the middle and rescheduling.
+ */
+void test_fqdn_heap_order(void)
+{
+    fqdn_entry_t *entries[FQDN_UT_NUM_ENTRIES];
+    fqdn_entry_t *e;
+    time_t last;
+    char name[32];
+    int num;
+    int i;
+
+    for (i = 0; i < FQDN_UT_NUM_ENTRIES; i++)
+    {
+        snprintf(name, sizeof(name), "host%d.example.com", i);
+        entries[i] = fqdn_ut_entry_new(name, "v4", "");
+        // pseudo random order with duplicates
+        entries[i]->retry_at_mono = 1000 + (i * 7919) % 23;
+        nm2_fqdn_heap_set(entries[i]);
+    }
+    TEST_ASSERT_EQUAL_INT(FQDN_UT_NUM_ENTRIES, g_fqdn_heap_len);
+
+    // remove a few from the middle of the heap
+    for (i = 0; i < FQDN_UT_NUM_ENTRIES; i += 5)
+    {
+        nm2_fqdn_heap_remove(entries[i]);
+        TEST_ASSERT_EQUAL_INT(-1, entries[i]->heap_idx);
+    }
+    // an entry becoming due earlier moves to the top
+    entries[3]->retry_at_mono = 10;
+    nm2_fqdn_heap_set(entries[3]);
+    TEST_ASSERT_EQUAL_PTR(entries[3], nm2_fqdn_heap_top());
+    // and back down when it is postponed
+    entries[3]->retry_at_mono = 5000;
+    nm2_fqdn_heap_set(entries[3]);
+
+    last = 0;
+    num = 0;
+    while ((e = nm2_fqdn_heap_top()) != NULL)
+    {
+        TEST_ASSERT_TRUE(e->retry_at_mono >= last);
+        TEST_ASSERT_EQUAL_INT(0, e->heap_idx);
+        last = e->retry_at_mono;
+        nm2_fqdn_heap_remove(e);
+        num++;
+    }
+    TEST_ASSERT_EQUAL_INT(FQDN_UT_NUM_ENTRIES - FQDN_UT_NUM_ENTRIES / 5, num);
+    TEST_ASSERT_EQUAL_INT(5000, last);
+
+    fqdn_ut_cleanup();
+}
+
+/*
+ * Due entries wait while CONFIG_MANAGER_NM_FQDN_INFLIGHT_MAX queries are
+ * outstanding, a completion frees a slot and restarts the resolve.
+ */
+void test_fqdn_inflight_window(void)
+{
+    fqdn_entry_t *entries[4];
+    fqdn_entry_t *busy;
+    time_t now = time_monotonic();
+    char name[32];
+    int i;
+
+    fqdn_ut_tables_init();
+    // ip address entries are resolved without ares
+    for (i = 0; i < ARRAY_LEN(entries); i++)
+    {
+        snprintf(name, sizeof(name), "192.0.2.%d", i + 1);
+        entries[i] = fqdn_ut_entry_new(name, "v4", "");
+        entries[i]->retry_at_mono = now - 1;
+        nm2_fqdn_heap_set(entries[i]);
+    }
+    busy = fqdn_ut_entry_new("busy.example.com", "v4", "");
+    busy->state = FQDN_ENTRY_PROGRESS;
+    busy->busy = true;
+    g_fqdn_inflight = CONFIG_MANAGER_NM_FQDN_INFLIGHT_MAX;
+
+    // window full: nothing is started
+    nm2_fqdn_update_all();
+    TEST_ASSERT_EQUAL_INT(ARRAY_LEN(entries), g_fqdn_heap_len);
+    for (i = 0; i < ARRAY_LEN(entries); i++)
+    {
+        TEST_ASSERT_EQUAL_INT(FQDN_ENTRY_INIT, entries[i]->state);
+    }
+
+    // a failed query completes: its slot is freed, the entry retries
+    // later and the due entries are resolved right away
+    ev_timer_stop(EV_DEFAULT, &g_nm2_fqdn_resolve_timer);
+    nm2_fqdn_ares_addrinfo_cb(busy, ARES_ENOTFOUND, 0, NULL);
+    TEST_ASSERT_EQUAL_INT(CONFIG_MANAGER_NM_FQDN_INFLIGHT_MAX - 1, g_fqdn_inflight);
+    TEST_ASSERT_FALSE(busy->busy);
+    TEST_ASSERT_EQUAL_INT(FQDN_ENTRY_ERROR, busy->state);
+    TEST_ASSERT_TRUE(busy->retry_at_mono >= now + nm2_fqdn_delay_table[0]);
+    TEST_ASSERT_TRUE(ev_is_active(&g_nm2_fqdn_resolve_timer));
+    TEST_ASSERT_TRUE(ev_timer_remaining(EV_DEFAULT, &g_nm2_fqdn_resolve_timer) <= 0.0);
+
+    nm2_fqdn_update_all();
+    for (i = 0; i < ARRAY_LEN(entries); i++)
+    {
+        TEST_ASSERT_EQUAL_INT(FQDN_ENTRY_SUCCESS, entries[i]->state);
+        TEST_ASSERT_EQUAL_INT(-1, entries[i]->heap_idx);
+        TEST_ASSERT_EQUAL_INT(1, entries[i]->ipv4.num_result);
+    }
+    // only the failed entry is left, waiting for its retry
+    TEST_ASSERT_EQUAL_INT(1, g_fqdn_heap_len);
+    TEST_ASSERT_EQUAL_PTR(busy, nm2_fqdn_heap_top());
+    TEST_ASSERT_EQUAL_INT(CONFIG_MANAGER_NM_FQDN_INFLIGHT_MAX - 1, g_fqdn_inflight);
+
+    fqdn_ut_cleanup();
+}
+
+/*
+ * One update transaction writes the existing tag, the missing one is then
+ * inserted by the second transaction.
+ */
+void test_fqdn_tag_batch_flush(void)
+{
+    char ips[2][INET6_ADDRSTRLEN] = {"192.0.2.1", "192.0.2.2"};
+
+    fqdn_ut_tables_init();
+    fqdn_ut_ovsh("ovsh d Openflow_Tag -w name==" FQDN_UT_OLD_TAG);
+    fqdn_ut_ovsh("ovsh d Openflow_Local_Tag -w name==" FQDN_UT_NEW_TAG);
+    fqdn_ut_ovsh("ovsh i Openflow_Tag name:=" FQDN_UT_OLD_TAG);
+
+    TEST_ASSERT_TRUE(nm2_fqdn_update_ovsdb_openflow_tag(FQDN_UT_OLD_TAG, ips, 1));
+    TEST_ASSERT_TRUE(nm2_fqdn_update_ovsdb_openflow_local_tag(FQDN_UT_NEW_TAG, ips, 1));
+    // a newer result replaces the pending one
+    TEST_ASSERT_TRUE(nm2_fqdn_update_ovsdb_openflow_local_tag(FQDN_UT_NEW_TAG, &ips[1], 1));
+    TEST_ASSERT_TRUE(ev_is_active(&g_nm2_fqdn_tag_timer));
+
+    nm2_fqdn_tag_flush();
+    TEST_ASSERT_TRUE(ds_tree_is_empty(&g_fqdn_tag_pending));
+    TEST_ASSERT_FALSE(ev_is_active(&g_nm2_fqdn_tag_timer));
+    TEST_ASSERT_EQUAL_INT(0, fqdn_ut_ovsh_tag_has("Openflow_Tag", FQDN_UT_OLD_TAG, "device_value", ips[0]));
+    TEST_ASSERT_EQUAL_INT(0, fqdn_ut_ovsh_tag_has("Openflow_Local_Tag", FQDN_UT_NEW_TAG, "values", ips[1]));
+
+    fqdn_ut_ovsh("ovsh d Openflow_Tag -w name==" FQDN_UT_OLD_TAG);
+    fqdn_ut_ovsh("ovsh d Openflow_Local_Tag -w name==" FQDN_UT_NEW_TAG);
+    fqdn_ut_cleanup();
+}
+
+/*
+ * A tag that could not be written is rewritten by the entries using it,
+ * even though their results did not change.
+ */
+void test_fqdn_tag_write_failed(void)
+{
+    fqdn_tag_update_t *u;
+    fqdn_entry_t *e;
+    fqdn_entry_t *other;
+
+    fqdn_ut_tables_init();
+    e = fqdn_ut_entry_new("192.0.2.1", "*" FQDN_UT_NEW_TAG, "");
+    other = fqdn_ut_entry_new("192.0.2.2", FQDN_UT_OLD_TAG, "");
+    TEST_ASSERT_TRUE(nm2_fqdn_update_active_entry(e));
+    TEST_ASSERT_TRUE(nm2_fqdn_update_active_entry(other));
+    TEST_ASSERT_EQUAL_INT(FQDN_ENTRY_SUCCESS, e->state);
+
+    u = ds_tree_find(&g_fqdn_tag_pending, "*" FQDN_UT_NEW_TAG);
+    TEST_ASSERT_NOT_NULL(u);
+    nm2_fqdn_tag_write_failed(u);
+    TEST_ASSERT_TRUE(e->ipv4.dirty);
+    TEST_ASSERT_EQUAL_INT(FQDN_ENTRY_ERROR, e->state);
+    TEST_ASSERT_TRUE(e->heap_idx >= 0);
+    TEST_ASSERT_FALSE(other->ipv4.dirty);
+    TEST_ASSERT_EQUAL_INT(-1, other->heap_idx);
+
+    // the retry queues the same results again
+    ds_tree_remove(&g_fqdn_tag_pending, u);
+    nm2_fqdn_tag_update_free(u);
+    nm2_fqdn_heap_remove(e);
+    TEST_ASSERT_TRUE(nm2_fqdn_update_active_entry(e));
+    TEST_ASSERT_NOT_NULL(ds_tree_find(&g_fqdn_tag_pending, "*" FQDN_UT_NEW_TAG));
+    TEST_ASSERT_FALSE(e->ipv4.dirty);
+    TEST_ASSERT_EQUAL_INT(FQDN_ENTRY_SUCCESS, e->state);
+
+    fqdn_ut_cleanup();
+}
+
+#endif /* CONFIG_LIBEVX_USE_CARES */
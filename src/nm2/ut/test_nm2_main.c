@@ -49,6 +49,12 @@ int main(void)
     RUN_TEST(test_bridge_port_second);
     RUN_TEST(test_interface_table);
     RUN_TEST(test_wifi_inet_table);
+#ifdef CONFIG_LIBEVX_USE_CARES
+    RUN_TEST(test_fqdn_heap_order);
+    RUN_TEST(test_fqdn_inflight_window);
+    RUN_TEST(test_fqdn_tag_batch_flush);
+    RUN_TEST(test_fqdn_tag_write_failed);
+#endif
 
     return ut_fini();
 }
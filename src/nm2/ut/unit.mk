@@ -30,6 +30,7 @@ UNIT_TYPE := TEST_BIN
 UNIT_SRC := test_nm2_main.c
 UNIT_SRC += test_nm2_mac_tags.c
 UNIT_SRC += test_nm2_native_bridge.c
+UNIT_SRC += test_nm2_fqdn.c
 
 UNIT_SRC    += ../src/nm2_dhcp_lease.c
 UNIT_SRC    += ../src/nm2_dhcp_option.c
@@ -77,3 +78,4 @@ UNIT_DEPS += src/lib/unity
 UNIT_DEPS += src/lib/unit_test_utils
 UNIT_DEPS += src/lib/os_fdbuf
 UNIT_DEPS += src/lib/ovsdb_bridge
+UNIT_DEPS += src/lib/ds_util
@@ -33,6 +33,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <memutil.h>
 #include <util.h>
 #include "log.h"
+#include "procfs_sample.h"
 
 /* These numbers identify the amount of time the CPU has spent performing different kinds of work
  * Time units are in USER_HZ or Jiffies (typically hundredths of a second).
@@ -74,7 +75,8 @@ struct pm_hw_acc_load_cpuload
 /* Faster than strstr() */
 static bool starts_with_cpu(const char *str)
 {
-    return ((str[0] - 'c') | (str[1] - 'p') | (str[2] - 'u')) == 0;
+    /* Stop at the terminating nul of short lines */
+    return str[0] == 'c' && str[1] == 'p' && str[2] == 'u';
 }
 
 /*
@@ -138,7 +140,9 @@ struct pm_hw_acc_load_cpustats *pm_hw_acc_load_cpustats_get_from_str(char *lines
 
 struct pm_hw_acc_load_cpustats *pm_hw_acc_load_cpustats_get(const size_t cpu_init)
 {
-    return pm_hw_acc_load_cpustats_get_from_str(file_geta("/proc/stat"), cpu_init);
+    /* The parser tokenizes in place, work on a stack copy of the shared sample */
+    const char *lines = procfs_sample_read("/proc/stat", NULL);
+    return pm_hw_acc_load_cpustats_get_from_str(lines ? strdupa(lines) : NULL, cpu_init);
 }
 
 void pm_hw_acc_load_cpustats_drop(struct pm_hw_acc_load_cpustats *cpu)
@@ -193,24 +197,8 @@ void pm_hw_acc_load_cpustats_compare(
 
 static size_t pm_hw_acc_load_cpustats_get_cpu_count(void)
 {
-    size_t proc_nr = 0;
-    char *line;
-    char *file = file_geta("/proc/stat");
-    if (file == NULL) return 0;
-
-    while ((line = strsep(&file, "\n")) != NULL)
-    {
-        if (!starts_with_cpu(line)) continue;
-        if (line[3] != ' ')
-        {
-            size_t num;
-            if (sscanf(line + 3, "%zu", &num) == 1 && num > proc_nr)
-            {
-                proc_nr = num;
-            }
-        }
-    }
-    return proc_nr + 1;
+    const int cpu_count = procfs_cpu_count();
+    return (cpu_count > 0) ? (size_t)cpu_count : 0;
 }
 
 size_t pm_hw_acc_load_cpustats_get_len(struct pm_hw_acc_load_cpustats *cpu)
@@ -27,16 +27,29 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "pm_hw_acc_load_netstats.h"
 
 #include <string.h>
+#include <errno.h>
 
 #include <memutil.h>
 #include <util.h>
 #include <ds_tree.h>
+#include <log.h>
+#include "procfs_sample.h"
+#include "rtnl_stats.h"
+
+/* Netdevs read over rtnetlink are keyed by ifindex, the
+ * /proc/net/dev fallback only knows names (ifindex 0).
+ */
+struct pm_hw_acc_load_netstats_key
+{
+    int ifindex;
+    char *if_name;
+};
 
 struct pm_hw_acc_load_netstats_netdev
 {
     ds_tree_node_t node;
     struct pm_hw_acc_load_netstats *stats;
-    char *if_name;
+    struct pm_hw_acc_load_netstats_key key;
     uint64_t tx_bytes;
     uint64_t rx_bytes;
     uint64_t tx_pkts;
@@ -48,29 +61,41 @@ struct pm_hw_acc_load_netstats
     ds_tree_t netdevs;
 };
 
+static int pm_hw_acc_load_netstats_key_cmp(const void *a, const void *b)
+{
+    const struct pm_hw_acc_load_netstats_key *x = a;
+    const struct pm_hw_acc_load_netstats_key *y = b;
+    if (x->ifindex != y->ifindex) return x->ifindex < y->ifindex ? -1 : 1;
+    return strcmp(x->if_name ?: "", y->if_name ?: "");
+}
+
 static struct pm_hw_acc_load_netstats_netdev *pm_hw_acc_load_netstats_netdev_alloc(
         struct pm_hw_acc_load_netstats *stats,
+        int ifindex,
         const char *if_name)
 {
     struct pm_hw_acc_load_netstats_netdev *netdev = CALLOC(1, sizeof(*netdev));
-    netdev->if_name = STRDUP(if_name);
+    netdev->key.ifindex = ifindex;
+    netdev->key.if_name = if_name ? STRDUP(if_name) : NULL;
     netdev->stats = stats;
-    ds_tree_insert(&stats->netdevs, netdev, netdev->if_name);
+    ds_tree_insert(&stats->netdevs, netdev, &netdev->key);
     return netdev;
 }
 
 static struct pm_hw_acc_load_netstats_netdev *pm_hw_acc_load_netstats_netdev_get(
         struct pm_hw_acc_load_netstats *stats,
+        int ifindex,
         const char *if_name)
 {
-    return ds_tree_find(&stats->netdevs, if_name) ?: pm_hw_acc_load_netstats_netdev_alloc(stats, if_name);
+    struct pm_hw_acc_load_netstats_key key = {.ifindex = ifindex, .if_name = (char *)if_name};
+    return ds_tree_find(&stats->netdevs, &key) ?: pm_hw_acc_load_netstats_netdev_alloc(stats, ifindex, if_name);
 }
 
 static void pm_hw_acc_load_netstats_netdev_drop(struct pm_hw_acc_load_netstats_netdev *netdev)
 {
     if (netdev == NULL) return;
     ds_tree_remove(&netdev->stats->netdevs, netdev);
-    FREE(netdev->if_name);
+    FREE(netdev->key.if_name);
     FREE(netdev);
 }
 
@@ -92,7 +117,7 @@ static void pm_hw_acc_load_netstats_parse(struct pm_hw_acc_load_netstats *stats,
         if (if_name == NULL) continue;
         if (if_name[0] == '\0') continue;
 
-        struct pm_hw_acc_load_netstats_netdev *netdev = pm_hw_acc_load_netstats_netdev_get(stats, if_name);
+        struct pm_hw_acc_load_netstats_netdev *netdev = pm_hw_acc_load_netstats_netdev_get(stats, 0, if_name);
         if (netdev == NULL) continue;
 
         const char *rx_bytes = strtok_r(NULL, " \t", &tmp);
@@ -139,17 +164,45 @@ static void pm_hw_acc_load_netstats_parse(struct pm_hw_acc_load_netstats *stats,
     }
 }
 
-struct pm_hw_acc_load_netstats *pm_hw_acc_load_netstats_get_from_str(char *lines)
+static struct pm_hw_acc_load_netstats *pm_hw_acc_load_netstats_alloc(void)
 {
     struct pm_hw_acc_load_netstats *stats = CALLOC(1, sizeof(*stats));
-    ds_tree_init(&stats->netdevs, ds_str_cmp, struct pm_hw_acc_load_netstats_netdev, node);
+    ds_tree_init(&stats->netdevs, pm_hw_acc_load_netstats_key_cmp, struct pm_hw_acc_load_netstats_netdev, node);
+    return stats;
+}
+
+static void pm_hw_acc_load_netstats_link_fn(void *ctx, const struct rtnl_stats_link *link)
+{
+    struct pm_hw_acc_load_netstats *stats = ctx;
+    struct pm_hw_acc_load_netstats_netdev *netdev =
+            pm_hw_acc_load_netstats_netdev_get(stats, link->rl_ifindex, NULL);
+    netdev->tx_bytes = link->rl_stats.tx_bytes;
+    netdev->rx_bytes = link->rl_stats.rx_bytes;
+    netdev->tx_pkts = link->rl_stats.tx_packets;
+    netdev->rx_pkts = link->rl_stats.rx_packets;
+}
+
+struct pm_hw_acc_load_netstats *pm_hw_acc_load_netstats_get_from_str(char *lines)
+{
+    struct pm_hw_acc_load_netstats *stats = pm_hw_acc_load_netstats_alloc();
     pm_hw_acc_load_netstats_parse(stats, lines);
     return stats;
 }
 
 struct pm_hw_acc_load_netstats *pm_hw_acc_load_netstats_get(void)
 {
-    return pm_hw_acc_load_netstats_get_from_str(file_geta("/proc/net/dev"));
+    struct pm_hw_acc_load_netstats *stats = pm_hw_acc_load_netstats_alloc();
+    if (rtnl_stats_get(NULL, 0, 0, pm_hw_acc_load_netstats_link_fn, stats)) return stats;
+
+    if (errno != EOPNOTSUPP)
+    {
+        LOGD("%s: rtnetlink stats dump failed (errno=%d), falling back to /proc/net/dev", __func__, errno);
+    }
+    pm_hw_acc_load_netstats_drop(stats);
+
+    /* The parser tokenizes in place, work on a stack copy of the shared sample */
+    const char *lines = procfs_sample_read("/proc/net/dev", NULL);
+    return pm_hw_acc_load_netstats_get_from_str(lines ? strdupa(lines) : NULL);
 }
 
 void pm_hw_acc_load_netstats_drop(struct pm_hw_acc_load_netstats *stats)
@@ -181,7 +234,7 @@ void pm_hw_acc_load_netstats_compare(
     ds_tree_foreach (((ds_tree_t *)&next_stats->netdevs), next_netdev)
     {
         const struct pm_hw_acc_load_netstats_netdev *prev_netdev =
-                ds_tree_find((ds_tree_t *)&prev_stats->netdevs, next_netdev->if_name);
+                ds_tree_find((ds_tree_t *)&prev_stats->netdevs, &next_netdev->key);
         if (prev_netdev == NULL) continue;
 
         const uint64_t tx_bytes = next_netdev->tx_bytes - prev_netdev->tx_bytes;
@@ -189,20 +242,14 @@ void pm_hw_acc_load_netstats_compare(
         const uint64_t tx_pkts = next_netdev->tx_pkts - prev_netdev->tx_pkts;
         const uint64_t rx_pkts = next_netdev->rx_pkts - prev_netdev->rx_pkts;
 
-        /* If an interface is re-created it can underflow
-         * into a very large number. Ignore very large
-         * deltas. It's unlikely the compared values will
-         * ever be far apart enough to amount to such big
-         * deltas.
-         *
-         * This is a result of not being able to tell
-         * ifindex had changed when parsing /proc/net/dev.
-         * ifindex would guarantee matching statistics, but
-         * that would require changing how stats are
-         * acquired.
-         *
-         * The /proc/net/dev seems good enough for the case
-         * this is used in.
+        /* Netdevs read over rtnetlink are matched by
+         * ifindex so a re-created interface never pairs
+         * with its predecessor. The /proc/net/dev
+         * fallback can only match by name, where a
+         * re-created interface can underflow into a very
+         * large number. Ignore very large deltas. It's
+         * unlikely the compared values will ever be far
+         * apart enough to amount to such big deltas.
          */
         const bool underflow_maybe = (tx_bytes > (UINT64_MAX / 2)) || (rx_bytes > (UINT64_MAX / 2))
                                      || (tx_pkts > (UINT64_MAX / 2)) || (rx_pkts > (UINT64_MAX / 2));
@@ -78,3 +78,5 @@ UNIT_DEPS += src/lib/ovsdb
 UNIT_DEPS += src/lib/schema
 UNIT_DEPS += src/lib/module
 UNIT_DEPS += src/lib/ff
+UNIT_DEPS += src/lib/procfs
+UNIT_DEPS += src/lib/rtnl_stats
@@ -43,5 +43,7 @@ UNIT_DEPS += src/lib/ovsdb
 UNIT_DEPS += src/lib/schema
 UNIT_DEPS += src/lib/module
 UNIT_DEPS += src/lib/ff
+UNIT_DEPS += src/lib/procfs
+UNIT_DEPS += src/lib/rtnl_stats
 UNIT_DEPS += src/lib/unity
 UNIT_DEPS += src/lib/unit_test_utils
@@ -44,6 +44,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #define PSM_DEBOUNCE_INIT_FACTOR    10.0
 
+/*
+ * Limits for a single bulk restore transaction -- maximum number of rows and
+ * maximum amount of serialized row data (in bytes)
+ */
+#define PSM_RESTORE_TRAN_ROWS       128
+#define PSM_RESTORE_TRAN_SIZE       (64 * 1024)
+
 bool psm_ovsdb_schema_init(bool monitor);
 bool psm_ovsdb_schema_column_exists(const char *table, const char *column);
 bool psm_ovsdb_schema_column_is_ephemeral(const char *table, const char *column);
@@ -31,6 +31,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "json_util.h"
 #include "log.h"
 #include "memutil.h"
+#include "os_time.h"
 #include "osp_ps.h"
 #include "ovsdb.h"
 #include "ovsdb_sync.h"
@@ -52,13 +53,15 @@ struct psm_ovsdb_row_key
  * The pr_uuid field is valid only when there's an associated table in OVSDB. A
  * row with an empty UUID is considered "orphaned" -- scheduled for deletion.
  *
- * The pr_data is valid only when there's pending data to be written to
- * persistent storage.
+ * The pr_sdata is valid only when there's pending data to be written to
+ * persistent storage. It holds the already serialized store record, which is
+ * built from the same string that was used to calculate the row key; this
+ * way each row is serialized only once.
  *
  * During a sync operation the various fields are interpreted as follows:
  *
- *  - if pr_data is not NULL, the data is written to persistent storage and
- *    and the pr_data field is freed and set to NULL
+ *  - if pr_sdata is not NULL, the data is written to persistent storage and
+ *    and the pr_sdata field is freed and set to NULL
  *  - if pr_uuid is empty it is assumed that the row was deleted from OVSDB
  *    therefore it will be removed from memory and persistent storage
  */
@@ -66,7 +69,7 @@ struct psm_ovsdb_row
 {
     struct psm_ovsdb_row_key    pr_key;             /* Row key */
     ovs_uuid_t                  pr_uuid;            /* Associated UUID */
-    json_t                     *pr_data;            /* Data to be written or NULL if none */
+    char                       *pr_sdata;           /* Serialized data to be written or NULL if none */
     ds_tree_node_t              pr_uuid_tnode;
     ds_tree_node_t              pr_key_tnode;
 };
@@ -75,10 +78,16 @@ static bool psm_ovsdb_row_store_load(void);
 static ev_debounce_fn_t psm_ovsdb_row_sync;
 static ds_key_cmp_t psm_ovsdb_row_key_cmp;
 static const char *psm_ovsdb_row_key_str(struct psm_ovsdb_row_key *rk);
-static void psm_ovsdb_row_key_from_json(struct psm_ovsdb_row_key *key, const char *table, json_t *row);
+static void psm_ovsdb_row_key_from_json(
+        struct psm_ovsdb_row_key *key,
+        const char *table,
+        json_t *row,
+        char **row_data);
+static char *psm_ovsdb_row_sdata(const char *table, const char *row_data);
 static bool psm_ovsdb_row_key_from_str(struct psm_ovsdb_row_key *key, const char *str);
 static bool psm_ovsdb_row_uuid_get(ovs_uuid_t *uuid, json_t *row);
 static json_t *psm_ovsdb_row_filter(const char *table, json_t *row);
+static int psm_ovsdb_row_restore_flush(json_t *tran, struct psm_ovsdb_row **prs, json_t **rows, int nrows);
 
 static ev_debounce g_psm_ovsdb_row_sync_debounce;
 
@@ -144,6 +153,7 @@ bool psm_ovsdb_row_update(const char *table, json_t *row)
     bool os_persist = false;
     bool retval = false;
     json_t *row_filtered = NULL;
+    char *row_data = NULL;
     bool do_sync = false;
 
     /* Extract the uuid from the row JSON data */
@@ -167,7 +177,7 @@ bool psm_ovsdb_row_update(const char *table, json_t *row)
     os_persist = json_is_boolean(jos_persist) && json_is_true(jos_persist);
 
     /* Calculate row key */
-    psm_ovsdb_row_key_from_json(&key, table, row_filtered);
+    psm_ovsdb_row_key_from_json(&key, table, row_filtered, &row_data);
 
     pr = ds_tree_find(&g_psm_ovsdb_row_uuid_list, &uuid);
     if (pr != NULL)
@@ -230,16 +240,14 @@ bool psm_ovsdb_row_update(const char *table, json_t *row)
     /*
      * Construct the row data, this consists of a JSON in the following format:
      * {
-     *    "table": "table_name",
-     *    "row": { row_data }
+     *    "row": { row_data },
+     *    "table": "table_name"
      * }
      *
-     * The row field is just the `row_filtered` variable, but with an acquired
-     * reference (hence the json_object_set() instead of json_object_set_new()).
+     * The row field is the serialized `row_filtered` string that was used to
+     * calculate the key, so the row is not serialized a second time.
      */
-    pr->pr_data = json_object();
-    json_object_set_new(pr->pr_data, "table", json_string(table));
-    json_object_set(pr->pr_data, "row", row_filtered);
+    pr->pr_sdata = psm_ovsdb_row_sdata(table, row_data);
 
     ds_tree_insert(&g_psm_ovsdb_row_key_list, pr, &pr->pr_key);
     ds_tree_insert(&g_psm_ovsdb_row_uuid_list, pr, &pr->pr_uuid);
@@ -253,6 +261,7 @@ exit:
         ev_debounce_start(EV_DEFAULT, &g_psm_ovsdb_row_sync_debounce);
     }
 
+    if (row_data != NULL) json_free(row_data);
     json_decref(row_filtered);
     return retval;
 }
@@ -291,9 +300,17 @@ bool psm_ovsdb_row_delete(const char *table, json_t *row)
 
 /*
  * Restore data from persistent storage to OVSDB
+ *
+ * Rows are inserted in bulk: insert operations are batched into a single
+ * OVSDB transaction until either PSM_RESTORE_TRAN_ROWS rows or
+ * PSM_RESTORE_TRAN_SIZE bytes of row data have been accumulated. This avoids
+ * a full round-trip to ovsdb-server (and a separate commit) per row, which
+ * dominates boot time with large stores.
  */
 bool psm_ovsdb_row_restore(void)
 {
+    struct psm_ovsdb_row *prs[PSM_RESTORE_TRAN_ROWS];
+    json_t *rows[PSM_RESTORE_TRAN_ROWS];
     struct psm_ovsdb_row *pr;
     json_error_t jerr;
     const char *table;
@@ -303,9 +320,15 @@ bool psm_ovsdb_row_restore(void)
     osp_ps_t *ps;
     void *inext;
     void *iter;
+    double tstart;
 
     char *sdata = NULL;
     json_t *jdata = NULL;
+    json_t *tran = NULL;
+    size_t tran_sz = 0;
+    int nrows = 0;
+    int nrestored = 0;
+    int ntotal = 0;
 
     ps = osp_ps_open(PSM_STORE, OSP_PS_PRESERVE | OSP_PS_READ);
     if (ps == NULL)
@@ -314,6 +337,8 @@ bool psm_ovsdb_row_restore(void)
         return true;
     }
 
+    tstart = clock_mono_double();
+
     ds_tree_foreach(&g_psm_ovsdb_row_key_list, pr)
     {
         /* Insert the row into OVSDB */
@@ -368,21 +393,38 @@ bool psm_ovsdb_row_restore(void)
         }
 
         /*
-         * ovsdb_sync_insert() steals the reference to jrow. This is not really
+         * ovsdb_tran_multi() steals the reference to jrow. This is not really
          * desired in this scenario since jrow is part of jdata, therefore
-         * increase the reference count by 1 to prevent stealing
+         * increase the reference count by 1 to prevent stealing. The record
+         * itself is kept in rows[] in case the batch must be retried row by
+         * row.
          */
-        json_incref(jrow);
-        if (ovsdb_sync_insert(table, jrow, &pr->pr_uuid) != 1)
+        tran = ovsdb_tran_multi(tran, NULL, table, OTR_INSERT, NULL, json_incref(jrow));
+        rows[nrows] = json_incref(jdata);
+        prs[nrows] = pr;
+        nrows++;
+        tran_sz += sdata_sz;
+        ntotal++;
+
+        if (nrows >= PSM_RESTORE_TRAN_ROWS || tran_sz >= PSM_RESTORE_TRAN_SIZE)
         {
-            memset(&pr->pr_uuid, 0, sizeof(pr->pr_uuid));
-            LOG(ERR, "Error inserting ROW into OVSDB: %s", sdata);
-            continue;
+            nrestored += psm_ovsdb_row_restore_flush(tran, prs, rows, nrows);
+            tran = NULL;
+            tran_sz = 0;
+            nrows = 0;
         }
+    }
 
-        LOG(INFO, "Restore table %s, row %s.", table, pr->pr_uuid.uuid);
+    if (nrows > 0)
+    {
+        nrestored += psm_ovsdb_row_restore_flush(tran, prs, rows, nrows);
     }
 
+    LOG(INFO, "Restored %d/%d rows in %.0f ms.",
+            nrestored,
+            ntotal,
+            (clock_mono_double() - tstart) * 1000.0);
+
     FREE(sdata);
     json_decref(jdata);
     osp_ps_close(ps);
@@ -396,6 +438,110 @@ bool psm_ovsdb_row_restore(void)
  * ===========================================================================
  */
 
+/*
+ * Send a bulk insert transaction created by psm_ovsdb_row_restore() and assign
+ * the resulting UUIDs to the rows in @p prs.
+ *
+ * OVSDB transactions are atomic, so a single bad row causes the whole batch
+ * to be rolled back. In that case fall back to inserting the rows of this
+ * batch one by one, so that only the offending rows are lost.
+ *
+ * Each element of @p rows is the store record ({"table": ..., "row": ...})
+ * of the corresponding element in @p prs. This function takes ownership of
+ * @p tran and the references in @p rows.
+ *
+ * Returns the number of successfully restored rows.
+ */
+int psm_ovsdb_row_restore_flush(json_t *tran, struct psm_ovsdb_row **prs, json_t **rows, int nrows)
+{
+    const char *table;
+    const char *suuid;
+    json_t *jresult;
+    json_t *jrow;
+    json_t *jstatus;
+    size_t idx;
+    int ii;
+
+    bool success = true;
+    int nrestored = 0;
+
+    jresult = ovsdb_method_send_s(MT_TRANS, tran);
+    if (!json_is_array(jresult))
+    {
+        LOG(ERR, "Bulk restore of %d rows failed: %s", nrows, json_dumps_static(jresult, 0));
+        success = false;
+    }
+
+    /*
+     * The result array contains one entry per operation. Skip empty objects,
+     * these belong to comment operations.
+     */
+    ii = 0;
+    for (idx = 0; success && idx < json_array_size(jresult); idx++)
+    {
+        jstatus = json_array_get(jresult, idx);
+        if (!json_is_object(jstatus) || json_object_size(jstatus) == 0) continue;
+
+        if (json_object_get(jstatus, "error") != NULL || ii >= nrows)
+        {
+            LOG(ERR, "Bulk restore of %d rows failed: %s", nrows, json_dumps_static(jstatus, 0));
+            success = false;
+            break;
+        }
+
+        suuid = json_string_value(json_array_get(json_object_get(jstatus, "uuid"), 1));
+        if (suuid == NULL)
+        {
+            LOG(ERR, "Bulk restore of %d rows: invalid result: %s", nrows, json_dumps_static(jstatus, 0));
+            success = false;
+            break;
+        }
+
+        STRSCPY(prs[ii]->pr_uuid.uuid, suuid);
+        ii++;
+    }
+
+    if (ii != nrows) success = false;
+    json_decref(jresult);
+
+    if (success)
+    {
+        nrestored = nrows;
+    }
+
+    for (ii = 0; ii < nrows; ii++)
+    {
+        if (!success)
+        {
+            table = json_string_value(json_object_get(rows[ii], "table"));
+            jrow = json_object_get(rows[ii], "row");
+
+            /* ovsdb_sync_insert() steals the reference to jrow */
+            json_incref(jrow);
+            if (ovsdb_sync_insert(table, jrow, &prs[ii]->pr_uuid))
+            {
+                nrestored++;
+            }
+            else
+            {
+                memset(&prs[ii]->pr_uuid, 0, sizeof(prs[ii]->pr_uuid));
+                LOG(ERR, "Error inserting ROW into OVSDB: %s", json_dumps_static(rows[ii], 0));
+            }
+        }
+
+        if (prs[ii]->pr_uuid.uuid[0] != '\0')
+        {
+            LOG(INFO, "Restore table %s, row %s.",
+                    json_string_value(json_object_get(rows[ii], "table")),
+                    prs[ii]->pr_uuid.uuid);
+        }
+
+        json_decref(rows[ii]);
+    }
+
+    return nrestored;
+}
+
 /*
  * Populate the row cache using data from the persistent storage. The elements
  * in the "orphaned" state until data is read from OVSDB.
@@ -444,11 +590,11 @@ bool psm_ovsdb_row_store_load(void)
  * If a row has an empty uuid, it is considered orphaned and is deleted from
  * persistent storage.
  *
- * If a row has the pr_data field set it is considered dirty. Write the data
+ * If a row has the pr_sdata field set it is considered dirty. Write the data
  * to persistent storage and free it from memory.
  *
  * After a sync operation, the memory cache will consist only of entries which
- * have valid uuids and have no associated data (pr_data).
+ * have valid uuids and have no associated data (pr_sdata).
  */
 void psm_ovsdb_row_sync(struct ev_loop *loop, ev_debounce *w, int revent)
 {
@@ -457,7 +603,6 @@ void psm_ovsdb_row_sync(struct ev_loop *loop, ev_debounce *w, int revent)
 
     ds_tree_iter_t iter;
     struct psm_ovsdb_row *pr;
-    char *strdata;
     osp_ps_t *ps;
 
     /* Reset the debounce timer values */
@@ -479,30 +624,16 @@ void psm_ovsdb_row_sync(struct ev_loop *loop, ev_debounce *w, int revent)
             osp_ps_set(ps, psm_ovsdb_row_key_str(&pr->pr_key), NULL, 0);
 
             ds_tree_iremove(&iter);
-            if (pr->pr_data != NULL)
-            {
-                json_decref(pr->pr_data);
-            }
+            FREE(pr->pr_sdata);
             FREE(pr);
         }
-        else if (pr->pr_data != NULL)
+        else if (pr->pr_sdata != NULL)
         {
-            strdata = json_dumps(
-                    pr->pr_data,
-                    JSON_COMPACT | JSON_SORT_KEYS | JSON_ENSURE_ASCII);
-            if (strdata == NULL)
-            {
-                LOG(ERR, "(sync) Error converting JSON to string for row: %s",
-                        pr->pr_uuid.uuid);
-                continue;
-            }
+            LOG(DEBUG, "ADD persistent row: %s -> %s", psm_ovsdb_row_key_str(&pr->pr_key), pr->pr_sdata);
+            osp_ps_set(ps, psm_ovsdb_row_key_str(&pr->pr_key), pr->pr_sdata, strlen(pr->pr_sdata) + 1);
 
-            LOG(DEBUG, "ADD persistent row: %s -> %s", psm_ovsdb_row_key_str(&pr->pr_key), strdata);
-            osp_ps_set(ps, psm_ovsdb_row_key_str(&pr->pr_key), strdata, strlen(strdata) + 1);
-
-            json_free(strdata);
-            json_decref(pr->pr_data);
-            pr->pr_data = NULL;
+            FREE(pr->pr_sdata);
+            pr->pr_sdata = NULL;
         }
     }
 
@@ -526,10 +657,17 @@ void psm_ovsdb_row_sync(struct ev_loop *loop, ev_debounce *w, int revent)
  * JSON_SORT_KEYS and JSON_ENSURE_ASCII flags. This seems to match the output
  * of `jq -acS` quite well and the generated string seems to be stable (both
  * jansson an jq always produce the same output given the same input).
+ *
+ * If @p prow_data is not NULL, the ROW_DATA string is returned there instead
+ * of being freed; the caller must release it with json_free().
  */
-void psm_ovsdb_row_key_from_json(struct psm_ovsdb_row_key *key, const char *table, json_t *row)
+void psm_ovsdb_row_key_from_json(
+        struct psm_ovsdb_row_key *key,
+        const char *table,
+        json_t *row,
+        char **prow_data)
 {
-    const char *row_data;
+    char *row_data;
 #if OPENSSL_VERSION_NUMBER >= 0x030000000  // 3.0.0
     EVP_MD_CTX *md_ctx = EVP_MD_CTX_create();
     const EVP_MD *md = EVP_sha256();
@@ -561,7 +699,14 @@ void psm_ovsdb_row_key_from_json(struct psm_ovsdb_row_key *key, const char *tabl
 
     SHA256_Final(sha_buf, &sha_ctx);
 #endif
-    json_memdbg_free((void *)row_data);
+    if (prow_data != NULL)
+    {
+        *prow_data = row_data;
+    }
+    else
+    {
+        json_free(row_data);
+    }
 
     bin2hex(sha_buf, sizeof(sha_buf), key->rk_key, sizeof(key->rk_key));
 }
@@ -589,6 +734,40 @@ const char *psm_ovsdb_row_key_str(struct psm_ovsdb_row_key *rk)
     return rk->rk_key;
 }
 
+/*
+ * Build the store record for a row from the serialized row data.
+ *
+ * The result is equivalent to dumping {"table": table, "row": row} with
+ * JSON_COMPACT | JSON_SORT_KEYS | JSON_ENSURE_ASCII, but reuses the string
+ * that was already generated for the key calculation. The returned string
+ * must be freed with FREE().
+ */
+char *psm_ovsdb_row_sdata(const char *table, const char *row_data)
+{
+    char *sdata;
+    char *stable;
+    size_t sz;
+    json_t *jtable;
+
+    if (row_data == NULL) return NULL;
+
+    jtable = json_string(table);
+    stable = json_dumps(jtable, JSON_ENCODE_ANY | JSON_COMPACT | JSON_ENSURE_ASCII);
+    json_decref(jtable);
+    if (stable == NULL)
+    {
+        LOG(ERR, "Error serializing table name: %s", table);
+        return NULL;
+    }
+
+    sz = strlen("{\"row\":,\"table\":}") + strlen(row_data) + strlen(stable) + 1;
+    sdata = MALLOC(sz);
+    snprintf(sdata, sz, "{\"row\":%s,\"table\":%s}", row_data, stable);
+    json_free(stable);
+
+    return sdata;
+}
+
 /*
  * ===========================================================================
  *  Utility functions
@@ -0,0 +1,310 @@
+/*
+Copyright (c) 2015, Plume Design Inc. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+   1. Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+   3. Neither the name of the Plume Design Inc. nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL Plume Design Inc. BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+/*
+ * The persistent store and the OVSDB transactions are replaced by the fakes
+ * below, which are declared by the headers under these names.
+ */
+#define osp_ps_open             test_psm_ps_open
+#define osp_ps_get              test_psm_ps_get
+#define osp_ps_close            test_psm_ps_close
+#define ovsdb_method_send_s     test_psm_method_send_s
+#define ovsdb_sync_insert       test_psm_sync_insert
+
+#include "unity.h"
+#include "unit_test_utils.h"
+
+// Include the file to be unit tested
+#include "psm_ovsdb_row.c"
+
+#define PSM_UT_MAX_ROWS     (PSM_RESTORE_TRAN_ROWS + 8)
+
+static const char *test_name = "psm_tests";
+
+static struct
+{
+    bool store_exists;
+    char *data[PSM_UT_MAX_ROWS];        /* store record of each row */
+    struct psm_ovsdb_row *rows[PSM_UT_MAX_ROWS];
+    int nrows;
+    int ntrans;                         /* bulk transactions sent */
+    int ninserts;                       /* single row insertions */
+    int max_tran_rows;                  /* largest bulk transaction */
+    int next_uuid;
+} g_psm_ut;
+
+osp_ps_t *test_psm_ps_open(const char *store, int flags)
+{
+    static int ps;
+
+    if (!g_psm_ut.store_exists) return NULL;
+
+    return (osp_ps_t *)&ps;
+}
+
+bool test_psm_ps_close(osp_ps_t *ps)
+{
+    return true;
+}
+
+ssize_t test_psm_ps_get(osp_ps_t *ps, const char *key, void *value, size_t value_sz)
+{
+    size_t len;
+    int ii;
+
+    for (ii = 0; ii < g_psm_ut.nrows; ii++)
+    {
+        if (strcmp(g_psm_ut.rows[ii]->pr_key.rk_key, key) != 0) continue;
+
+        /* Records are stored with the terminating NUL */
+        len = strlen(g_psm_ut.data[ii]) + 1;
+        if (value != NULL) memcpy(value, g_psm_ut.data[ii], len < value_sz ? len : value_sz);
+
+        return len;
+    }
+
+    return -1;
+}
+
+/* A row is rejected by OVSDB if it carries a "fail" column */
+static bool test_psm_row_fails(json_t *row)
+{
+    return json_object_get(row, "fail") != NULL;
+}
+
+static json_t *test_psm_uuid(void)
+{
+    char uuid[64];
+
+    snprintf(uuid, sizeof(uuid), "00000000-0000-0000-0000-%012d", ++g_psm_ut.next_uuid);
+
+    return json_pack("[s, s]", "uuid", uuid);
+}
+
+json_t *test_psm_method_send_s(ovsdb_mt_t mt, json_t *jparams)
+{
+    json_t *jresult;
+    json_t *op;
+    size_t idx;
+    int nrows;
+
+    g_psm_ut.ntrans++;
+
+    /* The first element is the database name */
+    jresult = json_array();
+    nrows = 0;
+    json_array_foreach(jparams, idx, op)
+    {
+        if (!json_is_object(op)) continue;
+
+        TEST_ASSERT_EQUAL_STRING("insert", json_string_value(json_object_get(op, "op")));
+        nrows++;
+
+        /* The transaction is rolled back on the first error */
+        if (test_psm_row_fails(json_object_get(op, "row")))
+        {
+            json_array_append_new(jresult, json_pack("{s:s}", "error", "constraint violation"));
+            break;
+        }
+        json_array_append_new(jresult, json_pack("{s:o}", "uuid", test_psm_uuid()));
+    }
+
+    if (nrows > g_psm_ut.max_tran_rows) g_psm_ut.max_tran_rows = nrows;
+    json_decref(jparams);
+
+    return jresult;
+}
+
+bool test_psm_sync_insert(const char *table, json_t *row, ovs_uuid_t *uuid)
+{
+    json_t *juuid;
+    bool rc;
+
+    g_psm_ut.ninserts++;
+
+    rc = !test_psm_row_fails(row);
+    if (rc)
+    {
+        juuid = test_psm_uuid();
+        STRSCPY(uuid->uuid, json_string_value(json_array_get(juuid, 1)));
+        json_decref(juuid);
+    }
+    json_decref(row);
+
+    return rc;
+}
+
+bool psm_ovsdb_schema_column_exists(const char *table, const char *column)
+{
+    return strcmp(column, "obsolete") != 0;
+}
+
+bool psm_ovsdb_schema_column_is_ephemeral(const char *table, const char *column)
+{
+    return false;
+}
+
+/* Add a row to the store, as loaded by psm_ovsdb_row_store_load() */
+static struct psm_ovsdb_row *psm_ut_row_add(const char *data)
+{
+    struct psm_ovsdb_row *pr;
+    int ii;
+
+    ii = g_psm_ut.nrows;
+    TEST_ASSERT_TRUE(ii < PSM_UT_MAX_ROWS);
+
+    pr = CALLOC(1, sizeof(*pr));
+    snprintf(pr->pr_key.rk_key, sizeof(pr->pr_key.rk_key), "%064x", ii);
+    ds_tree_insert(&g_psm_ovsdb_row_key_list, pr, &pr->pr_key);
+
+    g_psm_ut.rows[ii] = pr;
+    g_psm_ut.data[ii] = STRDUP(data);
+    g_psm_ut.nrows++;
+
+    return pr;
+}
+
+void psm_ut_setUp(void)
+{
+    memset(&g_psm_ut, 0, sizeof(g_psm_ut));
+    g_psm_ut.store_exists = true;
+}
+
+void psm_ut_tearDown(void)
+{
+    int ii;
+
+    for (ii = 0; ii < g_psm_ut.nrows; ii++)
+    {
+        ds_tree_remove(&g_psm_ovsdb_row_key_list, g_psm_ut.rows[ii]);
+        FREE(g_psm_ut.rows[ii]);
+        FREE(g_psm_ut.data[ii]);
+    }
+    g_psm_ut.nrows = 0;
+}
+
+/*
+ * Nothing is sent when there is no store, or no row in it
+ */
+void test_psm_restore_empty(void)
+{
+    g_psm_ut.store_exists = false;
+    TEST_ASSERT_TRUE(psm_ovsdb_row_restore());
+    TEST_ASSERT_EQUAL_INT(0, g_psm_ut.ntrans);
+
+    g_psm_ut.store_exists = true;
+    TEST_ASSERT_TRUE(psm_ovsdb_row_restore());
+    TEST_ASSERT_EQUAL_INT(0, g_psm_ut.ntrans);
+    TEST_ASSERT_EQUAL_INT(0, g_psm_ut.ninserts);
+}
+
+/*
+ * Several rows are restored in a single transaction
+ */
+void test_psm_restore_bulk(void)
+{
+    struct psm_ovsdb_row *pr[3];
+    int ii;
+
+    pr[0] = psm_ut_row_add("{\"table\": \"Node_Config\", \"row\": {\"key\": \"a\"}}");
+    pr[1] = psm_ut_row_add("{\"table\": \"Node_Config\", \"row\": {\"key\": \"b\", \"obsolete\": 1}}");
+    pr[2] = psm_ut_row_add("{\"table\": \"Node_State\", \"row\": {\"key\": \"c\"}}");
+
+    TEST_ASSERT_TRUE(psm_ovsdb_row_restore());
+    TEST_ASSERT_EQUAL_INT(1, g_psm_ut.ntrans);
+    TEST_ASSERT_EQUAL_INT(3, g_psm_ut.max_tran_rows);
+    TEST_ASSERT_EQUAL_INT(0, g_psm_ut.ninserts);
+
+    for (ii = 0; ii < 3; ii++)
+    {
+        TEST_ASSERT_TRUE(pr[ii]->pr_uuid.uuid[0] != '\0');
+    }
+    TEST_ASSERT_TRUE(strcmp(pr[0]->pr_uuid.uuid, pr[1]->pr_uuid.uuid) != 0);
+}
+
+/*
+ * A rejected batch is retried row by row, only the bad rows are lost
+ */
+void test_psm_restore_partial_failure(void)
+{
+    struct psm_ovsdb_row *pr[3];
+
+    pr[0] = psm_ut_row_add("{\"table\": \"Node_Config\", \"row\": {\"key\": \"a\"}}");
+    pr[1] = psm_ut_row_add("{\"table\": \"Node_Config\", \"row\": {\"key\": \"b\", \"fail\": true}}");
+    pr[2] = psm_ut_row_add("{\"table\": \"Node_Config\", \"row\": {\"key\": \"c\"}}");
+
+    /* Not a valid record, it is skipped */
+    psm_ut_row_add("{\"table\": \"Node_Config\"}");
+
+    TEST_ASSERT_TRUE(psm_ovsdb_row_restore());
+    TEST_ASSERT_EQUAL_INT(1, g_psm_ut.ntrans);
+    TEST_ASSERT_EQUAL_INT(3, g_psm_ut.ninserts);
+
+    TEST_ASSERT_TRUE(pr[0]->pr_uuid.uuid[0] != '\0');
+    TEST_ASSERT_EQUAL_STRING("", pr[1]->pr_uuid.uuid);
+    TEST_ASSERT_TRUE(pr[2]->pr_uuid.uuid[0] != '\0');
+}
+
+/*
+ * Transactions are bounded by PSM_RESTORE_TRAN_ROWS rows
+ */
+void test_psm_restore_batches(void)
+{
+    int ii;
+
+    for (ii = 0; ii < PSM_RESTORE_TRAN_ROWS + 1; ii++)
+    {
+        psm_ut_row_add("{\"table\": \"Node_Config\", \"row\": {\"key\": \"a\"}}");
+    }
+
+    TEST_ASSERT_TRUE(psm_ovsdb_row_restore());
+    TEST_ASSERT_EQUAL_INT(2, g_psm_ut.ntrans);
+    TEST_ASSERT_EQUAL_INT(PSM_RESTORE_TRAN_ROWS, g_psm_ut.max_tran_rows);
+    TEST_ASSERT_EQUAL_INT(0, g_psm_ut.ninserts);
+
+    for (ii = 0; ii < g_psm_ut.nrows; ii++)
+    {
+        TEST_ASSERT_TRUE(g_psm_ut.rows[ii]->pr_uuid.uuid[0] != '\0');
+    }
+}
+
+int main(void)
+{
+    ut_init(test_name, NULL, NULL);
+    ut_setUp_tearDown(test_name, psm_ut_setUp, psm_ut_tearDown);
+
+    RUN_TEST(test_psm_restore_empty);
+    RUN_TEST(test_psm_restore_bulk);
+    RUN_TEST(test_psm_restore_partial_failure);
+    RUN_TEST(test_psm_restore_batches);
+
+    return ut_fini();
+}
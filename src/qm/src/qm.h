@@ -63,6 +63,7 @@ typedef struct qm_stats
     int sent;
     int64_t bytes;
     int errors;
+    int dropped;    // messages dropped when put back in a full queue
     int runtime;
 } qm_stats_t;
 
@@ -94,6 +95,7 @@ int qm_queue_size();
 bool qm_queue_head(qm_item_t **qitem);
 bool qm_queue_tail(qm_item_t **qitem);
 bool qm_queue_remove(qm_item_t *qitem);
+bool qm_queue_push_head(qm_item_t *qitem);
 bool qm_queue_drop_head();
 bool qm_queue_make_room(qm_item_t *qi, qm_response_t *res);
 bool qm_queue_put(qm_item_t **qitem, qm_response_t *res);
@@ -39,6 +39,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "opensync_stats.pb-c.h"
 #include "memutil.h"
 #include "util.h"
+#include "kconfig.h"
 
 #include "qm.h"
 
@@ -54,6 +55,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define QM_PM_STRING_LENGTH     1025 /* power mode string length */
                                      /* max length defined in schema */
 
+#if !defined(CONFIG_MANAGER_QM_MQTT_INFLIGHT)
+#define CONFIG_MANAGER_QM_MQTT_INFLIGHT 8
+#endif
+
 /* Global MQTT instance */
 static mosqev_t         qm_mqtt;
 static bool             qm_mosquitto_init = false;
@@ -73,6 +78,7 @@ static int              qm_log_interval = 0; // 0 = disabled
 static int              qm_agg_stats_interval = STATS_MQTT_INTERVAL;
 static char             qm_power_mode[QM_PM_STRING_LENGTH];
 static bool             qm_has_power_mode;
+static bool             qm_mqtt_publishing = false;
 bool                    qm_log_enabled = false;
 qm_stats_t              g_qm_stats;
 
@@ -192,7 +198,8 @@ void qm_mqtt_stop(void)
     LOG(NOTICE, "Closing MQTT connection.");
 }
 
-bool qm_mqtt_publish(mosqev_t *mqtt, qm_item_t *qi)
+static bool qm_mqtt_publish_item(mosqev_t *mqtt, qm_item_t *qi,
+        mosqev_publish_done_cbk_t *cbk, void *ctx)
 {
     long mlen = qi->size;
     void *mbuf = qi->buf;
@@ -231,6 +238,7 @@ bool qm_mqtt_publish(mosqev_t *mqtt, qm_item_t *qi)
         if (ret != Z_OK)
         {
             LOGE("DPP: compression error %d", ret);
+            ret = false;
             goto exit;
         }
         LOGD("DPP: Publishing uncompressed: %ld compressed: %ld reduction: %d%%",
@@ -239,7 +247,7 @@ bool qm_mqtt_publish(mosqev_t *mqtt, qm_item_t *qi)
         mbuf = buf;
     }
     LOGI("MQTT: Publishing (%d) %ld bytes '%s'", (int)qi->size, mlen, topic);
-    ret = mosqev_publish(mqtt, NULL, topic, mlen, mbuf, qos, false);
+    ret = mosqev_publish_async(mqtt, NULL, topic, mlen, mbuf, qos, false, cbk, ctx);
     if (ret) {
         g_qm_stats.sent++;
         g_qm_stats.bytes += mlen;
@@ -251,6 +259,11 @@ exit:
     return ret;
 }
 
+bool qm_mqtt_publish(mosqev_t *mqtt, qm_item_t *qi)
+{
+    return qm_mqtt_publish_item(mqtt, qi, NULL, NULL);
+}
+
 bool qm_mqtt_send_message(qm_item_t *qi, qm_response_t *res)
 {
     bool result;
@@ -377,6 +390,67 @@ void qm_queue_merge_stats(qm_item_t *rep)
     }
 }
 
+static void qm_mqtt_publish_pending(mosqev_t *mqtt);
+
+// put a message that was not published back in front of the queue
+static void qm_mqtt_requeue(qm_item_t *qi)
+{
+    size_t size = qi->size;
+
+    if (!qm_queue_push_head(qi)) {
+        g_qm_stats.dropped++;
+        LOGW("MQTT: Queue full, message of %zu bytes dropped (total dropped: %d)",
+                size, g_qm_stats.dropped);
+    }
+}
+
+// completion of a queued message: free it, or put it back in front of the queue
+static void qm_mqtt_publish_done(mosqev_t *mqtt, void *ctx, int result)
+{
+    qm_item_t *qi = ctx;
+
+    if (result == MOSQ_ERR_SUCCESS) {
+        qm_queue_item_free(qi);
+        // a slot was freed in the in-flight window
+        if (qm_mqtt_is_connected()) qm_mqtt_publish_pending(mqtt);
+        return;
+    }
+
+    LOGW("MQTT: Publish of %zu bytes not completed: %s", qi->size, mosquitto_strerror(result));
+    g_qm_stats.errors++;
+    qm_mqtt_requeue(qi);
+}
+
+// publish queued messages, keeping up to the in-flight window of them
+// in flight; messages leave the queue while in flight
+static void qm_mqtt_publish_pending(mosqev_t *mqtt)
+{
+    ds_dlist_t failed;
+    qm_item_t *qi;
+
+    // the loop already refills the window
+    if (qm_mqtt_publishing) return;
+    qm_mqtt_publishing = true;
+
+    ds_dlist_init(&failed, qm_item_t, qnode);
+    while (mosqev_inflight_avail(mqtt) > 0 && qm_queue_get(&qi))
+    {
+        // qi may be completed and freed before this returns
+        if (!qm_mqtt_publish_item(mqtt, qi, qm_mqtt_publish_done, qi)) {
+            LOGE("Publish message failed.\n");
+            ds_dlist_insert_tail(&failed, qi);
+        }
+    }
+
+    // keep messages that failed in front, in order
+    while ((qi = ds_dlist_remove_tail(&failed)) != NULL)
+    {
+        qm_mqtt_requeue(qi);
+    }
+
+    qm_mqtt_publishing = false;
+}
+
 void qm_mqtt_publish_queue()
 {
     mosqev_t *mqtt = &qm_mqtt;
@@ -384,30 +458,19 @@ void qm_mqtt_publish_queue()
     LOGD("total %d elements queued for transmission.\n", qm_queue_length());
 
     qm_item_t  rep;
-    qm_item_t *qi = NULL;
-    qm_item_t *next = NULL;
 
     memset(&rep, 0, sizeof(rep));
     qm_queue_merge_stats(&rep);
-    // publish merged reports
+    // publish merged reports first, outside of the queue and of the
+    // in-flight window: the message is copied, the report can be freed
     if (rep.size) {
         if (!qm_mqtt_publish(mqtt, &rep)) {
             LOGE("Publish report failed.\n");
         }
-        // free
         qm_queue_item_free_buf(&rep);
     }
 
-    // publish the rest of messages
-    for (qi = ds_dlist_head(&g_qm_queue.queue); qi != NULL; qi = next)
-    {
-        next = ds_dlist_next(&g_qm_queue.queue, qi);
-        if (qm_mqtt_publish(mqtt, qi)) {
-            qm_queue_remove(qi);
-        } else {
-            LOGE("Publish message failed.\n");
-        }
-    }
+    qm_mqtt_publish_pending(mqtt);
 }
 
 void qm_mqtt_reconnect()
@@ -586,6 +649,9 @@ bool qm_mqtt_init(void)
     /* Initialize logging */
     mosqev_log_cbk_set(&qm_mqtt, qm_mqtt_log);
 
+    /* Keep several reports in flight on high latency uplinks */
+    mosqev_inflight_max_set(&qm_mqtt, CONFIG_MANAGER_QM_MQTT_INFLIGHT);
+
     qm_mosqev_init = true;
 
     // publish timer
@@ -101,6 +101,21 @@ bool qm_queue_remove(qm_item_t *qitem)
     return true;
 }
 
+// put back an item taken with qm_queue_get(), unless the queue is full
+bool qm_queue_push_head(qm_item_t *qitem)
+{
+    if (g_qm_queue.length >= QM_MAX_QUEUE_DEPTH
+            || g_qm_queue.size + qitem->size > QM_MAX_QUEUE_SIZE_BYTES)
+    {
+        qm_queue_item_free(qitem);
+        return false;
+    }
+    ds_dlist_insert_head(&g_qm_queue.queue, qitem);
+    g_qm_queue.length++;
+    g_qm_queue.size += qitem->size;
+    return true;
+}
+
 bool qm_queue_drop_head()
 {
     qm_item_t *qitem;